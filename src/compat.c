@@ -7,6 +7,7 @@
  */
 
 #include "compat.h"
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -76,8 +77,104 @@ get_temp_dir(void) {
   return tmpdir;
 }
 
+/*
+ * Get cache directory for Windows: %LOCALAPPDATA%\radfu
+ */
+int
+get_cache_dir(char *buf, size_t len) {
+  const char *base = getenv("LOCALAPPDATA");
+  if (base == NULL || base[0] == '\0')
+    return -1;
+
+  int n = snprintf(buf, len, "%s\\radfu", base);
+  if (n < 0 || (size_t)n >= len)
+    return -1;
+  if (_mkdir(buf) < 0 && errno != EEXIST)
+    return -1;
+  return 0;
+}
+
+/*
+ * Read-only file mapping for Windows
+ */
+void *
+map_file(const char *path, size_t *len_out) {
+  HANDLE f = CreateFileA(
+      path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (f == INVALID_HANDLE_VALUE) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(f, &size) || size.QuadPart == 0 || (uint64_t)size.QuadPart > SIZE_MAX) {
+    CloseHandle(f);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(f);
+  if (m == NULL) {
+    errno = EIO;
+    return NULL;
+  }
+
+  void *addr = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(m);
+  if (addr == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  *len_out = (size_t)size.QuadPart;
+  return addr;
+}
+
+void
+unmap_file(void *addr, size_t len) {
+  (void)len;
+  if (addr != NULL)
+    UnmapViewOfFile(addr);
+}
+
+int
+make_dir(const char *path) {
+  if (_mkdir(path) < 0 && errno != EEXIST)
+    return -1;
+  return 0;
+}
+
+int
+list_dir(const char *path, int (*fn)(const char *name, void *arg), void *arg) {
+  char pattern[MAX_PATH];
+  WIN32_FIND_DATAA fd;
+
+  int n = snprintf(pattern, sizeof(pattern), "%s\\*", path);
+  if (n < 0 || (size_t)n >= sizeof(pattern))
+    return -1;
+
+  HANDLE h = FindFirstFileA(pattern, &fd);
+  if (h == INVALID_HANDLE_VALUE)
+    return GetLastError() == ERROR_FILE_NOT_FOUND ? 0 : -1;
+
+  int ret = 0;
+  do {
+    if (strcmp(fd.cFileName, ".") == 0 || strcmp(fd.cFileName, "..") == 0)
+      continue;
+    ret = fn(fd.cFileName, arg);
+  } while (ret == 0 && FindNextFileA(h, &fd));
+  FindClose(h);
+  return ret;
+}
+
 #else /* POSIX */
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 /*
  * Get temp directory path for POSIX
  * Tries TMPDIR, falls back to /tmp
@@ -90,4 +187,95 @@ get_temp_dir(void) {
   return tmpdir;
 }
 
+/*
+ * Get cache directory for POSIX: $XDG_CACHE_HOME/radfu, else ~/.cache/radfu
+ * Missing parent directories are created as well.
+ */
+int
+get_cache_dir(char *buf, size_t len) {
+  const char *base = getenv("XDG_CACHE_HOME");
+  int n;
+
+  if (base != NULL && base[0] == '/')
+    n = snprintf(buf, len, "%s/radfu", base);
+  else if ((base = getenv("HOME")) != NULL && base[0] != '\0')
+    n = snprintf(buf, len, "%s/.cache/radfu", base);
+  else
+    return -1;
+  if (n < 0 || (size_t)n >= len)
+    return -1;
+
+  for (char *p = buf + 1; *p != '\0'; p++) {
+    if (*p != '/')
+      continue;
+    *p = '\0';
+    int ret = mkdir(buf, 0700);
+    *p = '/';
+    if (ret < 0 && errno != EEXIST)
+      return -1;
+  }
+  if (mkdir(buf, 0700) < 0 && errno != EEXIST)
+    return -1;
+  return 0;
+}
+
+/*
+ * Read-only file mapping for POSIX
+ */
+void *
+map_file(const char *path, size_t *len_out) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return NULL;
+  }
+  if (st.st_size == 0 || (uint64_t)st.st_size > SIZE_MAX) {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    return NULL;
+
+  *len_out = (size_t)st.st_size;
+  return addr;
+}
+
+void
+unmap_file(void *addr, size_t len) {
+  if (addr != NULL)
+    munmap(addr, len);
+}
+
+int
+make_dir(const char *path) {
+  if (mkdir(path, 0700) < 0 && errno != EEXIST)
+    return -1;
+  return 0;
+}
+
+int
+list_dir(const char *path, int (*fn)(const char *name, void *arg), void *arg) {
+  DIR *d = opendir(path);
+  if (d == NULL)
+    return -1;
+
+  int ret = 0;
+  struct dirent *e;
+  while (ret == 0 && (e = readdir(d)) != NULL) {
+    if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+      continue;
+    ret = fn(e->d_name, arg);
+  }
+  closedir(d);
+  return ret;
+}
+
 #endif /* _WIN32 */
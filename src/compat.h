@@ -26,6 +26,7 @@
 #include <io.h>
 #include <process.h>
 #include <fcntl.h>
+#include <sys/utime.h>
 
 /* Type definitions */
 typedef HANDLE ra_fd_t;
@@ -43,6 +44,9 @@ typedef SSIZE_T ssize_t;
 #define write _write
 #define close _close
 #define unlink _unlink
+#define getpid _getpid
+#define utime _utime
+#define utimbuf _utimbuf
 
 /* POSIX to Windows file mode flag mappings */
 #define O_CREAT _O_CREAT
@@ -73,41 +77,6 @@ char *mkdtemp(char *tmpl);
 #include <stdarg.h>
 #include <string.h>
 
-static inline void
-warn(const char *fmt, ...) {
-  va_list ap;
-  DWORD err = GetLastError();
-  char errbuf[256];
-
-  va_start(ap, fmt);
-  vfprintf(stderr, fmt, ap);
-  va_end(ap);
-
-  FormatMessageA(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-      NULL,
-      err,
-      0,
-      errbuf,
-      sizeof(errbuf),
-      NULL);
-  size_t len = strlen(errbuf);
-  if (len > 0 && errbuf[len - 1] == '\n')
-    errbuf[--len] = '\0';
-  if (len > 0 && errbuf[len - 1] == '\r')
-    errbuf[--len] = '\0';
-
-  fprintf(stderr, ": %s\n", errbuf);
-}
-
-static inline void
-warnx(const char *fmt, ...) {
-  va_list ap;
-  va_start(ap, fmt);
-  vfprintf(stderr, fmt, ap);
-  va_end(ap);
-  fprintf(stderr, "\n");
-}
-
 static inline void
 err(int eval, const char *fmt, ...) {
   va_list ap;
@@ -154,12 +123,19 @@ errx(int eval, const char *fmt, ...) {
 #include <strings.h>
 #include <getopt.h>
 #include <err.h>
+#include <pthread.h>
+#include <utime.h>
 
 typedef int ra_fd_t;
 #define RA_INVALID_FD -1
 
 #endif /* _WIN32 */
 
+/* warn/warnx go through the message sink (ralog.h), not straight to stderr */
+#include "ralog.h"
+#define warn ra_warn
+#define warnx ra_warnx
+
 /*
  * Cross-platform functions (implemented in compat.c)
  */
@@ -167,6 +143,101 @@ typedef int ra_fd_t;
 /* Get temp directory path */
 const char *get_temp_dir(void);
 
+/*
+ * Get (and create) the radfu user cache directory
+ * XDG_CACHE_HOME or ~/.cache on POSIX, LOCALAPPDATA on Windows
+ * Returns: 0 on success, -1 if no usable location
+ */
+int get_cache_dir(char *buf, size_t len);
+
+/*
+ * Map a whole file read-only
+ * Empty files cannot be mapped (NULL, errno EINVAL).
+ * Returns: mapping (release with unmap_file), NULL on error with errno set
+ */
+void *map_file(const char *path, size_t *len_out);
+void unmap_file(void *addr, size_t len);
+
+/*
+ * Create a directory (owner access only on POSIX), an existing one is fine
+ * Returns: 0 on success, -1 on error with errno set
+ */
+int make_dir(const char *path);
+
+/*
+ * Call fn for each entry of a directory, "." and ".." excluded
+ * Stops at the first non-zero return of fn.
+ * Returns: 0 when all entries were seen, fn's value if it stopped, -1 on error
+ */
+int list_dir(const char *path, int (*fn)(const char *name, void *arg), void *arg);
+
+/*
+ * Worker threads, for commands waiting on several devices at once
+ * t must stay in place until ra_thread_join(); fn runs with arg.
+ */
+typedef struct {
+#ifdef _WIN32
+  HANDLE handle;
+#else
+  pthread_t handle;
+#endif
+  void (*fn)(void *);
+  void *arg;
+} ra_thread_t;
+
+#ifdef _WIN32
+static inline unsigned __stdcall
+ra_thread_entry(void *p) {
+  ra_thread_t *t = p;
+  t->fn(t->arg);
+  return 0;
+}
+#else
+static inline void *
+ra_thread_entry(void *p) {
+  ra_thread_t *t = p;
+  t->fn(t->arg);
+  return NULL;
+}
+#endif
+
+/* Returns: 0 on success, -1 on error */
+static inline int
+ra_thread_start(ra_thread_t *t, void (*fn)(void *), void *arg) {
+  t->fn = fn;
+  t->arg = arg;
+#ifdef _WIN32
+  t->handle = (HANDLE)_beginthreadex(NULL, 0, ra_thread_entry, t, 0, NULL);
+  return t->handle != NULL ? 0 : -1;
+#else
+  return pthread_create(&t->handle, NULL, ra_thread_entry, t) == 0 ? 0 : -1;
+#endif
+}
+
+static inline void
+ra_thread_join(ra_thread_t *t) {
+#ifdef _WIN32
+  WaitForSingleObject(t->handle, INFINITE);
+  CloseHandle(t->handle);
+#else
+  pthread_join(t->handle, NULL);
+#endif
+}
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION ra_mutex_t;
+#define ra_mutex_init(m) InitializeCriticalSection(m)
+#define ra_mutex_lock(m) EnterCriticalSection(m)
+#define ra_mutex_unlock(m) LeaveCriticalSection(m)
+#define ra_mutex_destroy(m) DeleteCriticalSection(m)
+#else
+typedef pthread_mutex_t ra_mutex_t;
+#define ra_mutex_init(m) pthread_mutex_init(m, NULL)
+#define ra_mutex_lock(m) pthread_mutex_lock(m)
+#define ra_mutex_unlock(m) pthread_mutex_unlock(m)
+#define ra_mutex_destroy(m) pthread_mutex_destroy(m)
+#endif
+
 /* Get path separator character */
 static inline char
 path_separator(void) {
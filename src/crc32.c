@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Host CRC-32 matching the boot firmware CRC command
+ *
+ * The portable path is slice-by-8 with tables generated at build time by
+ * gen_crc32. On x86 a carry-less multiply folding path (PCLMULQDQ, after
+ * Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ")
+ * is picked at runtime for buffers of 64 bytes or more.
+ */
+
+#include "crc32.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32_tables.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_X86 1
+#include <immintrin.h>
+#define TARGET_PCLMUL __attribute__((target("sse2,pclmul")))
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h> /* interlocked pointer access */
+#endif
+
+/* Minimum length handled by the folding path (four 128-bit lanes) */
+#define FOLD_MIN_LEN 64
+
+/*
+ * Portable slice-by-8 on the raw (pre-inverted) CRC state
+ */
+static uint32_t
+slice8_raw(uint32_t crc, const uint8_t *buf, size_t len) {
+  while (len > 0 && ((uintptr_t)buf & 7) != 0) {
+    crc = (crc >> 8) ^ crc32_table[0][(crc ^ *buf++) & 0xFF];
+    len--;
+  }
+
+  while (len >= 8) {
+    uint32_t lo = crc ^ ((uint32_t)buf[0] | (uint32_t)buf[1] << 8 | (uint32_t)buf[2] << 16 |
+                            (uint32_t)buf[3] << 24);
+    uint32_t hi = (uint32_t)buf[4] | (uint32_t)buf[5] << 8 | (uint32_t)buf[6] << 16 |
+                  (uint32_t)buf[7] << 24;
+
+    crc = crc32_table[7][lo & 0xFF] ^ crc32_table[6][(lo >> 8) & 0xFF] ^
+          crc32_table[5][(lo >> 16) & 0xFF] ^ crc32_table[4][lo >> 24] ^
+          crc32_table[3][hi & 0xFF] ^ crc32_table[2][(hi >> 8) & 0xFF] ^
+          crc32_table[1][(hi >> 16) & 0xFF] ^ crc32_table[0][hi >> 24];
+    buf += 8;
+    len -= 8;
+  }
+
+  while (len-- > 0)
+    crc = (crc >> 8) ^ crc32_table[0][(crc ^ *buf++) & 0xFF];
+
+  return crc;
+}
+
+#ifdef CRC32_X86
+static bool
+pclmul_supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2") && __builtin_cpu_supports("pclmul");
+}
+
+/*
+ * Fold len bytes (len >= 64, multiple of 16) into the raw CRC state
+ * Constants are the bit-reflected x^n mod P(x) values from the paper.
+ */
+TARGET_PCLMUL static uint32_t
+pclmul_fold(uint32_t crc, const uint8_t *buf, size_t len) {
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+  x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+  x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+  x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+  buf += 64;
+  len -= 64;
+
+  /* Fold four lanes in parallel, 64 bytes per iteration */
+  x0 = k1k2;
+  while (len >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+
+    buf += 64;
+    len -= 64;
+  }
+
+  /* Fold the four lanes into one */
+  x0 = k3k4;
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* Remaining 16-byte blocks */
+  while (len >= 16) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)buf)), x5);
+    buf += 16;
+    len -= 16;
+  }
+
+  /* Fold 128 bits to 64 bits */
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+  x0 = k5k0;
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits */
+  x0 = poly;
+  x2 = _mm_and_si128(x1, mask32);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, mask32);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+static uint32_t
+pclmul_raw(uint32_t crc, const uint8_t *buf, size_t len) {
+  if (len >= FOLD_MIN_LEN) {
+    size_t n = len & ~(size_t)15;
+    crc = pclmul_fold(crc, buf, n);
+    buf += n;
+    len -= n;
+  }
+  return slice8_raw(crc, buf, len);
+}
+#endif
+
+typedef struct {
+  const char *name;
+  bool (*supported)(void);
+  uint32_t (*raw)(uint32_t crc, const uint8_t *buf, size_t len);
+} crc32_impl_t;
+
+/* Candidates in order of preference */
+static const crc32_impl_t impls[] = {
+#ifdef CRC32_X86
+  { "pclmul", pclmul_supported, pclmul_raw },
+#endif
+  { "slice8", NULL,             slice8_raw },
+};
+
+#define NR_IMPLS (sizeof(impls) / sizeof(impls[0]))
+
+/*
+ * Selected implementation, published like the rabuf one: inventory threads
+ * may make their first CRC at the same time and all store the same choice
+ */
+static const crc32_impl_t *active;
+
+#ifdef _MSC_VER
+#define load_active() \
+  ((const crc32_impl_t *)_InterlockedCompareExchangePointer((void *volatile *)&active, NULL, NULL))
+#define store_active(p) _InterlockedExchangePointer((void *volatile *)&active, (void *)(p))
+#else
+#define load_active() __atomic_load_n(&active, __ATOMIC_ACQUIRE)
+#define store_active(p) __atomic_store_n(&active, (p), __ATOMIC_RELEASE)
+#endif
+
+int
+crc32_select(const char *name) {
+  for (size_t i = 0; i < NR_IMPLS; i++) {
+    if (name != NULL && strcmp(impls[i].name, name) != 0)
+      continue;
+    if (impls[i].supported != NULL && !impls[i].supported())
+      continue;
+    store_active(&impls[i]);
+    return 0;
+  }
+  return -1;
+}
+
+/*
+ * First use honours RADFU_SIMD=generic (portable code only), else picks the best
+ */
+static const crc32_impl_t *
+impl(void) {
+  const crc32_impl_t *cur = load_active();
+
+  if (cur == NULL) {
+    const char *env = getenv("RADFU_SIMD");
+    if (env == NULL || strcmp(env, "generic") != 0 || crc32_select("slice8") < 0)
+      crc32_select(NULL);
+    cur = load_active();
+  }
+  return cur;
+}
+
+const char *
+crc32_impl_name(void) {
+  return impl()->name;
+}
+
+uint32_t
+crc32_update(uint32_t crc, const uint8_t *buf, size_t len) {
+  return ~impl()->raw(~crc, buf, len);
+}
+
+uint32_t
+crc32_fill(uint32_t crc, uint8_t byte, size_t len) {
+  uint8_t block[256];
+
+  memset(block, byte, sizeof(block));
+  while (len > 0) {
+    size_t n = len < sizeof(block) ? len : sizeof(block);
+    crc = crc32_update(crc, block, n);
+    len -= n;
+  }
+  return crc;
+}
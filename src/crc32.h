@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Host CRC-32 matching the boot firmware CRC command
+ * (CRC-32-IEEE-802.3: polynomial 0x04C11DB7 reflected, init and xorout 0xFFFFFFFF)
+ */
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Continue a CRC over more data
+ * crc: result of a previous call, or 0 to start
+ * Returns: CRC of all data fed so far
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t *buf, size_t len);
+
+/*
+ * Continue a CRC over len copies of the same byte (e.g. 0xFF padding)
+ */
+uint32_t crc32_fill(uint32_t crc, uint8_t byte, size_t len);
+
+/*
+ * CRC of a single buffer
+ */
+static inline uint32_t
+crc32_calc(const uint8_t *buf, size_t len) {
+  return crc32_update(0, buf, len);
+}
+
+/*
+ * Name of the implementation in use ("slice8", "pclmul")
+ */
+const char *crc32_impl_name(void);
+
+/*
+ * Force an implementation by name, mainly for tests and benchmarks
+ * The RADFU_SIMD environment variable selects "generic" (slice8) too.
+ * Returns: 0 on success, -1 if unknown or not supported by this CPU
+ */
+int crc32_select(const char *name);
+
+#endif /* CRC32_H */
@@ -12,53 +12,150 @@
 
 #include "compat.h"
 #include "formats.h"
+#include "rabuf.h"
+#include "rbk.h"
+#include "rfi.h"
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 
+/* Longest line fgets() returned before the parsers read mapped files */
 #define MAX_LINE_LEN 1024
 
+/* Hex digit value | 0x10, 0 for non-hex characters */
+static const uint8_t hex_tab[256] = {
+  ['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14, ['5'] = 0x15,
+  ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19, ['A'] = 0x1A, ['B'] = 0x1B,
+  ['C'] = 0x1C, ['D'] = 0x1D, ['E'] = 0x1E, ['F'] = 0x1F, ['a'] = 0x1A, ['b'] = 0x1B,
+  ['c'] = 0x1C, ['d'] = 0x1D, ['e'] = 0x1E, ['f'] = 0x1F,
+};
+
+static inline int
+hex_byte(const char *s) {
+  uint8_t hi = hex_tab[(uint8_t)s[0]];
+  uint8_t lo = hex_tab[(uint8_t)s[1]];
+  if (!(hi & lo & 0x10))
+    return -1;
+  return (hi & 0x0F) << 4 | (lo & 0x0F);
+}
+
+/*
+ * Decode n hex pairs into dst and add them to *sum
+ * Returns: 0 on success, -1 on a non-hex character
+ */
 static int
-hex_nibble(char c) {
-  if (c >= '0' && c <= '9')
-    return c - '0';
-  if (c >= 'A' && c <= 'F')
-    return c - 'A' + 10;
-  if (c >= 'a' && c <= 'f')
-    return c - 'a' + 10;
-  return -1;
+hex_decode(const char *s, uint8_t *dst, int n, uint8_t *sum) {
+  uint8_t acc = *sum;
+  uint8_t bad = 0x10;
+
+  for (int i = 0; i < n; i++) {
+    uint8_t hi = hex_tab[(uint8_t)s[2 * i]];
+    uint8_t lo = hex_tab[(uint8_t)s[2 * i + 1]];
+    uint8_t b = (uint8_t)((hi & 0x0F) << 4 | (lo & 0x0F));
+    bad &= hi & lo;
+    dst[i] = b;
+    acc = (uint8_t)(acc + b);
+  }
+
+  *sum = acc;
+  return bad ? 0 : -1;
 }
 
+/*
+ * Record files are mapped and parsed in place, one line at a time
+ */
+typedef struct {
+  const char *text;
+  size_t len;
+  size_t pos;
+  int line_num;
+} text_t;
+
 static int
-hex_byte(const char *s) {
-  int hi = hex_nibble(s[0]);
-  int lo = hex_nibble(s[1]);
-  if (hi < 0 || lo < 0)
-    return -1;
-  return (hi << 4) | lo;
+text_open(const char *filename, text_t *t) {
+  memset(t, 0, sizeof(*t));
+  t->text = map_file(filename, &t->len);
+  if (t->text == NULL) {
+    if (errno != EINVAL) {
+      warn("failed to open %s", filename);
+      return -1;
+    }
+    t->text = ""; /* empty file */
+    t->len = 0;
+  }
+  return 0;
+}
+
+static void
+text_close(text_t *t) {
+  if (t->len > 0)
+    unmap_file((void *)t->text, t->len);
 }
 
+static void
+text_rewind(text_t *t) {
+  t->pos = 0;
+  t->line_num = 0;
+}
+
+/*
+ * Next line, cut where fgets() into MAX_LINE_LEN would have cut it
+ * *end points past the text a C string would hold (first NUL or line end)
+ * with the line terminator stripped.
+ * Returns: start of the line, NULL at end of file
+ */
+static const char *
+text_line(text_t *t, const char **end) {
+  if (t->pos >= t->len)
+    return NULL;
+
+  const char *p = t->text + t->pos;
+  size_t max = t->len - t->pos < MAX_LINE_LEN - 1 ? t->len - t->pos : MAX_LINE_LEN - 1;
+  const char *nl = memchr(p, '\n', max);
+  size_t n = nl != NULL ? (size_t)(nl - p) + 1 : max;
+  const char *nul = memchr(p, '\0', n);
+
+  t->pos += n;
+  t->line_num++;
+
+  const char *e = nul != NULL ? nul : p + n;
+  while (e > p && (e[-1] == '\n' || e[-1] == '\r'))
+    e--;
+  *end = e;
+  return p;
+}
+
+/* Skip leading blanks, returns NULL for blank lines */
+static const char *
+skip_blank(const char *p, const char *end) {
+  while (p < end && isspace((uint8_t)*p))
+    p++;
+  return p < end ? p : NULL;
+}
+
+/*
+ * Parsed image spanning [min, end) of a sizing pass
+ * Every record the full pass accepts was seen by the sizing pass, which
+ * only stops on lines the full pass rejects, so the buffer never grows.
+ */
 static int
-ensure_capacity(uint8_t **buf, size_t *capacity, size_t needed) {
-  if (needed <= *capacity)
+image_alloc(uint8_t **buf, size_t *size, uint32_t min_addr, uint64_t end) {
+  *buf = NULL;
+  *size = 0;
+  if (min_addr == UINT32_MAX)
     return 0;
 
-  size_t new_cap = *capacity ? *capacity * 2 : 65536;
-  while (new_cap < needed)
-    new_cap *= 2;
-
-  uint8_t *new_buf = realloc(*buf, new_cap);
-  if (!new_buf) {
-    warn("realloc failed");
+  *size = (size_t)(end - min_addr);
+  *buf = malloc(*size ? *size : 1);
+  if (*buf == NULL) {
+    warn("malloc failed");
     return -1;
   }
-
-  memset(new_buf + *capacity, 0xFF, new_cap - *capacity);
-  *buf = new_buf;
-  *capacity = new_cap;
+  memset(*buf, 0xFF, *size);
   return 0;
 }
 
@@ -74,6 +171,12 @@ format_detect(const char *filename) {
   if (strcasecmp(ext, "srec") == 0 || strcasecmp(ext, "s19") == 0 || strcasecmp(ext, "s28") == 0 ||
       strcasecmp(ext, "s37") == 0 || strcasecmp(ext, "mot") == 0)
     return FORMAT_SREC;
+  if (strcasecmp(ext, "rfi") == 0)
+    return FORMAT_RFI;
+  if (strcasecmp(ext, "elf") == 0 || strcasecmp(ext, "axf") == 0)
+    return FORMAT_ELF;
+  if (strcasecmp(ext, "rbk") == 0)
+    return FORMAT_RBK;
 
   return FORMAT_BIN;
 }
@@ -89,6 +192,12 @@ format_name(input_format_t fmt) {
     return "Intel HEX";
   case FORMAT_SREC:
     return "Motorola S-record";
+  case FORMAT_RFI:
+    return "radfu image";
+  case FORMAT_ELF:
+    return "ELF";
+  case FORMAT_RBK:
+    return "radfu backup";
   default:
     return "unknown";
   }
@@ -134,45 +243,151 @@ bin_parse(const char *filename, parsed_file_t *out) {
   return 0;
 }
 
+/* Record ranges collected by a sizing pass (format_ranges()) */
+typedef struct {
+  format_extent_t *ext;
+  int nr;
+  int max;
+  uint32_t gap; /* records closer than this share a range */
+} range_set_t;
+
+static uint64_t
+range_end(const format_extent_t *r) {
+  return (uint64_t)r->addr + r->size;
+}
+
+/* Grow r to cover [addr, end) */
+static void
+range_cover(format_extent_t *r, uint32_t addr, uint64_t end) {
+  uint64_t hi = range_end(r) > end ? range_end(r) : end;
+
+  if (addr < r->addr)
+    r->addr = addr;
+  r->size = (uint32_t)(hi - r->addr);
+}
+
+static void
+range_add(range_set_t *rs, uint32_t addr, uint64_t end) {
+  if (rs == NULL || end <= addr)
+    return;
+
+  for (int i = 0; i < rs->nr; i++) {
+    format_extent_t *r = &rs->ext[i];
+    if (addr <= range_end(r) + rs->gap && end + rs->gap >= r->addr) {
+      range_cover(r, addr, end);
+      return;
+    }
+  }
+
+  if (rs->nr < rs->max)
+    rs->ext[rs->nr++] = (format_extent_t){ addr, (uint32_t)(end - addr), NULL };
+  else
+    range_cover(&rs->ext[rs->nr - 1], addr, end);
+}
+
+static int
+range_cmp(const void *a, const void *b) {
+  uint32_t sa = ((const format_extent_t *)a)->addr;
+  uint32_t sb = ((const format_extent_t *)b)->addr;
+  return (sa > sb) - (sa < sb);
+}
+
+/* Sort, then join the ranges that growing brought close together */
+static void
+range_finish(range_set_t *rs) {
+  int n = 0;
+
+  qsort(rs->ext, rs->nr, sizeof(*rs->ext), range_cmp);
+  for (int i = 0; i < rs->nr; i++) {
+    if (n > 0 && rs->ext[i].addr <= range_end(&rs->ext[n - 1]) + rs->gap)
+      range_cover(&rs->ext[n - 1], rs->ext[i].addr, range_end(&rs->ext[i]));
+    else
+      rs->ext[n++] = rs->ext[i];
+  }
+  rs->nr = n;
+}
+
+/*
+ * Sizing pass: address span of the data records, no diagnostics
+ * rs: if not NULL, also collects the ranges the records cover
+ */
+static void
+ihex_extent(text_t *t, uint32_t *min_out, uint64_t *end_out, range_set_t *rs) {
+  uint32_t ext_addr = 0;
+  uint32_t min_addr = UINT32_MAX;
+  uint64_t end = 0;
+  const char *p, *e;
+
+  while ((p = text_line(t, &e)) != NULL) {
+    if ((p = skip_blank(p, e)) == NULL)
+      continue;
+    if (*p++ != ':' || e - p < 10)
+      break;
+
+    int byte_count = hex_byte(p);
+    int addr_hi = hex_byte(p + 2);
+    int addr_lo = hex_byte(p + 4);
+    int rec_type = hex_byte(p + 6);
+    if (byte_count < 0 || addr_hi < 0 || addr_lo < 0 || rec_type < 0 ||
+        e - p < 8 + byte_count * 2 + 2)
+      break;
+
+    if (rec_type == 0x00) {
+      uint32_t full_addr = ext_addr + (uint32_t)(addr_hi << 8 | addr_lo);
+      if (full_addr < min_addr)
+        min_addr = full_addr;
+      if ((uint64_t)full_addr + byte_count > end)
+        end = (uint64_t)full_addr + byte_count;
+      range_add(rs, full_addr, (uint64_t)full_addr + byte_count);
+    } else if (rec_type == 0x02 || rec_type == 0x04) {
+      int hi = hex_byte(p + 8);
+      int lo = hex_byte(p + 10);
+      if (byte_count != 2 || hi < 0 || lo < 0)
+        break;
+      ext_addr = (uint32_t)(hi << 8 | lo) << (rec_type == 0x02 ? 4 : 16);
+    } else if (rec_type != 0x01 && rec_type != 0x03 && rec_type != 0x05) {
+      break;
+    }
+  }
+
+  *min_out = min_addr;
+  *end_out = end;
+}
+
 int
 ihex_parse(const char *filename, parsed_file_t *out) {
-  FILE *fp;
-  char line[MAX_LINE_LEN];
+  text_t t;
   uint8_t *buf = NULL;
-  size_t capacity = 0;
+  size_t buf_size;
   uint32_t ext_addr = 0;
   uint32_t min_addr = UINT32_MAX;
   uint32_t max_addr = 0;
-  int line_num = 0;
+  uint32_t base;
+  uint64_t end;
   int eof_seen = 0;
+  const char *p, *e;
 
-  fp = fopen(filename, "r");
-  if (!fp) {
-    warn("failed to open %s", filename);
+  if (text_open(filename, &t) < 0)
     return -1;
-  }
 
-  while (fgets(line, sizeof(line), fp)) {
-    line_num++;
-    char *p = line;
+  ihex_extent(&t, &base, &end, NULL);
+  if (image_alloc(&buf, &buf_size, base, end) < 0)
+    goto fail;
 
-    while (isspace(*p))
-      p++;
-    if (*p == '\0' || *p == '\n')
+  text_rewind(&t);
+  while ((p = text_line(&t, &e)) != NULL) {
+    if ((p = skip_blank(p, e)) == NULL)
       continue;
 
     if (*p != ':') {
-      warnx("%s:%d: expected ':' at start of line", filename, line_num);
+      warnx("%s:%d: expected ':' at start of line", filename, t.line_num);
       goto fail;
     }
     p++;
 
-    size_t len = strlen(p);
-    while (len > 0 && (p[len - 1] == '\n' || p[len - 1] == '\r'))
-      len--;
-
+    size_t len = (size_t)(e - p);
     if (len < 10) {
-      warnx("%s:%d: line too short", filename, line_num);
+      warnx("%s:%d: line too short", filename, t.line_num);
       goto fail;
     }
 
@@ -182,75 +397,66 @@ ihex_parse(const char *filename, parsed_file_t *out) {
     int rec_type = hex_byte(p + 6);
 
     if (byte_count < 0 || addr_hi < 0 || addr_lo < 0 || rec_type < 0) {
-      warnx("%s:%d: invalid hex digits", filename, line_num);
+      warnx("%s:%d: invalid hex digits", filename, t.line_num);
       goto fail;
     }
 
     uint16_t addr = (uint16_t)((addr_hi << 8) | addr_lo);
     size_t expected_len = 8 + byte_count * 2 + 2;
     if (len < expected_len) {
-      warnx("%s:%d: line too short for byte count", filename, line_num);
+      warnx("%s:%d: line too short for byte count", filename, t.line_num);
       goto fail;
     }
 
-    uint8_t checksum = (uint8_t)(byte_count + addr_hi + addr_lo + rec_type);
+    /* Data records decode straight into the image */
     uint8_t data[256];
-    for (int i = 0; i < byte_count; i++) {
-      int b = hex_byte(p + 8 + i * 2);
-      if (b < 0) {
-        warnx("%s:%d: invalid hex digits in data", filename, line_num);
+    uint8_t *dst = data;
+    uint32_t full_addr = ext_addr + addr;
+    if (rec_type == 0x00) {
+      if (buf == NULL || full_addr < base || (uint64_t)full_addr + byte_count > end) {
+        warnx("%s:%d: record outside the sized image", filename, t.line_num);
         goto fail;
       }
-      data[i] = (uint8_t)b;
-      checksum = (uint8_t)(checksum + b);
+      dst = buf + (full_addr - base);
+    }
+
+    uint8_t checksum = (uint8_t)(byte_count + addr_hi + addr_lo + rec_type);
+    if (hex_decode(p + 8, dst, byte_count, &checksum) < 0) {
+      warnx("%s:%d: invalid hex digits in data", filename, t.line_num);
+      goto fail;
     }
 
     int file_checksum = hex_byte(p + 8 + byte_count * 2);
     if (file_checksum < 0) {
-      warnx("%s:%d: invalid checksum hex", filename, line_num);
+      warnx("%s:%d: invalid checksum hex", filename, t.line_num);
       goto fail;
     }
     checksum = (uint8_t)(checksum + file_checksum);
     if (checksum != 0) {
-      warnx("%s:%d: checksum mismatch", filename, line_num);
+      warnx("%s:%d: checksum mismatch", filename, t.line_num);
       goto fail;
     }
 
     switch (rec_type) {
     case 0x00: /* Data record */
-    {
-      uint32_t full_addr = ext_addr + addr;
       if (full_addr < min_addr)
         min_addr = full_addr;
       if (full_addr + byte_count > max_addr)
         max_addr = full_addr + byte_count;
-
-      size_t offset = full_addr - (min_addr == UINT32_MAX ? full_addr : min_addr);
-      if (min_addr == UINT32_MAX) {
-        min_addr = full_addr;
-        offset = 0;
-      }
-      offset = full_addr - min_addr;
-
-      if (ensure_capacity(&buf, &capacity, offset + byte_count) < 0)
-        goto fail;
-
-      memcpy(buf + offset, data, byte_count);
       break;
-    }
     case 0x01: /* End of file */
       eof_seen = 1;
       break;
     case 0x02: /* Extended segment address */
       if (byte_count != 2) {
-        warnx("%s:%d: invalid extended segment address record", filename, line_num);
+        warnx("%s:%d: invalid extended segment address record", filename, t.line_num);
         goto fail;
       }
       ext_addr = ((uint32_t)data[0] << 8 | data[1]) << 4;
       break;
     case 0x04: /* Extended linear address */
       if (byte_count != 2) {
-        warnx("%s:%d: invalid extended linear address record", filename, line_num);
+        warnx("%s:%d: invalid extended linear address record", filename, t.line_num);
         goto fail;
       }
       ext_addr = ((uint32_t)data[0] << 8 | data[1]) << 16;
@@ -259,12 +465,12 @@ ihex_parse(const char *filename, parsed_file_t *out) {
     case 0x05: /* Start linear address - ignored */
       break;
     default:
-      warnx("%s:%d: unknown record type 0x%02X", filename, line_num, rec_type);
+      warnx("%s:%d: unknown record type 0x%02X", filename, t.line_num, rec_type);
       goto fail;
     }
   }
 
-  fclose(fp);
+  text_close(&t);
 
   if (!eof_seen) {
     warnx("%s: no EOF record found", filename);
@@ -286,129 +492,176 @@ ihex_parse(const char *filename, parsed_file_t *out) {
   return 0;
 
 fail:
-  fclose(fp);
+  text_close(&t);
   free(buf);
   return -1;
 }
 
+/* Address field width of an S-record type, -1 if unknown */
+static int
+srec_addr_bytes(int rec_type) {
+  switch (rec_type) {
+  case 0:
+  case 1:
+  case 5:
+  case 9:
+    return 2;
+  case 2:
+  case 8:
+    return 3;
+  case 3:
+  case 7:
+    return 4;
+  default:
+    return -1;
+  }
+}
+
+/*
+ * Sizing pass: address span of the data records, no diagnostics
+ * rs: if not NULL, also collects the ranges the records cover
+ */
+static void
+srec_extent(text_t *t, uint32_t *min_out, uint64_t *end_out, range_set_t *rs) {
+  uint32_t min_addr = UINT32_MAX;
+  uint64_t end = 0;
+  const char *p, *e;
+
+  while ((p = text_line(t, &e)) != NULL) {
+    if ((p = skip_blank(p, e)) == NULL)
+      continue;
+    if ((*p != 'S' && *p != 's') || e - p < 6 || !isdigit((uint8_t)p[1]))
+      break;
+
+    int rec_type = p[1] - '0';
+    int addr_bytes = srec_addr_bytes(rec_type);
+    int byte_count = hex_byte(p + 2);
+    p += 2;
+    if (addr_bytes < 0 || byte_count < addr_bytes + 1 || e - p < 2 + byte_count * 2)
+      break;
+
+    if (rec_type >= 1 && rec_type <= 3) {
+      uint32_t addr = 0;
+      uint8_t sum = 0;
+      uint8_t a[4];
+      if (hex_decode(p + 2, a, addr_bytes, &sum) < 0)
+        break;
+      for (int i = 0; i < addr_bytes; i++)
+        addr = addr << 8 | a[i];
+      uint64_t rec_end = (uint64_t)addr + (uint32_t)(byte_count - addr_bytes - 1);
+      if (addr < min_addr)
+        min_addr = addr;
+      if (rec_end > end)
+        end = rec_end;
+      range_add(rs, addr, rec_end);
+    }
+  }
+
+  *min_out = min_addr;
+  *end_out = end;
+}
+
 int
 srec_parse(const char *filename, parsed_file_t *out) {
-  FILE *fp;
-  char line[MAX_LINE_LEN];
+  text_t t;
   uint8_t *buf = NULL;
-  size_t capacity = 0;
+  size_t buf_size;
   uint32_t min_addr = UINT32_MAX;
   uint32_t max_addr = 0;
-  int line_num = 0;
+  uint32_t base;
+  uint64_t end;
   int eof_seen = 0;
+  const char *p, *e;
 
-  fp = fopen(filename, "r");
-  if (!fp) {
-    warn("failed to open %s", filename);
+  if (text_open(filename, &t) < 0)
     return -1;
-  }
 
-  while (fgets(line, sizeof(line), fp)) {
-    line_num++;
-    char *p = line;
+  srec_extent(&t, &base, &end, NULL);
+  if (image_alloc(&buf, &buf_size, base, end) < 0)
+    goto fail;
 
-    while (isspace(*p))
-      p++;
-    if (*p == '\0' || *p == '\n')
+  text_rewind(&t);
+  while ((p = text_line(&t, &e)) != NULL) {
+    if ((p = skip_blank(p, e)) == NULL)
       continue;
 
     if (*p != 'S' && *p != 's') {
-      warnx("%s:%d: expected 'S' at start of line", filename, line_num);
+      warnx("%s:%d: expected 'S' at start of line", filename, t.line_num);
       goto fail;
     }
     p++;
 
-    if (!isdigit(*p)) {
-      warnx("%s:%d: expected digit after 'S'", filename, line_num);
+    if (p == e || !isdigit((uint8_t)*p)) {
+      warnx("%s:%d: expected digit after 'S'", filename, t.line_num);
       goto fail;
     }
     int rec_type = *p - '0';
     p++;
 
-    size_t len = strlen(p);
-    while (len > 0 && (p[len - 1] == '\n' || p[len - 1] == '\r'))
-      len--;
-
+    size_t len = (size_t)(e - p);
     if (len < 4) {
-      warnx("%s:%d: line too short", filename, line_num);
+      warnx("%s:%d: line too short", filename, t.line_num);
       goto fail;
     }
 
     int byte_count = hex_byte(p);
     if (byte_count < 0) {
-      warnx("%s:%d: invalid byte count", filename, line_num);
+      warnx("%s:%d: invalid byte count", filename, t.line_num);
       goto fail;
     }
 
     size_t expected_len = 2 + byte_count * 2;
     if (len < expected_len) {
-      warnx("%s:%d: line too short for byte count", filename, line_num);
+      warnx("%s:%d: line too short for byte count", filename, t.line_num);
       goto fail;
     }
 
-    int addr_bytes;
-    switch (rec_type) {
-    case 0:
-    case 1:
-    case 5:
-    case 9:
-      addr_bytes = 2;
-      break;
-    case 2:
-    case 8:
-      addr_bytes = 3;
-      break;
-    case 3:
-    case 7:
-      addr_bytes = 4;
-      break;
-    default:
-      warnx("%s:%d: unknown record type S%d", filename, line_num, rec_type);
+    int addr_bytes = srec_addr_bytes(rec_type);
+    if (addr_bytes < 0) {
+      warnx("%s:%d: unknown record type S%d", filename, t.line_num, rec_type);
       goto fail;
     }
 
     if (byte_count < addr_bytes + 1) {
-      warnx("%s:%d: byte count too small", filename, line_num);
+      warnx("%s:%d: byte count too small", filename, t.line_num);
       goto fail;
     }
 
     uint8_t checksum = (uint8_t)byte_count;
-    uint32_t addr = 0;
-    for (int i = 0; i < addr_bytes; i++) {
-      int b = hex_byte(p + 2 + i * 2);
-      if (b < 0) {
-        warnx("%s:%d: invalid address hex", filename, line_num);
-        goto fail;
-      }
-      addr = (addr << 8) | (uint32_t)b;
-      checksum = (uint8_t)(checksum + b);
+    uint8_t a[4];
+    if (hex_decode(p + 2, a, addr_bytes, &checksum) < 0) {
+      warnx("%s:%d: invalid address hex", filename, t.line_num);
+      goto fail;
     }
+    uint32_t addr = 0;
+    for (int i = 0; i < addr_bytes; i++)
+      addr = (addr << 8) | a[i];
 
+    /* Data records decode straight into the image */
     int data_bytes = byte_count - addr_bytes - 1;
     uint8_t data[256];
-    for (int i = 0; i < data_bytes; i++) {
-      int b = hex_byte(p + 2 + addr_bytes * 2 + i * 2);
-      if (b < 0) {
-        warnx("%s:%d: invalid data hex", filename, line_num);
+    uint8_t *dst = data;
+    if (rec_type >= 1 && rec_type <= 3) {
+      if (buf == NULL || addr < base || (uint64_t)addr + data_bytes > end) {
+        warnx("%s:%d: record outside the sized image", filename, t.line_num);
         goto fail;
       }
-      data[i] = (uint8_t)b;
-      checksum = (uint8_t)(checksum + b);
+      dst = buf + (addr - base);
+    }
+
+    if (hex_decode(p + 2 + addr_bytes * 2, dst, data_bytes, &checksum) < 0) {
+      warnx("%s:%d: invalid data hex", filename, t.line_num);
+      goto fail;
     }
 
     int file_checksum = hex_byte(p + 2 + addr_bytes * 2 + data_bytes * 2);
     if (file_checksum < 0) {
-      warnx("%s:%d: invalid checksum hex", filename, line_num);
+      warnx("%s:%d: invalid checksum hex", filename, t.line_num);
       goto fail;
     }
     checksum = (uint8_t)(checksum + file_checksum);
     if (checksum != 0xFF) {
-      warnx("%s:%d: checksum mismatch", filename, line_num);
+      warnx("%s:%d: checksum mismatch", filename, t.line_num);
       goto fail;
     }
 
@@ -416,26 +669,11 @@ srec_parse(const char *filename, parsed_file_t *out) {
     case 1:
     case 2:
     case 3: /* Data records */
-    {
       if (addr < min_addr)
         min_addr = addr;
       if (addr + data_bytes > max_addr)
         max_addr = addr + data_bytes;
-
-      size_t offset;
-      if (min_addr == UINT32_MAX) {
-        min_addr = addr;
-        offset = 0;
-      } else {
-        offset = addr - min_addr;
-      }
-
-      if (ensure_capacity(&buf, &capacity, offset + data_bytes) < 0)
-        goto fail;
-
-      memcpy(buf + offset, data, data_bytes);
       break;
-    }
     case 7:
     case 8:
     case 9: /* End records */
@@ -447,7 +685,7 @@ srec_parse(const char *filename, parsed_file_t *out) {
     }
   }
 
-  fclose(fp);
+  text_close(&t);
 
   if (!eof_seen) {
     warnx("%s: no end record found", filename);
@@ -469,11 +707,192 @@ srec_parse(const char *filename, parsed_file_t *out) {
   return 0;
 
 fail:
-  fclose(fp);
+  text_close(&t);
   free(buf);
   return -1;
 }
 
+/*
+ * ELF32 executables
+ *
+ * Only the file header and the program headers are read: each PT_LOAD
+ * segment with file content is one range of flash, at its physical address
+ * (LMA), which is where initialized data lives before startup copies it.
+ */
+
+#define EI_NIDENT 16
+#define ELFCLASS32 1
+#define ELFDATA2LSB 1
+#define EM_ARM 40
+#define PT_LOAD 1
+#define ELF32_EHDR_LEN 52
+#define ELF32_PHDR_LEN 32
+
+static uint16_t
+le16(const uint8_t *p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t
+le32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* Loaded segment: flash range and where its bytes are in the file */
+typedef struct {
+  uint32_t addr;
+  uint32_t size;
+  uint32_t offset;
+} elf_seg_t;
+
+/* Merged segments [addr, end) */
+typedef struct {
+  uint32_t addr;
+  uint64_t end;
+} elf_run_t;
+
+static int
+elf_seg_cmp(const void *a, const void *b) {
+  const elf_seg_t *x = a, *y = b;
+  return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+int
+elf_parse(const char *filename, parsed_file_t *out) {
+  size_t len;
+  const uint8_t *map = map_file(filename, &len);
+  elf_seg_t *segs = NULL;
+  elf_run_t *runs = NULL;
+  int nr_segs = 0;
+
+  if (map == NULL) {
+    warn("failed to open %s", filename);
+    return -1;
+  }
+
+  if (len < ELF32_EHDR_LEN || memcmp(map, "\x7f" "ELF", 4) != 0) {
+    warnx("%s: not an ELF file", filename);
+    goto fail;
+  }
+  if (map[4] != ELFCLASS32 || map[5] != ELFDATA2LSB) {
+    warnx("%s: not a 32-bit little-endian ELF file", filename);
+    goto fail;
+  }
+  if (le16(map + 18) != EM_ARM) {
+    warnx("%s: not an ARM ELF file (machine %u)", filename, le16(map + 18));
+    goto fail;
+  }
+
+  uint32_t phoff = le32(map + 28);
+  uint16_t phentsize = le16(map + 42);
+  uint16_t phnum = le16(map + 44);
+  if (phnum == 0 || phentsize < ELF32_PHDR_LEN ||
+      (uint64_t)phoff + (uint64_t)phnum * phentsize > len) {
+    warnx("%s: invalid program header table", filename);
+    goto fail;
+  }
+
+  segs = malloc(phnum * sizeof(*segs));
+  if (segs == NULL) {
+    warn("malloc failed");
+    goto fail;
+  }
+
+  for (int i = 0; i < phnum; i++) {
+    const uint8_t *ph = map + phoff + (size_t)i * phentsize;
+    elf_seg_t seg = { le32(ph + 12), le32(ph + 16), le32(ph + 4) };
+
+    /* .bss and friends take no flash */
+    if (le32(ph) != PT_LOAD || seg.size == 0)
+      continue;
+    if ((uint64_t)seg.offset + seg.size > len) {
+      warnx("%s: segment %d extends past end of file", filename, i);
+      goto fail;
+    }
+    if ((uint64_t)seg.addr + seg.size > (uint64_t)UINT32_MAX + 1) {
+      warnx("%s: segment %d extends past 4GB", filename, i);
+      goto fail;
+    }
+    segs[nr_segs++] = seg;
+  }
+
+  if (nr_segs == 0) {
+    warnx("%s: no loadable segments", filename);
+    goto fail;
+  }
+  qsort(segs, nr_segs, sizeof(*segs), elf_seg_cmp);
+
+  /* Overlapping or touching segments make one extent */
+  runs = malloc(nr_segs * sizeof(*runs));
+  if (runs == NULL) {
+    warn("malloc failed");
+    goto fail;
+  }
+  int nr_runs = 0;
+  for (int i = 0; i < nr_segs; i++) {
+    uint64_t seg_end = (uint64_t)segs[i].addr + segs[i].size;
+    if (nr_runs > 0 && segs[i].addr <= runs[nr_runs - 1].end) {
+      if (seg_end > runs[nr_runs - 1].end)
+        runs[nr_runs - 1].end = seg_end;
+    } else {
+      runs[nr_runs++] = (elf_run_t){ segs[i].addr, seg_end };
+    }
+  }
+
+  /* Too scattered to list: the closest ones share an extent */
+  while (nr_runs > FORMAT_MAX_EXTENTS) {
+    int j = 0;
+    for (int i = 1; i < nr_runs - 1; i++) {
+      if (runs[i + 1].addr - runs[i].end < runs[j + 1].addr - runs[j].end)
+        j = i;
+    }
+    runs[j].end = runs[j + 1].end;
+    memmove(&runs[j + 1], &runs[j + 2], (nr_runs - j - 2) * sizeof(*runs));
+    nr_runs--;
+  }
+
+  /* One allocation, the extents back to back */
+  size_t packed = 0;
+  for (int i = 0; i < nr_runs; i++)
+    packed += (size_t)(runs[i].end - runs[i].addr);
+  out->data = malloc(packed);
+  if (out->data == NULL) {
+    warn("malloc failed");
+    goto fail;
+  }
+  memset(out->data, 0xFF, packed);
+
+  packed = 0;
+  for (int i = 0, j = 0; i < nr_segs; i++) {
+    while (segs[i].addr >= runs[j].end) {
+      packed += (size_t)(runs[j].end - runs[j].addr);
+      j++;
+    }
+    memcpy(out->data + packed + (segs[i].addr - runs[j].addr), map + segs[i].offset, segs[i].size);
+  }
+
+  packed = 0;
+  for (int i = 0; i < nr_runs; i++) {
+    uint32_t size = (uint32_t)(runs[i].end - runs[i].addr);
+    out->extents[i] = (format_extent_t){ runs[i].addr, size, out->data + packed };
+    packed += size;
+  }
+  out->nr_extents = nr_runs;
+  out->size = (size_t)(runs[nr_runs - 1].end - runs[0].addr);
+  out->base_addr = runs[0].addr;
+  out->has_addr = 1;
+  free(runs);
+  free(segs);
+  unmap_file((void *)map, len);
+  return 0;
+
+fail:
+  free(runs);
+  free(segs);
+  unmap_file((void *)map, len);
+  return -1;
+}
+
 int
 format_parse(const char *filename, input_format_t format, parsed_file_t *out) {
   if (format == FORMAT_AUTO)
@@ -488,121 +907,384 @@ format_parse(const char *filename, input_format_t format, parsed_file_t *out) {
     return ihex_parse(filename, out);
   case FORMAT_SREC:
     return srec_parse(filename, out);
+  case FORMAT_RFI:
+    return rfi_parse(filename, out);
+  case FORMAT_ELF:
+    return elf_parse(filename, out);
+  case FORMAT_RBK:
+    return rbk_parse(filename, out);
   default:
     warnx("unknown format");
     return -1;
   }
 }
 
+bool
+format_piece(const parsed_file_t *p, int i, size_t *off, const uint8_t **data, size_t *len) {
+  /* Extents held apart: offsets from the first one, whatever base_addr became */
+  if (p->nr_extents > 0 && p->extents[0].data != NULL) {
+    if (i >= p->nr_extents)
+      return false;
+    *off = p->extents[i].addr - p->extents[0].addr;
+    *data = p->extents[i].data;
+    *len = p->extents[i].size;
+    return true;
+  }
+
+  if (i > 0 || p->data == NULL)
+    return false;
+  *off = 0;
+  *data = p->data;
+  *len = p->size;
+  return true;
+}
+
+void
+format_copy(const parsed_file_t *p, size_t off, uint8_t *buf, size_t len) {
+  const uint8_t *data;
+  size_t at, n;
+
+  memset(buf, 0xFF, len);
+  for (int i = 0; format_piece(p, i, &at, &data, &n); i++) {
+    size_t lo = off > at ? off : at;
+    size_t hi = off + len < at + n ? off + len : at + n;
+    if (lo < hi)
+      memcpy(buf + (lo - off), data + (lo - at), hi - lo);
+  }
+}
+
+const uint8_t *
+format_bytes(const parsed_file_t *p, size_t off, size_t len) {
+  const uint8_t *data;
+  size_t at, n;
+
+  for (int i = 0; format_piece(p, i, &at, &data, &n); i++) {
+    if (off >= at && off + len <= at + n)
+      return data + (off - at);
+  }
+  return NULL;
+}
+
+size_t
+format_first_used(const parsed_file_t *p, size_t off, size_t len) {
+  const uint8_t *data;
+  size_t at, n;
+
+  for (int i = 0; format_piece(p, i, &at, &data, &n); i++) {
+    size_t lo = off > at ? off : at;
+    size_t hi = off + len < at + n ? off + len : at + n;
+    if (lo >= hi)
+      continue;
+    size_t used = rabuf_first_used(data + (lo - at), hi - lo);
+    if (used < hi - lo)
+      return lo + used - off;
+  }
+  return len;
+}
+
+size_t
+format_last_used(const parsed_file_t *p, size_t off, size_t len) {
+  const uint8_t *data;
+  size_t at, n;
+  size_t last = 0;
+
+  for (int i = 0; format_piece(p, i, &at, &data, &n); i++) {
+    size_t lo = off > at ? off : at;
+    size_t hi = off + len < at + n ? off + len : at + n;
+    if (lo >= hi)
+      continue;
+    size_t used = rabuf_last_used(data + (lo - at), hi - lo);
+    if (used > 0)
+      last = lo + used - off;
+  }
+  return last;
+}
+
+int
+format_ranges(const char *filename,
+    input_format_t format,
+    uint32_t gap,
+    format_extent_t *ranges,
+    int max) {
+  range_set_t rs = { ranges, 0, max, gap };
+  uint32_t base;
+  uint64_t end;
+  text_t t;
+
+  if (format == FORMAT_AUTO)
+    format = format_detect(filename);
+  if ((format != FORMAT_IHEX && format != FORMAT_SREC) || max <= 0)
+    return -1;
+  if (text_open(filename, &t) < 0)
+    return -1;
+
+  if (format == FORMAT_IHEX)
+    ihex_extent(&t, &base, &end, &rs);
+  else
+    srec_extent(&t, &base, &end, &rs);
+  text_close(&t);
+
+  range_finish(&rs);
+  return rs.nr;
+}
+
 /*
- * Intel HEX encoder
+ * Record encoders
+ *
+ * Lines are built in a large buffer with a hex digit table and written with
+ * one fwrite() per buffer.
  */
 
-#define IHEX_BYTES_PER_LINE 16
+#define ENC_BUF_LEN (64 * 1024)
+#define ENC_LINE_MAX 528 /* S3 or HEX record with 255 data bytes, and newline */
+
+/* S3 byte count covers address (4), data and checksum */
+#define SREC_MAX_DATA 250
+
+/* Granularity of blank skipping, a multiple of every RA write unit */
+#define BLANK_BLOCK 256
+
+static unsigned enc_record_bytes = FORMAT_RECORD_BYTES_DEFAULT;
+static bool enc_skip_blank;
 
 int
-ihex_write(const char *filename, const uint8_t *data, size_t size, uint32_t addr) {
-  FILE *fp = fopen(filename, "w");
-  if (!fp) {
-    warn("failed to open %s", filename);
+format_set_write_options(unsigned bytes, bool skip) {
+  if (bytes == 0 || bytes > FORMAT_RECORD_BYTES_MAX) {
+    warnx("record size must be 1 to %d bytes", FORMAT_RECORD_BYTES_MAX);
     return -1;
   }
+  enc_record_bytes = bytes;
+  enc_skip_blank = skip;
+  return 0;
+}
 
-  uint32_t current_ext_addr = 0;
-  size_t offset = 0;
+static const char hex_digits[16] = "0123456789ABCDEF";
 
-  while (offset < size) {
-    uint32_t line_addr = addr + (uint32_t)offset;
+typedef struct {
+  FILE *fp;
+  const char *filename;
+  char *buf;
+  size_t len;
+  int failed;
+} encoder_t;
 
-    /* Emit extended linear address record if needed (type 04) */
-    uint32_t ext_addr = line_addr >> 16;
-    if (ext_addr != current_ext_addr) {
-      uint8_t sum = (uint8_t)(0x02 + 0x00 + 0x00 + 0x04 + (ext_addr >> 8) + (ext_addr & 0xFF));
-      fprintf(fp, ":02000004%04X%02X\n", ext_addr, (uint8_t)(~sum + 1));
-      current_ext_addr = ext_addr;
-    }
+static int
+enc_open(encoder_t *enc, const char *filename) {
+  memset(enc, 0, sizeof(*enc));
+  enc->filename = filename;
+  enc->buf = malloc(ENC_BUF_LEN);
+  if (enc->buf == NULL) {
+    warn("malloc failed");
+    return -1;
+  }
+  enc->fp = fopen(filename, "w");
+  if (!enc->fp) {
+    warn("failed to open %s", filename);
+    free(enc->buf);
+    return -1;
+  }
+  return 0;
+}
 
-    /* Data record (type 00) */
-    size_t remaining = size - offset;
-    size_t line_len = remaining < IHEX_BYTES_PER_LINE ? remaining : IHEX_BYTES_PER_LINE;
-    uint16_t rec_addr = line_addr & 0xFFFF;
+static void
+enc_flush(encoder_t *enc) {
+  if (enc->len > 0 && fwrite(enc->buf, 1, enc->len, enc->fp) != enc->len)
+    enc->failed = 1;
+  enc->len = 0;
+}
+
+static int
+enc_close(encoder_t *enc) {
+  enc_flush(enc);
+  if (fclose(enc->fp) != 0)
+    enc->failed = 1;
+  free(enc->buf);
+  if (enc->failed) {
+    warn("failed to write %s", enc->filename);
+    return -1;
+  }
+  return 0;
+}
 
-    uint8_t sum = (uint8_t)line_len + (rec_addr >> 8) + (rec_addr & 0xFF) + 0x00;
-    fprintf(fp, ":%02X%04X00", (unsigned)line_len, rec_addr);
+/* Room for one more record line */
+static char *
+enc_line(encoder_t *enc) {
+  if (enc->len + ENC_LINE_MAX > ENC_BUF_LEN)
+    enc_flush(enc);
+  return enc->buf + enc->len;
+}
 
-    for (size_t i = 0; i < line_len; i++) {
-      fprintf(fp, "%02X", data[offset + i]);
-      sum += data[offset + i];
-    }
+static void
+enc_commit(encoder_t *enc, const char *end) {
+  enc->len = (size_t)(end - enc->buf);
+}
 
-    fprintf(fp, "%02X\n", (uint8_t)(~sum + 1));
-    offset += line_len;
+static inline char *
+put_hex(char *p, uint8_t b) {
+  p[0] = hex_digits[b >> 4];
+  p[1] = hex_digits[b & 0x0F];
+  return p + 2;
+}
+
+static char *
+put_hex_bytes(char *p, const uint8_t *data, size_t len, uint8_t *sum) {
+  uint8_t acc = *sum;
+  for (size_t i = 0; i < len; i++) {
+    p = put_hex(p, data[i]);
+    acc = (uint8_t)(acc + data[i]);
   }
+  *sum = acc;
+  return p;
+}
 
-  /* EOF record (type 01) */
-  fprintf(fp, ":00000001FF\n");
+static void
+ihex_record(encoder_t *enc, uint8_t type, uint16_t addr, const uint8_t *data, size_t len) {
+  char *p = enc_line(enc);
+  uint8_t hdr[4] = { (uint8_t)len, (uint8_t)(addr >> 8), (uint8_t)addr, type };
+  uint8_t sum = 0;
+
+  *p++ = ':';
+  p = put_hex_bytes(p, hdr, sizeof(hdr), &sum);
+  p = put_hex_bytes(p, data, len, &sum);
+  p = put_hex(p, (uint8_t)(~sum + 1));
+  *p++ = '\n';
+  enc_commit(enc, p);
+}
 
-  fclose(fp);
-  return 0;
+static void
+srec_record(encoder_t *enc, char type, uint32_t addr, const uint8_t *data, size_t len) {
+  int addr_bytes = type == '0' ? 2 : 4;
+  char *p = enc_line(enc);
+  uint8_t hdr[5] = { (uint8_t)(addr_bytes + len + 1) };
+  uint8_t sum = 0;
+
+  for (int i = 0; i < addr_bytes; i++)
+    hdr[1 + i] = (uint8_t)(addr >> (8 * (addr_bytes - 1 - i)));
+
+  *p++ = 'S';
+  *p++ = type;
+  p = put_hex_bytes(p, hdr, (size_t)addr_bytes + 1, &sum);
+  p = put_hex_bytes(p, data, len, &sum);
+  p = put_hex(p, (uint8_t)~sum);
+  *p++ = '\n';
+  enc_commit(enc, p);
 }
 
 /*
- * Motorola S-record encoder
+ * Next run of a region to encode: the rest of it, or with blank skipping
+ * the next stretch of BLANK_BLOCK blocks (address aligned) holding data
+ * Returns: run length, 0 when the region is done
  */
+static size_t
+next_run(const backup_region_t *reg, size_t *pos) {
+  size_t start = *pos;
 
-#define SREC_BYTES_PER_LINE 16
-
-int
-srec_write(const char *filename, const uint8_t *data, size_t size, uint32_t addr) {
-  FILE *fp = fopen(filename, "w");
-  if (!fp) {
-    warn("failed to open %s", filename);
-    return -1;
+  if (!enc_skip_blank) {
+    *pos = reg->size;
+    return reg->size - start;
   }
 
-  /* S0 header record */
-  const char *hdr = "HDR";
-  size_t hdr_len = strlen(hdr);
-  uint8_t sum = (uint8_t)(hdr_len + 3); /* byte count includes address (2) + data + checksum */
-  fprintf(fp, "S0%02X0000", (unsigned)(hdr_len + 3));
-  for (size_t i = 0; i < hdr_len; i++) {
-    fprintf(fp, "%02X", (uint8_t)hdr[i]);
-    sum += (uint8_t)hdr[i];
+  size_t end = start;
+  while (end < reg->size) {
+    size_t block_end = end + BLANK_BLOCK - (reg->addr + end) % BLANK_BLOCK;
+    if (block_end > reg->size)
+      block_end = reg->size;
+    bool blank = rabuf_is_blank(reg->data + end, block_end - end);
+    if (blank && end > start)
+      break;
+    if (blank)
+      start = block_end;
+    end = block_end;
   }
-  fprintf(fp, "%02X\n", (uint8_t)(~sum));
 
-  /* S3 data records (32-bit address) */
-  size_t offset = 0;
-  while (offset < size) {
-    uint32_t line_addr = addr + (uint32_t)offset;
-    size_t remaining = size - offset;
-    size_t line_len = remaining < SREC_BYTES_PER_LINE ? remaining : SREC_BYTES_PER_LINE;
+  *pos = end;
+  return end - start;
+}
 
-    /* Byte count = address (4) + data + checksum (1) */
-    uint8_t byte_count = (uint8_t)(4 + line_len + 1);
-    sum = byte_count;
-    sum += (line_addr >> 24) & 0xFF;
-    sum += (line_addr >> 16) & 0xFF;
-    sum += (line_addr >> 8) & 0xFF;
-    sum += line_addr & 0xFF;
+static int
+ihex_encode(const char *filename, const backup_region_t *regions, size_t count) {
+  encoder_t enc;
+  uint32_t current_ext_addr = 0;
 
-    fprintf(fp, "S3%02X%08X", byte_count, line_addr);
+  if (enc_open(&enc, filename) < 0)
+    return -1;
 
-    for (size_t i = 0; i < line_len; i++) {
-      fprintf(fp, "%02X", data[offset + i]);
-      sum += data[offset + i];
+  for (size_t r = 0; r < count; r++) {
+    const backup_region_t *reg = &regions[r];
+    size_t pos = 0, len;
+
+    while ((len = next_run(reg, &pos)) > 0) {
+      size_t offset = pos - len;
+      while (offset < pos) {
+        uint32_t line_addr = reg->addr + (uint32_t)offset;
+
+        /* Emit extended linear address record if needed (type 04) */
+        uint32_t ext_addr = line_addr >> 16;
+        if (ext_addr != current_ext_addr) {
+          uint8_t seg[2] = { (uint8_t)(ext_addr >> 8), (uint8_t)ext_addr };
+          ihex_record(&enc, 0x04, 0, seg, sizeof(seg));
+          current_ext_addr = ext_addr;
+        }
+
+        /* Data record (type 00), never across a 64KB segment */
+        size_t line_len = pos - offset < enc_record_bytes ? pos - offset : enc_record_bytes;
+        uint32_t seg_left = 0x10000 - (line_addr & 0xFFFF);
+        if (line_len > seg_left)
+          line_len = seg_left;
+
+        ihex_record(&enc, 0x00, (uint16_t)line_addr, reg->data + offset, line_len);
+        offset += line_len;
+      }
     }
+  }
 
-    fprintf(fp, "%02X\n", (uint8_t)(~sum));
-    offset += line_len;
+  /* EOF record (type 01) */
+  ihex_record(&enc, 0x01, 0, NULL, 0);
+
+  return enc_close(&enc);
+}
+
+static int
+srec_encode(const char *filename, const backup_region_t *regions, size_t count, uint32_t entry) {
+  encoder_t enc;
+  size_t max = enc_record_bytes < SREC_MAX_DATA ? enc_record_bytes : SREC_MAX_DATA;
+
+  if (enc_open(&enc, filename) < 0)
+    return -1;
+
+  /* S0 header record */
+  srec_record(&enc, '0', 0, (const uint8_t *)"HDR", 3);
+
+  /* S3 data records (32-bit address) */
+  for (size_t r = 0; r < count; r++) {
+    const backup_region_t *reg = &regions[r];
+    size_t pos = 0, len;
+
+    while ((len = next_run(reg, &pos)) > 0) {
+      for (size_t offset = pos - len; offset < pos;) {
+        size_t line_len = pos - offset < max ? pos - offset : max;
+        srec_record(&enc, '3', reg->addr + (uint32_t)offset, reg->data + offset, line_len);
+        offset += line_len;
+      }
+    }
   }
 
   /* S7 end record (32-bit start address) */
-  sum = 0x05 + ((addr >> 24) & 0xFF) + ((addr >> 16) & 0xFF) + ((addr >> 8) & 0xFF) + (addr & 0xFF);
-  fprintf(fp, "S705%08X%02X\n", addr, (uint8_t)(~sum));
+  srec_record(&enc, '7', entry, NULL, 0);
 
-  fclose(fp);
-  return 0;
+  return enc_close(&enc);
+}
+
+int
+ihex_write(const char *filename, const uint8_t *data, size_t size, uint32_t addr) {
+  backup_region_t reg = { data, size, addr };
+  return ihex_encode(filename, &reg, 1);
+}
+
+int
+srec_write(const char *filename, const uint8_t *data, size_t size, uint32_t addr) {
+  backup_region_t reg = { data, size, addr };
+  return srec_encode(filename, &reg, 1, addr);
 }
 
 int
@@ -637,116 +1319,16 @@ format_write(
 }
 
 /*
- * Multi-region Intel HEX writer
+ * Multi-region writers, the S7 entry point is 0
  */
 static int
 ihex_write_multi(const char *filename, const backup_region_t *regions, size_t count) {
-  FILE *fp = fopen(filename, "w");
-  if (!fp) {
-    warn("failed to open %s", filename);
-    return -1;
-  }
-
-  uint32_t current_ext_addr = 0;
-
-  for (size_t r = 0; r < count; r++) {
-    const backup_region_t *reg = &regions[r];
-    size_t offset = 0;
-
-    while (offset < reg->size) {
-      uint32_t line_addr = reg->addr + (uint32_t)offset;
-
-      /* Emit extended linear address record if needed (type 04) */
-      uint32_t ext_addr = line_addr >> 16;
-      if (ext_addr != current_ext_addr) {
-        uint8_t sum = (uint8_t)(0x02 + 0x00 + 0x00 + 0x04 + (ext_addr >> 8) + (ext_addr & 0xFF));
-        fprintf(fp, ":02000004%04X%02X\n", ext_addr, (uint8_t)(~sum + 1));
-        current_ext_addr = ext_addr;
-      }
-
-      /* Data record (type 00) */
-      size_t remaining = reg->size - offset;
-      size_t line_len = remaining < IHEX_BYTES_PER_LINE ? remaining : IHEX_BYTES_PER_LINE;
-      uint16_t rec_addr = line_addr & 0xFFFF;
-
-      uint8_t sum = (uint8_t)line_len + (rec_addr >> 8) + (rec_addr & 0xFF) + 0x00;
-      fprintf(fp, ":%02X%04X00", (unsigned)line_len, rec_addr);
-
-      for (size_t i = 0; i < line_len; i++) {
-        fprintf(fp, "%02X", reg->data[offset + i]);
-        sum += reg->data[offset + i];
-      }
-
-      fprintf(fp, "%02X\n", (uint8_t)(~sum + 1));
-      offset += line_len;
-    }
-  }
-
-  /* EOF record (type 01) */
-  fprintf(fp, ":00000001FF\n");
-
-  fclose(fp);
-  return 0;
+  return ihex_encode(filename, regions, count);
 }
 
-/*
- * Multi-region Motorola S-record writer
- */
 static int
 srec_write_multi(const char *filename, const backup_region_t *regions, size_t count) {
-  FILE *fp = fopen(filename, "w");
-  if (!fp) {
-    warn("failed to open %s", filename);
-    return -1;
-  }
-
-  /* S0 header record */
-  const char *hdr = "HDR";
-  size_t hdr_len = strlen(hdr);
-  uint8_t sum = (uint8_t)(hdr_len + 3);
-  fprintf(fp, "S0%02X0000", (unsigned)(hdr_len + 3));
-  for (size_t i = 0; i < hdr_len; i++) {
-    fprintf(fp, "%02X", (uint8_t)hdr[i]);
-    sum += (uint8_t)hdr[i];
-  }
-  fprintf(fp, "%02X\n", (uint8_t)(~sum));
-
-  /* S3 data records for each region */
-  for (size_t r = 0; r < count; r++) {
-    const backup_region_t *reg = &regions[r];
-    size_t offset = 0;
-
-    while (offset < reg->size) {
-      uint32_t line_addr = reg->addr + (uint32_t)offset;
-      size_t remaining = reg->size - offset;
-      size_t line_len = remaining < SREC_BYTES_PER_LINE ? remaining : SREC_BYTES_PER_LINE;
-
-      /* Byte count = address (4) + data + checksum (1) */
-      uint8_t byte_count = (uint8_t)(4 + line_len + 1);
-      sum = byte_count;
-      sum += (line_addr >> 24) & 0xFF;
-      sum += (line_addr >> 16) & 0xFF;
-      sum += (line_addr >> 8) & 0xFF;
-      sum += line_addr & 0xFF;
-
-      fprintf(fp, "S3%02X%08X", byte_count, line_addr);
-
-      for (size_t i = 0; i < line_len; i++) {
-        fprintf(fp, "%02X", reg->data[offset + i]);
-        sum += reg->data[offset + i];
-      }
-
-      fprintf(fp, "%02X\n", (uint8_t)(~sum));
-      offset += line_len;
-    }
-  }
-
-  /* S7 end record with entry point 0 */
-  sum = 0x05;
-  fprintf(fp, "S70500000000%02X\n", (uint8_t)(~sum));
-
-  fclose(fp);
-  return 0;
+  return srec_encode(filename, regions, count, 0);
 }
 
 int
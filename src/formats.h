@@ -13,6 +13,7 @@
 #ifndef FORMATS_H
 #define FORMATS_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -22,19 +23,64 @@ typedef enum {
   FORMAT_BIN,  /* Raw binary */
   FORMAT_IHEX, /* Intel HEX */
   FORMAT_SREC, /* Motorola S-record */
+  FORMAT_RFI,  /* Pre-compiled packet stream container (input only) */
+  FORMAT_ELF,  /* ELF32 ARM executable, PT_LOAD segments (input only) */
+  FORMAT_RBK,  /* Native compressed backup (written by backup only) */
 } input_format_t;
 
 /* Output format type (alias for clarity) */
 typedef input_format_t output_format_t;
 
+/* Most loaded ranges kept in a parsed file */
+#define FORMAT_MAX_EXTENTS 16
+
+/* Loaded range of a parsed file, inside [base_addr, base_addr + size) */
+typedef struct {
+  uint32_t addr;
+  uint32_t size;
+  const uint8_t *data; /* Its bytes when held apart (ELF), NULL if in the flat buffer */
+} format_extent_t;
+
 /* Parsed file data */
 typedef struct {
   uint8_t *data;      /* Binary data buffer (caller must free) */
-  size_t size;        /* Size of data in bytes */
+  size_t size;        /* Size of the image in bytes, from base_addr */
   uint32_t base_addr; /* Base address from file (0 for binary) */
   int has_addr;       /* Non-zero if file contained address info */
+  /*
+   * Loaded ranges, sorted and disjoint, when the format tells them apart
+   * from gaps (0 = the whole buffer is data, gaps filled with 0xFF). ELF
+   * images keep only these: data then holds them back to back, so read the
+   * image with format_copy() and friends rather than data + offset.
+   */
+  int nr_extents;
+  format_extent_t extents[FORMAT_MAX_EXTENTS];
 } parsed_file_t;
 
+/*
+ * Piece i of a parsed image held in memory: the flat buffer, or an extent
+ * off: offset of the piece from the start of the image
+ * Returns: false past the last piece
+ */
+bool format_piece(const parsed_file_t *p, int i, size_t *off, const uint8_t **data, size_t *len);
+
+/*
+ * Image bytes [off, off + len) into buf, 0xFF where nothing is loaded
+ */
+void format_copy(const parsed_file_t *p, size_t off, uint8_t *buf, size_t len);
+
+/*
+ * Image bytes [off, off + len) in place
+ * Returns: pointer into the piece holding them all, NULL if none does
+ */
+const uint8_t *format_bytes(const parsed_file_t *p, size_t off, size_t len);
+
+/*
+ * rabuf_first_used() and rabuf_last_used() over image bytes [off, off + len)
+ */
+size_t format_first_used(const parsed_file_t *p, size_t off, size_t len);
+size_t format_last_used(const parsed_file_t *p, size_t off, size_t len);
+
 /*
  * Detect input format from file extension
  * Returns FORMAT_BIN if extension not recognized
@@ -54,6 +100,23 @@ const char *format_name(input_format_t fmt);
  */
 int format_parse(const char *filename, input_format_t format, parsed_file_t *out);
 
+/* Record gap that still tells the flash areas of a backup apart */
+#define FORMAT_RANGE_GAP 0x10000
+
+/*
+ * Address ranges the records of an Intel HEX or S-record file cover
+ * The parsers fill gaps with 0xFF; this tells the covered ranges apart,
+ * e.g. the flash areas of a backup. Records closer than gap share a range
+ * (0: only touching ones). With more than max ranges the last one is
+ * stretched over the rest.
+ * Returns: number of ranges, -1 on error or for other formats
+ */
+int format_ranges(const char *filename,
+    input_format_t format,
+    uint32_t gap,
+    format_extent_t *ranges,
+    int max);
+
 /*
  * Parse Intel HEX file
  * Returns: 0 on success, -1 on error
@@ -66,12 +129,34 @@ int ihex_parse(const char *filename, parsed_file_t *out);
  */
 int srec_parse(const char *filename, parsed_file_t *out);
 
+/*
+ * Parse ELF32 little-endian ARM executable
+ * PT_LOAD segments are placed at their physical (load) address and kept as
+ * out->extents only, nothing is allocated for the gaps between them. Past
+ * FORMAT_MAX_EXTENTS the closest extents are merged, their gap read as 0xFF.
+ * Returns: 0 on success, -1 on error
+ */
+int elf_parse(const char *filename, parsed_file_t *out);
+
 /*
  * Parse raw binary file
  * Returns: 0 on success, -1 on error
  */
 int bin_parse(const char *filename, parsed_file_t *out);
 
+/* Data bytes per Intel HEX / S-record record written */
+#define FORMAT_RECORD_BYTES_DEFAULT 16
+#define FORMAT_RECORD_BYTES_MAX 255
+
+/*
+ * Set encoder options for the writes that follow
+ * record_bytes: data bytes per record, 1 to FORMAT_RECORD_BYTES_MAX
+ *               (S3 records are capped at 250, their byte count limit)
+ * skip_blank: leave out 256-byte aligned blocks that are all 0xFF
+ * Returns: 0 on success, -1 if record_bytes is out of range
+ */
+int format_set_write_options(unsigned record_bytes, bool skip_blank);
+
 /*
  * Write data to file in specified format
  * If format is FORMAT_AUTO, detects from extension
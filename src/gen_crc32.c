@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Build-time generator for the CRC-32 slice-by-8 lookup tables
+ *
+ * Usage: gen_crc32 <output.h>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* CRC-32-IEEE-802.3, bit-reflected form of 0x04C11DB7 */
+#define CRC32_POLY_REFLECTED 0xEDB88320u
+
+int
+main(int argc, char *argv[]) {
+  static uint32_t table[8][256];
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <output.h>\n", argv[0]);
+    return 1;
+  }
+
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t c = n;
+    for (int k = 0; k < 8; k++)
+      c = (c >> 1) ^ (CRC32_POLY_REFLECTED & (0u - (c & 1)));
+    table[0][n] = c;
+  }
+
+  /* table[k][n]: CRC of byte n followed by k zero bytes */
+  for (uint32_t n = 0; n < 256; n++) {
+    for (int k = 1; k < 8; k++)
+      table[k][n] = (table[k - 1][n] >> 8) ^ table[0][table[k - 1][n] & 0xFF];
+  }
+
+  FILE *f = fopen(argv[1], "w");
+  if (f == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  fprintf(f, "/* Generated by gen_crc32, do not edit */\n\n");
+  fprintf(f, "static const uint32_t crc32_table[8][256] = {\n");
+  for (int k = 0; k < 8; k++) {
+    fprintf(f, "  {");
+    for (int n = 0; n < 256; n++)
+      fprintf(f, "%s0x%08Xu,", (n % 6) == 0 ? "\n    " : " ", table[k][n]);
+    fprintf(f, "\n  },\n");
+  }
+  fprintf(f, "};\n");
+
+  if (fclose(f) != 0) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * libradfu: public API over the radfu flash operations
+ */
+
+#include "libradfu.h"
+#include "compat.h"
+#include "progress.h"
+#include "rabuf.h"
+#include "radfu.h"
+#include "ralog.h"
+#include "raop.h"
+#include "rapacker.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct radfu {
+  ra_device_t dev;
+};
+
+static radfu_log_cb_t log_cb;
+static void *log_user_data;
+static radfu_progress_cb_t progress_cb;
+static void *progress_user_data;
+
+const char *
+radfu_strerror(int err) {
+  switch (err) {
+  case RADFU_OK:
+    return "success";
+  case RADFU_ERR_ARG:
+    return "invalid argument";
+  case RADFU_ERR_NOMEM:
+    return "out of memory";
+  case RADFU_ERR_CONNECT:
+    return "connection failed";
+  case RADFU_ERR_DEVICE:
+    return "device error";
+  case RADFU_ERR_VERIFY:
+    return "verify failed";
+  default:
+    return "unknown error";
+  }
+}
+
+static void
+log_forward(ra_log_level_t level, const char *msg, void *user_data) {
+  (void)user_data;
+  if (log_cb == NULL)
+    return;
+
+  switch (level) {
+  case RA_LOG_WARN:
+    log_cb(RADFU_LOG_WARN, msg, log_user_data);
+    break;
+  case RA_LOG_INFO:
+    log_cb(RADFU_LOG_INFO, msg, log_user_data);
+    break;
+  case RA_LOG_OUTPUT:
+    log_cb(RADFU_LOG_OUTPUT, msg, log_user_data);
+    break;
+  }
+}
+
+static void
+progress_forward(size_t current, size_t total, const char *desc, void *user_data) {
+  (void)user_data;
+  if (progress_cb != NULL)
+    progress_cb(desc != NULL ? desc : "", current, total, progress_user_data);
+}
+
+/* From here on messages and progress go to the callbacks, whatever the caller set */
+static void
+take_output(void) {
+  ra_log_set_handler(log_forward, NULL);
+  progress_set_global_callback(progress_forward, NULL);
+}
+
+void
+radfu_set_log(radfu_log_cb_t cb, void *user_data) {
+  log_cb = cb;
+  log_user_data = user_data;
+  take_output();
+}
+
+void
+radfu_set_progress(radfu_progress_cb_t cb, void *user_data) {
+  progress_cb = cb;
+  progress_user_data = user_data;
+  take_output();
+}
+
+int
+radfu_open(radfu_t **out, const radfu_config_t *cfg) {
+  if (out == NULL || cfg == NULL)
+    return RADFU_ERR_ARG;
+  *out = NULL;
+  take_output();
+
+  radfu_t *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return RADFU_ERR_NOMEM;
+
+  if (ra_session_open(
+          &s->dev, cfg->port, cfg->uart, cfg->baudrate, cfg->id_code, cfg->layout_cache) < 0) {
+    free(s);
+    return RADFU_ERR_CONNECT;
+  }
+  /* No terminal bar for this session, without silencing the rest of the process */
+  s->dev.quiet = true;
+
+  *out = s;
+  return RADFU_OK;
+}
+
+void
+radfu_close(radfu_t *s) {
+  if (s == NULL)
+    return;
+  ra_close(&s->dev);
+  free(s);
+}
+
+static uint32_t
+nr_areas(const radfu_t *s) {
+  uint32_t n = s->dev.noa > 0 ? s->dev.noa : 4;
+  return n < MAX_AREAS ? n : MAX_AREAS;
+}
+
+int
+radfu_info(radfu_t *s, radfu_info_t *info) {
+  const uint8_t *sig = s != NULL ? s->dev.sig : NULL;
+
+  if (s == NULL || info == NULL)
+    return RADFU_ERR_ARG;
+  memset(info, 0, sizeof(*info));
+
+  /* Signature (spec 6.15.2.2): RMB(4) NOA(1) TYP(1) BFV(3) DID(16) PTN(16) */
+  if (s->dev.sig_len >= 9) {
+    info->max_baudrate = be_to_uint32(&sig[0]);
+    info->device_type = sig[5];
+    memcpy(info->boot_version, &sig[6], 3);
+  }
+  if (s->dev.sig_len >= 25)
+    memcpy(info->did, &sig[9], sizeof(info->did));
+  if (s->dev.sig_len >= 41) {
+    memcpy(info->product, &sig[25], 16);
+    for (int i = 15; i >= 0 && (info->product[i] == ' ' || info->product[i] == '\0'); i--)
+      info->product[i] = '\0';
+  }
+
+  info->nr_areas = nr_areas(s);
+  for (uint32_t i = 0; i < info->nr_areas; i++) {
+    const ra_area_t *a = &s->dev.chip_layout[i];
+    radfu_area_t *o = &info->areas[i];
+
+    o->koa = a->koa;
+    o->start = a->sad;
+    o->end = a->ead;
+    o->erase_unit = a->eau;
+    o->write_unit = a->wau;
+    o->read_unit = a->rau;
+    o->crc_unit = a->cau;
+  }
+  return RADFU_OK;
+}
+
+int
+radfu_read(radfu_t *s, uint32_t addr, uint8_t *buf, uint32_t len) {
+  if (s == NULL || buf == NULL || len == 0)
+    return RADFU_ERR_ARG;
+  return ra_read_mem(&s->dev, addr, buf, len) < 0 ? RADFU_ERR_DEVICE : RADFU_OK;
+}
+
+int
+radfu_write(radfu_t *s, uint32_t addr, const uint8_t *data, uint32_t len) {
+  if (s == NULL || data == NULL || len == 0)
+    return RADFU_ERR_ARG;
+  return ra_write_mem(&s->dev, addr, data, len) < 0 ? RADFU_ERR_DEVICE : RADFU_OK;
+}
+
+int
+radfu_erase(radfu_t *s, uint32_t addr, uint32_t len) {
+  if (s == NULL || len == 0)
+    return RADFU_ERR_ARG;
+  return ra_erase(&s->dev, addr, len) < 0 ? RADFU_ERR_DEVICE : RADFU_OK;
+}
+
+int
+radfu_verify(radfu_t *s, uint32_t addr, const uint8_t *data, uint32_t len) {
+  if (s == NULL || data == NULL || len == 0)
+    return RADFU_ERR_ARG;
+
+  int ret = ra_verify_mem(&s->dev, addr, data, len);
+  if (ret < 0)
+    return RADFU_ERR_DEVICE;
+  return ret == 1 ? RADFU_OK : RADFU_ERR_VERIFY;
+}
+
+int
+radfu_crc(radfu_t *s, uint32_t addr, uint32_t len, uint32_t *crc) {
+  if (s == NULL || crc == NULL || len == 0)
+    return RADFU_ERR_ARG;
+  return ra_crc_mem(&s->dev, addr, len, crc) < 0 ? RADFU_ERR_DEVICE : RADFU_OK;
+}
+
+int
+radfu_backup(radfu_t *s, uint8_t *const *bufs, uint32_t nr_bufs) {
+  ra_op_seg_t segs[RA_OP_MAX_SEGS];
+  uint32_t nr_segs = 0;
+  ra_op_t op;
+
+  if (s == NULL || bufs == NULL)
+    return RADFU_ERR_ARG;
+
+  for (uint32_t i = 0; i < nr_bufs && i < nr_areas(s); i++) {
+    const ra_area_t *a = &s->dev.chip_layout[i];
+
+    if (bufs[i] == NULL || a->ead == 0 || a->rau == 0)
+      continue;
+    segs[nr_segs++] = (ra_op_seg_t){ a->sad, bufs[i], a->ead - a->sad + 1 };
+  }
+
+  /* All areas as one operation */
+  ra_op_backup(&op, &s->dev, segs, nr_segs);
+  op.context = "backup";
+  return ra_op_run(&op) < 0 ? RADFU_ERR_DEVICE : RADFU_OK;
+}
+
+/* Erase one area, write back its non-blank erase units, then check it */
+static int
+restore_area(radfu_t *s, const ra_area_t *a, const uint8_t *buf) {
+  uint32_t size = a->ead - a->sad + 1;
+  uint32_t unit = a->eau;
+
+  if (ra_erase(&s->dev, a->sad, size) < 0)
+    return RADFU_ERR_DEVICE;
+
+  for (uint32_t off = 0; off < size; off += unit) {
+    if (rabuf_is_blank(buf + off, size - off < unit ? size - off : unit))
+      continue;
+
+    /* Extend over the run of used units */
+    uint32_t end = off + unit;
+    while (end < size && !rabuf_is_blank(buf + end, size - end < unit ? size - end : unit))
+      end += unit;
+    if (end > size)
+      end = size;
+
+    if (ra_write_mem(&s->dev, a->sad + off, buf + off, end - off) < 0)
+      return RADFU_ERR_DEVICE;
+    off = end - unit;
+  }
+
+  int ret = ra_verify_mem(&s->dev, a->sad, buf, size);
+  if (ret < 0)
+    return RADFU_ERR_DEVICE;
+  return ret == 1 ? RADFU_OK : RADFU_ERR_VERIFY;
+}
+
+int
+radfu_restore(radfu_t *s, const uint8_t *const *bufs, uint32_t nr_bufs) {
+  if (s == NULL || bufs == NULL)
+    return RADFU_ERR_ARG;
+
+  for (uint32_t i = 0; i < nr_bufs && i < nr_areas(s); i++) {
+    const ra_area_t *a = &s->dev.chip_layout[i];
+
+    if (bufs[i] == NULL || a->ead == 0 || a->koa == KOA_TYPE_CONFIG)
+      continue;
+    if (a->eau == 0 || a->wau == 0) {
+      warnx("area %u cannot be erased and written", i);
+      return RADFU_ERR_ARG;
+    }
+
+    int ret = restore_area(s, a, bufs[i]);
+    if (ret != RADFU_OK)
+      return ret;
+  }
+  return RADFU_OK;
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * libradfu: Renesas RA flash programming from another program
+ *
+ * Everything works on caller owned buffers: nothing is printed and no file
+ * is touched. Messages and progress reach the caller through callbacks.
+ * Callbacks are process wide; a session is used by one thread at a time.
+ *
+ *   radfu_t *s;
+ *   radfu_config_t cfg = { .port = "/dev/ttyACM0" };
+ *   if (radfu_open(&s, &cfg) == RADFU_OK) {
+ *     radfu_read(s, 0x00000000, buf, sizeof(buf));
+ *     radfu_close(s);
+ *   }
+ */
+
+#ifndef LIBRADFU_H
+#define LIBRADFU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The shared library is built with hidden visibility: only these are exported */
+#if defined(__GNUC__) && !defined(_WIN32)
+#define RADFU_API __attribute__((visibility("default")))
+#else
+#define RADFU_API
+#endif
+
+/* Every call returns RADFU_OK or one of the negative codes below */
+typedef enum {
+  RADFU_OK = 0,
+  RADFU_ERR_ARG = -1,     /* invalid argument (NULL pointer, empty or misaligned range) */
+  RADFU_ERR_NOMEM = -2,   /* out of memory */
+  RADFU_ERR_CONNECT = -3, /* no device, no sync, baud rate or ID authentication failed */
+  RADFU_ERR_DEVICE = -4,  /* command rejected or link failure, the log has the details */
+  RADFU_ERR_VERIFY = -5,  /* flash content differs from the buffer */
+} radfu_err_t;
+
+RADFU_API const char *radfu_strerror(int err);
+
+typedef enum {
+  RADFU_LOG_WARN,   /* an error or a suspicious condition */
+  RADFU_LOG_INFO,   /* progress notes: connection, baud rate, authentication */
+  RADFU_LOG_OUTPUT, /* command results (erased range, CRC) */
+} radfu_log_level_t;
+
+/* msg is one line without its newline, valid during the call only */
+typedef void (*radfu_log_cb_t)(radfu_log_level_t level, const char *msg, void *user_data);
+
+/* phase: "Reading", "Writing"...; current/total count bytes or packets */
+typedef void (*radfu_progress_cb_t)(const char *phase,
+    size_t current,
+    size_t total,
+    void *user_data);
+
+/* NULL drops the messages (the default) */
+RADFU_API void radfu_set_log(radfu_log_cb_t cb, void *user_data);
+
+/* NULL drops the progress (the default) */
+RADFU_API void radfu_set_progress(radfu_progress_cb_t cb, void *user_data);
+
+typedef struct {
+  const char *port;       /* serial device, NULL to auto-detect a Renesas USB board */
+  bool uart;              /* plain UART (P109/P110) rather than USB */
+  uint32_t baudrate;      /* 0: fastest rate both ends support in UART mode */
+  const uint8_t *id_code; /* 16-byte ID code, NULL if the device is not locked */
+  bool layout_cache;      /* keep the area table in the user cache directory */
+} radfu_config_t;
+
+typedef struct radfu radfu_t;
+
+/*
+ * Connect: sync, query the area table, switch baud rate, authenticate
+ * The session stays usable until radfu_close, saving a reconnect per call.
+ */
+RADFU_API int radfu_open(radfu_t **out, const radfu_config_t *cfg);
+RADFU_API void radfu_close(radfu_t *s);
+
+#define RADFU_MAX_AREAS 8
+
+#define RADFU_KOA_CODE 0x00   /* code flash (bank 0) */
+#define RADFU_KOA_CODE1 0x01  /* code flash bank 1 (dual bank mode) */
+#define RADFU_KOA_DATA 0x10   /* data flash */
+#define RADFU_KOA_CONFIG 0x20 /* config area */
+
+typedef struct {
+  uint8_t koa;         /* kind of area, RADFU_KOA_* */
+  uint32_t start;      /* first address */
+  uint32_t end;        /* last address (inclusive) */
+  uint32_t erase_unit; /* 0 if the area cannot be erased */
+  uint32_t write_unit; /* 0 if the area cannot be written */
+  uint32_t read_unit;  /* 0 if the area cannot be read */
+  uint32_t crc_unit;   /* 0 if the device cannot CRC the area */
+} radfu_area_t;
+
+typedef struct {
+  char product[17];        /* product type name, NUL terminated, blanks trimmed */
+  uint8_t did[16];         /* device unique ID */
+  uint8_t boot_version[3]; /* boot firmware major, minor, build */
+  uint8_t device_type;     /* device group (TYP) */
+  uint32_t max_baudrate;   /* recommended maximum UART rate (RMB) */
+  uint32_t nr_areas;
+  radfu_area_t areas[RADFU_MAX_AREAS];
+} radfu_info_t;
+
+/* Signature and area table, from what radfu_open already queried */
+RADFU_API int radfu_info(radfu_t *s, radfu_info_t *info);
+
+/* Read [addr, addr + len) into buf, len a multiple of the read unit */
+RADFU_API int radfu_read(radfu_t *s, uint32_t addr, uint8_t *buf, uint32_t len);
+
+/* Program erased flash; a partial last write unit is padded with zeros */
+RADFU_API int radfu_write(radfu_t *s, uint32_t addr, const uint8_t *data, uint32_t len);
+
+/* Erase the erase units covering [addr, addr + len) */
+RADFU_API int radfu_erase(radfu_t *s, uint32_t addr, uint32_t len);
+
+/*
+ * Compare flash with data, by device CRC when the range lies on CRC units
+ * Returns: RADFU_OK if equal, RADFU_ERR_VERIFY if not, another code on error
+ */
+RADFU_API int radfu_verify(radfu_t *s, uint32_t addr, const uint8_t *data, uint32_t len);
+
+/* CRC-32 computed by the device, the range on CRC unit boundaries */
+RADFU_API int radfu_crc(radfu_t *s, uint32_t addr, uint32_t len, uint32_t *crc);
+
+/*
+ * Read whole areas: bufs[i] receives area i of radfu_info (end - start + 1
+ * bytes); NULL entries and unreadable areas are skipped
+ */
+RADFU_API int radfu_backup(radfu_t *s, uint8_t *const *bufs, uint32_t nr_bufs);
+
+/*
+ * Put areas back from such buffers: each code/data area given is erased,
+ * its non-blank erase units written, then checked against the buffer
+ * The config area is never touched.
+ */
+RADFU_API int radfu_restore(radfu_t *s, const uint8_t *const *bufs, uint32_t nr_bufs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBRADFU_H */
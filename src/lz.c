@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Small LZ77 block compressor
+ *
+ * A block is a list of sequences:
+ *
+ *   token      high nibble: literal count, low nibble: match length - 4
+ *              (15 means more length bytes follow, each adding up to 255)
+ *   literals
+ *   offset     u16 little-endian, distance back to the match (1..65535)
+ *
+ * The last sequence carries literals only and ends the block. Matches are
+ * found through a hash of the next 4 bytes, keeping the latest position.
+ */
+
+#include "lz.h"
+
+#include <string.h>
+
+#define MIN_MATCH 4
+#define MAX_OFFSET 0xFFFF
+#define HASH_BITS 12
+
+static uint32_t
+read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t
+hash4(const uint8_t *p) {
+  return (read32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Extra length bytes after a nibble of 15 */
+static uint8_t *
+put_length(uint8_t *op, const uint8_t *oend, size_t len) {
+  for (; len >= 255; len -= 255) {
+    if (op >= oend)
+      return NULL;
+    *op++ = 255;
+  }
+  if (op >= oend)
+    return NULL;
+  *op++ = (uint8_t)len;
+  return op;
+}
+
+/* Token, literals and, unless this is the last sequence, the match */
+static uint8_t *
+put_sequence(uint8_t *op,
+    const uint8_t *oend,
+    const uint8_t *lit,
+    size_t nr_lit,
+    size_t offset,
+    size_t match) {
+  size_t ml = match ? match - MIN_MATCH : 0;
+
+  if (op >= oend)
+    return NULL;
+  *op++ = (uint8_t)((nr_lit < 15 ? nr_lit : 15) << 4 | (ml < 15 ? ml : 15));
+  if (nr_lit >= 15 && (op = put_length(op, oend, nr_lit - 15)) == NULL)
+    return NULL;
+
+  if ((size_t)(oend - op) < nr_lit)
+    return NULL;
+  memcpy(op, lit, nr_lit);
+  op += nr_lit;
+
+  if (match == 0)
+    return op;
+  if (oend - op < 2)
+    return NULL;
+  *op++ = (uint8_t)offset;
+  *op++ = (uint8_t)(offset >> 8);
+  if (ml >= 15 && (op = put_length(op, oend, ml - 15)) == NULL)
+    return NULL;
+  return op;
+}
+
+size_t
+lz_compress(const uint8_t *in, size_t len, uint8_t *out, size_t cap) {
+  uint32_t table[1 << HASH_BITS]; /* position + 1, 0 = empty */
+  const uint8_t *oend = out + cap;
+  uint8_t *op = out;
+  size_t ip = 0, anchor = 0;
+
+  memset(table, 0, sizeof(table));
+
+  while (ip + MIN_MATCH <= len) {
+    uint32_t h = hash4(in + ip);
+    size_t ref = table[h];
+    table[h] = (uint32_t)(ip + 1);
+
+    if (ref-- == 0 || ip - ref > MAX_OFFSET || read32(in + ref) != read32(in + ip)) {
+      ip++;
+      continue;
+    }
+
+    size_t match = MIN_MATCH;
+    while (ip + match < len && in[ref + match] == in[ip + match])
+      match++;
+
+    op = put_sequence(op, oend, in + anchor, ip - anchor, ip - ref, match);
+    if (op == NULL)
+      return 0;
+    ip += match;
+    anchor = ip;
+  }
+
+  op = put_sequence(op, oend, in + anchor, len - anchor, 0, 0);
+  return op ? (size_t)(op - out) : 0;
+}
+
+/* Length continued by extra bytes when the nibble is 15 */
+static int
+get_length(const uint8_t **ip, const uint8_t *iend, size_t *len) {
+  if (*len < 15)
+    return 0;
+  for (;;) {
+    if (*ip >= iend)
+      return -1;
+    uint8_t b = *(*ip)++;
+    *len += b;
+    if (b != 255)
+      return 0;
+  }
+}
+
+int
+lz_decompress(const uint8_t *in, size_t len, uint8_t *out, size_t out_len) {
+  const uint8_t *ip = in, *iend = in + len;
+  size_t op = 0;
+
+  for (;;) {
+    if (ip >= iend)
+      return -1;
+    uint8_t token = *ip++;
+
+    size_t nr_lit = token >> 4;
+    if (get_length(&ip, iend, &nr_lit) < 0 || (size_t)(iend - ip) < nr_lit ||
+        out_len - op < nr_lit)
+      return -1;
+    memcpy(out + op, ip, nr_lit);
+    ip += nr_lit;
+    op += nr_lit;
+
+    /* Only the last sequence ends with the input, and it has no match */
+    if (ip == iend) {
+      if (token & 0x0F)
+        return -1;
+      break;
+    }
+
+    if (iend - ip < 2)
+      return -1;
+    size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+    ip += 2;
+    size_t match = token & 0x0F;
+    if (get_length(&ip, iend, &match) < 0)
+      return -1;
+    match += MIN_MATCH;
+    if (offset == 0 || offset > op || out_len - op < match)
+      return -1;
+
+    /* Byte by byte: the match may overlap what it produces */
+    for (size_t i = 0; i < match; i++, op++)
+      out[op] = out[op - offset];
+  }
+
+  return op == out_len ? 0 : -1;
+}
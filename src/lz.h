@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Small LZ77 block compressor (byte-oriented, no entropy coding)
+ */
+
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Compress len bytes of in into out (at most cap bytes)
+ * Returns: compressed length, 0 if it does not fit in cap
+ */
+size_t lz_compress(const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+
+/*
+ * Decompress exactly out_len bytes
+ * Returns: 0 on success, -1 if the input is malformed or of another length
+ */
+int lz_decompress(const uint8_t *in, size_t len, uint8_t *out, size_t out_len);
+
+#endif /* LZ_H */
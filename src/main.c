@@ -6,13 +6,19 @@
  * RADFU - Renesas RA Device Firmware Update tool
  */
 
+#define _DEFAULT_SOURCE
+
 #include "compat.h"
 #include "formats.h"
+#include "manifest.h"
 #include "progress.h"
 #include "raconnect.h"
 #include "radfu.h"
 #include "raosis.h"
+#include "rastore.h"
+#include "rfi.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -31,13 +37,15 @@ usage(int status) {
       "\n"
       "Commands:\n"
       "  status         Show comprehensive device status with ASCII diagram\n"
+      "  status --from <backup>  Same report from a backup file, no device needed\n"
       "  info           Show device and memory information\n"
       "  read <file>    Read flash memory to file\n"
       "  write <file>[:<addr>] ...  Write file(s) to flash memory\n"
       "  verify <file>  Verify flash memory against file\n"
+      "  diff <file>    Show which flash ranges differ from file (CRC bisection)\n"
       "  erase          Erase flash sectors\n"
       "  blank-check    Check if flash region is erased (code flash only)\n"
-      "  crc            Calculate CRC-32 of flash region\n"
+      "  crc            Calculate CRC-32 of flash region (or of a file with --file)\n"
       "  dlm            Show Device Lifecycle Management state\n"
       "  dlm-transit <state>  Transition DLM state (ssd/nsecsd/dpl/lck_dbg/lck_boot)\n"
       "  dlm-auth <state> <key>  Authenticated DLM transition (ssd/nsecsd/rma_req)\n"
@@ -49,8 +57,11 @@ usage(int status) {
       "  init           Initialize device (factory reset to SSD state)\n"
       "  osis           Show OSIS (ID code protection) status\n"
       "  config-read    Read and display config area contents\n"
-      "  backup <file>  Backup all flash to file (requires .hex or .srec)\n"
+      "  backup <file>  Backup all flash to file (.hex, .srec or native .rbk)\n"
+      "  backup --store <dir>  Backup all flash into a deduplicating block store\n"
       "  restore <file> Restore flash from backup (full erase then write)\n"
+      "  restore --store <dir> [did]  Restore the last stored backup of a device\n"
+      "                       (default: the connected one)\n"
       "  fm2app-get     Read FM2APP boot preference partition from data flash\n"
       "  fm2app-set <field> <value>  Write FM2APP field (boot_pref, test_cmd)\n"
       "  key-set <type> <file>   Inject wrapped DLM key (secdbg|nonsecdbg|rma)\n"
@@ -58,7 +69,19 @@ usage(int status) {
       "  ukey-set <idx> <file>   Inject user wrapped key from file at index\n"
       "  ukey-verify <idx>       Verify user key at index\n"
       "  raw <cmd> [data...]     Send raw command (hex bytes) for protocol analysis\n"
-      "\n"
+      "  provision <manifest>    Bring the device to the state a manifest describes\n"
+      "  batch <script>          Run one command per script line over one connection\n"
+      "                          (- reads the script from stdin)\n"
+      "  compile <file> -o <out.rfi>  Pre-build the write packets of an image (offline)\n"
+      "  gc --store <dir>        Remove blocks no device backup uses any more (offline)\n"
+      "  identify --db <file>    Name the firmware release the device runs (CRCs only)\n"
+      "  identify --db <file> --add <image>  Fingerprint a release image (offline)\n"
+      "  inventory [--all] [--json]  Signature, DLM, boundary, OSIS and area CRCs\n"
+      "                          (--all: every connected board, scanned concurrently)\n"
+      "\n");
+
+  /* Split in two: ISO C caps string literals at 4095 characters */
+  fprintf(out,
       "Options:\n"
       "  -p, --port <dev>     Serial port (auto-detect if omitted)\n"
       "  -a, --address <hex>  Start address (default: 0x0)\n"
@@ -67,18 +90,37 @@ usage(int status) {
       "  -i, --id <hex>       ID code for authentication (32 hex chars)\n"
       "  -e, --erase-all      Erase all areas using ALeRASE magic ID\n"
       "  -v, --verify         Verify after write\n"
-      "  -f, --input-format <fmt>  Input file format (auto/bin/ihex/srec)\n"
-      "  -F, --output-format <fmt> Output file format (auto/bin/ihex/srec)\n"
+      "  -f, --input-format <fmt>  Input file format (auto/bin/ihex/srec/rfi/elf/rbk)\n"
+      "  -F, --output-format <fmt> Output file format (auto/bin/ihex/srec/rbk)\n"
       "      --area <type>    Select memory area (code/data/config or KOA value)\n"
       "      --bank <n>       Select bank for dual bank mode (0 or 1)\n"
       "  -u, --uart           Use plain UART mode (P109/P110 pins)\n"
       "  -q, --quiet          Suppress progress bar output\n"
+      "  -o, --output <file>  Output file (compile)\n"
       "      --cfs1 <KB>      Code flash secure region size without NSC\n"
       "      --cfs2 <KB>      Code flash secure region size (total)\n"
       "      --dfs <KB>       Data flash secure region size\n"
       "      --srs1 <KB>      SRAM secure region size without NSC\n"
       "      --srs2 <KB>      SRAM secure region size (total)\n"
-      "      --file <rpd>     Load boundary settings from .rpd file\n"
+      "      --file <file>    Load boundary settings from .rpd file (boundary-set)\n"
+      "                       or image to checksum offline (crc)\n"
+      "      --compare        With crc --file: compare file CRCs against the device\n"
+      "      --no-cache       Do not use the on-disk device layout cache\n"
+      "      --dry-run        With provision: show the plan, change nothing\n"
+      "      --record-bytes <n>  Data bytes per HEX/S-record record (default: 16, max: 255)\n"
+      "      --skip-blank     Leave erased (all 0xFF) blocks out of HEX/S-record output\n"
+      "      --store <dir>    Block store directory (backup, restore, gc)\n"
+      "      --base <file>    With backup: previous backup, only changed blocks are read\n"
+      "      --delta cached   With write: erase and program only the erase blocks changed\n"
+      "                       since the last write to this device (always CRC verified)\n"
+      "      --from <file>    Decode a backup instead of the device (status, config-read,\n"
+      "                       fm2app-get)\n"
+      "      --db <file>      Firmware fingerprint database (identify)\n"
+      "      --add <image>    With identify: add a release image to the database\n"
+      "      --all            With inventory: every connected Renesas USB board\n"
+      "      --json           With inventory: one JSON object per board and line\n"
+      "      --progress-fd <n>  Progress events to file descriptor n instead of the bar\n"
+      "      --progress-format jsonl  With --progress-fd: event format (default and only: jsonl)\n"
       "  -h, --help           Show this help message\n"
       "  -V, --version        Show version\n"
       "\n"
@@ -94,16 +136,19 @@ version(void) {
   exit(EXIT_SUCCESS);
 }
 
-static uint32_t
-parse_hex(const char *str) {
+static int
+parse_hex(const char *str, uint32_t *out) {
   char *endptr;
   unsigned long val;
 
   val = strtoul(str, &endptr, 16);
-  if (*endptr != '\0')
-    errx(EXIT_FAILURE, "invalid hex value: %s", str);
+  if (*endptr != '\0') {
+    warnx("invalid hex value: %s", str);
+    return -1;
+  }
 
-  return (uint32_t)val;
+  *out = (uint32_t)val;
+  return 0;
 }
 
 #define ID_CODE_LEN 16
@@ -193,6 +238,7 @@ enum command {
   CMD_READ,
   CMD_WRITE,
   CMD_VERIFY,
+  CMD_DIFF,
   CMD_ERASE,
   CMD_BLANK_CHECK,
   CMD_CRC,
@@ -215,6 +261,12 @@ enum command {
   CMD_RESTORE,
   CMD_FM2APP_GET,
   CMD_FM2APP_SET,
+  CMD_PROVISION,
+  CMD_BATCH,
+  CMD_COMPILE,
+  CMD_GC,
+  CMD_IDENTIFY,
+  CMD_INVENTORY,
 };
 
 /* FM2APP field name tokens */
@@ -254,11 +306,6 @@ static const struct {
   { NULL,       0    },
 };
 
-/* DLM key types (KYTY) per R01AN5562 */
-#define KYTY_SECDBG 0x01
-#define KYTY_NONSECDBG 0x02
-#define KYTY_RMA 0x03
-
 /* DLM authentication key length (16 bytes / 128 bits) */
 #define DLM_AUTH_KEY_LEN 16
 
@@ -338,82 +385,6 @@ parse_auth_key(const char *str, uint8_t *key) {
   }
 }
 
-/*
- * Parse .rpd (Renesas Partition Data) file for TrustZone boundary settings
- * Format: key=value lines where values are hex (with 0x prefix) in bytes
- * Keys: FLASH_S_SIZE, FLASH_C_SIZE, RAM_S_SIZE, RAM_C_SIZE, DATA_FLASH_S_SIZE
- * Converts bytes to KB for boundary settings
- * Returns: 0 on success, -1 on error
- */
-static int
-parse_rpd_file(const char *filename, ra_boundary_t *bnd) {
-  FILE *f = fopen(filename, "r");
-  if (!f) {
-    warn("failed to open boundary file: %s", filename);
-    return -1;
-  }
-
-  char line[256];
-  bool found_cfs1 = false, found_cfs2 = false, found_dfs = false;
-  bool found_srs1 = false, found_srs2 = false;
-
-  while (fgets(line, sizeof(line), f)) {
-    char *eq = strchr(line, '=');
-    if (!eq)
-      continue;
-
-    *eq = '\0';
-    const char *key = line;
-    const char *val = eq + 1;
-
-    /* Skip 0x prefix if present */
-    if (val[0] == '0' && (val[1] == 'x' || val[1] == 'X'))
-      val += 2;
-
-    char *endptr;
-    unsigned long bytes = strtoul(val, &endptr, 16);
-
-    /* Convert bytes to KB */
-    uint16_t kb = (uint16_t)(bytes / 1024);
-
-    if (strcmp(key, "FLASH_S_SIZE") == 0) {
-      bnd->cfs1 = kb;
-      found_cfs1 = true;
-    } else if (strcmp(key, "FLASH_C_SIZE") == 0) {
-      bnd->cfs2 = kb;
-      found_cfs2 = true;
-    } else if (strcmp(key, "RAM_S_SIZE") == 0) {
-      bnd->srs1 = kb;
-      found_srs1 = true;
-    } else if (strcmp(key, "RAM_C_SIZE") == 0) {
-      bnd->srs2 = kb;
-      found_srs2 = true;
-    } else if (strcmp(key, "DATA_FLASH_S_SIZE") == 0) {
-      bnd->dfs = kb;
-      found_dfs = true;
-    }
-  }
-
-  fclose(f);
-
-  if (!found_cfs1 || !found_cfs2 || !found_dfs || !found_srs1 || !found_srs2) {
-    warnx("incomplete .rpd file: missing required fields");
-    if (!found_cfs1)
-      warnx("  missing FLASH_S_SIZE (CFS1)");
-    if (!found_cfs2)
-      warnx("  missing FLASH_C_SIZE (CFS2)");
-    if (!found_dfs)
-      warnx("  missing DATA_FLASH_S_SIZE (DFS)");
-    if (!found_srs1)
-      warnx("  missing RAM_S_SIZE (SRS1)");
-    if (!found_srs2)
-      warnx("  missing RAM_C_SIZE (SRS2)");
-    return -1;
-  }
-
-  return 0;
-}
-
 /*
  * Parse key type from string: accepts numeric (1,2,3) or keywords
  * Keywords: secdbg, nonsecdbg, rma (case-insensitive)
@@ -447,164 +418,401 @@ parse_key_type(const char *str) {
 #define OPT_AREA 261
 #define OPT_BOUNDARY_FILE 262
 #define OPT_BANK 263
+#define OPT_COMPARE 264
+#define OPT_NO_CACHE 265
+#define OPT_DRY_RUN 266
+#define OPT_RECORD_BYTES 267
+#define OPT_SKIP_BLANK 268
+#define OPT_STORE 269
+#define OPT_BASE 270
+#define OPT_DELTA 271
+#define OPT_FROM 272
+#define OPT_DB 273
+#define OPT_ADD 274
+#define OPT_ALL 275
+#define OPT_JSON 276
+#define OPT_PROGRESS_FD 277
+#define OPT_PROGRESS_FORMAT 278
 
 static const struct option longopts[] = {
-  { "port",          required_argument, NULL, 'p'               },
-  { "address",       required_argument, NULL, 'a'               },
-  { "size",          required_argument, NULL, 's'               },
-  { "baudrate",      required_argument, NULL, 'b'               },
-  { "id",            required_argument, NULL, 'i'               },
-  { "erase-all",     no_argument,       NULL, 'e'               },
-  { "verify",        no_argument,       NULL, 'v'               },
-  { "input-format",  required_argument, NULL, 'f'               },
-  { "output-format", required_argument, NULL, 'F'               },
-  { "uart",          no_argument,       NULL, 'u'               },
-  { "quiet",         no_argument,       NULL, 'q'               },
-  { "cfs1",          required_argument, NULL, OPT_CFS1          },
-  { "cfs2",          required_argument, NULL, OPT_CFS2          },
-  { "dfs",           required_argument, NULL, OPT_DFS           },
-  { "srs1",          required_argument, NULL, OPT_SRS1          },
-  { "srs2",          required_argument, NULL, OPT_SRS2          },
-  { "area",          required_argument, NULL, OPT_AREA          },
-  { "bank",          required_argument, NULL, OPT_BANK          },
-  { "file",          required_argument, NULL, OPT_BOUNDARY_FILE },
-  { "help",          no_argument,       NULL, 'h'               },
-  { "version",       no_argument,       NULL, 'V'               },
-  { NULL,            0,                 NULL, 0                 }
+  { "port",            required_argument, NULL, 'p'                 },
+  { "address",         required_argument, NULL, 'a'                 },
+  { "size",            required_argument, NULL, 's'                 },
+  { "baudrate",        required_argument, NULL, 'b'                 },
+  { "id",              required_argument, NULL, 'i'                 },
+  { "erase-all",       no_argument,       NULL, 'e'                 },
+  { "verify",          no_argument,       NULL, 'v'                 },
+  { "input-format",    required_argument, NULL, 'f'                 },
+  { "output-format",   required_argument, NULL, 'F'                 },
+  { "uart",            no_argument,       NULL, 'u'                 },
+  { "quiet",           no_argument,       NULL, 'q'                 },
+  { "output",          required_argument, NULL, 'o'                 },
+  { "cfs1",            required_argument, NULL, OPT_CFS1            },
+  { "cfs2",            required_argument, NULL, OPT_CFS2            },
+  { "dfs",             required_argument, NULL, OPT_DFS             },
+  { "srs1",            required_argument, NULL, OPT_SRS1            },
+  { "srs2",            required_argument, NULL, OPT_SRS2            },
+  { "area",            required_argument, NULL, OPT_AREA            },
+  { "bank",            required_argument, NULL, OPT_BANK            },
+  { "file",            required_argument, NULL, OPT_BOUNDARY_FILE   },
+  { "compare",         no_argument,       NULL, OPT_COMPARE         },
+  { "no-cache",        no_argument,       NULL, OPT_NO_CACHE        },
+  { "dry-run",         no_argument,       NULL, OPT_DRY_RUN         },
+  { "record-bytes",    required_argument, NULL, OPT_RECORD_BYTES    },
+  { "skip-blank",      no_argument,       NULL, OPT_SKIP_BLANK      },
+  { "store",           required_argument, NULL, OPT_STORE           },
+  { "base",            required_argument, NULL, OPT_BASE            },
+  { "delta",           required_argument, NULL, OPT_DELTA           },
+  { "from",            required_argument, NULL, OPT_FROM            },
+  { "db",              required_argument, NULL, OPT_DB              },
+  { "add",             required_argument, NULL, OPT_ADD             },
+  { "all",             no_argument,       NULL, OPT_ALL             },
+  { "json",            no_argument,       NULL, OPT_JSON            },
+  { "progress-fd",     required_argument, NULL, OPT_PROGRESS_FD     },
+  { "progress-format", required_argument, NULL, OPT_PROGRESS_FORMAT },
+  { "help",            no_argument,       NULL, 'h'                 },
+  { "version",         no_argument,       NULL, 'V'                 },
+  { NULL,              0,                 NULL, 0                   }
 };
 
-int
-main(int argc, char *argv[]) {
-  const char *port = NULL;
-  const char *file = NULL;
-  const char *id_str = NULL;
+/* Maximum number of data bytes for the raw command */
+#define MAX_RAW_DATA 256
+
+/* Everything one command line (or one batch step) asks for */
+typedef struct {
+  const char *port;
+  const char *file;
+  const char *output;
+  const char *id_str;
   uint8_t id_code[ID_CODE_LEN];
-  uint32_t address = 0;
-  uint32_t size = 0;
-  uint32_t baudrate = 0;
-  bool verify = false;
-  bool use_auth = false;
-  bool erase_all = false;
-  bool uart_mode = false;
-  input_format_t input_format = FORMAT_AUTO;
-  output_format_t output_format = FORMAT_AUTO;
-  uint8_t dest_dlm = 0;
-  uint8_t param_value = 0;
-  uint8_t key_index = 0;
-  const char *key_file = NULL;
+  uint32_t address;
+  uint32_t size;
+  uint32_t baudrate;
+  bool verify;
+  bool use_auth;
+  bool erase_all;
+  bool uart_mode;
+  bool quiet; /* No progress bar, for this command (or batch step) only */
+  bool no_cache;
+  bool dry_run;
+  unsigned record_bytes; /* HEX/S-record data bytes per record */
+  bool skip_blank;
+  const char *store; /* Block store directory (backup/restore/gc) */
+  const char *base;  /* Previous backup for an incremental backup */
+  bool delta_cached; /* write: only the erase blocks changed since the last write */
+  const char *from;  /* Backup file decoded instead of the device (status/config/fm2app) */
+  const char *db;    /* Firmware fingerprint database (identify) */
+  const char *add;   /* identify: release image to fingerprint */
+  bool all;          /* inventory: every connected board */
+  bool json;         /* inventory: JSON lines output */
+  int progress_fd;   /* Progress events as JSON lines, -1 for the bar */
+  const char *progress_format;
+  input_format_t input_format;
+  output_format_t output_format;
+  uint8_t dest_dlm;
+  uint8_t param_value;
+  uint8_t key_index;
+  const char *key_file;
   uint8_t auth_key[DLM_AUTH_KEY_LEN];
-  ra_boundary_t bnd = { 0 };
-  bool bnd_cfs1_set = false, bnd_cfs2_set = false, bnd_dfs_set = false;
-  bool bnd_srs1_set = false, bnd_srs2_set = false;
-  const char *boundary_file = NULL;
-  int8_t area_koa = -1; /* -1 = not set, 0/1/2 = code/data/config */
-  int8_t bank = -1;     /* -1 = not set, 0/1 = bank selection for dual bank mode */
-  bool addr_explicit = false, size_explicit = false;
+  ra_boundary_t bnd;
+  bool bnd_cfs1_set, bnd_cfs2_set, bnd_dfs_set;
+  bool bnd_srs1_set, bnd_srs2_set;
+  const char *boundary_file;
+  bool crc_compare;
+  int8_t area_koa; /* -1 = not set, 0/1/2 = code/data/config */
+  int8_t bank;     /* -1 = not set, 0/1 = bank selection for dual bank mode */
+  bool addr_explicit, size_explicit;
   write_entry_t write_entries[MAX_WRITE_FILES];
-  int write_count = 0;
-  enum command cmd = CMD_NONE;
+  int write_count;
+  fm2app_field_t fm2app_field;
+  uint8_t fm2app_value;
+  uint8_t raw_cmd;
+  uint8_t raw_data[MAX_RAW_DATA];
+  size_t raw_len;
+  manifest_t *manifest;
+  enum command cmd;
+} options_t;
+
+/*
+ * Parse fm2app-set <field> <value> using the token tables (value may be numeric)
+ */
+static int
+parse_fm2app_set(const char *field_name, const char *value_str, options_t *o) {
+  bool found;
+
+  /* Parse field name using token table */
+  found = false;
+  for (int i = 0; fm2app_field_tokens[i].name != NULL; i++) {
+    if (strcmp(field_name, fm2app_field_tokens[i].name) == 0) {
+      o->fm2app_field = fm2app_field_tokens[i].field;
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    warnx("unknown field: %s (use boot_pref, retry_count, test_cmd, test_result)", field_name);
+    return -1;
+  }
+
+  /* Parse value using token tables or hex */
+  found = false;
+  if (o->fm2app_field == FM2APP_BOOT_PREF) {
+    for (int i = 0; fm2app_boot_pref_tokens[i].name != NULL; i++) {
+      if (strcmp(value_str, fm2app_boot_pref_tokens[i].name) == 0) {
+        o->fm2app_value = fm2app_boot_pref_tokens[i].value;
+        found = true;
+        break;
+      }
+    }
+  } else if (o->fm2app_field == FM2APP_TEST_CMD) {
+    for (int i = 0; fm2app_test_cmd_tokens[i].name != NULL; i++) {
+      if (strcmp(value_str, fm2app_test_cmd_tokens[i].name) == 0) {
+        o->fm2app_value = fm2app_test_cmd_tokens[i].value;
+        found = true;
+        break;
+      }
+    }
+  }
+  if (!found)
+    o->fm2app_value = (uint8_t)strtoul(value_str, NULL, 0);
+  return 0;
+}
+
+/*
+ * Parse raw <cmd> [data...] hex bytes
+ */
+static int
+parse_raw(int argc, char *argv[], int first, options_t *o) {
+  char *endptr;
+  unsigned long val = strtoul(argv[first], &endptr, 16);
+  if (*endptr != '\0' || val > 0xFF) {
+    warnx("invalid command byte: %s (use hex 0x00-0xFF)", argv[first]);
+    return -1;
+  }
+  o->raw_cmd = (uint8_t)val;
+
+  for (int i = first + 1; i < argc && o->raw_len < MAX_RAW_DATA; i++) {
+    val = strtoul(argv[i], &endptr, 16);
+    if (*endptr != '\0' || val > 0xFF) {
+      warnx("invalid data byte: %s (use hex 0x00-0xFF)", argv[i]);
+      return -1;
+    }
+    o->raw_data[o->raw_len++] = (uint8_t)val;
+  }
+  return 0;
+}
+
+/* parse_args() result for a missing command or a bad option */
+#define PARSE_USAGE (-2)
+
+/*
+ * Parse one command line into o
+ * Used for the process arguments and for each batch step, so getopt state is
+ * reset first. Errors are reported before any device traffic.
+ * Returns: 0 on success, -1 on error, PARSE_USAGE when the usage text applies
+ */
+static int
+parse_args(int argc, char *argv[], options_t *o) {
   int opt;
 
-  while ((opt = getopt_long(argc, argv, "p:a:s:b:i:evf:F:uqhV", longopts, NULL)) != -1) {
+  memset(o, 0, sizeof(*o));
+  o->input_format = FORMAT_AUTO;
+  o->output_format = FORMAT_AUTO;
+  o->area_koa = -1;
+  o->bank = -1;
+  o->cmd = CMD_NONE;
+  o->record_bytes = FORMAT_RECORD_BYTES_DEFAULT;
+  o->progress_fd = -1;
+
+  optind = 0; /* Full reinitialization (GNU and BSD getopt_long) */
+  while ((opt = getopt_long(argc, argv, "p:a:s:b:i:evf:F:uqo:hV", longopts, NULL)) != -1) {
     switch (opt) {
     case 'p':
-      port = optarg;
+      o->port = optarg;
       break;
     case 'a':
-      address = parse_hex(optarg);
-      addr_explicit = true;
+      if (parse_hex(optarg, &o->address) < 0)
+        return -1;
+      o->addr_explicit = true;
       break;
     case 's':
-      size = parse_hex(optarg);
-      size_explicit = true;
+      if (parse_hex(optarg, &o->size) < 0)
+        return -1;
+      o->size_explicit = true;
       break;
     case 'b':
-      baudrate = (uint32_t)strtoul(optarg, NULL, 10);
+      o->baudrate = (uint32_t)strtoul(optarg, NULL, 10);
       break;
     case 'i':
-      id_str = optarg;
+      o->id_str = optarg;
       break;
     case 'e':
-      erase_all = true;
+      o->erase_all = true;
       break;
     case 'v':
-      verify = true;
+      o->verify = true;
       break;
     case 'f':
       if (strcasecmp(optarg, "auto") == 0)
-        input_format = FORMAT_AUTO;
+        o->input_format = FORMAT_AUTO;
       else if (strcasecmp(optarg, "bin") == 0 || strcasecmp(optarg, "binary") == 0)
-        input_format = FORMAT_BIN;
+        o->input_format = FORMAT_BIN;
       else if (strcasecmp(optarg, "ihex") == 0 || strcasecmp(optarg, "hex") == 0)
-        input_format = FORMAT_IHEX;
+        o->input_format = FORMAT_IHEX;
       else if (strcasecmp(optarg, "srec") == 0 || strcasecmp(optarg, "s19") == 0)
-        input_format = FORMAT_SREC;
-      else
-        errx(EXIT_FAILURE, "unknown input format: %s (use auto/bin/ihex/srec)", optarg);
+        o->input_format = FORMAT_SREC;
+      else if (strcasecmp(optarg, "rfi") == 0)
+        o->input_format = FORMAT_RFI;
+      else if (strcasecmp(optarg, "elf") == 0)
+        o->input_format = FORMAT_ELF;
+      else if (strcasecmp(optarg, "rbk") == 0)
+        o->input_format = FORMAT_RBK;
+      else {
+        warnx("unknown input format: %s (use auto/bin/ihex/srec/rfi/elf/rbk)", optarg);
+        return -1;
+      }
       break;
     case 'F':
       if (strcasecmp(optarg, "auto") == 0)
-        output_format = FORMAT_AUTO;
+        o->output_format = FORMAT_AUTO;
       else if (strcasecmp(optarg, "bin") == 0 || strcasecmp(optarg, "binary") == 0)
-        output_format = FORMAT_BIN;
+        o->output_format = FORMAT_BIN;
       else if (strcasecmp(optarg, "ihex") == 0 || strcasecmp(optarg, "hex") == 0)
-        output_format = FORMAT_IHEX;
+        o->output_format = FORMAT_IHEX;
       else if (strcasecmp(optarg, "srec") == 0 || strcasecmp(optarg, "s19") == 0)
-        output_format = FORMAT_SREC;
-      else
-        errx(EXIT_FAILURE, "unknown output format: %s (use auto/bin/ihex/srec)", optarg);
+        o->output_format = FORMAT_SREC;
+      else if (strcasecmp(optarg, "rbk") == 0)
+        o->output_format = FORMAT_RBK;
+      else {
+        warnx("unknown output format: %s (use auto/bin/ihex/srec/rbk)", optarg);
+        return -1;
+      }
       break;
     case 'u':
-      uart_mode = true;
+      o->uart_mode = true;
       break;
     case 'q':
-      progress_global_quiet = 1;
+      o->quiet = true;
+      break;
+    case 'o':
+      o->output = optarg;
       break;
     case OPT_CFS1:
-      bnd.cfs1 = (uint16_t)strtoul(optarg, NULL, 10);
-      bnd_cfs1_set = true;
+      o->bnd.cfs1 = (uint16_t)strtoul(optarg, NULL, 10);
+      o->bnd_cfs1_set = true;
       break;
     case OPT_CFS2:
-      bnd.cfs2 = (uint16_t)strtoul(optarg, NULL, 10);
-      bnd_cfs2_set = true;
+      o->bnd.cfs2 = (uint16_t)strtoul(optarg, NULL, 10);
+      o->bnd_cfs2_set = true;
       break;
     case OPT_DFS:
-      bnd.dfs = (uint16_t)strtoul(optarg, NULL, 10);
-      bnd_dfs_set = true;
+      o->bnd.dfs = (uint16_t)strtoul(optarg, NULL, 10);
+      o->bnd_dfs_set = true;
       break;
     case OPT_SRS1:
-      bnd.srs1 = (uint16_t)strtoul(optarg, NULL, 10);
-      bnd_srs1_set = true;
+      o->bnd.srs1 = (uint16_t)strtoul(optarg, NULL, 10);
+      o->bnd_srs1_set = true;
       break;
     case OPT_SRS2:
-      bnd.srs2 = (uint16_t)strtoul(optarg, NULL, 10);
-      bnd_srs2_set = true;
+      o->bnd.srs2 = (uint16_t)strtoul(optarg, NULL, 10);
+      o->bnd_srs2_set = true;
       break;
     case OPT_AREA:
       if (strcasecmp(optarg, "code") == 0)
-        area_koa = KOA_TYPE_CODE;
+        o->area_koa = KOA_TYPE_CODE;
       else if (strcasecmp(optarg, "data") == 0)
-        area_koa = KOA_TYPE_DATA;
+        o->area_koa = KOA_TYPE_DATA;
       else if (strcasecmp(optarg, "config") == 0)
-        area_koa = KOA_TYPE_CONFIG;
+        o->area_koa = KOA_TYPE_CONFIG;
       else {
         char *endptr;
         unsigned long val = strtoul(optarg, &endptr, 0);
-        if (*endptr != '\0' || val > 0x20)
-          errx(EXIT_FAILURE, "invalid area: %s (use code/data/config or KOA value)", optarg);
-        area_koa = (int8_t)val;
+        if (*endptr != '\0' || val > 0x20) {
+          warnx("invalid area: %s (use code/data/config or KOA value)", optarg);
+          return -1;
+        }
+        o->area_koa = (int8_t)val;
       }
       break;
     case OPT_BANK: {
       char *endptr;
       long val = strtol(optarg, &endptr, 10);
-      if (*endptr != '\0' || val < 0 || val > 1)
-        errx(EXIT_FAILURE, "invalid bank: %s (use 0 or 1)", optarg);
-      bank = (int8_t)val;
+      if (*endptr != '\0' || val < 0 || val > 1) {
+        warnx("invalid bank: %s (use 0 or 1)", optarg);
+        return -1;
+      }
+      o->bank = (int8_t)val;
       break;
     }
     case OPT_BOUNDARY_FILE:
-      boundary_file = optarg;
+      o->boundary_file = optarg;
+      break;
+    case OPT_COMPARE:
+      o->crc_compare = true;
+      break;
+    case OPT_NO_CACHE:
+      o->no_cache = true;
+      break;
+    case OPT_DRY_RUN:
+      o->dry_run = true;
+      break;
+    case OPT_RECORD_BYTES: {
+      char *endptr;
+      unsigned long val = strtoul(optarg, &endptr, 0);
+      if (*endptr != '\0' || val == 0 || val > FORMAT_RECORD_BYTES_MAX) {
+        warnx("invalid record size: %s (1-255, e.g. 16/32/64/255)", optarg);
+        return -1;
+      }
+      o->record_bytes = (unsigned)val;
+      break;
+    }
+    case OPT_SKIP_BLANK:
+      o->skip_blank = true;
+      break;
+    case OPT_STORE:
+      o->store = optarg;
+      break;
+    case OPT_BASE:
+      o->base = optarg;
+      break;
+    case OPT_DELTA:
+      if (strcmp(optarg, "cached") != 0) {
+        warnx("invalid delta mode: %s (use cached)", optarg);
+        return -1;
+      }
+      o->delta_cached = true;
+      break;
+    case OPT_FROM:
+      o->from = optarg;
+      break;
+    case OPT_DB:
+      o->db = optarg;
+      break;
+    case OPT_ADD:
+      o->add = optarg;
+      break;
+    case OPT_ALL:
+      o->all = true;
+      break;
+    case OPT_JSON:
+      o->json = true;
+      break;
+    case OPT_PROGRESS_FD: {
+      char *endptr;
+      long val = strtol(optarg, &endptr, 10);
+      if (*endptr != '\0' || val < 0 || val > INT_MAX) {
+        warnx("invalid progress fd: %s", optarg);
+        return -1;
+      }
+      o->progress_fd = (int)val;
+      break;
+    }
+    case OPT_PROGRESS_FORMAT:
+      if (strcasecmp(optarg, "jsonl") != 0) {
+        warnx("unknown progress format: %s (use jsonl)", optarg);
+        return -1;
+      }
+      o->progress_format = optarg;
       break;
     case 'h':
       usage(EXIT_SUCCESS);
@@ -613,522 +821,930 @@ main(int argc, char *argv[]) {
       version();
       break;
     default:
-      usage(EXIT_FAILURE);
+      return PARSE_USAGE;
     }
   }
 
+  if (o->progress_format != NULL && o->progress_fd < 0) {
+    warnx("--progress-format requires --progress-fd");
+    return -1;
+  }
+
   /* Handle ID code: either from --id or --erase-all */
-  if (erase_all) {
-    if (id_str != NULL) {
+  if (o->erase_all) {
+    if (o->id_str != NULL) {
       warnx("--erase-all and --id are mutually exclusive");
-      usage(EXIT_FAILURE);
+      return PARSE_USAGE;
     }
-    memcpy(id_code, ALERASE_ID, ID_CODE_LEN);
-    use_auth = true;
+    memcpy(o->id_code, ALERASE_ID, ID_CODE_LEN);
+    o->use_auth = true;
     warnx("note: ALeRASE requires OSIS[127:126]=10b (Locked with All Erase support)");
     warnx("      will fail if device has OSIS[127:126]=01b (Locked mode)");
-  } else if (id_str != NULL) {
-    if (parse_id_code(id_str, id_code) < 0)
-      errx(EXIT_FAILURE, "invalid ID code format");
-    use_auth = true;
+  } else if (o->id_str != NULL) {
+    if (parse_id_code(o->id_str, o->id_code) < 0) {
+      warnx("invalid ID code format");
+      return -1;
+    }
+    o->use_auth = true;
   }
 
   if (optind >= argc)
-    usage(EXIT_FAILURE);
+    return PARSE_USAGE;
 
   const char *command = argv[optind++];
 
   if (strcmp(command, "status") == 0) {
-    cmd = CMD_STATUS;
+    o->cmd = CMD_STATUS;
   } else if (strcmp(command, "info") == 0) {
-    cmd = CMD_INFO;
+    o->cmd = CMD_INFO;
   } else if (strcmp(command, "read") == 0) {
-    cmd = CMD_READ;
-    if (optind >= argc)
-      errx(EXIT_FAILURE, "read command requires a file argument");
-    file = argv[optind];
+    o->cmd = CMD_READ;
+    if (optind >= argc) {
+      warnx("read command requires a file argument");
+      return -1;
+    }
+    o->file = argv[optind];
   } else if (strcmp(command, "write") == 0) {
-    cmd = CMD_WRITE;
-    if (optind >= argc)
-      errx(EXIT_FAILURE, "write command requires at least one file argument");
+    o->cmd = CMD_WRITE;
+    if (optind >= argc) {
+      warnx("write command requires at least one file argument");
+      return -1;
+    }
     /* Parse all remaining arguments as file:address pairs */
-    while (optind < argc && write_count < MAX_WRITE_FILES) {
-      if (parse_write_entry(argv[optind], &write_entries[write_count]) < 0)
-        errx(EXIT_FAILURE, "failed to parse file argument: %s", argv[optind]);
-      write_count++;
+    while (optind < argc && o->write_count < MAX_WRITE_FILES) {
+      if (parse_write_entry(argv[optind], &o->write_entries[o->write_count]) < 0) {
+        warnx("failed to parse file argument: %s", argv[optind]);
+        return -1;
+      }
+      o->write_count++;
       optind++;
     }
-    if (write_count == 0)
-      errx(EXIT_FAILURE, "write command requires at least one file argument");
+    if (o->write_count == 0) {
+      warnx("write command requires at least one file argument");
+      return -1;
+    }
     /* For single file, also set file/address for backward compatibility */
-    if (write_count == 1) {
-      file = write_entries[0].path;
-      if (write_entries[0].has_address && address == 0)
-        address = write_entries[0].address;
+    if (o->write_count == 1) {
+      o->file = o->write_entries[0].path;
+      if (o->write_entries[0].has_address && o->address == 0)
+        o->address = o->write_entries[0].address;
+    }
+    if (o->delta_cached && (o->write_count != 1 || o->size != 0)) {
+      warnx("--delta writes a single whole file (no --size)");
+      return -1;
     }
   } else if (strcmp(command, "verify") == 0) {
-    cmd = CMD_VERIFY;
-    if (optind >= argc)
-      errx(EXIT_FAILURE, "verify command requires a file argument");
-    file = argv[optind];
+    o->cmd = CMD_VERIFY;
+    if (optind >= argc) {
+      warnx("verify command requires a file argument");
+      return -1;
+    }
+    o->file = argv[optind];
+  } else if (strcmp(command, "diff") == 0) {
+    o->cmd = CMD_DIFF;
+    if (optind >= argc) {
+      warnx("diff command requires a file argument");
+      return -1;
+    }
+    o->file = argv[optind];
   } else if (strcmp(command, "erase") == 0) {
-    cmd = CMD_ERASE;
+    o->cmd = CMD_ERASE;
   } else if (strcmp(command, "blank-check") == 0) {
-    cmd = CMD_BLANK_CHECK;
+    o->cmd = CMD_BLANK_CHECK;
   } else if (strcmp(command, "crc") == 0) {
-    cmd = CMD_CRC;
+    o->cmd = CMD_CRC;
+    if (o->crc_compare && o->boundary_file == NULL) {
+      warnx("crc --compare requires --file <image>");
+      return -1;
+    }
   } else if (strcmp(command, "dlm") == 0) {
-    cmd = CMD_DLM;
+    o->cmd = CMD_DLM;
   } else if (strcmp(command, "dlm-transit") == 0) {
-    cmd = CMD_DLM_TRANSIT;
-    if (optind >= argc)
-      errx(EXIT_FAILURE, "dlm-transit requires a state argument (ssd/nsecsd/dpl/lck_dbg/lck_boot)");
+    o->cmd = CMD_DLM_TRANSIT;
+    if (optind >= argc) {
+      warnx("dlm-transit requires a state argument (ssd/nsecsd/dpl/lck_dbg/lck_boot)");
+      return -1;
+    }
     const char *state = argv[optind];
     if (strcasecmp(state, "ssd") == 0)
-      dest_dlm = DLM_STATE_SSD;
+      o->dest_dlm = DLM_STATE_SSD;
     else if (strcasecmp(state, "nsecsd") == 0)
-      dest_dlm = DLM_STATE_NSECSD;
+      o->dest_dlm = DLM_STATE_NSECSD;
     else if (strcasecmp(state, "dpl") == 0)
-      dest_dlm = DLM_STATE_DPL;
+      o->dest_dlm = DLM_STATE_DPL;
     else if (strcasecmp(state, "lck_dbg") == 0)
-      dest_dlm = DLM_STATE_LCK_DBG;
+      o->dest_dlm = DLM_STATE_LCK_DBG;
     else if (strcasecmp(state, "lck_boot") == 0)
-      dest_dlm = DLM_STATE_LCK_BOOT;
-    else
-      errx(EXIT_FAILURE, "unknown DLM state: %s (use ssd/nsecsd/dpl/lck_dbg/lck_boot)", state);
+      o->dest_dlm = DLM_STATE_LCK_BOOT;
+    else {
+      warnx("unknown DLM state: %s (use ssd/nsecsd/dpl/lck_dbg/lck_boot)", state);
+      return -1;
+    }
   } else if (strcmp(command, "dlm-auth") == 0) {
-    cmd = CMD_DLM_AUTH;
-    if (optind + 1 >= argc)
-      errx(EXIT_FAILURE, "dlm-auth requires <state> and <key> arguments");
+    o->cmd = CMD_DLM_AUTH;
+    if (optind + 1 >= argc) {
+      warnx("dlm-auth requires <state> and <key> arguments");
+      return -1;
+    }
     const char *state = argv[optind];
     if (strcasecmp(state, "ssd") == 0)
-      dest_dlm = DLM_STATE_SSD;
+      o->dest_dlm = DLM_STATE_SSD;
     else if (strcasecmp(state, "nsecsd") == 0)
-      dest_dlm = DLM_STATE_NSECSD;
+      o->dest_dlm = DLM_STATE_NSECSD;
     else if (strcasecmp(state, "rma_req") == 0)
-      dest_dlm = DLM_STATE_RMA_REQ;
-    else
-      errx(EXIT_FAILURE, "dlm-auth: invalid target state: %s (use ssd/nsecsd/rma_req)", state);
-    if (parse_auth_key(argv[optind + 1], auth_key) < 0)
-      errx(EXIT_FAILURE, "dlm-auth: invalid key format");
+      o->dest_dlm = DLM_STATE_RMA_REQ;
+    else {
+      warnx("dlm-auth: invalid target state: %s (use ssd/nsecsd/rma_req)", state);
+      return -1;
+    }
+    if (parse_auth_key(argv[optind + 1], o->auth_key) < 0) {
+      warnx("dlm-auth: invalid key format");
+      return -1;
+    }
   } else if (strcmp(command, "boundary") == 0) {
-    cmd = CMD_BOUNDARY;
+    o->cmd = CMD_BOUNDARY;
   } else if (strcmp(command, "boundary-set") == 0) {
-    cmd = CMD_BOUNDARY_SET;
-    if (boundary_file) {
+    o->cmd = CMD_BOUNDARY_SET;
+    if (o->boundary_file) {
       /* Parse .rpd file */
-      if (parse_rpd_file(boundary_file, &bnd) < 0)
-        exit(EXIT_FAILURE);
+      if (rpd_parse(o->boundary_file, &o->bnd) < 0)
+        return -1;
       printf("Loaded boundary settings from %s:\n"
              "  CFS1: %u KB, CFS2: %u KB, DFS: %u KB\n"
              "  SRS1: %u KB, SRS2: %u KB\n",
-          boundary_file,
-          bnd.cfs1,
-          bnd.cfs2,
-          bnd.dfs,
-          bnd.srs1,
-          bnd.srs2);
-    } else if (!bnd_cfs1_set || !bnd_cfs2_set || !bnd_dfs_set || !bnd_srs1_set || !bnd_srs2_set) {
-      errx(EXIT_FAILURE,
-          "boundary-set requires --file <rpd> or all options: --cfs1 --cfs2 --dfs --srs1 --srs2");
+          o->boundary_file,
+          o->bnd.cfs1,
+          o->bnd.cfs2,
+          o->bnd.dfs,
+          o->bnd.srs1,
+          o->bnd.srs2);
+    } else if (!o->bnd_cfs1_set || !o->bnd_cfs2_set || !o->bnd_dfs_set || !o->bnd_srs1_set ||
+               !o->bnd_srs2_set) {
+      warnx("boundary-set requires --file <rpd> or all options: --cfs1 --cfs2 --dfs --srs1 --srs2");
+      return -1;
     }
   } else if (strcmp(command, "param") == 0) {
-    cmd = CMD_PARAM;
+    o->cmd = CMD_PARAM;
   } else if (strcmp(command, "param-set") == 0) {
-    cmd = CMD_PARAM_SET;
-    if (optind >= argc)
-      errx(EXIT_FAILURE, "param-set requires an argument: enable or disable");
+    o->cmd = CMD_PARAM_SET;
+    if (optind >= argc) {
+      warnx("param-set requires an argument: enable or disable");
+      return -1;
+    }
     const char *val = argv[optind];
     if (strcasecmp(val, "enable") == 0)
-      param_value = PARAM_INIT_ENABLED;
+      o->param_value = PARAM_INIT_ENABLED;
     else if (strcasecmp(val, "disable") == 0)
-      param_value = PARAM_INIT_DISABLED;
-    else
-      errx(EXIT_FAILURE, "invalid param-set value: %s (use enable or disable)", val);
+      o->param_value = PARAM_INIT_DISABLED;
+    else {
+      warnx("invalid param-set value: %s (use enable or disable)", val);
+      return -1;
+    }
   } else if (strcmp(command, "init") == 0) {
-    cmd = CMD_INIT;
+    o->cmd = CMD_INIT;
   } else if (strcmp(command, "osis") == 0) {
-    cmd = CMD_OSIS;
+    o->cmd = CMD_OSIS;
   } else if (strcmp(command, "config-read") == 0) {
-    cmd = CMD_CONFIG_READ;
+    o->cmd = CMD_CONFIG_READ;
   } else if (strcmp(command, "key-set") == 0) {
-    cmd = CMD_KEY_SET;
-    if (optind + 1 >= argc)
-      errx(EXIT_FAILURE, "key-set requires type and file arguments");
-    key_index = parse_key_type(argv[optind]);
-    if (key_index == 0)
-      errx(EXIT_FAILURE, "key-set: invalid key type");
-    key_file = argv[optind + 1];
+    o->cmd = CMD_KEY_SET;
+    if (optind + 1 >= argc) {
+      warnx("key-set requires type and file arguments");
+      return -1;
+    }
+    o->key_index = parse_key_type(argv[optind]);
+    if (o->key_index == 0) {
+      warnx("key-set: invalid key type");
+      return -1;
+    }
+    o->key_file = argv[optind + 1];
   } else if (strcmp(command, "key-verify") == 0) {
-    cmd = CMD_KEY_VERIFY;
-    if (optind >= argc)
-      errx(EXIT_FAILURE, "key-verify requires type argument");
-    key_index = parse_key_type(argv[optind]);
-    if (key_index == 0)
-      errx(EXIT_FAILURE, "key-verify: invalid key type");
+    o->cmd = CMD_KEY_VERIFY;
+    if (optind >= argc) {
+      warnx("key-verify requires type argument");
+      return -1;
+    }
+    o->key_index = parse_key_type(argv[optind]);
+    if (o->key_index == 0) {
+      warnx("key-verify: invalid key type");
+      return -1;
+    }
   } else if (strcmp(command, "ukey-set") == 0) {
-    cmd = CMD_UKEY_SET;
-    if (optind + 1 >= argc)
-      errx(EXIT_FAILURE, "ukey-set requires index and file arguments");
-    key_index = (uint8_t)strtoul(argv[optind], NULL, 10);
-    key_file = argv[optind + 1];
+    o->cmd = CMD_UKEY_SET;
+    if (optind + 1 >= argc) {
+      warnx("ukey-set requires index and file arguments");
+      return -1;
+    }
+    o->key_index = (uint8_t)strtoul(argv[optind], NULL, 10);
+    o->key_file = argv[optind + 1];
   } else if (strcmp(command, "ukey-verify") == 0) {
-    cmd = CMD_UKEY_VERIFY;
-    if (optind >= argc)
-      errx(EXIT_FAILURE, "ukey-verify requires index argument");
-    key_index = (uint8_t)strtoul(argv[optind], NULL, 10);
+    o->cmd = CMD_UKEY_VERIFY;
+    if (optind >= argc) {
+      warnx("ukey-verify requires index argument");
+      return -1;
+    }
+    o->key_index = (uint8_t)strtoul(argv[optind], NULL, 10);
   } else if (strcmp(command, "backup") == 0) {
-    cmd = CMD_BACKUP;
-    if (optind >= argc)
-      errx(EXIT_FAILURE, "backup command requires a file argument");
-    file = argv[optind];
+    o->cmd = CMD_BACKUP;
+    if (o->store != NULL) {
+      if (optind < argc) {
+        warnx("backup takes either a file or --store, not both");
+        return -1;
+      }
+    } else {
+      if (optind >= argc) {
+        warnx("backup command requires a file argument (or --store <dir>)");
+        return -1;
+      }
+      o->file = argv[optind];
+    }
   } else if (strcmp(command, "restore") == 0) {
-    cmd = CMD_RESTORE;
-    if (optind >= argc)
-      errx(EXIT_FAILURE, "restore command requires a file argument");
-    file = argv[optind];
+    o->cmd = CMD_RESTORE;
+    if (o->store != NULL) {
+      /* Optional DID: restore another device's backup onto this one */
+      if (optind < argc) {
+        o->file = argv[optind];
+        if (strlen(o->file) != 32 || strspn(o->file, "0123456789abcdefABCDEF") != 32) {
+          warnx("invalid DID: %s (32 hex characters)", o->file);
+          return -1;
+        }
+      }
+    } else {
+      if (optind >= argc) {
+        warnx("restore command requires a file argument (or --store <dir>)");
+        return -1;
+      }
+      o->file = argv[optind];
+    }
   } else if (strcmp(command, "fm2app-get") == 0) {
-    cmd = CMD_FM2APP_GET;
+    o->cmd = CMD_FM2APP_GET;
   } else if (strcmp(command, "fm2app-set") == 0) {
-    cmd = CMD_FM2APP_SET;
-    if (optind + 1 >= argc)
-      errx(EXIT_FAILURE, "fm2app-set requires <field> <value>");
+    o->cmd = CMD_FM2APP_SET;
+    if (optind + 1 >= argc) {
+      warnx("fm2app-set requires <field> <value>");
+      return -1;
+    }
+    if (parse_fm2app_set(argv[optind], argv[optind + 1], o) < 0)
+      return -1;
   } else if (strcmp(command, "raw") == 0) {
-    cmd = CMD_RAW;
-    if (optind >= argc)
-      errx(EXIT_FAILURE, "raw command requires at least a command byte (hex)");
-    /* Arguments parsed later after device connection */
+    o->cmd = CMD_RAW;
+    if (optind >= argc) {
+      warnx("raw command requires at least a command byte (hex)");
+      return -1;
+    }
+    if (parse_raw(argc, argv, optind, o) < 0)
+      return -1;
+  } else if (strcmp(command, "provision") == 0) {
+    o->cmd = CMD_PROVISION;
+    if (optind >= argc) {
+      warnx("provision requires a manifest file argument");
+      return -1;
+    }
+    /* Load now, so a bad manifest fails before the device is touched */
+    o->manifest = malloc(sizeof(*o->manifest));
+    if (o->manifest == NULL) {
+      warn("malloc");
+      return -1;
+    }
+    if (manifest_load(argv[optind], o->manifest) < 0) {
+      warnx("invalid manifest: %s", argv[optind]);
+      return -1;
+    }
+  } else if (strcmp(command, "batch") == 0) {
+    o->cmd = CMD_BATCH;
+    if (optind >= argc) {
+      warnx("batch command requires a script file argument (- for stdin)");
+      return -1;
+    }
+    o->file = argv[optind];
+  } else if (strcmp(command, "compile") == 0) {
+    o->cmd = CMD_COMPILE;
+    if (optind >= argc) {
+      warnx("compile command requires an image file argument");
+      return -1;
+    }
+    if (o->output == NULL) {
+      warnx("compile requires -o <file.rfi>");
+      return -1;
+    }
+    o->file = argv[optind];
+  } else if (strcmp(command, "gc") == 0) {
+    o->cmd = CMD_GC;
+    if (o->store == NULL) {
+      warnx("gc requires --store <dir>");
+      return -1;
+    }
+  } else if (strcmp(command, "identify") == 0) {
+    o->cmd = CMD_IDENTIFY;
+    if (o->db == NULL) {
+      warnx("identify requires --db <file>");
+      return -1;
+    }
+  } else if (strcmp(command, "inventory") == 0) {
+    o->cmd = CMD_INVENTORY;
+    if (o->all && (o->port != NULL || o->uart_mode)) {
+      warnx("inventory --all finds the USB ports itself (no -p or -u)");
+      return -1;
+    }
   } else {
-    errx(EXIT_FAILURE, "unknown command: %s", command);
+    warnx("unknown command: %s", command);
+    return -1;
   }
 
-  ra_device_t dev;
-  ra_dev_init(&dev);
-  dev.uart_mode = uart_mode;
+  if (o->from != NULL && o->cmd != CMD_STATUS && o->cmd != CMD_CONFIG_READ &&
+      o->cmd != CMD_FM2APP_GET) {
+    warnx("--from only applies to status, config-read and fm2app-get");
+    return -1;
+  }
+  if (o->add != NULL && o->cmd != CMD_IDENTIFY) {
+    warnx("--add only applies to identify");
+    return -1;
+  }
+  if ((o->all || o->json) && o->cmd != CMD_INVENTORY) {
+    warnx("--all and --json only apply to inventory");
+    return -1;
+  }
+  return 0;
+}
 
-  if (ra_open(&dev, port) < 0)
-    errx(EXIT_FAILURE, "failed to connect to device");
+/*
+ * crc --file without --compare checksums the image on the host only,
+ * reports --from a backup decode the file, compile, gc and identify --add never
+ * need the device
+ */
+static bool
+is_offline(const options_t *o) {
+  if (o->cmd == CMD_COMPILE || o->cmd == CMD_GC || o->from != NULL)
+    return true;
+  if (o->cmd == CMD_IDENTIFY && o->add != NULL)
+    return true;
+  return o->cmd == CMD_CRC && o->boundary_file != NULL && !o->crc_compare;
+}
 
-  if (ra_get_area_info(&dev, false) < 0) {
-    ra_close(&dev);
-    errx(EXIT_FAILURE, "failed to get area info");
-  }
+/*
+ * Open the session: connect, query areas, switch baud rate, authenticate
+ * Returns: 0 on success, -1 on error (dev is closed)
+ */
+static int
+open_session(ra_device_t *dev, const options_t *o) {
+  return ra_session_open(dev,
+      o->port,
+      o->uart_mode,
+      o->baudrate,
+      o->use_auth ? o->id_code : NULL,
+      !o->no_cache);
+}
 
+/*
+ * Unique device ID (DID of the signature) as hex into buf (33 bytes)
+ * Returns: buf, NULL if the signature has not been read
+ */
+static const char *
+device_id(const ra_device_t *dev, char *buf) {
+  if (dev->sig_len < 25)
+    return NULL;
+  for (int i = 0; i < 16; i++)
+    snprintf(&buf[2 * i], 3, "%02x", dev->sig[9 + i]);
+  return buf;
+}
+
+/*
+ * Resolve --bank / --area into address and size, now that areas are known
+ * Returns: 0 on success, -1 on error
+ */
+static int
+resolve_area(ra_device_t *dev, options_t *o) {
   /* Handle --bank option for dual bank mode */
-  if (bank >= 0) {
+  if (o->bank >= 0) {
     /* Bank 0 = KOA 0x00 (User area 0), Bank 1 = KOA 0x01 (User area 1) */
-    if (dev.noa <= 4) {
-      ra_close(&dev);
-      errx(EXIT_FAILURE, "device is not in dual bank mode (NOA=%d)", dev.noa);
+    if (dev->noa <= 4) {
+      warnx("device is not in dual bank mode (NOA=%d)", dev->noa);
+      return -1;
     }
-    if (area_koa >= 0 && area_koa != KOA_TYPE_CODE && area_koa != KOA_TYPE_CODE1)
+    if (o->area_koa >= 0 && o->area_koa != KOA_TYPE_CODE && o->area_koa != KOA_TYPE_CODE1)
       warnx("--bank overrides --area for user area selection");
-    area_koa = bank; /* 0 = KOA_TYPE_CODE (0x00), 1 = KOA_TYPE_CODE1 (0x01) */
+    o->area_koa = o->bank; /* 0 = KOA_TYPE_CODE (0x00), 1 = KOA_TYPE_CODE1 (0x01) */
   }
 
   /* Resolve --area to address/size if specified */
-  if (area_koa >= 0) {
+  if (o->area_koa >= 0) {
     uint32_t area_sad, area_ead;
-    if (ra_find_area_by_koa(&dev, (uint8_t)area_koa, &area_sad, &area_ead) < 0) {
-      ra_close(&dev);
-      errx(EXIT_FAILURE, "area not found");
+    if (ra_find_area_by_koa(dev, (uint8_t)o->area_koa, &area_sad, &area_ead) < 0) {
+      warnx("area not found");
+      return -1;
     }
     /* Config area CRC requires exact boundaries per spec 6.21 */
-    if (cmd == CMD_CRC && area_koa == KOA_TYPE_CONFIG) {
-      if (addr_explicit || size_explicit)
+    if (o->cmd == CMD_CRC && o->area_koa == KOA_TYPE_CONFIG) {
+      if (o->addr_explicit || o->size_explicit)
         warnx("config area CRC requires exact boundaries, -a/-s ignored");
-      address = area_sad;
-      size = area_ead - area_sad + 1;
+      o->address = area_sad;
+      o->size = area_ead - area_sad + 1;
     } else {
       /* --area sets defaults, -a/-s can still override */
-      if (address == 0)
-        address = area_sad;
-      if (size == 0)
-        size = area_ead - area_sad + 1;
+      if (o->address == 0)
+        o->address = area_sad;
+      if (o->size == 0)
+        o->size = area_ead - area_sad + 1;
     }
   }
 
-  /* Note: IDA with all-0xFF fails with 0xC1 on unlocked devices
-   * Per Renesas docs, unlocked devices skip Authentication phase */
-
-  /* Set baud rate: auto-detect max in UART mode, or use explicit value */
-  if (baudrate > 0 && baudrate != 9600) {
-    if (ra_set_baudrate(&dev, baudrate) < 0) {
-      ra_close(&dev);
-      errx(EXIT_FAILURE, "failed to set baud rate");
-    }
-  } else if (uart_mode && baudrate == 0) {
-    /* Auto-switch to max baud rate in UART mode */
-    /* Get device limit based on MCU series */
-    uint32_t device_max = ra_get_device_max_baudrate(&dev);
-
-    /* Get adapter limit based on USB VID/PID */
-    const char *tty = port;
-    if (tty != NULL) {
-      const char *slash = strrchr(tty, '/');
-      if (slash != NULL)
-        tty = slash + 1;
-    }
-    uint32_t adapter_max = ra_get_adapter_max_baudrate(tty);
-
-    /* Use minimum of device max, adapter max, and termios support */
-    uint32_t target = device_max < adapter_max ? device_max : adapter_max;
-    uint32_t best = ra_best_baudrate(target);
-
-    if (best > 9600) {
-      if (ra_set_baudrate(&dev, best) == 0) {
-        /* Verify communication works at new rate */
-        uint32_t rmb_check;
-        if (ra_get_rmb(&dev, &rmb_check) < 0) {
-          ra_close(&dev);
-          errx(EXIT_FAILURE,
-              "communication failed at %u bps, reset board and use -b 115200 or lower",
-              best);
-        }
-      } else {
-        warnx("baud rate %u bps failed, falling back", best);
-        if (ra_set_baudrate(&dev, 115200) < 0) {
-          warnx("continuing at 9600 bps");
-        }
-      }
-    }
-  }
+  return 0;
+}
 
-  /* Perform ID authentication if requested */
-  if (use_auth) {
-    if (ra_authenticate(&dev, id_code) < 0) {
-      ra_close(&dev);
-      errx(EXIT_FAILURE, "ID authentication failed");
-    }
+/*
+ * Read a wrapped key file for key-set / ukey-set
+ * Returns: key length, 0 on error
+ */
+static size_t
+read_key_file(const char *key_file, uint8_t *key_data, size_t max_len) {
+  FILE *fp = fopen(key_file, "rb");
+  if (fp == NULL) {
+    warn("cannot open key file: %s", key_file);
+    return 0;
   }
+  size_t key_len = fread(key_data, 1, max_len, fp);
+  fclose(fp);
+  if (key_len == 0)
+    warnx("empty key file: %s", key_file);
+  return key_len;
+}
+
+/*
+ * Drop the blocks of a store that no device manifest references
+ * Returns: 0 on success, -1 on error
+ */
+static int
+run_gc(const char *dir) {
+  uint32_t removed;
+  uint64_t freed;
+
+  if (rastore_gc(dir, &removed, &freed) < 0)
+    return -1;
+  printf("Removed %u unreferenced blocks (%.1f KB)\n", removed, freed / 1024.0);
+  return 0;
+}
 
+/*
+ * Execute one parsed command (dev is NULL for offline commands)
+ * Returns: 0 on success, -1 on error
+ */
+static int
+run_command(ra_device_t *dev, options_t *o) {
   int ret = 0;
-  switch (cmd) {
+
+  /* Encoder and progress settings are per command, batch steps do not inherit them */
+  if (format_set_write_options(o->record_bytes, o->skip_blank) < 0)
+    return -1;
+  progress_global_quiet = o->quiet;
+
+  if (o->cmd == CMD_COMPILE)
+    return rfi_compile(o->file, o->input_format, o->address, o->output);
+  if (o->cmd == CMD_GC)
+    return run_gc(o->store);
+  if (o->cmd == CMD_IDENTIFY && o->add != NULL)
+    return ra_identify_add(o->db, o->add, o->input_format);
+  if (o->cmd == CMD_INVENTORY && o->all)
+    return ra_inventory_all(o->use_auth ? o->id_code : NULL, o->json, !o->no_cache);
+  if (o->from != NULL) {
+    if (o->cmd == CMD_CONFIG_READ)
+      return ra_config_read_file(o->from, o->input_format);
+    if (o->cmd == CMD_FM2APP_GET)
+      return ra_fm2app_get_file(o->from, o->input_format);
+    return ra_status_file(o->from, o->input_format);
+  }
+  if (is_offline(o))
+    return ra_crc_file(NULL, o->boundary_file, o->address, o->input_format);
+
+  if (resolve_area(dev, o) < 0)
+    return -1;
+
+  switch (o->cmd) {
   case CMD_STATUS:
-    ret = ra_status(&dev);
+    ret = ra_status(dev);
     break;
   case CMD_INFO:
-    ret = ra_get_dev_info(&dev);
+    ret = ra_get_dev_info(dev);
     if (ret == 0) {
       /* Show DLM state */
       uint8_t dlm_state;
-      if (ra_get_dlm(&dev, &dlm_state) == 0) {
+      if (ra_get_dlm(dev, &dlm_state) == 0) {
         printf("DLM State:          %s (0x%02X)\n", ra_dlm_state_name(dlm_state), dlm_state);
       }
       printf("\n");
-      ra_get_area_info(&dev, true);
+      ra_get_area_info(dev, true);
     }
     break;
   case CMD_READ:
-    ret = ra_read(&dev, file, address, size, output_format);
+    ret = ra_read(dev, o->file, o->address, o->size, o->output_format);
     break;
   case CMD_WRITE:
-    if (write_count == 1) {
+    if (o->write_count == 1) {
       /* Single file mode - use file/address variables (may include --area) */
-      ret = ra_write(&dev, file, address, size, verify, input_format);
+      if (o->delta_cached)
+        ret = ra_write_delta(dev, o->file, o->address, o->input_format);
+      else
+        ret = ra_write(dev, o->file, o->address, o->size, o->verify, o->input_format);
     } else {
       /* Multi-file mode - write each file sequentially */
-      for (int i = 0; i < write_count; i++) {
-        uint32_t addr = write_entries[i].has_address ? write_entries[i].address : 0;
-        printf("Writing %s to 0x%08X...\n", write_entries[i].path, addr);
-        ret = ra_write(&dev, write_entries[i].path, addr, 0, verify, input_format);
+      for (int i = 0; i < o->write_count; i++) {
+        const write_entry_t *entry = &o->write_entries[i];
+        uint32_t addr = entry->has_address ? entry->address : 0;
+        printf("Writing %s to 0x%08X...\n", entry->path, addr);
+        ret = ra_write(dev, entry->path, addr, 0, o->verify, o->input_format);
         if (ret < 0) {
-          warnx("failed to write %s", write_entries[i].path);
+          warnx("failed to write %s", entry->path);
           break;
         }
       }
       if (ret == 0)
-        printf("All %d files programmed successfully.\n", write_count);
+        printf("All %d files programmed successfully.\n", o->write_count);
     }
     break;
   case CMD_VERIFY:
-    ret = ra_verify(&dev, file, address, size, input_format);
+    ret = ra_verify(dev, o->file, o->address, o->size, o->input_format);
+    break;
+  case CMD_DIFF:
+    ret = ra_diff(dev, o->file, o->address, o->input_format);
     break;
   case CMD_ERASE:
     /* When --area is specified, iterate over all matching areas
      * to handle multi-area regions like code flash (area 0 + area 1) */
-    if (area_koa >= 0) {
+    if (o->area_koa >= 0) {
       for (int i = 0; i < MAX_AREAS; i++) {
-        ra_area_t *area = &dev.chip_layout[i];
+        ra_area_t *area = &dev->chip_layout[i];
         if (area->ead == 0 || area->eau == 0)
           continue;
-        if (area->koa != (uint8_t)area_koa)
+        if (area->koa != (uint8_t)o->area_koa)
           continue;
-        ret = ra_erase(&dev, area->sad, area->ead - area->sad + 1);
+        ret = ra_erase(dev, area->sad, area->ead - area->sad + 1);
         if (ret < 0)
           break;
       }
     } else {
-      ret = ra_erase(&dev, address, size);
+      ret = ra_erase(dev, o->address, o->size);
     }
     break;
   case CMD_BLANK_CHECK:
-    ret = ra_blank_check(&dev, address, size);
+    ret = ra_blank_check(dev, o->address, o->size);
     break;
   case CMD_CRC:
-    ret = ra_crc(&dev, address, size, NULL);
+    if (o->boundary_file != NULL)
+      ret = ra_crc_file(dev, o->boundary_file, o->address, o->input_format);
+    else
+      ret = ra_crc(dev, o->address, o->size, NULL);
     break;
   case CMD_DLM:
-    ret = ra_get_dlm(&dev, NULL);
+    ret = ra_get_dlm(dev, NULL);
     break;
   case CMD_DLM_TRANSIT:
-    ret = ra_dlm_transit(&dev, dest_dlm);
+    ret = ra_dlm_transit(dev, o->dest_dlm);
     break;
   case CMD_DLM_AUTH:
-    ret = ra_dlm_auth(&dev, dest_dlm, auth_key);
+    ret = ra_dlm_auth(dev, o->dest_dlm, o->auth_key);
     break;
   case CMD_BOUNDARY:
-    ret = ra_get_boundary(&dev, NULL);
+    ret = ra_get_boundary(dev, NULL);
     break;
   case CMD_BOUNDARY_SET:
-    ret = ra_set_boundary(&dev, &bnd);
+    ret = ra_set_boundary(dev, &o->bnd);
     break;
   case CMD_PARAM:
-    ret = ra_get_param(&dev, PARAM_ID_INIT, NULL);
+    ret = ra_get_param(dev, PARAM_ID_INIT, NULL);
     break;
   case CMD_PARAM_SET:
-    ret = ra_set_param(&dev, PARAM_ID_INIT, param_value);
+    ret = ra_set_param(dev, PARAM_ID_INIT, o->param_value);
     break;
   case CMD_INIT:
-    ret = ra_initialize(&dev);
+    ret = ra_initialize(dev);
     break;
   case CMD_OSIS: {
     osis_status_t status;
-    ret = ra_osis_detect(&dev, &status);
+    ret = ra_osis_detect(dev, &status);
     if (ret == 0)
       ra_osis_print(&status);
   } break;
   case CMD_CONFIG_READ:
-    ret = ra_config_read(&dev);
+    ret = ra_config_read(dev);
     break;
   case CMD_KEY_SET: {
-    FILE *fp = fopen(key_file, "rb");
-    if (fp == NULL) {
-      warn("cannot open key file: %s", key_file);
-      ret = -1;
-      break;
-    }
     uint8_t key_data[64];
-    size_t key_len = fread(key_data, 1, sizeof(key_data), fp);
-    fclose(fp);
+    size_t key_len = read_key_file(o->key_file, key_data, sizeof(key_data));
     if (key_len == 0) {
-      warnx("empty key file: %s", key_file);
       ret = -1;
       break;
     }
-    ret = ra_key_set(&dev, key_index, key_data, key_len);
+    ret = ra_key_set(dev, o->key_index, key_data, key_len);
   } break;
   case CMD_KEY_VERIFY:
-    ret = ra_key_verify(&dev, key_index, NULL);
+    ret = ra_key_verify(dev, o->key_index, NULL);
     break;
   case CMD_UKEY_SET: {
-    FILE *fp = fopen(key_file, "rb");
-    if (fp == NULL) {
-      warn("cannot open key file: %s", key_file);
-      ret = -1;
-      break;
-    }
     uint8_t key_data[64];
-    size_t key_len = fread(key_data, 1, sizeof(key_data), fp);
-    fclose(fp);
+    size_t key_len = read_key_file(o->key_file, key_data, sizeof(key_data));
     if (key_len == 0) {
-      warnx("empty key file: %s", key_file);
       ret = -1;
       break;
     }
-    ret = ra_ukey_set(&dev, key_index, key_data, key_len);
+    ret = ra_ukey_set(dev, o->key_index, key_data, key_len);
   } break;
   case CMD_UKEY_VERIFY:
-    ret = ra_ukey_verify(&dev, key_index, NULL);
+    ret = ra_ukey_verify(dev, o->key_index, NULL);
     break;
   case CMD_BACKUP:
-    ret = ra_backup(&dev, file, output_format);
+    if (o->store != NULL)
+      ret = ra_backup_store(dev, o->store, o->base);
+    else
+      ret = ra_backup(dev, o->file, o->output_format, o->base);
     break;
   case CMD_RESTORE:
-    ret = ra_restore(&dev, file, input_format, verify);
+    if (o->store != NULL)
+      ret = ra_restore_store(dev, o->store, o->file, o->verify);
+    else
+      ret = ra_restore(dev, o->file, o->input_format, o->verify);
     break;
   case CMD_FM2APP_GET:
-    ret = ra_fm2app_get(&dev);
+    ret = ra_fm2app_get(dev);
     break;
-  case CMD_FM2APP_SET: {
-    const char *field_name = argv[optind];
-    const char *value_str = argv[optind + 1];
-    fm2app_field_t field = (fm2app_field_t)-1;
-    uint8_t value = 0;
-    bool found;
-
-    /* Parse field name using token table */
-    found = false;
-    for (int i = 0; fm2app_field_tokens[i].name != NULL; i++) {
-      if (strcmp(field_name, fm2app_field_tokens[i].name) == 0) {
-        field = fm2app_field_tokens[i].field;
-        found = true;
-        break;
-      }
+  case CMD_FM2APP_SET:
+    ret = ra_fm2app_set(dev, o->fm2app_field, o->fm2app_value);
+    break;
+  case CMD_RAW:
+    ret = ra_raw_cmd(dev, o->raw_cmd, o->raw_data, o->raw_len);
+    break;
+  case CMD_PROVISION:
+    ret = ra_provision(dev, o->manifest, o->dry_run);
+    break;
+  case CMD_IDENTIFY:
+    ret = ra_identify(dev, o->db);
+    break;
+  case CMD_INVENTORY:
+    ret = ra_inventory(dev, o->port, o->json);
+    break;
+  default:
+    break;
+  }
+
+  return ret;
+}
+
+/* Batch script limits */
+#define MAX_BATCH_STEPS 256
+#define MAX_STEP_ARGS 64
+
+/* One line of a batch script, parsed before the device is touched */
+typedef struct {
+  int lineno;
+  char *line;                    /* Owns the strings argv points into */
+  char *argv[MAX_STEP_ARGS + 1]; /* argv[0] is the program name */
+  int argc;
+  options_t opt;
+} batch_step_t;
+
+/*
+ * Split a script line into words in place
+ * Words are separated by blanks; double quotes group words with blanks.
+ * A '#' outside quotes starts a comment.
+ * Returns: number of words, -1 on error
+ */
+static int
+split_line(char *line, char **words, int max_words) {
+  int n = 0;
+  char *p = line;
+
+  for (;;) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+      p++;
+    if (*p == '\0' || *p == '#')
+      break;
+    if (n >= max_words)
+      return -1;
+
+    char *out = p;
+    words[n++] = out;
+    bool quoted = false;
+    while (*p != '\0' && (quoted || (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n'))) {
+      if (*p == '"')
+        quoted = !quoted;
+      else
+        *out++ = *p;
+      p++;
     }
-    if (!found)
-      errx(EXIT_FAILURE,
-          "unknown field: %s (use boot_pref, retry_count, test_cmd, test_result)",
-          field_name);
-
-    /* Parse value using token tables or hex */
-    found = false;
-    if (field == FM2APP_BOOT_PREF) {
-      for (int i = 0; fm2app_boot_pref_tokens[i].name != NULL; i++) {
-        if (strcmp(value_str, fm2app_boot_pref_tokens[i].name) == 0) {
-          value = fm2app_boot_pref_tokens[i].value;
-          found = true;
-          break;
-        }
-      }
-    } else if (field == FM2APP_TEST_CMD) {
-      for (int i = 0; fm2app_test_cmd_tokens[i].name != NULL; i++) {
-        if (strcmp(value_str, fm2app_test_cmd_tokens[i].name) == 0) {
-          value = fm2app_test_cmd_tokens[i].value;
-          found = true;
-          break;
-        }
-      }
+    if (quoted)
+      return -1;
+    if (*p != '\0')
+      p++;
+    *out = '\0';
+  }
+
+  return n;
+}
+
+static void
+free_batch(batch_step_t *steps, int nr_steps) {
+  for (int i = 0; i < nr_steps; i++) {
+    for (int k = 0; k < steps[i].opt.write_count; k++) {
+      if (steps[i].opt.write_entries[k].has_address)
+        free((char *)steps[i].opt.write_entries[k].path);
     }
-    if (!found)
-      value = (uint8_t)strtoul(value_str, NULL, 0);
+    free(steps[i].opt.manifest);
+    free(steps[i].line);
+  }
+  free(steps);
+}
 
-    ret = ra_fm2app_set(&dev, field, value);
-    break;
+/*
+ * Parse a whole batch script (path, or "-" for stdin)
+ * Every step is checked before the device is opened, so a typo on the last
+ * line does not leave a board half provisioned.
+ * Returns: number of steps, -1 on error
+ */
+static int
+load_batch(const char *script, batch_step_t **steps_out) {
+  FILE *f = strcmp(script, "-") == 0 ? stdin : fopen(script, "r");
+  if (f == NULL) {
+    warn("cannot open batch script: %s", script);
+    return -1;
   }
-  case CMD_RAW: {
-    /* Parse command byte and optional data from remaining args */
-    uint8_t raw_cmd;
-    uint8_t raw_data[256];
-    size_t raw_len = 0;
 
-    /* Parse command byte */
-    char *endptr;
-    unsigned long val = strtoul(argv[optind], &endptr, 16);
-    if (*endptr != '\0' || val > 0xFF) {
-      warnx("invalid command byte: %s (use hex 0x00-0xFF)", argv[optind]);
+  batch_step_t *steps = calloc(MAX_BATCH_STEPS, sizeof(*steps));
+  if (steps == NULL) {
+    if (f != stdin)
+      fclose(f);
+    return -1;
+  }
+
+  char buf[1024];
+  int nr_steps = 0;
+  int lineno = 0;
+  int ret = 0;
+
+  while (fgets(buf, sizeof(buf), f) != NULL) {
+    lineno++;
+    if (strchr(buf, '\n') == NULL && !feof(f)) {
+      warnx("%s:%d: line too long", script, lineno);
       ret = -1;
       break;
     }
-    raw_cmd = (uint8_t)val;
 
-    /* Parse optional data bytes */
-    for (int i = optind + 1; i < argc && raw_len < sizeof(raw_data); i++) {
-      val = strtoul(argv[i], &endptr, 16);
-      if (*endptr != '\0' || val > 0xFF) {
-        warnx("invalid data byte: %s (use hex 0x00-0xFF)", argv[i]);
-        ret = -1;
-        break;
-      }
-      raw_data[raw_len++] = (uint8_t)val;
+    char *line = strdup(buf);
+    char *words[MAX_STEP_ARGS];
+    if (line == NULL) {
+      ret = -1;
+      break;
+    }
+    int nr_words = split_line(line, words, MAX_STEP_ARGS);
+    if (nr_words <= 0) {
+      free(line);
+      if (nr_words == 0)
+        continue;
+      warnx("%s:%d: unbalanced quotes or too many arguments", script, lineno);
+      ret = -1;
+      break;
+    }
+    if (nr_steps >= MAX_BATCH_STEPS) {
+      free(line);
+      warnx("%s:%d: too many steps (max %d)", script, lineno, MAX_BATCH_STEPS);
+      ret = -1;
+      break;
     }
+
+    batch_step_t *step = &steps[nr_steps++];
+    step->lineno = lineno;
+    step->line = line;
+    step->argv[0] = "radfu";
+    memcpy(&step->argv[1], words, (size_t)nr_words * sizeof(words[0]));
+    step->argc = nr_words + 1;
+    step->argv[step->argc] = NULL;
+
+    if (parse_args(step->argc, step->argv, &step->opt) != 0) {
+      warnx("%s:%d: invalid step", script, lineno);
+      ret = -1;
+      break;
+    }
+    if (step->opt.cmd == CMD_BATCH) {
+      warnx("%s:%d: batch scripts cannot nest", script, lineno);
+      ret = -1;
+      break;
+    }
+    if (step->opt.cmd == CMD_INVENTORY && step->opt.all) {
+      warnx("%s:%d: inventory --all opens its own connections", script, lineno);
+      ret = -1;
+      break;
+    }
+    if (step->opt.port != NULL || step->opt.baudrate != 0 || step->opt.uart_mode ||
+        step->opt.use_auth || step->opt.erase_all || step->opt.no_cache ||
+        step->opt.progress_fd >= 0) {
+      warnx("%s:%d: -p/-b/-u/-i/-e/--no-cache/--progress-fd belong on the batch command line",
+          script,
+          lineno);
+      ret = -1;
+      break;
+    }
+  }
+
+  if (f != stdin)
+    fclose(f);
+
+  if (ret < 0) {
+    free_batch(steps, nr_steps);
+    return -1;
+  }
+  *steps_out = steps;
+  return nr_steps;
+}
+
+/*
+ * Run every step of a batch script over one session, stopping at the first failure
+ * Returns: 0 if all steps succeeded, -1 otherwise
+ */
+static int
+run_batch(ra_device_t *dev, batch_step_t *steps, int nr_steps, bool quiet) {
+  progress_time_t start, step_start;
+  int ret = 0;
+  int done;
+
+  progress_time_now(&start);
+  for (done = 0; done < nr_steps; done++) {
+    batch_step_t *step = &steps[done];
+
+    printf("==> [%d/%d] line %d:", done + 1, nr_steps, step->lineno);
+    for (int i = 1; i < step->argc; i++)
+      printf(" %s", step->argv[i]);
+    printf("\n");
+    fflush(stdout);
+
+    /* -q on the batch command line quiets every step */
+    step->opt.quiet = step->opt.quiet || quiet;
+    progress_time_now(&step_start);
+    ret = run_command(dev, &step->opt);
+    double secs = progress_time_since(&step_start);
+
+    printf("<== [%d/%d] %s in %.2f s\n", done + 1, nr_steps, ret < 0 ? "FAILED" : "ok", secs);
     if (ret < 0)
       break;
+  }
 
-    ret = ra_raw_cmd(&dev, raw_cmd, raw_data, raw_len);
-  } break;
-  default:
-    break;
+  printf("Batch: %d of %d steps succeeded in %.2f s\n",
+      ret < 0 ? done : nr_steps,
+      nr_steps,
+      progress_time_since(&start));
+  if (ret < 0)
+    warnx("batch stopped at line %d", steps[done].lineno);
+  return ret;
+}
+
+int
+main(int argc, char *argv[]) {
+  options_t opt;
+  batch_step_t *steps = NULL;
+  int nr_steps = 0;
+
+  int parsed = parse_args(argc, argv, &opt);
+  if (parsed == PARSE_USAGE)
+    usage(EXIT_FAILURE);
+  if (parsed < 0)
+    return EXIT_FAILURE;
+  progress_global_quiet = opt.quiet;
+
+  /* Progress events for dashboards, in place of the bar */
+  if (opt.progress_fd >= 0) {
+    FILE *events = fdopen(opt.progress_fd, "w");
+    if (events == NULL)
+      err(EXIT_FAILURE, "progress fd %d", opt.progress_fd);
+    progress_set_channel(events);
+  }
+
+  /* Offline: checksum or compile the file on the host, no device needed */
+  if (is_offline(&opt))
+    return run_command(NULL, &opt) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+  /* inventory --all opens one connection per board */
+  if (opt.cmd == CMD_INVENTORY && opt.all)
+    return run_command(NULL, &opt) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+  if (opt.cmd == CMD_BATCH) {
+    nr_steps = load_batch(opt.file, &steps);
+    if (nr_steps < 0)
+      return EXIT_FAILURE;
+  }
+
+  ra_device_t dev;
+  if (open_session(&dev, &opt) < 0) {
+    if (steps != NULL)
+      free_batch(steps, nr_steps);
+    return EXIT_FAILURE;
+  }
+
+  char did[2 * 16 + 1];
+  progress_set_device(opt.port, device_id(&dev, did));
+
+  int ret;
+  if (opt.cmd == CMD_BATCH) {
+    ret = run_batch(&dev, steps, nr_steps, opt.quiet);
+    free_batch(steps, nr_steps);
+  } else {
+    ret = run_command(&dev, &opt);
+    free(opt.manifest);
   }
 
   ra_close(&dev);
@@ -0,0 +1,740 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Declarative provisioning manifest and execution planner
+ *
+ * Manifest format, one setting per line, '#' starts a comment:
+ *
+ *   [image]            (repeatable)
+ *   file = app.hex
+ *   address = 0x0      (optional, default: address from the file)
+ *   format = ihex      (optional, default: from the extension)
+ *
+ *   [boundary]
+ *   file = zephyr.rpd  (or cfs1/cfs2/dfs/srs1/srs2 in KB)
+ *
+ *   [param]
+ *   init = disable
+ *
+ *   [key]              (repeatable, one per type)
+ *   type = secdbg
+ *   file = secdbg.key
+ *
+ *   [ukey]             (repeatable, one per index)
+ *   index = 0
+ *   file = user0.key
+ *
+ *   [dlm]
+ *   state = dpl
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "manifest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+  SEC_NONE,
+  SEC_IMAGE,
+  SEC_BOUNDARY,
+  SEC_PARAM,
+  SEC_KEY,
+  SEC_UKEY,
+  SEC_DLM,
+} section_t;
+
+static const struct {
+  const char *name;
+  section_t section;
+} section_tokens[] = {
+  { "image",    SEC_IMAGE    },
+  { "boundary", SEC_BOUNDARY },
+  { "param",    SEC_PARAM    },
+  { "key",      SEC_KEY      },
+  { "ukey",     SEC_UKEY     },
+  { "dlm",      SEC_DLM      },
+  { NULL,       SEC_NONE     },
+};
+
+static const struct {
+  const char *name;
+  uint8_t code;
+} dlm_tokens[] = {
+  { "cm",       DLM_STATE_CM       },
+  { "ssd",      DLM_STATE_SSD      },
+  { "nsecsd",   DLM_STATE_NSECSD   },
+  { "dpl",      DLM_STATE_DPL      },
+  { "lck_dbg",  DLM_STATE_LCK_DBG  },
+  { "lck_boot", DLM_STATE_LCK_BOOT },
+  { "rma_req",  DLM_STATE_RMA_REQ  },
+  { "rma_ack",  DLM_STATE_RMA_ACK  },
+  { NULL,       0                  },
+};
+
+static const struct {
+  const char *name;
+  uint8_t kyty;
+} key_tokens[] = {
+  { "secdbg",    KYTY_SECDBG    },
+  { "nonsecdbg", KYTY_NONSECDBG },
+  { "rma",       KYTY_RMA       },
+  { NULL,        0              },
+};
+
+static const char *
+dlm_name(uint8_t code) {
+  for (int i = 0; dlm_tokens[i].name != NULL; i++) {
+    if (dlm_tokens[i].code == code)
+      return dlm_tokens[i].name;
+  }
+  return "unknown";
+}
+
+static const char *
+key_name(uint8_t kyty) {
+  for (int i = 0; key_tokens[i].name != NULL; i++) {
+    if (key_tokens[i].kyty == kyty)
+      return key_tokens[i].name;
+  }
+  return "unknown";
+}
+
+/*
+ * Forward position in the lifecycle, -1 for states no plan can start from
+ * NSECSD and DPL are both reachable from SSD, DPL is further.
+ */
+static int
+dlm_rank(uint8_t code) {
+  switch (code) {
+  case DLM_STATE_CM:
+    return 0;
+  case DLM_STATE_SSD:
+    return 1;
+  case DLM_STATE_NSECSD:
+    return 2;
+  case DLM_STATE_DPL:
+    return 3;
+  case DLM_STATE_LCK_DBG:
+    return 4;
+  case DLM_STATE_LCK_BOOT:
+    return 5;
+  default:
+    return -1;
+  }
+}
+
+/*
+ * Next state on the way from cur to target, using only unauthenticated
+ * transitions (see ra_dlm_transit)
+ */
+static uint8_t
+dlm_next_hop(uint8_t cur, uint8_t target) {
+  switch (cur) {
+  case DLM_STATE_CM:
+    return DLM_STATE_SSD;
+  case DLM_STATE_SSD:
+    return (target == DLM_STATE_NSECSD) ? DLM_STATE_NSECSD : DLM_STATE_DPL;
+  case DLM_STATE_NSECSD:
+    return DLM_STATE_DPL;
+  case DLM_STATE_DPL:
+    return target;
+  default:
+    return DLM_STATE_LCK_BOOT;
+  }
+}
+
+static char *
+trim(char *s) {
+  while (*s == ' ' || *s == '\t')
+    s++;
+  size_t len = strlen(s);
+  while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t' || s[len - 1] == '\r' ||
+                        s[len - 1] == '\n'))
+    s[--len] = '\0';
+  return s;
+}
+
+static int
+parse_u32(const char *val, uint32_t *out) {
+  char *end;
+  unsigned long v = strtoul(val, &end, 0);
+  if (*val == '\0' || *end != '\0' || v > UINT32_MAX)
+    return -1;
+  *out = (uint32_t)v;
+  return 0;
+}
+
+/*
+ * Resolve a file name relative to the manifest directory
+ */
+static int
+resolve_path(const char *manifest, const char *name, char *out, size_t len) {
+  const char *slash = strrchr(manifest, '/');
+#ifdef _WIN32
+  const char *bslash = strrchr(manifest, '\\');
+  if (bslash != NULL && (slash == NULL || bslash > slash))
+    slash = bslash;
+  bool absolute = name[0] == '/' || name[0] == '\\' || (name[0] != '\0' && name[1] == ':');
+#else
+  bool absolute = name[0] == '/';
+#endif
+
+  int n;
+  if (absolute || slash == NULL)
+    n = snprintf(out, len, "%s", name);
+  else
+    n = snprintf(out, len, "%.*s%c%s", (int)(slash - manifest), manifest, path_separator(), name);
+  return (n < 0 || (size_t)n >= len) ? -1 : 0;
+}
+
+static int
+load_key(const char *file, manifest_key_t *key) {
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) {
+    warn("cannot open key file: %s", file);
+    return -1;
+  }
+  uint8_t extra;
+  key->len = fread(key->data, 1, sizeof(key->data), fp);
+  bool too_long = fread(&extra, 1, 1, fp) == 1;
+  fclose(fp);
+
+  if (key->len == 0) {
+    warnx("empty key file: %s", file);
+    return -1;
+  }
+  if (too_long) {
+    warnx("wrapped key too long: %s (max %d bytes)", file, MANIFEST_KEY_MAX_LEN);
+    return -1;
+  }
+  return 0;
+}
+
+/* Parser state for the section being read */
+typedef struct {
+  const char *path;
+  int lineno;
+  section_t section;
+  bool has_file;
+  bool has_index;
+  uint8_t bnd_set; /* bit per boundary field */
+} parse_ctx_t;
+
+#define BND_ALL 0x1F
+
+/*
+ * Check that the section just read is complete
+ */
+static int
+finish_section(parse_ctx_t *ctx, manifest_t *m) {
+  const char *what = NULL;
+
+  switch (ctx->section) {
+  case SEC_IMAGE:
+    if (!ctx->has_file)
+      what = "[image] needs file";
+    break;
+  case SEC_BOUNDARY:
+    if (ctx->bnd_set != BND_ALL)
+      what = "[boundary] needs file or all of cfs1, cfs2, dfs, srs1, srs2";
+    else if (m->boundary.cfs1 > m->boundary.cfs2 || m->boundary.srs1 > m->boundary.srs2)
+      what = "[boundary] needs cfs1 <= cfs2 and srs1 <= srs2";
+    break;
+  case SEC_PARAM:
+    if (!m->has_param)
+      what = "[param] needs init";
+    break;
+  case SEC_KEY:
+    if (!ctx->has_index || !ctx->has_file)
+      what = "[key] needs type and file";
+    break;
+  case SEC_UKEY:
+    if (!ctx->has_index || !ctx->has_file)
+      what = "[ukey] needs index and file";
+    break;
+  case SEC_DLM:
+    if (m->dlm == 0)
+      what = "[dlm] needs state";
+    break;
+  case SEC_NONE:
+    break;
+  }
+
+  if (what != NULL) {
+    warnx("%s:%d: %s", ctx->path, ctx->lineno, what);
+    return -1;
+  }
+  return 0;
+}
+
+static int
+start_section(parse_ctx_t *ctx, manifest_t *m, const char *name) {
+  section_t section = SEC_NONE;
+  for (int i = 0; section_tokens[i].name != NULL; i++) {
+    if (strcmp(name, section_tokens[i].name) == 0)
+      section = section_tokens[i].section;
+  }
+
+  if (section == SEC_NONE) {
+    warnx("%s:%d: unknown section [%s]", ctx->path, ctx->lineno, name);
+    return -1;
+  }
+
+  ctx->section = section;
+  ctx->has_file = false;
+  ctx->has_index = false;
+  ctx->bnd_set = 0;
+
+  const char *dup = NULL;
+  switch (section) {
+  case SEC_IMAGE:
+    if (m->nr_images == MANIFEST_MAX_IMAGES)
+      dup = "too many [image] sections";
+    else
+      m->nr_images++;
+    break;
+  case SEC_KEY:
+    if (m->nr_keys == MANIFEST_MAX_KEYS)
+      dup = "too many [key] sections";
+    else
+      m->nr_keys++;
+    break;
+  case SEC_UKEY:
+    if (m->nr_ukeys == MANIFEST_MAX_UKEYS)
+      dup = "too many [ukey] sections";
+    else
+      m->nr_ukeys++;
+    break;
+  case SEC_BOUNDARY:
+    if (m->has_boundary)
+      dup = "duplicate [boundary] section";
+    m->has_boundary = true;
+    break;
+  case SEC_PARAM:
+  case SEC_DLM:
+    if ((section == SEC_PARAM && m->has_param) || (section == SEC_DLM && m->dlm != 0))
+      dup = "duplicate section";
+    break;
+  case SEC_NONE:
+    break;
+  }
+
+  if (dup != NULL) {
+    warnx("%s:%d: %s", ctx->path, ctx->lineno, dup);
+    return -1;
+  }
+  return 0;
+}
+
+static int
+set_image(parse_ctx_t *ctx, manifest_image_t *img, const char *key, const char *val) {
+  if (strcmp(key, "file") == 0) {
+    if (resolve_path(ctx->path, val, img->file, sizeof(img->file)) < 0)
+      return -1;
+    ctx->has_file = true;
+    return 0;
+  }
+  if (strcmp(key, "address") == 0)
+    return parse_u32(val, &img->address);
+  if (strcmp(key, "format") == 0) {
+    if (strcasecmp(val, "auto") == 0)
+      img->format = FORMAT_AUTO;
+    else if (strcasecmp(val, "bin") == 0 || strcasecmp(val, "binary") == 0)
+      img->format = FORMAT_BIN;
+    else if (strcasecmp(val, "ihex") == 0 || strcasecmp(val, "hex") == 0)
+      img->format = FORMAT_IHEX;
+    else if (strcasecmp(val, "srec") == 0 || strcasecmp(val, "s19") == 0)
+      img->format = FORMAT_SREC;
+    else if (strcasecmp(val, "rfi") == 0)
+      img->format = FORMAT_RFI;
+    else if (strcasecmp(val, "elf") == 0)
+      img->format = FORMAT_ELF;
+    else
+      return -1;
+    return 0;
+  }
+  return -1;
+}
+
+static int
+set_boundary(parse_ctx_t *ctx, manifest_t *m, const char *key, const char *val) {
+  static const char *const fields[] = { "cfs1", "cfs2", "dfs", "srs1", "srs2" };
+  uint16_t *slots[] = {
+    &m->boundary.cfs1,
+    &m->boundary.cfs2,
+    &m->boundary.dfs,
+    &m->boundary.srs1,
+    &m->boundary.srs2,
+  };
+
+  if (strcmp(key, "file") == 0) {
+    char rpd[PATH_MAX];
+    if (resolve_path(ctx->path, val, rpd, sizeof(rpd)) < 0 || rpd_parse(rpd, &m->boundary) < 0)
+      return -1;
+    ctx->bnd_set = BND_ALL;
+    return 0;
+  }
+
+  for (int i = 0; i < 5; i++) {
+    if (strcmp(key, fields[i]) != 0)
+      continue;
+    uint32_t kb;
+    if (parse_u32(val, &kb) < 0 || kb > UINT16_MAX)
+      return -1;
+    *slots[i] = (uint16_t)kb;
+    ctx->bnd_set |= (uint8_t)(1u << i);
+    return 0;
+  }
+  return -1;
+}
+
+static int
+set_key(parse_ctx_t *ctx, manifest_key_t *k, bool user, const char *key, const char *val) {
+  if (strcmp(key, "file") == 0) {
+    char file[PATH_MAX];
+    if (resolve_path(ctx->path, val, file, sizeof(file)) < 0 || load_key(file, k) < 0)
+      return -1;
+    ctx->has_file = true;
+    return 0;
+  }
+
+  uint32_t idx;
+  if (!user && strcmp(key, "type") == 0) {
+    for (int i = 0; key_tokens[i].name != NULL; i++) {
+      if (strcasecmp(val, key_tokens[i].name) == 0) {
+        k->index = key_tokens[i].kyty;
+        ctx->has_index = true;
+        return 0;
+      }
+    }
+    if (parse_u32(val, &idx) < 0 || idx < KYTY_SECDBG || idx > KYTY_RMA)
+      return -1;
+  } else if (user && strcmp(key, "index") == 0) {
+    if (parse_u32(val, &idx) < 0 || idx > 0xFF)
+      return -1;
+  } else {
+    return -1;
+  }
+  k->index = (uint8_t)idx;
+  ctx->has_index = true;
+  return 0;
+}
+
+/*
+ * Apply one "key = value" line to the current section
+ */
+static int
+set_value(parse_ctx_t *ctx, manifest_t *m, const char *key, const char *val) {
+  switch (ctx->section) {
+  case SEC_IMAGE:
+    return set_image(ctx, &m->images[m->nr_images - 1], key, val);
+  case SEC_BOUNDARY:
+    return set_boundary(ctx, m, key, val);
+  case SEC_PARAM:
+    if (strcmp(key, "init") != 0)
+      return -1;
+    if (strcasecmp(val, "enable") == 0)
+      m->param_init = PARAM_INIT_ENABLED;
+    else if (strcasecmp(val, "disable") == 0)
+      m->param_init = PARAM_INIT_DISABLED;
+    else
+      return -1;
+    m->has_param = true;
+    return 0;
+  case SEC_KEY:
+    return set_key(ctx, &m->keys[m->nr_keys - 1], false, key, val);
+  case SEC_UKEY:
+    return set_key(ctx, &m->ukeys[m->nr_ukeys - 1], true, key, val);
+  case SEC_DLM:
+    if (strcmp(key, "state") != 0)
+      return -1;
+    for (int i = 0; dlm_tokens[i].name != NULL; i++) {
+      if (strcasecmp(val, dlm_tokens[i].name) == 0 && dlm_rank(dlm_tokens[i].code) > 0) {
+        m->dlm = dlm_tokens[i].code;
+        return 0;
+      }
+    }
+    return -1;
+  case SEC_NONE:
+    break;
+  }
+  return -1;
+}
+
+/*
+ * Reject two sections installing the same key slot
+ */
+static int
+check_duplicate_keys(const char *path, const manifest_key_t *keys, int n, const char *what) {
+  for (int i = 0; i < n; i++) {
+    for (int j = i + 1; j < n; j++) {
+      if (keys[i].index == keys[j].index) {
+        warnx("%s: %s %u appears twice", path, what, keys[i].index);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+int
+manifest_load(const char *path, manifest_t *m) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    warn("cannot open manifest: %s", path);
+    return -1;
+  }
+
+  memset(m, 0, sizeof(*m));
+  parse_ctx_t ctx = { .path = path, .section = SEC_NONE };
+  char buf[PATH_MAX + 64];
+  int ret = 0;
+
+  while (ret == 0 && fgets(buf, sizeof(buf), f) != NULL) {
+    ctx.lineno++;
+    char *hash = strchr(buf, '#');
+    if (hash != NULL)
+      *hash = '\0';
+    char *line = trim(buf);
+    if (*line == '\0')
+      continue;
+
+    if (*line == '[') {
+      char *close = strchr(line, ']');
+      if (close == NULL || close[1] != '\0') {
+        warnx("%s:%d: malformed section header", path, ctx.lineno);
+        ret = -1;
+        break;
+      }
+      *close = '\0';
+      ret = finish_section(&ctx, m);
+      if (ret == 0)
+        ret = start_section(&ctx, m, trim(line + 1));
+      continue;
+    }
+
+    char *eq = strchr(line, '=');
+    if (eq == NULL || ctx.section == SEC_NONE) {
+      warnx("%s:%d: expected key = value inside a section", path, ctx.lineno);
+      ret = -1;
+      break;
+    }
+    *eq = '\0';
+    char *key = trim(line);
+    char *val = trim(eq + 1);
+
+    /* Double quotes allow spaces in file names */
+    size_t vlen = strlen(val);
+    if (vlen >= 2 && val[0] == '"' && val[vlen - 1] == '"') {
+      val[vlen - 1] = '\0';
+      val++;
+    }
+
+    if (set_value(&ctx, m, key, val) < 0) {
+      warnx("%s:%d: invalid setting: %s = %s", path, ctx.lineno, key, val);
+      ret = -1;
+    }
+  }
+  fclose(f);
+
+  if (ret == 0)
+    ret = finish_section(&ctx, m);
+  if (ret == 0)
+    ret = check_duplicate_keys(path, m->keys, m->nr_keys, "key type");
+  if (ret == 0)
+    ret = check_duplicate_keys(path, m->ukeys, m->nr_ukeys, "user key index");
+  return ret;
+}
+
+int
+manifest_plan(const manifest_t *m, const manifest_state_t *st, manifest_step_t *steps) {
+  int n = 0;
+
+  bool boundary = m->has_boundary && !st->boundary_ok;
+  bool param = m->has_param && !st->param_ok;
+  bool keys = false, writes = false;
+  for (int i = 0; i < m->nr_keys; i++)
+    keys |= !st->key_ok[i];
+  for (int i = 0; i < m->nr_ukeys; i++)
+    writes |= !st->ukey_ok[i];
+  for (int i = 0; i < m->nr_images; i++)
+    writes |= !st->image_ok[i];
+
+  /* Settings only the SSD state accepts */
+  const char *ssd_item = NULL;
+  if (boundary)
+    ssd_item = "boundary";
+  else if (keys)
+    ssd_item = "DLM keys";
+  else if (param)
+    ssd_item = "init parameter";
+
+  uint8_t cur = st->dlm;
+  uint8_t target = m->dlm != 0 ? m->dlm : cur;
+
+  if (!st->has_dlm) {
+    if (m->dlm != 0 || m->has_boundary || m->nr_keys > 0 || m->has_param) {
+      warnx("device has no DLM support: only [image] and [ukey] can be provisioned");
+      return -1;
+    }
+  } else {
+    bool work = writes || ssd_item != NULL || target != cur;
+
+    if (work && (dlm_rank(cur) < 0 || cur == DLM_STATE_LCK_BOOT)) {
+      warnx("device is in %s state, nothing can be provisioned", dlm_name(cur));
+      return -1;
+    }
+    if (dlm_rank(target) < dlm_rank(cur)) {
+      warnx("device is in %s state, going back to %s needs dlm-auth or init",
+          dlm_name(cur),
+          dlm_name(target));
+      return -1;
+    }
+    if (ssd_item != NULL && dlm_rank(cur) > dlm_rank(DLM_STATE_SSD)) {
+      warnx("%s can only be set in SSD state, device is in %s", ssd_item, dlm_name(cur));
+      return -1;
+    }
+
+    /* Nothing is programmable in CM */
+    if (work && cur == DLM_STATE_CM) {
+      steps[n++] = (manifest_step_t){ STEP_DLM_TRANSIT, 0, DLM_STATE_SSD };
+      cur = DLM_STATE_SSD;
+    }
+  }
+
+  if (boundary)
+    steps[n++] = (manifest_step_t){ STEP_BOUNDARY, 0, 0 };
+  for (int i = 0; i < m->nr_keys; i++) {
+    if (!st->key_ok[i])
+      steps[n++] = (manifest_step_t){ STEP_KEY, i, 0 };
+  }
+  for (int i = 0; i < m->nr_ukeys; i++) {
+    if (!st->ukey_ok[i])
+      steps[n++] = (manifest_step_t){ STEP_UKEY, i, 0 };
+  }
+  for (int i = 0; i < m->nr_images; i++) {
+    if (!st->image_ok[i])
+      steps[n++] = (manifest_step_t){ STEP_IMAGE, i, 0 };
+  }
+  if (param)
+    steps[n++] = (manifest_step_t){ STEP_PARAM, 0, 0 };
+
+  while (st->has_dlm && cur != target) {
+    cur = dlm_next_hop(cur, target);
+    steps[n++] = (manifest_step_t){ STEP_DLM_TRANSIT, 0, cur };
+  }
+
+  return n;
+}
+
+void
+manifest_step_describe(const manifest_t *m, const manifest_step_t *step, char *buf, size_t len) {
+  switch (step->kind) {
+  case STEP_DLM_TRANSIT:
+    snprintf(buf, len, "dlm-transit %s", dlm_name(step->dlm));
+    break;
+  case STEP_BOUNDARY:
+    snprintf(buf,
+        len,
+        "boundary-set cfs1=%u cfs2=%u dfs=%u srs1=%u srs2=%u KB",
+        m->boundary.cfs1,
+        m->boundary.cfs2,
+        m->boundary.dfs,
+        m->boundary.srs1,
+        m->boundary.srs2);
+    break;
+  case STEP_KEY:
+    snprintf(buf, len, "key-set %s", key_name(m->keys[step->item].index));
+    break;
+  case STEP_UKEY:
+    snprintf(buf, len, "ukey-set %u", m->ukeys[step->item].index);
+    break;
+  case STEP_IMAGE: {
+    const manifest_image_t *img = &m->images[step->item];
+    if (img->address != 0)
+      snprintf(buf, len, "erase + write -v %s at 0x%08X", img->file, img->address);
+    else
+      snprintf(buf, len, "erase + write -v %s", img->file);
+  } break;
+  case STEP_PARAM:
+    snprintf(buf,
+        len,
+        "param-set %s",
+        m->param_init == PARAM_INIT_DISABLED ? "disable" : "enable");
+    break;
+  }
+}
+
+int
+rpd_parse(const char *filename, ra_boundary_t *bnd) {
+  FILE *f = fopen(filename, "r");
+  if (!f) {
+    warn("failed to open boundary file: %s", filename);
+    return -1;
+  }
+
+  char line[256];
+  bool found_cfs1 = false, found_cfs2 = false, found_dfs = false;
+  bool found_srs1 = false, found_srs2 = false;
+
+  while (fgets(line, sizeof(line), f)) {
+    char *eq = strchr(line, '=');
+    if (!eq)
+      continue;
+
+    *eq = '\0';
+    const char *key = line;
+    const char *val = eq + 1;
+
+    /* Skip 0x prefix if present */
+    if (val[0] == '0' && (val[1] == 'x' || val[1] == 'X'))
+      val += 2;
+
+    char *endptr;
+    unsigned long bytes = strtoul(val, &endptr, 16);
+
+    /* Convert bytes to KB */
+    uint16_t kb = (uint16_t)(bytes / 1024);
+
+    if (strcmp(key, "FLASH_S_SIZE") == 0) {
+      bnd->cfs1 = kb;
+      found_cfs1 = true;
+    } else if (strcmp(key, "FLASH_C_SIZE") == 0) {
+      bnd->cfs2 = kb;
+      found_cfs2 = true;
+    } else if (strcmp(key, "RAM_S_SIZE") == 0) {
+      bnd->srs1 = kb;
+      found_srs1 = true;
+    } else if (strcmp(key, "RAM_C_SIZE") == 0) {
+      bnd->srs2 = kb;
+      found_srs2 = true;
+    } else if (strcmp(key, "DATA_FLASH_S_SIZE") == 0) {
+      bnd->dfs = kb;
+      found_dfs = true;
+    }
+  }
+
+  fclose(f);
+
+  if (!found_cfs1 || !found_cfs2 || !found_dfs || !found_srs1 || !found_srs2) {
+    warnx("incomplete .rpd file: missing required fields");
+    if (!found_cfs1)
+      warnx("  missing FLASH_S_SIZE (CFS1)");
+    if (!found_cfs2)
+      warnx("  missing FLASH_C_SIZE (CFS2)");
+    if (!found_dfs)
+      warnx("  missing DATA_FLASH_S_SIZE (DFS)");
+    if (!found_srs1)
+      warnx("  missing RAM_S_SIZE (SRS1)");
+    if (!found_srs2)
+      warnx("  missing RAM_C_SIZE (SRS2)");
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Declarative provisioning manifest and execution planner
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "compat.h"
+#include "formats.h"
+#include "radfu.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MANIFEST_MAX_IMAGES 8
+#define MANIFEST_MAX_KEYS 3 /* one per DLM key type */
+#define MANIFEST_MAX_UKEYS 16
+#define MANIFEST_KEY_MAX_LEN 48
+
+/* Image to program, address 0 means the address embedded in the file */
+typedef struct {
+  char file[PATH_MAX];
+  uint32_t address;
+  input_format_t format;
+} manifest_image_t;
+
+/* Wrapped key, loaded when the manifest is parsed */
+typedef struct {
+  uint8_t index; /* KYTY for DLM keys, KYID for user keys */
+  uint8_t data[MANIFEST_KEY_MAX_LEN];
+  size_t len;
+} manifest_key_t;
+
+/* Desired end state of a device, only the sections present are checked */
+typedef struct manifest {
+  manifest_image_t images[MANIFEST_MAX_IMAGES];
+  int nr_images;
+  bool has_boundary;
+  ra_boundary_t boundary;
+  bool has_param;
+  uint8_t param_init; /* PARAM_INIT_ENABLED or PARAM_INIT_DISABLED */
+  manifest_key_t keys[MANIFEST_MAX_KEYS];
+  int nr_keys;
+  manifest_key_t ukeys[MANIFEST_MAX_UKEYS];
+  int nr_ukeys;
+  uint8_t dlm; /* target DLM state, 0 = leave unchanged */
+} manifest_t;
+
+/* What the device already matches, filled by the caller before planning */
+typedef struct {
+  bool has_dlm; /* false on devices without DLM (GrpD) */
+  uint8_t dlm;
+  bool boundary_ok;
+  bool param_ok;
+  bool key_ok[MANIFEST_MAX_KEYS];
+  bool ukey_ok[MANIFEST_MAX_UKEYS];
+  bool image_ok[MANIFEST_MAX_IMAGES];
+} manifest_state_t;
+
+typedef enum {
+  STEP_DLM_TRANSIT,
+  STEP_BOUNDARY,
+  STEP_KEY,
+  STEP_UKEY,
+  STEP_IMAGE,
+  STEP_PARAM,
+} manifest_step_kind_t;
+
+typedef struct {
+  manifest_step_kind_t kind;
+  int item;    /* index in images/keys/ukeys */
+  uint8_t dlm; /* STEP_DLM_TRANSIT destination */
+} manifest_step_t;
+
+/* Every item once, plus the longest forward DLM path (CM -> LCK_BOOT) */
+#define MANIFEST_MAX_STEPS                                                                         \
+  (MANIFEST_MAX_IMAGES + MANIFEST_MAX_KEYS + MANIFEST_MAX_UKEYS + 2 + 5)
+
+/*
+ * Load a manifest (INI-like text, see radfu(1) [provisioning manifest])
+ * Relative file names are resolved from the manifest directory, key files
+ * and .rpd files are read immediately so that errors surface before the
+ * device is touched.
+ * Returns: 0 on success, -1 on error (reported with file and line)
+ */
+int manifest_load(const char *path, manifest_t *m);
+
+/*
+ * Build the minimal ordered list of steps taking the device from st to m:
+ *   CM -> SSD first when anything has to be done
+ *   boundary, DLM keys (SSD only), user keys, images
+ *   init parameter (disabling it removes the factory reset escape hatch)
+ *   forward DLM transitions, last
+ * Items the device already matches produce no step.
+ * Returns: number of steps (0 = nothing to do), -1 if the device cannot
+ *          reach the manifest state without authentication or a reset
+ */
+int manifest_plan(const manifest_t *m, const manifest_state_t *st, manifest_step_t *steps);
+
+/*
+ * Describe one planned step on a single line
+ */
+void manifest_step_describe(
+    const manifest_t *m, const manifest_step_t *step, char *buf, size_t len);
+
+/*
+ * Parse .rpd (Renesas Partition Data) file for TrustZone boundary settings
+ * Format: key=value lines where values are hex (with 0x prefix) in bytes
+ * Keys: FLASH_S_SIZE, FLASH_C_SIZE, RAM_S_SIZE, RAM_C_SIZE, DATA_FLASH_S_SIZE
+ * Converts bytes to KB for boundary settings
+ * Returns: 0 on success, -1 on error
+ */
+int rpd_parse(const char *filename, ra_boundary_t *bnd);
+
+#endif /* MANIFEST_H */
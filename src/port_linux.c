@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <linux/limits.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -61,8 +62,14 @@ ra_print_usb_info(const char *tty_name) {
   if (read_sysfs_str(path, serial, sizeof(serial)) < 0)
     strcpy(serial, "N/A");
 
-  fprintf(stderr, "USB device: %s %s [%s:%s] serial=%s\n", manufacturer, product, vid, pid, serial);
-  fprintf(stderr, "TTY port:   /dev/%s\n", tty_name);
+  ra_log(RA_LOG_INFO,
+      "USB device: %s %s [%s:%s] serial=%s",
+      manufacturer,
+      product,
+      vid,
+      pid,
+      serial);
+  ra_log(RA_LOG_INFO, "TTY port:   /dev/%s", tty_name);
 }
 
 /*
@@ -125,62 +132,93 @@ ra_get_adapter_max_baudrate(const char *tty_name) {
   for (const struct usb_serial_adapter *a = known_adapters; a->name != NULL; a++) {
     if (a->vid == vid && a->pid == pid) {
       if (a->max_baud >= 1000000) {
-        fprintf(stderr, "Adapter: %s (max %.0f Mbps)\n", a->name, a->max_baud / 1000000.0);
+        ra_log(RA_LOG_INFO, "Adapter: %s (max %.0f Mbps)", a->name, a->max_baud / 1000000.0);
       } else {
-        fprintf(stderr, "Adapter: %s (max %.0f Kbps)\n", a->name, a->max_baud / 1000.0);
+        ra_log(RA_LOG_INFO, "Adapter: %s (max %.0f Kbps)", a->name, a->max_baud / 1000.0);
       }
       return a->max_baud;
     }
   }
 
   /* Unknown adapter - use conservative default */
-  fprintf(stderr, "Unknown USB-serial adapter [%04x:%04x], using 115200 bps max\n", vid, pid);
+  ra_log(RA_LOG_INFO, "Unknown USB-serial adapter [%04x:%04x], using 115200 bps max", vid, pid);
   return 115200;
 }
 
+/* ttyACM/ttyUSB device whose USB vendor is Renesas */
+static bool
+is_renesas_tty(const char *name) {
+  char vid_path[PATH_MAX];
+  char vid_str[16];
+  unsigned int vid;
+
+  if (strncmp(name, "ttyACM", 6) != 0 && strncmp(name, "ttyUSB", 6) != 0)
+    return false;
+  snprintf(vid_path, sizeof(vid_path), "/sys/class/tty/%s/device/../idVendor", name);
+  if (read_sysfs_str(vid_path, vid_str, sizeof(vid_str)) < 0)
+    return false;
+  return sscanf(vid_str, "%x", &vid) == 1 && vid == RENESAS_VID;
+}
+
 int
 ra_find_port(char *buf, size_t len, char *tty_name, size_t tty_len) {
   DIR *dir;
   struct dirent *ent;
   char path[PATH_MAX];
-  char vid_path[PATH_MAX];
-  char vid_str[16];
-  FILE *f;
 
   dir = opendir("/sys/class/tty");
   if (dir == NULL)
     return -1;
 
   while ((ent = readdir(dir)) != NULL) {
-    if (strncmp(ent->d_name, "ttyACM", 6) != 0 && strncmp(ent->d_name, "ttyUSB", 6) != 0)
+    if (!is_renesas_tty(ent->d_name))
       continue;
 
-    snprintf(vid_path, sizeof(vid_path), "/sys/class/tty/%s/device/../idVendor", ent->d_name);
-    f = fopen(vid_path, "r");
-    if (f == NULL)
-      continue;
-
-    if (fgets(vid_str, sizeof(vid_str), f) != NULL) {
-      unsigned int vid;
-      if (sscanf(vid_str, "%x", &vid) == 1 && vid == RENESAS_VID) {
-        snprintf(path, sizeof(path), "/dev/%s", ent->d_name);
-        fclose(f);
-        closedir(dir);
-        if (strlen(path) < len) {
-          strncpy(buf, path, len);
-          buf[len - 1] = '\0';
-          if (tty_name != NULL && tty_len > 0) {
-            strncpy(tty_name, ent->d_name, tty_len);
-            tty_name[tty_len - 1] = '\0';
-          }
-          return 0;
-        }
-        return -1;
+    /* ent belongs to dir: copy the name before closing it */
+    int ret = -1;
+    snprintf(path, sizeof(path), "/dev/%s", ent->d_name);
+    if (strlen(path) < len) {
+      strncpy(buf, path, len);
+      buf[len - 1] = '\0';
+      if (tty_name != NULL && tty_len > 0) {
+        strncpy(tty_name, ent->d_name, tty_len);
+        tty_name[tty_len - 1] = '\0';
       }
+      ret = 0;
     }
-    fclose(f);
+    closedir(dir);
+    return ret;
   }
 
   closedir(dir);
   return -1;
 }
+
+static int
+compare_ports(const void *a, const void *b) {
+  return strcmp(a, b);
+}
+
+int
+ra_find_ports(char (*ports)[RA_PORT_LEN], int max) {
+  DIR *dir;
+  struct dirent *ent;
+  int count = 0;
+
+  dir = opendir("/sys/class/tty");
+  if (dir == NULL)
+    return 0;
+
+  while (count < max && (ent = readdir(dir)) != NULL) {
+    if (!is_renesas_tty(ent->d_name))
+      continue;
+    /* A name too long for a port path cannot be opened by it either */
+    int n = snprintf(ports[count], RA_PORT_LEN, "/dev/%s", ent->d_name);
+    if (n > 0 && n < RA_PORT_LEN)
+      count++;
+  }
+
+  closedir(dir);
+  qsort(ports, (size_t)count, sizeof(ports[0]), compare_ports);
+  return count;
+}
@@ -88,8 +88,14 @@ ra_print_usb_info(const char *tty_name) {
     }
   }
 
-  fprintf(stderr, "USB device: %s %s [%s:%s] serial=%s\n", manufacturer, product, vid, pid, serial);
-  fprintf(stderr, "TTY port:   %s\n", tty_name);
+  ra_log(RA_LOG_INFO,
+      "USB device: %s %s [%s:%s] serial=%s",
+      manufacturer,
+      product,
+      vid,
+      pid,
+      serial);
+  ra_log(RA_LOG_INFO, "TTY port:   %s", tty_name);
 }
 
 /*
@@ -153,15 +159,15 @@ ra_get_adapter_max_baudrate(const char *tty_name) {
   for (const struct usb_serial_adapter *a = known_adapters; a->name != NULL; a++) {
     if (a->vid == vid && a->pid == pid) {
       if (a->max_baud >= 1000000) {
-        fprintf(stderr, "Adapter: %s (max %.0f Mbps)\n", a->name, a->max_baud / 1000000.0);
+        ra_log(RA_LOG_INFO, "Adapter: %s (max %.0f Mbps)", a->name, a->max_baud / 1000000.0);
       } else {
-        fprintf(stderr, "Adapter: %s (max %.0f Kbps)\n", a->name, a->max_baud / 1000.0);
+        ra_log(RA_LOG_INFO, "Adapter: %s (max %.0f Kbps)", a->name, a->max_baud / 1000.0);
       }
       return a->max_baud;
     }
   }
 
-  fprintf(stderr, "Unknown USB-serial adapter [%04x:%04x], using 115200 bps max\n", vid, pid);
+  ra_log(RA_LOG_INFO, "Unknown USB-serial adapter [%04x:%04x], using 115200 bps max", vid, pid);
   return 115200;
 }
 
@@ -214,3 +220,35 @@ ra_find_port(char *buf, size_t len, char *tty_name, size_t tty_len) {
   IOObjectRelease(iter);
   return -1;
 }
+
+int
+ra_find_ports(char (*ports)[RA_PORT_LEN], int max) {
+  io_iterator_t iter;
+  io_service_t service;
+  int count = 0;
+
+  CFMutableDictionaryRef match = IOServiceMatching(kIOSerialBSDServiceValue);
+  if (match == NULL)
+    return 0;
+
+  CFDictionarySetValue(match, CFSTR(kIOSerialBSDTypeKey), CFSTR(kIOSerialBSDAllTypes));
+
+  if (IOServiceGetMatchingServices(kIOMainPortDefault, match, &iter) != KERN_SUCCESS)
+    return 0;
+
+  while (count < max && (service = IOIteratorNext(iter)) != IO_OBJECT_NULL) {
+    if (get_iokit_usb_int_property(service, CFSTR("idVendor")) == RENESAS_VID) {
+      CFStringRef path_cf = IORegistryEntryCreateCFProperty(
+          service, CFSTR(kIOCalloutDeviceKey), kCFAllocatorDefault, 0);
+      if (path_cf != NULL) {
+        if (CFStringGetCString(path_cf, ports[count], RA_PORT_LEN, kCFStringEncodingUTF8))
+          count++;
+        CFRelease(path_cf);
+      }
+    }
+    IOObjectRelease(service);
+  }
+
+  IOObjectRelease(iter);
+  return count;
+}
@@ -184,14 +184,14 @@ ra_print_usb_info(const char *tty_name) {
             sizeof(product),
             serial,
             sizeof(serial)) == 0) {
-      fprintf(stderr,
-          "USB device: %s %s [%04X:%04X] serial=%s\n",
+      ra_log(RA_LOG_INFO,
+          "USB device: %s %s [%04X:%04X] serial=%s",
           manufacturer,
           product,
           vid,
           pid,
           serial);
-      fprintf(stderr, "COM port:   %s\n", tty_name);
+      ra_log(RA_LOG_INFO, "COM port:   %s", tty_name);
     }
     break;
   }
@@ -245,16 +245,16 @@ ra_get_adapter_max_baudrate(const char *tty_name) {
     for (const struct usb_serial_adapter *a = known_adapters; a->name != NULL; a++) {
       if (a->vid == vid && a->pid == pid) {
         if (a->max_baud >= 1000000) {
-          fprintf(stderr, "Adapter: %s (max %.0f Mbps)\n", a->name, a->max_baud / 1000000.0);
+          ra_log(RA_LOG_INFO, "Adapter: %s (max %.0f Mbps)", a->name, a->max_baud / 1000000.0);
         } else {
-          fprintf(stderr, "Adapter: %s (max %.0f Kbps)\n", a->name, a->max_baud / 1000.0);
+          ra_log(RA_LOG_INFO, "Adapter: %s (max %.0f Kbps)", a->name, a->max_baud / 1000.0);
         }
         return a->max_baud;
       }
     }
 
     /* Unknown adapter */
-    fprintf(stderr, "Unknown USB-serial adapter [%04X:%04X], using 115200 bps max\n", vid, pid);
+    ra_log(RA_LOG_INFO, "Unknown USB-serial adapter [%04X:%04X], using 115200 bps max", vid, pid);
     return 115200;
   }
 
@@ -274,7 +274,7 @@ ra_find_port(char *buf, size_t len, char *tty_name, size_t tty_len) {
   dev_info = SetupDiGetClassDevsA(
       &GUID_DEVINTERFACE_COMPORT, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
   if (dev_info == INVALID_HANDLE_VALUE) {
-    fprintf(stderr, "Failed to enumerate COM ports\n");
+    warnx("Failed to enumerate COM ports");
     return -1;
   }
 
@@ -314,6 +314,47 @@ ra_find_port(char *buf, size_t len, char *tty_name, size_t tty_len) {
   }
 
   SetupDiDestroyDeviceInfoList(dev_info);
-  fprintf(stderr, "no Renesas device found\n");
+  warnx("no Renesas device found");
   return -1;
 }
+
+int
+ra_find_ports(char (*ports)[RA_PORT_LEN], int max) {
+  HDEVINFO dev_info;
+  SP_DEVINFO_DATA dev_data;
+  DWORD idx = 0;
+  char port_name[32];
+  unsigned int vid, pid;
+  char manufacturer[128], product[128], serial[64];
+  int count = 0;
+
+  dev_info = SetupDiGetClassDevsA(
+      &GUID_DEVINTERFACE_COMPORT, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+  if (dev_info == INVALID_HANDLE_VALUE)
+    return 0;
+
+  dev_data.cbSize = sizeof(SP_DEVINFO_DATA);
+
+  while (count < max && SetupDiEnumDeviceInfo(dev_info, idx++, &dev_data)) {
+    if (get_com_port_name(dev_info, &dev_data, port_name, sizeof(port_name)) < 0)
+      continue;
+
+    if (get_usb_device_info(dev_info,
+            &dev_data,
+            &vid,
+            &pid,
+            manufacturer,
+            sizeof(manufacturer),
+            product,
+            sizeof(product),
+            serial,
+            sizeof(serial)) < 0)
+      continue;
+
+    if (vid == RENESAS_VID)
+      snprintf(ports[count++], RA_PORT_LEN, "%s", port_name);
+  }
+
+  SetupDiDestroyDeviceInfoList(dev_info);
+  return count;
+}
@@ -16,9 +16,31 @@
 
 #define BAR_WIDTH 30
 
+/*
+ * A bar redrawn per 1 KB packet is thousands of writes per second for
+ * nothing: render at most every RENDER_SECS, plus the first and last update
+ */
+#define RENDER_SECS 0.2
+
+/* Speed: EWMA of per-render samples, weight of the newest one */
+#define RATE_ALPHA 0.3
+#define RATE_MIN_SECS 0.05 /* shorter samples are too noisy to count */
+
 /* Global quiet mode */
 int progress_global_quiet = 0;
 
+/* Global callback, copied into each new instance */
+static progress_cb_t global_callback;
+static void *global_user_data;
+
+/* Machine-readable channel, and what its events are tagged with */
+static FILE *channel;
+static const char *channel_port;
+static const char *channel_device;
+
+/* Clock of the throttling, NULL for the monotonic clock */
+static progress_clock_t clock_since;
+
 #ifdef _WIN32
 /* Windows: use QueryPerformanceCounter for high-resolution timing */
 static LARGE_INTEGER perf_freq;
@@ -56,17 +78,40 @@ get_elapsed_secs(const progress_time_t *start) {
 }
 #endif
 
+void
+progress_time_now(progress_time_t *t) {
+  get_current_time(t);
+}
+
+double
+progress_time_since(const progress_time_t *start) {
+  return get_elapsed_secs(start);
+}
+
+static void report(progress_t *p, size_t current, const char *event);
+
 void
 progress_init(progress_t *p, size_t total, const char *desc) {
-  p->total = total;
-  p->current = 0;
+  progress_init_steps(p, total, total, desc);
+}
+
+void
+progress_init_steps(progress_t *p, size_t steps, size_t bytes, const char *desc) {
+  progress_init_quiet(p, steps, bytes, desc, progress_global_quiet);
+}
+
+void
+progress_init_quiet(progress_t *p, size_t steps, size_t bytes, const char *desc, int quiet) {
+  memset(p, 0, sizeof(*p));
+  p->total = steps;
+  p->bytes = bytes;
   p->width = BAR_WIDTH;
   p->desc = desc;
-  p->callback = NULL;
-  p->user_data = NULL;
-  p->quiet = progress_global_quiet;
+  p->callback = global_callback;
+  p->user_data = global_user_data;
+  p->quiet = quiet;
   get_current_time(&p->start_time);
-  progress_update(p, 0);
+  report(p, 0, "start");
 }
 
 void
@@ -75,28 +120,97 @@ progress_set_callback(progress_t *p, progress_cb_t cb, void *user_data) {
   p->user_data = user_data;
 }
 
+void
+progress_set_global_callback(progress_cb_t cb, void *user_data) {
+  global_callback = cb;
+  global_user_data = user_data;
+}
+
+void
+progress_set_channel(FILE *out) {
+  channel = out;
+}
+
+void
+progress_set_device(const char *port, const char *device) {
+  channel_port = port;
+  channel_device = device;
+}
+
+void
+progress_set_clock(progress_clock_t since) {
+  clock_since = since;
+}
+
 void
 progress_set_quiet(progress_t *p, int quiet) {
   p->quiet = quiet;
 }
 
-void
-progress_update(progress_t *p, size_t current) {
-  p->current = current;
+/* Bytes done after current steps */
+static size_t
+done_bytes(const progress_t *p, size_t current) {
+  if (p->total == 0 || p->bytes == p->total)
+    return current;
+  if (current >= p->total)
+    return p->bytes;
+  return (size_t)((uint64_t)current * p->bytes / p->total);
+}
 
-  /* Use callback if set */
-  if (p->callback != NULL) {
-    p->callback(current, p->total, p->desc, p->user_data);
-    /* If quiet, skip default output even after callback */
-    if (p->quiet)
-      return;
-  }
+static void
+update_rate(progress_t *p, double now) {
+  size_t bytes = done_bytes(p, p->current);
+  double dt = now - p->rate_secs;
 
-  /* Skip output in quiet mode */
-  if (p->quiet)
+  if (dt < RATE_MIN_SECS || bytes < p->rate_bytes)
     return;
 
-  /* Default: print to stderr */
+  double sample = (double)(bytes - p->rate_bytes) / dt;
+  p->rate = p->rate > 0 ? RATE_ALPHA * sample + (1 - RATE_ALPHA) * p->rate : sample;
+  p->rate_secs = now;
+  p->rate_bytes = bytes;
+}
+
+/* Print s as a JSON string */
+static void
+put_json_str(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\')
+      fprintf(out, "\\%c", *s);
+    else if ((unsigned char)*s < 0x20)
+      fprintf(out, "\\u%04x", (unsigned char)*s);
+    else
+      fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+static void
+emit_event(const progress_t *p, const char *event, double now) {
+  fprintf(channel, "{\"event\":\"%s\",\"phase\":", event);
+  put_json_str(channel, p->desc != NULL ? p->desc : "");
+  fprintf(channel,
+      ",\"bytes\":%zu,\"total\":%zu,\"rate\":%.0f,\"elapsed\":%.3f",
+      done_bytes(p, p->current),
+      p->bytes,
+      p->rate,
+      now);
+  if (channel_port != NULL) {
+    fprintf(channel, ",\"port\":");
+    put_json_str(channel, channel_port);
+  }
+  if (channel_device != NULL) {
+    fprintf(channel, ",\"device\":");
+    put_json_str(channel, channel_device);
+  }
+  fprintf(channel, "}\n");
+  fflush(channel);
+}
+
+static void
+render_bar(const progress_t *p) {
+  size_t current = p->current;
   int percent = 0;
   int filled = 0;
 
@@ -115,23 +229,22 @@ progress_update(progress_t *p, size_t current) {
   memset(bar, '#', filled);
   bar[p->width] = '\0';
 
-  /* Calculate speed and ETA */
-  double elapsed = get_elapsed_secs(&p->start_time);
+  /* Speed and ETA from the smoothed rate */
   char speed_str[32] = "";
   char eta_str[32] = "";
 
-  if (elapsed > 0.1 && current > 0) {
+  if (p->rate > 0) {
     /* Speed in KB/s */
-    double speed = (double)current / elapsed / 1024.0;
+    double speed = p->rate / 1024.0;
     if (speed >= 1000.0)
       snprintf(speed_str, sizeof(speed_str), " %.1f MB/s", speed / 1024.0);
     else
       snprintf(speed_str, sizeof(speed_str), " %.1f KB/s", speed);
 
     /* ETA calculation */
-    if (current < p->total && speed > 0) {
-      double remaining_bytes = (double)(p->total - current);
-      double eta_secs = remaining_bytes / (speed * 1024.0);
+    size_t done = done_bytes(p, current);
+    if (done < p->bytes) {
+      double eta_secs = (double)(p->bytes - done) / p->rate;
       if (eta_secs < 60)
         snprintf(eta_str, sizeof(eta_str), " ETA %ds", (int)eta_secs);
       else if (eta_secs < 3600)
@@ -158,9 +271,42 @@ progress_update(progress_t *p, size_t current) {
   fflush(stderr);
 }
 
+/* Callback on every update; bar or channel event when due */
+static void
+report(progress_t *p, size_t current, const char *event) {
+  p->current = current;
+
+  /* Use callback if set */
+  if (p->callback != NULL)
+    p->callback(current, p->total, p->desc, p->user_data);
+
+  /* Skip output in quiet mode, unless a channel was asked for */
+  if (p->quiet && channel == NULL)
+    return;
+
+  double now = clock_since != NULL ? clock_since(&p->start_time) : get_elapsed_secs(&p->start_time);
+  bool due = !p->shown || current >= p->total || now - p->shown_secs >= RENDER_SECS;
+  if (strcmp(event, "progress") == 0 && !due)
+    return;
+
+  update_rate(p, now);
+  p->shown = true;
+  p->shown_secs = now;
+
+  if (channel != NULL)
+    emit_event(p, event, now);
+  else
+    render_bar(p);
+}
+
+void
+progress_update(progress_t *p, size_t current) {
+  report(p, current, "progress");
+}
+
 void
 progress_finish(progress_t *p) {
-  progress_update(p, p->total);
-  if (p->callback == NULL && !p->quiet)
+  report(p, p->total, "done");
+  if (channel == NULL && p->callback == NULL && !p->quiet)
     fprintf(stderr, "\n");
 }
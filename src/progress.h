@@ -9,8 +9,10 @@
 #ifndef PROGRESS_H
 #define PROGRESS_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -30,15 +32,32 @@ typedef void (*progress_cb_t)(size_t current, size_t total, const char *desc, vo
 typedef struct {
   size_t total;
   size_t current;
+  size_t bytes; /* Bytes that total stands for, for speed/ETA */
   int width;
   const char *desc;
   progress_cb_t callback;
   void *user_data;
   progress_time_t start_time; /* Start time for speed/ETA calculation */
   int quiet;                  /* Suppress output if set */
+  bool shown;                 /* Rendered at least once */
+  double shown_secs;          /* Last render, since start_time */
+  double rate;                /* Smoothed speed, bytes/s (0 until measured) */
+  double rate_secs;           /* Last rate sample */
+  size_t rate_bytes;
 } progress_t;
 
 void progress_init(progress_t *p, size_t total, const char *desc);
+
+/*
+ * Same, counting steps (e.g. 1 KB packets) that move bytes bytes in all
+ */
+void progress_init_steps(progress_t *p, size_t steps, size_t bytes, const char *desc);
+
+/*
+ * Same, quiet or not whatever progress_global_quiet says (e.g. a library
+ * session, which owns no terminal)
+ */
+void progress_init_quiet(progress_t *p, size_t steps, size_t bytes, const char *desc, int quiet);
 void progress_update(progress_t *p, size_t current);
 void progress_finish(progress_t *p);
 
@@ -48,12 +67,46 @@ void progress_finish(progress_t *p);
  */
 void progress_set_callback(progress_t *p, progress_cb_t cb, void *user_data);
 
+/*
+ * Callback for every progress created from now on (process wide), so a
+ * library caller follows operations it does not drive itself
+ * NULL goes back to the terminal bar.
+ */
+void progress_set_global_callback(progress_cb_t cb, void *user_data);
+
 /*
  * Set quiet mode (suppress default progress output to stderr)
  * Callbacks are still invoked if set
  */
 void progress_set_quiet(progress_t *p, int quiet);
 
+/*
+ * Machine-readable channel (--progress-fd): from now on every instance
+ * writes one JSON object per line to out instead of the terminal bar, even
+ * in quiet mode. Events: "start", "progress" (throttled like the bar) and
+ * "done", with phase, bytes, total, rate (bytes/s), elapsed and, when set,
+ * port and device. NULL goes back to the terminal bar.
+ */
+void progress_set_channel(FILE *out);
+
+/*
+ * Port and device (unique ID) reported on the channel, NULL to leave out
+ */
+void progress_set_device(const char *port, const char *device);
+
+/*
+ * Monotonic timestamp, and seconds elapsed since one (e.g. to time batch steps)
+ */
+void progress_time_now(progress_time_t *t);
+double progress_time_since(const progress_time_t *start);
+
+/*
+ * Clock the bar and channel throttling read, as seconds since an instance
+ * started; NULL for the monotonic clock (tests drive it by hand)
+ */
+typedef double (*progress_clock_t)(const progress_time_t *start);
+void progress_set_clock(progress_clock_t since);
+
 /*
  * Global quiet mode setting (affects all progress instances)
  * Set before calling progress_init to apply to new instances
@@ -0,0 +1,470 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Buffer checksum and classification kernels (SIMD with portable fallback)
+ *
+ * Every kernel has a portable word-at-a-time version. On x86 the SSE2 and
+ * AVX2 versions are compiled with target attributes and picked at runtime
+ * from the CPU features; on AArch64 NEON is always available.
+ */
+
+#include "rabuf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RABUF_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h> /* interlocked pointer access */
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define RABUF_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define ALL_ONES64 UINT64_C(0xFFFFFFFFFFFFFFFF)
+
+typedef struct {
+  const char *name;
+  bool (*supported)(void);
+  uint32_t (*sum)(const uint8_t *buf, size_t len);
+  size_t (*first_used)(const uint8_t *buf, size_t len);
+  size_t (*last_used)(const uint8_t *buf, size_t len);
+  size_t (*count_used)(const uint8_t *buf, size_t len);
+  size_t (*mismatch)(const uint8_t *a, const uint8_t *b, size_t len);
+} rabuf_impl_t;
+
+/*
+ * Portable kernels: 8 bytes at a time with unaligned-safe loads
+ */
+
+static inline uint64_t
+load64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline unsigned
+popcount64(uint64_t v) {
+#if defined(__GNUC__)
+  return (unsigned)__builtin_popcountll(v);
+#else
+  unsigned n = 0;
+  for (; v != 0; v &= v - 1)
+    n++;
+  return n;
+#endif
+}
+
+static uint32_t
+generic_sum(const uint8_t *buf, size_t len) {
+  const uint64_t lo = UINT64_C(0x00FF00FF00FF00FF);
+  uint64_t sum = 0;
+  size_t i = 0;
+
+  while (len - i >= 8) {
+    /* Four 16-bit lanes take up to 128 words (128 * 510) before overflow */
+    uint64_t acc = 0;
+    for (int n = 0; n < 128 && len - i >= 8; n++, i += 8) {
+      uint64_t w = load64(buf + i);
+      acc += (w & lo) + ((w >> 8) & lo);
+    }
+    sum += (acc & 0xFFFF) + ((acc >> 16) & 0xFFFF) + ((acc >> 32) & 0xFFFF) + (acc >> 48);
+  }
+
+  for (; i < len; i++)
+    sum += buf[i];
+
+  return (uint32_t)sum;
+}
+
+static size_t
+generic_first_used(const uint8_t *buf, size_t len) {
+  size_t i = 0;
+
+  for (; i + 8 <= len; i += 8) {
+    if (load64(buf + i) != ALL_ONES64)
+      break;
+  }
+  for (; i < len; i++) {
+    if (buf[i] != 0xFF)
+      return i;
+  }
+  return len;
+}
+
+static size_t
+generic_last_used(const uint8_t *buf, size_t len) {
+  size_t i = len;
+
+  while (i >= 8 && load64(buf + i - 8) == ALL_ONES64)
+    i -= 8;
+  while (i > 0 && buf[i - 1] == 0xFF)
+    i--;
+  return i;
+}
+
+static size_t
+generic_count_used(const uint8_t *buf, size_t len) {
+  const uint64_t hi = UINT64_C(0x8080808080808080);
+  const uint64_t lo7 = UINT64_C(0x7F7F7F7F7F7F7F7F);
+  size_t count = 0;
+  size_t i = 0;
+
+  for (; i + 8 <= len; i += 8) {
+    /* Non-zero byte of x <=> used byte; set its top bit without carries */
+    uint64_t x = ~load64(buf + i);
+    count += popcount64((((x & lo7) + lo7) | x) & hi);
+  }
+  for (; i < len; i++)
+    count += (buf[i] != 0xFF);
+
+  return count;
+}
+
+static size_t
+generic_mismatch(const uint8_t *a, const uint8_t *b, size_t len) {
+  size_t i = 0;
+
+  for (; i + 8 <= len; i += 8) {
+    if (load64(a + i) != load64(b + i))
+      break;
+  }
+  for (; i < len; i++) {
+    if (a[i] != b[i])
+      return i;
+  }
+  return len;
+}
+
+#ifdef RABUF_X86
+/*
+ * SSE2 kernels: 16 bytes per step, SAD against zero for sums
+ */
+
+static bool
+sse2_supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2");
+}
+
+static TARGET_SSE2 uint32_t
+sse2_sum(const uint8_t *buf, size_t len) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = _mm_setzero_si128();
+  uint64_t lanes[2];
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16)
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(buf + i)), zero));
+
+  _mm_storeu_si128((__m128i *)lanes, acc);
+  return (uint32_t)(lanes[0] + lanes[1]) + generic_sum(buf + i, len - i);
+}
+
+static TARGET_SSE2 size_t
+sse2_first_used(const uint8_t *buf, size_t len) {
+  const __m128i ff = _mm_set1_epi8((char)0xFF);
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, ff));
+    if (mask != 0xFFFF)
+      return i + (size_t)__builtin_ctz(~mask & 0xFFFF);
+  }
+  return i + generic_first_used(buf + i, len - i);
+}
+
+static TARGET_SSE2 size_t
+sse2_last_used(const uint8_t *buf, size_t len) {
+  const __m128i ff = _mm_set1_epi8((char)0xFF);
+  size_t i = len;
+
+  for (; i >= 16; i -= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(buf + i - 16));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, ff));
+    if (mask != 0xFFFF)
+      return i - 16 + (size_t)(32 - __builtin_clz(~mask & 0xFFFF));
+  }
+  return generic_last_used(buf, i);
+}
+
+static TARGET_SSE2 size_t
+sse2_count_used(const uint8_t *buf, size_t len) {
+  const __m128i ff = _mm_set1_epi8((char)0xFF);
+  size_t count = 0;
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, ff));
+    count += 16 - (size_t)__builtin_popcount(mask);
+  }
+  return count + generic_count_used(buf + i, len - i);
+}
+
+static TARGET_SSE2 size_t
+sse2_mismatch(const uint8_t *a, const uint8_t *b, size_t len) {
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+    if (mask != 0xFFFF)
+      return i + (size_t)__builtin_ctz(~mask & 0xFFFF);
+  }
+  return i + generic_mismatch(a + i, b + i, len - i);
+}
+
+/*
+ * AVX2 kernels: 32 bytes per step
+ */
+
+static bool
+avx2_supported(void) {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+static TARGET_AVX2 uint32_t
+avx2_sum(const uint8_t *buf, size_t len) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc = _mm256_setzero_si256();
+  uint64_t lanes[4];
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+  }
+
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+  return (uint32_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]) + generic_sum(buf + i, len - i);
+}
+
+static TARGET_AVX2 size_t
+avx2_first_used(const uint8_t *buf, size_t len) {
+  const __m256i ff = _mm256_set1_epi8((char)0xFF);
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, ff));
+    if (mask != UINT32_MAX)
+      return i + (size_t)__builtin_ctz(~mask);
+  }
+  return i + generic_first_used(buf + i, len - i);
+}
+
+static TARGET_AVX2 size_t
+avx2_last_used(const uint8_t *buf, size_t len) {
+  const __m256i ff = _mm256_set1_epi8((char)0xFF);
+  size_t i = len;
+
+  for (; i >= 32; i -= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i - 32));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, ff));
+    if (mask != UINT32_MAX)
+      return i - 32 + (size_t)(32 - __builtin_clz(~mask));
+  }
+  return generic_last_used(buf, i);
+}
+
+static TARGET_AVX2 size_t
+avx2_count_used(const uint8_t *buf, size_t len) {
+  const __m256i ff = _mm256_set1_epi8((char)0xFF);
+  size_t count = 0;
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, ff));
+    count += 32 - (size_t)__builtin_popcount(mask);
+  }
+  return count + generic_count_used(buf + i, len - i);
+}
+
+static TARGET_AVX2 size_t
+avx2_mismatch(const uint8_t *a, const uint8_t *b, size_t len) {
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+    if (mask != UINT32_MAX)
+      return i + (size_t)__builtin_ctz(~mask);
+  }
+  return i + generic_mismatch(a + i, b + i, len - i);
+}
+#endif /* RABUF_X86 */
+
+#ifdef RABUF_NEON
+/*
+ * NEON kernels: 16 bytes per step, horizontal reductions locate the block
+ * and the portable kernel finishes inside it
+ */
+
+static uint32_t
+neon_sum(const uint8_t *buf, size_t len) {
+  uint64_t sum = 0;
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16)
+    sum += vaddlvq_u8(vld1q_u8(buf + i));
+
+  return (uint32_t)sum + generic_sum(buf + i, len - i);
+}
+
+static size_t
+neon_first_used(const uint8_t *buf, size_t len) {
+  const uint8x16_t ff = vdupq_n_u8(0xFF);
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    if (vminvq_u8(vceqq_u8(vld1q_u8(buf + i), ff)) != 0xFF)
+      break;
+  }
+  return i + generic_first_used(buf + i, len - i);
+}
+
+static size_t
+neon_last_used(const uint8_t *buf, size_t len) {
+  const uint8x16_t ff = vdupq_n_u8(0xFF);
+  size_t i = len;
+
+  for (; i >= 16; i -= 16) {
+    if (vminvq_u8(vceqq_u8(vld1q_u8(buf + i - 16), ff)) != 0xFF)
+      break;
+  }
+  return generic_last_used(buf, i);
+}
+
+static size_t
+neon_count_used(const uint8_t *buf, size_t len) {
+  const uint8x16_t ff = vdupq_n_u8(0xFF);
+  size_t count = 0;
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    uint8x16_t used = vmvnq_u8(vceqq_u8(vld1q_u8(buf + i), ff));
+    count += vaddlvq_u8(vshrq_n_u8(used, 7));
+  }
+  return count + generic_count_used(buf + i, len - i);
+}
+
+static size_t
+neon_mismatch(const uint8_t *a, const uint8_t *b, size_t len) {
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    if (vminvq_u8(vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i))) != 0xFF)
+      break;
+  }
+  return i + generic_mismatch(a + i, b + i, len - i);
+}
+#endif /* RABUF_NEON */
+
+#define IMPL(name, supported, p) \
+  { name, supported, p##_sum, p##_first_used, p##_last_used, p##_count_used, p##_mismatch }
+
+/* Candidates in order of preference */
+static const rabuf_impl_t impls[] = {
+#ifdef RABUF_X86
+  IMPL("avx2", avx2_supported, avx2),
+  IMPL("sse2", sse2_supported, sse2),
+#endif
+#ifdef RABUF_NEON
+  IMPL("neon", NULL, neon),
+#endif
+  IMPL("generic", NULL, generic),
+};
+
+#define NR_IMPLS (sizeof(impls) / sizeof(impls[0]))
+
+/*
+ * Selected implementation, loaded and stored atomically: sessions on other
+ * threads may make their first call at the same time. They then all store
+ * the same choice, so no lock is needed.
+ */
+static const rabuf_impl_t *active;
+
+#ifdef _MSC_VER
+#define load_active() \
+  ((const rabuf_impl_t *)_InterlockedCompareExchangePointer((void *volatile *)&active, NULL, NULL))
+#define store_active(p) _InterlockedExchangePointer((void *volatile *)&active, (void *)(p))
+#else
+#define load_active() __atomic_load_n(&active, __ATOMIC_ACQUIRE)
+#define store_active(p) __atomic_store_n(&active, (p), __ATOMIC_RELEASE)
+#endif
+
+int
+rabuf_select(const char *name) {
+  for (size_t i = 0; i < NR_IMPLS; i++) {
+    if (name != NULL && strcmp(impls[i].name, name) != 0)
+      continue;
+    if (impls[i].supported != NULL && !impls[i].supported())
+      continue;
+    store_active(&impls[i]);
+    return 0;
+  }
+  return -1;
+}
+
+/*
+ * First use picks RADFU_SIMD if set and usable, else the best supported
+ */
+static const rabuf_impl_t *
+impl(void) {
+  const rabuf_impl_t *cur = load_active();
+
+  if (cur == NULL) {
+    const char *env = getenv("RADFU_SIMD");
+    if (env == NULL || rabuf_select(env) < 0)
+      rabuf_select(NULL);
+    cur = load_active();
+  }
+  return cur;
+}
+
+const char *
+rabuf_impl_name(void) {
+  return impl()->name;
+}
+
+uint32_t
+rabuf_sum(const uint8_t *buf, size_t len) {
+  return impl()->sum(buf, len);
+}
+
+size_t
+rabuf_first_used(const uint8_t *buf, size_t len) {
+  return impl()->first_used(buf, len);
+}
+
+size_t
+rabuf_last_used(const uint8_t *buf, size_t len) {
+  return impl()->last_used(buf, len);
+}
+
+size_t
+rabuf_count_used(const uint8_t *buf, size_t len) {
+  return impl()->count_used(buf, len);
+}
+
+size_t
+rabuf_mismatch(const uint8_t *a, const uint8_t *b, size_t len) {
+  return impl()->mismatch(a, b, len);
+}
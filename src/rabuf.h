@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Buffer checksum and classification kernels (SIMD with portable fallback)
+ */
+
+#ifndef RABUF_H
+#define RABUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Sum of all bytes (used by the packet checksum)
+ */
+uint32_t rabuf_sum(const uint8_t *buf, size_t len);
+
+/*
+ * Returns: offset of the first byte != 0xFF, or len if the buffer is blank
+ */
+size_t rabuf_first_used(const uint8_t *buf, size_t len);
+
+/*
+ * Returns: offset just past the last byte != 0xFF, or 0 if the buffer is blank
+ */
+size_t rabuf_last_used(const uint8_t *buf, size_t len);
+
+/*
+ * Returns: number of bytes != 0xFF
+ */
+size_t rabuf_count_used(const uint8_t *buf, size_t len);
+
+/*
+ * Returns: offset of the first differing byte, or len if both buffers match
+ */
+size_t rabuf_mismatch(const uint8_t *a, const uint8_t *b, size_t len);
+
+/*
+ * Check that all bytes are 0xFF (erased flash)
+ */
+static inline bool
+rabuf_is_blank(const uint8_t *buf, size_t len) {
+  return rabuf_first_used(buf, len) == len;
+}
+
+/*
+ * Name of the implementation in use ("generic", "sse2", "avx2", "neon")
+ */
+const char *rabuf_impl_name(void);
+
+/*
+ * Force an implementation by name, mainly for tests and benchmarks
+ * The RADFU_SIMD environment variable has the same effect at first use.
+ * Returns: 0 on success, -1 if unknown or not supported by this CPU
+ */
+int rabuf_select(const char *name);
+
+#endif /* RABUF_H */
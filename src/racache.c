@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Session flash read cache
+ *
+ * Pages of RA_CACHE_PAGE bytes are hashed by address. Each page keeps a
+ * per-byte valid bitmap, so a 32-byte header read caches exactly 32 bytes
+ * and never triggers a larger device read. CRC results are kept alongside,
+ * keyed by their exact [start, end] range.
+ */
+
+#include "racache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NR_BUCKETS 256
+
+typedef struct ra_cache_page {
+  struct ra_cache_page *next;
+  uint32_t base;
+  uint8_t valid[RA_CACHE_PAGE / 8];
+  uint8_t data[RA_CACHE_PAGE];
+} ra_cache_page_t;
+
+typedef struct {
+  uint32_t start;
+  uint32_t end;
+  uint32_t crc;
+} ra_cache_crc_t;
+
+struct ra_cache {
+  ra_cache_page_t *buckets[NR_BUCKETS];
+  ra_cache_crc_t *crcs;
+  size_t nr_crcs;
+  uint32_t hits;
+  uint32_t misses;
+};
+
+static unsigned
+bucket_of(uint32_t base) {
+  return (base / RA_CACHE_PAGE) % NR_BUCKETS;
+}
+
+static ra_cache_page_t *
+find_page(const ra_cache_t *cache, uint32_t base) {
+  for (ra_cache_page_t *p = cache->buckets[bucket_of(base)]; p != NULL; p = p->next) {
+    if (p->base == base)
+      return p;
+  }
+  return NULL;
+}
+
+static bool
+page_valid(const ra_cache_page_t *p, size_t off, size_t len) {
+  for (size_t i = off; i < off + len; i++) {
+    if (!(p->valid[i / 8] & (1u << (i % 8))))
+      return false;
+  }
+  return true;
+}
+
+ra_cache_t *
+ra_cache_new(void) {
+  return calloc(1, sizeof(ra_cache_t));
+}
+
+void
+ra_cache_invalidate_all(ra_cache_t *cache) {
+  if (cache == NULL)
+    return;
+
+  for (int b = 0; b < NR_BUCKETS; b++) {
+    ra_cache_page_t *p = cache->buckets[b];
+    while (p != NULL) {
+      ra_cache_page_t *next = p->next;
+      free(p);
+      p = next;
+    }
+    cache->buckets[b] = NULL;
+  }
+  free(cache->crcs);
+  cache->crcs = NULL;
+  cache->nr_crcs = 0;
+}
+
+void
+ra_cache_free(ra_cache_t *cache) {
+  if (cache == NULL)
+    return;
+
+  ra_cache_invalidate_all(cache);
+  free(cache);
+}
+
+bool
+ra_cache_read(ra_cache_t *cache, uint32_t addr, uint8_t *dst, size_t len) {
+  if (cache == NULL)
+    return false;
+
+  size_t done = 0;
+  while (done < len) {
+    uint32_t a = addr + (uint32_t)done;
+    uint32_t base = a - a % RA_CACHE_PAGE;
+    size_t off = a - base;
+    size_t n = RA_CACHE_PAGE - off;
+    if (n > len - done)
+      n = len - done;
+
+    const ra_cache_page_t *p = find_page(cache, base);
+    if (p == NULL || !page_valid(p, off, n)) {
+      cache->misses++;
+      return false;
+    }
+    memcpy(dst + done, p->data + off, n);
+    done += n;
+  }
+
+  cache->hits++;
+  return true;
+}
+
+void
+ra_cache_fill(ra_cache_t *cache, uint32_t addr, const uint8_t *src, size_t len) {
+  if (cache == NULL)
+    return;
+
+  size_t done = 0;
+  while (done < len) {
+    uint32_t a = addr + (uint32_t)done;
+    uint32_t base = a - a % RA_CACHE_PAGE;
+    size_t off = a - base;
+    size_t n = RA_CACHE_PAGE - off;
+    if (n > len - done)
+      n = len - done;
+
+    ra_cache_page_t *p = find_page(cache, base);
+    if (p == NULL) {
+      p = calloc(1, sizeof(*p));
+      if (p == NULL)
+        return; /* caching is best effort */
+      p->base = base;
+      p->next = cache->buckets[bucket_of(base)];
+      cache->buckets[bucket_of(base)] = p;
+    }
+
+    memcpy(p->data + off, src + done, n);
+    for (size_t i = off; i < off + n; i++)
+      p->valid[i / 8] |= (uint8_t)(1u << (i % 8));
+    done += n;
+  }
+}
+
+bool
+ra_cache_crc_get(ra_cache_t *cache, uint32_t start, uint32_t end, uint32_t *crc) {
+  if (cache == NULL)
+    return false;
+
+  for (size_t i = 0; i < cache->nr_crcs; i++) {
+    if (cache->crcs[i].start == start && cache->crcs[i].end == end) {
+      *crc = cache->crcs[i].crc;
+      cache->hits++;
+      return true;
+    }
+  }
+  cache->misses++;
+  return false;
+}
+
+void
+ra_cache_crc_put(ra_cache_t *cache, uint32_t start, uint32_t end, uint32_t crc) {
+  if (cache == NULL)
+    return;
+
+  ra_cache_crc_t *grown = realloc(cache->crcs, (cache->nr_crcs + 1) * sizeof(*grown));
+  if (grown == NULL)
+    return;
+  cache->crcs = grown;
+  cache->crcs[cache->nr_crcs].start = start;
+  cache->crcs[cache->nr_crcs].end = end;
+  cache->crcs[cache->nr_crcs].crc = crc;
+  cache->nr_crcs++;
+}
+
+void
+ra_cache_invalidate(ra_cache_t *cache, uint32_t start, uint32_t end) {
+  if (cache == NULL || end < start)
+    return;
+
+  for (int b = 0; b < NR_BUCKETS; b++) {
+    for (ra_cache_page_t *p = cache->buckets[b]; p != NULL; p = p->next) {
+      uint32_t last = p->base + RA_CACHE_PAGE - 1;
+      if (last < start || p->base > end)
+        continue;
+
+      size_t lo = start > p->base ? start - p->base : 0;
+      size_t hi = end < last ? end - p->base : RA_CACHE_PAGE - 1;
+      for (size_t i = lo; i <= hi; i++)
+        p->valid[i / 8] &= (uint8_t)~(1u << (i % 8));
+    }
+  }
+
+  /* Drop CRCs of overlapping ranges, keeping the others in order */
+  size_t kept = 0;
+  for (size_t i = 0; i < cache->nr_crcs; i++) {
+    if (cache->crcs[i].end < start || cache->crcs[i].start > end)
+      cache->crcs[kept++] = cache->crcs[i];
+  }
+  cache->nr_crcs = kept;
+}
+
+void
+ra_cache_stats(const ra_cache_t *cache, uint32_t *hits, uint32_t *misses) {
+  *hits = cache != NULL ? cache->hits : 0;
+  *misses = cache != NULL ? cache->misses : 0;
+}
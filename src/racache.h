@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Session flash read cache, address indexed and invalidated by ERA/WRI ranges
+ */
+
+#ifndef RACACHE_H
+#define RACACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Cache page size, one maximum read packet */
+#define RA_CACHE_PAGE 1024
+
+typedef struct ra_cache ra_cache_t;
+
+/*
+ * Allocate an empty cache
+ * Returns: cache, or NULL on allocation failure
+ */
+ra_cache_t *ra_cache_new(void);
+
+/*
+ * Free a cache (NULL is accepted)
+ */
+void ra_cache_free(ra_cache_t *cache);
+
+/*
+ * Copy [addr, addr + len) into dst if every byte is cached
+ * Returns: true on hit, false if any byte is missing (dst is then undefined)
+ */
+bool ra_cache_read(ra_cache_t *cache, uint32_t addr, uint8_t *dst, size_t len);
+
+/*
+ * Store bytes read from the device at addr
+ */
+void ra_cache_fill(ra_cache_t *cache, uint32_t addr, const uint8_t *src, size_t len);
+
+/*
+ * Look up / store the device CRC of [start, end]
+ */
+bool ra_cache_crc_get(ra_cache_t *cache, uint32_t start, uint32_t end, uint32_t *crc);
+void ra_cache_crc_put(ra_cache_t *cache, uint32_t start, uint32_t end, uint32_t crc);
+
+/*
+ * Forget cached bytes and CRCs overlapping [start, end] (after ERA/WRI)
+ */
+void ra_cache_invalidate(ra_cache_t *cache, uint32_t start, uint32_t end);
+
+/*
+ * Forget everything (after INI, DLM transitions, boundary or key changes)
+ */
+void ra_cache_invalidate_all(ra_cache_t *cache);
+
+/*
+ * Hit/miss counters since creation (reads only)
+ */
+void ra_cache_stats(const ra_cache_t *cache, uint32_t *hits, uint32_t *misses);
+
+#endif /* RACACHE_H */
@@ -10,12 +10,14 @@
 
 #include "raconnect.h"
 #include "rapacker.h"
+#include "racache.h"
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <termios.h>
 #include <unistd.h>
 
@@ -102,14 +104,15 @@ ra_open(ra_device_t *dev, const char *port) {
 
   /* Print device information */
   if (dev->uart_mode) {
-    fprintf(stderr, "UART mode: %s\n", port);
+    ra_log(RA_LOG_INFO, "UART mode: %s", port);
   } else {
     ra_print_usb_info(tty_name);
     if (auto_detect)
-      fprintf(stderr, "Auto-detected Renesas device\n");
+      ra_log(RA_LOG_INFO, "Auto-detected Renesas device");
   }
 
-  dev->fd = open(port, O_RDWR | O_NOCTTY | O_SYNC);
+  /* Non-blocking, so event loops can drive the port (see raop.h) */
+  dev->fd = open(port, O_RDWR | O_NOCTTY | O_SYNC | O_NONBLOCK);
   if (dev->fd == RA_INVALID_FD) {
     warn("failed to open %s", port);
     return -1;
@@ -134,7 +137,7 @@ ra_open(ra_device_t *dev, const char *port) {
   }
 
   if (already_connected) {
-    fprintf(stderr, "Bootloader already in command mode\n");
+    ra_log(RA_LOG_INFO, "Bootloader already in command mode");
   } else {
     /* Establish connection:
      * 1. Sync with 0x00 bytes until device responds with 0x00
@@ -168,30 +171,90 @@ ra_close(ra_device_t *dev) {
     close(dev->fd);
     dev->fd = RA_INVALID_FD;
   }
+  ra_cache_free(dev->cache);
+  dev->cache = NULL;
 }
 
 ssize_t
 ra_send(ra_device_t *dev, const uint8_t *data, size_t len) {
+  ra_iovec_t iov = { (void *)data, len };
+
+  return ra_sendv(dev, &iov, 1);
+}
+
+ssize_t
+ra_sendv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt) {
+  struct iovec vec[RA_IOV_MAX];
+  size_t total = 0;
+
   if (dev->fd == RA_INVALID_FD) {
     errno = EBADF;
     return -1;
   }
+  if (iovcnt < 0 || iovcnt > RA_IOV_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
 
-  ssize_t n = write(dev->fd, data, len);
-  if (n < 0) {
-    warn("write failed");
-    return n;
+  for (int i = 0; i < iovcnt; i++) {
+    vec[i].iov_base = iov[i].base;
+    vec[i].iov_len = iov[i].len;
+    total += iov[i].len;
   }
 
-  return n;
+  /* Single writev() in the common case, resume on partial writes */
+  size_t sent = 0;
+  int first = 0;
+  while (sent < total) {
+    ssize_t n = writev(dev->fd, &vec[first], iovcnt - first);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN && ra_wait(dev, true, -1) >= 0)
+        continue;
+      warn("write failed");
+      return -1;
+    }
+    sent += (size_t)n;
+    while (first < iovcnt && (size_t)n >= vec[first].iov_len) {
+      n -= (ssize_t)vec[first].iov_len;
+      first++;
+    }
+    if (first < iovcnt) {
+      vec[first].iov_base = (uint8_t *)vec[first].iov_base + n;
+      vec[first].iov_len -= (size_t)n;
+    }
+  }
+
+  return (ssize_t)sent;
 }
 
 ssize_t
 ra_recv(ra_device_t *dev, uint8_t *buf, size_t len, int timeout_ms) {
+  ra_iovec_t iov = { buf, len };
+
+  return ra_recvv(dev, &iov, 1, timeout_ms);
+}
+
+ssize_t
+ra_recvv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt, int timeout_ms) {
+  struct iovec vec[RA_IOV_MAX];
+  size_t len = 0;
+
   if (dev->fd == RA_INVALID_FD) {
     errno = EBADF;
     return -1;
   }
+  if (iovcnt < 0 || iovcnt > RA_IOV_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for (int i = 0; i < iovcnt; i++) {
+    vec[i].iov_base = iov[i].base;
+    vec[i].iov_len = iov[i].len;
+    len += iov[i].len;
+  }
 
   struct pollfd pfd = {
     .fd = dev->fd,
@@ -199,6 +262,7 @@ ra_recv(ra_device_t *dev, uint8_t *buf, size_t len, int timeout_ms) {
   };
 
   size_t total = 0;
+  int first = 0;
   while (total < len) {
     /* Use shorter timeout for continuation reads after initial data */
     int poll_timeout = (total > 0) ? 20 : timeout_ms;
@@ -212,20 +276,138 @@ ra_recv(ra_device_t *dev, uint8_t *buf, size_t len, int timeout_ms) {
       break;
     }
 
-    ssize_t n = read(dev->fd, buf + total, len - total);
+    ssize_t n = readv(dev->fd, &vec[first], iovcnt - first);
     if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
       warn("read failed");
       return -1;
     }
     if (n == 0)
       break;
 
-    total += n;
+    total += (size_t)n;
+    while (first < iovcnt && (size_t)n >= vec[first].iov_len) {
+      n -= (ssize_t)vec[first].iov_len;
+      first++;
+    }
+    if (first < iovcnt) {
+      vec[first].iov_base = (uint8_t *)vec[first].iov_base + n;
+      vec[first].iov_len -= (size_t)n;
+    }
   }
 
   return (ssize_t)total;
 }
 
+/* Fill a struct iovec array, checking the count */
+static int
+to_iovec(struct iovec *vec, const ra_iovec_t *iov, int iovcnt) {
+  if (iovcnt < 0 || iovcnt > RA_IOV_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (int i = 0; i < iovcnt; i++) {
+    vec[i].iov_base = iov[i].base;
+    vec[i].iov_len = iov[i].len;
+  }
+  return 0;
+}
+
+ssize_t
+ra_try_sendv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt) {
+  struct iovec vec[RA_IOV_MAX];
+
+  if (to_iovec(vec, iov, iovcnt) < 0)
+    return -1;
+
+  ssize_t n = writev(dev->fd, vec, iovcnt);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EINTR)
+      return 0;
+    warn("write failed");
+  }
+  return n;
+}
+
+ssize_t
+ra_try_recvv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt) {
+  struct iovec vec[RA_IOV_MAX];
+
+  if (to_iovec(vec, iov, iovcnt) < 0)
+    return -1;
+
+  ssize_t n = readv(dev->fd, vec, iovcnt);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EINTR)
+      return 0;
+    warn("read failed");
+  }
+  return n;
+}
+
+int
+ra_wait(ra_device_t *dev, bool want_write, int timeout_ms) {
+  struct pollfd pfd = {
+    .fd = dev->fd,
+    .events = want_write ? POLLOUT : POLLIN,
+  };
+
+  for (;;) {
+    int ret = poll(&pfd, 1, timeout_ms);
+    if (ret >= 0)
+      return ret > 0 ? 1 : 0;
+    if (errno != EINTR) {
+      warn("poll failed");
+      return -1;
+    }
+  }
+}
+
+ssize_t
+ra_recv_pkt(ra_device_t *dev, uint8_t *buf, size_t len, int timeout_ms) {
+  ra_decoder_t dec;
+  ra_frame_t frame;
+  uint8_t in[MAX_PKT_LEN];
+
+  ra_decoder_init(&dec, SOD_ACK);
+
+  /* Read exactly what the decoder still needs, so no timeout ends the frame */
+  for (;;) {
+    ssize_t n = ra_recv(dev, in, ra_decoder_need(&dec), timeout_ms);
+    if (n < 0)
+      return -1;
+    if (n == 0) {
+      if (dec.len == 0)
+        return 0;
+      errno = ETIMEDOUT;
+      return -1;
+    }
+
+    size_t off = 0;
+    while (off < (size_t)n) {
+      size_t used;
+      ra_dec_status_t st = ra_decoder_feed(&dec, in + off, (size_t)n - off, &used, &frame);
+      off += used;
+      if (st == RA_DEC_NEED_MORE)
+        continue;
+
+      if (frame.raw_len > len) {
+        errno = EMSGSIZE;
+        return -1;
+      }
+      memcpy(buf, frame.raw, frame.raw_len);
+      return (ssize_t)frame.raw_len;
+    }
+
+    /* Give up on a line that only carries noise */
+    if (dec.resync > MAX_PKT_LEN) {
+      errno = EPROTO;
+      return -1;
+    }
+  }
+}
+
 static int
 ra_sync(ra_device_t *dev) {
   const uint8_t sync[] = { SYNC_BYTE, SYNC_BYTE, SYNC_BYTE };
@@ -238,7 +420,7 @@ ra_sync(ra_device_t *dev) {
 
     ssize_t n = ra_recv(dev, &resp, 1, dev->timeout_ms);
     if (n == 1 && resp == SYNC_BYTE) {
-      fprintf(stderr, "Sync OK\n");
+      ra_log(RA_LOG_INFO, "Sync OK");
       return 0;
     }
   }
@@ -259,7 +441,7 @@ ra_inquire(ra_device_t *dev) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  uint8_t resp[4];
+  uint8_t resp[MAX_PKT_LEN];
   ssize_t n = ra_recv(dev, resp, 1, dev->timeout_ms);
   if (n < 0)
     return -1;
@@ -269,23 +451,22 @@ ra_inquire(ra_device_t *dev) {
     return 0;
   }
 
-  /* Read packet header (LNH, LNL, RES) to get length */
-  n = ra_recv(dev, resp, 3, dev->timeout_ms);
-  if (n < 3)
-    return -1;
-
-  /* Calculate remaining bytes: data_len + SUM + ETX */
-  uint16_t data_len = ((uint16_t)resp[0] << 8) | resp[1];
-  size_t remaining = (data_len > 1 ? data_len - 1 : 0) + 2;
+  /* Drain the rest of the response frame to clear the buffer */
+  ra_decoder_t dec;
+  ra_frame_t frame;
+  ra_dec_status_t st;
 
-  /* Drain the rest of the response to clear the buffer */
-  uint8_t drain[256];
-  while (remaining > 0) {
-    size_t to_read = remaining > sizeof(drain) ? sizeof(drain) : remaining;
-    n = ra_recv(dev, drain, to_read, dev->timeout_ms);
-    if (n <= 0)
-      break;
-    remaining -= n;
+  ra_decoder_init(&dec, SOD_ACK);
+  st = ra_decoder_feed(&dec, resp, 1, NULL, &frame);
+  while (st == RA_DEC_NEED_MORE) {
+    n = ra_recv(dev, resp, ra_decoder_need(&dec), dev->timeout_ms);
+    if (n <= 0 || dec.resync > MAX_PKT_LEN)
+      return -1;
+    for (size_t off = 0; off < (size_t)n && st == RA_DEC_NEED_MORE;) {
+      size_t used;
+      st = ra_decoder_feed(&dec, resp + off, (size_t)n - off, &used, &frame);
+      off += used;
+    }
   }
 
   /* Already connected */
@@ -304,21 +485,21 @@ ra_confirm(ra_device_t *dev) {
     ssize_t n = ra_recv(dev, &resp, 1, dev->timeout_ms);
     if (n == 1) {
       if (resp == BOOT_CODE_M4) {
-        fprintf(stderr, "Boot code 0xC3 (Cortex-M4/M23)\n");
+        ra_log(RA_LOG_INFO, "Boot code 0xC3 (Cortex-M4/M23)");
         return 0;
       }
       if (resp == BOOT_CODE_M33) {
-        fprintf(stderr, "Boot code 0xC6 (Cortex-M33)\n");
+        ra_log(RA_LOG_INFO, "Boot code 0xC6 (Cortex-M33)");
         return 0;
       }
       if (resp == BOOT_CODE_M85) {
-        fprintf(stderr, "Boot code 0xC5 (Cortex-M85)\n");
+        ra_log(RA_LOG_INFO, "Boot code 0xC5 (Cortex-M85)");
         return 0;
       }
       /* Unexpected response */
-      fprintf(stderr, "unexpected response: 0x%02X\n", resp);
+      ra_log(RA_LOG_INFO, "unexpected response: 0x%02X", resp);
     } else if (n == 0) {
-      fprintf(stderr, "no response (try %d/%d)\n", i + 1, dev->max_tries);
+      ra_log(RA_LOG_INFO, "no response (try %d/%d)", i + 1, dev->max_tries);
     } else {
       warn("read error: retry #%d", i);
     }
@@ -482,7 +663,7 @@ ra_set_baudrate(ra_device_t *dev, uint32_t baudrate) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7) {
     warnx("short response for baud rate command (got %zd bytes)", n);
     return -1;
@@ -507,11 +688,11 @@ ra_set_baudrate(ra_device_t *dev, uint32_t baudrate) {
   dev->baudrate = baudrate;
 
   if (baudrate >= 1000000) {
-    fprintf(stderr, "Baud rate changed to %.1f Mbps\n", baudrate / 1000000.0);
+    ra_log(RA_LOG_INFO, "Baud rate changed to %.1f Mbps", baudrate / 1000000.0);
   } else if (baudrate >= 1000) {
-    fprintf(stderr, "Baud rate changed to %.1f Kbps\n", baudrate / 1000.0);
+    ra_log(RA_LOG_INFO, "Baud rate changed to %.1f Kbps", baudrate / 1000.0);
   } else {
-    fprintf(stderr, "Baud rate changed to %u bps\n", baudrate);
+    ra_log(RA_LOG_INFO, "Baud rate changed to %u bps", baudrate);
   }
   return 0;
 }
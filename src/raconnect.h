@@ -30,6 +30,14 @@ typedef struct {
   uint32_t cau; /* CRC alignment unit */
 } ra_area_t;
 
+/* Scatter/gather segment for ra_sendv() / ra_recvv() */
+typedef struct {
+  void *base;
+  size_t len;
+} ra_iovec_t;
+
+#define RA_IOV_MAX 8
+
 typedef struct {
   ra_fd_t fd;
   uint16_t vendor_id;
@@ -42,6 +50,13 @@ typedef struct {
   bool authenticated; /* True if ID authentication was performed */
   bool uart_mode;     /* True for plain UART (P109/P110), false for USB */
   uint32_t baudrate;  /* Current baud rate (UART mode only) */
+  /* Session read cache (NULL until first read, freed by ra_close) */
+  struct ra_cache *cache;
+  uint8_t sig[64];   /* Signature response, queried once per session */
+  size_t sig_len;    /* 0 until the signature has been queried */
+  bool layout_valid; /* chip_layout holds noa areas */
+  bool layout_cache; /* Keep the area table in the user cache dir */
+  bool quiet;        /* No progress bar on the terminal (library sessions) */
 } ra_device_t;
 
 /*
@@ -72,6 +87,41 @@ ssize_t ra_send(ra_device_t *dev, const uint8_t *data, size_t len);
  */
 ssize_t ra_recv(ra_device_t *dev, uint8_t *buf, size_t len, int timeout_ms);
 
+/*
+ * Receive exactly one response packet (SOD..ETX) into buf
+ * Uses the incremental decoder to read no more than the frame, so it returns
+ * as soon as the frame is complete instead of waiting for a timeout.
+ * Returns: frame length, 0 on timeout with nothing received, -1 on error
+ */
+ssize_t ra_recv_pkt(ra_device_t *dev, uint8_t *buf, size_t len, int timeout_ms);
+
+/*
+ * Send data gathered from several buffers (e.g. header, payload, trailer)
+ * Returns: bytes sent on success, -1 on error
+ */
+ssize_t ra_sendv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt);
+
+/*
+ * Receive data scattered into several buffers, filled in order
+ * Same timeout semantics as ra_recv()
+ * Returns: bytes received on success, -1 on error
+ */
+ssize_t ra_recvv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt, int timeout_ms);
+
+/*
+ * Non-blocking transfers for event loops (see raop.h): move what the port
+ * takes or holds right now, without waiting
+ * Returns: bytes transferred (0 if the port is not ready), -1 on error
+ */
+ssize_t ra_try_sendv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt);
+ssize_t ra_try_recvv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt);
+
+/*
+ * Wait until the port is readable (or writable), timeout_ms < 0 for ever
+ * Returns: 1 when ready, 0 on timeout, -1 on error
+ */
+int ra_wait(ra_device_t *dev, bool want_write, int timeout_ms);
+
 /*
  * Set UART baud rate
  * Only affects UART communication, not USB
@@ -91,6 +141,16 @@ uint32_t ra_best_baudrate(uint32_t max);
 int ra_find_port(char *buf, size_t len, char *tty_name, size_t tty_len);
 void ra_print_usb_info(const char *tty_name);
 
+/* Room for one port path, and most ports ra_find_ports() is asked for */
+#define RA_PORT_LEN 256
+#define RA_MAX_PORTS 32
+
+/*
+ * List the ports of every connected Renesas USB device
+ * Returns: number of ports stored (at most max)
+ */
+int ra_find_ports(char (*ports)[RA_PORT_LEN], int max);
+
 /*
  * Get max baud rate for USB-serial adapter based on VID/PID
  * Returns known max rate for adapter, or 115200 for unknown
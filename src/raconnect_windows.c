@@ -8,6 +8,7 @@
 
 #include "raconnect.h"
 #include "rapacker.h"
+#include "racache.h"
 
 #include <windows.h>
 #include <stdio.h>
@@ -45,7 +46,7 @@ set_serial_attrs(HANDLE hPort, DWORD baudrate) {
   dcb.DCBlength = sizeof(dcb);
 
   if (!GetCommState(hPort, &dcb)) {
-    fprintf(stderr, "GetCommState failed: %lu\n", GetLastError());
+    warnx("GetCommState failed: %lu", GetLastError());
     return -1;
   }
 
@@ -65,7 +66,7 @@ set_serial_attrs(HANDLE hPort, DWORD baudrate) {
   dcb.fAbortOnError = FALSE;
 
   if (!SetCommState(hPort, &dcb)) {
-    fprintf(stderr, "SetCommState failed: %lu\n", GetLastError());
+    warnx("SetCommState failed: %lu", GetLastError());
     return -1;
   }
 
@@ -78,7 +79,7 @@ set_serial_attrs(HANDLE hPort, DWORD baudrate) {
   timeouts.WriteTotalTimeoutConstant = 1000; /* 1s write timeout */
 
   if (!SetCommTimeouts(hPort, &timeouts)) {
-    fprintf(stderr, "SetCommTimeouts failed: %lu\n", GetLastError());
+    warnx("SetCommTimeouts failed: %lu", GetLastError());
     return -1;
   }
 
@@ -94,11 +95,11 @@ ra_open(ra_device_t *dev, const char *port) {
 
   if (port == NULL) {
     if (dev->uart_mode) {
-      fprintf(stderr, "UART mode requires explicit port (-p option)\n");
+      warnx("UART mode requires explicit port (-p option)");
       return -1;
     }
     if (ra_find_port(portbuf, sizeof(portbuf), tty_name, sizeof(tty_name)) < 0) {
-      fprintf(stderr, "no Renesas device found\n");
+      warnx("no Renesas device found");
       return -1;
     }
     port = portbuf;
@@ -110,11 +111,11 @@ ra_open(ra_device_t *dev, const char *port) {
 
   /* Print device information */
   if (dev->uart_mode) {
-    fprintf(stderr, "UART mode: %s\n", port);
+    ra_log(RA_LOG_INFO, "UART mode: %s", port);
   } else {
     ra_print_usb_info(tty_name);
     if (auto_detect)
-      fprintf(stderr, "Auto-detected Renesas device\n");
+      ra_log(RA_LOG_INFO, "Auto-detected Renesas device");
   }
 
   /* Windows requires \\.\COMx format for COM ports >= 10 */
@@ -130,12 +131,12 @@ ra_open(ra_device_t *dev, const char *port) {
   dev->fd = CreateFileA(
       port_path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
   if (dev->fd == RA_INVALID_FD) {
-    fprintf(stderr, "failed to open %s: %lu\n", port, GetLastError());
+    warnx("failed to open %s: %lu", port, GetLastError());
     return -1;
   }
 
   if (set_serial_attrs(dev->fd, 9600) < 0) {
-    fprintf(stderr, "failed to set serial attributes\n");
+    warnx("failed to set serial attributes");
     CloseHandle(dev->fd);
     dev->fd = RA_INVALID_FD;
     return -1;
@@ -153,7 +154,7 @@ ra_open(ra_device_t *dev, const char *port) {
   }
 
   if (already_connected) {
-    fprintf(stderr, "Bootloader already in command mode\n");
+    ra_log(RA_LOG_INFO, "Bootloader already in command mode");
   } else {
     /* Establish connection:
      * 1. Sync with 0x00 bytes until device responds with 0x00
@@ -187,6 +188,8 @@ ra_close(ra_device_t *dev) {
     CloseHandle(dev->fd);
     dev->fd = RA_INVALID_FD;
   }
+  ra_cache_free(dev->cache);
+  dev->cache = NULL;
 }
 
 ssize_t
@@ -198,7 +201,7 @@ ra_send(ra_device_t *dev, const uint8_t *data, size_t len) {
 
   DWORD bytes_written;
   if (!WriteFile(dev->fd, data, (DWORD)len, &bytes_written, NULL)) {
-    fprintf(stderr, "write failed: %lu\n", GetLastError());
+    warnx("write failed: %lu", GetLastError());
     return -1;
   }
 
@@ -221,7 +224,7 @@ ra_recv(ra_device_t *dev, uint8_t *buf, size_t len, int timeout_ms) {
   timeouts.WriteTotalTimeoutConstant = 1000;
 
   if (!SetCommTimeouts(dev->fd, &timeouts)) {
-    fprintf(stderr, "SetCommTimeouts failed: %lu\n", GetLastError());
+    warnx("SetCommTimeouts failed: %lu", GetLastError());
     return -1;
   }
 
@@ -236,7 +239,7 @@ ra_recv(ra_device_t *dev, uint8_t *buf, size_t len, int timeout_ms) {
     }
 
     if (!ReadFile(dev->fd, buf + total, (DWORD)(len - total), &bytes_read, NULL)) {
-      fprintf(stderr, "read failed: %lu\n", GetLastError());
+      warnx("read failed: %lu", GetLastError());
       return -1;
     }
 
@@ -249,6 +252,149 @@ ra_recv(ra_device_t *dev, uint8_t *buf, size_t len, int timeout_ms) {
   return (ssize_t)total;
 }
 
+ssize_t
+ra_sendv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt) {
+  ssize_t total = 0;
+
+  /* No gather write on COM handles: one WriteFile() per segment */
+  for (int i = 0; i < iovcnt; i++) {
+    if (iov[i].len == 0)
+      continue;
+    ssize_t n = ra_send(dev, iov[i].base, iov[i].len);
+    if (n < 0)
+      return -1;
+    total += n;
+  }
+
+  return total;
+}
+
+ssize_t
+ra_recvv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt, int timeout_ms) {
+  ssize_t total = 0;
+
+  /* Fill segments in order, continuation segments use the short timeout */
+  for (int i = 0; i < iovcnt; i++) {
+    if (iov[i].len == 0)
+      continue;
+    ssize_t n = ra_recv(dev, iov[i].base, iov[i].len, total > 0 ? 20 : timeout_ms);
+    if (n < 0)
+      return -1;
+    total += n;
+    if ((size_t)n < iov[i].len)
+      break;
+  }
+
+  return total;
+}
+
+ssize_t
+ra_try_sendv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt) {
+  /* COM writes go to the driver queue, within the write timeout */
+  return ra_sendv(dev, iov, iovcnt);
+}
+
+ssize_t
+ra_try_recvv(ra_device_t *dev, const ra_iovec_t *iov, int iovcnt) {
+  COMMTIMEOUTS timeouts = {
+    .ReadIntervalTimeout = MAXDWORD, /* return at once with what is queued */
+    .WriteTotalTimeoutConstant = 1000,
+  };
+  ssize_t total = 0;
+
+  if (dev->fd == RA_INVALID_FD) {
+    SetLastError(ERROR_INVALID_HANDLE);
+    return -1;
+  }
+  if (!SetCommTimeouts(dev->fd, &timeouts)) {
+    warnx("SetCommTimeouts failed: %lu", GetLastError());
+    return -1;
+  }
+
+  for (int i = 0; i < iovcnt; i++) {
+    DWORD bytes_read;
+
+    if (iov[i].len == 0)
+      continue;
+    if (!ReadFile(dev->fd, iov[i].base, (DWORD)iov[i].len, &bytes_read, NULL)) {
+      warnx("read failed: %lu", GetLastError());
+      return -1;
+    }
+    total += bytes_read;
+    if (bytes_read < iov[i].len)
+      break;
+  }
+
+  return total;
+}
+
+int
+ra_wait(ra_device_t *dev, bool want_write, int timeout_ms) {
+  ULONGLONG start = GetTickCount64();
+
+  /* A COM handle has no readiness to wait on: poll the input queue */
+  if (want_write)
+    return 1;
+  for (;;) {
+    COMSTAT stat;
+    DWORD errors;
+
+    if (!ClearCommError(dev->fd, &errors, &stat)) {
+      warnx("ClearCommError failed: %lu", GetLastError());
+      return -1;
+    }
+    if (stat.cbInQue > 0)
+      return 1;
+    if (timeout_ms >= 0 && GetTickCount64() - start >= (ULONGLONG)timeout_ms)
+      return 0;
+    Sleep(1);
+  }
+}
+
+ssize_t
+ra_recv_pkt(ra_device_t *dev, uint8_t *buf, size_t len, int timeout_ms) {
+  ra_decoder_t dec;
+  ra_frame_t frame;
+  uint8_t in[MAX_PKT_LEN];
+
+  ra_decoder_init(&dec, SOD_ACK);
+
+  /* Read exactly what the decoder still needs, so no timeout ends the frame */
+  for (;;) {
+    ssize_t n = ra_recv(dev, in, ra_decoder_need(&dec), timeout_ms);
+    if (n < 0)
+      return -1;
+    if (n == 0) {
+      if (dec.len == 0)
+        return 0;
+      SetLastError(ERROR_TIMEOUT);
+      return -1;
+    }
+
+    size_t off = 0;
+    while (off < (size_t)n) {
+      size_t used;
+      ra_dec_status_t st = ra_decoder_feed(&dec, in + off, (size_t)n - off, &used, &frame);
+      off += used;
+      if (st == RA_DEC_NEED_MORE)
+        continue;
+
+      if (frame.raw_len > len) {
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return -1;
+      }
+      memcpy(buf, frame.raw, frame.raw_len);
+      return (ssize_t)frame.raw_len;
+    }
+
+    /* Give up on a line that only carries noise */
+    if (dec.resync > MAX_PKT_LEN) {
+      SetLastError(ERROR_INVALID_DATA);
+      return -1;
+    }
+  }
+}
+
 static int
 ra_sync(ra_device_t *dev) {
   const uint8_t sync[] = { SYNC_BYTE, SYNC_BYTE, SYNC_BYTE };
@@ -263,12 +409,12 @@ ra_sync(ra_device_t *dev) {
 
     ssize_t n = ra_recv(dev, &resp, 1, dev->timeout_ms);
     if (n == 1 && resp == SYNC_BYTE) {
-      fprintf(stderr, "Sync OK\n");
+      ra_log(RA_LOG_INFO, "Sync OK");
       return 0;
     }
   }
 
-  fprintf(stderr, "failed to sync with bootloader\n");
+  warnx("failed to sync with bootloader");
   return -1;
 }
 
@@ -284,7 +430,7 @@ ra_inquire(ra_device_t *dev) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  uint8_t resp[4];
+  uint8_t resp[MAX_PKT_LEN];
   ssize_t n = ra_recv(dev, resp, 1, dev->timeout_ms);
   if (n < 0)
     return -1;
@@ -294,23 +440,22 @@ ra_inquire(ra_device_t *dev) {
     return 0;
   }
 
-  /* Read packet header (LNH, LNL, RES) to get length */
-  n = ra_recv(dev, resp, 3, dev->timeout_ms);
-  if (n < 3)
-    return -1;
-
-  /* Calculate remaining bytes: data_len + SUM + ETX */
-  uint16_t data_len = ((uint16_t)resp[0] << 8) | resp[1];
-  size_t remaining = (data_len > 1 ? data_len - 1 : 0) + 2;
+  /* Drain the rest of the response frame to clear the buffer */
+  ra_decoder_t dec;
+  ra_frame_t frame;
+  ra_dec_status_t st;
 
-  /* Drain the rest of the response to clear the buffer */
-  uint8_t drain[256];
-  while (remaining > 0) {
-    size_t to_read = remaining > sizeof(drain) ? sizeof(drain) : remaining;
-    n = ra_recv(dev, drain, to_read, dev->timeout_ms);
-    if (n <= 0)
-      break;
-    remaining -= n;
+  ra_decoder_init(&dec, SOD_ACK);
+  st = ra_decoder_feed(&dec, resp, 1, NULL, &frame);
+  while (st == RA_DEC_NEED_MORE) {
+    n = ra_recv(dev, resp, ra_decoder_need(&dec), dev->timeout_ms);
+    if (n <= 0 || dec.resync > MAX_PKT_LEN)
+      return -1;
+    for (size_t off = 0; off < (size_t)n && st == RA_DEC_NEED_MORE;) {
+      size_t used;
+      st = ra_decoder_feed(&dec, resp + off, (size_t)n - off, &used, &frame);
+      off += used;
+    }
   }
 
   /* Already connected */
@@ -330,27 +475,27 @@ ra_confirm(ra_device_t *dev) {
     ssize_t n = ra_recv(dev, &resp, 1, dev->timeout_ms);
     if (n == 1) {
       if (resp == BOOT_CODE_M4) {
-        fprintf(stderr, "Boot code 0xC3 (Cortex-M4/M23)\n");
+        ra_log(RA_LOG_INFO, "Boot code 0xC3 (Cortex-M4/M23)");
         return 0;
       }
       if (resp == BOOT_CODE_M33) {
-        fprintf(stderr, "Boot code 0xC6 (Cortex-M33)\n");
+        ra_log(RA_LOG_INFO, "Boot code 0xC6 (Cortex-M33)");
         return 0;
       }
       if (resp == BOOT_CODE_M85) {
-        fprintf(stderr, "Boot code 0xC5 (Cortex-M85)\n");
+        ra_log(RA_LOG_INFO, "Boot code 0xC5 (Cortex-M85)");
         return 0;
       }
       /* Unexpected response */
-      fprintf(stderr, "unexpected response: 0x%02X\n", resp);
+      ra_log(RA_LOG_INFO, "unexpected response: 0x%02X", resp);
     } else if (n == 0) {
-      fprintf(stderr, "no response (try %d/%d)\n", i + 1, dev->max_tries);
+      ra_log(RA_LOG_INFO, "no response (try %d/%d)", i + 1, dev->max_tries);
     } else {
-      fprintf(stderr, "read error: retry #%d\n", i);
+      ra_log(RA_LOG_INFO, "read error: retry #%d", i);
     }
   }
 
-  fprintf(stderr, "failed to establish connection after %d tries\n", dev->max_tries);
+  warnx("failed to establish connection after %d tries", dev->max_tries);
   return -1;
 }
 
@@ -405,16 +550,16 @@ ra_set_baudrate(ra_device_t *dev, uint32_t baudrate) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7) {
-    fprintf(stderr, "short response for baud rate command (got %zd bytes)\n", n);
+    warnx("short response for baud rate command (got %zd bytes)", n);
     return -1;
   }
 
   size_t data_len;
   uint8_t cmd;
   if (ra_unpack_pkt(resp, n, NULL, &data_len, &cmd) < 0) {
-    fprintf(stderr, "baud rate setting failed\n");
+    warnx("baud rate setting failed");
     return -1;
   }
 
@@ -423,18 +568,18 @@ ra_set_baudrate(ra_device_t *dev, uint32_t baudrate) {
 
   /* Change local serial port baudrate */
   if (set_serial_attrs(dev->fd, baudrate) < 0) {
-    fprintf(stderr, "failed to set local baud rate to %u\n", baudrate);
+    warnx("failed to set local baud rate to %u", baudrate);
     return -1;
   }
 
   dev->baudrate = baudrate;
 
   if (baudrate >= 1000000) {
-    fprintf(stderr, "Baud rate changed to %.1f Mbps\n", baudrate / 1000000.0);
+    ra_log(RA_LOG_INFO, "Baud rate changed to %.1f Mbps", baudrate / 1000000.0);
   } else if (baudrate >= 1000) {
-    fprintf(stderr, "Baud rate changed to %.1f Kbps\n", baudrate / 1000.0);
+    ra_log(RA_LOG_INFO, "Baud rate changed to %.1f Kbps", baudrate / 1000.0);
   } else {
-    fprintf(stderr, "Baud rate changed to %u bps\n", baudrate);
+    ra_log(RA_LOG_INFO, "Baud rate changed to %u bps", baudrate);
   }
   return 0;
 }
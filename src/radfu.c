@@ -12,6 +12,17 @@
 #include "radfu.h"
 #include "rapacker.h"
 #include "progress.h"
+#include "rabuf.h"
+#include "crc32.h"
+#include "racache.h"
+#include "raop.h"
+#include "ralayout.h"
+#include "manifest.h"
+#include "raident.h"
+#include "raosis.h"
+#include "rastore.h"
+#include "rbk.h"
+#include "rfi.h"
 
 #ifdef HAVE_OPENSSL
 #include <openssl/evp.h>
@@ -25,6 +36,7 @@
 #define STATIC static
 #endif
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -39,44 +51,50 @@
 #define PRODUCT_NAME_LEN 16 /* PTN: Product Type Name */
 
 /*
- * Unpack packet and print MCU error if present
- * Returns: data length on success, -1 on error
+ * Read one single-packet chunk (<= CHUNK_SIZE bytes) straight into dst
  *
- * Error response format per spec 6.18.2.3/6.19.2.4:
- *   STS (1 byte)  - status code (ERR_ADDR, ERR_PROT, etc.)
- *   ST2 (4 bytes) - status details (FSTATR for flash errors)
- *   ADR (4 bytes) - failure address
+ * The response is received by scatter/gather: header and trailer land in
+ * small side buffers and the payload lands in dst, with no staging copy.
+ * context is used for error messages, NULL keeps the read silent.
+ * Bytes already read in this session are served from the cache.
+ * Returns: 0 on success, -1 on error
  */
-static ssize_t
-unpack_with_error(
-    const uint8_t *buf, size_t buflen, uint8_t *data, size_t *data_len, const char *context) {
-  uint8_t cmd;
-  size_t dlen = 0;
-  ssize_t ret = ra_unpack_pkt(buf, buflen, data, &dlen, &cmd);
-  if (data_len != NULL)
-    *data_len = dlen;
-  if (ret < 0) {
-    if (cmd & STATUS_ERR) {
-      /* Error code is in data[0], details in data[1-4], address in data[5-8] */
-      uint8_t err_code = (dlen > 0 && data != NULL) ? data[0] : 0;
-      warnx("%s: MCU error 0x%02X (%s: %s)",
-          context,
-          err_code,
-          ra_strerror(err_code),
-          ra_strdesc(err_code));
-      /* Show failure address for flash access errors */
-      if (dlen >= 9 && data != NULL) {
-        uint32_t st2 = be_to_uint32(&data[1]);
-        uint32_t adr = be_to_uint32(&data[5]);
-        if (st2 != 0xFFFFFFFF || adr != 0xFFFFFFFF) {
-          warnx("%s: flash status=0x%08X, failure address=0x%08X", context, st2, adr);
-        }
-      }
-    } else {
-      warnx("%s: unpack failed (cmd=0x%02X)", context, cmd);
-    }
+static int
+read_chunk_into(ra_device_t *dev, uint32_t addr, uint8_t *dst, size_t len, const char *context) {
+  ra_op_t op;
+
+  if (len == 0 || len > CHUNK_SIZE) {
+    errno = EINVAL;
+    return -1;
   }
-  return ret;
+
+  ra_op_read(&op, dev, addr, dst, (uint32_t)len);
+  op.context = context;
+  return ra_op_run(&op);
+}
+
+/*
+ * Read [start, start + size) straight into dst
+ *
+ * WORKAROUND: Use single-packet reads (<=1024 bytes each) to avoid
+ * multi-packet ACK protocol issue. See protocol.md for details.
+ * If prog is not NULL, it advances by one step per chunk.
+ * Returns: 0 on success, -1 on error
+ */
+static int
+read_range_into(ra_device_t *dev,
+    uint32_t start,
+    uint8_t *dst,
+    size_t size,
+    progress_t *prog,
+    const char *context) {
+  ra_op_t op;
+
+  if (ra_op_read(&op, dev, start, dst, (uint32_t)size) < 0)
+    return -1;
+  op.context = context;
+  op.prog = prog;
+  return ra_op_run(&op);
 }
 
 /*
@@ -307,6 +325,84 @@ set_crc_boundaries(ra_device_t *dev, uint32_t start, uint32_t size, uint32_t *en
   return 0;
 }
 
+/*
+ * Send CRC command for [start, end] (boundaries already checked) and read the result
+ */
+static int
+crc_query(ra_device_t *dev, uint32_t start, uint32_t end, uint32_t *crc_out) {
+  ra_op_t op;
+
+  ra_op_crc(&op, dev, start, end, crc_out);
+  op.context = "CRC";
+  return ra_op_run(&op);
+}
+
+
+/*
+ * Erased-state probe through the device CRC, so blank flash need not be read
+ * The CRC of an all-0xFF block depends only on its size: computed per call,
+ * as sessions on other threads probe too (crc32_fill is cheap next to the
+ * device round trip).
+ * Returns: 1 if [start, end] is blank, 0 if not or if the range cannot be
+ *          probed (no CRC support, not on CAU boundaries), -1 on error
+ */
+static int
+crc_probe_blank(ra_device_t *dev, uint32_t start, uint32_t end) {
+  int area = find_area_for_address(dev, start);
+  if (area < 0)
+    return 0;
+
+  const ra_area_t *a = &dev->chip_layout[area];
+  if (a->cau == 0 || end > a->ead || a->koa == KOA_TYPE_CONFIG)
+    return 0;
+  if ((start - a->sad) % a->cau != 0 || (end - a->sad + 1) % a->cau != 0)
+    return 0;
+
+  uint32_t dev_crc;
+  if (crc_query(dev, start, end, &dev_crc) < 0)
+    return -1;
+
+  return dev_crc == crc32_fill(0, 0xFF, end - start + 1);
+}
+
+/*
+ * Block size for CRC probing: the area's erase unit, or CAU when larger
+ */
+STATIC uint32_t
+crc_probe_unit(ra_device_t *dev, uint32_t addr) {
+  int area = find_area_for_address(dev, addr);
+  if (area < 0)
+    return CHUNK_SIZE;
+
+  const ra_area_t *a = &dev->chip_layout[area];
+  uint32_t unit = a->eau > a->cau ? a->eau : a->cau;
+  return unit != 0 ? unit : CHUNK_SIZE;
+}
+
+/*
+ * Start of the probe block containing addr, clipped to start
+ */
+STATIC uint32_t
+crc_probe_block_start(ra_device_t *dev, uint32_t addr, uint32_t unit, uint32_t start) {
+  int area = find_area_for_address(dev, addr);
+  uint32_t sad = area >= 0 ? dev->chip_layout[area].sad : 0;
+  uint32_t block_start = addr - (addr - sad) % unit;
+
+  return block_start > start ? block_start : start;
+}
+
+/*
+ * End of the probe block containing addr, clipped to end
+ */
+STATIC uint32_t
+crc_probe_block_end(ra_device_t *dev, uint32_t addr, uint32_t unit, uint32_t end) {
+  int area = find_area_for_address(dev, addr);
+  uint32_t sad = area >= 0 ? dev->chip_layout[area].sad : 0;
+  uint32_t block_end = addr - (addr - sad) % unit + unit - 1;
+
+  return block_end < end ? block_end : end;
+}
+
 /*
  * Get area type name based on address range
  */
@@ -400,17 +496,22 @@ format_size(uint32_t bytes, char *buf, size_t buflen) {
 }
 
 /*
- * Query signature to get NOA (Number of Areas) for dual bank detection
- * Stores NOA in dev->noa for use by ra_get_area_info
+ * Query the signature once per session and keep the response in dev
+ * refresh forces a new SIG round trip, e.g. to check a new baud rate.
+ * Also stores NOA in dev->noa for use by ra_get_area_info.
+ * Returns: 0 on success, -1 on error
  */
 static int
-query_noa(ra_device_t *dev) {
+query_signature(ra_device_t *dev, bool refresh) {
   uint8_t pkt[MAX_PKT_LEN];
   uint8_t resp[64]; /* Signature response can be up to 47 bytes */
   uint8_t data[64];
   size_t data_len;
   ssize_t pkt_len, n;
 
+  if (dev->sig_len > 0 && !refresh)
+    return 0;
+
   pkt_len = ra_pack_pkt(pkt, sizeof(pkt), SIG_CMD, NULL, 0, false);
   if (pkt_len < 0)
     return -1;
@@ -418,13 +519,18 @@ query_noa(ra_device_t *dev) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
-  if (n < 7)
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
+  if (n < 7) {
+    warnx("short response for signature");
     return -1;
+  }
 
-  if (unpack_with_error(resp, n, data, &data_len, "signature") < 0)
+  if (ra_unpack_with_error(resp, n, data, &data_len, "signature") < 0)
     return -1;
 
+  memcpy(dev->sig, data, data_len);
+  dev->sig_len = data_len;
+
   /* NOA is at offset 4 in signature response */
   if (data_len >= 5) {
     dev->noa = data[4];
@@ -437,27 +543,36 @@ query_noa(ra_device_t *dev) {
   return 0;
 }
 
-int
-ra_get_area_info(ra_device_t *dev, bool print) {
+/*
+ * Fill dev->chip_layout, once per session
+ * With dev->layout_cache set, a table cached for the same signature saves
+ * one ARE round trip per area; a table read from the device is stored.
+ * Returns: 0 on success, -1 on error
+ */
+static int
+load_area_info(ra_device_t *dev) {
   uint8_t pkt[MAX_PKT_LEN];
   uint8_t resp[64];
   uint8_t data[64];
   size_t data_len;
   ssize_t pkt_len, n;
-  uint32_t code_flash_size = 0;
-  uint32_t data_flash_size = 0;
-  uint32_t config_size = 0;
-  int user_area_count = 0; /* Count user areas for dual bank detection */
+  char dir[PATH_MAX];
 
-  /* Query NOA from signature if not already known */
-  if (dev->noa == 0) {
-    if (query_noa(dev) < 0) {
-      warnx("failed to query number of areas");
-      return -1;
-    }
+  if (dev->layout_valid)
+    return 0;
+
+  if (query_signature(dev, false) < 0) {
+    warnx("failed to query number of areas");
+    return -1;
   }
 
   int num_areas = dev->noa > 0 ? dev->noa : 4;
+  bool use_cache = dev->layout_cache && get_cache_dir(dir, sizeof(dir)) == 0;
+  if (use_cache && ra_layout_load(dir, dev->sig, dev->sig_len, dev->chip_layout, num_areas) == 0) {
+    dev->layout_valid = true;
+    return 0;
+  }
+
   for (int i = 0; i < num_areas; i++) {
     uint8_t area = (uint8_t)i;
     pkt_len = ra_pack_pkt(pkt, sizeof(pkt), ARE_CMD, &area, 1, false);
@@ -467,13 +582,13 @@ ra_get_area_info(ra_device_t *dev, bool print) {
     if (ra_send(dev, pkt, pkt_len) < 0)
       return -1;
 
-    n = ra_recv(dev, resp, sizeof(resp), 500);
+    n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
     if (n < 7) {
       warnx("short response for area %d (got %zd bytes)", i, n);
       return -1;
     }
 
-    if (unpack_with_error(resp, n, data, &data_len, "area info") < 0)
+    if (ra_unpack_with_error(resp, n, data, &data_len, "area info") < 0)
       return -1;
 
     /* Parse: KOA(1) + SAD(4) + EAD(4) + EAU(4) + WAU(4) + RAU(4) + CAU(4) = 25 bytes */
@@ -482,21 +597,43 @@ ra_get_area_info(ra_device_t *dev, bool print) {
       return -1;
     }
 
-    uint8_t koa = data[0];
-    uint32_t sad = be_to_uint32(&data[1]);
-    uint32_t ead = be_to_uint32(&data[5]);
-    uint32_t eau = be_to_uint32(&data[9]);
-    uint32_t wau = be_to_uint32(&data[13]);
-    uint32_t rau = be_to_uint32(&data[17]);
-    uint32_t cau = be_to_uint32(&data[21]);
-
-    dev->chip_layout[i].koa = koa;
-    dev->chip_layout[i].sad = sad;
-    dev->chip_layout[i].ead = ead;
-    dev->chip_layout[i].eau = eau;
-    dev->chip_layout[i].wau = wau;
-    dev->chip_layout[i].rau = rau;
-    dev->chip_layout[i].cau = cau;
+    dev->chip_layout[i].koa = data[0];
+    dev->chip_layout[i].sad = be_to_uint32(&data[1]);
+    dev->chip_layout[i].ead = be_to_uint32(&data[5]);
+    dev->chip_layout[i].eau = be_to_uint32(&data[9]);
+    dev->chip_layout[i].wau = be_to_uint32(&data[13]);
+    dev->chip_layout[i].rau = be_to_uint32(&data[17]);
+    dev->chip_layout[i].cau = be_to_uint32(&data[21]);
+  }
+
+  dev->layout_valid = true;
+  if (use_cache)
+    ra_layout_store(dir, dev->sig, dev->sig_len, dev->chip_layout, num_areas);
+  return 0;
+}
+
+int
+ra_get_area_info(ra_device_t *dev, bool print) {
+  uint32_t code_flash_size = 0;
+  uint32_t data_flash_size = 0;
+  uint32_t config_size = 0;
+  int user_area_count = 0; /* Count user areas for dual bank detection */
+
+  if (load_area_info(dev) < 0)
+    return -1;
+
+  if (!print)
+    return 0;
+
+  int num_areas = dev->noa > 0 ? dev->noa : 4;
+  for (int i = 0; i < num_areas; i++) {
+    uint8_t koa = dev->chip_layout[i].koa;
+    uint32_t sad = dev->chip_layout[i].sad;
+    uint32_t ead = dev->chip_layout[i].ead;
+    uint32_t eau = dev->chip_layout[i].eau;
+    uint32_t wau = dev->chip_layout[i].wau;
+    uint32_t rau = dev->chip_layout[i].rau;
+    uint32_t cau = dev->chip_layout[i].cau;
 
     /* Count user areas for dual bank detection (KOA=0x00 or 0x01) */
     if (koa == KOA_TYPE_CODE || koa == KOA_TYPE_CODE1)
@@ -511,59 +648,55 @@ ra_get_area_info(ra_device_t *dev, bool print) {
     else if (sad >= ADDR_CONFIG_START && sad < ADDR_CONFIG_END)
       config_size += area_size;
 
-    if (print) {
-      char size_str[32], erase_str[32], write_str[32], read_str[32], crc_str[32];
-      format_size(area_size, size_str, sizeof(size_str));
-      if (eau > 0)
-        format_size(eau, erase_str, sizeof(erase_str));
-      else
-        snprintf(erase_str, sizeof(erase_str), "n/a");
-      format_size(wau, write_str, sizeof(write_str));
-      if (rau > 0)
-        format_size(rau, read_str, sizeof(read_str));
-      else
-        snprintf(read_str, sizeof(read_str), "n/a");
-      if (cau > 0)
-        format_size(cau, crc_str, sizeof(crc_str));
-      else
-        snprintf(crc_str, sizeof(crc_str), "n/a");
-      /* Use KOA for area type (spec 6.16.2.2), fallback to address-based */
-      const char *area_type = (koa != 0) ? get_area_type_koa(koa) : get_area_type(sad);
-      /* Add bank label for dual bank mode user areas */
-      if (koa == KOA_TYPE_CODE1) {
-        printf("Area %d [%s Bank 1] (KOA=0x%02X): 0x%08X - 0x%08X\n", i, area_type, koa, sad, ead);
-      } else if (user_area_count > 1 && koa == KOA_TYPE_CODE) {
-        printf("Area %d [%s Bank 0] (KOA=0x%02X): 0x%08X - 0x%08X\n", i, area_type, koa, sad, ead);
-      } else {
-        printf("Area %d [%s] (KOA=0x%02X): 0x%08X - 0x%08X\n", i, area_type, koa, sad, ead);
-      }
-      printf("       Size: %-8s  Erase: %-8s  Write: %-8s  Read: %-8s  CRC: %s\n",
-          size_str,
-          erase_str,
-          write_str,
-          read_str,
-          crc_str);
+    char size_str[32], erase_str[32], write_str[32], read_str[32], crc_str[32];
+    format_size(area_size, size_str, sizeof(size_str));
+    if (eau > 0)
+      format_size(eau, erase_str, sizeof(erase_str));
+    else
+      snprintf(erase_str, sizeof(erase_str), "n/a");
+    format_size(wau, write_str, sizeof(write_str));
+    if (rau > 0)
+      format_size(rau, read_str, sizeof(read_str));
+    else
+      snprintf(read_str, sizeof(read_str), "n/a");
+    if (cau > 0)
+      format_size(cau, crc_str, sizeof(crc_str));
+    else
+      snprintf(crc_str, sizeof(crc_str), "n/a");
+    /* Use KOA for area type (spec 6.16.2.2), fallback to address-based */
+    const char *area_type = (koa != 0) ? get_area_type_koa(koa) : get_area_type(sad);
+    /* Add bank label for dual bank mode user areas */
+    if (koa == KOA_TYPE_CODE1) {
+      printf("Area %d [%s Bank 1] (KOA=0x%02X): 0x%08X - 0x%08X\n", i, area_type, koa, sad, ead);
+    } else if (user_area_count > 1 && koa == KOA_TYPE_CODE) {
+      printf("Area %d [%s Bank 0] (KOA=0x%02X): 0x%08X - 0x%08X\n", i, area_type, koa, sad, ead);
+    } else {
+      printf("Area %d [%s] (KOA=0x%02X): 0x%08X - 0x%08X\n", i, area_type, koa, sad, ead);
     }
+    printf("       Size: %-8s  Erase: %-8s  Write: %-8s  Read: %-8s  CRC: %s\n",
+        size_str,
+        erase_str,
+        write_str,
+        read_str,
+        crc_str);
   }
 
   /* Print summary */
-  if (print) {
-    char size_buf[32];
-    bool dual_bank = (user_area_count > 1);
-    printf("Dual Bank Mode:     %s\n", dual_bank ? "Yes" : "No");
-    printf("Memory:\n");
-    if (code_flash_size > 0) {
-      format_size(code_flash_size, size_buf, sizeof(size_buf));
-      printf("  Code Flash: %s\n", size_buf);
-    }
-    if (data_flash_size > 0) {
-      format_size(data_flash_size, size_buf, sizeof(size_buf));
-      printf("  Data Flash: %s\n", size_buf);
-    }
-    if (config_size > 0) {
-      format_size(config_size, size_buf, sizeof(size_buf));
-      printf("  Config: %s\n", size_buf);
-    }
+  char size_buf[32];
+  bool dual_bank = (user_area_count > 1);
+  printf("Dual Bank Mode:     %s\n", dual_bank ? "Yes" : "No");
+  printf("Memory:\n");
+  if (code_flash_size > 0) {
+    format_size(code_flash_size, size_buf, sizeof(size_buf));
+    printf("  Code Flash: %s\n", size_buf);
+  }
+  if (data_flash_size > 0) {
+    format_size(data_flash_size, size_buf, sizeof(size_buf));
+    printf("  Data Flash: %s\n", size_buf);
+  }
+  if (config_size > 0) {
+    format_size(config_size, size_buf, sizeof(size_buf));
+    printf("  Config: %s\n", size_buf);
   }
 
   return 0;
@@ -571,27 +704,11 @@ ra_get_area_info(ra_device_t *dev, bool print) {
 
 int
 ra_get_dev_info(ra_device_t *dev) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[64]; /* Signature response can be up to 47 bytes */
-  uint8_t data[64];
-  size_t data_len;
-  ssize_t pkt_len, n;
-
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), SIG_CMD, NULL, 0, false);
-  if (pkt_len < 0)
-    return -1;
-
-  if (ra_send(dev, pkt, pkt_len) < 0)
+  if (query_signature(dev, false) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
-  if (n < 7) {
-    warnx("short response for device info");
-    return -1;
-  }
-
-  if (unpack_with_error(resp, n, data, &data_len, "signature") < 0)
-    return -1;
+  const uint8_t *data = dev->sig;
+  size_t data_len = dev->sig_len;
 
   printf("==================== Device Information ====================\n");
 
@@ -704,66 +821,31 @@ ra_get_dev_info(ra_device_t *dev) {
 
 int
 ra_get_rmb(ra_device_t *dev, uint32_t *rmb_out) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[64];
-  uint8_t data[64];
-  size_t data_len;
-  ssize_t pkt_len, n;
-
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), SIG_CMD, NULL, 0, false);
-  if (pkt_len < 0)
-    return -1;
-
-  if (ra_send(dev, pkt, pkt_len) < 0)
+  /* Always a real round trip: callers use it to check the link */
+  if (query_signature(dev, true) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
-  if (n < 7) {
-    warnx("short response for signature");
-    return -1;
-  }
-
-  if (unpack_with_error(resp, n, data, &data_len, "signature") < 0)
-    return -1;
-
-  if (data_len < 4) {
+  if (dev->sig_len < 4) {
     warnx("signature response too short for RMB field");
     return -1;
   }
 
   /* RMB is first 4 bytes of signature response */
-  *rmb_out = be_to_uint32(&data[0]);
+  *rmb_out = be_to_uint32(&dev->sig[0]);
   return 0;
 }
 
 uint32_t
 ra_get_device_max_baudrate(ra_device_t *dev) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[64];
-  uint8_t data[64];
-  size_t data_len;
-  ssize_t pkt_len, n;
-
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), SIG_CMD, NULL, 0, false);
-  if (pkt_len < 0)
-    return 115200;
-
-  if (ra_send(dev, pkt, pkt_len) < 0)
-    return 115200;
-
-  n = ra_recv(dev, resp, sizeof(resp), 500);
-  if (n < 7)
-    return 115200;
-
-  if (ra_unpack_pkt(resp, n, data, &data_len, NULL) < 0)
+  if (query_signature(dev, false) < 0)
     return 115200;
 
   /* Product name is at offset 25, 16 bytes (requires data_len >= 41) */
-  if (data_len < 41)
+  if (dev->sig_len < 41)
     return 115200;
 
   char product[PRODUCT_NAME_LEN + 1] = { 0 };
-  memcpy(product, &data[25], PRODUCT_NAME_LEN);
+  memcpy(product, &dev->sig[25], PRODUCT_NAME_LEN);
 
   /*
    * Determine max baud rate from product name (R7FAxxxx format)
@@ -777,11 +859,11 @@ ra_get_device_max_baudrate(ra_device_t *dev) {
     switch (series) {
     case '2':
     case '4':
-      fprintf(stderr, "Device: RA%c series (24 MHz SCI, max 1.5 Mbps)\n", series);
+      ra_log(RA_LOG_INFO, "Device: RA%c series (24 MHz SCI, max 1.5 Mbps)", series);
       return 1500000;
     case '6':
     case '8':
-      fprintf(stderr, "Device: RA%c series (60 MHz SCI, max 4 Mbps)\n", series);
+      ra_log(RA_LOG_INFO, "Device: RA%c series (60 MHz SCI, max 4 Mbps)", series);
       return 4000000;
     }
   }
@@ -797,6 +879,7 @@ ra_authenticate(ra_device_t *dev, const uint8_t *id_code) {
   uint8_t resp[16];
   ssize_t pkt_len, n;
 
+  ra_cache_invalidate_all(dev->cache);
   pkt_len = ra_pack_pkt(pkt, sizeof(pkt), IDA_CMD, id_code, ID_CODE_LEN, false);
   if (pkt_len < 0)
     return -1;
@@ -804,7 +887,7 @@ ra_authenticate(ra_device_t *dev, const uint8_t *id_code) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7) {
     warnx("short response for ID authentication");
     return -1;
@@ -812,62 +895,124 @@ ra_authenticate(ra_device_t *dev, const uint8_t *id_code) {
 
   uint8_t data[16];
   size_t data_len;
-  if (unpack_with_error(resp, n, data, &data_len, "ID authentication") < 0)
+  if (ra_unpack_with_error(resp, n, data, &data_len, "ID authentication") < 0)
     return -1;
 
   dev->authenticated = true;
-  fprintf(stderr, "ID authentication successful\n");
+  ra_log(RA_LOG_INFO, "ID authentication successful");
   return 0;
 }
 
 int
-ra_erase(ra_device_t *dev, uint32_t start, uint32_t size) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[16];
-  uint8_t cmd_data[8];
-  uint8_t resp_data[16]; /* For error details: STS(1) + ST2(4) + ADR(4) */
-  ssize_t pkt_len, n;
-  uint32_t end;
+ra_session_open(ra_device_t *dev,
+    const char *port,
+    bool uart_mode,
+    uint32_t baudrate,
+    const uint8_t *id_code,
+    bool layout_cache) {
+  ra_dev_init(dev);
+  dev->uart_mode = uart_mode;
+  dev->layout_cache = layout_cache;
 
-  if (set_erase_boundaries(dev, start, size == 0 ? 1 : size, &end) < 0)
+  if (ra_open(dev, port) < 0) {
+    warnx("failed to connect to device");
     return -1;
+  }
 
-  printf("Erasing 0x%08x:0x%08x\n", start, end);
+  if (ra_get_area_info(dev, false) < 0) {
+    ra_close(dev);
+    warnx("failed to get area info");
+    return -1;
+  }
 
-  uint32_to_be(start, &cmd_data[0]);
-  uint32_to_be(end, &cmd_data[4]);
+  /* Note: IDA with all-0xFF fails with 0xC1 on unlocked devices
+   * Per Renesas docs, unlocked devices skip Authentication phase */
 
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), ERA_CMD, cmd_data, 8, false);
-  if (pkt_len < 0)
-    return -1;
+  /* Set baud rate: auto-detect max in UART mode, or use explicit value */
+  if (baudrate > 0 && baudrate != 9600) {
+    if (ra_set_baudrate(dev, baudrate) < 0) {
+      ra_close(dev);
+      warnx("failed to set baud rate");
+      return -1;
+    }
+  } else if (uart_mode && baudrate == 0) {
+    /* Auto-switch to max baud rate in UART mode */
+    /* Get device limit based on MCU series */
+    uint32_t device_max = ra_get_device_max_baudrate(dev);
+
+    /* Get adapter limit based on USB VID/PID */
+    const char *tty = port;
+    if (tty != NULL) {
+      const char *slash = strrchr(tty, '/');
+      if (slash != NULL)
+        tty = slash + 1;
+    }
+    uint32_t adapter_max = ra_get_adapter_max_baudrate(tty);
+
+    /* Use minimum of device max, adapter max, and termios support */
+    uint32_t target = device_max < adapter_max ? device_max : adapter_max;
+    uint32_t best = ra_best_baudrate(target);
+
+    if (best > 9600) {
+      if (ra_set_baudrate(dev, best) == 0) {
+        /* Verify communication works at new rate */
+        uint32_t rmb_check;
+        if (ra_get_rmb(dev, &rmb_check) < 0) {
+          ra_close(dev);
+          warnx("communication failed at %u bps, reset board and use -b 115200 or lower", best);
+          return -1;
+        }
+      } else {
+        warnx("baud rate %u bps failed, falling back", best);
+        if (ra_set_baudrate(dev, 115200) < 0) {
+          warnx("continuing at 9600 bps");
+        }
+      }
+    }
+  }
 
-  if (ra_send(dev, pkt, pkt_len) < 0)
-    return -1;
+  /* Perform ID authentication if requested */
+  if (id_code != NULL) {
+    if (ra_authenticate(dev, id_code) < 0) {
+      ra_close(dev);
+      warnx("ID authentication failed");
+      return -1;
+    }
+  }
 
-  n = ra_recv(dev, resp, sizeof(resp), 5000); /* Erase takes longer */
-  if (n < 7) {
-    warnx("short response for erase");
+  return 0;
+}
+
+int
+ra_erase(ra_device_t *dev, uint32_t start, uint32_t size) {
+  ra_op_t op;
+  uint32_t end;
+
+  if (set_erase_boundaries(dev, start, size == 0 ? 1 : size, &end) < 0)
     return -1;
-  }
 
-  size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "erase") < 0)
+  ra_log(RA_LOG_OUTPUT, "Erasing 0x%08x:0x%08x", start, end);
+
+  ra_op_erase(&op, dev, start, end);
+  op.context = "erase";
+  if (ra_op_run(&op) < 0)
     return -1;
 
-  printf("Erase complete\n");
+  ra_log(RA_LOG_OUTPUT, "Erase complete");
   return 0;
 }
 
+/* Progress of an operation on dev: library sessions draw no bar */
+static void
+dev_progress_init(
+    const ra_device_t *dev, progress_t *p, size_t steps, size_t bytes, const char *desc) {
+  progress_init_quiet(p, steps, bytes, desc, progress_global_quiet || (dev != NULL && dev->quiet));
+}
+
 int
 ra_read(ra_device_t *dev, const char *file, uint32_t start, uint32_t size, output_format_t format) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[CHUNK_SIZE + 6];
-  uint8_t chunk[CHUNK_SIZE];
-  uint8_t data[8];
-  ssize_t pkt_len, n;
   uint32_t end;
   uint8_t *buffer = NULL;
-  size_t buffer_offset = 0;
 
   if (set_read_boundaries(dev, start, size == 0 ? 0x3FFFF - start : size, &end) < 0)
     return -1;
@@ -879,62 +1024,20 @@ ra_read(ra_device_t *dev, const char *file, uint32_t start, uint32_t size, outpu
     return -1;
   }
 
-  /*
-   * WORKAROUND: Use single-packet reads (<=1024 bytes each) to avoid
-   * multi-packet ACK protocol issue. See protocol.md for details.
-   */
   uint32_t nr_chunks = (total_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
   progress_t prog;
-  progress_init(&prog, nr_chunks, "Reading");
-
-  uint32_t current_addr = start;
-  for (uint32_t i = 0; i < nr_chunks; i++) {
-    /* Calculate chunk boundaries (single-packet read) */
-    uint32_t chunk_start = current_addr;
-    uint32_t remaining = end - chunk_start + 1;
-    uint32_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
-    uint32_t chunk_end = chunk_start + chunk_size - 1;
-
-    /* Send single-packet READ command */
-    uint32_to_be(chunk_start, &data[0]);
-    uint32_to_be(chunk_end, &data[4]);
-
-    pkt_len = ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, data, 8, false);
-    if (pkt_len < 0) {
-      free(buffer);
-      return -1;
-    }
-
-    if (ra_send(dev, pkt, pkt_len) < 0) {
-      free(buffer);
-      return -1;
-    }
-
-    /* Receive single data packet */
-    n = ra_recv(dev, resp, CHUNK_SIZE + 6, 2000);
-    if (n < 7) {
-      warnx("short response during read (%zd bytes)", n);
-      free(buffer);
-      return -1;
-    }
+  dev_progress_init(dev, &prog, nr_chunks, total_size, "Reading");
 
-    size_t chunk_len;
-    if (unpack_with_error(resp, n, chunk, &chunk_len, "read") < 0) {
-      free(buffer);
-      return -1;
-    }
-
-    memcpy(buffer + buffer_offset, chunk, chunk_len);
-    buffer_offset += chunk_len;
-    current_addr += chunk_size;
-
-    progress_update(&prog, i + 1);
+  /* Chunks land directly in the output buffer */
+  if (read_range_into(dev, start, buffer, total_size, &prog, "read") < 0) {
+    free(buffer);
+    return -1;
   }
 
   progress_finish(&prog);
 
   /* Write buffer to file in specified format */
-  int ret = format_write(file, format, buffer, buffer_offset, start);
+  int ret = format_write(file, format, buffer, total_size, start);
   free(buffer);
 
   return ret;
@@ -943,11 +1046,8 @@ ra_read(ra_device_t *dev, const char *file, uint32_t start, uint32_t size, outpu
 int
 ra_verify(
     ra_device_t *dev, const char *file, uint32_t start, uint32_t size, input_format_t format) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[CHUNK_SIZE + 6];
   uint8_t flash_chunk[CHUNK_SIZE];
-  uint8_t data[8];
-  ssize_t pkt_len, n;
+  uint8_t file_chunk[CHUNK_SIZE];
   uint32_t end;
   parsed_file_t parsed;
 
@@ -983,73 +1083,52 @@ ra_verify(
   uint32_t current_addr = start;
   uint32_t file_offset = 0;
   progress_t prog;
-  progress_init(&prog, nr_chunks, "Verifying");
+  dev_progress_init(dev, &prog, nr_chunks, total_size, "Verifying");
 
   for (uint32_t i = 0; i < nr_chunks; i++) {
     /* Calculate chunk boundaries (single-packet read) */
     uint32_t chunk_start = current_addr;
     uint32_t remaining_flash = end - chunk_start + 1;
     uint32_t chunk_size = (remaining_flash > CHUNK_SIZE) ? CHUNK_SIZE : remaining_flash;
-    uint32_t chunk_end = chunk_start + chunk_size - 1;
-
-    /* Send single-packet READ command */
-    uint32_to_be(chunk_start, &data[0]);
-    uint32_to_be(chunk_end, &data[4]);
-
-    pkt_len = ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, data, 8, false);
-    if (pkt_len < 0) {
-      free(parsed.data);
-      return -1;
-    }
 
-    if (ra_send(dev, pkt, pkt_len) < 0) {
+    if (read_chunk_into(dev, chunk_start, flash_chunk, chunk_size, "verify read") < 0) {
       free(parsed.data);
       return -1;
     }
+    size_t chunk_len = chunk_size;
 
-    /* Receive single data packet */
-    n = ra_recv(dev, resp, CHUNK_SIZE + 6, 2000);
-    if (n < 7) {
-      warnx("short response during verify (%zd bytes)", n);
-      free(parsed.data);
-      return -1;
+    /* Compare flash data with file data from parsed buffer */
+    size_t remaining_file = parsed.size - file_offset;
+    size_t cmp_len = remaining_file < chunk_len ? remaining_file : chunk_len;
+    const uint8_t *want = format_bytes(&parsed, file_offset, cmp_len);
+    if (want == NULL) {
+      format_copy(&parsed, file_offset, file_chunk, cmp_len);
+      want = file_chunk;
     }
-
-    size_t chunk_len;
-    if (unpack_with_error(resp, n, flash_chunk, &chunk_len, "verify read") < 0) {
+    size_t j = rabuf_mismatch(flash_chunk, want, cmp_len);
+    if (j < cmp_len) {
+      progress_finish(&prog);
+      warnx("verify FAILED at 0x%08X: flash=0x%02X, file=0x%02X",
+          current_addr + (uint32_t)j,
+          flash_chunk[j],
+          want[j]);
       free(parsed.data);
       return -1;
     }
 
-    /* Compare flash data with file data from parsed buffer */
-    size_t remaining_file = parsed.size - file_offset;
-    size_t cmp_len = remaining_file < chunk_len ? remaining_file : chunk_len;
-    for (size_t j = 0; j < cmp_len; j++) {
-      if (flash_chunk[j] != parsed.data[file_offset + j]) {
+    /* If file is shorter than flash region, remaining flash bytes should be 0xFF */
+    if (cmp_len < chunk_len) {
+      j = cmp_len + rabuf_first_used(flash_chunk + cmp_len, chunk_len - cmp_len);
+      if (j < chunk_len) {
         progress_finish(&prog);
-        warnx("verify FAILED at 0x%08X: flash=0x%02X, file=0x%02X",
+        warnx("verify FAILED at 0x%08X: flash=0x%02X, expected=0xFF (beyond file)",
             current_addr + (uint32_t)j,
-            flash_chunk[j],
-            parsed.data[file_offset + j]);
+            flash_chunk[j]);
         free(parsed.data);
         return -1;
       }
     }
 
-    /* If file is shorter than flash region, remaining flash bytes should be 0xFF */
-    if (cmp_len < chunk_len) {
-      for (size_t j = cmp_len; j < chunk_len; j++) {
-        if (flash_chunk[j] != 0xFF) {
-          progress_finish(&prog);
-          warnx("verify FAILED at 0x%08X: flash=0x%02X, expected=0xFF (beyond file)",
-              current_addr + (uint32_t)j,
-              flash_chunk[j]);
-          free(parsed.data);
-          return -1;
-        }
-      }
-    }
-
     file_offset += (uint32_t)cmp_len;
     current_addr += chunk_size;
 
@@ -1065,11 +1144,7 @@ ra_verify(
 
 int
 ra_blank_check(ra_device_t *dev, uint32_t start, uint32_t size) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[CHUNK_SIZE + 6];
   uint8_t flash_chunk[CHUNK_SIZE];
-  uint8_t data[8];
-  ssize_t pkt_len, n;
   uint32_t end;
 
   if (size == 0) {
@@ -1082,180 +1157,200 @@ ra_blank_check(ra_device_t *dev, uint32_t start, uint32_t size) {
 
   uint32_t total_size = end - start + 1;
 
-  /*
-   * WORKAROUND: Use single-packet reads (<=1024 bytes each) to avoid
-   * multi-packet ACK protocol issue. See protocol.md for details.
-   */
-  uint32_t nr_chunks = (total_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
-  uint32_t current_addr = start;
-  progress_t prog;
-  progress_init(&prog, nr_chunks, "Checking");
+  /* Erased flash usually answers with a single CRC command */
+  int blank = crc_probe_blank(dev, start, end);
+  if (blank < 0)
+    return -1;
 
-  for (uint32_t i = 0; i < nr_chunks; i++) {
-    /* Calculate chunk boundaries (single-packet read) */
-    uint32_t chunk_start = current_addr;
-    uint32_t remaining = end - chunk_start + 1;
-    uint32_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
-    uint32_t chunk_end = chunk_start + chunk_size - 1;
+  if (blank == 0) {
+    /*
+     * Probe each erase block by CRC and read back only those that are not
+     * erased, to report the first used byte.
+     * WORKAROUND: Use single-packet reads (<=1024 bytes each) to avoid
+     * multi-packet ACK protocol issue. See protocol.md for details.
+     */
+    uint32_t unit = crc_probe_unit(dev, start);
+    uint32_t current_addr = start;
+    progress_t prog;
+    dev_progress_init(dev, &prog, total_size, total_size, "Checking");
 
-    /* Send single-packet READ command */
-    uint32_to_be(chunk_start, &data[0]);
-    uint32_to_be(chunk_end, &data[4]);
+    for (;;) {
+      uint32_t block_end = crc_probe_block_end(dev, current_addr, unit, end);
 
-    pkt_len = ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, data, 8, false);
-    if (pkt_len < 0)
-      return -1;
+      blank = crc_probe_blank(dev, current_addr, block_end);
+      if (blank < 0) {
+        progress_finish(&prog);
+        return -1;
+      }
 
-    if (ra_send(dev, pkt, pkt_len) < 0)
-      return -1;
+      for (uint32_t chunk_start = current_addr; blank == 0 && chunk_start <= block_end;) {
+        uint32_t remaining = block_end - chunk_start + 1;
+        uint32_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
 
-    /* Receive single data packet */
-    n = ra_recv(dev, resp, CHUNK_SIZE + 6, 2000);
-    if (n < 7) {
-      warnx("short response during blank check (%zd bytes)", n);
-      return -1;
-    }
+        if (read_chunk_into(dev, chunk_start, flash_chunk, chunk_size, "blank check") < 0) {
+          progress_finish(&prog);
+          return -1;
+        }
 
-    size_t chunk_len;
-    if (unpack_with_error(resp, n, flash_chunk, &chunk_len, "blank check") < 0)
-      return -1;
+        /* Check all bytes are 0xFF (erased state) */
+        size_t j = rabuf_first_used(flash_chunk, chunk_size);
+        if (j < chunk_size) {
+          progress_finish(&prog);
+          warnx("blank check FAILED at 0x%08X: found 0x%02X (expected 0xFF)",
+              chunk_start + (uint32_t)j,
+              flash_chunk[j]);
+          return -1;
+        }
 
-    /* Check all bytes are 0xFF (erased state) */
-    for (size_t j = 0; j < chunk_len; j++) {
-      if (flash_chunk[j] != 0xFF) {
-        progress_finish(&prog);
-        warnx("blank check FAILED at 0x%08X: found 0x%02X (expected 0xFF)",
-            current_addr + (uint32_t)j,
-            flash_chunk[j]);
-        return -1;
+        chunk_start += chunk_size;
       }
+
+      progress_update(&prog, block_end - start + 1);
+      if (block_end >= end)
+        break;
+      current_addr = block_end + 1;
     }
 
-    current_addr += chunk_size;
-    progress_update(&prog, i + 1);
+    progress_finish(&prog);
   }
 
-  progress_finish(&prog);
-
   printf("Blank check OK: %u bytes at 0x%08X are erased\n", total_size, start);
   return 0;
 }
 
-int
-ra_write(ra_device_t *dev,
-    const char *file,
-    uint32_t start,
-    uint32_t size,
-    bool verify,
-    input_format_t format) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[16];
-  uint8_t cmd_data[8];
-  uint8_t resp_data[16]; /* For error details: STS(1) + ST2(4) + ADR(4) */
-  uint8_t chunk[CHUNK_SIZE];
-  ssize_t pkt_len, n;
-  uint32_t end;
-  parsed_file_t parsed;
+/*
+ * Verify one extent of a compiled image
+ * The device CRC covers CAU-aligned extents in one command, others are read
+ * back chunk by chunk and checked against the stored chunk CRCs.
+ * Returns: 1 on match, 0 on mismatch, -1 on error
+ */
+static int
+rfi_verify_extent(ra_device_t *dev, const rfi_extent_t *ext) {
+  const ra_area_t *a = &dev->chip_layout[find_area_for_address(dev, ext->start)];
 
-  if (format_parse(file, format, &parsed) < 0)
-    return -1;
+  if (a->cau != 0 && a->koa != KOA_TYPE_CONFIG && (ext->start - a->sad) % a->cau == 0 &&
+      (ext->end - a->sad + 1) % a->cau == 0) {
+    uint32_t crc;
+    if (crc_query(dev, ext->start, ext->end, &crc) < 0)
+      return -1;
+    return crc == ext->crc;
+  }
 
-  /* Use address from file if not specified on command line */
-  if (start == 0 && parsed.has_addr)
-    start = parsed.base_addr;
+  uint8_t buf[RFI_CHUNK];
+  for (uint32_t i = 0; i < ext->nr_chunks; i++) {
+    size_t len;
+    uint32_t addr = ext->start + i * RFI_CHUNK;
+    rfi_chunk_data(ext, i, &len);
+    if (read_chunk_into(dev, addr, buf, len, "verify") < 0)
+      return -1;
+    if (crc32_calc(buf, len) != rfi_chunk_crc(ext, i))
+      return 0;
+  }
+  return 1;
+}
 
-  uint32_t file_size = (uint32_t)parsed.size;
-  if (size == 0)
-    size = file_size;
+/*
+ * Write a compiled image: the stored packets go out as they are
+ */
+static int
+write_rfi(ra_device_t *dev, const char *file, uint32_t start, uint32_t size, bool verify) {
+  rfi_t rfi;
 
-  if (size > file_size) {
-    warnx("write size > file size");
-    free(parsed.data);
+  if (start != 0 || size != 0) {
+    warnx("%s: compiled images carry their own addresses, drop -a/-s", file);
     return -1;
   }
 
-  if (set_write_boundaries(dev, start, size, &end) < 0) {
-    free(parsed.data);
+  if (rfi_open(file, &rfi) < 0)
     return -1;
+
+  /* Every extent must sit on write units of the area it lands in */
+  for (uint32_t e = 0; e < rfi.nr_extents; e++) {
+    const rfi_extent_t *ext = &rfi.extents[e];
+    uint32_t end;
+    if (set_write_boundaries(dev, ext->start, ext->end - ext->start + 1, &end) < 0 ||
+        end != ext->end) {
+      warnx("%s: extent 0x%08X-0x%08X does not fit the device layout", file, ext->start, ext->end);
+      rfi_close(&rfi);
+      return -1;
+    }
   }
 
-  /* Calculate actual write size (WAU-aligned range) */
-  uint32_t write_size = end - start + 1;
+  progress_t prog;
+  dev_progress_init(dev, &prog, rfi.payload, rfi.payload, "Writing");
 
-  /* Send write command */
-  uint32_to_be(start, &cmd_data[0]);
-  uint32_to_be(end, &cmd_data[4]);
+  uint32_t total = 0;
+  for (uint32_t e = 0; e < rfi.nr_extents; e++) {
+    const rfi_extent_t *ext = &rfi.extents[e];
+    ra_op_t op;
 
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), WRI_CMD, cmd_data, 8, false);
-  if (pkt_len < 0) {
-    free(parsed.data);
-    return -1;
+    ra_op_write_frames(&op, dev, ext->start, ext->end, ext->stream, ext->stream_len);
+    op.context = "write";
+    op.prog = &prog;
+    op.prog_base = total;
+    if (ra_op_run(&op) < 0)
+      goto fail;
+    total += op.off;
   }
 
-  if (ra_send(dev, pkt, pkt_len) < 0) {
-    free(parsed.data);
-    return -1;
-  }
+  progress_finish(&prog);
 
-  n = ra_recv(dev, resp, sizeof(resp), 1000);
-  if (n < 7) {
-    warnx("short response for write init");
-    free(parsed.data);
-    return -1;
+  if (verify) {
+    for (uint32_t e = 0; e < rfi.nr_extents; e++) {
+      int ok = rfi_verify_extent(dev, &rfi.extents[e]);
+      if (ok < 0)
+        goto fail;
+      if (ok == 0) {
+        printf("Verify failed at extent 0x%08X-0x%08X\n", rfi.extents[e].start, rfi.extents[e].end);
+        rfi_close(&rfi);
+        return -1;
+      }
+    }
+    printf("Verify complete\n");
   }
 
-  size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "write init") < 0) {
-    free(parsed.data);
-    return -1;
-  }
+  rfi_close(&rfi);
+  return 0;
 
-  progress_t prog;
-  progress_init(&prog, write_size, "Writing");
+fail:
+  rfi_close(&rfi);
+  return -1;
+}
 
-  uint32_t total = 0;
-  uint32_t buf_offset = 0;
-  while (total < write_size) {
-    /* Calculate chunk size: min(CHUNK_SIZE, remaining) per spec 6.19 */
-    uint32_t remaining = write_size - total;
-    uint32_t chunk_size = remaining < CHUNK_SIZE ? remaining : CHUNK_SIZE;
-
-    /* Copy from parsed buffer, pad with zeros if smaller than write range */
-    uint32_t copy_size = (buf_offset + chunk_size <= file_size)
-                             ? chunk_size
-                             : (file_size > buf_offset ? file_size - buf_offset : 0);
-    if (copy_size > 0)
-      memcpy(chunk, parsed.data + buf_offset, copy_size);
-    if (copy_size < chunk_size)
-      memset(chunk + copy_size, 0, chunk_size - copy_size);
-    buf_offset += copy_size;
-
-    pkt_len = ra_pack_pkt(pkt, sizeof(pkt), WRI_CMD, chunk, chunk_size, true);
-    if (pkt_len < 0) {
-      free(parsed.data);
-      return -1;
-    }
+/*
+ * Write one contiguous image to flash
+ * data/file_size: image content, start/size: range to program (the
+ * WAU-aligned tail past the image is padded with zeros)
+ * Returns: 0 on success, -1 on error or when the read back differs
+ */
+static int
+write_image(ra_device_t *dev,
+    const uint8_t *data,
+    uint32_t file_size,
+    uint32_t start,
+    uint32_t size,
+    bool verify) {
+  ra_op_t op;
+  uint32_t end;
 
-    if (ra_send(dev, pkt, pkt_len) < 0) {
-      free(parsed.data);
-      return -1;
-    }
+  if (set_write_boundaries(dev, start, size, &end) < 0)
+    return -1;
 
-    n = ra_recv(dev, resp, sizeof(resp), 2000);
-    if (n < 7) {
-      warnx("short response during write");
-      free(parsed.data);
-      return -1;
-    }
+  /* Calculate actual write size (WAU-aligned range) */
+  uint32_t write_size = end - start + 1;
 
-    if (unpack_with_error(resp, n, resp_data, &data_len, "write") < 0) {
-      free(parsed.data);
-      return -1;
-    }
+  /*
+   * Sent straight from the parsed buffer; only the last chunk, when the
+   * WAU-aligned range runs past the file, is staged to pad with zeros.
+   */
+  progress_t prog;
+  dev_progress_init(dev, &prog, write_size, write_size, "Writing");
 
-    total += chunk_size;
-    progress_update(&prog, total);
-  }
+  ra_op_write(&op, dev, start, data, file_size < write_size ? file_size : write_size, write_size);
+  op.context = "write";
+  op.prog = &prog;
+  if (ra_op_run(&op) < 0)
+    return -1;
 
   progress_finish(&prog);
 
@@ -1266,14 +1361,12 @@ ra_write(ra_device_t *dev,
     int tmpfd = mkstemp(tmpfile);
     if (tmpfd < 0) {
       warn("failed to create temp file for verify");
-      free(parsed.data);
       return -1;
     }
     close(tmpfd);
 
     if (ra_read(dev, tmpfile, start, size, FORMAT_BIN) < 0) {
       unlink(tmpfile);
-      free(parsed.data);
       return -1;
     }
 
@@ -1281,7 +1374,6 @@ ra_write(ra_device_t *dev,
     tmpfd = open(tmpfile, O_RDONLY);
     if (tmpfd < 0) {
       unlink(tmpfile);
-      free(parsed.data);
       return -1;
     }
 
@@ -1299,7 +1391,9 @@ ra_write(ra_device_t *dev,
         break;
 
       size_t cmp_len = (size_t)n_read;
-      if (memcmp(parsed.data + compared, buf, cmp_len) != 0) {
+      if (cmp_len > file_size - compared)
+        cmp_len = file_size - compared;
+      if (rabuf_mismatch(data + compared, buf, cmp_len) != cmp_len) {
         match = false;
         break;
       }
@@ -1309,58 +1403,155 @@ ra_write(ra_device_t *dev,
     close(tmpfd);
     unlink(tmpfile);
 
-    if (match)
-      printf("Verify complete\n");
-    else
+    if (!match) {
       printf("Verify failed\n");
+      return -1;
+    }
+    printf("Verify complete\n");
   }
 
-  free(parsed.data);
   return 0;
 }
 
-int
-ra_crc(ra_device_t *dev, uint32_t start, uint32_t size, uint32_t *crc_out) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[16];
-  uint8_t data[8];
-  uint8_t resp_data[16];
-  ssize_t pkt_len, n;
-  uint32_t end;
+/*
+ * Image bytes [off, off + len) in one piece: in place when the file holds
+ * them so, else staged in *staged (to free, NULL otherwise)
+ * Returns: the bytes, NULL if out of memory
+ */
+static const uint8_t *
+image_bytes(const parsed_file_t *parsed, size_t off, size_t len, uint8_t **staged) {
+  const uint8_t *data = format_bytes(parsed, off, len);
+
+  *staged = NULL;
+  if (data == NULL) {
+    *staged = malloc(len ? len : 1);
+    if (*staged == NULL) {
+      warnx("memory allocation failed");
+      return NULL;
+    }
+    format_copy(parsed, off, *staged, len);
+    data = *staged;
+  }
+  return data;
+}
 
-  if (set_crc_boundaries(dev, start, size == 0 ? 1 : size, &end) < 0)
-    return -1;
+/*
+ * Write the loaded ranges of an image, leaving the gaps untouched
+ * Extents closer than a write unit share their blocks (filled from the
+ * image), so that no block is programmed twice.
+ */
+static int
+write_extents(ra_device_t *dev, const parsed_file_t *parsed, bool verify) {
+  uint32_t base = parsed->base_addr;
+  int i = 0;
+
+  while (i < parsed->nr_extents) {
+    uint32_t start = parsed->extents[i].addr;
+    int area = find_area_for_address(dev, start);
+    if (area < 0) {
+      warnx("address 0x%x not in any known area", start);
+      return -1;
+    }
+    uint32_t wau = dev->chip_layout[area].wau;
+    if (wau == 0) {
+      warnx("area %d does not support write operations", area);
+      return -1;
+    }
 
-  printf("Calculating CRC for 0x%08x-0x%08x\n", start, end);
+    /* Round out to write units; the first extent may only start aligned */
+    uint32_t sad = dev->chip_layout[area].sad;
+    uint32_t lead = (start - sad) % wau;
+    if (start - lead >= base)
+      start -= lead;
+    uint64_t end = (uint64_t)parsed->extents[i].addr + parsed->extents[i].size;
+    for (i++; i < parsed->nr_extents; i++) {
+      uint64_t next = parsed->extents[i].addr;
+      uint64_t aligned = sad + ((end - sad + wau - 1) / wau) * wau;
+      if (next > aligned || next > dev->chip_layout[area].ead)
+        break;
+      uint64_t ext_end = next + parsed->extents[i].size;
+      if (ext_end > end)
+        end = ext_end;
+    }
 
-  uint32_to_be(start, &data[0]);
-  uint32_to_be(end, &data[4]);
+    /*
+     * The WAU tail past the extent is sent from the image (0xFF in its gaps),
+     * not zero padded; only past the image end is there nothing to send
+     */
+    uint64_t aligned = sad + ((end - sad + wau - 1) / wau) * wau;
+    uint64_t image_end = (uint64_t)base + parsed->size;
+    uint32_t len = (uint32_t)(aligned - start);
+    uint32_t avail = (uint32_t)((aligned < image_end ? aligned : image_end) - start);
+    uint8_t *staged;
+    const uint8_t *data = image_bytes(parsed, start - base, avail, &staged);
+    int ret = data != NULL ? write_image(dev, data, avail, start, len, verify) : -1;
+    free(staged);
+    if (ret < 0)
+      return -1;
+  }
 
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), CRC_CMD, data, 8, false);
-  if (pkt_len < 0)
-    return -1;
+  return 0;
+}
 
-  if (ra_send(dev, pkt, pkt_len) < 0)
+int
+ra_write(ra_device_t *dev,
+    const char *file,
+    uint32_t start,
+    uint32_t size,
+    bool verify,
+    input_format_t format) {
+  parsed_file_t parsed;
+  int ret;
+
+  if (format == FORMAT_RFI || (format == FORMAT_AUTO && format_detect(file) == FORMAT_RFI))
+    return write_rfi(dev, file, start, size, verify);
+
+  if (format_parse(file, format, &parsed) < 0)
     return -1;
 
-  /* CRC calculation can take time for large areas */
-  n = ra_recv(dev, resp, sizeof(resp), 5000);
-  if (n < 7) {
-    warnx("short response for CRC command");
+  /* Loaded ranges known: program them only, not the gaps in between */
+  if (start == 0 && size == 0 && parsed.nr_extents > 0) {
+    ret = write_extents(dev, &parsed, verify);
+    free(parsed.data);
+    return ret;
+  }
+
+  /* Use address from file if not specified on command line */
+  if (start == 0 && parsed.has_addr)
+    start = parsed.base_addr;
+
+  uint32_t file_size = (uint32_t)parsed.size;
+  if (size == 0)
+    size = file_size;
+
+  if (size > file_size) {
+    warnx("write size > file size");
+    free(parsed.data);
     return -1;
   }
 
-  size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "CRC") < 0)
+  uint8_t *staged;
+  const uint8_t *data = image_bytes(&parsed, 0, file_size, &staged);
+  ret = data != NULL ? write_image(dev, data, file_size, start, size, verify) : -1;
+  free(staged);
+  free(parsed.data);
+  return ret;
+}
+
+int
+ra_crc(ra_device_t *dev, uint32_t start, uint32_t size, uint32_t *crc_out) {
+  uint32_t end;
+  uint32_t crc;
+
+  if (set_crc_boundaries(dev, start, size == 0 ? 1 : size, &end) < 0)
     return -1;
 
-  if (data_len < 4) {
-    warnx("invalid CRC response length: %zu", data_len);
+  ra_log(RA_LOG_OUTPUT, "Calculating CRC for 0x%08x-0x%08x", start, end);
+
+  if (crc_query(dev, start, end, &crc) < 0)
     return -1;
-  }
 
-  uint32_t crc = be_to_uint32(resp_data);
-  printf("CRC-32: 0x%08X\n", crc);
+  ra_log(RA_LOG_OUTPUT, "CRC-32: 0x%08X", crc);
 
   if (crc_out != NULL)
     *crc_out = crc;
@@ -1368,31 +1559,731 @@ ra_crc(ra_device_t *dev, uint32_t start, uint32_t size, uint32_t *crc_out) {
   return 0;
 }
 
-/* DLM state code definitions */
-static const struct {
-  uint8_t code;
-  const char *name;
-  const char *desc;
-} dlm_states[] = {
-  { DLM_STATE_CM,       "CM",       "Chip Manufacturing"                         },
-  { DLM_STATE_SSD,      "SSD",      "Secure Software Development"                },
-  { DLM_STATE_NSECSD,   "NSECSD",   "Non-Secure Software Development"            },
-  { DLM_STATE_DPL,      "DPL",      "Deployed"                                   },
-  { DLM_STATE_LCK_DBG,  "LCK_DBG",  "Locked Debug"                               },
-  { DLM_STATE_LCK_BOOT, "LCK_BOOT", "Locked Boot Interface"                      },
-  { DLM_STATE_RMA_REQ,  "RMA_REQ",  "Return Material Authorization Request"      },
-  { DLM_STATE_RMA_ACK,  "RMA_ACK",  "Return Material Authorization Acknowledged" },
-  { 0,                  NULL,       NULL                                         },
-};
+int
+ra_read_mem(ra_device_t *dev, uint32_t start, uint8_t *buf, uint32_t size) {
+  uint32_t end;
 
-const char *
-ra_dlm_state_name(uint8_t code) {
-  for (size_t i = 0; dlm_states[i].name != NULL; i++) {
-    if (dlm_states[i].code == code)
-      return dlm_states[i].name;
+  if (size == 0) {
+    warnx("empty read");
+    return -1;
+  }
+  if (set_read_boundaries(dev, start, size, &end) < 0)
+    return -1;
+  if (end - start + 1 != size) {
+    warnx("read of 0x%x bytes does not end on a read unit", size);
+    return -1;
+  }
+
+  uint32_t nr_chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  progress_t prog;
+  dev_progress_init(dev, &prog, nr_chunks, size, "Reading");
+  int ret = read_range_into(dev, start, buf, size, &prog, "read");
+  progress_finish(&prog);
+  return ret;
+}
+
+int
+ra_write_mem(ra_device_t *dev, uint32_t start, const uint8_t *data, uint32_t size) {
+  if (size == 0) {
+    warnx("empty write");
+    return -1;
+  }
+  return write_image(dev, data, size, start, size, false);
+}
+
+int
+ra_verify_mem(ra_device_t *dev, uint32_t start, const uint8_t *data, uint32_t size) {
+  uint8_t chunk[CHUNK_SIZE];
+  uint32_t end;
+
+  if (size == 0) {
+    warnx("empty verify");
+    return -1;
+  }
+
+  /* Whole CRC units: the device does the reading */
+  int area = find_area_for_address(dev, start);
+  if (area >= 0) {
+    const ra_area_t *a = &dev->chip_layout[area];
+    uint32_t crc;
+
+    end = start + size - 1;
+    if (a->cau != 0 && a->koa != KOA_TYPE_CONFIG && end >= start && end <= a->ead &&
+        (start - a->sad) % a->cau == 0 && size % a->cau == 0) {
+      if (crc_query(dev, start, end, &crc) < 0)
+        return -1;
+      return crc == crc32_calc(data, size) ? 1 : 0;
+    }
   }
-  return "UNKNOWN";
-}
+
+  if (set_read_boundaries(dev, start, size, &end) < 0)
+    return -1;
+  if (end - start + 1 != size) {
+    warnx("verify of 0x%x bytes does not end on a read unit", size);
+    return -1;
+  }
+
+  for (uint32_t off = 0; off < size; off += CHUNK_SIZE) {
+    uint32_t len = size - off < CHUNK_SIZE ? size - off : CHUNK_SIZE;
+
+    if (read_chunk_into(dev, start + off, chunk, len, "verify read") < 0)
+      return -1;
+    if (rabuf_mismatch(chunk, data + off, len) < len)
+      return 0;
+  }
+  return 1;
+}
+
+int
+ra_crc_mem(ra_device_t *dev, uint32_t start, uint32_t size, uint32_t *crc_out) {
+  uint32_t end;
+
+  if (set_crc_boundaries(dev, start, size == 0 ? 1 : size, &end) < 0)
+    return -1;
+  return crc_query(dev, start, end, crc_out);
+}
+
+static const char *
+koa_label(uint8_t koa) {
+  switch (koa) {
+  case KOA_TYPE_CODE:
+    return "code flash";
+  case KOA_TYPE_CODE1:
+    return "code flash bank 1";
+  case KOA_TYPE_DATA:
+    return "data flash";
+  case KOA_TYPE_CONFIG:
+    return "config area";
+  default:
+    return "unknown";
+  }
+}
+
+/* Offline mode: erased runs at least this long split the file into regions */
+#define CRC_REGION_GAP 0x10000
+
+/*
+ * Host CRC of the image over [start, end], with 0xFF wherever the file has no data
+ */
+static uint32_t
+crc_of_image(const parsed_file_t *parsed, uint32_t base, uint32_t start, uint32_t end) {
+  uint32_t file_end = base + (uint32_t)parsed->size - 1;
+  uint32_t crc = 0;
+
+  if (end < base || start > file_end)
+    return crc32_fill(0, 0xFF, (size_t)(end - start) + 1);
+
+  /* The pieces the file holds, 0xFF around and between them */
+  uint64_t pos = start;
+  const uint8_t *data;
+  size_t at, n;
+  for (int i = 0; format_piece(parsed, i, &at, &data, &n); i++) {
+    uint64_t lo = (uint64_t)base + at;
+    uint64_t hi = lo + n; /* exclusive */
+    if (lo < pos)
+      lo = pos;
+    if (hi > (uint64_t)end + 1)
+      hi = (uint64_t)end + 1;
+    if (lo >= hi)
+      continue;
+    crc = crc32_fill(crc, 0xFF, (size_t)(lo - pos));
+    crc = crc32_update(crc, data + (lo - base - at), (size_t)(hi - lo));
+    pos = hi;
+  }
+  return crc32_fill(crc, 0xFF, (size_t)((uint64_t)end + 1 - pos));
+}
+
+/*
+ * Next populated region of an image from *off on, merging data less than
+ * CRC_REGION_GAP apart
+ * Returns: true with the region in [*off, *end), false if only 0xFF is left
+ */
+static bool
+image_next_region(const parsed_file_t *parsed, size_t *off, size_t *end) {
+  size_t size = parsed->size;
+  size_t start = *off + format_first_used(parsed, *off, size - *off);
+  if (start >= size)
+    return false;
+
+  size_t last = start + 1;
+  for (;;) {
+    size_t next = last + format_first_used(parsed, last, size - last);
+    if (next >= size || next - last >= CRC_REGION_GAP)
+      break;
+    last = next + 1;
+  }
+
+  *off = start;
+  *end = last;
+  return true;
+}
+
+/*
+ * Print CRC-32 of each populated region of the file, no device needed
+ */
+static int
+crc_file_offline(const parsed_file_t *parsed, uint32_t base) {
+  size_t off = 0, end;
+  int regions = 0;
+
+  for (; image_next_region(parsed, &off, &end); off = end) {
+    uint32_t crc =
+        crc_of_image(parsed, base, base + (uint32_t)off, base + (uint32_t)(end - 1));
+    printf("  0x%08X-0x%08X  %8zu bytes  CRC-32: 0x%08X\n",
+        base + (uint32_t)off,
+        base + (uint32_t)(end - 1),
+        end - off,
+        crc);
+    regions++;
+  }
+
+  if (regions == 0)
+    printf("  (file is blank)\n");
+
+  return 0;
+}
+
+/*
+ * Extend the overlap of [base, file_end] with an area to whole align units
+ * The config area CRC requires exact boundaries, so it is always taken whole.
+ */
+static void
+crc_area_extent(const ra_area_t *area,
+    uint32_t base,
+    uint32_t file_end,
+    uint32_t align,
+    uint32_t *start_out,
+    uint32_t *end_out) {
+  if (area->koa == KOA_TYPE_CONFIG) {
+    *start_out = area->sad;
+    *end_out = area->ead;
+    return;
+  }
+
+  uint32_t lo = area->sad > base ? area->sad : base;
+  uint32_t hi = area->ead < file_end ? area->ead : file_end;
+  uint32_t end = area->sad + ((hi - area->sad) / align + 1) * align - 1;
+
+  *start_out = area->sad + (lo - area->sad) / align * align;
+  *end_out = end > area->ead ? area->ead : end;
+}
+
+/*
+ * Compare host CRC of the file against the device, one CRC command per area
+ * Returns: number of areas that differ, -1 on error
+ */
+static int
+crc_file_compare(ra_device_t *dev, const parsed_file_t *parsed, uint32_t base) {
+  uint32_t file_end = base + (uint32_t)parsed->size - 1;
+  int checked = 0;
+  int mismatches = 0;
+
+  for (int i = 0; i < MAX_AREAS; i++) {
+    ra_area_t *area = &dev->chip_layout[i];
+    if (area->ead == 0 || area->cau == 0)
+      continue;
+    if (area->ead < base || area->sad > file_end)
+      continue;
+
+    uint32_t start, end;
+    crc_area_extent(area, base, file_end, area->cau, &start, &end);
+
+    uint32_t checked_end;
+    if (set_crc_boundaries(dev, start, end - start + 1, &checked_end) < 0)
+      return -1;
+
+    uint32_t dev_crc;
+    if (crc_query(dev, start, checked_end, &dev_crc) < 0)
+      return -1;
+
+    uint32_t host_crc = crc_of_image(parsed, base, start, checked_end);
+    bool match = host_crc == dev_crc;
+    printf("  %-18s 0x%08X-0x%08X  file: 0x%08X  device: 0x%08X  %s\n",
+        koa_label(area->koa),
+        start,
+        checked_end,
+        host_crc,
+        dev_crc,
+        match ? "OK" : "MISMATCH");
+
+    checked++;
+    if (!match)
+      mismatches++;
+  }
+
+  if (checked == 0) {
+    warnx("no CRC-capable area overlaps with file data (0x%08X - 0x%08X)", base, file_end);
+    return -1;
+  }
+
+  if (mismatches > 0)
+    printf("CRC compare FAILED: %d of %d areas differ\n", mismatches, checked);
+  else
+    printf("CRC compare OK: %d areas match\n", checked);
+  return mismatches;
+}
+
+int
+ra_crc_file(ra_device_t *dev, const char *file, uint32_t start, input_format_t format) {
+  parsed_file_t parsed;
+
+  if (format_parse(file, format, &parsed) < 0)
+    return -1;
+
+  if (parsed.size == 0) {
+    warnx("file is empty: %s", file);
+    free(parsed.data);
+    return -1;
+  }
+
+  /* Use embedded address if available and no explicit address given */
+  uint32_t base = (start == 0 && parsed.has_addr) ? parsed.base_addr : start;
+
+  printf("CRC-32 of %s (%s, %s):\n",
+      file,
+      format_name(format == FORMAT_AUTO ? format_detect(file) : format),
+      crc32_impl_name());
+
+  int ret;
+  if (dev == NULL)
+    ret = crc_file_offline(&parsed, base);
+  else
+    ret = crc_file_compare(dev, &parsed, base) == 0 ? 0 : -1;
+
+  free(parsed.data);
+  return ret;
+}
+
+/* Flash a release fingerprint covers */
+static const struct {
+  uint32_t start, end; /* end is exclusive */
+} ident_windows[] = {
+  { 0,                     ADDR_CODE_FLASH_END },
+  { ADDR_DATA_FLASH_START, ADDR_DATA_FLASH_END },
+};
+
+/*
+ * Fingerprint of a release image: the CRC of each populated region
+ * Regions are cut like crc --file prints them, split between code and data
+ * flash, and widened to RAIDENT_ALIGN with 0xFF. The config area is left out:
+ * its CRC only covers the whole area, which also holds per-board settings.
+ * Returns: 0 on success, -1 if the image has too many regions
+ */
+STATIC int
+ident_fingerprint(const parsed_file_t *parsed, uint32_t base, raident_entry_t *e) {
+  size_t off = 0, end;
+
+  e->nr_ranges = 0;
+  for (; image_next_region(parsed, &off, &end); off = end) {
+    for (size_t w = 0; w < sizeof(ident_windows) / sizeof(ident_windows[0]); w++) {
+      uint64_t lo = (uint64_t)base + off;
+      uint64_t hi = (uint64_t)base + end; /* exclusive */
+
+      if (lo < ident_windows[w].start)
+        lo = ident_windows[w].start;
+      if (hi > ident_windows[w].end)
+        hi = ident_windows[w].end;
+      if (lo >= hi)
+        continue;
+
+      /* A split may leave 0xFF at either end */
+      size_t first = format_first_used(parsed, (size_t)(lo - base), (size_t)(hi - lo));
+      if (first == hi - lo)
+        continue;
+      hi = lo + format_last_used(parsed, (size_t)(lo - base), (size_t)(hi - lo));
+      lo += first;
+
+      if (e->nr_ranges >= RAIDENT_MAX_RANGES) {
+        warnx("image has more than %d populated regions", RAIDENT_MAX_RANGES);
+        return -1;
+      }
+      raident_range_t *r = &e->ranges[e->nr_ranges++];
+      uint32_t start = (uint32_t)lo / RAIDENT_ALIGN * RAIDENT_ALIGN;
+      uint32_t last = (uint32_t)((hi + RAIDENT_ALIGN - 1) / RAIDENT_ALIGN * RAIDENT_ALIGN - 1);
+      r->addr = start;
+      r->size = last - start + 1;
+      r->crc = crc_of_image(parsed, base, start, last);
+    }
+  }
+  return 0;
+}
+
+/* Release name from an image path: file name without directory nor extension */
+static void
+ident_name(const char *file, char *name, size_t len) {
+  const char *p = file;
+
+  for (const char *s = file; *s != '\0'; s++) {
+    if (*s == '/' || *s == path_separator())
+      p = s + 1;
+  }
+  size_t n = strlen(p);
+  const char *dot = strrchr(p, '.');
+  if (dot != NULL && dot != p)
+    n = (size_t)(dot - p);
+  if (n >= len)
+    n = len - 1;
+  for (size_t i = 0; i < n; i++)
+    name[i] = isspace((unsigned char)p[i]) ? '_' : p[i];
+  name[n] = '\0';
+}
+
+int
+ra_identify_add(const char *db_path, const char *file, input_format_t format) {
+  parsed_file_t parsed;
+  raident_entry_t e;
+  raident_db_t db;
+
+  if (format_parse(file, format, &parsed) < 0)
+    return -1;
+  int ret = ident_fingerprint(&parsed, parsed.has_addr ? parsed.base_addr : 0, &e);
+  free(parsed.data);
+  if (ret < 0)
+    return -1;
+  if (e.nr_ranges == 0) {
+    warnx("no code or data flash content in %s", file);
+    return -1;
+  }
+  ident_name(file, e.name, sizeof(e.name));
+
+  if (raident_load(db_path, &db) < 0)
+    return -1;
+  ret = raident_put(&db, &e);
+  if (ret == 0)
+    ret = raident_save(db_path, &db);
+  raident_free(&db);
+  if (ret < 0)
+    return -1;
+
+  printf("Added %s to %s:\n", e.name, db_path);
+  for (uint32_t i = 0; i < e.nr_ranges; i++)
+    printf("  0x%08X-0x%08X  %8u bytes  CRC-32: 0x%08X\n",
+        e.ranges[i].addr,
+        e.ranges[i].addr + e.ranges[i].size - 1,
+        e.ranges[i].size,
+        e.ranges[i].crc);
+  return 0;
+}
+
+/*
+ * Check one fingerprinted range with a single CRC command
+ * The range is extended with 0xFF to whole CRC units of its area.
+ * Returns: 1 if it matches, 0 if not (or not checkable on this device), -1 on error
+ */
+static int
+ident_check_range(ra_device_t *dev, const raident_range_t *r) {
+  int i = find_area_for_address(dev, r->addr);
+  const ra_area_t *area = i < 0 ? NULL : &dev->chip_layout[i];
+  uint32_t cau = area ? area->cau : 0;
+  uint32_t pad = cau ? (cau - r->size % cau) % cau : 0;
+  uint64_t end = (uint64_t)r->addr + r->size - 1 + pad;
+
+  /* CRC units count from the area start, the range must start on one */
+  if (cau == 0 || area->koa == KOA_TYPE_CONFIG || (r->addr - area->sad) % cau != 0 ||
+      end > area->ead) {
+    warnx("range 0x%08X-0x%08X cannot be checked with CRC commands on this device",
+        r->addr,
+        r->addr + r->size - 1);
+    return 0;
+  }
+
+  uint32_t crc;
+  dev->sel_area = i;
+  if (crc_query(dev, r->addr, (uint32_t)end, &crc) < 0)
+    return -1;
+  return crc == crc32_fill(r->crc, 0xFF, pad);
+}
+
+int
+ra_identify(ra_device_t *dev, const char *db_path) {
+  raident_db_t db;
+  int matches = 0;
+  int ret = 0;
+
+  if (raident_load(db_path, &db) < 0)
+    return -1;
+  if (db.count == 0) {
+    warnx("no release in %s (add some with identify --add)", db_path);
+    return -1;
+  }
+
+  /* Releases sharing a range (bootloader, data flash) share its CRC command */
+  for (uint32_t i = 0; i < db.count && ret == 0; i++) {
+    const raident_entry_t *e = &db.entries[i];
+    int match = 1;
+
+    for (uint32_t r = 0; r < e->nr_ranges && match == 1; r++)
+      match = ident_check_range(dev, &e->ranges[r]);
+    if (match < 0) {
+      ret = -1;
+    } else if (match) {
+      printf("%s\n", e->name);
+      matches++;
+    }
+  }
+  raident_free(&db);
+
+  if (ret == 0 && matches == 0)
+    printf("unknown\n");
+  return ret;
+}
+
+/*
+ * Diff bisection state
+ * leaf: what to do with a unit whose CRC differs (diff: record the bytes,
+ * incremental backup: read it into the image)
+ */
+typedef struct diff_ctx {
+  ra_device_t *dev;
+  const parsed_file_t *parsed;
+  uint32_t base;
+  int (*leaf)(struct diff_ctx *ctx, uint32_t start, uint32_t end);
+  ra_range_t *ranges;
+  size_t count;
+  uint32_t crc_cmds;
+  uint32_t bytes_read;
+} diff_ctx_t;
+
+STATIC uint32_t
+diff_split(uint32_t start, uint32_t end, uint32_t unit) {
+  uint32_t half = ((end - start + 1) / unit) / 2;
+
+  if (half == 0)
+    half = 1;
+  return start + half * unit;
+}
+
+STATIC int
+diff_collect(const uint8_t *expected,
+    const uint8_t *actual,
+    size_t len,
+    uint32_t addr,
+    ra_range_t **ranges,
+    size_t *count) {
+  size_t pos = 0;
+
+  while (pos < len) {
+    pos += rabuf_mismatch(expected + pos, actual + pos, len - pos);
+    if (pos >= len)
+      break;
+
+    size_t run = pos;
+    while (run < len && expected[run] != actual[run])
+      run++;
+
+    uint32_t rstart = addr + (uint32_t)pos;
+    uint32_t rend = addr + (uint32_t)run - 1;
+
+    if (*count > 0 && (*ranges)[*count - 1].end + 1 == rstart) {
+      (*ranges)[*count - 1].end = rend;
+    } else {
+      ra_range_t *grown = realloc(*ranges, (*count + 1) * sizeof(**ranges));
+      if (grown == NULL)
+        return -1;
+      *ranges = grown;
+      (*ranges)[*count].start = rstart;
+      (*ranges)[*count].end = rend;
+      (*count)++;
+    }
+    pos = run;
+  }
+
+  return 0;
+}
+
+/*
+ * Read back a leaf block and record the exact differing bytes
+ */
+static int
+diff_leaf(diff_ctx_t *ctx, uint32_t start, uint32_t end) {
+  size_t size = (size_t)(end - start) + 1;
+  uint32_t file_end = ctx->base + (uint32_t)ctx->parsed->size - 1;
+  uint32_t read_end;
+
+  if (set_read_boundaries(ctx->dev, start, (uint32_t)size, &read_end) < 0)
+    return -1;
+
+  uint8_t *expected = malloc(size);
+  uint8_t *actual = malloc(size);
+  if (expected == NULL || actual == NULL) {
+    warnx("memory allocation failed");
+    free(expected);
+    free(actual);
+    return -1;
+  }
+
+  memset(expected, 0xFF, size);
+  if (end >= ctx->base && start <= file_end) {
+    uint32_t lo = start > ctx->base ? start : ctx->base;
+    uint32_t hi = end < file_end ? end : file_end;
+    format_copy(ctx->parsed, lo - ctx->base, expected + (lo - start), hi - lo + 1);
+  }
+
+  int ret = read_range_into(ctx->dev, start, actual, size, NULL, "diff read");
+  if (ret == 0) {
+    ctx->bytes_read += (uint32_t)size;
+    ret = diff_collect(expected, actual, size, start, &ctx->ranges, &ctx->count);
+    if (ret < 0)
+      warnx("memory allocation failed");
+  }
+
+  free(expected);
+  free(actual);
+  return ret;
+}
+
+/*
+ * Bisect [start, end] on unit boundaries
+ * known_diff: caller already knows this range differs (sibling matched)
+ * Returns: 1 if the range differs, 0 if identical, -1 on error
+ */
+static int
+diff_range(diff_ctx_t *ctx, uint32_t start, uint32_t end, uint32_t unit, bool known_diff) {
+  if (!known_diff) {
+    uint32_t checked_end, dev_crc;
+
+    if (set_crc_boundaries(ctx->dev, start, end - start + 1, &checked_end) < 0)
+      return -1;
+    if (crc_query(ctx->dev, start, end, &dev_crc) < 0)
+      return -1;
+    ctx->crc_cmds++;
+
+    if (dev_crc == crc_of_image(ctx->parsed, ctx->base, start, end))
+      return 0;
+  }
+
+  if (end - start + 1 <= unit)
+    return ctx->leaf(ctx, start, end) < 0 ? -1 : 1;
+
+  uint32_t mid = diff_split(start, end, unit);
+  int lower = diff_range(ctx, start, mid - 1, unit, false);
+  if (lower < 0)
+    return -1;
+
+  /* If the lower half matches, the difference must be in the upper half */
+  if (diff_range(ctx, mid, end, unit, lower == 0) < 0)
+    return -1;
+
+  return 1;
+}
+
+int
+ra_diff(ra_device_t *dev, const char *file, uint32_t start, input_format_t format) {
+  parsed_file_t parsed;
+  diff_ctx_t ctx;
+
+  if (format_parse(file, format, &parsed) < 0)
+    return -1;
+
+  if (parsed.size == 0) {
+    warnx("file is empty: %s", file);
+    free(parsed.data);
+    return -1;
+  }
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.dev = dev;
+  ctx.parsed = &parsed;
+  ctx.leaf = diff_leaf;
+  ctx.base = (start == 0 && parsed.has_addr) ? parsed.base_addr : start;
+
+  uint32_t file_end = ctx.base + (uint32_t)parsed.size - 1;
+  uint32_t total_bytes = 0;
+  int areas = 0;
+  int ret = 0;
+
+  printf("Diff of %s against device:\n", file);
+
+  for (int i = 0; i < MAX_AREAS; i++) {
+    ra_area_t *area = &dev->chip_layout[i];
+    if (area->ead == 0 || area->cau == 0)
+      continue;
+    if (area->ead < ctx.base || area->sad > file_end)
+      continue;
+
+    /* Bisect on erase blocks so that the map lines up with what can be rewritten */
+    uint32_t unit = area->eau > area->cau ? area->eau : area->cau;
+    uint32_t astart, aend;
+    crc_area_extent(area, ctx.base, file_end, unit, &astart, &aend);
+    if (area->koa == KOA_TYPE_CONFIG)
+      unit = aend - astart + 1;
+
+    size_t first = ctx.count;
+    int differs = diff_range(&ctx, astart, aend, unit, false);
+    if (differs < 0) {
+      ret = -1;
+      break;
+    }
+    areas++;
+
+    uint32_t area_bytes = 0;
+    for (size_t r = first; r < ctx.count; r++)
+      area_bytes += ctx.ranges[r].end - ctx.ranges[r].start + 1;
+    total_bytes += area_bytes;
+
+    if (ctx.count == first) {
+      printf("  %-18s 0x%08X-0x%08X  identical\n", koa_label(area->koa), astart, aend);
+      continue;
+    }
+
+    printf("  %-18s 0x%08X-0x%08X  differs: %zu ranges, %u bytes\n",
+        koa_label(area->koa),
+        astart,
+        aend,
+        ctx.count - first,
+        area_bytes);
+    for (size_t r = first; r < ctx.count; r++) {
+      printf("    0x%08X-0x%08X  %u bytes\n",
+          ctx.ranges[r].start,
+          ctx.ranges[r].end,
+          ctx.ranges[r].end - ctx.ranges[r].start + 1);
+    }
+  }
+
+  if (ret == 0 && areas == 0) {
+    warnx("no CRC-capable area overlaps with file data (0x%08X - 0x%08X)", ctx.base, file_end);
+    ret = -1;
+  } else if (ret == 0 && ctx.count > 0) {
+    printf("Diff: %u bytes differ in %zu ranges (%u CRC commands, %u bytes read back)\n",
+        total_bytes,
+        ctx.count,
+        ctx.crc_cmds,
+        ctx.bytes_read);
+    ret = -1;
+  } else if (ret == 0) {
+    printf("Diff: flash matches file (%u CRC commands)\n", ctx.crc_cmds);
+  }
+
+  free(ctx.ranges);
+  free(parsed.data);
+  return ret;
+}
+
+/* DLM state code definitions */
+static const struct {
+  uint8_t code;
+  const char *name;
+  const char *desc;
+} dlm_states[] = {
+  { DLM_STATE_CM,       "CM",       "Chip Manufacturing"                         },
+  { DLM_STATE_SSD,      "SSD",      "Secure Software Development"                },
+  { DLM_STATE_NSECSD,   "NSECSD",   "Non-Secure Software Development"            },
+  { DLM_STATE_DPL,      "DPL",      "Deployed"                                   },
+  { DLM_STATE_LCK_DBG,  "LCK_DBG",  "Locked Debug"                               },
+  { DLM_STATE_LCK_BOOT, "LCK_BOOT", "Locked Boot Interface"                      },
+  { DLM_STATE_RMA_REQ,  "RMA_REQ",  "Return Material Authorization Request"      },
+  { DLM_STATE_RMA_ACK,  "RMA_ACK",  "Return Material Authorization Acknowledged" },
+  { 0,                  NULL,       NULL                                         },
+};
+
+const char *
+ra_dlm_state_name(uint8_t code) {
+  for (size_t i = 0; dlm_states[i].name != NULL; i++) {
+    if (dlm_states[i].code == code)
+      return dlm_states[i].name;
+  }
+  return "UNKNOWN";
+}
 
 static const char *
 dlm_state_desc(uint8_t code) {
@@ -1418,14 +2309,14 @@ ra_get_dlm(ra_device_t *dev, uint8_t *dlm_out) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7) {
     warnx("short response for DLM state request");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "DLM state") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "DLM state") < 0)
     return -1;
 
   if (data_len < 1) {
@@ -1462,14 +2353,14 @@ ra_dlm_transit(ra_device_t *dev, uint8_t dest_dlm) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7) {
     warnx("short response for DLM state request");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "DLM state") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "DLM state") < 0)
     return -1;
 
   if (data_len < 1) {
@@ -1500,6 +2391,7 @@ ra_dlm_transit(ra_device_t *dev, uint8_t dest_dlm) {
   data[0] = current_dlm; /* SDLM: source DLM state */
   data[1] = dest_dlm;    /* DDLM: destination DLM state */
 
+  ra_cache_invalidate_all(dev->cache);
   pkt_len = ra_pack_pkt(pkt, sizeof(pkt), DLM_TRANSIT_CMD, data, 2, false);
   if (pkt_len < 0)
     return -1;
@@ -1508,7 +2400,7 @@ ra_dlm_transit(ra_device_t *dev, uint8_t dest_dlm) {
     return -1;
 
   /* DLM transit may involve flash writes */
-  n = ra_recv(dev, resp, sizeof(resp), 5000);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 5000);
   if (n < 7) {
     /* If transitioning to LCK_BOOT, device won't respond after sending OK */
     if (dest_dlm == DLM_STATE_LCK_BOOT) {
@@ -1519,7 +2411,7 @@ ra_dlm_transit(ra_device_t *dev, uint8_t dest_dlm) {
     return -1;
   }
 
-  if (unpack_with_error(resp, n, resp_data, &data_len, "DLM transit") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "DLM transit") < 0)
     return -1;
 
   printf("DLM transit complete: %s -> %s\n",
@@ -1551,14 +2443,14 @@ ra_get_boundary(ra_device_t *dev, ra_boundary_t *bnd_out) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7) {
     warnx("short response for boundary request");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "boundary") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "boundary") < 0)
     return -1;
 
   /* Response: CFS1(2) + CFS2(2) + DFS1(2) + SRS1(2) + SRS2(2) = 10 bytes */
@@ -1642,6 +2534,7 @@ ra_set_boundary(ra_device_t *dev, const ra_boundary_t *bnd) {
   uint16_to_be(bnd->srs1, &data[6]);
   uint16_to_be(bnd->srs2, &data[8]);
 
+  ra_cache_invalidate_all(dev->cache);
   pkt_len = ra_pack_pkt(pkt, sizeof(pkt), BND_SET_CMD, data, 10, false);
   if (pkt_len < 0)
     return -1;
@@ -1650,14 +2543,14 @@ ra_set_boundary(ra_device_t *dev, const ra_boundary_t *bnd) {
     return -1;
 
   /* Boundary setting involves flash writes */
-  n = ra_recv(dev, resp, sizeof(resp), 5000);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 5000);
   if (n < 7) {
     warnx("short response for boundary setting");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "boundary setting") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "boundary setting") < 0)
     return -1;
 
   printf("Boundary settings stored successfully\n");
@@ -1680,14 +2573,14 @@ ra_get_param(ra_device_t *dev, uint8_t param_id, uint8_t *value_out) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7) {
     warnx("short response for parameter request");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "parameter") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "parameter") < 0)
     return -1;
 
   if (data_len < 1) {
@@ -1746,6 +2639,7 @@ ra_set_param(ra_device_t *dev, uint8_t param_id, uint8_t value) {
   data[0] = param_id;
   data[1] = value;
 
+  ra_cache_invalidate_all(dev->cache);
   pkt_len = ra_pack_pkt(pkt, sizeof(pkt), PRM_SET_CMD, data, 2, false);
   if (pkt_len < 0)
     return -1;
@@ -1754,14 +2648,14 @@ ra_set_param(ra_device_t *dev, uint8_t param_id, uint8_t value) {
     return -1;
 
   /* Parameter setting may involve flash writes */
-  n = ra_recv(dev, resp, sizeof(resp), 5000);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 5000);
   if (n < 7) {
     warnx("short response for parameter setting");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "parameter setting") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "parameter setting") < 0)
     return -1;
 
   printf("Parameter set successfully\n");
@@ -1785,14 +2679,14 @@ ra_initialize(ra_device_t *dev) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7) {
     warnx("short response for DLM state request");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "DLM state") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "DLM state") < 0)
     return -1;
 
   if (data_len < 1) {
@@ -1826,6 +2720,7 @@ ra_initialize(ra_device_t *dev) {
   data[0] = current_dlm;   /* SDLM: source DLM state */
   data[1] = DLM_STATE_SSD; /* DDLM: destination DLM state (always SSD) */
 
+  ra_cache_invalidate_all(dev->cache);
   pkt_len = ra_pack_pkt(pkt, sizeof(pkt), INI_CMD, data, 2, false);
   if (pkt_len < 0)
     return -1;
@@ -1834,13 +2729,13 @@ ra_initialize(ra_device_t *dev) {
     return -1;
 
   /* Initialize can take a long time due to flash erase */
-  n = ra_recv(dev, resp, sizeof(resp), 30000);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 30000);
   if (n < 7) {
     warnx("short response for initialize command");
     return -1;
   }
 
-  if (unpack_with_error(resp, n, resp_data, &data_len, "initialize") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "initialize") < 0)
     return -1;
 
   printf("Initialize complete: %s -> SSD\n", ra_dlm_state_name(current_dlm));
@@ -1866,6 +2761,7 @@ ra_key_set(ra_device_t *dev, uint8_t key_index, const uint8_t *wrapped_key, size
   data[0] = key_index;
   memcpy(&data[1], wrapped_key, key_len);
 
+  ra_cache_invalidate_all(dev->cache);
   pkt_len = ra_pack_pkt(pkt, sizeof(pkt), KEY_CMD, data, 1 + key_len, false);
   if (pkt_len < 0)
     return -1;
@@ -1874,14 +2770,14 @@ ra_key_set(ra_device_t *dev, uint8_t key_index, const uint8_t *wrapped_key, size
     return -1;
 
   /* Key setting involves flash writes */
-  n = ra_recv(dev, resp, sizeof(resp), 5000);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 5000);
   if (n < 7) {
     warnx("short response for key setting");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "key setting") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "key setting") < 0)
     return -1;
 
   printf("Key set successfully at index %u\n", key_index);
@@ -1905,14 +2801,14 @@ ra_key_verify(ra_device_t *dev, uint8_t key_index, int *valid_out) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 1000);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 1000);
   if (n < 7) {
     warnx("short response for key verify");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "key verify") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "key verify") < 0)
     return -1;
 
   /* Response contains KVST (key verification status): STATUS_OK = valid */
@@ -1948,6 +2844,7 @@ ra_ukey_set(ra_device_t *dev, uint8_t key_index, const uint8_t *wrapped_key, siz
   data[0] = key_index;
   memcpy(&data[1], wrapped_key, key_len);
 
+  ra_cache_invalidate_all(dev->cache);
   pkt_len = ra_pack_pkt(pkt, sizeof(pkt), UKEY_CMD, data, 1 + key_len, false);
   if (pkt_len < 0)
     return -1;
@@ -1956,14 +2853,14 @@ ra_ukey_set(ra_device_t *dev, uint8_t key_index, const uint8_t *wrapped_key, siz
     return -1;
 
   /* Key setting involves flash writes */
-  n = ra_recv(dev, resp, sizeof(resp), 5000);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 5000);
   if (n < 7) {
     warnx("short response for user key setting");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "user key setting") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "user key setting") < 0)
     return -1;
 
   printf("User key set successfully at index %u\n", key_index);
@@ -1987,14 +2884,14 @@ ra_ukey_verify(ra_device_t *dev, uint8_t key_index, int *valid_out) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 1000);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 1000);
   if (n < 7) {
     warnx("short response for user key verify");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "user key verify") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "user key verify") < 0)
     return -1;
 
   /* Response contains KVST (key verification status): STATUS_OK = valid */
@@ -2062,14 +2959,14 @@ ra_dlm_auth(ra_device_t *dev, uint8_t dest_dlm, const uint8_t *key) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7) {
     warnx("short response for DLM state request");
     return -1;
   }
 
   size_t data_len;
-  if (unpack_with_error(resp, n, resp_data, &data_len, "DLM state") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "DLM state") < 0)
     return -1;
 
   if (data_len < 1) {
@@ -2129,6 +3026,7 @@ ra_dlm_auth(ra_device_t *dev, uint8_t dest_dlm, const uint8_t *key) {
   data[1] = dest_dlm;    /* DDLM: destination DLM state */
   data[2] = 0x00;        /* CHCT: use random challenge */
 
+  ra_cache_invalidate_all(dev->cache);
   pkt_len = ra_pack_pkt(pkt, sizeof(pkt), DLM_AUTH_CMD, data, 3, false);
   if (pkt_len < 0)
     return -1;
@@ -2137,14 +3035,14 @@ ra_dlm_auth(ra_device_t *dev, uint8_t dest_dlm, const uint8_t *key) {
     return -1;
 
   /* Receive challenge (16 bytes) */
-  n = ra_recv(dev, resp, sizeof(resp), 5000);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 5000);
   if (n < 7) {
     warnx("short response for authentication challenge");
     return -1;
   }
 
   uint8_t challenge[16];
-  if (unpack_with_error(resp, n, challenge, &data_len, "challenge") < 0)
+  if (ra_unpack_with_error(resp, n, challenge, &data_len, "challenge") < 0)
     return -1;
 
   if (data_len < 16) {
@@ -2194,13 +3092,13 @@ ra_dlm_auth(ra_device_t *dev, uint8_t dest_dlm, const uint8_t *key) {
 
   /* Receive final status - may take time for RMA_REQ (flash erase) */
   int timeout = (dest_dlm == DLM_STATE_RMA_REQ) ? 30000 : 5000;
-  n = ra_recv(dev, resp, sizeof(resp), timeout);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), timeout);
   if (n < 7) {
     warnx("short response for authentication result");
     return -1;
   }
 
-  if (unpack_with_error(resp, n, resp_data, &data_len, "authentication") < 0)
+  if (ra_unpack_with_error(resp, n, resp_data, &data_len, "authentication") < 0)
     return -1;
 
   printf("DLM authentication successful: %s -> %s\n",
@@ -2210,6 +3108,184 @@ ra_dlm_auth(ra_device_t *dev, uint8_t dest_dlm, const uint8_t *key) {
 #endif /* HAVE_OPENSSL */
 }
 
+/*
+ * Flash content the status, config and FM2APP reports decode
+ *
+ * Either a live device (reads and CRC blank probes over the link) or a
+ * backup file loaded in memory. dev always gives the area table; the one
+ * of a backup view is built from the file and is never opened.
+ */
+typedef struct flash_view {
+  ra_device_t *dev;
+  const parsed_file_t *image; /* Backup content, NULL for a live device */
+  /* Returns: 0 on success, -1 on error */
+  int (*read)(const struct flash_view *v, uint32_t addr, uint8_t *buf, size_t len);
+  /* Returns: 1 if [start, end] is erased, 0 if not or unknown, -1 on error */
+  int (*blank)(const struct flash_view *v, uint32_t start, uint32_t end);
+} flash_view_t;
+
+static int
+device_view_read(const flash_view_t *v, uint32_t addr, uint8_t *buf, size_t len) {
+  return read_range_into(v->dev, addr, buf, len, NULL, NULL);
+}
+
+static int
+device_view_blank(const flash_view_t *v, uint32_t start, uint32_t end) {
+  return crc_probe_blank(v->dev, start, end);
+}
+
+/* Outside the loaded ranges a backup reads as erased flash */
+static int
+image_view_read(const flash_view_t *v, uint32_t addr, uint8_t *buf, size_t len) {
+  const parsed_file_t *p = v->image;
+  uint64_t lo = addr > p->base_addr ? addr : p->base_addr;
+  uint64_t hi = (uint64_t)addr + len;
+
+  if (hi > (uint64_t)p->base_addr + p->size)
+    hi = (uint64_t)p->base_addr + p->size;
+  memset(buf, 0xFF, len);
+  if (lo < hi)
+    format_copy(p, (size_t)(lo - p->base_addr), buf + (lo - addr), (size_t)(hi - lo));
+  return 0;
+}
+
+static int
+image_view_blank(const flash_view_t *v, uint32_t start, uint32_t end) {
+  const parsed_file_t *p = v->image;
+  uint64_t file_end = (uint64_t)p->base_addr + p->size - 1;
+
+  if (p->size == 0 || end < p->base_addr || start > file_end)
+    return 1;
+  uint32_t lo = start > p->base_addr ? start : p->base_addr;
+  uint32_t hi = end < file_end ? end : (uint32_t)file_end;
+  size_t len = (size_t)(hi - lo) + 1;
+  return format_first_used(p, lo - p->base_addr, len) == len;
+}
+
+static void
+device_view_init(flash_view_t *v, ra_device_t *dev) {
+  v->dev = dev;
+  v->image = NULL;
+  v->read = device_view_read;
+  v->blank = device_view_blank;
+}
+
+/* A backup file opened for offline reports */
+typedef struct {
+  ra_device_t dev; /* Area table and signature only */
+  parsed_file_t image;
+  flash_view_t view;
+} backup_view_t;
+
+/*
+ * Area table of a HEX/S-record/binary backup, which carries none
+ * Covered ranges are sorted into code flash, data flash and config area by
+ * address; each kind becomes one area spanning its ranges. Unknown erase and
+ * CRC units make the scans walk the image in CHUNK_SIZE steps.
+ * Returns: number of areas filled
+ */
+STATIC int
+backup_view_layout(const parsed_file_t *parsed, ra_area_t *areas) {
+  static const struct {
+    uint8_t koa;
+    uint32_t start, end; /* end is exclusive */
+  } kinds[] = {
+    { KOA_TYPE_CODE,   0,                     ADDR_CODE_FLASH_END },
+    { KOA_TYPE_DATA,   ADDR_DATA_FLASH_START, ADDR_DATA_FLASH_END },
+    { KOA_TYPE_CONFIG, ADDR_CONFIG_START,     ADDR_CONFIG_END     },
+  };
+  format_extent_t whole = { parsed->base_addr, (uint32_t)parsed->size, NULL };
+  const format_extent_t *ext = parsed->nr_extents > 0 ? parsed->extents : &whole;
+  int nr_ext = parsed->nr_extents > 0 ? parsed->nr_extents : 1;
+  int count = 0;
+
+  for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+    ra_area_t *a = &areas[count];
+    bool found = false;
+
+    for (int i = 0; i < nr_ext; i++) {
+      if (ext[i].size == 0 || ext[i].addr < kinds[k].start || ext[i].addr >= kinds[k].end)
+        continue;
+      uint32_t last = ext[i].addr + ext[i].size - 1;
+      if (!found || ext[i].addr < a->sad)
+        a->sad = ext[i].addr;
+      if (!found || last > a->ead)
+        a->ead = last;
+      found = true;
+    }
+    if (found) {
+      a->koa = kinds[k].koa;
+      a->eau = a->wau = a->cau = 0;
+      a->rau = 1;
+      count++;
+    }
+  }
+  return count;
+}
+
+/*
+ * Load a backup (Intel HEX, S-record, binary or native .rbk) for offline reports
+ * A native backup brings the device signature and area table it was taken
+ * with; other formats only the address ranges they cover.
+ * Returns: 0 on success, -1 on error
+ */
+static int
+backup_view_open(const char *file, input_format_t format, backup_view_t *b) {
+  if (format == FORMAT_AUTO)
+    format = format_detect(file);
+  if (format == FORMAT_RFI) {
+    warnx("%s: a compiled image is not a backup", file);
+    return -1;
+  }
+
+  ra_dev_init(&b->dev);
+  if (format == FORMAT_RBK) {
+    rbk_t rbk;
+    if (rbk_open(file, &rbk) < 0)
+      return -1;
+    for (uint32_t i = 0; i < rbk.nr_areas; i++)
+      b->dev.chip_layout[i] = rbk.areas[i].area;
+    b->dev.noa = (uint8_t)rbk.nr_areas;
+    memcpy(b->dev.sig, rbk.sig, rbk.sig_len);
+    b->dev.sig_len = rbk.sig_len;
+    rbk_close(&rbk);
+  }
+
+  if (format_parse(file, format, &b->image) < 0)
+    return -1;
+  if (b->dev.noa == 0) {
+    /* HEX and S-record gaps read as 0xFF: areas come from the records */
+    parsed_file_t covered = b->image;
+    int n = covered.nr_extents == 0 ? format_ranges(file,
+                                          format,
+                                          FORMAT_RANGE_GAP,
+                                          covered.extents,
+                                          FORMAT_MAX_EXTENTS)
+                                    : -1;
+    if (n > 0)
+      covered.nr_extents = n;
+    b->dev.noa = (uint8_t)backup_view_layout(&covered, b->dev.chip_layout);
+  }
+  if (b->dev.noa == 0) {
+    warnx("%s: no flash content", file);
+    free(b->image.data);
+    return -1;
+  }
+  b->dev.layout_valid = true;
+
+  b->view.dev = &b->dev;
+  b->view.image = &b->image;
+  b->view.read = image_view_read;
+  b->view.blank = image_view_blank;
+  return 0;
+}
+
+static void
+backup_view_close(backup_view_t *b) {
+  free(b->image.data);
+  b->image.data = NULL;
+}
+
 /*
  * Find config area in chip layout
  * Returns area index, or -1 if not found
@@ -2265,13 +3341,7 @@ print_block_protection(const char *label, const uint8_t *bps, size_t len, bool i
   int total = (int)(len * 8);
 
   /* Check if all 0xFF (no protection) */
-  bool all_ff = true;
-  for (size_t i = 0; i < len; i++) {
-    if (bps[i] != 0xFF) {
-      all_ff = false;
-      break;
-    }
-  }
+  bool all_ff = rabuf_is_blank(bps, len);
 
   if (all_ff) {
     printf("  %s: none %s\n",
@@ -2306,128 +3376,45 @@ print_block_protection(const char *label, const uint8_t *bps, size_t len, bool i
  * Print hex dump with ASCII representation
  */
 static void
-hexdump(const uint8_t *data, size_t len, uint32_t base_addr) {
-  for (size_t i = 0; i < len; i += 16) {
-    printf("  %08X: ", base_addr + (uint32_t)i);
-
-    /* Hex bytes */
-    for (size_t j = 0; j < 16; j++) {
-      if (i + j < len)
-        printf("%02X ", data[i + j]);
-      else
-        printf("   ");
-      if (j == 7)
-        printf(" ");
-    }
-
-    /* ASCII */
-    printf(" |");
-    for (size_t j = 0; j < 16 && i + j < len; j++) {
-      uint8_t c = data[i + j];
-      printf("%c", (c >= 0x20 && c <= 0x7E) ? c : '.');
-    }
-    printf("|\n");
-  }
-}
-
-int
-ra_config_read(ra_device_t *dev) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[CHUNK_SIZE + 6];
-  uint8_t chunk[CHUNK_SIZE];
-  uint8_t data[8];
-  ssize_t pkt_len, n;
-
-  /* Ensure chip layout is populated */
-  if (ra_get_area_info(dev, false) < 0)
-    return -1;
-
-  /* Find config area */
-  int area = find_config_area(dev);
-  if (area < 0) {
-    warnx("config area not found in chip layout");
-    return -1;
-  }
-
-  uint32_t sad = dev->chip_layout[area].sad;
-  uint32_t ead = dev->chip_layout[area].ead;
-  uint32_t rau = dev->chip_layout[area].rau;
-
-  if (rau == 0) {
-    warnx("config area does not support read operations");
-    return -1;
-  }
-
-  uint32_t size = ead - sad + 1;
-  printf("Config Area (0x%08X - 0x%08X, %u bytes):\n\n", sad, ead, size);
-
-  /* Allocate buffer for config data */
-  uint8_t *config = malloc(size);
-  if (!config) {
-    warnx("failed to allocate config buffer");
-    return -1;
-  }
-
-  /* Set read boundaries */
-  dev->sel_area = area;
-
-  /*
-   * WORKAROUND: Use single-packet reads (<=1024 bytes each) to avoid
-   * multi-packet ACK protocol issue. See protocol.md for details.
-   */
-  uint32_t nr_chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
-  uint32_t current_addr = sad;
-  size_t offset = 0;
-
-  for (uint32_t i = 0; i < nr_chunks; i++) {
-    /* Calculate chunk boundaries (single-packet read) */
-    uint32_t chunk_start = current_addr;
-    uint32_t remaining = ead - chunk_start + 1;
-    uint32_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
-    uint32_t chunk_end = chunk_start + chunk_size - 1;
-
-    /* Send single-packet READ command */
-    uint32_to_be(chunk_start, &data[0]);
-    uint32_to_be(chunk_end, &data[4]);
-
-    pkt_len = ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, data, 8, false);
-    if (pkt_len < 0) {
-      free(config);
-      return -1;
-    }
-
-    if (ra_send(dev, pkt, pkt_len) < 0) {
-      free(config);
-      return -1;
-    }
+hexdump(const uint8_t *data, size_t len, uint32_t base_addr) {
+  for (size_t i = 0; i < len; i += 16) {
+    printf("  %08X: ", base_addr + (uint32_t)i);
 
-    /* Receive single data packet */
-    n = ra_recv(dev, resp, CHUNK_SIZE + 6, 2000);
-    if (n < 7) {
-      warnx("short response during config read");
-      free(config);
-      return -1;
+    /* Hex bytes */
+    for (size_t j = 0; j < 16; j++) {
+      if (i + j < len)
+        printf("%02X ", data[i + j]);
+      else
+        printf("   ");
+      if (j == 7)
+        printf(" ");
     }
 
-    size_t chunk_len;
-    if (unpack_with_error(resp, n, chunk, &chunk_len, "config read") < 0) {
-      free(config);
-      return -1;
+    /* ASCII */
+    printf(" |");
+    for (size_t j = 0; j < 16 && i + j < len; j++) {
+      uint8_t c = data[i + j];
+      printf("%c", (c >= 0x20 && c <= 0x7E) ? c : '.');
     }
-
-    memcpy(config + offset, chunk, chunk_len);
-    offset += chunk_len;
-    current_addr += chunk_size;
+    printf("|\n");
   }
+}
+
+/*
+ * Decode and dump the config area content read at sad
+ */
+static void
+config_report(const uint8_t *config, uint32_t sad, uint32_t size) {
+  printf("Config Area (0x%08X - 0x%08X, %u bytes):\n\n", sad, sad + size - 1, size);
 
   /* Analyze config area */
-  int all_ff = 1;
+  int all_ff = rabuf_is_blank(config, size);
   int all_zero = 1;
-  for (size_t i = 0; i < size; i++) {
-    if (config[i] != 0xFF)
-      all_ff = 0;
-    if (config[i] != 0x00)
+  for (size_t i = 0; i < size && !all_ff; i++) {
+    if (config[i] != 0x00) {
       all_zero = 0;
+      break;
+    }
   }
 
   if (all_ff) {
@@ -2469,8 +3456,79 @@ ra_config_read(ra_device_t *dev) {
   /* Display hex dump */
   printf("Raw contents:\n");
   hexdump(config, size, sad);
+}
+
+int
+ra_config_read(ra_device_t *dev) {
+  /* Ensure chip layout is populated */
+  if (ra_get_area_info(dev, false) < 0)
+    return -1;
+
+  /* Find config area */
+  int area = find_config_area(dev);
+  if (area < 0) {
+    warnx("config area not found in chip layout");
+    return -1;
+  }
+
+  uint32_t sad = dev->chip_layout[area].sad;
+  uint32_t ead = dev->chip_layout[area].ead;
+  uint32_t rau = dev->chip_layout[area].rau;
+
+  if (rau == 0) {
+    warnx("config area does not support read operations");
+    return -1;
+  }
+
+  uint32_t size = ead - sad + 1;
+
+  /* Allocate buffer for config data */
+  uint8_t *config = malloc(size);
+  if (!config) {
+    warnx("failed to allocate config buffer");
+    return -1;
+  }
+
+  /* Set read boundaries */
+  dev->sel_area = area;
 
+  if (read_range_into(dev, sad, config, size, NULL, "config read") < 0) {
+    free(config);
+    return -1;
+  }
+
+  config_report(config, sad, size);
+  free(config);
+  return 0;
+}
+
+int
+ra_config_read_file(const char *file, input_format_t format) {
+  backup_view_t b;
+
+  if (backup_view_open(file, format, &b) < 0)
+    return -1;
+
+  int area = find_config_area(&b.dev);
+  if (area < 0) {
+    warnx("%s: no config area in the backup", file);
+    backup_view_close(&b);
+    return -1;
+  }
+
+  uint32_t sad = b.dev.chip_layout[area].sad;
+  uint32_t size = b.dev.chip_layout[area].ead - sad + 1;
+  uint8_t *config = malloc(size);
+  if (config == NULL) {
+    warnx("failed to allocate config buffer");
+    backup_view_close(&b);
+    return -1;
+  }
+
+  image_view_read(&b.view, sad, config, size);
+  config_report(config, sad, size);
   free(config);
+  backup_view_close(&b);
   return 0;
 }
 
@@ -2670,78 +3728,201 @@ status_build_flash_bar(char *bar_buf,
   }
 }
 
+#define MCUBOOT_IMAGE_MAGIC 0x96f3b83d
+#define MCUBOOT_HEADER_SIZE 32
+#define MCUBOOT_SCAN_STEP 4096 /* common minimum slot alignment */
+
+/* One probe block seen by the usage scan */
+typedef struct {
+  uint32_t start;
+  uint32_t end;
+  uint32_t last_used; /* offset past the last non-0xFF byte, 0 if erased */
+} flash_block_t;
+
+/* MCUboot header candidate (magic matched) seen while reading a block */
+typedef struct {
+  uint32_t addr;
+  uint8_t hdr[MCUBOOT_HEADER_SIZE];
+} mcuboot_hit_t;
+
+/*
+ * What the usage scan learned about code flash, so that the MCUboot and
+ * region scans that follow need few or no extra transfers
+ */
+typedef struct {
+  uint32_t hdr_base; /* origin of the MCUboot header stride */
+  flash_block_t *blocks;
+  size_t nr_blocks;
+  mcuboot_hit_t *hits;
+  size_t nr_hits;
+} flash_scan_t;
+
+static void
+flash_scan_free(flash_scan_t *scan) {
+  free(scan->blocks);
+  free(scan->hits);
+  scan->blocks = NULL;
+  scan->hits = NULL;
+  scan->nr_blocks = 0;
+  scan->nr_hits = 0;
+}
+
+static void
+flash_scan_add_block(flash_scan_t *scan, uint32_t start, uint32_t end, uint32_t last_used) {
+  flash_block_t *grown = realloc(scan->blocks, (scan->nr_blocks + 1) * sizeof(*grown));
+  if (grown == NULL)
+    return; /* lookups then fall back to device access */
+
+  scan->blocks = grown;
+  scan->blocks[scan->nr_blocks].start = start;
+  scan->blocks[scan->nr_blocks].end = end;
+  scan->blocks[scan->nr_blocks].last_used = last_used;
+  scan->nr_blocks++;
+}
+
+/*
+ * Record the MCUboot header candidates of a chunk read at addr
+ */
+static void
+flash_scan_add_hits(flash_scan_t *scan, uint32_t addr, const uint8_t *buf, size_t len) {
+  uint32_t off = (MCUBOOT_SCAN_STEP - (addr - scan->hdr_base) % MCUBOOT_SCAN_STEP) %
+                 MCUBOOT_SCAN_STEP;
+
+  for (; off + MCUBOOT_HEADER_SIZE <= len; off += MCUBOOT_SCAN_STEP) {
+    const uint8_t *p = buf + off;
+    uint32_t magic = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    if (magic != MCUBOOT_IMAGE_MAGIC)
+      continue;
+
+    mcuboot_hit_t *grown = realloc(scan->hits, (scan->nr_hits + 1) * sizeof(*grown));
+    if (grown == NULL)
+      return;
+    scan->hits = grown;
+    scan->hits[scan->nr_hits].addr = addr + off;
+    memcpy(scan->hits[scan->nr_hits].hdr, p, MCUBOOT_HEADER_SIZE);
+    scan->nr_hits++;
+  }
+}
+
+static int
+flash_block_cmp(const void *a, const void *b) {
+  uint32_t sa = ((const flash_block_t *)a)->start;
+  uint32_t sb = ((const flash_block_t *)b)->start;
+  return (sa > sb) - (sa < sb);
+}
+
+static int
+mcuboot_hit_cmp(const void *a, const void *b) {
+  uint32_t sa = ((const mcuboot_hit_t *)a)->addr;
+  uint32_t sb = ((const mcuboot_hit_t *)b)->addr;
+  return (sa > sb) - (sa < sb);
+}
+
+/*
+ * Order blocks and hits by address for lookups, whatever the area order
+ */
+static void
+flash_scan_sort(flash_scan_t *scan) {
+  if (scan->nr_blocks > 1)
+    qsort(scan->blocks, scan->nr_blocks, sizeof(*scan->blocks), flash_block_cmp);
+  if (scan->nr_hits > 1)
+    qsort(scan->hits, scan->nr_hits, sizeof(*scan->hits), mcuboot_hit_cmp);
+}
+
+/*
+ * Block recorded by the usage scan that contains addr, or NULL
+ */
+static const flash_block_t *
+flash_scan_find(const flash_scan_t *scan, uint32_t addr) {
+  size_t lo = 0, hi = scan != NULL ? scan->nr_blocks : 0;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (addr < scan->blocks[mid].start)
+      hi = mid;
+    else if (addr > scan->blocks[mid].end)
+      lo = mid + 1;
+    else
+      return &scan->blocks[mid];
+  }
+  return NULL;
+}
+
 /*
  * Scan flash area for usage (count non-0xFF bytes)
+ * scan: if not NULL, records erased blocks, per-block last used byte and
+ *       MCUboot header candidates (areas must be scanned in address order)
  * Returns bytes used, or -1 on error
  *
  * WORKAROUND: Uses single-packet reads (<=1024 bytes each) to avoid
  * multi-packet ACK protocol issue. See protocol.md for details.
  */
 static int64_t
-status_scan_flash_usage(ra_device_t *dev, uint32_t sad, uint32_t ead, uint32_t rau) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[CHUNK_SIZE + 6];
+status_scan_flash_usage(
+    const flash_view_t *v, uint32_t sad, uint32_t ead, uint32_t rau, flash_scan_t *scan) {
   uint8_t chunk[CHUNK_SIZE];
-  uint8_t data[8];
-  ssize_t pkt_len, n;
 
   if (rau == 0)
     return -1;
 
+  /* Fully erased area: one CRC command */
+  int blank = v->blank(v, sad, ead);
+  if (blank < 0)
+    return -1;
+  if (blank > 0) {
+    if (scan != NULL)
+      flash_scan_add_block(scan, sad, ead, 0);
+    return 0;
+  }
+
   uint32_t total_size = ead - sad + 1;
-  uint32_t nr_chunks = (total_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  uint32_t unit = crc_probe_unit(v->dev, sad);
+  uint32_t nr_blocks = (total_size + unit - 1) / unit;
 
   int64_t used = 0;
   uint32_t current_addr = sad;
+  progress_t prog;
+  dev_progress_init(v->dev, &prog, nr_blocks, total_size, "Scanning flash");
 
-  for (uint32_t i = 0; i < nr_chunks; i++) {
-    /* Calculate chunk boundaries (single-packet read) */
-    uint32_t chunk_start = current_addr;
-    uint32_t remaining = ead - chunk_start + 1;
-    uint32_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
-    uint32_t chunk_end = chunk_start + chunk_size - 1;
-
-    /* Send single-packet READ command */
-    uint32_to_be(chunk_start, &data[0]);
-    uint32_to_be(chunk_end, &data[4]);
+  for (uint32_t i = 0; i < nr_blocks; i++) {
+    uint32_t block_end = crc_probe_block_end(v->dev, current_addr, unit, ead);
 
-    pkt_len = ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, data, 8, false);
-    if (pkt_len < 0)
+    /* Only blocks whose CRC differs from erased flash are read back */
+    blank = v->blank(v, current_addr, block_end);
+    if (blank < 0)
       return -1;
 
-    if (ra_send(dev, pkt, pkt_len) < 0)
-      return -1;
+    uint32_t last_used = 0;
+    for (uint32_t chunk_start = current_addr; blank == 0 && chunk_start <= block_end;) {
+      /* Calculate chunk boundaries (single-packet read) */
+      uint32_t remaining = block_end - chunk_start + 1;
+      uint32_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
 
-    /* Receive single data packet */
-    n = ra_recv(dev, resp, CHUNK_SIZE + 6, 2000);
-    if (n < 7)
-      return -1;
+      if (v->read(v, chunk_start, chunk, chunk_size) < 0)
+        return -1;
 
-    size_t chunk_len;
-    uint8_t cmd;
-    if (ra_unpack_pkt(resp, n, chunk, &chunk_len, &cmd) < 0)
-      return -1;
-    if (cmd & STATUS_ERR)
-      return -1;
+      /* Count non-0xFF bytes */
+      used += rabuf_count_used(chunk, chunk_size);
 
-    /* Count non-0xFF bytes */
-    for (size_t j = 0; j < chunk_len; j++) {
-      if (chunk[j] != 0xFF)
-        used++;
+      size_t j = rabuf_last_used(chunk, chunk_size);
+      if (j > 0)
+        last_used = chunk_start - current_addr + (uint32_t)j;
+      if (scan != NULL)
+        flash_scan_add_hits(scan, chunk_start, chunk, chunk_size);
+
+      chunk_start += chunk_size;
     }
+    if (scan != NULL)
+      flash_scan_add_block(scan, current_addr, block_end, last_used);
 
-    current_addr += chunk_size;
+    progress_update(&prog, i + 1);
 
-    /* Show progress for large areas */
-    if (nr_chunks > 10 && (i % (nr_chunks / 10)) == 0) {
-      fprintf(stderr, "\rScanning flash... %u%%", (i * 100) / nr_chunks);
-      fflush(stderr);
-    }
+    if (block_end >= ead)
+      break;
+    current_addr = block_end + 1;
   }
 
-  if (nr_chunks > 10)
-    fprintf(stderr, "\r                          \r");
-
+  progress_finish(&prog);
   return used;
 }
 
@@ -2749,8 +3930,6 @@ status_scan_flash_usage(ra_device_t *dev, uint32_t sad, uint32_t ead, uint32_t r
  * MCUboot image header structure
  * See: https://docs.mcuboot.com/design.html#image-format
  */
-#define MCUBOOT_IMAGE_MAGIC 0x96f3b83d
-#define MCUBOOT_HEADER_SIZE 32
 
 typedef struct {
   uint32_t ih_magic;
@@ -2784,50 +3963,19 @@ typedef struct {
  * Returns 0 on success, -1 on error
  */
 static int
-status_read_flash_chunk(ra_device_t *dev, uint32_t addr, uint8_t *buf, size_t len) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[CHUNK_SIZE + 6];
-  uint8_t data[8];
-  ssize_t pkt_len, n;
-
+status_read_flash_chunk(const flash_view_t *v, uint32_t addr, uint8_t *buf, size_t len) {
   if (len > CHUNK_SIZE)
     len = CHUNK_SIZE;
 
-  uint32_to_be(addr, &data[0]);
-  uint32_to_be(addr + len - 1, &data[4]);
-
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, data, 8, false);
-  if (pkt_len < 0)
-    return -1;
-
-  if (ra_send(dev, pkt, pkt_len) < 0)
-    return -1;
-
-  n = ra_recv(dev, resp, len + 6, 2000);
-  if (n < 7)
-    return -1;
-
-  size_t chunk_len;
-  uint8_t cmd;
-  if (ra_unpack_pkt(resp, n, buf, &chunk_len, &cmd) < 0)
-    return -1;
-  if (cmd & STATUS_ERR)
-    return -1;
-
-  return 0;
+  return v->read(v, addr, buf, len);
 }
 
 /*
- * Check if address contains MCUboot image header
+ * Parse MCUboot image header read from addr
  * Returns 1 if valid MCUboot header found, 0 otherwise
  */
 static int
-status_check_mcuboot_header(ra_device_t *dev, uint32_t addr, mcuboot_partition_t *part) {
-  uint8_t buf[MCUBOOT_HEADER_SIZE];
-
-  if (status_read_flash_chunk(dev, addr, buf, MCUBOOT_HEADER_SIZE) < 0)
-    return 0;
-
+status_parse_mcuboot_header(uint32_t addr, const uint8_t *buf, mcuboot_partition_t *part) {
   /* MCUboot uses little-endian format */
   uint32_t magic = buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24);
 
@@ -2852,52 +4000,97 @@ status_check_mcuboot_header(ra_device_t *dev, uint32_t addr, mcuboot_partition_t
 
 /*
  * Scan flash region to find last non-0xFF byte (actual used size)
+ * Blocks already classified by the usage scan are answered without device access.
  * Returns the used size in bytes, or 0 if region is empty
  */
 static uint32_t
-status_scan_region_usage(ra_device_t *dev, uint32_t start, uint32_t end) {
+status_scan_region_usage(
+    const flash_view_t *v, uint32_t start, uint32_t end, const flash_scan_t *scan) {
   uint8_t buf[CHUNK_SIZE];
-  uint32_t last_used = 0;
-  uint32_t size = end - start + 1;
-  uint32_t nr_chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  uint32_t unit = crc_probe_unit(v->dev, start);
 
-  for (uint32_t i = 0; i < nr_chunks; i++) {
-    uint32_t chunk_start = start + i * CHUNK_SIZE;
-    uint32_t remaining = end - chunk_start + 1;
-    uint32_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
+  if (scan == NULL && v->blank(v, start, end) > 0)
+    return 0;
 
-    if (status_read_flash_chunk(dev, chunk_start, buf, chunk_size) < 0)
-      continue;
+  /* Walk blocks from the top: the first one not erased holds the last used byte */
+  uint32_t block_end = end;
+  for (;;) {
+    uint32_t block_start = crc_probe_block_start(v->dev, block_end, unit, start);
+    const flash_block_t *known = flash_scan_find(scan, block_end);
+
+    if (known != NULL && known->last_used == 0 && known->start <= block_start) {
+      /* Erased */
+    } else if (known != NULL && known->last_used > 0 && known->start >= block_start &&
+               known->start + known->last_used - 1 <= block_end) {
+      return known->start - start + known->last_used;
+    } else if (v->blank(v, block_start, block_end) <= 0) {
+      /* Read this block from its top, chunk by chunk */
+      uint32_t chunk_end = block_end;
+      for (;;) {
+        uint32_t size = chunk_end - block_start + 1;
+        uint32_t chunk_size = (size > CHUNK_SIZE) ? CHUNK_SIZE : size;
+        uint32_t chunk_start = chunk_end - chunk_size + 1;
+
+        if (status_read_flash_chunk(v, chunk_start, buf, chunk_size) == 0) {
+          /* Find last non-0xFF byte in this chunk */
+          size_t j = rabuf_last_used(buf, chunk_size);
+          if (j > 0)
+            return chunk_start - start + (uint32_t)j;
+        }
 
-    /* Find last non-0xFF byte in this chunk */
-    for (uint32_t j = chunk_size; j > 0; j--) {
-      if (buf[j - 1] != 0xFF) {
-        uint32_t offset = chunk_start - start + j;
-        if (offset > last_used)
-          last_used = offset;
-        break;
+        if (chunk_start == block_start)
+          break;
+        chunk_end = chunk_start - 1;
       }
     }
+
+    if (block_start == start)
+      break;
+    block_end = block_start - 1;
   }
 
-  return last_used;
+  return 0;
 }
 
 /*
  * Scan code flash for MCUboot images
- * Scans at 4KB boundaries (common minimum slot alignment)
+ * Looks at 4KB boundaries (common minimum slot alignment). Strides in blocks
+ * the usage scan found erased are skipped, and those in blocks it read are
+ * answered from the headers it recorded; only the rest are read from the device.
  * Returns number of images found
  */
 static int
-status_scan_mcuboot_images(
-    ra_device_t *dev, uint32_t sad, uint32_t ead, mcuboot_partition_t *parts, int max_parts) {
+status_scan_mcuboot_images(const flash_view_t *v,
+    uint32_t sad,
+    uint32_t ead,
+    const flash_scan_t *scan,
+    mcuboot_partition_t *parts,
+    int max_parts) {
+  uint8_t buf[MCUBOOT_HEADER_SIZE];
   int count = 0;
-  uint32_t scan_step = 4096; /* 4KB alignment */
+  uint32_t scan_step = MCUBOOT_SCAN_STEP;
+  size_t next_hit = 0;
 
   fprintf(stderr, "Scanning for MCUboot images...\n");
 
   for (uint32_t addr = sad; addr < ead && count < max_parts; addr += scan_step) {
-    if (status_check_mcuboot_header(dev, addr, &parts[count])) {
+    const flash_block_t *known = flash_scan_find(scan, addr);
+    int found = 0;
+
+    if (known != NULL && addr + MCUBOOT_HEADER_SIZE - 1 <= known->end) {
+      if (known->last_used == 0)
+        continue;
+
+      /* Block was read by the usage scan: hits are sorted by address */
+      while (next_hit < scan->nr_hits && scan->hits[next_hit].addr < addr)
+        next_hit++;
+      if (next_hit < scan->nr_hits && scan->hits[next_hit].addr == addr)
+        found = status_parse_mcuboot_header(addr, scan->hits[next_hit].hdr, &parts[count]);
+    } else if (status_read_flash_chunk(v, addr, buf, MCUBOOT_HEADER_SIZE) == 0) {
+      found = status_parse_mcuboot_header(addr, buf, &parts[count]);
+    }
+
+    if (found) {
       count++;
       /* Skip past this image to avoid finding overlapping headers */
       if (parts[count - 1].end > addr)
@@ -2945,61 +4138,44 @@ status_get_group(uint8_t typ) {
 }
 
 /*
- * Query signature and return parsed fields
- * Returns 0 on success, -1 on error
+ * What the status report shows, gathered from a device or a backup file
+ * Fields a backup cannot tell (DLM, boundary, parameter, keys) are left
+ * unknown there: have_* false and key_* -1.
  */
-static int
-status_query_signature(ra_device_t *dev,
-    char *product,
-    size_t product_len,
-    uint8_t *typ,
-    uint8_t *bfv_major,
-    uint8_t *bfv_minor,
-    uint8_t *bfv_build,
-    uint32_t *rmb,
-    uint8_t *noa) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[64];
-  uint8_t data[64];
-  size_t data_len;
-  ssize_t pkt_len, n;
-
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), SIG_CMD, NULL, 0, false);
-  if (pkt_len < 0)
-    return -1;
-
-  if (ra_send(dev, pkt, pkt_len) < 0)
-    return -1;
-
-  n = ra_recv(dev, resp, sizeof(resp), 500);
-  if (n < 7)
-    return -1;
-
-  uint8_t cmd;
-  if (ra_unpack_pkt(resp, n, data, &data_len, &cmd) < 0)
-    return -1;
-  if (cmd & STATUS_ERR)
-    return -1;
+typedef struct {
+  bool offline; /* From a backup file */
+  char product[17];
+  uint8_t typ, bfv_major, bfv_minor, bfv_build, noa;
+  uint32_t rmb;
+  bool have_dlm, have_boundary, have_param;
+  uint8_t dlm_state;
+  uint8_t init_param;
+  ra_boundary_t bnd;
+  int key_secdbg, key_nonsecdbg, key_rma;
+  bool authenticated;
+} status_info_t;
 
+/*
+ * Decode the signature response fields the status report shows
+ */
+static void
+status_decode_signature(const uint8_t *data, size_t data_len, status_info_t *s) {
   if (data_len >= 9) {
-    *rmb = be_to_uint32(&data[0]);
-    *noa = data[4];
-    *typ = data[5];
-    *bfv_major = data[6];
-    *bfv_minor = data[7];
-    *bfv_build = data[8];
+    s->rmb = be_to_uint32(&data[0]);
+    s->noa = data[4];
+    s->typ = data[5];
+    s->bfv_major = data[6];
+    s->bfv_minor = data[7];
+    s->bfv_build = data[8];
   }
 
   if (data_len >= 41) {
-    size_t copy_len = product_len - 1 < 16 ? product_len - 1 : 16;
-    memcpy(product, &data[25], copy_len);
-    product[copy_len] = '\0';
+    memcpy(s->product, &data[25], 16);
+    s->product[16] = '\0';
     /* Trim trailing spaces */
-    for (int i = (int)copy_len - 1; i >= 0 && product[i] == ' '; i--)
-      product[i] = '\0';
+    for (int i = 15; i >= 0 && s->product[i] == ' '; i--)
+      s->product[i] = '\0';
   }
-
-  return 0;
 }
 
 /*
@@ -3020,7 +4196,7 @@ status_query_boundary(ra_device_t *dev, ra_boundary_t *bnd) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7)
     return -1;
 
@@ -3058,7 +4234,7 @@ status_query_dlm(ra_device_t *dev, uint8_t *dlm_state) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7)
     return -1;
 
@@ -3091,7 +4267,7 @@ status_query_param(ra_device_t *dev, uint8_t param_id, uint8_t *value) {
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7)
     return -1;
 
@@ -3108,23 +4284,24 @@ status_query_param(ra_device_t *dev, uint8_t param_id, uint8_t *value) {
 
 /*
  * Query key verify (silent version for status)
+ * vfy_cmd: KEY_VFY_CMD for DLM keys, UKEY_VFY_CMD for user keys
  * Returns: 1 if key valid, 0 if not valid, -1 on error (command not supported)
  */
 static int
-status_query_key_verify(ra_device_t *dev, uint8_t key_type) {
+status_query_key_verify(ra_device_t *dev, uint8_t vfy_cmd, uint8_t key_type) {
   uint8_t pkt[MAX_PKT_LEN];
   uint8_t resp[32];
   uint8_t resp_data[16];
   ssize_t pkt_len, n;
 
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), KEY_VFY_CMD, &key_type, 1, false);
+  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), vfy_cmd, &key_type, 1, false);
   if (pkt_len < 0)
     return -1;
 
   if (ra_send(dev, pkt, pkt_len) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 500);
+  n = ra_recv_pkt(dev, resp, sizeof(resp), 500);
   if (n < 7)
     return -1;
 
@@ -3148,84 +4325,40 @@ status_query_key_verify(ra_device_t *dev, uint8_t key_type) {
  * WORKAROUND: Uses single-packet reads (<=1024 bytes each) to avoid
  * multi-packet ACK protocol issue. See protocol.md for details.
  */
-static int
-status_read_config(
-    ra_device_t *dev, int area, bool *fspr_locked, uint8_t *bps, uint8_t *pbps, size_t bps_len) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[CHUNK_SIZE + 6];
-  uint8_t chunk[CHUNK_SIZE];
-  uint8_t data[8];
-  ssize_t pkt_len, n;
-
-  uint32_t sad = dev->chip_layout[area].sad;
-  uint32_t ead = dev->chip_layout[area].ead;
-  uint32_t rau = dev->chip_layout[area].rau;
-
-  if (rau == 0)
-    return -1;
-
-  uint32_t size = ead - sad + 1;
-  uint8_t *config = malloc(size);
-  if (!config)
-    return -1;
-
-  uint32_t nr_chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
-  uint32_t current_addr = sad;
-  size_t offset = 0;
-
-  for (uint32_t i = 0; i < nr_chunks; i++) {
-    /* Calculate chunk boundaries (single-packet read) */
-    uint32_t chunk_start = current_addr;
-    uint32_t remaining = ead - chunk_start + 1;
-    uint32_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
-    uint32_t chunk_end = chunk_start + chunk_size - 1;
-
-    /* Send single-packet READ command */
-    uint32_to_be(chunk_start, &data[0]);
-    uint32_to_be(chunk_end, &data[4]);
-
-    pkt_len = ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, data, 8, false);
-    if (pkt_len < 0) {
-      free(config);
-      return -1;
-    }
-
-    if (ra_send(dev, pkt, pkt_len) < 0) {
-      free(config);
-      return -1;
-    }
-
-    /* Receive single data packet */
-    n = ra_recv(dev, resp, CHUNK_SIZE + 6, 2000);
-    if (n < 7) {
-      free(config);
-      return -1;
-    }
+static int
+status_read_config(const flash_view_t *v,
+    int area,
+    bool *fspr_locked,
+    uint8_t *bps,
+    uint8_t *pbps,
+    size_t bps_len) {
+
+  uint32_t sad = v->dev->chip_layout[area].sad;
+  uint32_t ead = v->dev->chip_layout[area].ead;
+  uint32_t rau = v->dev->chip_layout[area].rau;
+
+  /* A backup may hold no (or only part of the) config area */
+  uint32_t size = ead - sad + 1;
+  if (rau == 0 || size < CFG_PBPS_OFFSET + CFG_BPS_LEN)
+    return -1;
 
-    size_t chunk_len;
-    uint8_t cmd;
-    if (ra_unpack_pkt(resp, n, chunk, &chunk_len, &cmd) < 0 || (cmd & STATUS_ERR)) {
-      free(config);
-      return -1;
-    }
+  uint8_t *config = malloc(size);
+  if (!config)
+    return -1;
 
-    memcpy(config + offset, chunk, chunk_len);
-    offset += chunk_len;
-    current_addr += chunk_size;
+  if (v->read(v, sad, config, size) < 0) {
+    free(config);
+    return -1;
   }
 
   /* Extract FSPR from SAS register */
-  if (size > CFG_SAS_OFFSET + 1) {
-    uint16_t sas = config[CFG_SAS_OFFSET] | ((uint16_t)config[CFG_SAS_OFFSET + 1] << 8);
-    *fspr_locked = (sas & SAS_FSPR_BIT) == 0;
-  }
+  uint16_t sas = config[CFG_SAS_OFFSET] | ((uint16_t)config[CFG_SAS_OFFSET + 1] << 8);
+  *fspr_locked = (sas & SAS_FSPR_BIT) == 0;
 
   /* Extract BPS/PBPS */
-  if (size >= CFG_PBPS_OFFSET + CFG_BPS_LEN) {
-    size_t copy_len = bps_len < CFG_BPS_LEN ? bps_len : CFG_BPS_LEN;
-    memcpy(bps, &config[CFG_BPS_OFFSET], copy_len);
-    memcpy(pbps, &config[CFG_PBPS_OFFSET], copy_len);
-  }
+  size_t copy_len = bps_len < CFG_BPS_LEN ? bps_len : CFG_BPS_LEN;
+  memcpy(bps, &config[CFG_BPS_OFFSET], copy_len);
+  memcpy(pbps, &config[CFG_PBPS_OFFSET], copy_len);
 
   free(config);
   return 0;
@@ -3246,86 +4379,24 @@ status_count_protected_blocks(const uint8_t *bps, size_t len) {
   return count;
 }
 
-int
-ra_status(ra_device_t *dev) {
-  char product[17] = { 0 };
-  uint8_t typ = 0, bfv_major = 0, bfv_minor = 0, bfv_build = 0, noa = 0;
-  uint32_t rmb = 0;
-  uint8_t dlm_state = 0;
-  uint8_t init_param = PARAM_INIT_ENABLED;
-  ra_boundary_t bnd = { 0 };
-  bool have_boundary = false, have_dlm = false, have_param = false;
+/*
+ * Scan the flash a view shows and print the status report
+ * Returns: 0 on success
+ */
+static int
+status_report(const flash_view_t *v, const status_info_t *s) {
   bool fspr_locked = false;
-  uint8_t bps[CFG_BPS_LEN] = { 0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF };
-  uint8_t pbps[CFG_BPS_LEN] = { 0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF,
-    0xFF };
-  int key_secdbg = -1, key_nonsecdbg = -1, key_rma = -1;
+  uint8_t bps[CFG_BPS_LEN];
+  uint8_t pbps[CFG_BPS_LEN];
   char line[256];
 
-  /* Ensure chip layout is populated */
-  if (ra_get_area_info(dev, false) < 0)
-    return -1;
-
-  /* Query device signature */
-  if (status_query_signature(
-          dev, product, sizeof(product), &typ, &bfv_major, &bfv_minor, &bfv_build, &rmb, &noa) <
-      0) {
-    warnx("failed to query device signature");
-    return -1;
-  }
-
-  /* Query DLM state (may not be supported on GrpD) */
-  have_dlm = (status_query_dlm(dev, &dlm_state) == 0);
-
-  /* Query boundary settings (may not be supported on GrpD) */
-  have_boundary = (status_query_boundary(dev, &bnd) == 0);
-
-  /* Query initialization parameter (may not be supported on GrpD) */
-  have_param = (status_query_param(dev, PARAM_ID_INIT, &init_param) == 0);
-
-  /* Query key verification status */
-  key_secdbg = status_query_key_verify(dev, 0x01);
-  key_nonsecdbg = status_query_key_verify(dev, 0x02);
-  key_rma = status_query_key_verify(dev, 0x03);
+  memset(bps, 0xFF, sizeof(bps));
+  memset(pbps, 0xFF, sizeof(pbps));
 
-  /* Read config area for protection settings */
-  int cfg_area = find_config_area(dev);
-  if (cfg_area >= 0) {
-    status_read_config(dev, cfg_area, &fspr_locked, bps, pbps, CFG_BPS_LEN);
-  }
+  /* Read config area for protection settings (unknown when not readable) */
+  int cfg_area = find_config_area(v->dev);
+  bool have_config = cfg_area >= 0 &&
+                     status_read_config(v, cfg_area, &fspr_locked, bps, pbps, CFG_BPS_LEN) == 0;
 
   /* Calculate memory sizes and usage */
   uint32_t code_size = 0, code_used = 0;
@@ -3334,10 +4405,10 @@ ra_status(ra_device_t *dev) {
   uint32_t code_sad = 0, code_ead = 0;
   uint32_t data_sad = 0, data_ead = 0;
   uint32_t cfg_sad = 0, cfg_ead = 0;
-  bool dual_bank = (noa > 4);
+  bool dual_bank = (s->noa > 4);
 
   for (int i = 0; i < MAX_AREAS; i++) {
-    ra_area_t *area = &dev->chip_layout[i];
+    ra_area_t *area = &v->dev->chip_layout[i];
     if (area->sad == 0 && area->ead == 0)
       continue;
 
@@ -3363,17 +4434,19 @@ ra_status(ra_device_t *dev) {
     }
   }
 
-  /* Scan flash usage */
+  /* Scan flash usage, keeping what was learned for the MCUboot and region scans */
+  flash_scan_t scan = { .hdr_base = code_sad };
   fprintf(stderr, "Scanning code flash usage...\n");
   for (int i = 0; i < MAX_AREAS; i++) {
-    ra_area_t *area = &dev->chip_layout[i];
+    ra_area_t *area = &v->dev->chip_layout[i];
     if ((area->koa == KOA_TYPE_CODE || area->koa == KOA_TYPE_CODE1) && area->ead != 0 &&
         area->rau != 0) {
-      int64_t used = status_scan_flash_usage(dev, area->sad, area->ead, area->rau);
+      int64_t used = status_scan_flash_usage(v, area->sad, area->ead, area->rau, &scan);
       if (used >= 0)
         code_used += (uint32_t)used;
     }
   }
+  flash_scan_sort(&scan);
 
   /* NOTE: Data flash usage scanning is skipped because erased data flash
    * reads undefined values (not 0xFF) per Renesas RA hardware spec.
@@ -3386,15 +4459,15 @@ ra_status(ra_device_t *dev) {
   uint32_t storage_start = 0, storage_size = 0;
 
   if (code_size > 0)
-    mcuboot_count =
-        status_scan_mcuboot_images(dev, code_sad, code_ead, mcuboot_parts, MAX_MCUBOOT_PARTITIONS);
+    mcuboot_count = status_scan_mcuboot_images(
+        v, code_sad, code_ead, &scan, mcuboot_parts, MAX_MCUBOOT_PARTITIONS);
 
   /* Scan bootloader and storage regions if MCUboot images found */
   if (mcuboot_count > 0) {
     /* Scan bootloader region */
     if (mcuboot_parts[0].start > code_sad) {
       fprintf(stderr, "Scanning bootloader region...\n");
-      bl_used = status_scan_region_usage(dev, code_sad, mcuboot_parts[0].start - 1);
+      bl_used = status_scan_region_usage(v, code_sad, mcuboot_parts[0].start - 1, &scan);
     }
 
     /* Scan storage region (last 48KB) */
@@ -3403,7 +4476,7 @@ ra_status(ra_device_t *dev) {
     if (storage_start > mcuboot_parts[mcuboot_count - 1].start) {
       storage_size = code_ead - storage_start + 1;
       fprintf(stderr, "Scanning storage region...\n");
-      storage_used = status_scan_region_usage(dev, storage_start, code_ead);
+      storage_used = status_scan_region_usage(v, storage_start, code_ead, &scan);
     }
   }
 
@@ -3415,32 +4488,32 @@ ra_status(ra_device_t *dev) {
 
   /* MCU Info Section */
   char cpu_core[16] = "Unknown";
-  if (product[0] == 'R' && product[1] == '7' && product[2] == 'F' && product[3] == 'A') {
-    snprintf(cpu_core, sizeof(cpu_core), "%s", status_get_cpu_core(product[4]));
+  if (strncmp(s->product, "R7FA", 4) == 0) {
+    snprintf(cpu_core, sizeof(cpu_core), "%s", status_get_cpu_core(s->product[4]));
   }
 
   snprintf(line,
       sizeof(line),
       "MCU: %-16s  Group: %-10s  Core: %s",
-      product,
-      status_get_group(typ),
+      s->product,
+      status_get_group(s->typ),
       cpu_core);
   status_print_line(line, STATUS_WIDTH);
 
   char baud_str[32];
-  if (rmb >= 1000000)
-    snprintf(baud_str, sizeof(baud_str), "%.1f Mbps", rmb / 1000000.0);
-  else if (rmb >= 1000)
-    snprintf(baud_str, sizeof(baud_str), "%.1f Kbps", rmb / 1000.0);
+  if (s->rmb >= 1000000)
+    snprintf(baud_str, sizeof(baud_str), "%.1f Mbps", s->rmb / 1000000.0);
+  else if (s->rmb >= 1000)
+    snprintf(baud_str, sizeof(baud_str), "%.1f Kbps", s->rmb / 1000.0);
   else
-    snprintf(baud_str, sizeof(baud_str), "%u bps", rmb);
+    snprintf(baud_str, sizeof(baud_str), "%u bps", s->rmb);
 
   snprintf(line,
       sizeof(line),
       "Boot FW: v%d.%d.%d      Max Baud: %-10s  Mode: %s",
-      bfv_major,
-      bfv_minor,
-      bfv_build,
+      s->bfv_major,
+      s->bfv_minor,
+      s->bfv_build,
       baud_str,
       dual_bank ? "Dual Bank" : "Linear");
   status_print_line(line, STATUS_WIDTH);
@@ -3478,11 +4551,12 @@ ra_status(ra_device_t *dev) {
   status_print_line(line, STATUS_WIDTH);
 
   /* Code Flash - TrustZone regions indicator */
-  if (have_boundary && (bnd.cfs1 > 0 || bnd.cfs2 > 0)) {
+  if (s->have_boundary && (s->bnd.cfs1 > 0 || s->bnd.cfs2 > 0)) {
     uint16_t code_kb = code_size / 1024;
-    int sec_chars = (bnd.cfs1 > 0) ? (int)((uint64_t)bnd.cfs1 * 40 / code_kb) : 0;
-    int nsc_chars =
-        (bnd.cfs2 > bnd.cfs1) ? (int)((uint64_t)(bnd.cfs2 - bnd.cfs1) * 40 / code_kb) : 0;
+    int sec_chars = (s->bnd.cfs1 > 0) ? (int)((uint64_t)s->bnd.cfs1 * 40 / code_kb) : 0;
+    int nsc_chars = (s->bnd.cfs2 > s->bnd.cfs1)
+                        ? (int)((uint64_t)(s->bnd.cfs2 - s->bnd.cfs1) * 40 / code_kb)
+                        : 0;
     if (sec_chars > 40)
       sec_chars = 40;
     if (sec_chars + nsc_chars > 40)
@@ -3499,10 +4573,10 @@ ra_status(ra_device_t *dev) {
       strcat(bar_buf, TZ_NONSEC);
 
     char tz_info[64];
-    if (bnd.cfs1 > 0 && bnd.cfs2 > bnd.cfs1)
-      snprintf(tz_info, sizeof(tz_info), "S=%uKB N=%uKB", bnd.cfs1, bnd.cfs2 - bnd.cfs1);
-    else if (bnd.cfs2 > 0)
-      snprintf(tz_info, sizeof(tz_info), "S=%uKB", bnd.cfs2);
+    if (s->bnd.cfs1 > 0 && s->bnd.cfs2 > s->bnd.cfs1)
+      snprintf(tz_info, sizeof(tz_info), "S=%uKB N=%uKB", s->bnd.cfs1, s->bnd.cfs2 - s->bnd.cfs1);
+    else if (s->bnd.cfs2 > 0)
+      snprintf(tz_info, sizeof(tz_info), "S=%uKB", s->bnd.cfs2);
     else
       tz_info[0] = '\0';
 
@@ -3513,7 +4587,7 @@ ra_status(ra_device_t *dev) {
 
   /* Code Flash - usage bar with protection indicators */
   pct = (code_size > 0) ? (int)((uint64_t)code_used * 100 / code_size) : 0;
-  status_build_flash_bar(bar_buf, 40, pct, code_size, bnd.cfs1, bnd.cfs2, bps, pbps);
+  status_build_flash_bar(bar_buf, 40, pct, code_size, s->bnd.cfs1, s->bnd.cfs2, bps, pbps);
   snprintf(content, sizeof(content), " %s  %3d%% used", bar_buf, pct);
   status_format_inner(line, sizeof(line), content, INNER_WIDTH);
   status_print_line(line, STATUS_WIDTH);
@@ -3627,9 +4701,9 @@ ra_status(ra_device_t *dev) {
     status_print_line(line, STATUS_WIDTH);
 
     /* Data Flash - TrustZone indicator (if applicable) */
-    if (have_boundary && bnd.dfs > 0) {
+    if (s->have_boundary && s->bnd.dfs > 0) {
       uint16_t data_kb = data_size / 1024;
-      int sec_chars = (bnd.dfs > 0) ? (int)((uint64_t)bnd.dfs * 40 / data_kb) : 0;
+      int sec_chars = (s->bnd.dfs > 0) ? (int)((uint64_t)s->bnd.dfs * 40 / data_kb) : 0;
       if (sec_chars > 40)
         sec_chars = 40;
       int ns_chars = 40 - sec_chars;
@@ -3641,7 +4715,7 @@ ra_status(ra_device_t *dev) {
       for (int i = 0; i < ns_chars; i++)
         strcat(bar_buf, TZ_NONSEC);
 
-      snprintf(content, sizeof(content), "%s  TZ: S=%uKB", bar_buf, bnd.dfs);
+      snprintf(content, sizeof(content), "%s  TZ: S=%uKB", bar_buf, s->bnd.dfs);
       status_format_inner(line, sizeof(line), content, INNER_WIDTH);
       status_print_line(line, STATUS_WIDTH);
     }
@@ -3721,7 +4795,7 @@ ra_status(ra_device_t *dev) {
   status_print_line(content, STATUS_WIDTH);
 
   /* FSPR status indicator */
-  if (cfg_area >= 0) {
+  if (have_config) {
     snprintf(content,
         sizeof(content),
         "        FSPR: %s",
@@ -3735,26 +4809,28 @@ ra_status(ra_device_t *dev) {
   /* Security Summary / Warning */
   int bps_protected = status_count_protected_blocks(bps, CFG_BPS_LEN);
   int pbps_protected = status_count_protected_blocks(pbps, CFG_BPS_LEN);
-  bool has_tz = have_boundary && (bnd.cfs1 > 0 || bnd.cfs2 > 0 || bnd.dfs > 0);
-  bool has_dlm_keys = (key_secdbg == 1 || key_nonsecdbg == 1 || key_rma == 1);
-  bool is_ssd = (have_dlm && dlm_state == 0x02);
-  bool init_enabled = (have_param && init_param == PARAM_INIT_ENABLED);
+  bool has_tz = s->have_boundary && (s->bnd.cfs1 > 0 || s->bnd.cfs2 > 0 || s->bnd.dfs > 0);
+  bool has_dlm_keys = (s->key_secdbg == 1 || s->key_nonsecdbg == 1 || s->key_rma == 1);
+  bool is_ssd = (s->have_dlm && s->dlm_state == 0x02);
+  bool init_enabled = (s->have_param && s->init_param == PARAM_INIT_ENABLED);
 
   /* Count security issues */
+  bool no_bps = have_config && bps_protected == 0 && pbps_protected == 0;
+  bool fspr_open = have_config && !fspr_locked;
   int warnings = 0;
-  if (bps_protected == 0)
+  if (have_config && bps_protected == 0)
     warnings++;
-  if (pbps_protected == 0)
+  if (have_config && pbps_protected == 0)
     warnings++;
-  if (!has_tz)
+  if (!has_tz && !s->offline)
     warnings++;
-  if (!fspr_locked)
+  if (fspr_open)
     warnings++;
   if (is_ssd)
     warnings++;
   if (init_enabled)
     warnings++;
-  if (!has_dlm_keys)
+  if (!has_dlm_keys && !s->offline)
     warnings++;
 
   if (warnings >= 5) {
@@ -3762,14 +4838,14 @@ ra_status(ra_device_t *dev) {
     status_print_line("\xe2\x9a\xa0  SECURITY WARNING: Device is NOT secured!", STATUS_WIDTH);
     status_print_line("", STATUS_WIDTH);
 
-    if (bps_protected == 0 && pbps_protected == 0)
+    if (no_bps)
       status_print_line(
           "  \xe2\x9c\x97 No block protection: All flash blocks can be erased/written",
           STATUS_WIDTH);
-    if (!fspr_locked)
+    if (fspr_open)
       status_print_line(
           "  \xe2\x9c\x97 FSPR unlocked: Block protection settings can be modified", STATUS_WIDTH);
-    if (!has_tz)
+    if (!has_tz && !s->offline)
       status_print_line("  \xe2\x9c\x97 No TrustZone: All memory is Non-Secure", STATUS_WIDTH);
     if (is_ssd)
       status_print_line(
@@ -3777,7 +4853,7 @@ ra_status(ra_device_t *dev) {
     if (init_enabled)
       status_print_line(
           "  \xe2\x9c\x97 Init enabled: Device can be factory reset by anyone", STATUS_WIDTH);
-    if (!has_dlm_keys)
+    if (!has_dlm_keys && !s->offline)
       status_print_line(
           "  \xe2\x9c\x97 No DLM keys: Cannot use authenticated state regression", STATUS_WIDTH);
 
@@ -3785,15 +4861,19 @@ ra_status(ra_device_t *dev) {
   } else if (warnings > 0) {
     /* Partial security */
     status_print_line("Security Notes:", STATUS_WIDTH);
-    if (bps_protected == 0 && pbps_protected == 0)
+    if (no_bps)
       status_print_line("  - No block protection configured", STATUS_WIDTH);
-    if (!fspr_locked)
+    if (fspr_open)
       status_print_line("  - FSPR unlocked (BPS can be modified)", STATUS_WIDTH);
-    if (!has_tz)
+    if (!has_tz && !s->offline)
       status_print_line("  - TrustZone not configured", STATUS_WIDTH);
     if (init_enabled)
       status_print_line("  - Initialize command enabled", STATUS_WIDTH);
     status_print_line("", STATUS_WIDTH);
+  } else if (!have_config) {
+    /* Nothing against it, but block protection and FSPR are unknown */
+    status_print_line("Security: N/A (config area not readable)", STATUS_WIDTH);
+    status_print_line("", STATUS_WIDTH);
   } else {
     status_print_line("\xe2\x9c\x93 Device security configured", STATUS_WIDTH);
     status_print_line("", STATUS_WIDTH);
@@ -3804,26 +4884,34 @@ ra_status(ra_device_t *dev) {
   status_print_hline(BOX_LT, BOX_H, BOX_RT, STATUS_WIDTH);
 
   /* DLM State */
-  if (have_dlm) {
-    snprintf(line, sizeof(line), "DLM State: %s (0x%02X)", ra_dlm_state_name(dlm_state), dlm_state);
+  if (s->have_dlm) {
+    snprintf(line,
+        sizeof(line),
+        "DLM State: %s (0x%02X)",
+        ra_dlm_state_name(s->dlm_state),
+        s->dlm_state);
     status_print_line(line, STATUS_WIDTH);
   } else {
-    status_print_line("DLM State: N/A (not supported on this device)", STATUS_WIDTH);
+    status_print_line(s->offline ? "DLM State: N/A (not kept in a backup)"
+                                 : "DLM State: N/A (not supported on this device)",
+        STATUS_WIDTH);
   }
 
   /* OSIS Status */
   snprintf(line,
       sizeof(line),
       "OSIS:      %s",
-      dev->authenticated ? "Locked (authenticated)" : "Unlocked (no ID protection)");
+      s->offline         ? "N/A (not kept in a backup)"
+      : s->authenticated ? "Locked (authenticated)"
+                         : "Unlocked (no ID protection)");
   status_print_line(line, STATUS_WIDTH);
 
   /* Init Command - always show */
-  if (have_param) {
+  if (s->have_param) {
     snprintf(line,
         sizeof(line),
         "Init Cmd:  %s",
-        init_param == PARAM_INIT_ENABLED ? "Enabled" : "Disabled");
+        s->init_param == PARAM_INIT_ENABLED ? "Enabled" : "Disabled");
   } else {
     snprintf(line, sizeof(line), "Init Cmd:  N/A");
   }
@@ -3833,11 +4921,11 @@ ra_status(ra_device_t *dev) {
 
   /* TrustZone Boundaries - always show */
   status_print_line("TrustZone Boundaries:", STATUS_WIDTH);
-  if (have_boundary) {
-    uint16_t cfs_ns = (code_size / 1024) - bnd.cfs2;
-    uint16_t dfs_ns = (data_size / 1024) - bnd.dfs;
-    uint16_t cfs_nsc = bnd.cfs2 - bnd.cfs1;
-    uint16_t srs_nsc = bnd.srs2 - bnd.srs1;
+  if (s->have_boundary) {
+    uint16_t cfs_ns = (code_size / 1024) - s->bnd.cfs2;
+    uint16_t dfs_ns = (data_size / 1024) - s->bnd.dfs;
+    uint16_t cfs_nsc = s->bnd.cfs2 - s->bnd.cfs1;
+    uint16_t srs_nsc = s->bnd.srs2 - s->bnd.srs1;
 
     status_print_line(BOX_TL2 "────────────────" BOX_TT "─────────" BOX_TT "─────────" BOX_TT
                               "─────────────" BOX_TR2,
@@ -3852,7 +4940,7 @@ ra_status(ra_device_t *dev) {
     snprintf(line,
         sizeof(line),
         BOX_V2 " Code Flash     " BOX_V2 " %4u KB " BOX_V2 " %4u KB " BOX_V2 "   %5u KB  " BOX_V2,
-        bnd.cfs1,
+        s->bnd.cfs1,
         cfs_nsc,
         cfs_ns);
     status_print_line(line, STATUS_WIDTH);
@@ -3860,14 +4948,14 @@ ra_status(ra_device_t *dev) {
     snprintf(line,
         sizeof(line),
         BOX_V2 " Data Flash     " BOX_V2 " %4u KB " BOX_V2 "    -    " BOX_V2 "   %5u KB  " BOX_V2,
-        bnd.dfs,
+        s->bnd.dfs,
         dfs_ns);
     status_print_line(line, STATUS_WIDTH);
 
     snprintf(line,
         sizeof(line),
         BOX_V2 " SRAM           " BOX_V2 " %4u KB " BOX_V2 " %4u KB " BOX_V2 "      -      " BOX_V2,
-        bnd.srs1,
+        s->bnd.srs1,
         srs_nsc);
     status_print_line(line, STATUS_WIDTH);
 
@@ -3875,7 +4963,9 @@ ra_status(ra_device_t *dev) {
                               "─────────────" BOX_BR2,
         STATUS_WIDTH);
   } else {
-    status_print_line("  N/A (not supported on this device)", STATUS_WIDTH);
+    status_print_line(s->offline ? "  N/A (not kept in a backup)"
+                                 : "  N/A (not supported on this device)",
+        STATUS_WIDTH);
   }
 
   status_print_line("", STATUS_WIDTH);
@@ -3885,18 +4975,18 @@ ra_status(ra_device_t *dev) {
   snprintf(line,
       sizeof(line),
       "  SECDBG: [%s] %-10s  NONSECDBG: [%s] %-10s  RMA: [%s] %s",
-      key_secdbg == 1 ? CHECK_MARK : " ",
-      key_secdbg == 1 ? "Installed" : (key_secdbg == 0 ? "Empty" : "N/A"),
-      key_nonsecdbg == 1 ? CHECK_MARK : " ",
-      key_nonsecdbg == 1 ? "Installed" : (key_nonsecdbg == 0 ? "Empty" : "N/A"),
-      key_rma == 1 ? CHECK_MARK : " ",
-      key_rma == 1 ? "Installed" : (key_rma == 0 ? "Empty" : "N/A"));
+      s->key_secdbg == 1 ? CHECK_MARK : " ",
+      s->key_secdbg == 1 ? "Installed" : (s->key_secdbg == 0 ? "Empty" : "N/A"),
+      s->key_nonsecdbg == 1 ? CHECK_MARK : " ",
+      s->key_nonsecdbg == 1 ? "Installed" : (s->key_nonsecdbg == 0 ? "Empty" : "N/A"),
+      s->key_rma == 1 ? CHECK_MARK : " ",
+      s->key_rma == 1 ? "Installed" : (s->key_rma == 0 ? "Empty" : "N/A"));
   status_print_line(line, STATUS_WIDTH);
   status_print_line("", STATUS_WIDTH);
 
   /* Block Protection - always show */
   status_print_line("Block Protection (BPS):", STATUS_WIDTH);
-  if (cfg_area >= 0) {
+  if (have_config) {
     int bps_protected = status_count_protected_blocks(bps, CFG_BPS_LEN);
     int pbps_protected = status_count_protected_blocks(pbps, CFG_BPS_LEN);
     int total_blocks = CFG_BPS_LEN * 8;
@@ -3929,9 +5019,379 @@ ra_status(ra_device_t *dev) {
   status_print_hline(BOX_BL, BOX_H, BOX_BR, STATUS_WIDTH);
   printf("\n");
 
+  flash_scan_free(&scan);
+  return 0;
+}
+
+int
+ra_status(ra_device_t *dev) {
+  status_info_t s = { .init_param = PARAM_INIT_ENABLED };
+  flash_view_t view;
+
+  /* Ensure chip layout is populated */
+  if (ra_get_area_info(dev, false) < 0)
+    return -1;
+
+  /* Query device signature */
+  if (query_signature(dev, false) < 0) {
+    warnx("failed to query device signature");
+    return -1;
+  }
+  status_decode_signature(dev->sig, dev->sig_len, &s);
+
+  /* Query DLM state (may not be supported on GrpD) */
+  s.have_dlm = (status_query_dlm(dev, &s.dlm_state) == 0);
+
+  /* Query boundary settings (may not be supported on GrpD) */
+  s.have_boundary = (status_query_boundary(dev, &s.bnd) == 0);
+
+  /* Query initialization parameter (may not be supported on GrpD) */
+  s.have_param = (status_query_param(dev, PARAM_ID_INIT, &s.init_param) == 0);
+
+  /* Query key verification status */
+  s.key_secdbg = status_query_key_verify(dev, KEY_VFY_CMD, KYTY_SECDBG);
+  s.key_nonsecdbg = status_query_key_verify(dev, KEY_VFY_CMD, KYTY_NONSECDBG);
+  s.key_rma = status_query_key_verify(dev, KEY_VFY_CMD, KYTY_RMA);
+  s.authenticated = dev->authenticated;
+
+  device_view_init(&view, dev);
+  return status_report(&view, &s);
+}
+
+int
+ra_status_file(const char *file, input_format_t format) {
+  status_info_t s = { .offline = true, .key_secdbg = -1, .key_nonsecdbg = -1, .key_rma = -1 };
+  backup_view_t b;
+
+  if (backup_view_open(file, format, &b) < 0)
+    return -1;
+
+  status_decode_signature(b.dev.sig, b.dev.sig_len, &s);
+  if (s.noa == 0)
+    s.noa = b.dev.noa;
+  if (s.product[0] == '\0')
+    snprintf(s.product, sizeof(s.product), "unknown");
+
+  int ret = status_report(&b.view, &s);
+  backup_view_close(&b);
+  return ret;
+}
+
+/*
+ * Inventory: what incoming QA records of a board
+ * Queries only: signature, DLM state, boundary, OSIS and one CRC per area.
+ */
+typedef struct {
+  char port[RA_PORT_LEN];
+  const char *error; /* NULL when the board answered */
+  double secs;
+  status_info_t s;
+  char did[RASTORE_DID_HEX_LEN + 1];
+  osis_status_t osis;
+  int nr_areas;
+  ra_area_t areas[MAX_AREAS];
+  bool have_crc[MAX_AREAS];
+  uint32_t crc[MAX_AREAS];
+} inventory_t;
+
+/*
+ * Run the inventory queries over an open connection
+ * id_code: authenticate first (NULL if not needed or already done)
+ * Returns: 0 on success, -1 on error (inv->error says which query failed)
+ */
+static int
+inventory_query(ra_device_t *dev, const uint8_t *id_code, inventory_t *inv) {
+  if (ra_get_area_info(dev, false) < 0) {
+    inv->error = "area query failed";
+    return -1;
+  }
+  if (id_code != NULL && ra_authenticate(dev, id_code) < 0) {
+    inv->error = "ID authentication failed";
+    return -1;
+  }
+  if (query_signature(dev, false) < 0) {
+    inv->error = "signature query failed";
+    return -1;
+  }
+  status_decode_signature(dev->sig, dev->sig_len, &inv->s);
+  if (rastore_did_hex(dev->sig, dev->sig_len, inv->did) < 0)
+    inv->did[0] = '\0';
+
+  /* DLM and boundary may not be supported (GrpD) */
+  inv->s.have_dlm = (status_query_dlm(dev, &inv->s.dlm_state) == 0);
+  inv->s.have_boundary = (status_query_boundary(dev, &inv->s.bnd) == 0);
+  ra_osis_detect(dev, &inv->osis);
+
+  for (int i = 0; i < MAX_AREAS; i++) {
+    const ra_area_t *area = &dev->chip_layout[i];
+    int n = inv->nr_areas;
+
+    if (area->sad == 0 && area->ead == 0)
+      continue;
+    inv->areas[n] = *area;
+    if (area->cau != 0) {
+      dev->sel_area = i;
+      if (crc_query(dev, area->sad, area->ead, &inv->crc[n]) < 0) {
+        inv->error = "CRC query failed";
+        return -1;
+      }
+      inv->have_crc[n] = true;
+    }
+    inv->nr_areas++;
+  }
   return 0;
 }
 
+/* JSON string, escaped */
+static void
+json_string(FILE *out, const char *str) {
+  fputc('"', out);
+  for (const unsigned char *p = (const unsigned char *)str; *p != '\0'; p++) {
+    if (*p == '"' || *p == '\\')
+      fprintf(out, "\\%c", *p);
+    else if (*p < 0x20)
+      fprintf(out, "\\u%04x", *p);
+    else
+      fputc(*p, out);
+  }
+  fputc('"', out);
+}
+
+static const char *
+inventory_osis_token(osis_mode_t mode) {
+  switch (mode) {
+  case OSIS_MODE_UNLOCKED:
+    return "unlocked";
+  case OSIS_MODE_LOCKED:
+    return "locked";
+  case OSIS_MODE_DISABLED:
+    return "disabled";
+  default:
+    return "unknown";
+  }
+}
+
+/* One line per board, so records can be streamed as boards complete */
+static void
+inventory_print_json(FILE *out, const inventory_t *inv) {
+  const status_info_t *s = &inv->s;
+
+  fprintf(out, "{\"port\":");
+  json_string(out, inv->port);
+  fprintf(out, ",\"time\":%.3f", inv->secs);
+  if (inv->error != NULL) {
+    fprintf(out, ",\"error\":");
+    json_string(out, inv->error);
+    fprintf(out, "}\n");
+    return;
+  }
+
+  fprintf(out, ",\"did\":");
+  json_string(out, inv->did);
+  fprintf(out, ",\"product\":");
+  json_string(out, s->product);
+  fprintf(out,
+      ",\"type\":\"0x%02X\",\"bfv\":\"%u.%u.%u\"",
+      s->typ,
+      s->bfv_major,
+      s->bfv_minor,
+      s->bfv_build);
+  if (s->have_dlm)
+    fprintf(out, ",\"dlm\":\"%s\"", ra_dlm_state_name(s->dlm_state));
+  else
+    fprintf(out, ",\"dlm\":null");
+  if (s->have_boundary)
+    fprintf(out,
+        ",\"boundary\":{\"cfs1\":%u,\"cfs2\":%u,\"dfs\":%u,\"srs1\":%u,\"srs2\":%u}",
+        s->bnd.cfs1,
+        s->bnd.cfs2,
+        s->bnd.dfs,
+        s->bnd.srs1,
+        s->bnd.srs2);
+  else
+    fprintf(out, ",\"boundary\":null");
+  fprintf(out, ",\"osis\":\"%s\",\"areas\":[", inventory_osis_token(inv->osis.mode));
+  for (int i = 0; i < inv->nr_areas; i++) {
+    const ra_area_t *a = &inv->areas[i];
+
+    fprintf(out,
+        "%s{\"koa\":\"0x%02X\",\"start\":\"0x%08X\",\"end\":\"0x%08X\",",
+        i > 0 ? "," : "",
+        a->koa,
+        a->sad,
+        a->ead);
+    if (inv->have_crc[i])
+      fprintf(out, "\"crc\":\"0x%08X\"}", inv->crc[i]);
+    else
+      fprintf(out, "\"crc\":null}");
+  }
+  fprintf(out, "]}\n");
+}
+
+static void
+inventory_print_text(FILE *out, const inventory_t *inv) {
+  const status_info_t *s = &inv->s;
+
+  if (inv->error != NULL) {
+    fprintf(out, "%s: %s (%.2f s)\n", inv->port, inv->error, inv->secs);
+    return;
+  }
+
+  fprintf(out,
+      "%s: %s  DID %s  BFV %u.%u.%u  (%.2f s)\n",
+      inv->port,
+      s->product,
+      inv->did[0] != '\0' ? inv->did : "?",
+      s->bfv_major,
+      s->bfv_minor,
+      s->bfv_build,
+      inv->secs);
+  if (s->have_dlm)
+    fprintf(out, "  DLM:      %s\n", ra_dlm_state_name(s->dlm_state));
+  else
+    fprintf(out, "  DLM:      N/A\n");
+  if (s->have_boundary)
+    fprintf(out,
+        "  Boundary: CFS1=%uKB CFS2=%uKB DFS=%uKB SRS1=%uKB SRS2=%uKB\n",
+        s->bnd.cfs1,
+        s->bnd.cfs2,
+        s->bnd.dfs,
+        s->bnd.srs1,
+        s->bnd.srs2);
+  else
+    fprintf(out, "  Boundary: N/A\n");
+  fprintf(out, "  OSIS:     %s\n", ra_osis_mode_str(inv->osis.mode));
+  for (int i = 0; i < inv->nr_areas; i++) {
+    const ra_area_t *a = &inv->areas[i];
+
+    if (inv->have_crc[i])
+      fprintf(out,
+          "  %-18s 0x%08X-0x%08X  CRC-32: 0x%08X\n",
+          koa_label(a->koa),
+          a->sad,
+          a->ead,
+          inv->crc[i]);
+    else
+      fprintf(out, "  %-18s 0x%08X-0x%08X  (no CRC)\n", koa_label(a->koa), a->sad, a->ead);
+  }
+}
+
+static void
+inventory_print(const inventory_t *inv, bool json) {
+  if (json)
+    inventory_print_json(stdout, inv);
+  else
+    inventory_print_text(stdout, inv);
+  fflush(stdout);
+}
+
+int
+ra_inventory(ra_device_t *dev, const char *port, bool json) {
+  inventory_t inv = { 0 };
+  progress_time_t start;
+
+  progress_time_now(&start);
+  snprintf(inv.port, sizeof(inv.port), "%s", port != NULL ? port : "auto");
+  int ret = inventory_query(dev, NULL, &inv);
+  inv.secs = progress_time_since(&start);
+  inventory_print(&inv, json);
+  return ret;
+}
+
+/* One board of inventory --all, scanned by its own thread */
+typedef struct {
+  inventory_t inv;
+  const uint8_t *id_code;
+  bool layout_cache;
+  bool json;
+  ra_mutex_t *lock; /* Serializes the records on stdout */
+  ra_thread_t thread;
+  bool started;
+  int ret;
+} inventory_job_t;
+
+static void
+inventory_worker(void *arg) {
+  inventory_job_t *job = arg;
+  progress_time_t start;
+  ra_device_t dev;
+
+  progress_time_now(&start);
+  ra_dev_init(&dev);
+  dev.layout_cache = job->layout_cache;
+  if (ra_open(&dev, job->inv.port) < 0) {
+    job->inv.error = "connection failed";
+    job->ret = -1;
+  } else {
+    job->ret = inventory_query(&dev, job->id_code, &job->inv);
+    ra_close(&dev);
+  }
+  job->inv.secs = progress_time_since(&start);
+
+  ra_mutex_lock(job->lock);
+  inventory_print(&job->inv, job->json);
+  ra_mutex_unlock(job->lock);
+}
+
+int
+ra_inventory_all(const uint8_t *id_code, bool json, bool layout_cache) {
+  char(*ports)[RA_PORT_LEN] = calloc(RA_MAX_PORTS, sizeof(*ports));
+  inventory_job_t *jobs = NULL;
+  progress_time_t start;
+  ra_mutex_t lock;
+  int failed = 0;
+
+  if (ports == NULL) {
+    warnx("out of memory");
+    return -1;
+  }
+  int count = ra_find_ports(ports, RA_MAX_PORTS);
+  if (count == 0) {
+    warnx("no Renesas device found");
+    free(ports);
+    return -1;
+  }
+  jobs = calloc((size_t)count, sizeof(*jobs));
+  if (jobs == NULL) {
+    warnx("out of memory");
+    free(ports);
+    return -1;
+  }
+
+  /* Each board waits on its own link: the slowest one bounds the total */
+  progress_time_now(&start);
+  ra_mutex_init(&lock);
+  for (int i = 0; i < count; i++) {
+    inventory_job_t *job = &jobs[i];
+
+    snprintf(job->inv.port, sizeof(job->inv.port), "%s", ports[i]);
+    job->id_code = id_code;
+    job->layout_cache = layout_cache;
+    job->json = json;
+    job->lock = &lock;
+    job->started = (ra_thread_start(&job->thread, inventory_worker, job) == 0);
+  }
+  for (int i = 0; i < count; i++) {
+    /* A thread that did not start: scan that board now */
+    if (jobs[i].started)
+      ra_thread_join(&jobs[i].thread);
+    else
+      inventory_worker(&jobs[i]);
+    if (jobs[i].ret < 0)
+      failed++;
+  }
+  ra_mutex_destroy(&lock);
+
+  fprintf(stderr,
+      "Inventory: %d boards, %d failed in %.2f s\n",
+      count,
+      failed,
+      progress_time_since(&start));
+  free(jobs);
+  free(ports);
+  return failed > 0 ? -1 : 0;
+}
+
 /*
  * Known command names for protocol analysis
  */
@@ -4113,9 +5573,7 @@ print_packet_analysis(const char *direction, const uint8_t *pkt, size_t len, boo
     uint8_t etx = pkt[len - 1];
 
     /* Verify checksum */
-    uint8_t calc_sum = 0;
-    for (size_t i = 1; i < len - 2; i++)
-      calc_sum += pkt[i];
+    uint8_t calc_sum = (uint8_t)rabuf_sum(pkt + 1, len - 3);
     calc_sum = (~calc_sum + 1) & 0xFF;
 
     printf("    SUM: 0x%02X (%s)\n", sum, sum == calc_sum ? "valid" : "INVALID");
@@ -4150,6 +5608,9 @@ ra_raw_cmd(ra_device_t *dev, uint8_t cmd, const uint8_t *data, size_t data_len)
   /* Display TX packet */
   print_packet_analysis("TX", pkt, (size_t)pkt_len, false);
 
+  /* A raw command may erase or write anything: trust no cached byte after it */
+  ra_cache_invalidate_all(dev->cache);
+
   /* Send command */
   if (ra_send(dev, pkt, pkt_len) < 0) {
     warnx("failed to send command");
@@ -4234,29 +5695,167 @@ ra_raw_cmd(ra_device_t *dev, uint8_t cmd, const uint8_t *data, size_t data_len)
   return 0;
 }
 
-int
-ra_backup(ra_device_t *dev, const char *file, output_format_t format) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[CHUNK_SIZE + 6];
-  uint8_t chunk[CHUNK_SIZE];
-  uint8_t data[8];
-  ssize_t pkt_len, n;
+/* Previous backup an incremental backup starts from */
+typedef struct {
+  bool is_rbk;
+  rbk_t rbk;
+  parsed_file_t parsed;
+} backup_base_t;
 
-  /* Auto-detect format from extension */
-  if (format == FORMAT_AUTO)
-    format = format_detect(file);
+static int
+backup_base_open(ra_device_t *dev, const char *file, backup_base_t *b) {
+  memset(b, 0, sizeof(*b));
 
-  /* Validate format - BIN cannot represent sparse data */
-  if (format == FORMAT_BIN) {
-    warnx("backup requires Intel HEX (-F ihex) or S-record (-F srec) format");
-    warnx("use .hex or .srec extension, or specify format with -F");
+  /* Native backups are decoded area by area, never as one flat image */
+  if (format_detect(file) == FORMAT_RBK) {
+    if (rbk_open(file, &b->rbk) < 0)
+      return -1;
+    b->is_rbk = true;
+    if (b->rbk.sig_len >= SIG_DID_OFFSET + SIG_DID_LEN &&
+        dev->sig_len >= SIG_DID_OFFSET + SIG_DID_LEN &&
+        memcmp(&b->rbk.sig[SIG_DID_OFFSET], &dev->sig[SIG_DID_OFFSET], SIG_DID_LEN) != 0)
+      warnx("base backup was taken from another device, expect more blocks to read");
+    return 0;
+  }
+
+  if (format_parse(file, FORMAT_AUTO, &b->parsed) < 0)
+    return -1;
+  if (!b->parsed.has_addr) {
+    warnx("base backup needs embedded address info (Intel HEX, S-record or .rbk)");
+    free(b->parsed.data);
     return -1;
   }
+  return 0;
+}
 
-  /* Ensure chip layout is populated */
-  if (ra_get_area_info(dev, false) < 0)
+static void
+backup_base_close(backup_base_t *b) {
+  if (b->is_rbk)
+    rbk_close(&b->rbk);
+  else
+    free(b->parsed.data);
+}
+
+/*
+ * Copy the part of an image that falls in an area (0xFF elsewhere)
+ */
+STATIC void
+image_fill_area(const parsed_file_t *parsed, const ra_area_t *area, uint8_t *buf) {
+  uint32_t file_end = parsed->base_addr + (uint32_t)parsed->size - 1;
+
+  memset(buf, 0xFF, (size_t)(area->ead - area->sad) + 1);
+  if (parsed->size == 0 || area->ead < parsed->base_addr || area->sad > file_end)
+    return;
+
+  uint32_t lo = area->sad > parsed->base_addr ? area->sad : parsed->base_addr;
+  uint32_t hi = area->ead < file_end ? area->ead : file_end;
+  format_copy(parsed, lo - parsed->base_addr, buf + (lo - area->sad), hi - lo + 1);
+}
+
+/*
+ * Seed an area buffer with what the base backup holds for it (0xFF elsewhere)
+ * Blocks that fail to decode stay 0xFF: their CRC will not match, so they
+ * are read from the device like any changed block.
+ */
+static void
+backup_base_fill(const backup_base_t *b, const ra_area_t *area, uint8_t *buf) {
+  if (!b->is_rbk) {
+    image_fill_area(&b->parsed, area, buf);
+    return;
+  }
+
+  memset(buf, 0xFF, (size_t)(area->ead - area->sad) + 1);
+
+  for (uint32_t n = 0; n < b->rbk.nr_areas; n++) {
+    const rbk_area_t *a = &b->rbk.areas[n];
+    for (uint32_t i = 0; i < a->nr_blocks; i++) {
+      uint32_t addr = a->area.sad + i * RBK_BLOCK_SIZE;
+      uint32_t len = rbk_block_len(a, i);
+      if (addr < area->sad || addr + (len - 1) > area->ead)
+        continue;
+      rbk_block_read(&b->rbk, a, i, buf + (addr - area->sad));
+    }
+  }
+}
+
+/* Incremental backup: a unit whose CRC changed is read into the area image */
+static int
+backup_leaf(diff_ctx_t *ctx, uint32_t start, uint32_t end) {
+  size_t size = (size_t)(end - start) + 1;
+  uint32_t read_end;
+
+  if (set_read_boundaries(ctx->dev, start, (uint32_t)size, &read_end) < 0)
+    return -1;
+  if (read_range_into(
+          ctx->dev, start, ctx->parsed->data + (start - ctx->base), size, NULL, "backup read") < 0)
     return -1;
+  ctx->bytes_read += (uint32_t)size;
+  return 0;
+}
+
+/*
+ * Bisection leaf of an incremental backup: the erase block, or the whole area
+ * when CRC needs exact boundaries (config) or blocks do not tile it
+ */
+STATIC uint32_t
+backup_delta_unit(const ra_area_t *area) {
+  uint32_t area_size = area->ead - area->sad + 1;
+  uint32_t unit = area->eau > area->cau ? area->eau : area->cau;
+
+  if (area->koa == KOA_TYPE_CONFIG || unit == 0 || area_size % unit != 0)
+    return area_size;
+  return unit;
+}
+
+/*
+ * Refresh an area image seeded from the base backup
+ * CRC bisection on erase blocks, as diff does: one CRC command for an
+ * unchanged area, and only the blocks that changed are read.
+ */
+static int
+backup_area_delta(ra_device_t *dev,
+    const ra_area_t *area,
+    uint8_t *buf,
+    uint32_t *crc_cmds,
+    uint64_t *bytes_read) {
+  uint32_t area_size = area->ead - area->sad + 1;
+  parsed_file_t image = {
+    .data = buf,
+    .size = area_size,
+    .base_addr = area->sad,
+    .has_addr = 1,
+  };
+  diff_ctx_t ctx = {
+    .dev = dev,
+    .parsed = &image,
+    .base = area->sad,
+    .leaf = backup_leaf,
+  };
+
+  if (diff_range(&ctx, area->sad, area->ead, backup_delta_unit(area), false) < 0)
+    return -1;
+  *crc_cmds += ctx.crc_cmds;
+  *bytes_read += ctx.bytes_read;
+
+  if (ctx.bytes_read == 0)
+    fprintf(stderr, "  unchanged since base (%u CRC commands)\n", ctx.crc_cmds);
+  else
+    fprintf(stderr,
+        "  %.1f KB changed and read (%u CRC commands)\n",
+        ctx.bytes_read / 1024.0,
+        ctx.crc_cmds);
+  return 0;
+}
 
+/*
+ * Read every readable area into its own buffer
+ * areas/buffers receive one entry per area read (MAX_AREAS room); buffers are
+ * left for the caller to free, also on error.
+ * base: previous backup of the device, only changed blocks are read (may be NULL)
+ * Returns: number of areas, -1 on error
+ */
+static int
+backup_read_areas(ra_device_t *dev, ra_area_t *areas, uint8_t **buffers, const char *base) {
   /* Count readable areas and calculate total size */
   size_t num_regions = 0;
   size_t total_size = 0;
@@ -4275,58 +5874,35 @@ ra_backup(ra_device_t *dev, const char *file, output_format_t format) {
 
   fprintf(stderr, "Backing up %zu regions (%.1f KB total)...\n", num_regions, total_size / 1024.0);
 
-  /* Allocate region array and data buffers */
-  backup_region_t *regions = calloc(num_regions, sizeof(backup_region_t));
-  if (!regions) {
-    warnx("failed to allocate region array");
-    return -1;
-  }
-
-  uint8_t **buffers = calloc(num_regions, sizeof(uint8_t *));
-  if (!buffers) {
-    free(regions);
-    warnx("failed to allocate buffer array");
-    return -1;
+  backup_base_t prev;
+  if (base != NULL) {
+    if (backup_base_open(dev, base, &prev) < 0)
+      return -1;
+    fprintf(stderr, "Incremental from %s\n", base);
   }
 
-  int ret = 0;
-  size_t region_idx = 0;
+  int count = 0;
+  uint32_t crc_cmds = 0;
+  uint64_t bytes_read = 0;
 
   /* Read each area */
-  for (int i = 0; i < MAX_AREAS && region_idx < num_regions; i++) {
+  for (int i = 0; i < MAX_AREAS; i++) {
     ra_area_t *area = &dev->chip_layout[i];
     if (area->ead == 0 || area->rau == 0)
-      continue;
-
-    uint32_t area_size = area->ead - area->sad + 1;
-    uint8_t *buffer = malloc(area_size);
-    if (!buffer) {
-      warnx("failed to allocate buffer for area %d", i);
-      ret = -1;
-      goto cleanup;
-    }
-    buffers[region_idx] = buffer;
-
-    /* Show area type */
-    const char *area_name;
-    switch (area->koa) {
-    case KOA_TYPE_CODE:
-      area_name = "code flash";
-      break;
-    case KOA_TYPE_CODE1:
-      area_name = "code flash bank 1";
-      break;
-    case KOA_TYPE_DATA:
-      area_name = "data flash";
-      break;
-    case KOA_TYPE_CONFIG:
-      area_name = "config area";
-      break;
-    default:
-      area_name = "unknown";
+      continue;
+
+    uint32_t area_size = area->ead - area->sad + 1;
+    uint8_t *buffer = malloc(area_size);
+    if (!buffer) {
+      warnx("failed to allocate buffer for area %d", i);
+      count = -1;
       break;
     }
+    buffers[count] = buffer;
+    areas[count] = *area;
+    count++;
 
+    const char *area_name = koa_label(area->koa);
     fprintf(stderr,
         "Reading area %d (%s): 0x%08X - 0x%08X (%.1f KB)\n",
         i,
@@ -4335,77 +5911,128 @@ ra_backup(ra_device_t *dev, const char *file, output_format_t format) {
         area->ead,
         area_size / 1024.0);
 
+    /* Areas without CRC support are read in full */
+    if (base != NULL && area->cau != 0) {
+      backup_base_fill(&prev, area, buffer);
+      if (backup_area_delta(dev, area, buffer, &crc_cmds, &bytes_read) < 0) {
+        count = -1;
+        break;
+      }
+      continue;
+    }
+
     /* Read area using single-packet reads (WORKAROUND for multi-packet ACK issue) */
     uint32_t nr_chunks = (area_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
     progress_t prog;
-    progress_init(&prog, nr_chunks, area_name);
-
-    uint32_t current_addr = area->sad;
-    size_t buffer_offset = 0;
+    dev_progress_init(dev, &prog, nr_chunks, area_size, area_name);
 
-    for (uint32_t j = 0; j < nr_chunks; j++) {
-      uint32_t chunk_start = current_addr;
-      uint32_t remaining = area->ead - chunk_start + 1;
-      uint32_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
-      uint32_t chunk_end = chunk_start + chunk_size - 1;
-
-      /* Send single-packet READ command */
-      uint32_to_be(chunk_start, &data[0]);
-      uint32_to_be(chunk_end, &data[4]);
+    if (read_range_into(dev, area->sad, buffer, area_size, &prog, "backup read") < 0) {
+      count = -1;
+      break;
+    }
+    bytes_read += area_size;
 
-      pkt_len = ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, data, 8, false);
-      if (pkt_len < 0) {
-        ret = -1;
-        goto cleanup;
-      }
+    progress_finish(&prog);
+  }
 
-      if (ra_send(dev, pkt, pkt_len) < 0) {
-        ret = -1;
-        goto cleanup;
-      }
+  if (base != NULL) {
+    backup_base_close(&prev);
+    if (count > 0)
+      fprintf(stderr,
+          "Incremental: %.1f KB of %.1f KB read, %u CRC commands\n",
+          bytes_read / 1024.0,
+          total_size / 1024.0,
+          crc_cmds);
+  }
+  return count;
+}
 
-      n = ra_recv(dev, resp, CHUNK_SIZE + 6, 2000);
-      if (n < 7) {
-        warnx("short response during read (%zd bytes)", n);
-        ret = -1;
-        goto cleanup;
-      }
+int
+ra_backup(ra_device_t *dev, const char *file, output_format_t format, const char *base) {
+  /* Auto-detect format from extension */
+  if (format == FORMAT_AUTO)
+    format = format_detect(file);
 
-      size_t chunk_len;
-      if (unpack_with_error(resp, n, chunk, &chunk_len, "backup read") < 0) {
-        ret = -1;
-        goto cleanup;
-      }
+  /* Validate format - BIN cannot represent sparse data */
+  if (format != FORMAT_IHEX && format != FORMAT_SREC && format != FORMAT_RBK) {
+    warnx("backup requires Intel HEX (-F ihex), S-record (-F srec) or native (-F rbk) format");
+    warnx("use .hex, .srec or .rbk extension, or specify format with -F");
+    return -1;
+  }
 
-      memcpy(buffer + buffer_offset, chunk, chunk_len);
-      buffer_offset += chunk_len;
-      current_addr += chunk_size;
+  /* Ensure chip layout is populated; the native format keeps the signature, base checks it */
+  if (ra_get_area_info(dev, false) < 0)
+    return -1;
+  if ((format == FORMAT_RBK || base != NULL) && query_signature(dev, false) < 0)
+    return -1;
 
-      progress_update(&prog, j + 1);
-    }
+  ra_area_t areas[MAX_AREAS];
+  uint8_t *buffers[MAX_AREAS] = { NULL };
+  backup_region_t regions[MAX_AREAS];
 
-    progress_finish(&prog);
+  int ret = backup_read_areas(dev, areas, buffers, base);
+  int count = ret;
+  if (ret < 0)
+    goto cleanup;
 
-    /* Store region info */
-    regions[region_idx].data = buffer;
-    regions[region_idx].size = buffer_offset;
-    regions[region_idx].addr = area->sad;
-    region_idx++;
+  for (int i = 0; i < count; i++) {
+    regions[i].data = buffers[i];
+    regions[i].size = areas[i].ead - areas[i].sad + 1;
+    regions[i].addr = areas[i].sad;
   }
 
   /* Write all regions to file */
   fprintf(stderr, "Writing backup to %s (%s format)...\n", file, format_name(format));
-  ret = format_write_multi(file, format, regions, num_regions);
+  if (format == FORMAT_RBK)
+    ret = rbk_write(
+        file, dev->sig, dev->sig_len, areas, (const uint8_t *const *)buffers, (size_t)count);
+  else
+    ret = format_write_multi(file, format, regions, (size_t)count);
+  if (ret == 0) {
+    fprintf(stderr, "Backup complete: %d regions saved to %s\n", count, file);
+  }
+
+cleanup:
+  for (int i = 0; i < MAX_AREAS; i++) {
+    free(buffers[i]);
+  }
+  return ret;
+}
+
+int
+ra_backup_store(ra_device_t *dev, const char *dir, const char *base) {
+  ra_area_t areas[MAX_AREAS];
+  uint8_t *buffers[MAX_AREAS] = { NULL };
+  rastore_stats_t stats;
+
+  /* The manifest is named after the DID, kept in the signature */
+  if (ra_get_area_info(dev, false) < 0 || query_signature(dev, false) < 0)
+    return -1;
+
+  int ret = backup_read_areas(dev, areas, buffers, base);
+  int count = ret;
+  if (ret < 0)
+    goto cleanup;
+
+  fprintf(stderr, "Adding backup to store %s...\n", dir);
+  ret = rastore_put(
+      dir, dev->sig, dev->sig_len, areas, (const uint8_t *const *)buffers, (size_t)count, &stats);
   if (ret == 0) {
-    fprintf(stderr, "Backup complete: %zu regions saved to %s\n", num_regions, file);
+    char did_hex[RASTORE_DID_HEX_LEN + 1];
+    rastore_did_hex(dev->sig, dev->sig_len, did_hex);
+    fprintf(stderr,
+        "Backup complete: device %s, %u blocks (%u erased), %u new (%.1f KB stored)\n",
+        did_hex,
+        stats.blocks,
+        stats.blank,
+        stats.added,
+        stats.added_len / 1024.0);
   }
 
 cleanup:
-  for (size_t i = 0; i < num_regions; i++) {
+  for (int i = 0; i < MAX_AREAS; i++) {
     free(buffers[i]);
   }
-  free(buffers);
-  free(regions);
   return ret;
 }
 
@@ -4419,61 +6046,27 @@ restore_write_region(ra_device_t *dev,
     uint32_t addr,
     const char *name,
     bool verify) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[64];
-  uint8_t cmd_data[8];
-  ssize_t pkt_len, n;
+  ra_op_t op;
 
   uint32_t nr_chunks = ((uint32_t)size + CHUNK_SIZE - 1) / CHUNK_SIZE;
 
   progress_t prog;
-  progress_init(&prog, nr_chunks, name);
+  dev_progress_init(dev, &prog, nr_chunks, size, name);
 
   size_t offset = 0;
   for (uint32_t i = 0; i < nr_chunks; i++) {
-    uint32_t chunk_start = addr + (uint32_t)offset;
     size_t remaining = size - offset;
     size_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
-    uint32_t chunk_end = chunk_start + (uint32_t)chunk_size - 1;
-
-    /* Send WRITE command */
-    uint32_to_be(chunk_start, &cmd_data[0]);
-    uint32_to_be(chunk_end, &cmd_data[4]);
-
-    pkt_len = ra_pack_pkt(pkt, sizeof(pkt), WRI_CMD, cmd_data, 8, false);
-    if (pkt_len < 0)
-      return -1;
-
-    if (ra_send(dev, pkt, pkt_len) < 0)
-      return -1;
-
-    /* Wait for ACK */
-    n = ra_recv(dev, resp, sizeof(resp), 2000);
-    if (n < 7) {
-      warnx("short response during write setup (%zd bytes)", n);
-      return -1;
-    }
-
-    size_t dlen;
-    if (unpack_with_error(resp, n, NULL, &dlen, "write setup") < 0)
-      return -1;
-
-    /* Send data packet */
-    pkt_len = ra_pack_pkt(pkt, sizeof(pkt), WRI_CMD, data + offset, chunk_size, true);
-    if (pkt_len < 0)
-      return -1;
-
-    if (ra_send(dev, pkt, pkt_len) < 0)
-      return -1;
-
-    /* Wait for completion ACK */
-    n = ra_recv(dev, resp, sizeof(resp), 5000);
-    if (n < 7) {
-      warnx("short response during write (%zd bytes)", n);
-      return -1;
-    }
 
-    if (unpack_with_error(resp, n, NULL, &dlen, "write") < 0)
+    /* One WRI per chunk, data sent straight from the backup buffer */
+    ra_op_write(&op,
+        dev,
+        addr + (uint32_t)offset,
+        data + offset,
+        (uint32_t)chunk_size,
+        (uint32_t)chunk_size);
+    op.context = "write";
+    if (ra_op_run(&op) < 0)
       return -1;
 
     offset += chunk_size;
@@ -4484,7 +6077,7 @@ restore_write_region(ra_device_t *dev,
 
   /* Verify if requested */
   if (verify) {
-    progress_init(&prog, nr_chunks, "Verifying");
+    dev_progress_init(dev, &prog, nr_chunks, size, "Verifying");
     uint8_t flash_chunk[CHUNK_SIZE];
 
     offset = 0;
@@ -4492,41 +6085,19 @@ restore_write_region(ra_device_t *dev,
       uint32_t chunk_start = addr + (uint32_t)offset;
       size_t remaining = size - offset;
       size_t chunk_size = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
-      uint32_t chunk_end = chunk_start + (uint32_t)chunk_size - 1;
-
-      /* Send READ command */
-      uint32_to_be(chunk_start, &cmd_data[0]);
-      uint32_to_be(chunk_end, &cmd_data[4]);
-
-      pkt_len = ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, cmd_data, 8, false);
-      if (pkt_len < 0)
-        return -1;
 
-      if (ra_send(dev, pkt, pkt_len) < 0)
-        return -1;
-
-      uint8_t read_resp[CHUNK_SIZE + 6];
-      n = ra_recv(dev, read_resp, CHUNK_SIZE + 6, 2000);
-      if (n < 7) {
-        warnx("short response during verify (%zd bytes)", n);
-        return -1;
-      }
-
-      size_t chunk_len;
-      if (unpack_with_error(read_resp, n, flash_chunk, &chunk_len, "verify read") < 0)
+      if (read_chunk_into(dev, chunk_start, flash_chunk, chunk_size, "verify read") < 0)
         return -1;
+      size_t chunk_len = chunk_size;
 
       /* Compare */
-      if (memcmp(flash_chunk, data + offset, chunk_len) != 0) {
-        for (size_t j = 0; j < chunk_len; j++) {
-          if (flash_chunk[j] != data[offset + j]) {
-            warnx("verify mismatch at 0x%08X: expected 0x%02X, got 0x%02X",
-                chunk_start + (uint32_t)j,
-                data[offset + j],
-                flash_chunk[j]);
-            return -1;
-          }
-        }
+      size_t j = rabuf_mismatch(flash_chunk, data + offset, chunk_len);
+      if (j < chunk_len) {
+        warnx("verify mismatch at 0x%08X: expected 0x%02X, got 0x%02X",
+            chunk_start + (uint32_t)j,
+            data[offset + j],
+            flash_chunk[j]);
+        return -1;
       }
 
       offset += chunk_size;
@@ -4539,10 +6110,261 @@ restore_write_region(ra_device_t *dev,
   return 0;
 }
 
+/*
+ * Full erase of all code flash and data flash areas before a restore
+ */
+static int
+restore_erase(ra_device_t *dev) {
+  fprintf(stderr, "Performing full chip erase...\n");
+
+  for (int i = 0; i < MAX_AREAS; i++) {
+    ra_area_t *area = &dev->chip_layout[i];
+    if (area->ead == 0 || area->eau == 0)
+      continue;
+
+    /* Erase code and data flash areas (skip config) */
+    if (area->koa == KOA_TYPE_CODE || area->koa == KOA_TYPE_CODE1 || area->koa == KOA_TYPE_DATA) {
+      const char *area_name;
+      switch (area->koa) {
+      case KOA_TYPE_CODE:
+        area_name = "code flash";
+        break;
+      case KOA_TYPE_CODE1:
+        area_name = "code flash bank 1";
+        break;
+      case KOA_TYPE_DATA:
+        area_name = "data flash";
+        break;
+      default:
+        area_name = "unknown";
+        break;
+      }
+
+      fprintf(
+          stderr, "Erasing area %d (%s): 0x%08X - 0x%08X\n", i, area_name, area->sad, area->ead);
+
+      if (ra_erase(dev, area->sad, area->ead - area->sad + 1) < 0) {
+        warnx("failed to erase area %d", i);
+        return -1;
+      }
+    }
+  }
+
+  fprintf(stderr, "Erase complete\n");
+  return 0;
+}
+
+/*
+ * Blocks of a backup, wherever they are kept (native file or block store)
+ * Both cut areas into RBK_BLOCK_SIZE blocks, the last one possibly shorter.
+ */
+typedef struct {
+  const uint8_t *sig;
+  size_t sig_len;
+  uint32_t nr_areas;
+  const ra_area_t *(*area)(const void *ctx, uint32_t n);
+  bool (*blank)(const void *ctx, uint32_t n, uint32_t b);
+  int (*read)(const void *ctx, uint32_t n, uint32_t b, uint8_t *out);
+  const void *ctx;
+} block_source_t;
+
+static uint32_t
+source_blocks(const ra_area_t *area) {
+  return (uint32_t)(((uint64_t)area->ead - area->sad + RBK_BLOCK_SIZE) / RBK_BLOCK_SIZE);
+}
+
+static uint32_t
+source_block_len(const ra_area_t *area, uint32_t b) {
+  uint32_t left = area->ead - area->sad - b * RBK_BLOCK_SIZE;
+  return left < RBK_BLOCK_SIZE ? left + 1 : RBK_BLOCK_SIZE;
+}
+
+/*
+ * Restore a block-indexed backup, one area at a time
+ * Erased blocks are skipped; each run of data blocks is decoded on its own,
+ * so only the blocks written are ever expanded.
+ */
+static int
+restore_blocks(ra_device_t *dev, const block_source_t *src, bool verify) {
+  uint8_t *buf = NULL;
+  int ret;
+
+  if (ra_get_area_info(dev, false) < 0 || query_signature(dev, false) < 0)
+    return -1;
+
+  /* Product type name (PTN): a different part usually means another layout */
+  if (src->sig_len >= 41 && dev->sig_len >= 41 && memcmp(&src->sig[25], &dev->sig[25], 16) != 0)
+    warnx("backup was taken from a %.16s, device is a %.16s",
+        (const char *)&src->sig[25],
+        (const char *)&dev->sig[25]);
+
+  ret = restore_erase(dev);
+  for (uint32_t n = 0; n < src->nr_areas && ret == 0; n++) {
+    const ra_area_t *area = src->area(src->ctx, n);
+    if (area->koa == KOA_TYPE_CONFIG)
+      continue;
+
+    int i = find_area_for_address(dev, area->sad);
+    if (i < 0 || dev->chip_layout[i].wau == 0 || area->ead > dev->chip_layout[i].ead) {
+      warnx("backup area 0x%08X - 0x%08X does not fit the device, skipped", area->sad, area->ead);
+      continue;
+    }
+
+    uint32_t nr_blocks = source_blocks(area);
+    uint32_t used = 0;
+    for (uint32_t b = 0; b < nr_blocks; b++)
+      used += !src->blank(src->ctx, n, b);
+    fprintf(stderr,
+        "Writing area %d (%s): 0x%08X - 0x%08X (%u of %u blocks)\n",
+        i,
+        koa_label(area->koa),
+        area->sad,
+        area->ead,
+        used,
+        nr_blocks);
+
+    for (uint32_t b = 0; b < nr_blocks && ret == 0; b++) {
+      if (src->blank(src->ctx, n, b))
+        continue;
+
+      /* Extend over the run of data blocks */
+      uint32_t e = b + 1;
+      while (e < nr_blocks && !src->blank(src->ctx, n, e))
+        e++;
+
+      size_t len = (size_t)(e - 1 - b) * RBK_BLOCK_SIZE + source_block_len(area, e - 1);
+      uint8_t *run = realloc(buf, len);
+      if (run == NULL) {
+        warnx("memory allocation failed");
+        ret = -1;
+        break;
+      }
+      buf = run;
+
+      for (uint32_t k = b; k < e && ret == 0; k++)
+        ret = src->read(src->ctx, n, k, buf + (size_t)(k - b) * RBK_BLOCK_SIZE);
+      if (ret == 0)
+        ret = restore_write_region(
+            dev, buf, len, area->sad + b * RBK_BLOCK_SIZE, koa_label(area->koa), verify);
+      b = e - 1;
+    }
+  }
+
+  if (ret == 0)
+    fprintf(stderr, "Restore complete\n");
+  free(buf);
+  return ret;
+}
+
+static const ra_area_t *
+rbk_source_area(const void *ctx, uint32_t n) {
+  return &((const rbk_t *)ctx)->areas[n].area;
+}
+
+static bool
+rbk_source_blank(const void *ctx, uint32_t n, uint32_t b) {
+  return rbk_block_blank(&((const rbk_t *)ctx)->areas[n], b);
+}
+
+static int
+rbk_source_read(const void *ctx, uint32_t n, uint32_t b, uint8_t *out) {
+  const rbk_t *rbk = ctx;
+  return rbk_block_read(rbk, &rbk->areas[n], b, out);
+}
+
+static int
+restore_rbk(ra_device_t *dev, const char *file, bool verify) {
+  rbk_t rbk;
+
+  if (rbk_open(file, &rbk) < 0)
+    return -1;
+
+  fprintf(stderr, "Restore file: %s\n", file);
+
+  block_source_t src = {
+    .sig = rbk.sig,
+    .sig_len = rbk.sig_len,
+    .nr_areas = rbk.nr_areas,
+    .area = rbk_source_area,
+    .blank = rbk_source_blank,
+    .read = rbk_source_read,
+    .ctx = &rbk,
+  };
+  int ret = restore_blocks(dev, &src, verify);
+  rbk_close(&rbk);
+  return ret;
+}
+
+/* A device manifest and the store holding its blocks */
+typedef struct {
+  const char *dir;
+  rastore_manifest_t m;
+} store_source_t;
+
+static const ra_area_t *
+store_source_area(const void *ctx, uint32_t n) {
+  return &((const store_source_t *)ctx)->m.areas[n].area;
+}
+
+static bool
+store_source_blank(const void *ctx, uint32_t n, uint32_t b) {
+  return ((const store_source_t *)ctx)->m.areas[n].blocks[b].blank;
+}
+
+static int
+store_source_read(const void *ctx, uint32_t n, uint32_t b, uint8_t *out) {
+  const store_source_t *st = ctx;
+  const rastore_area_t *a = &st->m.areas[n];
+  return rastore_block(st->dir, a->blocks[b].hash, out, rastore_block_len(a, b));
+}
+
+int
+ra_restore_store(ra_device_t *dev, const char *dir, const char *did_hex, bool verify) {
+  char did[RASTORE_DID_HEX_LEN + 1];
+  store_source_t st = { .dir = dir };
+
+  /* Default to this device's own last backup */
+  if (did_hex == NULL) {
+    if (query_signature(dev, false) < 0)
+      return -1;
+    if (rastore_did_hex(dev->sig, dev->sig_len, did) < 0) {
+      warnx("device signature carries no DID, name the backup to restore");
+      return -1;
+    }
+  } else {
+    /* Manifests are named in lowercase */
+    snprintf(did, sizeof(did), "%s", did_hex);
+    for (char *p = did; *p != '\0'; p++)
+      *p = (char)tolower((unsigned char)*p);
+  }
+  did_hex = did;
+
+  if (rastore_load(dir, did_hex, &st.m) < 0)
+    return -1;
+
+  fprintf(stderr, "Restore from store %s: device %s\n", dir, did_hex);
+
+  block_source_t src = {
+    .sig = st.m.sig,
+    .sig_len = st.m.sig_len,
+    .nr_areas = st.m.nr_areas,
+    .area = store_source_area,
+    .blank = store_source_blank,
+    .read = store_source_read,
+    .ctx = &st,
+  };
+  int ret = restore_blocks(dev, &src, verify);
+  rastore_free(&st.m);
+  return ret;
+}
+
 int
 ra_restore(ra_device_t *dev, const char *file, input_format_t format, bool verify) {
   parsed_file_t parsed;
 
+  if (format == FORMAT_RBK || (format == FORMAT_AUTO && format_detect(file) == FORMAT_RBK))
+    return restore_rbk(dev, file, verify);
+
   /* Parse input file */
   if (format_parse(file, format, &parsed) < 0)
     return -1;
@@ -4593,50 +6415,16 @@ ra_restore(ra_device_t *dev, const char *file, input_format_t format, bool verif
 
   if (region_count == 0) {
     warnx("no flash areas overlap with file data (0x%08X - 0x%08X)", file_start, file_end);
-    free(parsed.data);
-    return -1;
-  }
-
-  fprintf(stderr, "  Regions to restore: %d (%.1f KB total)\n", region_count, total_size / 1024.0);
-
-  /* Full erase: erase all code flash and data flash areas */
-  fprintf(stderr, "Performing full chip erase...\n");
-
-  for (int i = 0; i < MAX_AREAS; i++) {
-    ra_area_t *area = &dev->chip_layout[i];
-    if (area->ead == 0 || area->eau == 0)
-      continue;
-
-    /* Erase code and data flash areas (skip config) */
-    if (area->koa == KOA_TYPE_CODE || area->koa == KOA_TYPE_CODE1 || area->koa == KOA_TYPE_DATA) {
-      const char *area_name;
-      switch (area->koa) {
-      case KOA_TYPE_CODE:
-        area_name = "code flash";
-        break;
-      case KOA_TYPE_CODE1:
-        area_name = "code flash bank 1";
-        break;
-      case KOA_TYPE_DATA:
-        area_name = "data flash";
-        break;
-      default:
-        area_name = "unknown";
-        break;
-      }
-
-      fprintf(
-          stderr, "Erasing area %d (%s): 0x%08X - 0x%08X\n", i, area_name, area->sad, area->ead);
-
-      if (ra_erase(dev, area->sad, area->ead - area->sad + 1) < 0) {
-        warnx("failed to erase area %d", i);
-        free(parsed.data);
-        return -1;
-      }
-    }
+    free(parsed.data);
+    return -1;
   }
 
-  fprintf(stderr, "Erase complete\n");
+  fprintf(stderr, "  Regions to restore: %d (%.1f KB total)\n", region_count, total_size / 1024.0);
+
+  if (restore_erase(dev) < 0) {
+    free(parsed.data);
+    return -1;
+  }
 
   /* Write each region that overlaps with file data */
   fprintf(stderr, "Writing data from backup...\n");
@@ -4685,8 +6473,13 @@ ra_restore(ra_device_t *dev, const char *file, input_format_t format, bool verif
         overlap_end,
         overlap_size / 1024.0);
 
-    if (restore_write_region(
-            dev, parsed.data + data_offset, overlap_size, overlap_start, area_name, verify) < 0) {
+    uint8_t *staged;
+    const uint8_t *data = image_bytes(&parsed, data_offset, overlap_size, &staged);
+    int ret = data != NULL ? restore_write_region(
+                                 dev, data, overlap_size, overlap_start, area_name, verify)
+                           : -1;
+    free(staged);
+    if (ret < 0) {
       free(parsed.data);
       return -1;
     }
@@ -4698,46 +6491,409 @@ ra_restore(ra_device_t *dev, const char *file, input_format_t format, bool verif
 }
 
 /*
- * FM2APP boot preference partition reader
- * Reads and displays the boot_pref_partition structure from data flash.
+ * Delta write against the last programmed image
  *
- * Layout at 0x08000000:
- *   offset 0:  boot_pref    (4 bytes) - 0x00=Bank1, 0x01=Bank0, 0xFF=default
- *   offset 4:  retry_count  (4 bytes) - bit-clearing: 0xFF=0, 0xFE=1, 0xFC=2, 0xF8=3
- *   offset 8:  test_cmd     (4 bytes) - 0xFF=none, 0x01=switch, 0x02=selftest, 0x03=security
- *   offset 12: test_result  (4 bytes) - 0xB0=Bank0 OK, 0xB1=Bank1 OK, 0xAA/0x55=sec tests
+ * Only the erase blocks holding image data (the loaded ELF segments, HEX or
+ * S-record records, or the whole of a binary) are touched: flash in the
+ * gaps between them, and outside the image, is never erased. Their span in
+ * each area, rounded out to erase units, is kept after each delta write in
+ * the cache directory as a one-area native backup, named after the device
+ * DID and the span bounds (0xFF stands in for the blocks the image leaves
+ * alone). The next delta write of the same span compares the new content
+ * with it on the host and only erases and programs the covered erase blocks
+ * that differ. One device CRC per run of covered blocks before (is the
+ * record still what the flash holds?) and one after (verify) are the only
+ * queries.
  */
-int
-ra_fm2app_get(ra_device_t *dev) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[32];
-  uint8_t data[16];
-  uint8_t cmd_data[8];
-  ssize_t pkt_len, n;
 
-  /* Boot preference partition is at 0x08000000 (data flash start) */
-  uint32_t start = 0x08000000;
-  uint32_t end = start + 15; /* Read 16 bytes */
+/* Ranges a HEX or S-record image may load before a delta write gives up */
+#define DELTA_MAX_RANGES 256
 
-  /* Ensure area info is populated */
-  if (ra_get_area_info(dev, false) < 0)
-    return -1;
+static bool
+delta_overlaps(const format_extent_t *range, uint64_t lo, uint64_t hi) {
+  return range->size != 0 && range->addr <= hi && (uint64_t)range->addr + range->size - 1 >= lo;
+}
 
-  /* Build read command */
-  uint32_to_be(start, &cmd_data[0]);
-  uint32_to_be(end, &cmd_data[4]);
+STATIC int
+delta_span(const ra_area_t *area, const format_extent_t *ranges, int nr, ra_area_t *span) {
+  uint64_t lo = UINT64_MAX;
+  uint64_t hi = 0;
+  int n = 0;
 
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, cmd_data, 8, false);
-  if (pkt_len < 0)
+  for (int i = 0; i < nr; i++) {
+    if (!delta_overlaps(&ranges[i], area->sad, area->ead))
+      continue;
+    uint64_t r_hi = (uint64_t)ranges[i].addr + ranges[i].size - 1;
+    lo = ranges[i].addr < lo ? ranges[i].addr : lo;
+    hi = r_hi > hi ? r_hi : hi;
+    n++;
+  }
+  if (n == 0 || area->eau == 0)
+    return n;
+
+  lo = lo > area->sad ? lo : area->sad;
+  hi = hi < area->ead ? hi : area->ead;
+  *span = *area;
+  span->sad = area->sad + (uint32_t)(lo - area->sad) / area->eau * area->eau;
+  span->ead = area->sad + ((uint32_t)(hi - area->sad) / area->eau + 1) * area->eau - 1;
+  return n;
+}
+
+STATIC uint32_t
+delta_covered_blocks(
+    const ra_area_t *span, const format_extent_t *ranges, int nr, bool *covered) {
+  uint32_t nr_blocks = (span->ead - span->sad + 1) / span->eau;
+  uint32_t count = 0;
+
+  for (uint32_t b = 0; b < nr_blocks; b++) {
+    uint64_t lo = span->sad + (uint64_t)b * span->eau;
+    uint64_t hi = lo + span->eau - 1;
+    covered[b] = false;
+    for (int i = 0; i < nr && !covered[b]; i++)
+      covered[b] = delta_overlaps(&ranges[i], lo, hi);
+    count += covered[b];
+  }
+  return count;
+}
+
+STATIC uint32_t
+delta_dirty_blocks(
+    const uint8_t *prev, const uint8_t *next, uint32_t size, uint32_t eau, bool *dirty) {
+  uint32_t count = 0;
+
+  for (uint32_t off = 0, i = 0; off < size; off += eau, i++) {
+    uint32_t len = size - off < eau ? size - off : eau;
+    dirty[i] = rabuf_mismatch(prev + off, next + off, len) < len;
+    count += dirty[i];
+  }
+  return count;
+}
+
+/* Next run [*b, *e) of flagged blocks at or after *b; false when there is none */
+static bool
+delta_next_run(const bool *set, uint32_t nr, uint32_t *b, uint32_t *e) {
+  while (*b < nr && !set[*b])
+    (*b)++;
+  if (*b == nr)
+    return false;
+  *e = *b + 1;
+  while (*e < nr && set[*e])
+    (*e)++;
+  return true;
+}
+
+/*
+ * Compare the device CRC of each run of covered blocks with buf
+ * Returns: 1 if all of them match, 0 on a mismatch (reported if verify),
+ *          -1 on device error
+ */
+static int
+delta_check(ra_device_t *dev,
+    const ra_area_t *area,
+    const uint8_t *buf,
+    const bool *covered,
+    bool verify) {
+  uint32_t nr_blocks = (area->ead - area->sad + 1) / area->eau;
+
+  for (uint32_t b = 0, e; delta_next_run(covered, nr_blocks, &b, &e); b = e) {
+    uint32_t off = b * area->eau;
+    uint32_t len = (e - b) * area->eau;
+    uint32_t crc;
+    if (crc_query(dev, area->sad + off, area->sad + off + len - 1, &crc) < 0)
+      return -1;
+    uint32_t expected = crc32_calc(buf + off, len);
+    if (crc != expected) {
+      if (verify)
+        warnx("verify failed: %s 0x%08X-0x%08X CRC 0x%08X, expected 0x%08X",
+            koa_label(area->koa),
+            area->sad + off,
+            area->sad + off + len - 1,
+            crc,
+            expected);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int
+delta_record_path(const char *did_hex, const ra_area_t *span, char *path, size_t len) {
+  char dir[PATH_MAX];
+
+  if (get_cache_dir(dir, sizeof(dir)) < 0)
+    return -1;
+  int n = snprintf(path,
+      len,
+      "%s%cprogrammed-%s-%08x-%08x.rbk",
+      dir,
+      path_separator(),
+      did_hex,
+      span->sad,
+      span->ead);
+  return (n < 0 || (size_t)n >= len) ? -1 : 0;
+}
+
+/*
+ * Load the recorded content of a span, if its covered blocks still match
+ * the flash
+ * Returns: 1 if prev holds the span content, 0 if there is no usable record
+ *          (then all covered blocks are rewritten), -1 on device error
+ */
+static int
+delta_record_load(ra_device_t *dev,
+    const char *path,
+    const ra_area_t *span,
+    const bool *covered,
+    uint8_t *prev) {
+  rbk_t rbk;
+
+  if (rbk_open(path, &rbk) < 0)
+    return 0;
+
+  const rbk_area_t *a = &rbk.areas[0];
+  int ok = rbk.nr_areas == 1 && a->area.sad == span->sad && a->area.ead == span->ead &&
+           a->area.eau == span->eau;
+  for (uint32_t i = 0; ok && i < a->nr_blocks; i++)
+    ok = rbk_block_read(&rbk, a, i, prev + (size_t)i * RBK_BLOCK_SIZE) == 0;
+  rbk_close(&rbk);
+  if (!ok)
+    return 0;
+
+  /* Anything written since, by radfu or not, shows in the CRCs */
+  int known = delta_check(dev, span, prev, covered, false);
+  if (known == 0)
+    printf("  Record of the last programmed image is stale, rewriting the covered blocks\n");
+  return known;
+}
+
+/*
+ * Erase and program the dirty erase blocks of a span, then check the CRCs
+ * of its covered blocks
+ */
+static int
+delta_program(ra_device_t *dev,
+    const ra_area_t *span,
+    const uint8_t *next,
+    const bool *dirty,
+    const bool *covered) {
+  uint32_t nr_blocks = (span->ead - span->sad + 1) / span->eau;
+
+  for (uint32_t b = 0, e; delta_next_run(dirty, nr_blocks, &b, &e); b = e) {
+    uint32_t off = b * span->eau;
+    uint32_t len = (e - b) * span->eau;
+    if (ra_erase(dev, span->sad + off, len) < 0)
+      return -1;
+
+    /* Program from the first to the last used write unit of the run */
+    size_t first = rabuf_first_used(next + off, len);
+    if (first < len) {
+      size_t last = rabuf_last_used(next + off, len);
+      uint32_t lo = (uint32_t)(first / span->wau) * span->wau;
+      uint32_t hi = (uint32_t)((last / span->wau) + 1) * span->wau;
+      if (write_image(dev, next + off + lo, hi - lo, span->sad + off + lo, hi - lo, false) < 0)
+        return -1;
+    }
+  }
+
+  return delta_check(dev, span, next, covered, true) == 1 ? 0 : -1;
+}
+
+/*
+ * Bring the erase blocks of an area holding image data to the content the
+ * image gives them
+ */
+static int
+delta_write_area(ra_device_t *dev,
+    const ra_area_t *area,
+    const parsed_file_t *parsed,
+    const format_extent_t *ranges,
+    int nr_ranges,
+    const char *did_hex,
+    uint32_t *erased) {
+  ra_area_t span;
+  delta_span(area, ranges, nr_ranges, &span);
+
+  uint32_t span_size = span.ead - span.sad + 1;
+  uint32_t nr_blocks = span_size / span.eau;
+  char path[PATH_MAX];
+  int ret = -1;
+
+  uint8_t *next = malloc(span_size);
+  uint8_t *prev = malloc(span_size);
+  bool *dirty = calloc(nr_blocks, sizeof(*dirty));
+  bool *covered = calloc(nr_blocks, sizeof(*covered));
+  if (next == NULL || prev == NULL || dirty == NULL || covered == NULL) {
+    warnx("memory allocation failed");
+    goto out;
+  }
+
+  uint32_t nr_covered = delta_covered_blocks(&span, ranges, nr_ranges, covered);
+  /* No image data in the blocks left alone: the record holds 0xFF for them */
+  image_fill_area(parsed, &span, next);
+
+  bool recorded = delta_record_path(did_hex, &span, path, sizeof(path)) == 0;
+  if (!recorded)
+    warnx("no cache directory, the programmed image cannot be recorded");
+
+  int known = recorded ? delta_record_load(dev, path, &span, covered, prev) : 0;
+  if (known < 0)
+    goto out;
+
+  if (known)
+    delta_dirty_blocks(prev, next, span_size, span.eau, dirty);
+  uint32_t count = 0;
+  for (uint32_t b = 0; b < nr_blocks; b++) {
+    dirty[b] = covered[b] && (!known || dirty[b]);
+    count += dirty[b];
+  }
+
+  printf("%s 0x%08X-0x%08X: %u of %u erase blocks to program%s\n",
+      koa_label(span.koa),
+      span.sad,
+      span.ead,
+      count,
+      nr_covered,
+      known ? "" : " (no valid record)");
+
+  /* The record goes first: a failed write must not leave a stale one behind */
+  if (recorded)
+    remove(path);
+  if (delta_program(dev, &span, next, dirty, covered) < 0)
+    goto out;
+  *erased += count;
+
+  const uint8_t *data = next;
+  if (recorded && rbk_write(path, dev->sig, dev->sig_len, &span, &data, 1) < 0)
+    warnx("could not record the programmed image in %s", path);
+  ret = 0;
+
+out:
+  free(next);
+  free(prev);
+  free(dirty);
+  free(covered);
+  return ret;
+}
+
+/*
+ * Ranges the image loads: ELF extents, the HEX or S-record records, or the
+ * whole of a binary, moved along with a base address given on the command line
+ * Returns: number of ranges, -1 on error
+ */
+static int
+delta_ranges(const char *file,
+    input_format_t format,
+    const parsed_file_t *parsed,
+    uint32_t loaded_base,
+    format_extent_t *ranges,
+    int max) {
+  int n = parsed->nr_extents;
+
+  if (n > 0) {
+    memcpy(ranges, parsed->extents, (size_t)n * sizeof(*ranges));
+  } else {
+    n = format_ranges(file, format, 0, ranges, max);
+    if (n == max) {
+      warnx("%s: too many separate records for a delta write", file);
+      return -1;
+    }
+    if (n <= 0) {
+      ranges[0].addr = loaded_base;
+      ranges[0].size = (uint32_t)parsed->size;
+      n = 1;
+    }
+  }
+
+  for (int i = 0; i < n; i++)
+    ranges[i].addr += parsed->base_addr - loaded_base;
+  return n;
+}
+
+int
+ra_write_delta(ra_device_t *dev, const char *file, uint32_t start, input_format_t format) {
+  char did_hex[RASTORE_DID_HEX_LEN + 1];
+  format_extent_t ranges[DELTA_MAX_RANGES];
+  parsed_file_t parsed;
+  int ret = 0;
+
+  if (format == FORMAT_RFI || (format == FORMAT_AUTO && format_detect(file) == FORMAT_RFI)) {
+    warnx("%s: delta writes need the image content, not a compiled image", file);
     return -1;
+  }
 
-  if (ra_send(dev, pkt, pkt_len) < 0)
+  if (ra_get_area_info(dev, false) < 0 || query_signature(dev, false) < 0)
+    return -1;
+  if (rastore_did_hex(dev->sig, dev->sig_len, did_hex) < 0) {
+    warnx("device signature carries no DID, cannot key the programmed image");
     return -1;
+  }
+
+  if (format_parse(file, format, &parsed) < 0)
+    return -1;
+  uint32_t loaded_base = parsed.base_addr;
+  if (start != 0 || !parsed.has_addr)
+    parsed.base_addr = start;
+  if (parsed.size == 0) {
+    warnx("file is empty: %s", file);
+    free(parsed.data);
+    return -1;
+  }
 
-  n = ra_recv(dev, resp, sizeof(resp), 2000);
-  if (n < 0 || unpack_with_error(resp, n, data, NULL, "fm2app-get read") < 0)
+  int nr_ranges = delta_ranges(file, format, &parsed, loaded_base, ranges, DELTA_MAX_RANGES);
+  if (nr_ranges < 0) {
+    free(parsed.data);
     return -1;
+  }
+
+  uint32_t file_end = parsed.base_addr + (uint32_t)parsed.size - 1;
+  uint32_t erased = 0;
+  int areas = 0;
+
+  for (int i = 0; i < MAX_AREAS && ret == 0; i++) {
+    const ra_area_t *area = &dev->chip_layout[i];
+    ra_area_t span;
+    if (area->ead == 0 || delta_span(area, ranges, nr_ranges, &span) == 0)
+      continue;
+
+    /* Whole erase blocks are rewritten: only erasable flash, with CRC support */
+    uint32_t area_size = area->ead - area->sad + 1;
+    if (area->koa == KOA_TYPE_CONFIG || area->eau == 0 || area->wau == 0 || area->cau == 0 ||
+        area->eau % area->cau != 0 || area->eau % area->wau != 0 || area_size % area->eau != 0) {
+      warnx("%s at 0x%08X cannot be delta written", koa_label(area->koa), area->sad);
+      ret = -1;
+      break;
+    }
+
+    ret = delta_write_area(dev, area, &parsed, ranges, nr_ranges, did_hex, &erased);
+    areas++;
+  }
+
+  if (ret == 0 && areas == 0) {
+    warnx("no flash area overlaps with file data (0x%08X - 0x%08X)", parsed.base_addr, file_end);
+    ret = -1;
+  }
+  if (ret == 0)
+    printf("Delta write complete: %u erase blocks programmed, CRC verified\n", erased);
+
+  free(parsed.data);
+  return ret;
+}
+
+/*
+ * FM2APP boot preference partition reader
+ * Reads and displays the boot_pref_partition structure from data flash.
+ *
+ * Layout at 0x08000000:
+ *   offset 0:  boot_pref    (4 bytes) - 0x00=Bank1, 0x01=Bank0, 0xFF=default
+ *   offset 4:  retry_count  (4 bytes) - bit-clearing: 0xFF=0, 0xFE=1, 0xFC=2, 0xF8=3
+ *   offset 8:  test_cmd     (4 bytes) - 0xFF=none, 0x01=switch, 0x02=selftest, 0x03=security
+ *   offset 12: test_result  (4 bytes) - 0xB0=Bank0 OK, 0xB1=Bank1 OK, 0xAA/0x55=sec tests
+ */
+#define FM2APP_BASE 0x08000000 /* data flash start */
+#define FM2APP_LEN 16
 
+static void
+fm2app_report(const uint8_t *data, uint32_t start) {
   /* Parse the 4 fields (each is 4 bytes, but only first byte matters) */
   uint8_t boot_pref = data[0];
   uint8_t retry_count_raw = data[4];
@@ -4809,7 +6965,34 @@ ra_fm2app_get(ra_device_t *dev) {
   else
     printf(" -> Unknown (0x%02X)", test_result);
   printf("\n");
+}
+
+int
+ra_fm2app_get(ra_device_t *dev) {
+  uint8_t data[FM2APP_LEN];
+
+  /* Ensure area info is populated */
+  if (ra_get_area_info(dev, false) < 0)
+    return -1;
+
+  if (read_chunk_into(dev, FM2APP_BASE, data, sizeof(data), "fm2app-get read") < 0)
+    return -1;
 
+  fm2app_report(data, FM2APP_BASE);
+  return 0;
+}
+
+int
+ra_fm2app_get_file(const char *file, input_format_t format) {
+  uint8_t data[FM2APP_LEN];
+  backup_view_t b;
+
+  if (backup_view_open(file, format, &b) < 0)
+    return -1;
+
+  image_view_read(&b.view, FM2APP_BASE, data, sizeof(data));
+  fm2app_report(data, FM2APP_BASE);
+  backup_view_close(&b);
   return 0;
 }
 
@@ -4823,19 +7006,15 @@ ra_fm2app_get(ra_device_t *dev) {
  */
 int
 ra_fm2app_set(ra_device_t *dev, fm2app_field_t field, uint8_t value) {
-  uint8_t pkt[MAX_PKT_LEN];
-  uint8_t resp[32];
   uint8_t data[16];
-  uint8_t cmd_data[8];
-  ssize_t pkt_len, n;
+  ra_op_t op;
 
   if (field > FM2APP_TEST_RESULT) {
     warnx("invalid field index %d", field);
     return -1;
   }
 
-  /* Boot preference partition is at 0x08000000 (data flash start) */
-  uint32_t base = 0x08000000;
+  uint32_t base = FM2APP_BASE;
   uint32_t offset = (uint32_t)(field * 4);
 
   /* Ensure area info is populated */
@@ -4843,18 +7022,7 @@ ra_fm2app_set(ra_device_t *dev, fm2app_field_t field, uint8_t value) {
     return -1;
 
   /* Read current 16 bytes */
-  uint32_to_be(base, &cmd_data[0]);
-  uint32_to_be(base + 15, &cmd_data[4]);
-
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, cmd_data, 8, false);
-  if (pkt_len < 0)
-    return -1;
-
-  if (ra_send(dev, pkt, pkt_len) < 0)
-    return -1;
-
-  n = ra_recv(dev, resp, sizeof(resp), 2000);
-  if (n < 0 || unpack_with_error(resp, n, data, NULL, "fm2app-set read") < 0)
+  if (read_chunk_into(dev, base, data, 16, "fm2app-set read") < 0)
     return -1;
 
   uint8_t old_value = data[offset];
@@ -4882,33 +7050,199 @@ ra_fm2app_set(ra_device_t *dev, fm2app_field_t field, uint8_t value) {
 
   printf("Writing 0x%02X to offset %u (address 0x%08X)...\n", value, offset, base + offset);
 
-  /* Send write command with start/end addresses */
-  uint32_to_be(write_start, &cmd_data[0]);
-  uint32_to_be(write_start + write_size - 1, &cmd_data[4]);
+  ra_op_write(&op, dev, write_start, write_data, write_size, write_size);
+  op.context = "fm2app-set write";
+  if (ra_op_run(&op) < 0)
+    return -1;
 
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), WRI_CMD, cmd_data, 8, false);
-  if (pkt_len < 0)
+  printf("Write complete\n");
+  return 0;
+}
+
+/*
+ * Check one manifest image against the device, one CRC command per area
+ * Returns: 1 if every overlapping area matches, 0 if not, -1 on error
+ */
+static int
+provision_image_matches(ra_device_t *dev, const manifest_image_t *img) {
+  parsed_file_t parsed;
+
+  if (format_parse(img->file, img->format, &parsed) < 0)
     return -1;
 
-  if (ra_send(dev, pkt, pkt_len) < 0)
+  if (parsed.size == 0) {
+    warnx("file is empty: %s", img->file);
+    free(parsed.data);
     return -1;
+  }
+
+  uint32_t base = (img->address == 0 && parsed.has_addr) ? parsed.base_addr : img->address;
 
-  n = ra_recv(dev, resp, sizeof(resp), 1000);
-  if (n < 0 || unpack_with_error(resp, n, NULL, NULL, "fm2app-set write init") < 0)
+  printf("Image %s:\n", img->file);
+  int ret = crc_file_compare(dev, &parsed, base);
+  free(parsed.data);
+
+  if (ret < 0)
     return -1;
+  return ret == 0 ? 1 : 0;
+}
 
-  /* Send data packet */
-  pkt_len = ra_pack_pkt(pkt, sizeof(pkt), WRI_CMD, write_data, write_size, true);
-  if (pkt_len < 0)
+/*
+ * Erase the blocks covering an image, then write and verify it
+ */
+static int
+provision_image(ra_device_t *dev, const manifest_image_t *img) {
+  parsed_file_t parsed;
+
+  if (format_parse(img->file, img->format, &parsed) < 0)
     return -1;
 
-  if (ra_send(dev, pkt, pkt_len) < 0)
+  uint32_t base = (img->address == 0 && parsed.has_addr) ? parsed.base_addr : img->address;
+  uint32_t file_end = base + (uint32_t)parsed.size - 1;
+  free(parsed.data);
+
+  for (int i = 0; i < MAX_AREAS; i++) {
+    ra_area_t *area = &dev->chip_layout[i];
+    if (area->ead == 0 || area->eau == 0)
+      continue;
+    if (area->ead < base || area->sad > file_end)
+      continue;
+
+    uint32_t start, end;
+    crc_area_extent(area, base, file_end, area->eau, &start, &end);
+    if (ra_erase(dev, start, end - start + 1) < 0)
+      return -1;
+  }
+
+  return ra_write(dev, img->file, img->address, 0, true, img->format);
+}
+
+/*
+ * Gather what the device already matches, querying only what the manifest names
+ * Returns: 0 on success, -1 on error
+ */
+static int
+provision_check(ra_device_t *dev, const manifest_t *m, manifest_state_t *st) {
+  st->has_dlm = status_query_dlm(dev, &st->dlm) == 0;
+  if (st->has_dlm)
+    printf("DLM state:          %s\n", ra_dlm_state_name(st->dlm));
+  else
+    printf("DLM state:          not supported\n");
+
+  if (m->has_boundary) {
+    ra_boundary_t bnd;
+    if (status_query_boundary(dev, &bnd) < 0) {
+      warnx("cannot read boundary settings");
+      return -1;
+    }
+    st->boundary_ok = bnd.cfs1 == m->boundary.cfs1 && bnd.cfs2 == m->boundary.cfs2 &&
+                      bnd.dfs == m->boundary.dfs && bnd.srs1 == m->boundary.srs1 &&
+                      bnd.srs2 == m->boundary.srs2;
+    printf("Boundary:           %s\n", st->boundary_ok ? "OK" : "differs");
+  }
+
+  if (m->has_param) {
+    uint8_t value;
+    if (status_query_param(dev, PARAM_ID_INIT, &value) < 0) {
+      warnx("cannot read initialization parameter");
+      return -1;
+    }
+    st->param_ok = value == m->param_init;
+    printf("Init parameter:     %s\n", st->param_ok ? "OK" : "differs");
+  }
+
+  for (int i = 0; i < m->nr_keys; i++) {
+    int valid = status_query_key_verify(dev, KEY_VFY_CMD, m->keys[i].index);
+    if (valid < 0) {
+      warnx("cannot verify key type %u", m->keys[i].index);
+      return -1;
+    }
+    st->key_ok[i] = valid == 1;
+    printf("DLM key type %u:     %s\n", m->keys[i].index, valid ? "present" : "missing");
+  }
+
+  for (int i = 0; i < m->nr_ukeys; i++) {
+    int valid = status_query_key_verify(dev, UKEY_VFY_CMD, m->ukeys[i].index);
+    if (valid < 0) {
+      warnx("cannot verify user key %u", m->ukeys[i].index);
+      return -1;
+    }
+    st->ukey_ok[i] = valid == 1;
+    printf("User key %-3u:       %s\n", m->ukeys[i].index, valid ? "present" : "missing");
+  }
+
+  for (int i = 0; i < m->nr_images; i++) {
+    int match = provision_image_matches(dev, &m->images[i]);
+    if (match < 0)
+      return -1;
+    st->image_ok[i] = match == 1;
+  }
+
+  return 0;
+}
+
+static int
+provision_step(ra_device_t *dev, const manifest_t *m, const manifest_step_t *step) {
+  const manifest_key_t *key;
+
+  switch (step->kind) {
+  case STEP_DLM_TRANSIT:
+    return ra_dlm_transit(dev, step->dlm);
+  case STEP_BOUNDARY:
+    return ra_set_boundary(dev, &m->boundary);
+  case STEP_KEY:
+    key = &m->keys[step->item];
+    return ra_key_set(dev, key->index, key->data, key->len);
+  case STEP_UKEY:
+    key = &m->ukeys[step->item];
+    return ra_ukey_set(dev, key->index, key->data, key->len);
+  case STEP_IMAGE:
+    return provision_image(dev, &m->images[step->item]);
+  case STEP_PARAM:
+    return ra_set_param(dev, PARAM_ID_INIT, m->param_init);
+  }
+  return -1;
+}
+
+int
+ra_provision(ra_device_t *dev, const manifest_t *m, bool dry_run) {
+  manifest_state_t st = { 0 };
+  manifest_step_t steps[MANIFEST_MAX_STEPS];
+  char desc[PATH_MAX + 64];
+  progress_time_t t0;
+
+  progress_time_now(&t0);
+
+  if (provision_check(dev, m, &st) < 0)
     return -1;
 
-  n = ra_recv(dev, resp, sizeof(resp), 2000);
-  if (n < 0 || unpack_with_error(resp, n, NULL, NULL, "fm2app-set write") < 0)
+  int n = manifest_plan(m, &st, steps);
+  if (n < 0)
     return -1;
 
-  printf("Write complete\n");
+  if (n == 0) {
+    printf("\nDevice matches the manifest, nothing to do (%.2f s)\n", progress_time_since(&t0));
+    return 0;
+  }
+
+  printf("\nPlan (%d steps):\n", n);
+  for (int i = 0; i < n; i++) {
+    manifest_step_describe(m, &steps[i], desc, sizeof(desc));
+    printf("  %d. %s\n", i + 1, desc);
+  }
+
+  if (dry_run)
+    return 0;
+
+  for (int i = 0; i < n; i++) {
+    manifest_step_describe(m, &steps[i], desc, sizeof(desc));
+    printf("\n==> [%d/%d] %s\n", i + 1, n, desc);
+    if (provision_step(dev, m, &steps[i]) < 0) {
+      warnx("provisioning stopped at step %d of %d", i + 1, n);
+      return -1;
+    }
+  }
+
+  printf("\nProvisioning complete: %d steps in %.2f s\n", n, progress_time_since(&t0));
   return 0;
 }
@@ -33,6 +33,31 @@ int ra_get_dev_info(ra_device_t *dev);
  */
 int ra_status(ra_device_t *dev);
 
+/*
+ * Same report from a backup file (Intel HEX, S-record, binary or .rbk)
+ * Only a native backup brings the signature and area table; DLM, boundary,
+ * parameter and key state are not in any backup and show as N/A.
+ * Returns: 0 on success, -1 on error
+ */
+int ra_status_file(const char *file, input_format_t format);
+
+/*
+ * Inventory of the connected board: signature, boot firmware version, DLM
+ * state, boundary, OSIS status and the CRC of each area, queries only
+ * port: name shown in the record (NULL if auto-detected)
+ * json: one JSON object per line instead of text
+ * Returns: 0 on success, -1 on error
+ */
+int ra_inventory(ra_device_t *dev, const char *port, bool json);
+
+/*
+ * Inventory of every connected Renesas USB board, scanned concurrently
+ * Each record is printed as soon as its board completes.
+ * id_code: ID authentication for each board (NULL for none)
+ * Returns: 0 if every board answered, -1 otherwise
+ */
+int ra_inventory_all(const uint8_t *id_code, bool json, bool layout_cache);
+
 /*
  * Query recommended maximum UART baudrate (RMB) from device signature
  * rmb_out: pointer to store the RMB value in bps
@@ -53,6 +78,20 @@ uint32_t ra_get_device_max_baudrate(ra_device_t *dev);
  */
 int ra_authenticate(ra_device_t *dev, const uint8_t *id_code);
 
+/*
+ * Connect and get a device ready for commands: open the port, query the
+ * area table, switch baud rate and authenticate
+ * baudrate: 0 picks the highest rate both ends support in UART mode
+ * id_code: 16-byte ID code, NULL to skip authentication
+ * Returns: 0 on success, -1 on error (dev is closed)
+ */
+int ra_session_open(ra_device_t *dev,
+    const char *port,
+    bool uart_mode,
+    uint32_t baudrate,
+    const uint8_t *id_code,
+    bool layout_cache);
+
 /*
  * Erase flash sectors
  * Returns: 0 on success, -1 on error
@@ -104,6 +143,17 @@ int ra_write(ra_device_t *dev,
     bool verify,
     input_format_t format);
 
+/*
+ * Write file to flash memory, erasing and programming only what changed
+ * The content each area was last given is recorded per device DID in the
+ * cache directory. Erase blocks equal to that record are left alone, once
+ * a device CRC of the area confirms the record still matches the flash.
+ * Every area the file touches is taken whole: outside the file it ends up
+ * erased. Each area is checked by CRC afterwards.
+ * Returns: 0 on success, -1 on error
+ */
+int ra_write_delta(ra_device_t *dev, const char *file, uint32_t start, input_format_t format);
+
 /*
  * Calculate CRC of flash memory region
  * Uses CRC-32-IEEE-802.3 (polynomial 0x04C11DB7)
@@ -112,6 +162,77 @@ int ra_write(ra_device_t *dev,
  */
 int ra_crc(ra_device_t *dev, uint32_t start, uint32_t size, uint32_t *crc_out);
 
+/*
+ * Buffer counterparts of read/write/verify/crc for library callers
+ * Nothing is printed; progress and messages go through progress.h/ralog.h.
+ */
+
+/*
+ * Read [start, start + size) into buf
+ * Returns: 0 on success, -1 on error
+ */
+int ra_read_mem(ra_device_t *dev, uint32_t start, uint8_t *buf, uint32_t size);
+
+/*
+ * Program data at start (on a write unit boundary)
+ * A partial last write unit is padded with zeros, as ra_write does.
+ * Returns: 0 on success, -1 on error
+ */
+int ra_write_mem(ra_device_t *dev, uint32_t start, const uint8_t *data, uint32_t size);
+
+/*
+ * Compare flash with data: one CRC command when the range lies on CRC unit
+ * boundaries, a read back otherwise
+ * Returns: 1 if equal, 0 if not, -1 on error
+ */
+int ra_verify_mem(ra_device_t *dev, uint32_t start, const uint8_t *data, uint32_t size);
+
+/*
+ * CRC-32 of [start, start + size) as the device computes it
+ * Returns: 0 on success, -1 on error
+ */
+int ra_crc_mem(ra_device_t *dev, uint32_t start, uint32_t size, uint32_t *crc_out);
+
+/*
+ * CRC-32 of an image file computed on the host
+ * dev == NULL: print the CRC of each populated region of the file (offline)
+ * dev != NULL: compare against the device CRC, one command per overlapping area,
+ *              padding with 0xFF to whole CRC units
+ * start: base address for files without address info (0 = use file address)
+ * Returns: 0 on success (all areas match), -1 on error or mismatch
+ */
+int ra_crc_file(ra_device_t *dev, const char *file, uint32_t start, input_format_t format);
+
+/*
+ * Name the release a device runs, from a fingerprint database
+ * One CRC command per range of each release, nothing is read back. Prints
+ * the name of every release that matches, or "unknown".
+ * Returns: 0 on success (even if unknown), -1 on error
+ */
+int ra_identify(ra_device_t *dev, const char *db_path);
+
+/*
+ * Fingerprint a release image into the database (offline)
+ * The release is named after the file, without directory nor extension.
+ * Returns: 0 on success, -1 on error
+ */
+int ra_identify_add(const char *db_path, const char *file, input_format_t format);
+
+/* Inclusive address range */
+typedef struct {
+  uint32_t start;
+  uint32_t end;
+} ra_range_t;
+
+/*
+ * Show which address ranges of the device differ from an image file
+ * Compares whole-area CRCs, bisects mismatching ranges at CAU/EAU alignment
+ * and reads back only the leaf blocks that differ.
+ * start: base address for files without address info (0 = use file address)
+ * Returns: 0 if flash matches the file, -1 on error or difference
+ */
+int ra_diff(ra_device_t *dev, const char *file, uint32_t start, input_format_t format);
+
 /*
  * Query Device Lifecycle Management (DLM) state
  * Supported on GrpA (RA4M2/3, RA6M4/5), GrpB (RA4E1, RA6E1), GrpC (RA6T2)
@@ -287,6 +408,11 @@ int ra_set_param(ra_device_t *dev, uint8_t param_id, uint8_t value);
  */
 int ra_initialize(ra_device_t *dev);
 
+/* DLM key types (KYTY) per R01AN5562 */
+#define KYTY_SECDBG 0x01
+#define KYTY_NONSECDBG 0x02
+#define KYTY_RMA 0x03
+
 /*
  * Key setting - inject wrapped DLM key for authenticated state transitions
  * Supported on GrpA (RA4M2/3, RA6M4/5), GrpB (RA4E1, RA6E1), GrpC (RA6T2)
@@ -340,25 +466,50 @@ int ra_ukey_verify(ra_device_t *dev, uint8_t key_index, int *valid_out);
  */
 int ra_config_read(ra_device_t *dev);
 
+/*
+ * Same, from the config area held by a backup file
+ * Returns: 0 on success, -1 on error (or no config area in the backup)
+ */
+int ra_config_read_file(const char *file, input_format_t format);
+
 /*
  * Backup all flash areas to a single file
  * Reads all readable areas (code flash, data flash, config) and saves to file.
- * Only IHEX and SREC formats are supported (BIN cannot represent sparse data).
+ * IHEX, SREC and native (.rbk) formats are supported (BIN cannot represent
+ * sparse data).
  * format: output file format (FORMAT_AUTO to detect from extension)
+ * base: previous backup (IHEX, SREC or .rbk) to start from, or NULL; blocks
+ *       whose device CRC still matches it are taken from it instead of read
+ * Returns: 0 on success, -1 on error
+ */
+int ra_backup(ra_device_t *dev, const char *file, output_format_t format, const char *base);
+
+/*
+ * Backup all flash areas into a content-addressed store directory
+ * Only blocks the store does not hold yet are written; the device manifest,
+ * named after its DID, replaces the previous one.
+ * base: previous backup to start from, as for ra_backup() (may be NULL)
  * Returns: 0 on success, -1 on error
  */
-int ra_backup(ra_device_t *dev, const char *file, output_format_t format);
+int ra_backup_store(ra_device_t *dev, const char *dir, const char *base);
 
 /*
  * Restore flash from backup file
  * Performs full chip erase then writes all regions from backup file.
- * Supports IHEX and SREC formats with embedded address info.
+ * Supports IHEX and SREC formats with embedded address info, and native (.rbk).
  * format: input file format (FORMAT_AUTO to detect from extension)
  * verify: if true, verify after writing each region
  * Returns: 0 on success, -1 on error
  */
 int ra_restore(ra_device_t *dev, const char *file, input_format_t format, bool verify);
 
+/*
+ * Restore flash from the last backup of a device in a store directory
+ * did_hex: device whose backup to restore, NULL for the connected device
+ * Returns: 0 on success, -1 on error
+ */
+int ra_restore_store(ra_device_t *dev, const char *dir, const char *did_hex, bool verify);
+
 /*
  * Send raw command for protocol analysis/exploration
  * Sends a command with optional data and displays detailed TX/RX analysis.
@@ -393,6 +544,12 @@ typedef enum {
  */
 int ra_fm2app_get(ra_device_t *dev);
 
+/*
+ * Same, from the data flash held by a backup file (0xFF where it has none)
+ * Returns: 0 on success, -1 on error
+ */
+int ra_fm2app_get_file(const char *file, input_format_t format);
+
 /*
  * Write FM2APP boot preference partition field
  * Handles erase automatically if needed (when setting bits from 0 to 1).
@@ -400,4 +557,15 @@ int ra_fm2app_get(ra_device_t *dev);
  */
 int ra_fm2app_set(ra_device_t *dev, fm2app_field_t field, uint8_t value);
 
+struct manifest;
+
+/*
+ * Bring the device to the state described by a provisioning manifest
+ * Checks DLM state, boundary, init parameter, keys (key verify) and images
+ * (CRC per area), then runs only the steps whose item differs, in the order
+ * given by manifest_plan(). Nothing is changed when dry_run is set.
+ * Returns: 0 when the device matches the manifest, -1 on error
+ */
+int ra_provision(ra_device_t *dev, const struct manifest *m, bool dry_run);
+
 #endif /* RADFU_H */
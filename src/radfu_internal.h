@@ -11,6 +11,7 @@
 #define RADFU_INTERNAL_H
 
 #include "radfu.h"
+#include "raident.h"
 
 #ifdef TESTING
 
@@ -60,6 +61,76 @@ int set_write_boundaries(ra_device_t *dev, uint32_t start, uint32_t size, uint32
  */
 int set_crc_boundaries(ra_device_t *dev, uint32_t start, uint32_t size, uint32_t *end_out);
 
+/*
+ * CRC probe blocks: erase unit (or CAU) of the area holding addr, and the
+ * bounds of the block containing addr clipped to the scanned range
+ */
+uint32_t crc_probe_unit(ra_device_t *dev, uint32_t addr);
+uint32_t crc_probe_block_start(ra_device_t *dev, uint32_t addr, uint32_t unit, uint32_t start);
+uint32_t crc_probe_block_end(ra_device_t *dev, uint32_t addr, uint32_t unit, uint32_t end);
+
+/*
+ * Split point for diff bisection: start of the upper half, aligned on unit
+ */
+uint32_t diff_split(uint32_t start, uint32_t end, uint32_t unit);
+
+/*
+ * Append the byte ranges where expected and actual differ, merging with the
+ * last range when contiguous
+ * Returns: 0 on success, -1 on allocation failure
+ */
+int diff_collect(const uint8_t *expected,
+    const uint8_t *actual,
+    size_t len,
+    uint32_t addr,
+    ra_range_t **ranges,
+    size_t *count);
+
+/*
+ * Area content a flat image gives (0xFF where the image has nothing)
+ */
+void image_fill_area(const parsed_file_t *parsed, const ra_area_t *area, uint8_t *buf);
+
+/*
+ * Offline reports: area table inferred from the ranges a backup covers
+ * Returns: number of areas filled
+ */
+int backup_view_layout(const parsed_file_t *parsed, ra_area_t *areas);
+
+/*
+ * Incremental backup: unit the CRC bisection stops at
+ */
+uint32_t backup_delta_unit(const ra_area_t *area);
+
+/*
+ * Delta write: part of an area from the first to the last range the image
+ * loads into it, rounded out to erase units (span is left alone when the
+ * area has no erase unit)
+ * Returns: number of ranges overlapping the area
+ */
+int delta_span(const ra_area_t *area, const format_extent_t *ranges, int nr, ra_area_t *span);
+
+/*
+ * Delta write: flag the erase blocks of a span that hold image data (the only
+ * flash a delta write touches)
+ * Returns: number of covered blocks
+ */
+uint32_t delta_covered_blocks(
+    const ra_area_t *span, const format_extent_t *ranges, int nr, bool *covered);
+
+/*
+ * Delta write: flag the erase blocks where prev and next differ
+ * Returns: number of dirty blocks
+ */
+uint32_t delta_dirty_blocks(
+    const uint8_t *prev, const uint8_t *next, uint32_t size, uint32_t eau, bool *dirty);
+
+/*
+ * Identify: CRC of each populated code/data flash region of a release image
+ * Returns: 0 on success, -1 if the image has too many regions
+ */
+int ident_fingerprint(const parsed_file_t *parsed, uint32_t base, raident_entry_t *e);
+
 #endif /* TESTING */
 
 #endif /* RADFU_INTERNAL_H */
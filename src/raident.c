@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Firmware fingerprint database
+ *
+ * A text file, one release per line:
+ *
+ *   # radfu firmware fingerprints
+ *   <name> <addr>:<size>:<crc> [<addr>:<size>:<crc> ...]
+ *
+ * Fields are hex. Names hold no blanks; a release added again under the
+ * same name replaces its line.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "raident.h"
+#include "compat.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Name and ranges of one line */
+static int
+parse_entry(const char *line, raident_entry_t *e) {
+  size_t len = strcspn(line, " \t");
+  const char *p = line + len;
+
+  memset(e, 0, sizeof(*e));
+  if (len == 0 || len >= sizeof(e->name))
+    return -1;
+  memcpy(e->name, line, len);
+
+  for (;;) {
+    unsigned addr, size, crc;
+    int n = 0;
+
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (*p == '\0')
+      break;
+    if (sscanf(p, "%x:%x:%x%n", &addr, &size, &crc, &n) != 3 ||
+        (p[n] != '\0' && p[n] != ' ' && p[n] != '\t'))
+      return -1;
+    if (e->nr_ranges >= RAIDENT_MAX_RANGES || size == 0 || addr + (uint64_t)size - 1 > UINT32_MAX)
+      return -1;
+    e->ranges[e->nr_ranges].addr = addr;
+    e->ranges[e->nr_ranges].size = size;
+    e->ranges[e->nr_ranges].crc = crc;
+    e->nr_ranges++;
+    p += n;
+  }
+
+  return e->nr_ranges > 0 ? 0 : -1;
+}
+
+int
+raident_load(const char *path, raident_db_t *db) {
+  char line[64 + RAIDENT_NAME_MAX + RAIDENT_MAX_RANGES * 28];
+  unsigned lineno = 0;
+  int ret = 0;
+
+  memset(db, 0, sizeof(*db));
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    if (errno == ENOENT)
+      return 0;
+    warn("failed to open %s", path);
+    return -1;
+  }
+
+  while (ret == 0 && fgets(line, sizeof(line), f) != NULL) {
+    raident_entry_t e;
+
+    lineno++;
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '#' || line[0] == '\0')
+      continue;
+    if (parse_entry(line, &e) < 0) {
+      warnx("%s:%u: malformed fingerprint", path, lineno);
+      ret = -1;
+      break;
+    }
+    ret = raident_put(db, &e);
+  }
+
+  fclose(f);
+  if (ret < 0)
+    raident_free(db);
+  return ret;
+}
+
+/* Replace path by a file written aside, so readers never see half of one */
+static int
+commit_file(const char *tmp, const char *path) {
+#ifdef _WIN32
+  remove(path);
+#endif
+  if (rename(tmp, path) != 0) {
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+int
+raident_save(const char *path, const raident_db_t *db) {
+  char tmp[PATH_MAX + 16];
+
+  snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+  FILE *f = fopen(tmp, "w");
+  if (f == NULL) {
+    warn("failed to create %s", tmp);
+    return -1;
+  }
+
+  fprintf(f, "# radfu firmware fingerprints\n");
+  for (uint32_t i = 0; i < db->count; i++) {
+    const raident_entry_t *e = &db->entries[i];
+
+    fprintf(f, "%s", e->name);
+    for (uint32_t r = 0; r < e->nr_ranges; r++)
+      fprintf(f, " %08x:%x:%08x", e->ranges[r].addr, e->ranges[r].size, e->ranges[r].crc);
+    fprintf(f, "\n");
+  }
+
+  if (fclose(f) != 0) {
+    warn("failed to write %s", tmp);
+    remove(tmp);
+    return -1;
+  }
+  if (commit_file(tmp, path) < 0) {
+    warn("failed to replace %s", path);
+    return -1;
+  }
+  return 0;
+}
+
+int
+raident_put(raident_db_t *db, const raident_entry_t *e) {
+  for (uint32_t i = 0; i < db->count; i++) {
+    if (strcmp(db->entries[i].name, e->name) == 0) {
+      db->entries[i] = *e;
+      return 0;
+    }
+  }
+
+  raident_entry_t *entries = realloc(db->entries, (db->count + 1) * sizeof(*entries));
+  if (entries == NULL) {
+    warnx("out of memory");
+    return -1;
+  }
+  db->entries = entries;
+  db->entries[db->count++] = *e;
+  return 0;
+}
+
+void
+raident_free(raident_db_t *db) {
+  free(db->entries);
+  db->entries = NULL;
+  db->count = 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Firmware fingerprint database: which release a board runs, from CRCs only
+ */
+
+#ifndef RAIDENT_H
+#define RAIDENT_H
+
+#include <stdint.h>
+
+/*
+ * Fingerprinted ranges start and end on this boundary (0xFF padded), so any
+ * CRC unit dividing it checks them with one CRC command each
+ */
+#define RAIDENT_ALIGN 0x100
+
+#define RAIDENT_NAME_MAX 64
+#define RAIDENT_MAX_RANGES 32
+
+typedef struct {
+  uint32_t addr;
+  uint32_t size;
+  uint32_t crc; /* CRC-32 as the device CRC command computes it */
+} raident_range_t;
+
+/* One release: its name and the CRC of each range it populates */
+typedef struct {
+  char name[RAIDENT_NAME_MAX];
+  uint32_t nr_ranges;
+  raident_range_t ranges[RAIDENT_MAX_RANGES];
+} raident_entry_t;
+
+typedef struct {
+  raident_entry_t *entries;
+  uint32_t count;
+} raident_db_t;
+
+/*
+ * Load a database (release with raident_free); a missing file is empty
+ * Returns: 0 on success, -1 if unreadable or malformed
+ */
+int raident_load(const char *path, raident_db_t *db);
+
+/*
+ * Write a database, replacing the file only once it is complete
+ * Returns: 0 on success, -1 on error
+ */
+int raident_save(const char *path, const raident_db_t *db);
+
+/*
+ * Add a release, replacing any entry of the same name
+ * Returns: 0 on success, -1 on error
+ */
+int raident_put(raident_db_t *db, const raident_entry_t *e);
+
+void raident_free(raident_db_t *db);
+
+#endif /* RAIDENT_H */
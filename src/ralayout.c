@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * On-disk cache of device area tables
+ *
+ * One small text file per key, named after the CRC-32 of the key:
+ *
+ *   # radfu layout cache
+ *   sig <signature without DID, hex>
+ *   area <koa> <sad> <ead> <eau> <wau> <rau> <cau>
+ *   ...
+ *
+ * The full key is stored and compared, so a file name collision is a miss.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "ralayout.h"
+#include "crc32.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Signature response is at most 41 bytes, 25 without DID */
+#define MAX_KEY_LEN 64
+
+/*
+ * Build the cache key: signature response with the DID left out
+ * Returns: key length, 0 if the signature is too short to identify a device
+ */
+static size_t
+layout_key(const uint8_t *sig, size_t sig_len, uint8_t *key) {
+  if (sig_len <= SIG_DID_OFFSET)
+    return 0;
+
+  size_t len = 0;
+  for (size_t i = 0; i < sig_len && len < MAX_KEY_LEN; i++) {
+    if (i >= SIG_DID_OFFSET && i < SIG_DID_OFFSET + SIG_DID_LEN)
+      continue;
+    key[len++] = sig[i];
+  }
+  return len;
+}
+
+static void
+key_to_hex(const uint8_t *key, size_t len, char *hex) {
+  for (size_t i = 0; i < len; i++)
+    snprintf(hex + 2 * i, 3, "%02x", key[i]);
+  hex[2 * len] = '\0';
+}
+
+static int
+layout_path(const char *dir, const uint8_t *key, size_t key_len, char *path, size_t path_len) {
+  int n = snprintf(path,
+      path_len,
+      "%s%clayout-%08x",
+      dir,
+      path_separator(),
+      (unsigned)crc32_calc(key, key_len));
+  return (n < 0 || (size_t)n >= path_len) ? -1 : 0;
+}
+
+int
+ra_layout_load(const char *dir, const uint8_t *sig, size_t sig_len, ra_area_t *areas, int noa) {
+  uint8_t key[MAX_KEY_LEN];
+  char hex[2 * MAX_KEY_LEN + 1];
+  char path[PATH_MAX];
+  char line[256];
+
+  size_t key_len = layout_key(sig, sig_len, key);
+  if (key_len == 0 || noa <= 0 || noa > MAX_AREAS)
+    return -1;
+  if (layout_path(dir, key, key_len, path, sizeof(path)) < 0)
+    return -1;
+  key_to_hex(key, key_len, hex);
+
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+    return -1;
+
+  ra_area_t tmp[MAX_AREAS];
+  bool key_ok = false;
+  int count = 0;
+
+  while (fgets(line, sizeof(line), f) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '#' || line[0] == '\0')
+      continue;
+
+    if (strncmp(line, "sig ", 4) == 0) {
+      key_ok = strcmp(line + 4, hex) == 0;
+      continue;
+    }
+
+    unsigned koa, sad, ead, eau, wau, rau, cau;
+    if (sscanf(line, "area %x %x %x %x %x %x %x", &koa, &sad, &ead, &eau, &wau, &rau, &cau) != 7 ||
+        koa > 0xFF || count >= noa) {
+      count = -1;
+      break;
+    }
+    tmp[count].koa = (uint8_t)koa;
+    tmp[count].sad = sad;
+    tmp[count].ead = ead;
+    tmp[count].eau = eau;
+    tmp[count].wau = wau;
+    tmp[count].rau = rau;
+    tmp[count].cau = cau;
+    count++;
+  }
+  fclose(f);
+
+  if (!key_ok || count != noa)
+    return -1;
+
+  memcpy(areas, tmp, (size_t)noa * sizeof(*areas));
+  return 0;
+}
+
+int
+ra_layout_store(
+    const char *dir, const uint8_t *sig, size_t sig_len, const ra_area_t *areas, int noa) {
+  uint8_t key[MAX_KEY_LEN];
+  char hex[2 * MAX_KEY_LEN + 1];
+  char path[PATH_MAX];
+  char tmp[PATH_MAX + 16];
+
+  size_t key_len = layout_key(sig, sig_len, key);
+  if (key_len == 0 || noa <= 0 || noa > MAX_AREAS)
+    return -1;
+  if (layout_path(dir, key, key_len, path, sizeof(path)) < 0)
+    return -1;
+  key_to_hex(key, key_len, hex);
+
+  /*
+   * Write aside and rename, so concurrent sessions never see half a file;
+   * a unique name, as sessions of one process (inventory --all) race too
+   */
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+  int fd = mkstemp(tmp);
+  if (fd < 0)
+    return -1;
+  FILE *f = fdopen(fd, "w");
+  if (f == NULL) {
+    close(fd);
+    remove(tmp);
+    return -1;
+  }
+
+  fprintf(f, "# radfu layout cache\n");
+  fprintf(f, "sig %s\n", hex);
+  for (int i = 0; i < noa; i++) {
+    fprintf(f,
+        "area %02x %08x %08x %x %x %x %x\n",
+        areas[i].koa,
+        areas[i].sad,
+        areas[i].ead,
+        areas[i].eau,
+        areas[i].wau,
+        areas[i].rau,
+        areas[i].cau);
+  }
+
+  if (fclose(f) != 0) {
+    remove(tmp);
+    return -1;
+  }
+#ifdef _WIN32
+  remove(path);
+#endif
+  if (rename(tmp, path) != 0) {
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
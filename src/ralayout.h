@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * On-disk cache of device area tables, keyed by the signature response
+ */
+
+#ifndef RALAYOUT_H
+#define RALAYOUT_H
+
+#include "raconnect.h"
+
+/* Signature response layout (spec 6.15.2.2) */
+#define SIG_DID_OFFSET 9
+#define SIG_DID_LEN 16
+
+/*
+ * Load the area table cached for this signature
+ * The DID (device unique ID) is not part of the key: every device with the
+ * same product name, boot firmware and area count shares one entry.
+ * Returns: 0 on hit (noa areas filled), -1 on miss or unusable entry
+ */
+int ra_layout_load(const char *dir, const uint8_t *sig, size_t sig_len, ra_area_t *areas, int noa);
+
+/*
+ * Store the area table for this signature, replacing any previous entry
+ * Returns: 0 on success, -1 on error (nothing is printed, caching is best effort)
+ */
+int ra_layout_store(
+    const char *dir, const uint8_t *sig, size_t sig_len, const ra_area_t *areas, int noa);
+
+#endif /* RALAYOUT_H */
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Message sink: default printing or a caller supplied handler
+ */
+
+#include "ralog.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <err.h>
+#endif
+
+/* Longer messages are truncated */
+#define LOG_MSG_MAX 1024
+
+static ra_log_cb_t log_cb;
+static void *log_user_data;
+
+void
+ra_log_set_handler(ra_log_cb_t cb, void *user_data) {
+  log_cb = cb;
+  log_user_data = user_data;
+}
+
+static void
+log_emit(ra_log_level_t level, const char *msg) {
+  if (log_cb != NULL) {
+    log_cb(level, msg, log_user_data);
+    return;
+  }
+
+  switch (level) {
+  case RA_LOG_WARN:
+#ifdef _WIN32
+    fprintf(stderr, "%s\n", msg);
+#else
+    warnx("%s", msg);
+#endif
+    break;
+  case RA_LOG_INFO:
+    fprintf(stderr, "%s\n", msg);
+    break;
+  case RA_LOG_OUTPUT:
+    printf("%s\n", msg);
+    break;
+  }
+}
+
+void
+ra_log(ra_log_level_t level, const char *fmt, ...) {
+  char msg[LOG_MSG_MAX];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+  log_emit(level, msg);
+}
+
+void
+ra_warnx(const char *fmt, ...) {
+  char msg[LOG_MSG_MAX];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+  log_emit(RA_LOG_WARN, msg);
+}
+
+void
+ra_warn(const char *fmt, ...) {
+  char msg[LOG_MSG_MAX];
+  char reason[256];
+  va_list ap;
+
+  /* Before anything else can overwrite it */
+#ifdef _WIN32
+  DWORD code = GetLastError();
+
+  FormatMessageA(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+      NULL,
+      code,
+      0,
+      reason,
+      sizeof(reason),
+      NULL);
+  size_t len = strlen(reason);
+  if (len > 0 && reason[len - 1] == '\n')
+    reason[--len] = '\0';
+  if (len > 0 && reason[len - 1] == '\r')
+    reason[--len] = '\0';
+#else
+  snprintf(reason, sizeof(reason), "%s", strerror(errno));
+#endif
+
+  va_start(ap, fmt);
+  int n = vsnprintf(msg, sizeof(msg), fmt, ap);
+  va_end(ap);
+  if (n >= 0 && (size_t)n < sizeof(msg))
+    snprintf(msg + n, sizeof(msg) - (size_t)n, ": %s", reason);
+  log_emit(RA_LOG_WARN, msg);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Message sink: everything the flash code has to say goes through here
+ *
+ * By default warnings and notes go to stderr and command output to stdout,
+ * as a command line tool expects. A program embedding the library installs
+ * a handler instead and nothing is printed.
+ */
+
+#ifndef RALOG_H
+#define RALOG_H
+
+typedef enum {
+  RA_LOG_WARN,   /* warnx/warn: something failed or looks wrong */
+  RA_LOG_INFO,   /* notes on what is going on (connection, baud rate) */
+  RA_LOG_OUTPUT, /* results of a command */
+} ra_log_level_t;
+
+/*
+ * Message handler: msg is one line without its newline
+ * user_data: opaque pointer passed to ra_log_set_handler
+ */
+typedef void (*ra_log_cb_t)(ra_log_level_t level, const char *msg, void *user_data);
+
+/*
+ * Route all messages to cb (process wide), NULL restores the default
+ * printing to stderr/stdout
+ */
+void ra_log_set_handler(ra_log_cb_t cb, void *user_data);
+
+void ra_log(ra_log_level_t level, const char *fmt, ...);
+
+/* warnx(3) and warn(3) through the handler, see compat.h */
+void ra_warnx(const char *fmt, ...);
+void ra_warn(const char *fmt, ...);
+
+#endif /* RALOG_H */
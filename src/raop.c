@@ -0,0 +1,586 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Non-blocking flash operations: one state machine per command sequence
+ *
+ * An operation alternates between sending a packet (SEND, waits for the
+ * port to be writable) and receiving its response (RECV, waits for it to
+ * be readable), until the last response is in (DONE) or something fails.
+ */
+
+#include "raop.h"
+#include "compat.h"
+
+#include <errno.h>
+#include <string.h>
+
+enum {
+  OP_FAILED = -1,
+  OP_DONE = 0,
+  OP_SEND,
+  OP_RECV,
+};
+
+#define READ_REPLY_MS 2000  /* REA data */
+#define WRITE_INIT_MS 1000  /* WRI command acknowledge */
+#define WRITE_REPLY_MS 5000 /* WRI data acknowledge, once programmed */
+#define ERASE_REPLY_MS 5000 /* ERA takes longer */
+#define CRC_REPLY_MS 5000   /* CRC of large areas takes time */
+
+ra_cache_t *
+ra_dev_cache(ra_device_t *dev) {
+  if (dev->cache == NULL)
+    dev->cache = ra_cache_new();
+  return dev->cache;
+}
+
+/*
+ * Error response format per spec 6.18.2.3/6.19.2.4:
+ *   STS (1 byte)  - status code (ERR_ADDR, ERR_PROT, etc.)
+ *   ST2 (4 bytes) - status details (FSTATR for flash errors)
+ *   ADR (4 bytes) - failure address
+ */
+ssize_t
+ra_unpack_with_error(
+    const uint8_t *buf, size_t buflen, uint8_t *data, size_t *data_len, const char *context) {
+  uint8_t cmd;
+  size_t dlen = 0;
+  ssize_t ret = ra_unpack_pkt(buf, buflen, data, &dlen, &cmd);
+  if (data_len != NULL)
+    *data_len = dlen;
+  if (ret < 0) {
+    if (cmd & STATUS_ERR) {
+      /* Error code is in data[0], details in data[1-4], address in data[5-8] */
+      uint8_t err_code = (dlen > 0 && data != NULL) ? data[0] : 0;
+      warnx("%s: MCU error 0x%02X (%s: %s)",
+          context,
+          err_code,
+          ra_strerror(err_code),
+          ra_strdesc(err_code));
+      /* Show failure address for flash access errors */
+      if (dlen >= 9 && data != NULL) {
+        uint32_t st2 = be_to_uint32(&data[1]);
+        uint32_t adr = be_to_uint32(&data[5]);
+        if (st2 != 0xFFFFFFFF || adr != 0xFFFFFFFF) {
+          warnx("%s: flash status=0x%08X, failure address=0x%08X", context, st2, adr);
+        }
+      }
+    } else {
+      warnx("%s: unpack failed (cmd=0x%02X)", context, cmd);
+    }
+  }
+  return ret;
+}
+
+static int
+op_fail(ra_op_t *op) {
+  op->state = OP_FAILED;
+  return -1;
+}
+
+static void
+op_init(ra_op_t *op, ra_device_t *dev, ra_op_kind_t kind) {
+  memset(op, 0, sizeof(*op));
+  op->dev = dev;
+  op->kind = kind;
+  progress_time_now(&op->started);
+}
+
+/* Queue a command packet carrying a start/end address pair */
+static int
+op_send_cmd(ra_op_t *op, uint8_t cmd, uint32_t start, uint32_t end, int reply_ms) {
+  uint8_t data[8];
+
+  uint32_to_be(start, &data[0]);
+  uint32_to_be(end, &data[4]);
+  ssize_t len = ra_pack_pkt(op->cmd, sizeof(op->cmd), cmd, data, 8, false);
+  if (len < 0)
+    return op_fail(op);
+
+  op->tx[0] = (ra_iovec_t){ op->cmd, (size_t)len };
+  op->tx_first = 0;
+  op->tx_cnt = 1;
+  op->reply_ms = reply_ms;
+  op->state = OP_SEND;
+  progress_time_now(&op->wait_since);
+  return 0;
+}
+
+/* Queue a data packet; its payload is sent from where it lies */
+static int
+op_send_data(ra_op_t *op, const uint8_t *data, size_t len, int reply_ms) {
+  if (ra_pack_hdr_trl(op->hdr, op->trl, WRI_CMD, data, len, true) < 0)
+    return op_fail(op);
+
+  op->tx[0] = (ra_iovec_t){ op->hdr, sizeof(op->hdr) };
+  op->tx[1] = (ra_iovec_t){ (void *)data, len };
+  op->tx[2] = (ra_iovec_t){ op->trl, sizeof(op->trl) };
+  op->tx_first = 0;
+  op->tx_cnt = 3;
+  op->reply_ms = reply_ms;
+  op->state = OP_SEND;
+  progress_time_now(&op->wait_since);
+  return 0;
+}
+
+/* Consume n bytes from the front of an iovec array */
+static size_t
+iov_advance(ra_iovec_t *iov, int cnt, int *first, size_t n) {
+  size_t left = 0;
+
+  while (*first < cnt && n >= iov[*first].len) {
+    n -= iov[*first].len;
+    (*first)++;
+  }
+  if (*first < cnt) {
+    iov[*first].base = (uint8_t *)iov[*first].base + n;
+    iov[*first].len -= n;
+  }
+  for (int i = *first; i < cnt; i++)
+    left += iov[i].len;
+  return left;
+}
+
+/* Next REA, serving whatever the session cache holds on the way */
+static int
+op_read_next(ra_op_t *op) {
+  ra_cache_t *cache = ra_dev_cache(op->dev);
+
+  while (op->seg < op->nr_segs) {
+    const ra_op_seg_t *s = &op->segs[op->seg];
+
+    if (op->off >= s->size) {
+      op->seg++;
+      op->off = 0;
+      continue;
+    }
+
+    uint32_t left = s->size - op->off;
+    op->chunk = left < RA_OP_CHUNK ? left : RA_OP_CHUNK;
+    if (!ra_cache_read(cache, s->addr + op->off, s->buf + op->off, op->chunk))
+      return op_send_cmd(
+          op, REA_CMD, s->addr + op->off, s->addr + op->off + op->chunk - 1, READ_REPLY_MS);
+
+    op->off += op->chunk;
+    if (op->prog != NULL)
+      progress_update(op->prog, ++op->packets);
+  }
+
+  op->state = OP_DONE;
+  return 0;
+}
+
+/* Next data packet, the tail past the source padded with zeros */
+static int
+op_write_next(ra_op_t *op) {
+  uint32_t size = op->end - op->start + 1;
+
+  if (op->off >= size) {
+    op->state = OP_DONE;
+    return 0;
+  }
+
+  uint32_t left = size - op->off;
+  op->chunk = left < RA_OP_CHUNK ? left : RA_OP_CHUNK;
+
+  const uint8_t *payload = op->src + op->off;
+  if (op->off + op->chunk > op->src_len) {
+    uint32_t copy = op->src_len > op->off ? op->src_len - op->off : 0;
+    if (copy > 0)
+      memcpy(op->pad, op->src + op->off, copy);
+    memset(op->pad + copy, 0, op->chunk - copy);
+    payload = op->pad;
+  }
+  return op_send_data(op, payload, op->chunk, WRITE_REPLY_MS);
+}
+
+/* Next prebuilt packet, its length taken from its own header */
+static int
+op_frames_next(ra_op_t *op) {
+  size_t left = op->frames_len - op->frame_off;
+
+  if (left == 0) {
+    op->state = OP_DONE;
+    return 0;
+  }
+
+  const uint8_t *pkt = op->frames + op->frame_off;
+  size_t lnx = left >= PKT_HDR_LEN ? ((size_t)pkt[1] << 8) | pkt[2] : 0;
+  size_t len = PKT_HDR_LEN + lnx - 1 + PKT_TRL_LEN;
+  if (lnx == 0 || len > left) {
+    errno = EINVAL;
+    if (op->context != NULL)
+      warnx("%s: truncated packet at offset %zu", op->context, op->frame_off);
+    return op_fail(op);
+  }
+
+  /* The command is acknowledged first, then each data packet */
+  bool first = op->frame_off == 0;
+  op->chunk = first ? 0 : (uint32_t)(lnx - 1);
+  op->frame_off += len;
+
+  op->tx[0] = (ra_iovec_t){ (void *)pkt, len };
+  op->tx_first = 0;
+  op->tx_cnt = 1;
+  op->reply_ms = first ? WRITE_INIT_MS : WRITE_REPLY_MS;
+  op->state = OP_SEND;
+  progress_time_now(&op->wait_since);
+  return 0;
+}
+
+/* Receive side of the packet just sent */
+static void
+op_expect(ra_op_t *op) {
+  ra_decoder_init(&op->dec, SOD_ACK);
+  op->rx_got = 0;
+  op->rx_direct = false;
+
+  /* Read data is received straight into the caller buffer */
+  if (op->kind == RA_OP_READ) {
+    const ra_op_seg_t *s = &op->segs[op->seg];
+
+    op->rx[0] = (ra_iovec_t){ op->rx_hdr, sizeof(op->rx_hdr) };
+    op->rx[1] = (ra_iovec_t){ s->buf + op->off, op->chunk };
+    op->rx[2] = (ra_iovec_t){ op->rx_trl, sizeof(op->rx_trl) };
+    op->rx_first = 0;
+    op->rx_left = PKT_HDR_LEN + op->chunk + PKT_TRL_LEN;
+    op->rx_direct = true;
+  }
+  op->state = OP_RECV;
+}
+
+static int
+op_read_done(ra_op_t *op) {
+  const ra_op_seg_t *s = &op->segs[op->seg];
+
+  ra_cache_fill(ra_dev_cache(op->dev), s->addr + op->off, s->buf + op->off, op->chunk);
+  op->off += op->chunk;
+  if (op->prog != NULL)
+    progress_update(op->prog, ++op->packets);
+  return op_read_next(op);
+}
+
+/* A whole response frame came in */
+static int
+op_frame(ra_op_t *op, ra_dec_status_t st, const ra_frame_t *frame) {
+  if (st != RA_DEC_FRAME) {
+    if (op->context != NULL) {
+      uint8_t data[MAX_PKT_LEN];
+      ra_unpack_with_error(frame->raw, frame->raw_len, data, NULL, op->context);
+    }
+    return op_fail(op);
+  }
+
+  switch (op->kind) {
+  case RA_OP_READ:
+    if (frame->len != op->chunk) {
+      if (op->context != NULL)
+        warnx("%s: unexpected response length (%zu bytes)", op->context, frame->raw_len);
+      return op_fail(op);
+    }
+    memcpy(op->segs[op->seg].buf + op->off, frame->data, op->chunk);
+    return op_read_done(op);
+
+  case RA_OP_WRITE:
+    /* First acknowledge is for the command, then one per data packet */
+    if (op->chunk > 0) {
+      op->off += op->chunk;
+      if (op->prog != NULL)
+        progress_update(op->prog, op->prog_base + op->off);
+    }
+    return op->frames != NULL ? op_frames_next(op) : op_write_next(op);
+
+  case RA_OP_ERASE:
+    op->state = OP_DONE;
+    return 0;
+
+  case RA_OP_CRC:
+    if (frame->len < 4) {
+      warnx("invalid CRC response length: %zu", frame->len);
+      return op_fail(op);
+    }
+    *op->crc_out = be_to_uint32(frame->data);
+    ra_cache_crc_put(op->dev->cache, op->start, op->end, *op->crc_out);
+    op->state = OP_DONE;
+    return 0;
+  }
+  return op_fail(op);
+}
+
+/* Feed received bytes to the decoder, handling any frame they complete */
+static int
+op_feed(ra_op_t *op, const uint8_t *in, size_t len) {
+  size_t off = 0;
+
+  while (off < len && op->state == OP_RECV) {
+    ra_frame_t frame;
+    size_t used;
+    ra_dec_status_t st = ra_decoder_feed(&op->dec, in + off, len - off, &used, &frame);
+
+    off += used;
+    if (st != RA_DEC_NEED_MORE && op_frame(op, st, &frame) < 0)
+      return -1;
+  }
+
+  /* Give up on a line that only carries noise */
+  if (op->state == OP_RECV && op->dec.resync > MAX_PKT_LEN) {
+    errno = EPROTO;
+    if (op->context != NULL)
+      warnx("%s: no valid response frame", op->context);
+    return op_fail(op);
+  }
+  return 0;
+}
+
+/*
+ * The read data did not start with the expected header, typically a
+ * (shorter) MCU error response spilled into the buffer: hand what came in
+ * to the decoder, which reads the rest of that frame.
+ */
+static int
+op_read_fallback(ra_op_t *op) {
+  uint8_t seen[PKT_HDR_LEN + RA_OP_CHUNK + PKT_TRL_LEN];
+  const uint8_t *dst = op->segs[op->seg].buf + op->off;
+  size_t got = op->rx_got;
+  size_t hdr = got < PKT_HDR_LEN ? got : PKT_HDR_LEN;
+  size_t body = got - hdr < op->chunk ? got - hdr : op->chunk;
+
+  memcpy(seen, op->rx_hdr, hdr);
+  memcpy(seen + hdr, dst, body);
+  memcpy(seen + hdr + body, op->rx_trl, got - hdr - body);
+
+  op->rx_direct = false;
+  return op_feed(op, seen, got);
+}
+
+static int
+op_receive(ra_op_t *op) {
+  uint8_t in[MAX_PKT_LEN];
+
+  while (op->state == OP_RECV) {
+    ssize_t n;
+
+    if (op->rx_direct) {
+      n = ra_try_recvv(op->dev, &op->rx[op->rx_first], 3 - op->rx_first);
+      if (n <= 0)
+        return n < 0 ? op_fail(op) : 0;
+
+      bool had_hdr = op->rx_got >= PKT_HDR_LEN;
+      op->rx_got += (size_t)n;
+      op->rx_left = iov_advance(op->rx, 3, &op->rx_first, (size_t)n);
+
+      /* Header in: is this the data packet? */
+      if (!had_hdr && op->rx_got >= PKT_HDR_LEN) {
+        size_t lnx = ((size_t)op->rx_hdr[1] << 8) | op->rx_hdr[2];
+        if (op->rx_hdr[0] != SOD_ACK || op->rx_hdr[3] != REA_CMD || lnx != op->chunk + 1)
+          return op_read_fallback(op);
+      }
+      if (op->rx_left > 0)
+        continue;
+
+      const uint8_t *dst = op->segs[op->seg].buf + op->off;
+      if (ra_unpack_pkt_split(op->rx_hdr, dst, op->chunk, op->rx_trl, NULL) < 0)
+        return op_read_fallback(op);
+      if (op_read_done(op) < 0)
+        return -1;
+      continue;
+    }
+
+    size_t need = ra_decoder_need(&op->dec);
+    ra_iovec_t iov = { in, need < sizeof(in) ? need : sizeof(in) };
+    n = ra_try_recvv(op->dev, &iov, 1);
+    if (n <= 0)
+      return n < 0 ? op_fail(op) : 0;
+    op->rx_got += (size_t)n;
+    if (op_feed(op, in, (size_t)n) < 0)
+      return -1;
+  }
+
+  /* Completing a response may have queued the next packet */
+  if (op->state == OP_SEND || op->state == OP_DONE)
+    return 0;
+  return op->state == OP_FAILED ? -1 : 0;
+}
+
+static int
+op_transmit(ra_op_t *op) {
+  while (op->state == OP_SEND) {
+    ssize_t n = ra_try_sendv(op->dev, &op->tx[op->tx_first], op->tx_cnt - op->tx_first);
+    if (n < 0)
+      return op_fail(op);
+    if (n == 0)
+      return 0;
+    if (iov_advance(op->tx, op->tx_cnt, &op->tx_first, (size_t)n) == 0)
+      op_expect(op);
+  }
+  return 0;
+}
+
+int
+ra_op_read(ra_op_t *op, ra_device_t *dev, uint32_t addr, uint8_t *buf, uint32_t size) {
+  ra_op_seg_t seg = { addr, buf, size };
+
+  return ra_op_backup(op, dev, &seg, 1);
+}
+
+int
+ra_op_backup(ra_op_t *op, ra_device_t *dev, const ra_op_seg_t *segs, uint32_t nr_segs) {
+  op_init(op, dev, RA_OP_READ);
+  if (nr_segs > RA_OP_MAX_SEGS) {
+    errno = EINVAL;
+    return op_fail(op);
+  }
+  memcpy(op->segs, segs, nr_segs * sizeof(*segs));
+  op->nr_segs = nr_segs;
+  return op_read_next(op);
+}
+
+int
+ra_op_write(ra_op_t *op,
+    ra_device_t *dev,
+    uint32_t addr,
+    const uint8_t *data,
+    uint32_t len,
+    uint32_t size) {
+  op_init(op, dev, RA_OP_WRITE);
+  if (size == 0 || len > size) {
+    errno = EINVAL;
+    return op_fail(op);
+  }
+  op->src = data;
+  op->src_len = len;
+  op->start = addr;
+  op->end = addr + size - 1;
+  ra_cache_invalidate(dev->cache, op->start, op->end);
+  return op_send_cmd(op, WRI_CMD, op->start, op->end, WRITE_INIT_MS);
+}
+
+int
+ra_op_write_frames(ra_op_t *op,
+    ra_device_t *dev,
+    uint32_t start,
+    uint32_t end,
+    const uint8_t *frames,
+    size_t len) {
+  op_init(op, dev, RA_OP_WRITE);
+  if (frames == NULL || len == 0) {
+    errno = EINVAL;
+    return op_fail(op);
+  }
+  op->frames = frames;
+  op->frames_len = len;
+  op->start = start;
+  op->end = end;
+  ra_cache_invalidate(dev->cache, start, end);
+  return op_frames_next(op);
+}
+
+int
+ra_op_erase(ra_op_t *op, ra_device_t *dev, uint32_t start, uint32_t end) {
+  op_init(op, dev, RA_OP_ERASE);
+  op->start = start;
+  op->end = end;
+  ra_cache_invalidate(dev->cache, start, end);
+  return op_send_cmd(op, ERA_CMD, start, end, ERASE_REPLY_MS);
+}
+
+int
+ra_op_crc(ra_op_t *op, ra_device_t *dev, uint32_t start, uint32_t end, uint32_t *crc_out) {
+  op_init(op, dev, RA_OP_CRC);
+  op->start = start;
+  op->end = end;
+  op->crc_out = crc_out;
+  if (ra_cache_crc_get(ra_dev_cache(dev), start, end, crc_out)) {
+    op->state = OP_DONE;
+    return 0;
+  }
+  return op_send_cmd(op, CRC_CMD, start, end, CRC_REPLY_MS);
+}
+
+void
+ra_op_set_deadline(ra_op_t *op, int timeout_ms) {
+  progress_time_now(&op->started);
+  op->deadline_ms = timeout_ms;
+}
+
+ra_fd_t
+ra_op_fd(const ra_op_t *op) {
+  return op->dev->fd;
+}
+
+int
+ra_op_events(const ra_op_t *op) {
+  switch (op->state) {
+  case OP_SEND:
+    return RA_OP_WANT_WRITE;
+  case OP_RECV:
+    return RA_OP_WANT_READ;
+  default:
+    return 0;
+  }
+}
+
+/* Milliseconds left of a wait of limit_ms started at since */
+static int
+ms_left(const progress_time_t *since, int limit_ms) {
+  double left = limit_ms - progress_time_since(since) * 1000.0;
+
+  return left > 0 ? (int)left + 1 : 0;
+}
+
+int
+ra_op_timeout(const ra_op_t *op) {
+  if (op->state != OP_SEND && op->state != OP_RECV)
+    return 0;
+
+  int left = ms_left(&op->wait_since, op->reply_ms);
+  if (op->deadline_ms > 0) {
+    int deadline = ms_left(&op->started, op->deadline_ms);
+    if (deadline < left)
+      left = deadline;
+  }
+  return left;
+}
+
+int
+ra_op_step(ra_op_t *op, int ready) {
+  if (op->state == OP_SEND && (ready & RA_OP_WANT_WRITE))
+    op_transmit(op);
+  if (op->state == OP_RECV && (ready & RA_OP_WANT_READ))
+    op_receive(op);
+
+  if (op->state == OP_SEND || op->state == OP_RECV) {
+    bool deadline = op->deadline_ms > 0 && ms_left(&op->started, op->deadline_ms) == 0;
+    if (deadline || ms_left(&op->wait_since, op->reply_ms) == 0) {
+      errno = ETIMEDOUT;
+      if (op->context != NULL && deadline)
+        warnx("%s: timed out", op->context);
+      else if (op->context != NULL)
+        warnx("short response during %s (%zu bytes)", op->context, op->rx_got);
+      op_fail(op);
+    }
+  }
+
+  if (op->state == OP_DONE)
+    return 0;
+  return op->state == OP_FAILED ? -1 : 1;
+}
+
+int
+ra_op_run(ra_op_t *op) {
+  int ret = op->state == OP_FAILED ? -1 : 1;
+
+  while (ret > 0) {
+    int events = ra_op_events(op);
+    if (events == 0)
+      break;
+
+    int ready = ra_wait(op->dev, events == RA_OP_WANT_WRITE, ra_op_timeout(op));
+    if (ready < 0)
+      return op_fail(op);
+    ret = ra_op_step(op, ready > 0 ? events : 0);
+  }
+  return op->state == OP_DONE ? 0 : -1;
+}
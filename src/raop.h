@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Non-blocking flash operations
+ *
+ * Each read, write, erase, CRC or backup is a state machine over the port:
+ * it tells which readiness it waits for (ra_op_events) and for how long
+ * (ra_op_timeout), and ra_op_step advances it once the port is ready. One
+ * thread can so drive many boards from a single poll/epoll loop:
+ *
+ *   ra_op_read(&op[i], &dev[i], addr, buf[i], len);
+ *   ...
+ *   pfd[i].fd = ra_op_fd(&op[i]);
+ *   pfd[i].events = ra_op_events(&op[i]) == RA_OP_WANT_WRITE ? POLLOUT : POLLIN;
+ *   poll(pfd, n, smallest ra_op_timeout());
+ *   ra_op_step(&op[i], ready bits of pfd[i]);  until it returns 0 or -1
+ *
+ * ra_op_run does this for a single operation; the blocking calls of
+ * radfu.c are built on it.
+ */
+
+#ifndef RAOP_H
+#define RAOP_H
+
+#include "progress.h"
+#include "racache.h"
+#include "raconnect.h"
+#include "rapacker.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Readiness an operation waits for, and what ra_op_step is told */
+#define RA_OP_WANT_READ 0x1
+#define RA_OP_WANT_WRITE 0x2
+
+/* Largest payload of one read or write packet */
+#define RA_OP_CHUNK 1024
+
+/* Ranges of one operation: a backup reads every area in one go */
+#define RA_OP_MAX_SEGS MAX_AREAS
+
+typedef enum {
+  RA_OP_READ,
+  RA_OP_WRITE,
+  RA_OP_ERASE,
+  RA_OP_CRC,
+} ra_op_kind_t;
+
+typedef struct {
+  uint32_t addr;
+  uint8_t *buf;
+  uint32_t size;
+} ra_op_seg_t;
+
+typedef struct {
+  ra_device_t *dev;
+  ra_op_kind_t kind;
+  int state;
+  const char *context; /* names the operation in messages, NULL keeps it silent */
+  progress_t *prog;    /* advanced per packet (reads) or per byte (writes), may be NULL */
+  uint32_t prog_base;  /* writes: bytes of prog already done by earlier operations */
+
+  /* Ranges read */
+  ra_op_seg_t segs[RA_OP_MAX_SEGS];
+  uint32_t nr_segs;
+  uint32_t seg;      /* current range */
+  uint32_t off;      /* bytes of it done */
+  uint32_t chunk;    /* bytes in flight */
+  uint32_t start;    /* ERA/WRI/CRC command range */
+  uint32_t end;      /* inclusive */
+  uint32_t *crc_out; /* CRC result */
+  uint32_t packets;  /* reads completed, for the progress */
+
+  /* Write source, zero padded from src_len up to the command range */
+  const uint8_t *src;
+  uint32_t src_len;
+  uint8_t pad[RA_OP_CHUNK];
+
+  /* Or prebuilt packets (WRI command, then data), sent as they are */
+  const uint8_t *frames;
+  size_t frames_len;
+  size_t frame_off;
+
+  /* Packet being sent: header, payload (maybe the caller buffer), trailer */
+  uint8_t cmd[16];
+  uint8_t hdr[PKT_HDR_LEN];
+  uint8_t trl[PKT_TRL_LEN];
+  ra_iovec_t tx[3];
+  int tx_first;
+  int tx_cnt;
+
+  /* Response: read data lands in the caller buffer, the rest goes to the decoder */
+  uint8_t rx_hdr[PKT_HDR_LEN];
+  uint8_t rx_trl[PKT_TRL_LEN];
+  ra_iovec_t rx[3];
+  int rx_first;
+  size_t rx_left;
+  size_t rx_got;
+  bool rx_direct;
+  ra_decoder_t dec;
+
+  /* Deadlines */
+  int reply_ms;               /* for each response */
+  int deadline_ms;            /* whole operation, 0 for none */
+  progress_time_t started;    /* operation start */
+  progress_time_t wait_since; /* current response */
+} ra_op_t;
+
+/*
+ * Prepare an operation; nothing is sent before the first ra_op_step
+ * Ranges follow the rules of the blocking calls (read unit, write unit...),
+ * which check them beforehand. A write sends len bytes of data followed by
+ * zeros up to size. Returns: 0, -1 on invalid arguments
+ */
+int ra_op_read(ra_op_t *op, ra_device_t *dev, uint32_t addr, uint8_t *buf, uint32_t size);
+int ra_op_write(ra_op_t *op,
+    ra_device_t *dev,
+    uint32_t addr,
+    const uint8_t *data,
+    uint32_t len,
+    uint32_t size);
+int ra_op_erase(ra_op_t *op, ra_device_t *dev, uint32_t start, uint32_t end);
+
+/*
+ * Write from prebuilt packets (a compiled image): the WRI command for
+ * [start, end] followed by its data packets, back to back in frames
+ */
+int ra_op_write_frames(ra_op_t *op,
+    ra_device_t *dev,
+    uint32_t start,
+    uint32_t end,
+    const uint8_t *frames,
+    size_t len);
+int ra_op_crc(ra_op_t *op, ra_device_t *dev, uint32_t start, uint32_t end, uint32_t *crc_out);
+
+/* Read several ranges (e.g. each area for a backup) as one operation */
+int ra_op_backup(ra_op_t *op, ra_device_t *dev, const ra_op_seg_t *segs, uint32_t nr_segs);
+
+/* Fail the operation if not over after timeout_ms (from now) */
+void ra_op_set_deadline(ra_op_t *op, int timeout_ms);
+
+/* Port to watch, and RA_OP_WANT_* bits (0 once finished) */
+ra_fd_t ra_op_fd(const ra_op_t *op);
+int ra_op_events(const ra_op_t *op);
+
+/* Milliseconds until the operation times out, the longest to wait for */
+int ra_op_timeout(const ra_op_t *op);
+
+/*
+ * Advance as far as the port allows without blocking
+ * ready: RA_OP_WANT_* bits the port was found ready for (0 after a timeout)
+ * Returns: 1 to call again on readiness, 0 when done, -1 on failure
+ */
+int ra_op_step(ra_op_t *op, int ready);
+
+/*
+ * Drive an operation to completion, waiting on the port in between
+ * Returns: 0 on success, -1 on failure
+ */
+int ra_op_run(ra_op_t *op);
+
+/*
+ * Session read cache of a device, created on first use
+ * Every REA and CRC goes through it; ERA/WRI drop the ranges they touch and
+ * commands that may change what is readable (INI, DLM, boundaries, keys)
+ * drop everything. A failed allocation just disables caching.
+ */
+ra_cache_t *ra_dev_cache(ra_device_t *dev);
+
+/*
+ * Unpack a response, reporting MCU errors (status code, flash status and
+ * failure address) under context
+ * Returns: payload length, -1 on error
+ */
+ssize_t ra_unpack_with_error(
+    const uint8_t *buf, size_t buflen, uint8_t *data, size_t *data_len, const char *context);
+
+#endif /* RAOP_H */
@@ -7,6 +7,7 @@
  */
 
 #include "rapacker.h"
+#include "rabuf.h"
 #include <errno.h>
 #include <string.h>
 
@@ -58,13 +59,56 @@ ra_calc_sum(uint8_t cmd, const uint8_t *data, size_t len) {
   uint8_t lnl = pkt_len & 0xFF;
   uint32_t sum = lnh + lnl + cmd;
 
-  for (size_t i = 0; i < len; i++)
-    sum += data[i];
+  if (len > 0)
+    sum += rabuf_sum(data, len);
 
   /* Two's complement */
   return (~(sum - 1)) & 0xFF;
 }
 
+int
+ra_pack_hdr_trl(uint8_t hdr[PKT_HDR_LEN],
+    uint8_t trl[PKT_TRL_LEN],
+    uint8_t cmd,
+    const uint8_t *data,
+    size_t len,
+    bool ack) {
+  if (len > MAX_DATA_LEN) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  uint16_t data_len = (uint16_t)(len + 1); /* includes CMD in length */
+
+  hdr[0] = ack ? SOD_ACK : SOD_CMD;
+  hdr[1] = (data_len >> 8) & 0xFF;
+  hdr[2] = data_len & 0xFF;
+  hdr[3] = cmd;
+  trl[0] = ra_calc_sum(cmd, data, len);
+  trl[1] = ETX;
+
+  return 0;
+}
+
+ssize_t
+ra_pack_pkt_inplace(uint8_t *buf, size_t buflen, uint8_t cmd, size_t len, bool ack) {
+  size_t pkt_len = len + PKT_HDR_LEN + PKT_TRL_LEN;
+
+  if (len > MAX_DATA_LEN) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (buflen < pkt_len) {
+    errno = ENOBUFS;
+    return -1;
+  }
+
+  if (ra_pack_hdr_trl(buf, &buf[PKT_HDR_LEN + len], cmd, &buf[PKT_HDR_LEN], len, ack) < 0)
+    return -1;
+
+  return (ssize_t)pkt_len;
+}
+
 ssize_t
 ra_pack_pkt(uint8_t *buf, size_t buflen, uint8_t cmd, const uint8_t *data, size_t len, bool ack) {
   if (len > MAX_DATA_LEN) {
@@ -78,25 +122,19 @@ ra_pack_pkt(uint8_t *buf, size_t buflen, uint8_t cmd, const uint8_t *data, size_
     return -1;
   }
 
-  uint16_t data_len = (uint16_t)(len + 1); /* includes CMD in length */
-  uint8_t lnh = (data_len >> 8) & 0xFF;
-  uint8_t lnl = data_len & 0xFF;
-  uint8_t sum = ra_calc_sum(cmd, data, len);
-
-  buf[0] = ack ? SOD_ACK : SOD_CMD;
-  buf[1] = lnh;
-  buf[2] = lnl;
-  buf[3] = cmd;
+  /* memmove: data may already sit at its final place in buf */
   if (len > 0 && data != NULL)
-    memcpy(&buf[4], data, len);
-  buf[4 + len] = sum;
-  buf[5 + len] = ETX;
+    memmove(&buf[PKT_HDR_LEN], data, len);
 
-  return (ssize_t)pkt_len;
+  return ra_pack_pkt_inplace(buf, buflen, cmd, len, ack);
 }
 
 ssize_t
-ra_unpack_pkt(const uint8_t *buf, size_t buflen, uint8_t *data, size_t *data_len, uint8_t *cmd) {
+ra_unpack_pkt_view(const uint8_t *buf,
+    size_t buflen,
+    const uint8_t **data,
+    size_t *data_len,
+    uint8_t *cmd) {
   if (buflen < 6) {
     errno = EINVAL;
     return -1;
@@ -134,7 +172,7 @@ ra_unpack_pkt(const uint8_t *buf, size_t buflen, uint8_t *data, size_t *data_len
   if (res & STATUS_ERR) {
     if (dlen > 0 && data != NULL && data_len != NULL) {
       *data_len = dlen;
-      memcpy(data, &buf[4], dlen);
+      *data = &buf[4];
     }
     errno = EIO;
     return -1;
@@ -155,10 +193,193 @@ ra_unpack_pkt(const uint8_t *buf, size_t buflen, uint8_t *data, size_t *data_len
     return -1;
   }
 
-  if (data != NULL && dlen > 0)
-    memcpy(data, &buf[4], dlen);
+  if (data != NULL)
+    *data = &buf[4];
   if (data_len != NULL)
     *data_len = dlen;
 
   return (ssize_t)dlen;
 }
+
+ssize_t
+ra_unpack_pkt(const uint8_t *buf, size_t buflen, uint8_t *data, size_t *data_len, uint8_t *cmd) {
+  const uint8_t *view = NULL;
+  size_t dlen = 0;
+
+  ssize_t ret = ra_unpack_pkt_view(buf, buflen, &view, &dlen, cmd);
+  if (ret < 0) {
+    /* MCU error: hand the error details to the caller */
+    if (view != NULL && data != NULL && data_len != NULL) {
+      *data_len = dlen;
+      memcpy(data, view, dlen);
+    }
+    return -1;
+  }
+
+  if (data != NULL && dlen > 0)
+    memcpy(data, view, dlen);
+  if (data_len != NULL)
+    *data_len = dlen;
+
+  return ret;
+}
+
+ssize_t
+ra_unpack_pkt_split(const uint8_t hdr[PKT_HDR_LEN],
+    const uint8_t *data,
+    size_t len,
+    const uint8_t trl[PKT_TRL_LEN],
+    uint8_t *cmd) {
+  if (hdr[0] != SOD_ACK) {
+    errno = EPROTO;
+    return -1;
+  }
+
+  if (cmd != NULL)
+    *cmd = hdr[3];
+
+  if (hdr[3] & STATUS_ERR) {
+    errno = EIO;
+    return -1;
+  }
+
+  uint16_t pkt_len = ((uint16_t)hdr[1] << 8) | hdr[2];
+  if (pkt_len != len + 1 || trl[1] != ETX) {
+    errno = EPROTO;
+    return -1;
+  }
+
+  if (trl[0] != ra_calc_sum(hdr[3], data, len)) {
+    errno = EBADMSG;
+    return -1;
+  }
+
+  return (ssize_t)len;
+}
+
+void
+ra_decoder_init(ra_decoder_t *dec, uint8_t sod) {
+  memset(dec, 0, sizeof(*dec));
+  dec->sod = sod;
+}
+
+/*
+ * Drop the first buffered byte and realign on the next SOD candidate
+ */
+static void
+decoder_resync(ra_decoder_t *dec) {
+  size_t skip = 1;
+
+  while (skip < dec->len && dec->buf[skip] != dec->sod)
+    skip++;
+
+  memmove(dec->buf, dec->buf + skip, dec->len - skip);
+  dec->len -= skip;
+  dec->resync += skip;
+}
+
+/*
+ * Look for a complete frame at the start of the buffer
+ */
+static ra_dec_status_t
+decoder_parse(ra_decoder_t *dec, ra_frame_t *frame) {
+  for (;;) {
+    if (dec->len == 0)
+      return RA_DEC_NEED_MORE;
+
+    if (dec->buf[0] != dec->sod) {
+      decoder_resync(dec);
+      continue;
+    }
+
+    if (dec->len < 3)
+      return RA_DEC_NEED_MORE;
+
+    size_t pkt_len = ((size_t)dec->buf[1] << 8) | dec->buf[2];
+    if (pkt_len < 1 || pkt_len - 1 > MAX_DATA_LEN) {
+      decoder_resync(dec);
+      continue;
+    }
+
+    size_t dlen = pkt_len - 1;
+    size_t total = PKT_HDR_LEN + dlen + PKT_TRL_LEN;
+    if (dec->len < total)
+      return RA_DEC_NEED_MORE;
+
+    if (dec->buf[total - 1] != ETX) {
+      decoder_resync(dec);
+      continue;
+    }
+
+    frame->cmd = dec->buf[3];
+    frame->data = &dec->buf[PKT_HDR_LEN];
+    frame->len = dlen;
+    frame->raw = dec->buf;
+    frame->raw_len = total;
+    dec->emitted = total;
+
+    if (dec->buf[total - 2] != ra_calc_sum(frame->cmd, frame->data, dlen))
+      return RA_DEC_BAD_SUM;
+    if (frame->cmd & STATUS_ERR)
+      return RA_DEC_MCU_ERROR;
+    return RA_DEC_FRAME;
+  }
+}
+
+size_t
+ra_decoder_need(const ra_decoder_t *dec) {
+  const uint8_t *p = dec->buf + dec->emitted;
+  size_t have = dec->len - dec->emitted;
+
+  /* SOD + LNH + LNL are needed to learn the frame size */
+  if (have < 3)
+    return 3 - have;
+
+  size_t pkt_len = ((size_t)p[1] << 8) | p[2];
+  if (p[0] != dec->sod || pkt_len < 1 || pkt_len - 1 > MAX_DATA_LEN)
+    return 1; /* Will resync on the next feed */
+
+  size_t total = PKT_HDR_LEN + pkt_len - 1 + PKT_TRL_LEN;
+  return total > have ? total - have : 0;
+}
+
+ra_dec_status_t
+ra_decoder_feed(
+    ra_decoder_t *dec, const uint8_t *in, size_t len, size_t *consumed, ra_frame_t *frame) {
+  ra_dec_status_t status;
+  size_t used = 0;
+
+  /* Release the frame handed out by the previous call */
+  if (dec->emitted > 0) {
+    memmove(dec->buf, dec->buf + dec->emitted, dec->len - dec->emitted);
+    dec->len -= dec->emitted;
+    dec->emitted = 0;
+  }
+
+  for (;;) {
+    status = decoder_parse(dec, frame);
+    if (status != RA_DEC_NEED_MORE || used == len)
+      break;
+
+    /* Hunt for SOD without buffering the noise */
+    if (dec->len == 0) {
+      while (used < len && in[used] != dec->sod) {
+        used++;
+        dec->resync++;
+      }
+      if (used == len)
+        break;
+    }
+
+    /* Never buffer past the current frame: the rest belongs to the next one */
+    size_t want = ra_decoder_need(dec);
+    size_t n = (len - used) < want ? (len - used) : want;
+    memcpy(dec->buf + dec->len, in + used, n);
+    dec->len += n;
+    used += n;
+  }
+
+  if (consumed != NULL)
+    *consumed = used;
+  return status;
+}
@@ -61,6 +61,8 @@
 
 #define MAX_DATA_LEN 1024
 #define MAX_PKT_LEN (MAX_DATA_LEN + 6) /* SOD + LNH + LNL + CMD + data + SUM + ETX */
+#define PKT_HDR_LEN 4                  /* SOD + LNH + LNL + CMD */
+#define PKT_TRL_LEN 2                  /* SUM + ETX */
 
 /*
  * Convert uint32_t to big-endian byte array (portable across architectures)
@@ -95,6 +97,27 @@ uint8_t ra_calc_sum(uint8_t cmd, const uint8_t *data, size_t len);
 ssize_t ra_pack_pkt(
     uint8_t *buf, size_t buflen, uint8_t cmd, const uint8_t *data, size_t len, bool ack);
 
+/*
+ * Pack a protocol packet around a payload already stored at buf[PKT_HDR_LEN]
+ * Only the header and trailer are written, the payload is not moved.
+ *
+ * Returns: packet length on success, -1 on error
+ */
+ssize_t ra_pack_pkt_inplace(uint8_t *buf, size_t buflen, uint8_t cmd, size_t len, bool ack);
+
+/*
+ * Build header and trailer for a payload that stays in the caller's buffer
+ * (scatter/gather send: hdr + data + trl)
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int ra_pack_hdr_trl(uint8_t hdr[PKT_HDR_LEN],
+    uint8_t trl[PKT_TRL_LEN],
+    uint8_t cmd,
+    const uint8_t *data,
+    size_t len,
+    bool ack);
+
 /*
  * Unpack a protocol packet
  *
@@ -104,6 +127,81 @@ ssize_t ra_pack_pkt(
 ssize_t ra_unpack_pkt(
     const uint8_t *buf, size_t buflen, uint8_t *data, size_t *data_len, uint8_t *cmd);
 
+/*
+ * Unpack a protocol packet without copying the payload
+ * On success (and on MCU error), *data points into buf.
+ *
+ * Returns: data length on success, -1 on error (sets errno, same codes as ra_unpack_pkt)
+ */
+ssize_t ra_unpack_pkt_view(const uint8_t *buf,
+    size_t buflen,
+    const uint8_t **data,
+    size_t *data_len,
+    uint8_t *cmd);
+
+/*
+ * Validate a response received by scatter/gather: header, payload and
+ * trailer are in separate buffers, the payload is expected to be len bytes.
+ *
+ * Returns: data length on success, -1 on error (sets errno)
+ */
+ssize_t ra_unpack_pkt_split(const uint8_t hdr[PKT_HDR_LEN],
+    const uint8_t *data,
+    size_t len,
+    const uint8_t trl[PKT_TRL_LEN],
+    uint8_t *cmd);
+
+/*
+ * Incremental packet decoder
+ *
+ * Bytes are fed in arbitrary slices; complete frames come back one at a
+ * time with their status. Garbage before a frame, or a frame with a bad
+ * length or ETX, is skipped byte by byte until the next SOD (resync).
+ */
+typedef enum {
+  RA_DEC_NEED_MORE = 0, /* No complete frame yet, feed more bytes */
+  RA_DEC_FRAME,         /* Valid frame */
+  RA_DEC_MCU_ERROR,     /* Valid frame carrying an MCU error (CMD | 0x80) */
+  RA_DEC_BAD_SUM,       /* Well-framed packet with checksum mismatch */
+} ra_dec_status_t;
+
+typedef struct {
+  uint8_t cmd;         /* Command / response code */
+  const uint8_t *data; /* Payload, points into the decoder buffer */
+  size_t len;          /* Payload length */
+  const uint8_t *raw;  /* Whole frame (SOD..ETX), points into the decoder buffer */
+  size_t raw_len;      /* Whole frame length */
+} ra_frame_t;
+
+typedef struct {
+  uint8_t buf[MAX_PKT_LEN]; /* Bytes of the frame being assembled */
+  size_t len;               /* Bytes buffered */
+  size_t emitted;           /* Size of the frame handed out by the last feed */
+  size_t resync;            /* Total bytes discarded while resynchronizing */
+  uint8_t sod;              /* Expected start byte (SOD_ACK or SOD_CMD) */
+} ra_decoder_t;
+
+/*
+ * Reset decoder, sod is the start byte to lock on (SOD_ACK for responses)
+ */
+void ra_decoder_init(ra_decoder_t *dec, uint8_t sod);
+
+/*
+ * Feed up to len bytes; stops right after the first complete frame so
+ * back-to-back frames in one read are returned by successive calls.
+ * *consumed receives the number of input bytes used. On any status other
+ * than RA_DEC_NEED_MORE, frame describes the packet; its pointers stay
+ * valid until the next call.
+ */
+ra_dec_status_t ra_decoder_feed(
+    ra_decoder_t *dec, const uint8_t *in, size_t len, size_t *consumed, ra_frame_t *frame);
+
+/*
+ * Bytes still needed to complete the current frame (never past its end)
+ * Returns: 0 only if a complete frame is buffered and not yet fed out
+ */
+size_t ra_decoder_need(const ra_decoder_t *dec);
+
 /*
  * Get error name for MCU error code (e.g., "ERR_ADDR")
  */
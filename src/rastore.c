@@ -0,0 +1,592 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Content-addressed backup store
+ *
+ * Layout of a store directory:
+ *
+ *   blocks/<2 hex>/<62 hex>   one file per distinct block, named after the
+ *                             SHA-256 of its content; compressed when that
+ *                             makes it smaller, as is otherwise (then the file
+ *                             is exactly the block length)
+ *   devices/<DID>.txt         manifest of the last backup of each device:
+ *
+ *     # radfu backup store manifest
+ *     sig <signature response, hex>
+ *     area <koa> <sad> <ead> <eau> <wau> <rau> <cau>
+ *     <block hash, or - for an erased block>
+ *     ...
+ *
+ * A block is written once, whatever the number of devices holding it, and is
+ * never modified: backups only add files, gc removes the unreferenced ones.
+ * A block a running backup found already stored is unreferenced until its
+ * manifest is replaced: the backup touches it instead, and gc leaves blocks
+ * modified within RASTORE_GC_GRACE alone, so both may run side by side.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "rastore.h"
+#include "compat.h"
+#include "lz.h"
+#include "rabuf.h"
+#include "ralayout.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define HASH_HEX_LEN (2 * SHA256_LEN)
+#define MANIFEST_SUFFIX ".txt"
+
+static uint32_t
+area_blocks(const ra_area_t *area) {
+  return (uint32_t)(((uint64_t)area->ead - area->sad + RASTORE_BLOCK_SIZE) / RASTORE_BLOCK_SIZE);
+}
+
+static int
+hex_to_bytes(const char *hex, uint8_t *out, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    unsigned int byte;
+    if (!isxdigit((unsigned char)hex[2 * i]) || !isxdigit((unsigned char)hex[2 * i + 1]) ||
+        sscanf(hex + 2 * i, "%2x", &byte) != 1)
+      return -1;
+    out[i] = (uint8_t)byte;
+  }
+  return 0;
+}
+
+static void
+bytes_to_hex(const uint8_t *in, size_t len, char *hex) {
+  for (size_t i = 0; i < len; i++)
+    snprintf(hex + 2 * i, 3, "%02x", in[i]);
+  hex[2 * len] = '\0';
+}
+
+static int
+join(char *path, size_t len, const char *dir, const char *name) {
+  int n = snprintf(path, len, "%s%c%s", dir, path_separator(), name);
+  return (n < 0 || (size_t)n >= len) ? -1 : 0;
+}
+
+static int
+block_path(const char *dir, const uint8_t hash[SHA256_LEN], char *path, size_t len) {
+  char hex[HASH_HEX_LEN + 1];
+
+  sha256_hex(hash, hex);
+  int n = snprintf(path,
+      len,
+      "%s%cblocks%c%.2s%c%s",
+      dir,
+      path_separator(),
+      path_separator(),
+      hex,
+      path_separator(),
+      hex + 2);
+  return (n < 0 || (size_t)n >= len) ? -1 : 0;
+}
+
+static int
+manifest_path(const char *dir, const char *did_hex, char *path, size_t len) {
+  int n = snprintf(path,
+      len,
+      "%s%cdevices%c%s" MANIFEST_SUFFIX,
+      dir,
+      path_separator(),
+      path_separator(),
+      did_hex);
+  return (n < 0 || (size_t)n >= len) ? -1 : 0;
+}
+
+/* Replace path by a file written aside, so readers never see half of one */
+static int
+commit_file(const char *tmp, const char *path) {
+#ifdef _WIN32
+  remove(path);
+#endif
+  if (rename(tmp, path) != 0) {
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+int
+rastore_did_hex(const uint8_t *sig, size_t sig_len, char *hex) {
+  if (sig_len < SIG_DID_OFFSET + SIG_DID_LEN)
+    return -1;
+  bytes_to_hex(sig + SIG_DID_OFFSET, SIG_DID_LEN, hex);
+  return 0;
+}
+
+uint32_t
+rastore_block_len(const rastore_area_t *a, uint32_t i) {
+  uint32_t left = a->area.ead - a->area.sad - i * RASTORE_BLOCK_SIZE;
+  return left < RASTORE_BLOCK_SIZE ? left + 1 : RASTORE_BLOCK_SIZE;
+}
+
+/*
+ * Store one block unless it is already there, then it is touched so that gc
+ * sees it in use
+ * Returns: bytes written (0 if it was known), -1 on error
+ */
+static long
+put_block(const char *dir, const uint8_t hash[SHA256_LEN], const uint8_t *block, uint32_t len) {
+  uint8_t packed[RASTORE_BLOCK_SIZE];
+  char path[PATH_MAX];
+  char tmp[PATH_MAX + 16];
+  struct stat st;
+
+  if (block_path(dir, hash, path, sizeof(path)) < 0)
+    return -1;
+  if (stat(path, &st) == 0) {
+    if (utime(path, NULL) < 0) {
+      warn("failed to touch block %s", path);
+      return -1;
+    }
+    return 0;
+  }
+
+  /* Fan-out directory, named by the first hash byte */
+  char *sep = strrchr(path, path_separator());
+  *sep = '\0';
+  int ret = make_dir(path);
+  *sep = path_separator();
+  if (ret < 0) {
+    warn("failed to create directory for %s", path);
+    return -1;
+  }
+
+  /* Kept as is unless compression saves space */
+  size_t n = lz_compress(block, len, packed, len - 1);
+  const uint8_t *out = n ? packed : block;
+  size_t out_len = n ? n : len;
+
+  snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+  FILE *f = fopen(tmp, "wb");
+  if (f == NULL) {
+    warn("failed to create %s", tmp);
+    return -1;
+  }
+  if (fwrite(out, 1, out_len, f) != out_len || fclose(f) != 0) {
+    warn("failed to write %s", tmp);
+    remove(tmp);
+    return -1;
+  }
+
+  /* Another backup may have stored the same block meanwhile, that is fine */
+  if (commit_file(tmp, path) < 0 && stat(path, &st) != 0) {
+    warn("failed to store block %s", path);
+    return -1;
+  }
+  return (long)out_len;
+}
+
+static int
+write_manifest(const char *dir, const char *did_hex, const rastore_manifest_t *m) {
+  char path[PATH_MAX];
+  char tmp[PATH_MAX + 16];
+  char hex[2 * RBK_SIG_MAX + 1];
+
+  if (manifest_path(dir, did_hex, path, sizeof(path)) < 0)
+    return -1;
+  snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+  FILE *f = fopen(tmp, "w");
+  if (f == NULL) {
+    warn("failed to create %s", tmp);
+    return -1;
+  }
+
+  bytes_to_hex(m->sig, m->sig_len, hex);
+  fprintf(f, "# radfu backup store manifest\n");
+  fprintf(f, "sig %s\n", hex);
+  for (uint32_t a = 0; a < m->nr_areas; a++) {
+    const rastore_area_t *ma = &m->areas[a];
+
+    fprintf(f,
+        "area %02x %08x %08x %x %x %x %x\n",
+        ma->area.koa,
+        ma->area.sad,
+        ma->area.ead,
+        ma->area.eau,
+        ma->area.wau,
+        ma->area.rau,
+        ma->area.cau);
+    for (uint32_t i = 0; i < ma->nr_blocks; i++) {
+      char hash_hex[HASH_HEX_LEN + 1];
+
+      if (ma->blocks[i].blank) {
+        fprintf(f, "-\n");
+        continue;
+      }
+      sha256_hex(ma->blocks[i].hash, hash_hex);
+      fprintf(f, "%s\n", hash_hex);
+    }
+  }
+
+  if (fclose(f) != 0) {
+    warn("failed to write %s", tmp);
+    remove(tmp);
+    return -1;
+  }
+  if (commit_file(tmp, path) < 0) {
+    warn("failed to replace %s", path);
+    return -1;
+  }
+  return 0;
+}
+
+int
+rastore_put(const char *dir,
+    const uint8_t *sig,
+    size_t sig_len,
+    const ra_area_t *areas,
+    const uint8_t *const *data,
+    size_t count,
+    rastore_stats_t *stats) {
+  char did_hex[RASTORE_DID_HEX_LEN + 1];
+  char path[PATH_MAX];
+  rastore_manifest_t m;
+  int ret = -1;
+
+  memset(stats, 0, sizeof(*stats));
+  memset(&m, 0, sizeof(m));
+  if (count == 0 || count > MAX_AREAS || sig_len > RBK_SIG_MAX) {
+    warnx("invalid backup layout");
+    return -1;
+  }
+  if (rastore_did_hex(sig, sig_len, did_hex) < 0) {
+    warnx("device signature carries no DID, cannot name its manifest");
+    return -1;
+  }
+
+  if (make_dir(dir) < 0 || join(path, sizeof(path), dir, "blocks") < 0 || make_dir(path) < 0 ||
+      join(path, sizeof(path), dir, "devices") < 0 || make_dir(path) < 0) {
+    warn("failed to create store %s", dir);
+    return -1;
+  }
+
+  memcpy(m.sig, sig, sig_len);
+  m.sig_len = sig_len;
+  for (size_t a = 0; a < count; a++) {
+    rastore_area_t *ma = &m.areas[m.nr_areas];
+    ma->area = areas[a];
+    ma->nr_blocks = area_blocks(&areas[a]);
+    ma->blocks = calloc(ma->nr_blocks, sizeof(*ma->blocks));
+    if (ma->blocks == NULL) {
+      warnx("memory allocation failed");
+      goto out;
+    }
+    m.nr_areas++;
+
+    for (uint32_t i = 0; i < ma->nr_blocks; i++) {
+      const uint8_t *block = data[a] + (size_t)i * RASTORE_BLOCK_SIZE;
+      uint32_t len = rastore_block_len(ma, i);
+      rastore_block_t *b = &ma->blocks[i];
+
+      stats->blocks++;
+      if (rabuf_is_blank(block, len)) {
+        b->blank = true;
+        stats->blank++;
+        continue;
+      }
+      sha256(block, len, b->hash);
+      long n = put_block(dir, b->hash, block, len);
+      if (n < 0)
+        goto out;
+      if (n > 0) {
+        stats->added++;
+        stats->added_len += (uint64_t)n;
+      }
+    }
+  }
+
+  /* Blocks first: the manifest only ever references stored blocks */
+  ret = write_manifest(dir, did_hex, &m);
+out:
+  rastore_free(&m);
+  return ret;
+}
+
+void
+rastore_free(rastore_manifest_t *m) {
+  for (uint32_t a = 0; a < m->nr_areas; a++)
+    free(m->areas[a].blocks);
+  memset(m, 0, sizeof(*m));
+}
+
+static int
+load_manifest(const char *path, rastore_manifest_t *m) {
+  char line[256];
+  rastore_area_t *cur = NULL;
+  uint32_t filled = 0;
+  bool sig_ok = false;
+  int ret = 0;
+
+  memset(m, 0, sizeof(*m));
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+    return -1;
+
+  while (ret == 0 && fgets(line, sizeof(line), f) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '#' || line[0] == '\0')
+      continue;
+
+    if (strncmp(line, "sig ", 4) == 0) {
+      size_t len = strlen(line + 4) / 2;
+      if (sig_ok || len > RBK_SIG_MAX || strlen(line + 4) != 2 * len ||
+          hex_to_bytes(line + 4, m->sig, len) < 0)
+        ret = -1;
+      m->sig_len = len;
+      sig_ok = true;
+      continue;
+    }
+
+    unsigned koa, sad, ead, eau, wau, rau, cau;
+    if (sscanf(line, "area %x %x %x %x %x %x %x", &koa, &sad, &ead, &eau, &wau, &rau, &cau) ==
+        7) {
+      if ((cur != NULL && filled != cur->nr_blocks) || m->nr_areas >= MAX_AREAS || koa > 0xFF ||
+          ead < sad) {
+        ret = -1;
+        break;
+      }
+      cur = &m->areas[m->nr_areas];
+      cur->area.koa = (uint8_t)koa;
+      cur->area.sad = sad;
+      cur->area.ead = ead;
+      cur->area.eau = eau;
+      cur->area.wau = wau;
+      cur->area.rau = rau;
+      cur->area.cau = cau;
+      cur->nr_blocks = area_blocks(&cur->area);
+      cur->blocks = calloc(cur->nr_blocks, sizeof(*cur->blocks));
+      if (cur->blocks == NULL) {
+        ret = -1;
+        break;
+      }
+      m->nr_areas++;
+      filled = 0;
+      continue;
+    }
+
+    if (cur == NULL || filled >= cur->nr_blocks) {
+      ret = -1;
+      break;
+    }
+    rastore_block_t *b = &cur->blocks[filled++];
+    if (strcmp(line, "-") == 0)
+      b->blank = true;
+    else if (strlen(line) != HASH_HEX_LEN || hex_to_bytes(line, b->hash, SHA256_LEN) < 0)
+      ret = -1;
+  }
+  fclose(f);
+
+  if (ret == 0 && (!sig_ok || cur == NULL || filled != cur->nr_blocks))
+    ret = -1;
+  if (ret < 0)
+    rastore_free(m);
+  return ret;
+}
+
+int
+rastore_load(const char *dir, const char *did_hex, rastore_manifest_t *m) {
+  char path[PATH_MAX];
+
+  if (manifest_path(dir, did_hex, path, sizeof(path)) < 0)
+    return -1;
+  if (load_manifest(path, m) < 0) {
+    warnx("no usable manifest for device %s in %s", did_hex, dir);
+    return -1;
+  }
+  return 0;
+}
+
+int
+rastore_block(const char *dir, const uint8_t hash[SHA256_LEN], uint8_t *out, uint32_t len) {
+  char path[PATH_MAX];
+  uint8_t packed[RASTORE_BLOCK_SIZE];
+  uint8_t check[SHA256_LEN];
+  char hex[HASH_HEX_LEN + 1];
+
+  if (len == 0 || len > RASTORE_BLOCK_SIZE || block_path(dir, hash, path, sizeof(path)) < 0)
+    return -1;
+
+  sha256_hex(hash, hex);
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    warnx("block %s is missing from the store", hex);
+    return -1;
+  }
+  size_t n = fread(packed, 1, sizeof(packed), f);
+  fclose(f);
+
+  /* A stored block of the full length was kept as is */
+  int ret = 0;
+  if (n == len)
+    memcpy(out, packed, len);
+  else if (n == 0 || n > len || lz_decompress(packed, n, out, len) < 0)
+    ret = -1;
+
+  if (ret == 0) {
+    sha256(out, len, check);
+    if (memcmp(check, hash, SHA256_LEN) == 0)
+      return 0;
+  }
+  warnx("block %s in the store is corrupted", hex);
+  return -1;
+}
+
+/* Sorted hashes referenced by the manifests */
+typedef struct {
+  const char *dir;
+  uint8_t (*hashes)[SHA256_LEN];
+  size_t count, cap;
+  int error;
+} gc_refs_t;
+
+/* Block file being considered for removal */
+typedef struct {
+  const gc_refs_t *refs;
+  const char *subdir;
+  const char *prefix;
+  time_t now;
+  uint32_t removed;
+  uint64_t freed;
+} gc_sweep_t;
+
+static int
+cmp_hash(const void *a, const void *b) {
+  return memcmp(a, b, SHA256_LEN);
+}
+
+static int
+gc_add_manifest(const char *name, void *arg) {
+  gc_refs_t *refs = arg;
+  char devices[PATH_MAX];
+  char path[PATH_MAX];
+  size_t len = strlen(name);
+  rastore_manifest_t m;
+
+  /* Temporary files of a backup in progress are not manifests yet */
+  if (len != RASTORE_DID_HEX_LEN + strlen(MANIFEST_SUFFIX) ||
+      strcmp(name + RASTORE_DID_HEX_LEN, MANIFEST_SUFFIX) != 0)
+    return 0;
+
+  if (join(devices, sizeof(devices), refs->dir, "devices") < 0 ||
+      join(path, sizeof(path), devices, name) < 0 || load_manifest(path, &m) < 0) {
+    warnx("unreadable manifest %s, nothing removed", name);
+    refs->error = -1;
+    return -1;
+  }
+
+  for (uint32_t a = 0; a < m.nr_areas; a++) {
+    for (uint32_t i = 0; i < m.areas[a].nr_blocks; i++) {
+      if (m.areas[a].blocks[i].blank)
+        continue;
+      if (refs->count == refs->cap) {
+        size_t cap = refs->cap ? refs->cap * 2 : 1024;
+        void *p = realloc(refs->hashes, cap * SHA256_LEN);
+        if (p == NULL) {
+          rastore_free(&m);
+          warnx("memory allocation failed");
+          refs->error = -1;
+          return -1;
+        }
+        refs->hashes = p;
+        refs->cap = cap;
+      }
+      memcpy(refs->hashes[refs->count++], m.areas[a].blocks[i].hash, SHA256_LEN);
+    }
+  }
+  rastore_free(&m);
+  return 0;
+}
+
+static int
+gc_sweep_block(const char *name, void *arg) {
+  gc_sweep_t *sweep = arg;
+  char hex[HASH_HEX_LEN + 1];
+  uint8_t hash[SHA256_LEN];
+  char path[PATH_MAX];
+  struct stat st;
+
+  /* Only finished blocks, never a block temp file (<hash>.<pid>) */
+  if (strlen(name) != HASH_HEX_LEN - 2)
+    return 0;
+  snprintf(hex, sizeof(hex), "%s%s", sweep->prefix, name);
+  if (hex_to_bytes(hex, hash, SHA256_LEN) < 0)
+    return 0;
+  if (bsearch(hash, sweep->refs->hashes, sweep->refs->count, SHA256_LEN, cmp_hash) != NULL)
+    return 0;
+
+  if (join(path, sizeof(path), sweep->subdir, name) < 0 || stat(path, &st) < 0)
+    return 0;
+
+  /* Possibly reused by a backup whose manifest is not written yet */
+  if (difftime(sweep->now, st.st_mtime) < RASTORE_GC_GRACE)
+    return 0;
+  if (remove(path) == 0) {
+    sweep->removed++;
+    sweep->freed += (uint64_t)st.st_size;
+  }
+  return 0;
+}
+
+static int
+gc_sweep_dir(const char *name, void *arg) {
+  gc_sweep_t *sweep = arg;
+  char subdir[PATH_MAX];
+  uint8_t byte;
+
+  if (strlen(name) != 2 || hex_to_bytes(name, &byte, 1) < 0)
+    return 0;
+  if (join(subdir, sizeof(subdir), sweep->subdir, name) < 0)
+    return 0;
+
+  gc_sweep_t sub = *sweep;
+  sub.subdir = subdir;
+  sub.prefix = name;
+  list_dir(subdir, gc_sweep_block, &sub);
+  sweep->removed = sub.removed;
+  sweep->freed = sub.freed;
+  return 0;
+}
+
+int
+rastore_gc(const char *dir, uint32_t *removed, uint64_t *freed) {
+  gc_refs_t refs = { .dir = dir };
+  char path[PATH_MAX];
+
+  if (join(path, sizeof(path), dir, "devices") < 0 || list_dir(path, gc_add_manifest, &refs) < 0 ||
+      refs.error < 0) {
+    if (refs.error == 0)
+      warn("cannot read store %s", dir);
+    free(refs.hashes);
+    return -1;
+  }
+  qsort(refs.hashes, refs.count, SHA256_LEN, cmp_hash);
+
+  gc_sweep_t sweep = { .refs = &refs, .now = time(NULL) };
+  if (join(path, sizeof(path), dir, "blocks") < 0) {
+    free(refs.hashes);
+    return -1;
+  }
+  sweep.subdir = path;
+  int ret = list_dir(path, gc_sweep_dir, &sweep) < 0 ? -1 : 0;
+  if (ret < 0)
+    warn("cannot read store %s", path);
+  free(refs.hashes);
+
+  if (removed != NULL)
+    *removed = sweep.removed;
+  if (freed != NULL)
+    *freed = sweep.freed;
+  return ret;
+}
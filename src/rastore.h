@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Content-addressed backup store shared by many devices
+ */
+
+#ifndef RASTORE_H
+#define RASTORE_H
+
+#include "raconnect.h"
+#include "rbk.h"
+#include "sha256.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Blocks are cut like in a native backup, so both restore the same way */
+#define RASTORE_BLOCK_SIZE RBK_BLOCK_SIZE
+
+/* Device unique ID (DID) in hex, the manifest name */
+#define RASTORE_DID_HEX_LEN 32
+
+typedef struct {
+  uint8_t hash[SHA256_LEN]; /* SHA-256 of the block content */
+  bool blank;               /* All 0xFF, not kept in the store */
+} rastore_block_t;
+
+typedef struct {
+  ra_area_t area;
+  uint32_t nr_blocks;
+  rastore_block_t *blocks;
+} rastore_area_t;
+
+/* What a device manifest describes: its signature and the blocks of each area */
+typedef struct {
+  uint8_t sig[RBK_SIG_MAX];
+  size_t sig_len;
+  uint32_t nr_areas;
+  rastore_area_t areas[MAX_AREAS];
+} rastore_manifest_t;
+
+typedef struct {
+  uint32_t blocks;    /* Blocks in the backup */
+  uint32_t blank;     /* Erased blocks, referenced but not stored */
+  uint32_t added;     /* Blocks that were not in the store yet */
+  uint64_t added_len; /* Bytes those took on disk */
+} rastore_stats_t;
+
+/*
+ * DID of a signature response in hex (hex must hold RASTORE_DID_HEX_LEN + 1)
+ * Returns: 0 on success, -1 if the signature carries no DID
+ */
+int rastore_did_hex(const uint8_t *sig, size_t sig_len, char *hex);
+
+/*
+ * Add a backup of whole areas to the store
+ * New blocks are written first, then the device manifest is replaced, so an
+ * interrupted backup leaves the previous manifest usable.
+ * data[i]: content of areas[i], ead - sad + 1 bytes
+ * Returns: 0 on success, -1 on error
+ */
+int rastore_put(const char *dir,
+    const uint8_t *sig,
+    size_t sig_len,
+    const ra_area_t *areas,
+    const uint8_t *const *data,
+    size_t count,
+    rastore_stats_t *stats);
+
+/*
+ * Load the manifest of a device (release with rastore_free)
+ * Returns: 0 on success, -1 if missing or malformed
+ */
+int rastore_load(const char *dir, const char *did_hex, rastore_manifest_t *m);
+
+void rastore_free(rastore_manifest_t *m);
+
+/* Length of block i of an area */
+uint32_t rastore_block_len(const rastore_area_t *a, uint32_t i);
+
+/*
+ * Read a block back from the store, checking it against its hash
+ * Returns: 0 on success, -1 if missing or corrupted
+ */
+int rastore_block(const char *dir, const uint8_t hash[SHA256_LEN], uint8_t *out, uint32_t len);
+
+/* Seconds an unreferenced block is kept after a backup last stored or reused it */
+#define RASTORE_GC_GRACE (24 * 3600)
+
+/*
+ * Remove the blocks no manifest references
+ * Blocks modified within RASTORE_GC_GRACE are kept: a backup running alongside
+ * may be about to reference them.
+ * removed/freed: blocks deleted and their size on disk (may be NULL)
+ * Returns: 0 on success, -1 on error (nothing is deleted if a manifest is unreadable)
+ */
+int rastore_gc(const char *dir, uint32_t *removed, uint64_t *freed);
+
+#endif /* RASTORE_H */
@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Native backup container (.rbk)
+ *
+ * Layout, all integers little-endian:
+ *
+ *   header (96 bytes)
+ *     0  magic "RBK1"
+ *     4  u16 version, u16 header length
+ *     8  u32 block size, u32 area count, u32 data offset
+ *    20  u32 CRC-32 of everything before the data offset, this field as 0
+ *    24  u32 signature length, reserved (4 bytes)
+ *    32  device signature (64 bytes)
+ *   area table (32 bytes per area)
+ *     sad, ead, eau, wau, rau, cau, u8 koa and 3 reserved, index offset
+ *   block index (16 bytes per block, per area)
+ *     data offset, stored length (0 = erased, left out), CRC-32, flags
+ *   block data
+ *
+ * Blocks are compressed one by one (flag bit 0), or stored as is when that
+ * does not make them smaller, so any block is decoded on its own.
+ */
+
+#include "rbk.h"
+#include "compat.h"
+#include "crc32.h"
+#include "lz.h"
+#include "rabuf.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_COMPRESSED 0x01
+
+static void
+put_le16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void
+put_le32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t
+get_le16(const uint8_t *p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t
+get_le32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t
+area_blocks(const ra_area_t *area) {
+  return (uint32_t)(((uint64_t)area->ead - area->sad + RBK_BLOCK_SIZE) / RBK_BLOCK_SIZE);
+}
+
+/* CRC of the header and tables with the CRC field taken as 0 */
+static uint32_t
+tables_crc(const uint8_t *buf, size_t len) {
+  uint32_t crc = crc32_update(0, buf, 20);
+  crc = crc32_fill(crc, 0, 4);
+  return crc32_update(crc, buf + 24, len - 24);
+}
+
+/*
+ * Compress and write the blocks of one area, filling its index
+ */
+static int
+write_blocks(FILE *fp, const ra_area_t *area, const uint8_t *data, uint8_t *index, size_t *off) {
+  uint8_t packed[RBK_BLOCK_SIZE];
+  uint32_t size = area->ead - area->sad + 1;
+
+  for (uint32_t i = 0; i < area_blocks(area); i++) {
+    const uint8_t *block = data + (size_t)i * RBK_BLOCK_SIZE;
+    uint32_t len = size - i * RBK_BLOCK_SIZE < RBK_BLOCK_SIZE ? size - i * RBK_BLOCK_SIZE
+                                                               : RBK_BLOCK_SIZE;
+    uint8_t *e = index + (size_t)i * RBK_ENTRY_LEN;
+
+    put_le32(&e[8], crc32_calc(block, len));
+    if (rabuf_is_blank(block, len))
+      continue;
+
+    /* Kept as is unless compression saves space */
+    size_t n = lz_compress(block, len, packed, len - 1);
+    const uint8_t *out = n ? packed : block;
+    size_t out_len = n ? n : len;
+
+    if (fwrite(out, 1, out_len, fp) != out_len)
+      return -1;
+    put_le32(&e[0], (uint32_t)*off);
+    put_le32(&e[4], (uint32_t)out_len);
+    put_le32(&e[12], n ? BLOCK_COMPRESSED : 0);
+    *off += out_len;
+  }
+  return 0;
+}
+
+int
+rbk_write(const char *path,
+    const uint8_t *sig,
+    size_t sig_len,
+    const ra_area_t *areas,
+    const uint8_t *const *data,
+    size_t count) {
+  if (count == 0 || count > MAX_AREAS || sig_len > RBK_SIG_MAX) {
+    warnx("invalid backup layout");
+    return -1;
+  }
+
+  size_t tables_len = RBK_HEADER_LEN + count * RBK_AREA_LEN;
+  for (size_t a = 0; a < count; a++)
+    tables_len += (size_t)area_blocks(&areas[a]) * RBK_ENTRY_LEN;
+
+  uint8_t *tables = calloc(1, tables_len);
+  if (tables == NULL) {
+    warn("malloc failed");
+    return -1;
+  }
+
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL) {
+    warn("failed to create %s", path);
+    free(tables);
+    return -1;
+  }
+
+  memcpy(tables, RBK_MAGIC, 4);
+  put_le16(&tables[4], RBK_VERSION);
+  put_le16(&tables[6], RBK_HEADER_LEN);
+  put_le32(&tables[8], RBK_BLOCK_SIZE);
+  put_le32(&tables[12], (uint32_t)count);
+  put_le32(&tables[16], (uint32_t)tables_len);
+  put_le32(&tables[24], (uint32_t)sig_len);
+  if (sig_len > 0)
+    memcpy(&tables[32], sig, sig_len);
+
+  /* Blocks go out first (seek back for the tables once offsets are known) */
+  int ret = fseek(fp, (long)tables_len, SEEK_SET) == 0 ? 0 : -1;
+  size_t off = tables_len;
+  size_t index_off = RBK_HEADER_LEN + count * RBK_AREA_LEN;
+  for (size_t a = 0; a < count && ret == 0; a++) {
+    const ra_area_t *area = &areas[a];
+    uint8_t *t = tables + RBK_HEADER_LEN + a * RBK_AREA_LEN;
+    put_le32(&t[0], area->sad);
+    put_le32(&t[4], area->ead);
+    put_le32(&t[8], area->eau);
+    put_le32(&t[12], area->wau);
+    put_le32(&t[16], area->rau);
+    put_le32(&t[20], area->cau);
+    t[24] = area->koa;
+    put_le32(&t[28], (uint32_t)index_off);
+
+    ret = write_blocks(fp, area, data[a], tables + index_off, &off);
+    index_off += (size_t)area_blocks(area) * RBK_ENTRY_LEN;
+    if (off > UINT32_MAX)
+      ret = -1;
+  }
+
+  put_le32(&tables[20], tables_crc(tables, tables_len));
+  if (ret == 0 && (fseek(fp, 0, SEEK_SET) != 0 || fwrite(tables, 1, tables_len, fp) != tables_len))
+    ret = -1;
+  if (fclose(fp) != 0)
+    ret = -1;
+  if (ret < 0) {
+    warn("failed to write %s", path);
+    remove(path);
+  }
+
+  free(tables);
+  return ret;
+}
+
+/*
+ * Check one area entry and its block index against the mapped file
+ */
+static int
+load_area(const rbk_t *rbk, const uint8_t *t, size_t data_off, rbk_area_t *a) {
+  a->area.sad = get_le32(&t[0]);
+  a->area.ead = get_le32(&t[4]);
+  a->area.eau = get_le32(&t[8]);
+  a->area.wau = get_le32(&t[12]);
+  a->area.rau = get_le32(&t[16]);
+  a->area.cau = get_le32(&t[20]);
+  a->area.koa = t[24];
+  if (a->area.ead < a->area.sad)
+    return -1;
+
+  uint32_t index_off = get_le32(&t[28]);
+  a->nr_blocks = area_blocks(&a->area);
+  if (index_off > data_off || (data_off - index_off) / RBK_ENTRY_LEN < a->nr_blocks)
+    return -1;
+  a->index = (const uint8_t *)rbk->map + index_off;
+
+  for (uint32_t i = 0; i < a->nr_blocks; i++) {
+    const uint8_t *e = a->index + (size_t)i * RBK_ENTRY_LEN;
+    uint32_t off = get_le32(&e[0]);
+    uint32_t len = get_le32(&e[4]);
+    uint32_t flags = get_le32(&e[12]);
+
+    if (len == 0)
+      continue;
+    if (off < data_off || off > rbk->map_len || rbk->map_len - off < len ||
+        len > rbk_block_len(a, i) || (flags & ~BLOCK_COMPRESSED) != 0 ||
+        (!(flags & BLOCK_COMPRESSED) && len != rbk_block_len(a, i)))
+      return -1;
+  }
+  return 0;
+}
+
+int
+rbk_open(const char *path, rbk_t *rbk) {
+  memset(rbk, 0, sizeof(*rbk));
+
+  rbk->map = map_file(path, &rbk->map_len);
+  if (rbk->map == NULL) {
+    warn("failed to open %s", path);
+    return -1;
+  }
+
+  const uint8_t *hdr = rbk->map;
+  if (rbk->map_len < RBK_HEADER_LEN || memcmp(hdr, RBK_MAGIC, 4) != 0) {
+    warnx("%s: not a radfu backup", path);
+    rbk_close(rbk);
+    return -1;
+  }
+  if (get_le16(&hdr[4]) != RBK_VERSION || get_le16(&hdr[6]) != RBK_HEADER_LEN ||
+      get_le32(&hdr[8]) != RBK_BLOCK_SIZE) {
+    warnx("%s: unsupported backup version or layout", path);
+    rbk_close(rbk);
+    return -1;
+  }
+
+  uint32_t data_off = get_le32(&hdr[16]);
+  rbk->nr_areas = get_le32(&hdr[12]);
+  rbk->sig_len = get_le32(&hdr[24]);
+  if (data_off > rbk->map_len || rbk->nr_areas == 0 || rbk->nr_areas > MAX_AREAS ||
+      rbk->sig_len > RBK_SIG_MAX ||
+      data_off < RBK_HEADER_LEN + (size_t)rbk->nr_areas * RBK_AREA_LEN) {
+    warnx("%s: truncated backup", path);
+    rbk_close(rbk);
+    return -1;
+  }
+  if (tables_crc(hdr, data_off) != get_le32(&hdr[20])) {
+    warnx("%s: corrupted backup header", path);
+    rbk_close(rbk);
+    return -1;
+  }
+  memcpy(rbk->sig, &hdr[32], rbk->sig_len);
+
+  for (uint32_t a = 0; a < rbk->nr_areas; a++) {
+    const uint8_t *t = hdr + RBK_HEADER_LEN + (size_t)a * RBK_AREA_LEN;
+    if (load_area(rbk, t, data_off, &rbk->areas[a]) < 0) {
+      warnx("%s: corrupted area %u", path, a);
+      rbk_close(rbk);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void
+rbk_close(rbk_t *rbk) {
+  unmap_file(rbk->map, rbk->map_len);
+  memset(rbk, 0, sizeof(*rbk));
+}
+
+uint32_t
+rbk_block_len(const rbk_area_t *a, uint32_t i) {
+  uint32_t left = a->area.ead - a->area.sad - i * RBK_BLOCK_SIZE;
+  return left < RBK_BLOCK_SIZE ? left + 1 : RBK_BLOCK_SIZE;
+}
+
+bool
+rbk_block_blank(const rbk_area_t *a, uint32_t i) {
+  return get_le32(a->index + (size_t)i * RBK_ENTRY_LEN + 4) == 0;
+}
+
+uint32_t
+rbk_block_crc(const rbk_area_t *a, uint32_t i) {
+  return get_le32(a->index + (size_t)i * RBK_ENTRY_LEN + 8);
+}
+
+int
+rbk_block_read(const rbk_t *rbk, const rbk_area_t *a, uint32_t i, uint8_t *out) {
+  const uint8_t *e = a->index + (size_t)i * RBK_ENTRY_LEN;
+  const uint8_t *src = (const uint8_t *)rbk->map + get_le32(&e[0]);
+  uint32_t stored = get_le32(&e[4]);
+  uint32_t len = rbk_block_len(a, i);
+
+  if (stored == 0)
+    memset(out, 0xFF, len);
+  else if (get_le32(&e[12]) & BLOCK_COMPRESSED) {
+    if (lz_decompress(src, stored, out, len) < 0)
+      goto corrupted;
+  } else {
+    memcpy(out, src, len);
+  }
+
+  if (crc32_calc(out, len) == get_le32(&e[8]))
+    return 0;
+
+corrupted:
+  warnx("backup block at 0x%08X is corrupted", a->area.sad + i * RBK_BLOCK_SIZE);
+  return -1;
+}
+
+int
+rbk_parse(const char *filename, parsed_file_t *out) {
+  rbk_t rbk;
+
+  if (rbk_open(filename, &rbk) < 0)
+    return -1;
+
+  /* Areas in address order, as extents */
+  int order[MAX_AREAS];
+  for (uint32_t a = 0; a < rbk.nr_areas; a++) {
+    uint32_t j = a;
+    for (; j > 0 && rbk.areas[order[j - 1]].area.sad > rbk.areas[a].area.sad; j--)
+      order[j] = order[j - 1];
+    order[j] = (int)a;
+  }
+
+  uint32_t base = rbk.areas[order[0]].area.sad;
+  uint64_t end = 0;
+  for (uint32_t a = 0; a < rbk.nr_areas; a++) {
+    if ((uint64_t)rbk.areas[a].area.ead + 1 > end)
+      end = (uint64_t)rbk.areas[a].area.ead + 1;
+  }
+
+  size_t size = (size_t)(end - base);
+  out->data = end - base <= UINT32_MAX ? malloc(size) : NULL;
+  if (out->data == NULL) {
+    warn("malloc failed");
+    rbk_close(&rbk);
+    return -1;
+  }
+  memset(out->data, 0xFF, size);
+
+  for (uint32_t n = 0; n < rbk.nr_areas; n++) {
+    const rbk_area_t *a = &rbk.areas[order[n]];
+    uint8_t *dst = out->data + (a->area.sad - base);
+
+    for (uint32_t i = 0; i < a->nr_blocks; i++) {
+      if (!rbk_block_blank(a, i) &&
+          rbk_block_read(&rbk, a, i, dst + (size_t)i * RBK_BLOCK_SIZE) < 0) {
+        free(out->data);
+        out->data = NULL;
+        rbk_close(&rbk);
+        return -1;
+      }
+    }
+    out->extents[n] = (format_extent_t){ a->area.sad, a->area.ead - a->area.sad + 1, NULL };
+  }
+
+  out->nr_extents = (int)rbk.nr_areas;
+  out->size = size;
+  out->base_addr = base;
+  out->has_addr = 1;
+  rbk_close(&rbk);
+  return 0;
+}
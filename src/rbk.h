@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Native backup container (.rbk): compressed, block-indexed flash areas
+ */
+
+#ifndef RBK_H
+#define RBK_H
+
+#include "formats.h"
+#include "raconnect.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RBK_MAGIC "RBK1"
+#define RBK_VERSION 1
+#define RBK_HEADER_LEN 96
+#define RBK_AREA_LEN 32
+#define RBK_ENTRY_LEN 16
+
+/*
+ * Bytes per block, the unit of compression, CRCs and store dedup
+ * Not tied to the erase unit (32KB on code flash): restore erases every
+ * area up front (restore_erase) and only writes, so a block only has to
+ * be a multiple of the write unit.
+ */
+#define RBK_BLOCK_SIZE 4096
+
+/* Device signature kept in the header (RMB NOA TYP BFV DID PTN) */
+#define RBK_SIG_MAX 64
+
+typedef struct {
+  ra_area_t area;       /* Area as reported by the device */
+  uint32_t nr_blocks;   /* Blocks covering [sad, ead] */
+  const uint8_t *index; /* RBK_ENTRY_LEN per block, in the mapping */
+} rbk_area_t;
+
+typedef struct {
+  void *map;
+  size_t map_len;
+  uint8_t sig[RBK_SIG_MAX];
+  size_t sig_len;
+  uint32_t nr_areas;
+  rbk_area_t areas[MAX_AREAS];
+} rbk_t;
+
+/*
+ * Write a backup of whole areas
+ * sig: signature response of the device (sig_len bytes, may be 0)
+ * data[i]: content of areas[i], ead - sad + 1 bytes
+ * Returns: 0 on success, -1 on error
+ */
+int rbk_write(const char *path,
+    const uint8_t *sig,
+    size_t sig_len,
+    const ra_area_t *areas,
+    const uint8_t *const *data,
+    size_t count);
+
+/*
+ * Map a backup and check its header and block index
+ * Block contents are checked against their CRC when decoded.
+ * Returns: 0 on success, -1 on error (rbk is left closed)
+ */
+int rbk_open(const char *path, rbk_t *rbk);
+
+void rbk_close(rbk_t *rbk);
+
+/*
+ * Block i of an area: its length, whether it was elided as erased, and the
+ * CRC-32 of its content (what the device CRC command returns for it)
+ */
+uint32_t rbk_block_len(const rbk_area_t *a, uint32_t i);
+bool rbk_block_blank(const rbk_area_t *a, uint32_t i);
+uint32_t rbk_block_crc(const rbk_area_t *a, uint32_t i);
+
+/*
+ * Decode block i of an area into out (rbk_block_len() bytes)
+ * Returns: 0 on success, -1 if the block is corrupted
+ */
+int rbk_block_read(const rbk_t *rbk, const rbk_area_t *a, uint32_t i, uint8_t *out);
+
+/*
+ * Expand a backup into a flat image (format_parse() for FORMAT_RBK)
+ * Each area is one extent; gaps between areas are filled with 0xFF.
+ * Returns: 0 on success, -1 on error
+ */
+int rbk_parse(const char *filename, parsed_file_t *out);
+
+#endif /* RBK_H */
@@ -0,0 +1,535 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Pre-compiled image container (.rfi)
+ *
+ * Layout, all integers little-endian:
+ *
+ *   header (64 bytes)
+ *     0  magic "RFI1"
+ *     4  u16 version, u16 header length
+ *     8  u32 extent count, u32 chunk size, u32 alignment, u32 payload bytes
+ *    24  reserved (8 bytes)
+ *    32  SHA-256 over (start, end, data) of every extent
+ *   extent table (32 bytes per extent)
+ *     start, end, CRC-32, chunk count, stream offset, stream length,
+ *     chunk CRC table offset, reserved
+ *   chunk CRC tables, then packet streams
+ *
+ * A stream holds the exact bytes the write command sends: the WRI command
+ * packet for [start, end], then the framed data packets with their checksums.
+ */
+
+#include "rfi.h"
+#include "compat.h"
+#include "crc32.h"
+#include "rabuf.h"
+#include "rapacker.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DATA_PKT_LEN (PKT_HDR_LEN + RFI_CHUNK + PKT_TRL_LEN)
+
+static void
+put_le16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void
+put_le32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static uint16_t
+get_le16(const uint8_t *p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t
+get_le32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t
+chunk_count(uint32_t start, uint32_t end) {
+  return (end - start) / RFI_CHUNK + 1;
+}
+
+static size_t
+stream_size(uint32_t start, uint32_t end) {
+  uint32_t len = end - start + 1;
+  return RFI_CMD_PKT_LEN + (size_t)chunk_count(start, end) * (PKT_HDR_LEN + PKT_TRL_LEN) + len;
+}
+
+/*
+ * Parsed image placed at base, 0xFF where the file loads nothing, as erased
+ * flash reads
+ */
+typedef struct {
+  const parsed_file_t *parsed;
+  uint64_t base;
+  uint64_t end; /* exclusive */
+} image_t;
+
+static void
+image_copy(const image_t *img, uint64_t addr, uint8_t *dst, size_t len) {
+  memset(dst, 0xFF, len);
+  uint64_t lo = addr > img->base ? addr : img->base;
+  uint64_t hi = addr + len < img->end ? addr + len : img->end;
+  if (lo < hi)
+    format_copy(img->parsed, (size_t)(lo - img->base), dst + (lo - addr), (size_t)(hi - lo));
+}
+
+static bool
+image_block_used(const image_t *img, uint64_t addr) {
+  uint64_t lo = addr > img->base ? addr : img->base;
+  uint64_t hi = addr + RFI_ALIGN < img->end ? addr + RFI_ALIGN : img->end;
+  if (lo >= hi)
+    return false;
+  size_t len = (size_t)(hi - lo);
+  return format_first_used(img->parsed, (size_t)(lo - img->base), len) < len;
+}
+
+/* Extent list built by the compiler */
+typedef struct {
+  uint32_t start;
+  uint32_t end;
+} range_t;
+
+/*
+ * Runs of non-blank RFI_ALIGN blocks, cut at RFI_SPLIT boundaries
+ * Returns: extent count, -1 on error (*out must be freed)
+ */
+static int
+find_extents(const image_t *img, range_t **out) {
+  range_t *r = NULL;
+  int count = 0, cap = 0;
+  uint64_t first = img->base / RFI_ALIGN * RFI_ALIGN;
+
+  *out = NULL;
+  for (uint64_t addr = first; addr < img->end; addr += RFI_ALIGN) {
+    if (!image_block_used(img, addr))
+      continue;
+
+    bool extend = count > 0 && r[count - 1].end + 1 == addr && addr % RFI_SPLIT != 0;
+    if (extend) {
+      r[count - 1].end = (uint32_t)(addr + RFI_ALIGN - 1);
+      continue;
+    }
+
+    if (count == cap) {
+      cap = cap ? cap * 2 : 16;
+      range_t *n = realloc(r, (size_t)cap * sizeof(*r));
+      if (n == NULL) {
+        warn("malloc failed");
+        free(r);
+        return -1;
+      }
+      r = n;
+    }
+    r[count].start = (uint32_t)addr;
+    r[count].end = (uint32_t)(addr + RFI_ALIGN - 1);
+    count++;
+  }
+
+  *out = r;
+  return count;
+}
+
+/*
+ * Emit the packet stream of one extent and collect its CRCs
+ */
+static int
+write_stream(FILE *fp, const image_t *img, const range_t *r, uint8_t *crcs, uint32_t *crc_out) {
+  uint8_t pkt[DATA_PKT_LEN];
+  uint8_t cmd[8];
+  uint32_t crc = 0;
+
+  uint32_to_be(r->start, &cmd[0]);
+  uint32_to_be(r->end, &cmd[4]);
+  ssize_t n = ra_pack_pkt(pkt, sizeof(pkt), WRI_CMD, cmd, sizeof(cmd), false);
+  if (n != RFI_CMD_PKT_LEN || fwrite(pkt, 1, (size_t)n, fp) != (size_t)n)
+    return -1;
+
+  uint32_t i = 0;
+  for (uint64_t addr = r->start; addr <= r->end; addr += RFI_CHUNK, i++) {
+    size_t len = r->end - addr + 1 < RFI_CHUNK ? (size_t)(r->end - addr + 1) : RFI_CHUNK;
+    image_copy(img, addr, pkt + PKT_HDR_LEN, len);
+    put_le32(crcs + 4 * i, crc32_calc(pkt + PKT_HDR_LEN, len));
+    crc = crc32_update(crc, pkt + PKT_HDR_LEN, len);
+
+    n = ra_pack_pkt_inplace(pkt, sizeof(pkt), WRI_CMD, len, true);
+    if (n < 0 || fwrite(pkt, 1, (size_t)n, fp) != (size_t)n)
+      return -1;
+  }
+
+  *crc_out = crc;
+  return 0;
+}
+
+/*
+ * Content hash: (start, end, data) of every extent in address order
+ */
+static void
+hash_extents(const image_t *img, const range_t *r, int count, uint8_t digest[SHA256_LEN]) {
+  sha256_ctx_t ctx;
+  uint8_t buf[RFI_CHUNK];
+  uint8_t hdr[8];
+
+  sha256_init(&ctx);
+  for (int e = 0; e < count; e++) {
+    put_le32(&hdr[0], r[e].start);
+    put_le32(&hdr[4], r[e].end);
+    sha256_update(&ctx, hdr, sizeof(hdr));
+    for (uint64_t addr = r[e].start; addr <= r[e].end; addr += RFI_CHUNK) {
+      size_t len = r[e].end - addr + 1 < RFI_CHUNK ? (size_t)(r[e].end - addr + 1) : RFI_CHUNK;
+      image_copy(img, addr, buf, len);
+      sha256_update(&ctx, buf, len);
+    }
+  }
+  sha256_final(&ctx, digest);
+}
+
+static int
+write_container(FILE *fp, const image_t *img, const range_t *r, int count) {
+  uint8_t hdr[RFI_HEADER_LEN] = { 0 };
+  uint8_t *table = calloc((size_t)count, RFI_EXTENT_LEN);
+  uint32_t total_chunks = 0, payload = 0;
+
+  for (int e = 0; e < count; e++) {
+    total_chunks += chunk_count(r[e].start, r[e].end);
+    payload += r[e].end - r[e].start + 1;
+  }
+
+  uint8_t *crcs = calloc(total_chunks ? total_chunks : 1, 4);
+  if (table == NULL || crcs == NULL) {
+    warn("malloc failed");
+    free(table);
+    free(crcs);
+    return -1;
+  }
+
+  memcpy(hdr, RFI_MAGIC, 4);
+  put_le16(&hdr[4], RFI_VERSION);
+  put_le16(&hdr[6], RFI_HEADER_LEN);
+  put_le32(&hdr[8], (uint32_t)count);
+  put_le32(&hdr[12], RFI_CHUNK);
+  put_le32(&hdr[16], RFI_ALIGN);
+  put_le32(&hdr[20], payload);
+  hash_extents(img, r, count, &hdr[32]);
+
+  /* Tables first, streams after: offsets are known up front */
+  size_t crc_off = RFI_HEADER_LEN + (size_t)count * RFI_EXTENT_LEN;
+  size_t stream_off = crc_off + (size_t)total_chunks * 4;
+  for (int e = 0; e < count; e++) {
+    uint8_t *t = table + (size_t)e * RFI_EXTENT_LEN;
+    uint32_t chunks = chunk_count(r[e].start, r[e].end);
+    size_t len = stream_size(r[e].start, r[e].end);
+    put_le32(&t[0], r[e].start);
+    put_le32(&t[4], r[e].end);
+    put_le32(&t[12], chunks);
+    put_le32(&t[16], (uint32_t)stream_off);
+    put_le32(&t[20], (uint32_t)len);
+    put_le32(&t[24], (uint32_t)crc_off);
+    crc_off += (size_t)chunks * 4;
+    stream_off += len;
+  }
+
+  /* Streams go out first (seek back for the tables once CRCs are known) */
+  int ret = -1;
+  size_t streams_at = RFI_HEADER_LEN + (size_t)count * RFI_EXTENT_LEN + (size_t)total_chunks * 4;
+  if (fseek(fp, (long)streams_at, SEEK_SET) == 0) {
+    uint8_t *c = crcs;
+    ret = 0;
+    for (int e = 0; e < count && ret == 0; e++) {
+      uint32_t crc = 0;
+      ret = write_stream(fp, img, &r[e], c, &crc);
+      put_le32(table + (size_t)e * RFI_EXTENT_LEN + 8, crc);
+      c += (size_t)chunk_count(r[e].start, r[e].end) * 4;
+    }
+  }
+
+  if (ret == 0 && (fseek(fp, 0, SEEK_SET) != 0 || fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) ||
+                      fwrite(table, RFI_EXTENT_LEN, (size_t)count, fp) != (size_t)count ||
+                      fwrite(crcs, 4, total_chunks, fp) != total_chunks))
+    ret = -1;
+
+  free(table);
+  free(crcs);
+  return ret;
+}
+
+int
+rfi_compile(const char *in, input_format_t format, uint32_t base, const char *out) {
+  parsed_file_t parsed;
+  range_t *ranges;
+
+  if (format == FORMAT_RFI || (format == FORMAT_AUTO && format_detect(in) == FORMAT_RFI)) {
+    warnx("%s is already a compiled image", in);
+    return -1;
+  }
+  if (format_parse(in, format, &parsed) < 0)
+    return -1;
+
+  image_t img;
+  img.parsed = &parsed;
+  img.base = (base == 0 && parsed.has_addr) ? parsed.base_addr : base;
+  img.end = img.base + parsed.size;
+  if (img.end > (uint64_t)UINT32_MAX + 1) {
+    warnx("%s: image extends past the 32-bit address space", in);
+    free(parsed.data);
+    return -1;
+  }
+
+  int count = find_extents(&img, &ranges);
+  if (count <= 0) {
+    if (count == 0)
+      warnx("%s: image is blank, nothing to compile", in);
+    free(parsed.data);
+    return -1;
+  }
+
+  FILE *fp = fopen(out, "wb");
+  if (fp == NULL) {
+    warn("failed to create %s", out);
+    free(ranges);
+    free(parsed.data);
+    return -1;
+  }
+
+  int ret = write_container(fp, &img, ranges, count);
+  if (fclose(fp) != 0)
+    ret = -1;
+  if (ret < 0) {
+    warn("failed to write %s", out);
+    remove(out);
+  }
+
+  if (ret == 0) {
+    rfi_t rfi;
+    char hex[2 * SHA256_LEN + 1];
+    if (rfi_open(out, &rfi) < 0)
+      ret = -1;
+    if (ret == 0) {
+      sha256_hex(rfi.sha256, hex);
+      printf("Compiled %s -> %s\n", in, out);
+      printf("  %u extents, %u bytes to program (%zu bytes in file)\n",
+          rfi.nr_extents,
+          rfi.payload,
+          parsed.size);
+      for (uint32_t e = 0; e < rfi.nr_extents; e++)
+        printf("  0x%08X-0x%08X  CRC-32: 0x%08X\n",
+            rfi.extents[e].start,
+            rfi.extents[e].end,
+            rfi.extents[e].crc);
+      printf("  SHA-256: %s\n", hex);
+      rfi_close(&rfi);
+    }
+  }
+
+  free(ranges);
+  free(parsed.data);
+  return ret;
+}
+
+/*
+ * Check one extent entry against the mapped file: the packets must frame
+ * the chunks exactly as write_stream() emits them, and carry what the CRC
+ * tables say. The data is fed to the content hash on the way.
+ */
+static int
+load_extent(const rfi_t *rfi, const uint8_t *t, rfi_extent_t *ext, sha256_ctx_t *ctx) {
+  const uint8_t *map = rfi->map;
+  uint32_t stream_off = get_le32(&t[16]);
+  uint32_t stream_len = get_le32(&t[20]);
+  uint32_t crc_off = get_le32(&t[24]);
+  uint8_t pkt[RFI_CMD_PKT_LEN];
+  uint8_t hdr[PKT_HDR_LEN];
+  uint8_t trl[PKT_TRL_LEN];
+  uint8_t cmd[8];
+
+  ext->start = get_le32(&t[0]);
+  ext->end = get_le32(&t[4]);
+  ext->crc = get_le32(&t[8]);
+  ext->nr_chunks = get_le32(&t[12]);
+
+  if (ext->end < ext->start || ext->start % RFI_ALIGN != 0 || (ext->end + 1) % RFI_ALIGN != 0 ||
+      ext->nr_chunks != chunk_count(ext->start, ext->end) ||
+      stream_len != stream_size(ext->start, ext->end))
+    return -1;
+  if (stream_off > rfi->map_len || stream_len > rfi->map_len - stream_off ||
+      crc_off > rfi->map_len || (size_t)ext->nr_chunks * 4 > rfi->map_len - crc_off)
+    return -1;
+
+  ext->stream = map + stream_off;
+  ext->stream_len = stream_len;
+  ext->chunk_crcs = map + crc_off;
+
+  /* The write command must address the extent itself */
+  uint32_to_be(ext->start, &cmd[0]);
+  uint32_to_be(ext->end, &cmd[4]);
+  if (ra_pack_pkt(pkt, sizeof(pkt), WRI_CMD, cmd, sizeof(cmd), false) != RFI_CMD_PKT_LEN ||
+      memcmp(ext->stream, pkt, RFI_CMD_PKT_LEN) != 0)
+    return -1;
+
+  put_le32(&cmd[0], ext->start);
+  put_le32(&cmd[4], ext->end);
+  sha256_update(ctx, cmd, sizeof(cmd));
+
+  uint32_t crc = 0;
+  for (uint32_t i = 0; i < ext->nr_chunks; i++) {
+    size_t len;
+    const uint8_t *data = rfi_chunk_data(ext, i, &len);
+    if (ra_pack_hdr_trl(hdr, trl, WRI_CMD, data, len, true) < 0 ||
+        memcmp(data - PKT_HDR_LEN, hdr, PKT_HDR_LEN) != 0 ||
+        memcmp(data + len, trl, PKT_TRL_LEN) != 0)
+      return -1;
+    uint32_t c = crc32_calc(data, len);
+    if (c != rfi_chunk_crc(ext, i))
+      return -1;
+    crc = crc32_update(crc, data, len);
+    sha256_update(ctx, data, len);
+  }
+  return crc == ext->crc ? 0 : -1;
+}
+
+int
+rfi_open(const char *path, rfi_t *rfi) {
+  memset(rfi, 0, sizeof(*rfi));
+
+  rfi->map = map_file(path, &rfi->map_len);
+  if (rfi->map == NULL) {
+    warn("failed to open %s", path);
+    return -1;
+  }
+
+  const uint8_t *hdr = rfi->map;
+  if (rfi->map_len < RFI_HEADER_LEN || memcmp(hdr, RFI_MAGIC, 4) != 0) {
+    warnx("%s: not a radfu image container", path);
+    rfi_close(rfi);
+    return -1;
+  }
+  if (get_le16(&hdr[4]) != RFI_VERSION || get_le16(&hdr[6]) != RFI_HEADER_LEN ||
+      get_le32(&hdr[12]) != RFI_CHUNK || get_le32(&hdr[16]) != RFI_ALIGN) {
+    warnx("%s: unsupported container version or layout", path);
+    rfi_close(rfi);
+    return -1;
+  }
+
+  rfi->nr_extents = get_le32(&hdr[8]);
+  rfi->payload = get_le32(&hdr[20]);
+  memcpy(rfi->sha256, &hdr[32], SHA256_LEN);
+
+  if (rfi->nr_extents == 0 ||
+      rfi->nr_extents > (rfi->map_len - RFI_HEADER_LEN) / RFI_EXTENT_LEN) {
+    warnx("%s: truncated container", path);
+    rfi_close(rfi);
+    return -1;
+  }
+
+  rfi->extents = calloc(rfi->nr_extents, sizeof(*rfi->extents));
+  if (rfi->extents == NULL) {
+    warn("malloc failed");
+    rfi_close(rfi);
+    return -1;
+  }
+
+  sha256_ctx_t ctx;
+  uint8_t digest[SHA256_LEN];
+  uint32_t payload = 0;
+
+  sha256_init(&ctx);
+  for (uint32_t e = 0; e < rfi->nr_extents; e++) {
+    rfi_extent_t *ext = &rfi->extents[e];
+    const uint8_t *t = hdr + RFI_HEADER_LEN + (size_t)e * RFI_EXTENT_LEN;
+    if (load_extent(rfi, t, ext, &ctx) < 0 || (e > 0 && ext->start <= rfi->extents[e - 1].end)) {
+      warnx("%s: corrupted extent %u", path, e);
+      rfi_close(rfi);
+      return -1;
+    }
+    payload += ext->end - ext->start + 1;
+  }
+
+  if (payload != rfi->payload) {
+    warnx("%s: corrupted header", path);
+    rfi_close(rfi);
+    return -1;
+  }
+
+  sha256_final(&ctx, digest);
+  if (memcmp(digest, rfi->sha256, SHA256_LEN) != 0) {
+    warnx("%s: content hash mismatch", path);
+    rfi_close(rfi);
+    return -1;
+  }
+  return 0;
+}
+
+void
+rfi_close(rfi_t *rfi) {
+  free(rfi->extents);
+  unmap_file(rfi->map, rfi->map_len);
+  memset(rfi, 0, sizeof(*rfi));
+}
+
+const uint8_t *
+rfi_data_packet(const rfi_extent_t *ext, uint32_t i, size_t *len) {
+  uint32_t left = ext->end - ext->start + 1 - i * RFI_CHUNK;
+  *len = PKT_HDR_LEN + (left < RFI_CHUNK ? left : RFI_CHUNK) + PKT_TRL_LEN;
+  return ext->stream + RFI_CMD_PKT_LEN + (size_t)i * DATA_PKT_LEN;
+}
+
+const uint8_t *
+rfi_chunk_data(const rfi_extent_t *ext, uint32_t i, size_t *len) {
+  const uint8_t *pkt = rfi_data_packet(ext, i, len);
+  *len -= PKT_HDR_LEN + PKT_TRL_LEN;
+  return pkt + PKT_HDR_LEN;
+}
+
+uint32_t
+rfi_chunk_crc(const rfi_extent_t *ext, uint32_t i) {
+  return get_le32(ext->chunk_crcs + 4 * (size_t)i);
+}
+
+int
+rfi_parse(const char *filename, parsed_file_t *out) {
+  rfi_t rfi;
+
+  if (rfi_open(filename, &rfi) < 0)
+    return -1;
+
+  uint32_t base = rfi.extents[0].start;
+  size_t size = (size_t)rfi.extents[rfi.nr_extents - 1].end - base + 1;
+
+  out->data = malloc(size);
+  if (out->data == NULL) {
+    warn("malloc failed");
+    rfi_close(&rfi);
+    return -1;
+  }
+  memset(out->data, 0xFF, size);
+
+  for (uint32_t e = 0; e < rfi.nr_extents; e++) {
+    const rfi_extent_t *ext = &rfi.extents[e];
+    for (uint32_t i = 0; i < ext->nr_chunks; i++) {
+      size_t len;
+      const uint8_t *data = rfi_chunk_data(ext, i, &len);
+      memcpy(out->data + (ext->start - base) + (size_t)i * RFI_CHUNK, data, len);
+    }
+  }
+
+  out->size = size;
+  out->base_addr = base;
+  out->has_addr = 1;
+  rfi_close(&rfi);
+  return 0;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Pre-compiled image container (.rfi): ready-to-send write packet streams
+ */
+
+#ifndef RFI_H
+#define RFI_H
+
+#include "formats.h"
+#include "sha256.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RFI_MAGIC "RFI1"
+#define RFI_VERSION 1
+#define RFI_HEADER_LEN 64
+#define RFI_EXTENT_LEN 32
+
+/* Extents are aligned to a multiple of every RA write unit (WAU) */
+#define RFI_ALIGN 256
+
+/* Extents never cross this boundary, so each stays inside one device area */
+#define RFI_SPLIT 0x8000
+
+/* Data bytes per write packet */
+#define RFI_CHUNK 1024
+
+/* WRI command packet: SOD LNH LNL CMD SAD(4) EAD(4) SUM ETX */
+#define RFI_CMD_PKT_LEN 14
+
+/*
+ * One programmed range, backed by the mapped container:
+ *   stream: WRI command packet, then one framed data packet per chunk
+ *   chunk_crcs: host CRC-32 of each chunk (little-endian)
+ */
+typedef struct {
+  uint32_t start;
+  uint32_t end; /* inclusive */
+  uint32_t crc; /* CRC-32 of the whole extent */
+  uint32_t nr_chunks;
+  const uint8_t *stream;
+  size_t stream_len;
+  const uint8_t *chunk_crcs;
+} rfi_extent_t;
+
+typedef struct {
+  void *map;
+  size_t map_len;
+  uint8_t sha256[SHA256_LEN]; /* identity of the programmed content */
+  uint32_t nr_extents;
+  uint32_t payload; /* data bytes over all extents */
+  rfi_extent_t *extents;
+} rfi_t;
+
+/*
+ * Compile an image file into a container
+ * Erased (all 0xFF) RFI_ALIGN blocks are left out: writing is meant for
+ * erased flash, where they are no-ops.
+ * base: address for files without address info (0 = use file address)
+ * Returns: 0 on success, -1 on error
+ */
+int rfi_compile(const char *in, input_format_t format, uint32_t base, const char *out);
+
+/*
+ * Map and validate a container (layout, packet framing, chunk CRCs, digest)
+ * Returns: 0 on success, -1 on error (rfi is left closed)
+ */
+int rfi_open(const char *path, rfi_t *rfi);
+
+void rfi_close(rfi_t *rfi);
+
+/*
+ * Framed data packet of chunk i, and the data it carries
+ */
+const uint8_t *rfi_data_packet(const rfi_extent_t *ext, uint32_t i, size_t *len);
+const uint8_t *rfi_chunk_data(const rfi_extent_t *ext, uint32_t i, size_t *len);
+
+uint32_t rfi_chunk_crc(const rfi_extent_t *ext, uint32_t i);
+
+/*
+ * Expand a container into a flat image (format_parse() for FORMAT_RFI)
+ * Gaps between extents are filled with 0xFF.
+ * Returns: 0 on success, -1 on error
+ */
+int rfi_parse(const char *filename, parsed_file_t *out);
+
+#endif /* RFI_H */
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * SHA-256 (FIPS 180-4), used to identify image contents
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_LEN 32
+
+typedef struct {
+  uint32_t state[8];
+  uint64_t bytes;
+  uint8_t block[64];
+  size_t used;
+} sha256_ctx_t;
+
+void sha256_init(sha256_ctx_t *ctx);
+void sha256_update(sha256_ctx_t *ctx, const void *data, size_t len);
+void sha256_final(sha256_ctx_t *ctx, uint8_t digest[SHA256_LEN]);
+
+/*
+ * Digest of a single buffer
+ */
+void sha256(const void *data, size_t len, uint8_t digest[SHA256_LEN]);
+
+/*
+ * Lowercase hex form of a digest (hex must hold 2 * SHA256_LEN + 1 bytes)
+ */
+void sha256_hex(const uint8_t digest[SHA256_LEN], char *hex);
+
+#endif /* SHA256_H */
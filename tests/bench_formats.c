@@ -0,0 +1,933 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Benchmark for the Intel HEX and S-record parsers
+ *
+ * Usage: bench_formats [MiB]
+ * A synthetic image is encoded in both formats by the buffered encoders and
+ * by the fprintf() based ones they replaced, then parsed by the mapped,
+ * table-driven parsers and by the fgets() based ones. Outputs are compared,
+ * then a few thousand corrupted files check that both parsers report the
+ * same errors.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/compat.h"
+#include "../src/formats.h"
+
+/*
+ * Previous implementations, kept as the reference
+ */
+
+#define MAX_LINE_LEN 1024
+
+static int
+legacy_hex_nibble(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+static int
+legacy_hex_byte(const char *s) {
+  int hi = legacy_hex_nibble(s[0]);
+  int lo = legacy_hex_nibble(s[1]);
+  if (hi < 0 || lo < 0)
+    return -1;
+  return (hi << 4) | lo;
+}
+
+static int
+legacy_ensure_capacity(uint8_t **buf, size_t *capacity, size_t needed) {
+  if (needed <= *capacity)
+    return 0;
+
+  size_t new_cap = *capacity ? *capacity * 2 : 65536;
+  while (new_cap < needed)
+    new_cap *= 2;
+
+  uint8_t *new_buf = realloc(*buf, new_cap);
+  if (!new_buf) {
+    warn("realloc failed");
+    return -1;
+  }
+
+  memset(new_buf + *capacity, 0xFF, new_cap - *capacity);
+  *buf = new_buf;
+  *capacity = new_cap;
+  return 0;
+}
+
+static int
+legacy_ihex_parse(const char *filename, parsed_file_t *out) {
+  FILE *fp;
+  char line[MAX_LINE_LEN];
+  uint8_t *buf = NULL;
+  size_t capacity = 0;
+  uint32_t ext_addr = 0;
+  uint32_t min_addr = UINT32_MAX;
+  uint32_t max_addr = 0;
+  int line_num = 0;
+  int eof_seen = 0;
+
+  fp = fopen(filename, "r");
+  if (!fp) {
+    warn("failed to open %s", filename);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), fp)) {
+    line_num++;
+    char *p = line;
+
+    while (isspace(*p))
+      p++;
+    if (*p == '\0' || *p == '\n')
+      continue;
+
+    if (*p != ':') {
+      warnx("%s:%d: expected ':' at start of line", filename, line_num);
+      goto fail;
+    }
+    p++;
+
+    size_t len = strlen(p);
+    while (len > 0 && (p[len - 1] == '\n' || p[len - 1] == '\r'))
+      len--;
+
+    if (len < 10) {
+      warnx("%s:%d: line too short", filename, line_num);
+      goto fail;
+    }
+
+    int byte_count = legacy_hex_byte(p);
+    int addr_hi = legacy_hex_byte(p + 2);
+    int addr_lo = legacy_hex_byte(p + 4);
+    int rec_type = legacy_hex_byte(p + 6);
+
+    if (byte_count < 0 || addr_hi < 0 || addr_lo < 0 || rec_type < 0) {
+      warnx("%s:%d: invalid hex digits", filename, line_num);
+      goto fail;
+    }
+
+    uint16_t addr = (uint16_t)((addr_hi << 8) | addr_lo);
+    size_t expected_len = 8 + byte_count * 2 + 2;
+    if (len < expected_len) {
+      warnx("%s:%d: line too short for byte count", filename, line_num);
+      goto fail;
+    }
+
+    uint8_t checksum = (uint8_t)(byte_count + addr_hi + addr_lo + rec_type);
+    uint8_t data[256];
+    for (int i = 0; i < byte_count; i++) {
+      int b = legacy_hex_byte(p + 8 + i * 2);
+      if (b < 0) {
+        warnx("%s:%d: invalid hex digits in data", filename, line_num);
+        goto fail;
+      }
+      data[i] = (uint8_t)b;
+      checksum = (uint8_t)(checksum + b);
+    }
+
+    int file_checksum = legacy_hex_byte(p + 8 + byte_count * 2);
+    if (file_checksum < 0) {
+      warnx("%s:%d: invalid checksum hex", filename, line_num);
+      goto fail;
+    }
+    checksum = (uint8_t)(checksum + file_checksum);
+    if (checksum != 0) {
+      warnx("%s:%d: checksum mismatch", filename, line_num);
+      goto fail;
+    }
+
+    switch (rec_type) {
+    case 0x00: /* Data record */
+    {
+      uint32_t full_addr = ext_addr + addr;
+      if (full_addr < min_addr)
+        min_addr = full_addr;
+      if (full_addr + byte_count > max_addr)
+        max_addr = full_addr + byte_count;
+
+      size_t offset = full_addr - (min_addr == UINT32_MAX ? full_addr : min_addr);
+      if (min_addr == UINT32_MAX) {
+        min_addr = full_addr;
+        offset = 0;
+      }
+      offset = full_addr - min_addr;
+
+      if (legacy_ensure_capacity(&buf, &capacity, offset + byte_count) < 0)
+        goto fail;
+
+      memcpy(buf + offset, data, byte_count);
+      break;
+    }
+    case 0x01: /* End of file */
+      eof_seen = 1;
+      break;
+    case 0x02: /* Extended segment address */
+      if (byte_count != 2) {
+        warnx("%s:%d: invalid extended segment address record", filename, line_num);
+        goto fail;
+      }
+      ext_addr = ((uint32_t)data[0] << 8 | data[1]) << 4;
+      break;
+    case 0x04: /* Extended linear address */
+      if (byte_count != 2) {
+        warnx("%s:%d: invalid extended linear address record", filename, line_num);
+        goto fail;
+      }
+      ext_addr = ((uint32_t)data[0] << 8 | data[1]) << 16;
+      break;
+    case 0x03: /* Start segment address - ignored */
+    case 0x05: /* Start linear address - ignored */
+      break;
+    default:
+      warnx("%s:%d: unknown record type 0x%02X", filename, line_num, rec_type);
+      goto fail;
+    }
+  }
+
+  fclose(fp);
+
+  if (!eof_seen) {
+    warnx("%s: no EOF record found", filename);
+    free(buf);
+    return -1;
+  }
+
+  if (min_addr == UINT32_MAX) {
+    warnx("%s: no data records found", filename);
+    free(buf);
+    return -1;
+  }
+
+  out->data = buf;
+  out->size = max_addr - min_addr;
+  out->base_addr = min_addr;
+  out->has_addr = 1;
+
+  return 0;
+
+fail:
+  fclose(fp);
+  free(buf);
+  return -1;
+}
+
+static int
+legacy_srec_parse(const char *filename, parsed_file_t *out) {
+  FILE *fp;
+  char line[MAX_LINE_LEN];
+  uint8_t *buf = NULL;
+  size_t capacity = 0;
+  uint32_t min_addr = UINT32_MAX;
+  uint32_t max_addr = 0;
+  int line_num = 0;
+  int eof_seen = 0;
+
+  fp = fopen(filename, "r");
+  if (!fp) {
+    warn("failed to open %s", filename);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), fp)) {
+    line_num++;
+    char *p = line;
+
+    while (isspace(*p))
+      p++;
+    if (*p == '\0' || *p == '\n')
+      continue;
+
+    if (*p != 'S' && *p != 's') {
+      warnx("%s:%d: expected 'S' at start of line", filename, line_num);
+      goto fail;
+    }
+    p++;
+
+    if (!isdigit(*p)) {
+      warnx("%s:%d: expected digit after 'S'", filename, line_num);
+      goto fail;
+    }
+    int rec_type = *p - '0';
+    p++;
+
+    size_t len = strlen(p);
+    while (len > 0 && (p[len - 1] == '\n' || p[len - 1] == '\r'))
+      len--;
+
+    if (len < 4) {
+      warnx("%s:%d: line too short", filename, line_num);
+      goto fail;
+    }
+
+    int byte_count = legacy_hex_byte(p);
+    if (byte_count < 0) {
+      warnx("%s:%d: invalid byte count", filename, line_num);
+      goto fail;
+    }
+
+    size_t expected_len = 2 + byte_count * 2;
+    if (len < expected_len) {
+      warnx("%s:%d: line too short for byte count", filename, line_num);
+      goto fail;
+    }
+
+    int addr_bytes;
+    switch (rec_type) {
+    case 0:
+    case 1:
+    case 5:
+    case 9:
+      addr_bytes = 2;
+      break;
+    case 2:
+    case 8:
+      addr_bytes = 3;
+      break;
+    case 3:
+    case 7:
+      addr_bytes = 4;
+      break;
+    default:
+      warnx("%s:%d: unknown record type S%d", filename, line_num, rec_type);
+      goto fail;
+    }
+
+    if (byte_count < addr_bytes + 1) {
+      warnx("%s:%d: byte count too small", filename, line_num);
+      goto fail;
+    }
+
+    uint8_t checksum = (uint8_t)byte_count;
+    uint32_t addr = 0;
+    for (int i = 0; i < addr_bytes; i++) {
+      int b = legacy_hex_byte(p + 2 + i * 2);
+      if (b < 0) {
+        warnx("%s:%d: invalid address hex", filename, line_num);
+        goto fail;
+      }
+      addr = (addr << 8) | (uint32_t)b;
+      checksum = (uint8_t)(checksum + b);
+    }
+
+    int data_bytes = byte_count - addr_bytes - 1;
+    uint8_t data[256];
+    for (int i = 0; i < data_bytes; i++) {
+      int b = legacy_hex_byte(p + 2 + addr_bytes * 2 + i * 2);
+      if (b < 0) {
+        warnx("%s:%d: invalid data hex", filename, line_num);
+        goto fail;
+      }
+      data[i] = (uint8_t)b;
+      checksum = (uint8_t)(checksum + b);
+    }
+
+    int file_checksum = legacy_hex_byte(p + 2 + addr_bytes * 2 + data_bytes * 2);
+    if (file_checksum < 0) {
+      warnx("%s:%d: invalid checksum hex", filename, line_num);
+      goto fail;
+    }
+    checksum = (uint8_t)(checksum + file_checksum);
+    if (checksum != 0xFF) {
+      warnx("%s:%d: checksum mismatch", filename, line_num);
+      goto fail;
+    }
+
+    switch (rec_type) {
+    case 1:
+    case 2:
+    case 3: /* Data records */
+    {
+      if (addr < min_addr)
+        min_addr = addr;
+      if (addr + data_bytes > max_addr)
+        max_addr = addr + data_bytes;
+
+      size_t offset;
+      if (min_addr == UINT32_MAX) {
+        min_addr = addr;
+        offset = 0;
+      } else {
+        offset = addr - min_addr;
+      }
+
+      if (legacy_ensure_capacity(&buf, &capacity, offset + data_bytes) < 0)
+        goto fail;
+
+      memcpy(buf + offset, data, data_bytes);
+      break;
+    }
+    case 7:
+    case 8:
+    case 9: /* End records */
+      eof_seen = 1;
+      break;
+    case 0: /* Header - ignored */
+    case 5: /* Record count - ignored */
+      break;
+    }
+  }
+
+  fclose(fp);
+
+  if (!eof_seen) {
+    warnx("%s: no end record found", filename);
+    free(buf);
+    return -1;
+  }
+
+  if (min_addr == UINT32_MAX) {
+    warnx("%s: no data records found", filename);
+    free(buf);
+    return -1;
+  }
+
+  out->data = buf;
+  out->size = max_addr - min_addr;
+  out->base_addr = min_addr;
+  out->has_addr = 1;
+
+  return 0;
+
+fail:
+  fclose(fp);
+  free(buf);
+  return -1;
+}
+
+#define IHEX_BYTES_PER_LINE 16
+
+static int
+legacy_ihex_write(const char *filename, const uint8_t *data, size_t size, uint32_t addr) {
+  FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    warn("failed to open %s", filename);
+    return -1;
+  }
+
+  uint32_t current_ext_addr = 0;
+  size_t offset = 0;
+
+  while (offset < size) {
+    uint32_t line_addr = addr + (uint32_t)offset;
+
+    /* Emit extended linear address record if needed (type 04) */
+    uint32_t ext_addr = line_addr >> 16;
+    if (ext_addr != current_ext_addr) {
+      uint8_t sum = (uint8_t)(0x02 + 0x00 + 0x00 + 0x04 + (ext_addr >> 8) + (ext_addr & 0xFF));
+      fprintf(fp, ":02000004%04X%02X\n", ext_addr, (uint8_t)(~sum + 1));
+      current_ext_addr = ext_addr;
+    }
+
+    /* Data record (type 00) */
+    size_t remaining = size - offset;
+    size_t line_len = remaining < IHEX_BYTES_PER_LINE ? remaining : IHEX_BYTES_PER_LINE;
+    uint16_t rec_addr = line_addr & 0xFFFF;
+
+    uint8_t sum = (uint8_t)line_len + (rec_addr >> 8) + (rec_addr & 0xFF) + 0x00;
+    fprintf(fp, ":%02X%04X00", (unsigned)line_len, rec_addr);
+
+    for (size_t i = 0; i < line_len; i++) {
+      fprintf(fp, "%02X", data[offset + i]);
+      sum += data[offset + i];
+    }
+
+    fprintf(fp, "%02X\n", (uint8_t)(~sum + 1));
+    offset += line_len;
+  }
+
+  /* EOF record (type 01) */
+  fprintf(fp, ":00000001FF\n");
+
+  fclose(fp);
+  return 0;
+}
+
+#define SREC_BYTES_PER_LINE 16
+
+static int
+legacy_srec_write(const char *filename, const uint8_t *data, size_t size, uint32_t addr) {
+  FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    warn("failed to open %s", filename);
+    return -1;
+  }
+
+  /* S0 header record */
+  const char *hdr = "HDR";
+  size_t hdr_len = strlen(hdr);
+  uint8_t sum = (uint8_t)(hdr_len + 3); /* byte count includes address (2) + data + checksum */
+  fprintf(fp, "S0%02X0000", (unsigned)(hdr_len + 3));
+  for (size_t i = 0; i < hdr_len; i++) {
+    fprintf(fp, "%02X", (uint8_t)hdr[i]);
+    sum += (uint8_t)hdr[i];
+  }
+  fprintf(fp, "%02X\n", (uint8_t)(~sum));
+
+  /* S3 data records (32-bit address) */
+  size_t offset = 0;
+  while (offset < size) {
+    uint32_t line_addr = addr + (uint32_t)offset;
+    size_t remaining = size - offset;
+    size_t line_len = remaining < SREC_BYTES_PER_LINE ? remaining : SREC_BYTES_PER_LINE;
+
+    /* Byte count = address (4) + data + checksum (1) */
+    uint8_t byte_count = (uint8_t)(4 + line_len + 1);
+    sum = byte_count;
+    sum += (line_addr >> 24) & 0xFF;
+    sum += (line_addr >> 16) & 0xFF;
+    sum += (line_addr >> 8) & 0xFF;
+    sum += line_addr & 0xFF;
+
+    fprintf(fp, "S3%02X%08X", byte_count, line_addr);
+
+    for (size_t i = 0; i < line_len; i++) {
+      fprintf(fp, "%02X", data[offset + i]);
+      sum += data[offset + i];
+    }
+
+    fprintf(fp, "%02X\n", (uint8_t)(~sum));
+    offset += line_len;
+  }
+
+  /* S7 end record (32-bit start address) */
+  sum = 0x05 + ((addr >> 24) & 0xFF) + ((addr >> 16) & 0xFF) + ((addr >> 8) & 0xFF) + (addr & 0xFF);
+  fprintf(fp, "S705%08X%02X\n", addr, (uint8_t)(~sum));
+
+  fclose(fp);
+  return 0;
+}
+
+/*
+ * Multi-region Intel HEX writer
+ */
+static int
+legacy_ihex_write_multi(const char *filename, const backup_region_t *regions, size_t count) {
+  FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    warn("failed to open %s", filename);
+    return -1;
+  }
+
+  uint32_t current_ext_addr = 0;
+
+  for (size_t r = 0; r < count; r++) {
+    const backup_region_t *reg = &regions[r];
+    size_t offset = 0;
+
+    while (offset < reg->size) {
+      uint32_t line_addr = reg->addr + (uint32_t)offset;
+
+      /* Emit extended linear address record if needed (type 04) */
+      uint32_t ext_addr = line_addr >> 16;
+      if (ext_addr != current_ext_addr) {
+        uint8_t sum = (uint8_t)(0x02 + 0x00 + 0x00 + 0x04 + (ext_addr >> 8) + (ext_addr & 0xFF));
+        fprintf(fp, ":02000004%04X%02X\n", ext_addr, (uint8_t)(~sum + 1));
+        current_ext_addr = ext_addr;
+      }
+
+      /* Data record (type 00) */
+      size_t remaining = reg->size - offset;
+      size_t line_len = remaining < IHEX_BYTES_PER_LINE ? remaining : IHEX_BYTES_PER_LINE;
+      uint16_t rec_addr = line_addr & 0xFFFF;
+
+      uint8_t sum = (uint8_t)line_len + (rec_addr >> 8) + (rec_addr & 0xFF) + 0x00;
+      fprintf(fp, ":%02X%04X00", (unsigned)line_len, rec_addr);
+
+      for (size_t i = 0; i < line_len; i++) {
+        fprintf(fp, "%02X", reg->data[offset + i]);
+        sum += reg->data[offset + i];
+      }
+
+      fprintf(fp, "%02X\n", (uint8_t)(~sum + 1));
+      offset += line_len;
+    }
+  }
+
+  /* EOF record (type 01) */
+  fprintf(fp, ":00000001FF\n");
+
+  fclose(fp);
+  return 0;
+}
+
+/*
+ * Multi-region Motorola S-record writer
+ */
+static int
+legacy_srec_write_multi(const char *filename, const backup_region_t *regions, size_t count) {
+  FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    warn("failed to open %s", filename);
+    return -1;
+  }
+
+  /* S0 header record */
+  const char *hdr = "HDR";
+  size_t hdr_len = strlen(hdr);
+  uint8_t sum = (uint8_t)(hdr_len + 3);
+  fprintf(fp, "S0%02X0000", (unsigned)(hdr_len + 3));
+  for (size_t i = 0; i < hdr_len; i++) {
+    fprintf(fp, "%02X", (uint8_t)hdr[i]);
+    sum += (uint8_t)hdr[i];
+  }
+  fprintf(fp, "%02X\n", (uint8_t)(~sum));
+
+  /* S3 data records for each region */
+  for (size_t r = 0; r < count; r++) {
+    const backup_region_t *reg = &regions[r];
+    size_t offset = 0;
+
+    while (offset < reg->size) {
+      uint32_t line_addr = reg->addr + (uint32_t)offset;
+      size_t remaining = reg->size - offset;
+      size_t line_len = remaining < SREC_BYTES_PER_LINE ? remaining : SREC_BYTES_PER_LINE;
+
+      /* Byte count = address (4) + data + checksum (1) */
+      uint8_t byte_count = (uint8_t)(4 + line_len + 1);
+      sum = byte_count;
+      sum += (line_addr >> 24) & 0xFF;
+      sum += (line_addr >> 16) & 0xFF;
+      sum += (line_addr >> 8) & 0xFF;
+      sum += line_addr & 0xFF;
+
+      fprintf(fp, "S3%02X%08X", byte_count, line_addr);
+
+      for (size_t i = 0; i < line_len; i++) {
+        fprintf(fp, "%02X", reg->data[offset + i]);
+        sum += reg->data[offset + i];
+      }
+
+      fprintf(fp, "%02X\n", (uint8_t)(~sum));
+      offset += line_len;
+    }
+  }
+
+  /* S7 end record with entry point 0 */
+  sum = 0x05;
+  fprintf(fp, "S70500000000%02X\n", (uint8_t)(~sum));
+
+  fclose(fp);
+  return 0;
+}
+
+typedef int (*parse_fn)(const char *, parsed_file_t *);
+typedef int (*write_fn)(const char *, const uint8_t *, size_t, uint32_t);
+typedef int (*write_multi_fn)(const char *, const backup_region_t *, size_t);
+
+static double
+now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Best of a few runs, in seconds */
+static double
+time_parse(parse_fn fn, const char *path) {
+  double best = 0;
+
+  for (int run = 0; run < 3; run++) {
+    parsed_file_t out;
+    double t = now();
+    if (fn(path, &out) < 0)
+      return -1;
+    t = now() - t;
+    free(out.data);
+    if (run == 0 || t < best)
+      best = t;
+  }
+  return best;
+}
+
+static bool
+same_file(const char *a, const char *b) {
+  FILE *fa = fopen(a, "rb");
+  FILE *fb = fopen(b, "rb");
+  bool same = fa != NULL && fb != NULL;
+
+  while (same) {
+    int ca = fgetc(fa);
+    int cb = fgetc(fb);
+    same = ca == cb;
+    if (ca == EOF || cb == EOF)
+      break;
+  }
+  if (fa != NULL)
+    fclose(fa);
+  if (fb != NULL)
+    fclose(fb);
+  return same;
+}
+
+static long
+file_size(const char *path) {
+  FILE *f = fopen(path, "rb");
+  long size = -1;
+  if (f != NULL && fseek(f, 0, SEEK_END) == 0)
+    size = ftell(f);
+  if (f != NULL)
+    fclose(f);
+  return size;
+}
+
+/* Best of a few runs, in seconds */
+static double
+time_write(write_fn fn, const char *path, const uint8_t *data, size_t size) {
+  double best = 0;
+
+  for (int run = 0; run < 3; run++) {
+    double t = now();
+    if (fn(path, data, size, 0x08000000) < 0)
+      return -1;
+    t = now() - t;
+    if (run == 0 || t < best)
+      best = t;
+  }
+  return best;
+}
+
+/*
+ * Default options must give the same bytes as before, wider records a
+ * smaller file with the same content
+ */
+static int
+run_encode(const char *name,
+    write_fn legacy,
+    write_fn fast,
+    write_multi_fn legacy_multi,
+    const char *path,
+    const char *ref,
+    const uint8_t *image,
+    size_t total) {
+  double mib = (double)total / (1024.0 * 1024.0);
+  int failed = 0;
+
+  format_set_write_options(FORMAT_RECORD_BYTES_DEFAULT, false);
+  double t_legacy = time_write(legacy, ref, image, total);
+  double t_fast = time_write(fast, path, image, total);
+  if (t_legacy < 0 || t_fast < 0) {
+    printf("  %-6s write failed\n", name);
+    return 1;
+  }
+  bool same = same_file(ref, path);
+  failed |= !same;
+  printf("  %-6s fprintf %6.1f MiB/s   buffered %6.1f MiB/s   x%.1f%s\n",
+      name,
+      mib / t_legacy,
+      mib / t_fast,
+      t_legacy / t_fast,
+      same ? "" : "   OUTPUT DIFFERS");
+
+  /* Sparse regions, unaligned start */
+  backup_region_t regions[2] = {
+    { image + 3, 0x1234, 0x00000003 },
+    { image,     0x2000, 0x40100000 },
+  };
+  legacy_multi(ref, regions, 2);
+  format_write_multi(path, strcmp(name, "ihex") == 0 ? FORMAT_IHEX : FORMAT_SREC, regions, 2);
+  if (!same_file(ref, path)) {
+    printf("  %-6s multi-region OUTPUT DIFFERS\n", name);
+    failed = 1;
+  }
+
+  legacy(ref, image, total, 0x08000000);
+  long size16 = file_size(ref);
+  format_set_write_options(FORMAT_RECORD_BYTES_MAX, false);
+  double t_wide = time_write(fast, path, image, total);
+  printf("  %-6s 255-byte records %6.1f MiB/s, file %ld -> %ld bytes\n",
+      name,
+      mib / t_wide,
+      size16,
+      file_size(path));
+  format_set_write_options(FORMAT_RECORD_BYTES_DEFAULT, false);
+  return failed;
+}
+
+static bool
+same_result(parse_fn a, parse_fn b, const char *path) {
+  parsed_file_t x, y;
+  int ra = a(path, &x);
+  int rb = b(path, &y);
+
+  if (ra != rb)
+    return false;
+  if (ra < 0)
+    return true;
+
+  bool same = x.size == y.size && x.base_addr == y.base_addr && x.has_addr == y.has_addr &&
+              memcmp(x.data, y.data, x.size) == 0;
+  free(x.data);
+  free(y.data);
+  return same;
+}
+
+static void
+write_text(const char *path, const char *text, size_t len) {
+  FILE *f = fopen(path, "wb");
+  if (f != NULL) {
+    fwrite(text, 1, len, f);
+    fclose(f);
+  }
+}
+
+/*
+ * Parse with stderr sent to a file, so diagnostics can be compared
+ * Returns: parser result, diagnostics in msg
+ */
+static int
+parse_captured(parse_fn fn, const char *path, const char *log, char *msg, size_t len) {
+  parsed_file_t out;
+
+  fflush(stderr);
+  int saved = dup(2);
+  FILE *f = fopen(log, "w+");
+  dup2(fileno(f), 2);
+
+  int ret = fn(path, &out);
+  if (ret == 0)
+    free(out.data);
+
+  fflush(stderr);
+  dup2(saved, 2);
+  close(saved);
+
+  rewind(f);
+  size_t n = fread(msg, 1, len - 1, f);
+  msg[n] = '\0';
+  fclose(f);
+  return ret;
+}
+
+/*
+ * Flip one byte at a time in a small valid file: both parsers must agree
+ * Returns: number of disagreements
+ */
+static int
+compare_errors(parse_fn a, parse_fn b, const char *name, const char *path, const char *log) {
+  FILE *f = fopen(path, "rb");
+  static char text[1 << 16];
+  size_t len = f != NULL ? fread(text, 1, sizeof(text), f) : 0;
+  static const char subst[] = { '0', 'F', 'g', ':', 'S', '\r', '\n', ' ', '\0', '7' };
+  char msg_a[1024], msg_b[1024];
+  int diffs = 0, cases = 0;
+
+  if (f != NULL)
+    fclose(f);
+
+  srand(1);
+  for (int i = 0; i < 2000 && len > 0; i++) {
+    size_t pos = (size_t)rand() % len;
+    char saved = text[pos];
+    text[pos] = subst[rand() % (int)sizeof(subst)];
+    size_t cut = (i % 10 == 0) ? pos + 1 : len; /* sometimes truncate too */
+
+    write_text(path, text, cut);
+    int ra = parse_captured(a, path, log, msg_a, sizeof(msg_a));
+    int rb = parse_captured(b, path, log, msg_b, sizeof(msg_b));
+    if (ra != rb || strcmp(msg_a, msg_b) != 0 || (ra == 0 && !same_result(a, b, path))) {
+      if (diffs++ < 5)
+        printf("  %s: mismatch at byte %zu:\n    %s    %s", name, pos, msg_a, msg_b);
+    }
+    cases++;
+    text[pos] = saved;
+  }
+
+  write_text(path, text, len);
+  printf("  %-6s %d corrupted files, %d mismatches\n", name, cases, diffs);
+  return diffs;
+}
+
+static int
+run(const char *name, parse_fn legacy, parse_fn fast, const char *path, size_t bytes) {
+  double t_legacy = time_parse(legacy, path);
+  double t_fast = time_parse(fast, path);
+
+  if (t_legacy < 0 || t_fast < 0) {
+    printf("  %-6s parse failed\n", name);
+    return 1;
+  }
+
+  double mib = (double)bytes / (1024.0 * 1024.0);
+  printf("  %-6s fgets %8.1f MiB/s   mapped %8.1f MiB/s   x%.1f%s\n",
+      name,
+      mib / t_legacy,
+      mib / t_fast,
+      t_legacy / t_fast,
+      same_result(legacy, fast, path) ? "" : "   RESULTS DIFFER");
+  return same_result(legacy, fast, path) ? 0 : 1;
+}
+
+int
+main(int argc, char *argv[]) {
+  size_t mib = (argc > 1) ? strtoul(argv[1], NULL, 0) : 4;
+  if (mib == 0)
+    mib = 1;
+  size_t total = mib * 1024 * 1024;
+
+  char dir[256], hex[512], srec[512], ref[512], log[512];
+  snprintf(dir, sizeof(dir), "%s%cbench_formats.XXXXXX", get_temp_dir(), path_separator());
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(hex, sizeof(hex), "%s%cimage.hex", dir, path_separator());
+  snprintf(srec, sizeof(srec), "%s%cimage.srec", dir, path_separator());
+  snprintf(ref, sizeof(ref), "%s%creference.txt", dir, path_separator());
+  snprintf(log, sizeof(log), "%s%cstderr.txt", dir, path_separator());
+
+  /* Firmware-like content spanning several 64KB HEX segments */
+  uint8_t *image = malloc(total);
+  if (image == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for (size_t i = 0; i < total; i++)
+    image[i] = (uint8_t)(i * 2654435761u >> 13);
+
+  int failed = 0;
+  printf("formats: %zu MiB payload\n", mib);
+  failed |= run_encode("ihex", legacy_ihex_write, ihex_write, legacy_ihex_write_multi, hex, ref,
+      image, total);
+  failed |= run_encode("srec", legacy_srec_write, srec_write, legacy_srec_write_multi, srec, ref,
+      image, total);
+  if (format_write(hex, FORMAT_IHEX, image, total, 0x08000000) < 0 ||
+      format_write(srec, FORMAT_SREC, image, total, 0x08000000) < 0) {
+    fprintf(stderr, "failed to write the test files\n");
+    failed = 1;
+  } else {
+    failed |= run("ihex", legacy_ihex_parse, ihex_parse, hex, total);
+    failed |= run("srec", legacy_srec_parse, srec_parse, srec, total);
+
+    /* Small files for the error comparison */
+    format_write(hex, FORMAT_IHEX, image, 2048, 0x0001FC00);
+    format_write(srec, FORMAT_SREC, image, 2048, 0x0001FC00);
+    failed |= compare_errors(legacy_ihex_parse, ihex_parse, "ihex", hex, log) != 0;
+    failed |= compare_errors(legacy_srec_parse, srec_parse, "srec", srec, log) != 0;
+  }
+
+  remove(hex);
+  remove(srec);
+  remove(ref);
+  remove(log);
+  rmdir(dir);
+  free(image);
+  return failed;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Microbenchmark for buffer checksum and classification kernels
+ *
+ * Usage: bench_rabuf [MiB]
+ * Each kernel runs over 1 KiB chunks (one read packet) of mostly erased
+ * flash, once per implementation usable on this CPU and once with the
+ * per-byte loops they replace.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/rabuf.h"
+#include "../src/rapacker.h"
+
+#define CHUNK 1024
+
+static const char *const impl_names[] = { "generic", "sse2", "avx2", "neon" };
+
+static volatile size_t sink;
+
+static double
+now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void
+report(const char *impl, const char *kernel, double secs, size_t bytes) {
+  printf("  %-8s %-12s %8.1f MiB/s\n", impl, kernel, (double)bytes / secs / (1024.0 * 1024.0));
+}
+
+/*
+ * Per-byte loops as previously open coded at the call sites
+ */
+
+static void
+run_scalar(const uint8_t *a, const uint8_t *b, size_t total) {
+  double t;
+  size_t acc = 0;
+
+  t = now();
+  for (size_t off = 0; off < total; off += CHUNK) {
+    uint32_t sum = 0;
+    for (size_t j = 0; j < CHUNK; j++)
+      sum += a[off + j];
+    acc += sum;
+  }
+  report("scalar", "sum", now() - t, total);
+
+  t = now();
+  for (size_t off = 0; off < total; off += CHUNK) {
+    for (size_t j = 0; j < CHUNK; j++)
+      acc += (a[off + j] != 0xFF);
+  }
+  report("scalar", "count_used", now() - t, total);
+
+  t = now();
+  for (size_t off = 0; off < total; off += CHUNK) {
+    for (size_t j = CHUNK; j > 0; j--) {
+      if (a[off + j - 1] != 0xFF) {
+        acc += j;
+        break;
+      }
+    }
+  }
+  report("scalar", "last_used", now() - t, total);
+
+  t = now();
+  for (size_t off = 0; off < total; off += CHUNK) {
+    for (size_t j = 0; j < CHUNK; j++) {
+      if (a[off + j] != b[off + j]) {
+        acc += j;
+        break;
+      }
+    }
+  }
+  report("scalar", "mismatch", now() - t, total);
+
+  sink = acc;
+}
+
+static void
+run_impl(const char *name, const uint8_t *a, const uint8_t *b, size_t total) {
+  double t;
+  size_t acc = 0;
+
+  t = now();
+  for (size_t off = 0; off < total; off += CHUNK)
+    acc += rabuf_sum(a + off, CHUNK);
+  report(name, "sum", now() - t, total);
+
+  t = now();
+  for (size_t off = 0; off < total; off += CHUNK)
+    acc += rabuf_count_used(a + off, CHUNK);
+  report(name, "count_used", now() - t, total);
+
+  t = now();
+  for (size_t off = 0; off < total; off += CHUNK)
+    acc += rabuf_last_used(a + off, CHUNK);
+  report(name, "last_used", now() - t, total);
+
+  t = now();
+  for (size_t off = 0; off < total; off += CHUNK)
+    acc += rabuf_mismatch(a + off, b + off, CHUNK);
+  report(name, "mismatch", now() - t, total);
+
+  t = now();
+  for (size_t off = 0; off < total; off += CHUNK)
+    acc += ra_calc_sum(REA_CMD, a + off, CHUNK);
+  report(name, "ra_calc_sum", now() - t, total);
+
+  sink = acc;
+}
+
+int
+main(int argc, char *argv[]) {
+  size_t mib = (argc > 1) ? strtoul(argv[1], NULL, 0) : 64;
+  if (mib == 0)
+    mib = 1;
+  size_t total = mib * 1024 * 1024;
+
+  uint8_t *a = malloc(total);
+  uint8_t *b = malloc(total);
+  if (a == NULL || b == NULL) {
+    fprintf(stderr, "out of memory\n");
+    free(a);
+    free(b);
+    return 1;
+  }
+
+  /* Mostly erased flash: first quarter of each chunk used, rest 0xFF */
+  memset(a, 0xFF, total);
+  for (size_t off = 0; off < total; off += CHUNK) {
+    for (size_t j = 0; j < CHUNK / 4; j++)
+      a[off + j] = (uint8_t)(off + j * 7);
+  }
+  memcpy(b, a, total);
+
+  printf("rabuf: %zu MiB in %d byte chunks\n", mib, CHUNK);
+  run_scalar(a, b, total);
+  for (size_t i = 0; i < sizeof(impl_names) / sizeof(impl_names[0]); i++) {
+    if (rabuf_select(impl_names[i]) < 0)
+      continue;
+    run_impl(impl_names[i], a, b, total);
+  }
+
+  free(a);
+  free(b);
+  return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for the host CRC-32 engine
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "../src/crc32.h"
+
+#define MAX_TEST_LEN 600
+#define MAX_TEST_OFF 16
+
+static const char *const impl_names[] = { "slice8", "pclmul" };
+
+/* Bitwise reference, straight from the polynomial */
+static uint32_t
+ref_crc32(const uint8_t *buf, size_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (int k = 0; k < 8; k++)
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+  }
+  return ~crc;
+}
+
+static void
+fill(uint8_t *buf, size_t len, uint32_t seed) {
+  for (size_t i = 0; i < len; i++) {
+    seed = seed * 1103515245 + 12345;
+    buf[i] = (uint8_t)(seed >> 16);
+  }
+}
+
+static void
+test_check_value(void **state) {
+  (void)state;
+
+  const uint8_t check[] = "123456789";
+
+  for (size_t i = 0; i < sizeof(impl_names) / sizeof(impl_names[0]); i++) {
+    if (crc32_select(impl_names[i]) < 0)
+      continue;
+    assert_int_equal(crc32_calc(check, 9), 0xCBF43926);
+    assert_int_equal(crc32_calc(check, 0), 0);
+  }
+}
+
+static void
+test_erased_flash(void **state) {
+  (void)state;
+
+  /* 1 KB of erased flash, as the device reports for a blank CRC unit */
+  uint8_t buf[1024];
+  memset(buf, 0xFF, sizeof(buf));
+
+  for (size_t i = 0; i < sizeof(impl_names) / sizeof(impl_names[0]); i++) {
+    if (crc32_select(impl_names[i]) < 0)
+      continue;
+    assert_int_equal(crc32_calc(buf, sizeof(buf)), ref_crc32(buf, sizeof(buf)));
+    assert_int_equal(crc32_fill(0, 0xFF, sizeof(buf)), ref_crc32(buf, sizeof(buf)));
+  }
+}
+
+static void
+test_all_impls(void **state) {
+  (void)state;
+
+  uint8_t buf[MAX_TEST_OFF + MAX_TEST_LEN];
+  int tested = 0;
+
+  fill(buf, sizeof(buf), 42);
+  for (size_t i = 0; i < sizeof(impl_names) / sizeof(impl_names[0]); i++) {
+    if (crc32_select(impl_names[i]) < 0)
+      continue;
+    assert_string_equal(crc32_impl_name(), impl_names[i]);
+    for (size_t off = 0; off < MAX_TEST_OFF; off += 3) {
+      for (size_t len = 0; len <= MAX_TEST_LEN; len++)
+        assert_int_equal(crc32_calc(buf + off, len), ref_crc32(buf + off, len));
+    }
+    tested++;
+  }
+
+  /* The portable path is always available */
+  assert_true(tested >= 1);
+}
+
+static void
+test_incremental(void **state) {
+  (void)state;
+
+  uint8_t buf[4096];
+  fill(buf, sizeof(buf), 7);
+  uint32_t expected = ref_crc32(buf, sizeof(buf));
+
+  for (size_t i = 0; i < sizeof(impl_names) / sizeof(impl_names[0]); i++) {
+    if (crc32_select(impl_names[i]) < 0)
+      continue;
+    /* Split at every position of interest for the folding path */
+    for (size_t split = 0; split <= 200; split++) {
+      uint32_t crc = crc32_update(0, buf, split);
+      crc = crc32_update(crc, buf + split, sizeof(buf) - split);
+      assert_int_equal(crc, expected);
+    }
+  }
+}
+
+static void
+test_select(void **state) {
+  (void)state;
+
+  assert_int_equal(crc32_select("slice8"), 0);
+  assert_string_equal(crc32_impl_name(), "slice8");
+  assert_int_equal(crc32_select("bogus"), -1);
+  assert_int_equal(crc32_select(NULL), 0);
+  assert_non_null(crc32_impl_name());
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_check_value),
+    cmocka_unit_test(test_erased_flash),
+    cmocka_unit_test(test_all_impls),
+    cmocka_unit_test(test_incremental),
+    cmocka_unit_test(test_select),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -81,6 +81,14 @@ test_format_detect_srec(void **state) {
   assert_int_equal(format_detect("firmware.mot"), FORMAT_SREC);
 }
 
+static void
+test_format_detect_elf(void **state) {
+  (void)state;
+  assert_int_equal(format_detect("zephyr.elf"), FORMAT_ELF);
+  assert_int_equal(format_detect("firmware.AXF"), FORMAT_ELF);
+  assert_string_equal(format_name(FORMAT_ELF), "ELF");
+}
+
 static void
 test_format_name(void **state) {
   (void)state;
@@ -169,6 +177,47 @@ test_ihex_extended_addr(void **state) {
   free(out.data);
 }
 
+static void
+test_format_ranges(void **state) {
+  (void)state;
+  char filename[512];
+  format_extent_t ranges[FORMAT_MAX_EXTENTS];
+
+  /* Code records 32 KB apart, data flash at 0x08000000 */
+  const char *ihex = ":10000000000102030405060708090A0B0C0D0E0F78\n"
+                     ":108000001111111111111111111111111111111160\n"
+                     ":020000040800F2\n"
+                     ":10000000AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA50\n"
+                     ":00000001FF\n";
+
+  snprintf(filename, sizeof(filename), "%s/ranges.hex", temp_dir);
+  write_file(filename, ihex);
+
+  assert_int_equal(
+      format_ranges(filename, FORMAT_AUTO, FORMAT_RANGE_GAP, ranges, FORMAT_MAX_EXTENTS), 2);
+  assert_int_equal(ranges[0].addr, 0);
+  assert_int_equal(ranges[0].size, 0x8010);
+  assert_int_equal(ranges[1].addr, 0x08000000);
+  assert_int_equal(ranges[1].size, 16);
+
+  /* One slot: stretched over everything */
+  assert_int_equal(format_ranges(filename, FORMAT_IHEX, FORMAT_RANGE_GAP, ranges, 1), 1);
+  assert_int_equal(ranges[0].addr, 0);
+  assert_int_equal(ranges[0].size, 0x08000010);
+
+  /* No gap: only the records themselves */
+  assert_int_equal(format_ranges(filename, FORMAT_IHEX, 0, ranges, FORMAT_MAX_EXTENTS), 3);
+  assert_int_equal(ranges[0].addr, 0);
+  assert_int_equal(ranges[0].size, 16);
+  assert_int_equal(ranges[1].addr, 0x8000);
+  assert_int_equal(ranges[1].size, 16);
+  assert_int_equal(ranges[2].addr, 0x08000000);
+
+  /* Binary files have no records */
+  assert_int_equal(
+      format_ranges(filename, FORMAT_BIN, FORMAT_RANGE_GAP, ranges, FORMAT_MAX_EXTENTS), -1);
+}
+
 static void
 test_ihex_segment_addr(void **state) {
   (void)state;
@@ -408,6 +457,70 @@ test_ihex_lowercase(void **state) {
   free(out.data);
 }
 
+static void
+test_ihex_descending_records(void **state) {
+  (void)state;
+  char filename[512];
+  parsed_file_t out;
+
+  /* Records need not be in address order, no trailing newline */
+  const char *ihex = ":040010001122334442\n"
+                     ":02000000AABB99\n"
+                     ":00000001FF";
+
+  snprintf(filename, sizeof(filename), "%s/descending.hex", temp_dir);
+  write_file(filename, ihex);
+
+  assert_int_equal(ihex_parse(filename, &out), 0);
+  assert_int_equal(out.base_addr, 0);
+  assert_int_equal(out.size, 0x14);
+  assert_int_equal(out.data[0x00], 0xAA);
+  assert_int_equal(out.data[0x01], 0xBB);
+  assert_int_equal(out.data[0x02], 0xFF);
+  assert_int_equal(out.data[0x10], 0x11);
+  assert_int_equal(out.data[0x13], 0x44);
+
+  free(out.data);
+}
+
+static void
+test_ihex_empty_file(void **state) {
+  (void)state;
+  char filename[512];
+  parsed_file_t out;
+
+  snprintf(filename, sizeof(filename), "%s/empty.hex", temp_dir);
+  write_file(filename, "");
+  assert_int_equal(ihex_parse(filename, &out), -1);
+
+  snprintf(filename, sizeof(filename), "%s/missing.hex", temp_dir);
+  assert_int_equal(ihex_parse(filename, &out), -1);
+}
+
+static void
+test_srec_descending_records(void **state) {
+  (void)state;
+  char filename[512];
+  parsed_file_t out;
+
+  const char *srec = "S10500101122B7\n"
+                     "S1040004AA4D\n"
+                     "S9030000FC\n";
+
+  snprintf(filename, sizeof(filename), "%s/descending.srec", temp_dir);
+  write_file(filename, srec);
+
+  assert_int_equal(srec_parse(filename, &out), 0);
+  assert_int_equal(out.base_addr, 4);
+  assert_int_equal(out.size, 0x0E);
+  assert_int_equal(out.data[0x00], 0xAA);
+  assert_int_equal(out.data[0x01], 0xFF);
+  assert_int_equal(out.data[0x0C], 0x11);
+  assert_int_equal(out.data[0x0D], 0x22);
+
+  free(out.data);
+}
+
 static void
 test_srec_multirecord_manpage(void **state) {
   (void)state;
@@ -535,6 +648,103 @@ test_ihex_write_extended_addr(void **state) {
   free(out.data);
 }
 
+/* Longest line of a record file */
+static size_t
+longest_line(const char *filename) {
+  char line[1024];
+  size_t longest = 0;
+  FILE *fp = fopen(filename, "r");
+  assert_non_null(fp);
+  while (fgets(line, sizeof(line), fp)) {
+    size_t len = strcspn(line, "\r\n");
+    if (len > longest)
+      longest = len;
+  }
+  fclose(fp);
+  return longest;
+}
+
+static void
+test_write_record_bytes(void **state) {
+  (void)state;
+  char filename[512];
+  parsed_file_t out;
+  static uint8_t data[0x1000];
+
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = (uint8_t)(i * 13);
+
+  assert_int_equal(format_set_write_options(0, false), -1);
+  assert_int_equal(format_set_write_options(256, false), -1);
+
+  /* Widest records, starting just below a 64KB segment boundary */
+  assert_int_equal(format_set_write_options(255, false), 0);
+  snprintf(filename, sizeof(filename), "%s/wide.hex", temp_dir);
+  assert_int_equal(ihex_write(filename, data, sizeof(data), 0x0800FF80), 0);
+  assert_int_equal(longest_line(filename), 1 + 2 * (4 + 255 + 1));
+  assert_int_equal(ihex_parse(filename, &out), 0);
+  assert_int_equal(out.base_addr, 0x0800FF80);
+  assert_int_equal(out.size, sizeof(data));
+  assert_memory_equal(out.data, data, sizeof(data));
+  free(out.data);
+
+  /* S3 records carry at most 250 data bytes */
+  snprintf(filename, sizeof(filename), "%s/wide.srec", temp_dir);
+  assert_int_equal(srec_write(filename, data, sizeof(data), 0x0800FF80), 0);
+  assert_int_equal(longest_line(filename), 2 + 2 * (1 + 4 + 250 + 1));
+  assert_int_equal(srec_parse(filename, &out), 0);
+  assert_int_equal(out.size, sizeof(data));
+  assert_memory_equal(out.data, data, sizeof(data));
+  free(out.data);
+
+  assert_int_equal(format_set_write_options(32, false), 0);
+  assert_int_equal(ihex_write(filename, data, sizeof(data), 0), 0);
+  assert_int_equal(longest_line(filename), 1 + 2 * (4 + 32 + 1));
+
+  format_set_write_options(FORMAT_RECORD_BYTES_DEFAULT, false);
+}
+
+static void
+test_write_skip_blank(void **state) {
+  (void)state;
+  char filename[512];
+  parsed_file_t out;
+  static uint8_t code[0x4000];
+  static uint8_t flash[0x400];
+
+  /* Data at the start and in the middle, everything else erased */
+  memset(code, 0xFF, sizeof(code));
+  memset(code, 0x11, 0x20);
+  code[0x2345] = 0x22;
+  memset(flash, 0xFF, sizeof(flash));
+
+  backup_region_t regions[] = {
+    { code,  sizeof(code),  0x00000000 },
+    { flash, sizeof(flash), 0x08000000 },
+  };
+
+  assert_int_equal(format_set_write_options(FORMAT_RECORD_BYTES_DEFAULT, true), 0);
+  snprintf(filename, sizeof(filename), "%s/sparse.hex", temp_dir);
+  assert_int_equal(format_write_multi(filename, FORMAT_IHEX, regions, 2), 0);
+  format_set_write_options(FORMAT_RECORD_BYTES_DEFAULT, false);
+
+  /* Only the two non-blank 256-byte blocks are kept */
+  assert_int_equal(ihex_parse(filename, &out), 0);
+  assert_int_equal(out.base_addr, 0);
+  assert_int_equal(out.size, 0x2400);
+  assert_memory_equal(out.data, code, out.size);
+  free(out.data);
+
+  FILE *fp = fopen(filename, "r");
+  char line[128];
+  int records = 0;
+  assert_non_null(fp);
+  while (fgets(line, sizeof(line), fp))
+    records++;
+  fclose(fp);
+  assert_int_equal(records, 2 * 0x100 / 16 + 1);
+}
+
 static void
 test_srec_write_simple(void **state) {
   (void)state;
@@ -719,6 +929,180 @@ test_format_parse_explicit(void **state) {
   free(out.data);
 }
 
+/*
+ * ELF parser tests
+ */
+
+typedef struct {
+  uint32_t type;
+  uint32_t paddr;
+  uint32_t filesz;
+  const uint8_t *data;
+} test_seg_t;
+
+static void
+put32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+/* ELF32 ARM file: header, program headers, then segment contents */
+static void
+write_elf(const char *filename, const test_seg_t *segs, int count, uint8_t class, uint16_t machine) {
+  uint8_t buf[1024] = { 0 };
+  uint32_t off = 52 + 32 * (uint32_t)count;
+
+  memcpy(buf, "\x7f" "ELF", 4);
+  buf[4] = class;
+  buf[5] = 1; /* little-endian */
+  buf[6] = 1; /* EV_CURRENT */
+  buf[16] = 2; /* ET_EXEC */
+  buf[18] = (uint8_t)machine;
+  put32(buf + 28, 52);
+  buf[40] = 52;
+  buf[42] = 32;
+  buf[44] = (uint8_t)count;
+
+  for (int i = 0; i < count; i++) {
+    uint8_t *ph = buf + 52 + 32 * i;
+    put32(ph, segs[i].type);
+    put32(ph + 4, off);
+    put32(ph + 8, 0x20000000 + segs[i].paddr); /* VMA differs from LMA */
+    put32(ph + 12, segs[i].paddr);
+    put32(ph + 16, segs[i].filesz);
+    put32(ph + 20, segs[i].filesz + 0x10);
+    if (segs[i].data)
+      memcpy(buf + off, segs[i].data, segs[i].filesz);
+    off += segs[i].filesz;
+  }
+
+  FILE *fp = fopen(filename, "wb");
+  assert_non_null(fp);
+  assert_int_equal(fwrite(buf, 1, off, fp), off);
+  fclose(fp);
+}
+
+static void
+test_elf_segments(void **state) {
+  (void)state;
+  char filename[512];
+  parsed_file_t out;
+  static const uint8_t text[] = { 0x00, 0x20, 0x00, 0x20, 0xC1, 0x01, 0x00, 0x00 };
+  static const uint8_t rodata[] = { 0x11, 0x22, 0x33, 0x44 };
+  static const uint8_t data[] = { 0xAA, 0xBB };
+  static const uint8_t note[] = { 0x55 };
+
+  /* Out of order, a touching segment, a non-load one and a .bss */
+  const test_seg_t segs[] = {
+    { 1, 0x1000, sizeof(data), data },
+    { 1, 0x0000, sizeof(text), text },
+    { 4, 0x0800, sizeof(note), note },
+    { 1, 0x0008, sizeof(rodata), rodata },
+    { 1, 0x2000, 0, NULL },
+  };
+
+  snprintf(filename, sizeof(filename), "%s/test.elf", temp_dir);
+  write_elf(filename, segs, 5, 1, 40);
+
+  assert_int_equal(format_parse(filename, FORMAT_AUTO, &out), 0);
+  assert_int_equal(out.has_addr, 1);
+  assert_int_equal(out.base_addr, 0);
+  assert_int_equal(out.size, 0x1002);
+
+  assert_int_equal(out.nr_extents, 2);
+  assert_int_equal(out.extents[0].addr, 0);
+  assert_int_equal(out.extents[0].size, 12);
+  assert_int_equal(out.extents[1].addr, 0x1000);
+  assert_int_equal(out.extents[1].size, 2);
+
+  /* Only the extents are held, back to back; the gap reads as 0xFF */
+  assert_ptr_equal(out.extents[0].data, out.data);
+  assert_ptr_equal(out.extents[1].data, out.data + 12);
+  uint8_t buf[0x1002];
+  format_copy(&out, 0, buf, sizeof(buf));
+  assert_memory_equal(buf, text, sizeof(text));
+  assert_memory_equal(buf + 8, rodata, sizeof(rodata));
+  assert_int_equal(buf[0x0C], 0xFF);
+  assert_int_equal(buf[0x800], 0xFF);
+  assert_memory_equal(buf + 0x1000, data, sizeof(data));
+
+  assert_ptr_equal(format_bytes(&out, 8, 4), out.data + 8);
+  assert_ptr_equal(format_bytes(&out, 0x1000, 2), out.data + 12);
+  assert_null(format_bytes(&out, 8, 8));
+  assert_int_equal(format_first_used(&out, 0x0C, 0xFF6), 0xFF4);
+  assert_int_equal(format_last_used(&out, 0, 0x1000), 12);
+  assert_int_equal(format_last_used(&out, 0x0C, 0xFF4), 0);
+  free(out.data);
+
+  /* Code and data flash 128 MB apart: nothing held in between */
+  const test_seg_t far[] = {
+    { 1, 0x00000000, sizeof(text), text },
+    { 1, 0x08000000, sizeof(data), data },
+  };
+  write_elf(filename, far, 2, 1, 40);
+  assert_int_equal(format_parse(filename, FORMAT_ELF, &out), 0);
+  assert_int_equal(out.size, 0x08000002);
+  assert_int_equal(out.nr_extents, 2);
+  assert_ptr_equal(out.extents[1].data, out.data + sizeof(text));
+  free(out.data);
+
+  /* More segments than extents: the closest ones are merged */
+  test_seg_t many[FORMAT_MAX_EXTENTS + 2];
+  for (int i = 0; i < FORMAT_MAX_EXTENTS + 2; i++)
+    many[i] = (test_seg_t){ 1, (uint32_t)i * 0x1000, sizeof(note), note };
+  many[5].paddr = 0x4010; /* 16 bytes after the previous one */
+  many[9].paddr = 0x8020;
+  write_elf(filename, many, FORMAT_MAX_EXTENTS + 2, 1, 40);
+  assert_int_equal(format_parse(filename, FORMAT_ELF, &out), 0);
+  assert_int_equal(out.nr_extents, FORMAT_MAX_EXTENTS);
+  assert_int_equal(out.extents[4].addr, 0x4000);
+  assert_int_equal(out.extents[4].size, 0x11);
+  assert_int_equal(out.extents[4].data[0x0F], 0xFF);
+  assert_int_equal(out.extents[4].data[0x10], note[0]);
+  assert_int_equal(out.extents[7].addr, 0x8000);
+  assert_int_equal(out.extents[7].size, 0x21);
+  free(out.data);
+}
+
+static void
+test_elf_invalid(void **state) {
+  (void)state;
+  char filename[512];
+  parsed_file_t out;
+  static const uint8_t text[] = { 0x01, 0x02, 0x03, 0x04 };
+  const test_seg_t seg = { 1, 0, sizeof(text), text };
+  const test_seg_t bss = { 1, 0, 0, NULL };
+
+  snprintf(filename, sizeof(filename), "%s/bad.elf", temp_dir);
+
+  /* ELF64 */
+  write_elf(filename, &seg, 1, 2, 40);
+  assert_int_equal(elf_parse(filename, &out), -1);
+
+  /* x86 */
+  write_elf(filename, &seg, 1, 1, 3);
+  assert_int_equal(elf_parse(filename, &out), -1);
+
+  /* Nothing to program */
+  write_elf(filename, &bss, 1, 1, 40);
+  assert_int_equal(elf_parse(filename, &out), -1);
+
+  /* Not an ELF file */
+  write_file(filename, ":00000001FF\n");
+  assert_int_equal(elf_parse(filename, &out), -1);
+
+  /* Segment past the end of the file */
+  write_elf(filename, &seg, 1, 1, 40);
+  FILE *fp = fopen(filename, "r+b");
+  assert_non_null(fp);
+  fseek(fp, 52 + 16, SEEK_SET);
+  fputc(0x40, fp);
+  fclose(fp);
+  assert_int_equal(elf_parse(filename, &out), -1);
+}
+
 int
 main(void) {
   const struct CMUnitTest tests[] = {
@@ -734,6 +1118,7 @@ main(void) {
     /* Intel HEX parser tests */
     cmocka_unit_test(test_ihex_simple),
     cmocka_unit_test(test_ihex_extended_addr),
+    cmocka_unit_test(test_format_ranges),
     cmocka_unit_test(test_ihex_segment_addr),
     cmocka_unit_test(test_ihex_bad_checksum),
     cmocka_unit_test(test_ihex_no_eof),
@@ -752,6 +1137,9 @@ main(void) {
     cmocka_unit_test(test_srec_multirecord_manpage),
     cmocka_unit_test(test_srec_crlf_endings),
     cmocka_unit_test(test_srec_lowercase),
+    cmocka_unit_test(test_ihex_descending_records),
+    cmocka_unit_test(test_ihex_empty_file),
+    cmocka_unit_test(test_srec_descending_records),
 
     /* Output format encoder tests (roundtrip) */
     cmocka_unit_test(test_ihex_write_simple),
@@ -761,11 +1149,18 @@ main(void) {
     cmocka_unit_test(test_format_write_auto_ihex),
     cmocka_unit_test(test_format_write_auto_srec),
     cmocka_unit_test(test_format_write_large_data),
+    cmocka_unit_test(test_write_record_bytes),
+    cmocka_unit_test(test_write_skip_blank),
 
     /* format_parse auto-detection tests */
     cmocka_unit_test(test_format_parse_auto_ihex),
     cmocka_unit_test(test_format_parse_auto_srec),
     cmocka_unit_test(test_format_parse_explicit),
+
+    /* ELF parser tests */
+    cmocka_unit_test(test_format_detect_elf),
+    cmocka_unit_test(test_elf_segments),
+    cmocka_unit_test(test_elf_invalid),
   };
 
   return cmocka_run_group_tests(tests, setup, teardown);
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for the library API and the message sink
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/compat.h"
+#include "../src/libradfu.h"
+#include "../src/ralog.h"
+
+#define NR_LINES 8
+
+static struct {
+  int level[NR_LINES];
+  char msg[NR_LINES][256];
+  int count;
+} logged;
+
+static void
+capture(radfu_log_level_t level, const char *msg, void *user_data) {
+  assert_true(user_data == &logged);
+  if (logged.count < NR_LINES) {
+    logged.level[logged.count] = level;
+    snprintf(logged.msg[logged.count], sizeof(logged.msg[0]), "%s", msg);
+  }
+  logged.count++;
+}
+
+static void
+capture_ra(ra_log_level_t level, const char *msg, void *user_data) {
+  capture((radfu_log_level_t)level, msg, user_data);
+}
+
+static void
+reset(void) {
+  memset(&logged, 0, sizeof(logged));
+}
+
+static void
+test_log_handler(void **state) {
+  (void)state;
+  reset();
+  ra_log_set_handler(capture_ra, &logged);
+  warnx("area %d does not support read operations", 3);
+  errno = ENOENT;
+  warn("failed to open %s", "x.bin");
+  ra_log(RA_LOG_OUTPUT, "CRC-32: 0x%08X", 0xCAFEF00Du);
+  ra_log_set_handler(NULL, NULL);
+
+  assert_int_equal(logged.count, 3);
+  assert_int_equal(logged.level[0], RA_LOG_WARN);
+  assert_string_equal(logged.msg[0], "area 3 does not support read operations");
+  assert_int_equal(logged.level[1], RA_LOG_WARN);
+  assert_true(strncmp(logged.msg[1], "failed to open x.bin: ", 22) == 0);
+  assert_true(strlen(logged.msg[1]) > 22);
+  assert_int_equal(logged.level[2], RA_LOG_OUTPUT);
+  assert_string_equal(logged.msg[2], "CRC-32: 0xCAFEF00D");
+}
+
+static void
+test_args(void **state) {
+  (void)state;
+  radfu_t *s = (radfu_t *)&logged;
+  uint8_t buf[16];
+  uint32_t crc;
+  radfu_config_t cfg;
+
+  memset(&cfg, 0, sizeof(cfg));
+
+  assert_int_equal(radfu_open(NULL, &cfg), RADFU_ERR_ARG);
+  assert_int_equal(radfu_open(&s, NULL), RADFU_ERR_ARG);
+  assert_int_equal(radfu_read(NULL, 0, buf, sizeof(buf)), RADFU_ERR_ARG);
+  assert_int_equal(radfu_write(NULL, 0, buf, sizeof(buf)), RADFU_ERR_ARG);
+  assert_int_equal(radfu_verify(NULL, 0, buf, sizeof(buf)), RADFU_ERR_ARG);
+  assert_int_equal(radfu_crc(NULL, 0, sizeof(buf), &crc), RADFU_ERR_ARG);
+  assert_int_equal(radfu_erase(NULL, 0, sizeof(buf)), RADFU_ERR_ARG);
+  assert_int_equal(radfu_backup(NULL, NULL, 0), RADFU_ERR_ARG);
+  assert_int_equal(radfu_restore(NULL, NULL, 0), RADFU_ERR_ARG);
+  radfu_close(NULL);
+
+  assert_string_equal(radfu_strerror(RADFU_OK), "success");
+  assert_string_equal(radfu_strerror(RADFU_ERR_VERIFY), "verify failed");
+  assert_string_equal(radfu_strerror(42), "unknown error");
+}
+
+static void
+test_open_fails(void **state) {
+  (void)state;
+  radfu_t *s = (radfu_t *)&logged;
+  radfu_config_t cfg = { .port = "/nonexistent/radfu-test-tty" };
+
+  /* Failure details reach the callback, not stderr */
+  reset();
+  radfu_set_log(capture, &logged);
+  assert_int_equal(radfu_open(&s, &cfg), RADFU_ERR_CONNECT);
+  assert_null(s);
+  radfu_set_log(NULL, NULL);
+
+  assert_true(logged.count > 0);
+  int last = (logged.count < NR_LINES ? logged.count : NR_LINES) - 1;
+  assert_int_equal(logged.level[last], RADFU_LOG_WARN);
+  assert_string_equal(logged.msg[last], "failed to connect to device");
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_log_handler),
+    cmocka_unit_test(test_args),
+    cmocka_unit_test(test_open_fails),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for the provisioning manifest parser and planner
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/manifest.h"
+
+static char temp_dir[256];
+static char path[512];
+
+static const char *
+write_file(const char *name, const char *content, size_t len) {
+  snprintf(path, sizeof(path), "%s%c%s", temp_dir, path_separator(), name);
+  FILE *f = fopen(path, "wb");
+  assert_non_null(f);
+  assert_int_equal(fwrite(content, 1, len, f), len);
+  fclose(f);
+  return path;
+}
+
+static const char *
+write_manifest(const char *content) {
+  return write_file("radfu.manifest", content, strlen(content));
+}
+
+static int
+setup(void **state) {
+  (void)state;
+  snprintf(
+      temp_dir, sizeof(temp_dir), "%s%ctest_manifest.XXXXXX", get_temp_dir(), path_separator());
+  if (mkdtemp(temp_dir) == NULL)
+    return -1;
+
+  char key[48];
+  memset(key, 0x5A, sizeof(key));
+  write_file("secdbg.key", key, sizeof(key));
+  write_file("user0.key", key, 32);
+  write_file("big.key", key, sizeof(key));
+  FILE *f = fopen(path, "ab");
+  if (f == NULL)
+    return -1;
+  fputc(0, f);
+  fclose(f);
+
+  const char *rpd = "FLASH_S_SIZE=0x8000\n"
+                    "FLASH_C_SIZE=0x8000\n"
+                    "RAM_S_SIZE=0x2000\n"
+                    "RAM_C_SIZE=0x2000\n"
+                    "DATA_FLASH_S_SIZE=0x0\n";
+  write_file("zephyr.rpd", rpd, strlen(rpd));
+  return 0;
+}
+
+static int
+teardown(void **state) {
+  (void)state;
+  char cmd[512];
+#ifdef _WIN32
+  snprintf(cmd, sizeof(cmd), "rmdir /s /q \"%s\"", temp_dir);
+#else
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", temp_dir);
+#endif
+  return system(cmd);
+}
+
+static void
+test_load(void **state) {
+  (void)state;
+
+  manifest_t *m = malloc(sizeof(*m));
+  char expected[512];
+
+  assert_non_null(m);
+  const char *file = write_manifest("# board bring-up\n"
+                                    "[image]\n"
+                                    "file = app.hex\n"
+                                    "\n"
+                                    "[image]\n"
+                                    "file = \"calib data.bin\"   # spaces need quotes\n"
+                                    "address = 0x08000000\n"
+                                    "format = bin\n"
+                                    "[boundary]\n"
+                                    "file = zephyr.rpd\n"
+                                    "[param]\n"
+                                    "init = disable\n"
+                                    "[key]\n"
+                                    "type = secdbg\n"
+                                    "file = secdbg.key\n"
+                                    "[ukey]\n"
+                                    "index = 4\n"
+                                    "file = user0.key\n"
+                                    "[dlm]\n"
+                                    "state = DPL\n");
+  assert_int_equal(manifest_load(file, m), 0);
+
+  assert_int_equal(m->nr_images, 2);
+  snprintf(expected, sizeof(expected), "%s%capp.hex", temp_dir, path_separator());
+  assert_string_equal(m->images[0].file, expected);
+  assert_int_equal(m->images[0].address, 0);
+  assert_int_equal(m->images[0].format, FORMAT_AUTO);
+  snprintf(expected, sizeof(expected), "%s%ccalib data.bin", temp_dir, path_separator());
+  assert_string_equal(m->images[1].file, expected);
+  assert_int_equal(m->images[1].address, 0x08000000);
+  assert_int_equal(m->images[1].format, FORMAT_BIN);
+
+  assert_true(m->has_boundary);
+  assert_int_equal(m->boundary.cfs1, 32);
+  assert_int_equal(m->boundary.cfs2, 32);
+  assert_int_equal(m->boundary.dfs, 0);
+  assert_int_equal(m->boundary.srs1, 8);
+  assert_int_equal(m->boundary.srs2, 8);
+
+  assert_true(m->has_param);
+  assert_int_equal(m->param_init, PARAM_INIT_DISABLED);
+
+  assert_int_equal(m->nr_keys, 1);
+  assert_int_equal(m->keys[0].index, KYTY_SECDBG);
+  assert_int_equal(m->keys[0].len, 48);
+  assert_int_equal(m->nr_ukeys, 1);
+  assert_int_equal(m->ukeys[0].index, 4);
+  assert_int_equal(m->ukeys[0].len, 32);
+
+  assert_int_equal(m->dlm, DLM_STATE_DPL);
+
+  free(m);
+}
+
+static void
+test_load_errors(void **state) {
+  (void)state;
+
+  static const char *const bad[] = {
+    "[firmware]\nfile = app.hex\n",                        /* unknown section */
+    "file = app.hex\n",                                    /* outside any section */
+    "[image]\naddress = 0x0\n",                            /* image without file */
+    "[image]\nfile = a.hex\nformat = coff\n",              /* unknown format */
+    "[boundary]\ncfs1 = 32\ncfs2 = 32\n",                  /* incomplete boundary */
+    "[boundary]\ncfs1=64\ncfs2=32\ndfs=0\nsrs1=8\nsrs2=8", /* cfs1 > cfs2 */
+    "[param]\ninit = maybe\n",                             /* bad value */
+    "[key]\nfile = secdbg.key\n",                          /* key without type */
+    "[key]\ntype = secdbg\nfile = big.key\n",              /* wrapped key too long */
+    "[key]\ntype=rma\nfile=secdbg.key\n[key]\ntype=3\nfile=secdbg.key\n", /* twice */
+    "[ukey]\nindex = 1\nfile = missing.key\n",                            /* no file */
+    "[dlm]\nstate = cm\n",                                                /* not a target */
+    "[dlm]\nstate = dpl\n[dlm]\nstate = dpl\n",                           /* duplicate */
+    "[image\nfile = a.hex\n",                                             /* header */
+  };
+
+  manifest_t *m = malloc(sizeof(*m));
+  assert_non_null(m);
+
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    assert_int_equal(manifest_load(write_manifest(bad[i]), m), -1);
+
+  snprintf(path, sizeof(path), "%s%cnone.manifest", temp_dir, path_separator());
+  assert_int_equal(manifest_load(path, m), -1);
+
+  free(m);
+}
+
+/* Every section present, device state filled by each test */
+static void
+full_manifest(manifest_t *m, uint8_t dlm) {
+  memset(m, 0, sizeof(*m));
+  m->nr_images = 2;
+  m->has_boundary = true;
+  m->has_param = true;
+  m->param_init = PARAM_INIT_DISABLED;
+  m->nr_keys = 1;
+  m->keys[0].index = KYTY_SECDBG;
+  m->nr_ukeys = 1;
+  m->dlm = dlm;
+}
+
+static void
+all_ok(manifest_state_t *st, uint8_t dlm) {
+  memset(st, 0, sizeof(*st));
+  st->has_dlm = true;
+  st->dlm = dlm;
+  st->boundary_ok = true;
+  st->param_ok = true;
+  st->key_ok[0] = true;
+  st->ukey_ok[0] = true;
+  st->image_ok[0] = true;
+  st->image_ok[1] = true;
+}
+
+static void
+test_plan_nothing_to_do(void **state) {
+  (void)state;
+
+  manifest_t *m = malloc(sizeof(*m));
+  manifest_state_t st;
+  manifest_step_t steps[MANIFEST_MAX_STEPS];
+
+  assert_non_null(m);
+  full_manifest(m, DLM_STATE_DPL);
+  all_ok(&st, DLM_STATE_DPL);
+  assert_int_equal(manifest_plan(m, &st, steps), 0);
+
+  /* No target DLM: the current state is fine whatever it is */
+  m->dlm = 0;
+  m->has_boundary = false;
+  m->has_param = false;
+  m->nr_keys = 0;
+  all_ok(&st, DLM_STATE_LCK_BOOT);
+  assert_int_equal(manifest_plan(m, &st, steps), 0);
+
+  free(m);
+}
+
+static void
+test_plan_order(void **state) {
+  (void)state;
+
+  manifest_t *m = malloc(sizeof(*m));
+  manifest_state_t st;
+  manifest_step_t steps[MANIFEST_MAX_STEPS];
+
+  assert_non_null(m);
+  full_manifest(m, DLM_STATE_LCK_DBG);
+  memset(&st, 0, sizeof(st));
+  st.has_dlm = true;
+  st.dlm = DLM_STATE_CM;
+  st.image_ok[0] = true;
+
+  static const manifest_step_kind_t kinds[] = {
+    STEP_DLM_TRANSIT, STEP_BOUNDARY, STEP_KEY, STEP_UKEY,
+    STEP_IMAGE,       STEP_PARAM,    STEP_DLM_TRANSIT, STEP_DLM_TRANSIT,
+  };
+
+  int n = manifest_plan(m, &st, steps);
+  assert_int_equal(n, 8);
+  for (int i = 0; i < n; i++)
+    assert_int_equal(steps[i].kind, kinds[i]);
+  assert_int_equal(steps[0].dlm, DLM_STATE_SSD);
+  assert_int_equal(steps[4].item, 1); /* image 0 already matches */
+  assert_int_equal(steps[6].dlm, DLM_STATE_DPL);
+  assert_int_equal(steps[7].dlm, DLM_STATE_LCK_DBG);
+
+  /* Only an image differs on a deployed board */
+  all_ok(&st, DLM_STATE_DPL);
+  st.image_ok[0] = false;
+  m->dlm = DLM_STATE_DPL;
+  assert_int_equal(manifest_plan(m, &st, steps), 1);
+  assert_int_equal(steps[0].kind, STEP_IMAGE);
+  assert_int_equal(steps[0].item, 0);
+
+  /* SSD -> NSECSD is one hop */
+  all_ok(&st, DLM_STATE_SSD);
+  m->dlm = DLM_STATE_NSECSD;
+  assert_int_equal(manifest_plan(m, &st, steps), 1);
+  assert_int_equal(steps[0].dlm, DLM_STATE_NSECSD);
+
+  free(m);
+}
+
+static void
+test_plan_refused(void **state) {
+  (void)state;
+
+  manifest_t *m = malloc(sizeof(*m));
+  manifest_state_t st;
+  manifest_step_t steps[MANIFEST_MAX_STEPS];
+
+  assert_non_null(m);
+
+  /* Boundary only settable in SSD */
+  full_manifest(m, DLM_STATE_DPL);
+  all_ok(&st, DLM_STATE_DPL);
+  st.boundary_ok = false;
+  assert_int_equal(manifest_plan(m, &st, steps), -1);
+
+  /* Going back needs authentication */
+  all_ok(&st, DLM_STATE_DPL);
+  m->dlm = DLM_STATE_SSD;
+  assert_int_equal(manifest_plan(m, &st, steps), -1);
+  m->dlm = DLM_STATE_NSECSD;
+  assert_int_equal(manifest_plan(m, &st, steps), -1);
+
+  /* Bootloader locked */
+  all_ok(&st, DLM_STATE_LCK_BOOT);
+  st.image_ok[1] = false;
+  m->dlm = DLM_STATE_LCK_BOOT;
+  assert_int_equal(manifest_plan(m, &st, steps), -1);
+
+  /* No DLM (GrpD): images and user keys only */
+  all_ok(&st, 0);
+  st.has_dlm = false;
+  st.image_ok[0] = false;
+  assert_int_equal(manifest_plan(m, &st, steps), -1);
+  full_manifest(m, 0);
+  m->has_boundary = false;
+  m->has_param = false;
+  m->nr_keys = 0;
+  assert_int_equal(manifest_plan(m, &st, steps), 1);
+  assert_int_equal(steps[0].kind, STEP_IMAGE);
+
+  free(m);
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_load),
+    cmocka_unit_test(test_load_errors),
+    cmocka_unit_test(test_plan_nothing_to_do),
+    cmocka_unit_test(test_plan_order),
+    cmocka_unit_test(test_plan_refused),
+  };
+
+  return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for the progress throttling and the JSON lines channel
+ */
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/progress.h"
+
+#define MAX_LINES 16
+
+static char lines[MAX_LINES][256];
+
+/* Test clock: seconds since start, advanced by hand */
+static double fake_secs;
+
+static double
+fake_clock(const progress_time_t *start) {
+  (void)start;
+  return fake_secs;
+}
+
+/* Rewind the channel and split what it got into lines */
+static int
+read_lines(FILE *f) {
+  int n = 0;
+
+  rewind(f);
+  while (n < MAX_LINES && fgets(lines[n], sizeof(lines[0]), f) != NULL)
+    n++;
+  return n;
+}
+
+static void
+test_channel_events(void **state) {
+  (void)state;
+  FILE *f = tmpfile();
+  progress_t p;
+
+  assert_non_null(f);
+  progress_set_channel(f);
+  progress_set_device("/dev/ttyACM0", "0123456789abcdef0123456789abcdef");
+  progress_set_clock(fake_clock);
+  fake_secs = 0;
+
+  /* 4 KB in 1 KB steps, the last one short */
+  progress_init_steps(&p, 4, 3500, "Reading");
+  for (size_t i = 1; i <= 4; i++)
+    progress_update(&p, i);
+  progress_finish(&p);
+
+  progress_set_channel(NULL);
+  progress_set_device(NULL, NULL);
+  progress_set_clock(NULL);
+
+  /* start, the first step after it is throttled, then 100% and done */
+  int n = read_lines(f);
+  assert_int_equal(n, 3);
+  const char *start = "{\"event\":\"start\",\"phase\":\"Reading\",\"bytes\":0,\"total\":3500,";
+  assert_true(strncmp(lines[0], start, strlen(start)) == 0);
+  assert_non_null(strstr(lines[0], "\"port\":\"/dev/ttyACM0\""));
+  assert_non_null(strstr(lines[0], "\"device\":\"0123456789abcdef0123456789abcdef\"}\n"));
+  assert_non_null(strstr(lines[1], "\"event\":\"progress\""));
+  assert_non_null(strstr(lines[1], "\"bytes\":3500,\"total\":3500,"));
+  assert_non_null(strstr(lines[2], "\"event\":\"done\""));
+  fclose(f);
+}
+
+static void
+test_throttle_and_escape(void **state) {
+  (void)state;
+  FILE *f = tmpfile();
+  progress_t p;
+
+  assert_non_null(f);
+  progress_set_channel(f);
+  progress_set_clock(fake_clock);
+  fake_secs = 0;
+
+  /* Thousands of updates within one render period: only the start is shown */
+  progress_init(&p, 100000, "Area \"code\"\\1");
+  for (size_t i = 1; i < 50000; i++)
+    progress_update(&p, i);
+
+  /* One period later, the next update is shown */
+  fake_secs = 0.25;
+  for (size_t i = 50000; i < 100000; i++)
+    progress_update(&p, i);
+  progress_set_channel(NULL);
+  progress_set_clock(NULL);
+
+  int n = read_lines(f);
+  assert_int_equal(n, 2);
+  assert_non_null(strstr(lines[0], "\"phase\":\"Area \\\"code\\\"\\\\1\""));
+  assert_null(strstr(lines[0], "\"port\""));
+  assert_non_null(strstr(lines[1], "\"bytes\":50000,"));
+  fclose(f);
+}
+
+static void
+count_cb(size_t current, size_t total, const char *desc, void *user_data) {
+  size_t *calls = user_data;
+
+  (void)desc;
+  assert_true(current <= total);
+  (*calls)++;
+}
+
+static void
+test_callback_not_throttled(void **state) {
+  (void)state;
+  progress_t p;
+  size_t calls = 0;
+
+  /* The library callback sees every update, the bar only some */
+  progress_global_quiet = 1;
+  progress_init(&p, 1000, "Writing");
+  progress_set_callback(&p, count_cb, &calls);
+  for (size_t i = 1; i <= 1000; i++)
+    progress_update(&p, i);
+  progress_finish(&p);
+  assert_int_equal(calls, 1001); /* updates and finish */
+  progress_global_quiet = 0;
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_channel_events),
+    cmocka_unit_test(test_throttle_and_escape),
+    cmocka_unit_test(test_callback_not_throttled),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for buffer checksum and classification kernels
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "../src/rabuf.h"
+
+#define MAX_TEST_LEN 300
+#define MAX_TEST_OFF 64
+
+static const char *const impl_names[] = { "generic", "sse2", "avx2", "neon" };
+
+/*
+ * Scalar references
+ */
+
+static uint32_t
+ref_sum(const uint8_t *buf, size_t len) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < len; i++)
+    sum += buf[i];
+  return sum;
+}
+
+static size_t
+ref_first_used(const uint8_t *buf, size_t len) {
+  size_t i = 0;
+  while (i < len && buf[i] == 0xFF)
+    i++;
+  return i;
+}
+
+static size_t
+ref_last_used(const uint8_t *buf, size_t len) {
+  while (len > 0 && buf[len - 1] == 0xFF)
+    len--;
+  return len;
+}
+
+static size_t
+ref_count_used(const uint8_t *buf, size_t len) {
+  size_t count = 0;
+  for (size_t i = 0; i < len; i++)
+    count += (buf[i] != 0xFF);
+  return count;
+}
+
+static size_t
+ref_mismatch(const uint8_t *a, const uint8_t *b, size_t len) {
+  size_t i = 0;
+  while (i < len && a[i] == b[i])
+    i++;
+  return i;
+}
+
+/* Deterministic pseudo-random fill, biased towards 0xFF like real flash */
+static void
+fill(uint8_t *buf, size_t len, uint32_t seed) {
+  for (size_t i = 0; i < len; i++) {
+    seed = seed * 1103515245 + 12345;
+    buf[i] = ((seed >> 16) & 3) ? 0xFF : (uint8_t)(seed >> 8);
+  }
+}
+
+/*
+ * Compare every implementation usable on this CPU against the references,
+ * across lengths and alignments that hit the vector heads and tails.
+ */
+
+static void
+check_impl(void) {
+  uint8_t a[MAX_TEST_OFF + MAX_TEST_LEN];
+  uint8_t b[MAX_TEST_OFF + MAX_TEST_LEN];
+
+  for (size_t off = 0; off < MAX_TEST_OFF; off += 7) {
+    for (size_t len = 0; len <= MAX_TEST_LEN; len++) {
+      const uint8_t *pa = a + off;
+      const uint8_t *pb = b + off;
+
+      fill(a, sizeof(a), (uint32_t)(off * 1000 + len));
+      assert_int_equal(rabuf_sum(pa, len), ref_sum(pa, len));
+      assert_int_equal(rabuf_first_used(pa, len), ref_first_used(pa, len));
+      assert_int_equal(rabuf_last_used(pa, len), ref_last_used(pa, len));
+      assert_int_equal(rabuf_count_used(pa, len), ref_count_used(pa, len));
+
+      /* Blank buffer, and a single used byte at each end */
+      memset(a, 0xFF, sizeof(a));
+      assert_true(rabuf_is_blank(pa, len));
+      assert_int_equal(rabuf_first_used(pa, len), len);
+      assert_int_equal(rabuf_last_used(pa, len), 0);
+      assert_int_equal(rabuf_count_used(pa, len), 0);
+      if (len > 0) {
+        a[off + len - 1] = 0xFE;
+        assert_int_equal(rabuf_first_used(pa, len), len - 1);
+        assert_int_equal(rabuf_last_used(pa, len), len);
+        a[off + len - 1] = 0xFF;
+        a[off] = 0x00;
+        assert_int_equal(rabuf_first_used(pa, len), 0);
+        assert_int_equal(rabuf_last_used(pa, len), 1);
+      }
+
+      /* Mismatch at every position, and no mismatch */
+      fill(a, sizeof(a), (uint32_t)len);
+      memcpy(b, a, sizeof(b));
+      assert_int_equal(rabuf_mismatch(pa, pb, len), len);
+      for (size_t j = 0; j < len; j += 13) {
+        b[off + j] ^= 0x80;
+        assert_int_equal(rabuf_mismatch(pa, pb, len), ref_mismatch(pa, pb, len));
+        assert_int_equal(rabuf_mismatch(pa, pb, len), j);
+        b[off + j] ^= 0x80;
+      }
+    }
+  }
+}
+
+static void
+test_all_impls(void **state) {
+  (void)state;
+
+  int tested = 0;
+  for (size_t i = 0; i < sizeof(impl_names) / sizeof(impl_names[0]); i++) {
+    if (rabuf_select(impl_names[i]) < 0)
+      continue;
+    assert_string_equal(rabuf_impl_name(), impl_names[i]);
+    check_impl();
+    tested++;
+  }
+
+  /* The portable fallback is always available */
+  assert_true(tested >= 1);
+}
+
+static void
+test_select(void **state) {
+  (void)state;
+
+  assert_int_equal(rabuf_select("generic"), 0);
+  assert_string_equal(rabuf_impl_name(), "generic");
+  assert_int_equal(rabuf_select("bogus"), -1);
+  assert_string_equal(rabuf_impl_name(), "generic");
+
+  /* Best available */
+  assert_int_equal(rabuf_select(NULL), 0);
+  assert_non_null(rabuf_impl_name());
+}
+
+static void
+test_sum_large(void **state) {
+  (void)state;
+
+  /* Full packet payload of 0xFF must not overflow the vector accumulators */
+  static uint8_t buf[65536];
+  memset(buf, 0xFF, sizeof(buf));
+
+  for (size_t i = 0; i < sizeof(impl_names) / sizeof(impl_names[0]); i++) {
+    if (rabuf_select(impl_names[i]) < 0)
+      continue;
+    assert_int_equal(rabuf_sum(buf, sizeof(buf)), 0xFFu * sizeof(buf));
+    assert_int_equal(rabuf_count_used(buf, sizeof(buf)), 0);
+  }
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_all_impls),
+    cmocka_unit_test(test_select),
+    cmocka_unit_test(test_sum_large),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for the session flash read cache
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "../src/racache.h"
+
+static void
+fill(uint8_t *buf, size_t len, uint8_t seed) {
+  for (size_t i = 0; i < len; i++)
+    buf[i] = (uint8_t)(seed + i * 7);
+}
+
+static void
+test_fill_read(void **state) {
+  (void)state;
+
+  ra_cache_t *cache = ra_cache_new();
+  uint8_t src[3000];
+  uint8_t dst[3000];
+  uint32_t hits, misses;
+
+  assert_non_null(cache);
+  fill(src, sizeof(src), 1);
+
+  /* Nothing cached yet */
+  assert_false(ra_cache_read(cache, 0x1000, dst, 16));
+
+  /* Unaligned fill spanning several pages */
+  ra_cache_fill(cache, 0x1000 + 100, src, sizeof(src));
+  assert_true(ra_cache_read(cache, 0x1000 + 100, dst, sizeof(src)));
+  assert_memory_equal(dst, src, sizeof(src));
+
+  /* Any sub-range is served */
+  assert_true(ra_cache_read(cache, 0x1000 + 1000, dst, 100));
+  assert_memory_equal(dst, src + 900, 100);
+
+  /* One byte before or after the filled range misses */
+  assert_false(ra_cache_read(cache, 0x1000 + 99, dst, 2));
+  assert_false(ra_cache_read(cache, 0x1000 + 100 + sizeof(src) - 1, dst, 2));
+
+  ra_cache_stats(cache, &hits, &misses);
+  assert_int_equal(hits, 2);
+  assert_int_equal(misses, 3);
+
+  ra_cache_free(cache);
+}
+
+static void
+test_partial_page(void **state) {
+  (void)state;
+
+  ra_cache_t *cache = ra_cache_new();
+  uint8_t hdr[32];
+  uint8_t dst[64];
+
+  /* A 32-byte header read caches exactly 32 bytes of its page */
+  fill(hdr, sizeof(hdr), 9);
+  ra_cache_fill(cache, 0x8000, hdr, sizeof(hdr));
+  assert_true(ra_cache_read(cache, 0x8000, dst, 32));
+  assert_memory_equal(dst, hdr, 32);
+  assert_false(ra_cache_read(cache, 0x8000, dst, 33));
+  assert_false(ra_cache_read(cache, 0x8020, dst, 1));
+
+  ra_cache_free(cache);
+}
+
+static void
+test_invalidate(void **state) {
+  (void)state;
+
+  ra_cache_t *cache = ra_cache_new();
+  uint8_t src[4096];
+  uint8_t dst[4096];
+
+  fill(src, sizeof(src), 3);
+  ra_cache_fill(cache, 0, src, sizeof(src));
+
+  /* Drop one byte in the middle of a page, neighbours survive */
+  ra_cache_invalidate(cache, 0x500, 0x500);
+  assert_false(ra_cache_read(cache, 0x400, dst, 0x400));
+  assert_true(ra_cache_read(cache, 0x400, dst, 0x100));
+  assert_true(ra_cache_read(cache, 0x501, dst, 0x100));
+
+  /* Range across a page boundary */
+  ra_cache_invalidate(cache, 0x7F0, 0x80F);
+  assert_true(ra_cache_read(cache, 0x7E0, dst, 0x10));
+  assert_false(ra_cache_read(cache, 0x7F0, dst, 1));
+  assert_false(ra_cache_read(cache, 0x80F, dst, 1));
+  assert_true(ra_cache_read(cache, 0x810, dst, 0x10));
+  assert_memory_equal(dst, src + 0x810, 0x10);
+
+  /* Refill restores validity */
+  ra_cache_fill(cache, 0x7F0, src + 0x7F0, 0x20);
+  assert_true(ra_cache_read(cache, 0x600, dst, 0x400));
+  assert_memory_equal(dst, src + 0x600, 0x400);
+
+  ra_cache_invalidate_all(cache);
+  assert_false(ra_cache_read(cache, 0, dst, 1));
+
+  ra_cache_free(cache);
+}
+
+static void
+test_crc(void **state) {
+  (void)state;
+
+  ra_cache_t *cache = ra_cache_new();
+  uint32_t crc = 0;
+
+  ra_cache_crc_put(cache, 0x0000, 0x0FFF, 0x11111111);
+  ra_cache_crc_put(cache, 0x1000, 0x1FFF, 0x22222222);
+  ra_cache_crc_put(cache, 0x2000, 0x2FFF, 0x33333333);
+
+  assert_true(ra_cache_crc_get(cache, 0x1000, 0x1FFF, &crc));
+  assert_int_equal(crc, 0x22222222);
+
+  /* Only exact ranges match */
+  assert_false(ra_cache_crc_get(cache, 0x1000, 0x17FF, &crc));
+
+  /* Writing one byte drops only the CRC covering it */
+  ra_cache_invalidate(cache, 0x1800, 0x1800);
+  assert_false(ra_cache_crc_get(cache, 0x1000, 0x1FFF, &crc));
+  assert_true(ra_cache_crc_get(cache, 0x0000, 0x0FFF, &crc));
+  assert_int_equal(crc, 0x11111111);
+  assert_true(ra_cache_crc_get(cache, 0x2000, 0x2FFF, &crc));
+  assert_int_equal(crc, 0x33333333);
+
+  ra_cache_free(cache);
+}
+
+static void
+test_null_cache(void **state) {
+  (void)state;
+
+  uint8_t buf[4] = { 0 };
+  uint32_t crc, hits, misses;
+
+  /* A failed allocation degrades to no caching */
+  ra_cache_fill(NULL, 0, buf, sizeof(buf));
+  assert_false(ra_cache_read(NULL, 0, buf, sizeof(buf)));
+  ra_cache_crc_put(NULL, 0, 3, 0);
+  assert_false(ra_cache_crc_get(NULL, 0, 3, &crc));
+  ra_cache_invalidate(NULL, 0, 3);
+  ra_cache_invalidate_all(NULL);
+  ra_cache_stats(NULL, &hits, &misses);
+  assert_int_equal(hits, 0);
+  assert_int_equal(misses, 0);
+  ra_cache_free(NULL);
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_fill_read),
+    cmocka_unit_test(test_partial_page),
+    cmocka_unit_test(test_invalidate),
+    cmocka_unit_test(test_crc),
+    cmocka_unit_test(test_null_cache),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
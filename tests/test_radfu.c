@@ -11,11 +11,13 @@
 #include <stdint.h>
 #include <setjmp.h>
 #include <cmocka.h>
+#include <stdlib.h>
 #include <string.h>
 
 #ifndef TESTING
 #define TESTING
 #endif
+#include "../src/crc32.h"
 #include "../src/radfu_internal.h"
 
 /*
@@ -376,6 +378,269 @@ test_boundaries_unknown_address(void **state) {
   assert_int_equal(set_crc_boundaries(dev, 0x20000000, 0x1000, &end), -1);
 }
 
+/*
+ * CRC probe block tests
+ */
+
+static void
+test_crc_probe_blocks(void **state) {
+  (void)state;
+
+  ra_device_t *dev = setup_test_device();
+
+  /* Erase unit is the probe unit; no area falls back to a chunk */
+  assert_int_equal(crc_probe_unit(dev, 0x00001000), 0x2000);
+  assert_int_equal(crc_probe_unit(dev, 0x08000000), 0x40);
+  assert_int_equal(crc_probe_unit(dev, 0x20000000), 1024);
+
+  /* Blocks are aligned on the area start and clipped to the range */
+  assert_int_equal(crc_probe_block_end(dev, 0x00000000, 0x2000, 0x7FFFF), 0x1FFF);
+  assert_int_equal(crc_probe_block_end(dev, 0x00001000, 0x2000, 0x7FFFF), 0x1FFF);
+  assert_int_equal(crc_probe_block_end(dev, 0x00002000, 0x2000, 0x2FFF), 0x2FFF);
+  assert_int_equal(crc_probe_block_start(dev, 0x00003FFF, 0x2000, 0), 0x2000);
+  assert_int_equal(crc_probe_block_start(dev, 0x00003FFF, 0x2000, 0x3000), 0x3000);
+  assert_int_equal(crc_probe_block_start(dev, 0x0800007F, 0x40, 0x08000000), 0x08000040);
+}
+
+/*
+ * Diff bisection helpers
+ */
+
+static void
+test_diff_split(void **state) {
+  (void)state;
+
+  /* Halves on unit boundaries */
+  assert_int_equal(diff_split(0x0000, 0xFFFF, 0x2000), 0x8000);
+  assert_int_equal(diff_split(0x0000, 0x5FFF, 0x2000), 0x2000);
+  assert_int_equal(diff_split(0x08000000, 0x080000FF, 0x40), 0x08000080);
+
+  /* Range just above one unit must still make progress */
+  assert_int_equal(diff_split(0x0000, 0x2003, 0x2000), 0x2000);
+}
+
+static void
+test_diff_collect(void **state) {
+  (void)state;
+
+  uint8_t expected[64];
+  uint8_t actual[64];
+  ra_range_t *ranges = NULL;
+  size_t count = 0;
+
+  memset(expected, 0xFF, sizeof(expected));
+  memcpy(actual, expected, sizeof(actual));
+
+  /* Identical buffers add nothing */
+  assert_int_equal(diff_collect(expected, actual, sizeof(actual), 0x1000, &ranges, &count), 0);
+  assert_int_equal(count, 0);
+
+  /* Two separate runs */
+  actual[3] = 0x00;
+  actual[4] = 0x00;
+  actual[40] = 0x12;
+  assert_int_equal(diff_collect(expected, actual, sizeof(actual), 0x1000, &ranges, &count), 0);
+  assert_int_equal(count, 2);
+  assert_int_equal(ranges[0].start, 0x1003);
+  assert_int_equal(ranges[0].end, 0x1004);
+  assert_int_equal(ranges[1].start, 0x1028);
+  assert_int_equal(ranges[1].end, 0x1028);
+
+  /* A run ending a block merges with one starting the next block */
+  memcpy(actual, expected, sizeof(actual));
+  actual[63] = 0x00;
+  count = 0;
+  assert_int_equal(diff_collect(expected, actual, sizeof(actual), 0x2000, &ranges, &count), 0);
+  memcpy(actual, expected, sizeof(actual));
+  actual[0] = 0x00;
+  actual[1] = 0x00;
+  assert_int_equal(diff_collect(expected, actual, sizeof(actual), 0x2040, &ranges, &count), 0);
+  assert_int_equal(count, 1);
+  assert_int_equal(ranges[0].start, 0x203F);
+  assert_int_equal(ranges[0].end, 0x2041);
+
+  free(ranges);
+}
+
+/*
+ * Incremental backup and delta write helpers
+ */
+
+static void
+test_image_fill_area(void **state) {
+  (void)state;
+
+  ra_device_t *dev = setup_test_device();
+  const ra_area_t *data = &dev->chip_layout[1];
+  static uint8_t image[0x3000];
+  static uint8_t buf[0x2000];
+
+  /* Base covers the second half of data flash and beyond */
+  memset(image, 0x5A, sizeof(image));
+  parsed_file_t parsed = { .data = image, .size = sizeof(image), .base_addr = 0x08001000 };
+  image_fill_area(&parsed, data, buf);
+  assert_int_equal(buf[0], 0xFF);
+  assert_int_equal(buf[0xFFF], 0xFF);
+  assert_int_equal(buf[0x1000], 0x5A);
+  assert_int_equal(buf[0x1FFF], 0x5A);
+
+  /* No overlap: all erased */
+  parsed.base_addr = 0;
+  image_fill_area(&parsed, data, buf);
+  assert_int_equal(buf[0x1000], 0xFF);
+  assert_int_equal(buf[0x1FFF], 0xFF);
+}
+
+static void
+test_backup_delta_unit(void **state) {
+  (void)state;
+
+  ra_device_t *dev = setup_test_device();
+
+  /* Erase blocks, whole area for config */
+  assert_int_equal(backup_delta_unit(&dev->chip_layout[0]), 0x2000);
+  assert_int_equal(backup_delta_unit(&dev->chip_layout[1]), 0x40);
+  dev->chip_layout[2].koa = KOA_TYPE_CONFIG;
+  assert_int_equal(backup_delta_unit(&dev->chip_layout[2]), 0x200);
+
+  /* Blocks that do not tile the area */
+  ra_area_t odd = { .sad = 0, .ead = 0x2FFF, .eau = 0x2000, .cau = 0x04 };
+  assert_int_equal(backup_delta_unit(&odd), 0x3000);
+}
+
+static void
+test_backup_view_layout(void **state) {
+  (void)state;
+  ra_area_t areas[MAX_AREAS];
+
+  /* Backup HEX: code, data and config ranges, code in two pieces */
+  parsed_file_t parsed = { .base_addr = 0, .has_addr = 1, .nr_extents = 4 };
+  parsed.extents[0] = (format_extent_t){ 0x00000000, 0x40000, NULL };
+  parsed.extents[1] = (format_extent_t){ 0x00060000, 0x20000, NULL };
+  parsed.extents[2] = (format_extent_t){ 0x0100A100, 0x200, NULL };
+  parsed.extents[3] = (format_extent_t){ 0x08000000, 0x2000, NULL };
+  parsed.size = 0x08002000;
+
+  assert_int_equal(backup_view_layout(&parsed, areas), 3);
+  assert_int_equal(areas[0].koa, KOA_TYPE_CODE);
+  assert_int_equal(areas[0].sad, 0x00000000);
+  assert_int_equal(areas[0].ead, 0x0007FFFF);
+  assert_int_equal(areas[1].koa, KOA_TYPE_DATA);
+  assert_int_equal(areas[1].sad, 0x08000000);
+  assert_int_equal(areas[1].ead, 0x08001FFF);
+  assert_int_equal(areas[2].koa, KOA_TYPE_CONFIG);
+  assert_int_equal(areas[2].sad, 0x0100A100);
+  assert_int_equal(areas[2].ead, 0x0100A2FF);
+  assert_int_equal(areas[2].rau, 1);
+  assert_int_equal(areas[2].cau, 0);
+
+  /* Binary image: one range, code flash only */
+  parsed_file_t bin = { .base_addr = 0, .size = 0x1000 };
+  assert_int_equal(backup_view_layout(&bin, areas), 1);
+  assert_int_equal(areas[0].ead, 0x0FFF);
+
+  /* Nothing in flash */
+  parsed_file_t ram = { .base_addr = 0x20000000, .size = 0x100, .has_addr = 1 };
+  assert_int_equal(backup_view_layout(&ram, areas), 0);
+}
+
+static void
+test_ident_fingerprint(void **state) {
+  (void)state;
+  raident_entry_t e;
+  uint8_t *buf = malloc(0x30000);
+  assert_non_null(buf);
+
+  /* Two regions further apart than CRC_REGION_GAP, not aligned */
+  memset(buf, 0xFF, 0x30000);
+  memset(buf + 0x110, 0x5A, 4);
+  memset(buf + 0x24000, 0xA5, 0x10);
+  parsed_file_t img = { .data = buf, .size = 0x30000, .has_addr = 1 };
+  assert_int_equal(ident_fingerprint(&img, 0, &e), 0);
+  assert_int_equal(e.nr_ranges, 2);
+  assert_int_equal(e.ranges[0].addr, 0x100);
+  assert_int_equal(e.ranges[0].size, RAIDENT_ALIGN);
+  assert_int_equal(e.ranges[0].crc, crc32_calc(buf + 0x100, RAIDENT_ALIGN));
+  assert_int_equal(e.ranges[1].addr, 0x24000);
+  assert_int_equal(e.ranges[1].crc, crc32_calc(buf + 0x24000, RAIDENT_ALIGN));
+
+  /* Past the end of code flash nothing is fingerprinted */
+  memset(buf, 0x00, 0x300);
+  parsed_file_t tail = { .data = buf, .size = 0x300, .base_addr = 0x000FFF00, .has_addr = 1 };
+  assert_int_equal(ident_fingerprint(&tail, tail.base_addr, &e), 0);
+  assert_int_equal(e.nr_ranges, 1);
+  assert_int_equal(e.ranges[0].addr, 0x000FFF00);
+  assert_int_equal(e.ranges[0].size, 0x100);
+
+  /* Blank image */
+  memset(buf, 0xFF, 0x300);
+  assert_int_equal(ident_fingerprint(&tail, tail.base_addr, &e), 0);
+  assert_int_equal(e.nr_ranges, 0);
+  free(buf);
+}
+
+static void
+test_delta_dirty_blocks(void **state) {
+  (void)state;
+  uint8_t prev[0x140], next[0x140];
+  bool dirty[5];
+
+  memset(prev, 0xFF, sizeof(prev));
+  memcpy(next, prev, sizeof(next));
+  assert_int_equal(delta_dirty_blocks(prev, next, sizeof(prev), 0x40, dirty), 0);
+  for (int i = 0; i < 5; i++)
+    assert_false(dirty[i]);
+
+  /* First and last byte of a block, and the short last block */
+  next[0x40] = 0x00;
+  next[0xBF] = 0x00;
+  next[0x13F] = 0x00;
+  assert_int_equal(delta_dirty_blocks(prev, next, sizeof(prev), 0x40, dirty), 3);
+  assert_false(dirty[0]);
+  assert_true(dirty[1]);
+  assert_true(dirty[2]);
+  assert_false(dirty[3]);
+  assert_true(dirty[4]);
+
+  /* A size that is not a multiple of the erase unit */
+  assert_int_equal(delta_dirty_blocks(prev, next, 0x130, 0x40, dirty), 2);
+  assert_false(dirty[4]);
+}
+
+static void
+test_delta_span(void **state) {
+  (void)state;
+  ra_device_t *dev = setup_test_device();
+  format_extent_t ranges[] = {
+    { .addr = 0x00010100, .size = 0x100 },
+    { .addr = 0x00016000, .size = 0x10 },
+    { .addr = 0x08001F00, .size = 0x200 },
+  };
+  bool covered[4];
+  ra_area_t span;
+
+  /* An app past the bootloader: from its first to its last erase block */
+  assert_int_equal(delta_span(&dev->chip_layout[0], ranges, 3, &span), 2);
+  assert_int_equal(span.sad, 0x00010000);
+  assert_int_equal(span.ead, 0x00017FFF);
+  assert_int_equal(span.eau, 0x2000);
+
+  /* The gap between its segments is left alone */
+  assert_int_equal(delta_covered_blocks(&span, ranges, 3, covered), 2);
+  assert_true(covered[0]);
+  assert_false(covered[1]);
+  assert_false(covered[2]);
+  assert_true(covered[3]);
+
+  /* Running past the area end: clipped to it */
+  assert_int_equal(delta_span(&dev->chip_layout[1], ranges, 3, &span), 1);
+  assert_int_equal(span.sad, 0x08001F00);
+  assert_int_equal(span.ead, 0x08001FFF);
+
+  /* Nothing loaded into the config area */
+  assert_int_equal(delta_span(&dev->chip_layout[2], ranges, 3, &span), 0);
+}
+
 /*
  * Parameter constants tests
  */
@@ -419,6 +684,19 @@ main(void) {
     cmocka_unit_test(test_boundaries_exceed_area),
     cmocka_unit_test(test_boundaries_unknown_address),
 
+    /* CRC probe blocks */
+    cmocka_unit_test(test_crc_probe_blocks),
+
+    /* Diff bisection helpers */
+    cmocka_unit_test(test_diff_split),
+    cmocka_unit_test(test_diff_collect),
+    cmocka_unit_test(test_image_fill_area),
+    cmocka_unit_test(test_backup_delta_unit),
+    cmocka_unit_test(test_delta_dirty_blocks),
+    cmocka_unit_test(test_delta_span),
+    cmocka_unit_test(test_backup_view_layout),
+    cmocka_unit_test(test_ident_fingerprint),
+
     /* Parameter constants */
     cmocka_unit_test(test_param_constants),
   };
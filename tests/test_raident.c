@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for the firmware fingerprint database
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/compat.h"
+#include "../src/raident.h"
+
+static char temp_dir[256];
+static char db_path[300];
+
+static int
+setup(void **state) {
+  (void)state;
+  snprintf(
+      temp_dir, sizeof(temp_dir), "%s%ctest_raident.XXXXXX", get_temp_dir(), path_separator());
+  if (mkdtemp(temp_dir) == NULL)
+    return -1;
+  snprintf(db_path, sizeof(db_path), "%s%cfirmware.db", temp_dir, path_separator());
+  return 0;
+}
+
+static int
+teardown(void **state) {
+  (void)state;
+  char cmd[512];
+#ifdef _WIN32
+  snprintf(cmd, sizeof(cmd), "rmdir /s /q \"%s\"", temp_dir);
+#else
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", temp_dir);
+#endif
+  return system(cmd);
+}
+
+static void
+entry(raident_entry_t *e, const char *name, uint32_t crc) {
+  memset(e, 0, sizeof(*e));
+  snprintf(e->name, sizeof(e->name), "%s", name);
+  e->ranges[0] = (raident_range_t){ 0x00000000, 0x4000, crc };
+  e->ranges[1] = (raident_range_t){ 0x08000000, 0x100, 0xCAFEF00D };
+  e->nr_ranges = 2;
+}
+
+static void
+write_file(const char *text) {
+  FILE *f = fopen(db_path, "w");
+  assert_non_null(f);
+  fputs(text, f);
+  fclose(f);
+}
+
+static void
+test_db_missing(void **state) {
+  (void)state;
+  raident_db_t db;
+
+  assert_int_equal(raident_load(db_path, &db), 0);
+  assert_int_equal(db.count, 0);
+  raident_free(&db);
+}
+
+static void
+test_db_roundtrip(void **state) {
+  (void)state;
+  raident_db_t db = { NULL, 0 };
+  raident_entry_t e;
+
+  entry(&e, "app-1.0.0", 0x11111111);
+  assert_int_equal(raident_put(&db, &e), 0);
+  entry(&e, "app-1.1.0", 0x22222222);
+  assert_int_equal(raident_put(&db, &e), 0);
+
+  /* Same name again: replaced, not duplicated */
+  entry(&e, "app-1.0.0", 0x33333333);
+  assert_int_equal(raident_put(&db, &e), 0);
+  assert_int_equal(db.count, 2);
+
+  assert_int_equal(raident_save(db_path, &db), 0);
+  raident_free(&db);
+
+  assert_int_equal(raident_load(db_path, &db), 0);
+  assert_int_equal(db.count, 2);
+  assert_string_equal(db.entries[0].name, "app-1.0.0");
+  assert_int_equal(db.entries[0].nr_ranges, 2);
+  assert_int_equal(db.entries[0].ranges[0].crc, 0x33333333);
+  assert_int_equal(db.entries[0].ranges[1].addr, 0x08000000);
+  assert_int_equal(db.entries[0].ranges[1].size, 0x100);
+  assert_int_equal(db.entries[0].ranges[1].crc, 0xCAFEF00D);
+  assert_string_equal(db.entries[1].name, "app-1.1.0");
+  assert_int_equal(db.entries[1].ranges[0].size, 0x4000);
+  raident_free(&db);
+}
+
+static void
+test_db_malformed(void **state) {
+  (void)state;
+  raident_db_t db;
+
+  /* Hand edits: comments, blank lines and CRLF are fine */
+  write_file("# radfu firmware fingerprints\r\n\r\nboot 0:100:deadbeef\r\n");
+  assert_int_equal(raident_load(db_path, &db), 0);
+  assert_int_equal(db.count, 1);
+  assert_int_equal(db.entries[0].ranges[0].crc, 0xDEADBEEF);
+  raident_free(&db);
+
+  static const char *const bad[] = {
+    "boot\n",                       /* no range */
+    "boot 0:100\n",                 /* no CRC */
+    "boot 0:0:deadbeef\n",          /* empty range */
+    "boot ffffff00:200:deadbeef\n", /* past the address space */
+    "boot 0:100:deadbeefx\n",
+  };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    write_file(bad[i]);
+    assert_int_equal(raident_load(db_path, &db), -1);
+    assert_int_equal(db.count, 0);
+  }
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_db_missing),
+    cmocka_unit_test(test_db_roundtrip),
+    cmocka_unit_test(test_db_malformed),
+  };
+
+  return cmocka_run_group_tests(tests, setup, teardown);
+}
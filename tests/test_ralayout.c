@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for the on-disk device layout cache
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/compat.h"
+#include "../src/crc32.h"
+#include "../src/ralayout.h"
+
+static char temp_dir[256];
+
+static const ra_area_t layout[4] = {
+  { 0x00, 0x00000000, 0x0007FFFF, 0x2000, 0x80, 0x04, 0x04 },
+  { 0x10, 0x08000000, 0x08001FFF, 0x40,   0x04, 0x04, 0x04 },
+  { 0x20, 0x0100A100, 0x0100A2FF, 0,      0x04, 0x04, 0x04 },
+  { 0x00, 0,          0,          0,      0,    0,    0    },
+};
+
+/* RMB, NOA, TYP, BFV, DID, PTN */
+static void
+make_sig(uint8_t *sig, uint8_t did_seed, const char *ptn) {
+  static const uint8_t head[9] = { 0x00, 0x16, 0xE3, 0x60, 0x04, 0x02, 0x01, 0x02, 0x03 };
+
+  memcpy(sig, head, sizeof(head));
+  for (int i = 0; i < SIG_DID_LEN; i++)
+    sig[SIG_DID_OFFSET + i] = (uint8_t)(did_seed + i);
+  memset(&sig[25], ' ', 16);
+  memcpy(&sig[25], ptn, strlen(ptn));
+}
+
+/* Field by field: ra_area_t has padding after koa */
+static void
+assert_layout_equal(const ra_area_t *a, const ra_area_t *b, int noa) {
+  for (int i = 0; i < noa; i++) {
+    assert_int_equal(a[i].koa, b[i].koa);
+    assert_int_equal(a[i].sad, b[i].sad);
+    assert_int_equal(a[i].ead, b[i].ead);
+    assert_int_equal(a[i].eau, b[i].eau);
+    assert_int_equal(a[i].wau, b[i].wau);
+    assert_int_equal(a[i].rau, b[i].rau);
+    assert_int_equal(a[i].cau, b[i].cau);
+  }
+}
+
+static int
+setup(void **state) {
+  (void)state;
+  snprintf(
+      temp_dir, sizeof(temp_dir), "%s%ctest_ralayout.XXXXXX", get_temp_dir(), path_separator());
+  if (mkdtemp(temp_dir) == NULL)
+    return -1;
+  return 0;
+}
+
+static int
+teardown(void **state) {
+  (void)state;
+  char cmd[512];
+#ifdef _WIN32
+  snprintf(cmd, sizeof(cmd), "rmdir /s /q \"%s\"", temp_dir);
+#else
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", temp_dir);
+#endif
+  return system(cmd);
+}
+
+static void
+test_store_load(void **state) {
+  (void)state;
+
+  uint8_t sig[41];
+  ra_area_t areas[4];
+
+  make_sig(sig, 0x10, "R7FA4M2AD3CFP");
+  assert_int_equal(ra_layout_load(temp_dir, sig, sizeof(sig), areas, 4), -1);
+
+  assert_int_equal(ra_layout_store(temp_dir, sig, sizeof(sig), layout, 4), 0);
+  memset(areas, 0xAA, sizeof(areas));
+  assert_int_equal(ra_layout_load(temp_dir, sig, sizeof(sig), areas, 4), 0);
+  assert_layout_equal(areas, layout, 4);
+
+  /* A different area count is a different device configuration */
+  assert_int_equal(ra_layout_load(temp_dir, sig, sizeof(sig), areas, 3), -1);
+}
+
+static void
+test_key_ignores_did(void **state) {
+  (void)state;
+
+  uint8_t sig_a[41], sig_b[41], sig_c[41];
+  ra_area_t areas[4];
+
+  make_sig(sig_a, 0x20, "R7FA6M4AF3CFB");
+  make_sig(sig_b, 0x90, "R7FA6M4AF3CFB");
+  make_sig(sig_c, 0x20, "R7FA6M5BH3CFC");
+
+  assert_int_equal(ra_layout_store(temp_dir, sig_a, sizeof(sig_a), layout, 4), 0);
+
+  /* Same part, another chip */
+  assert_int_equal(ra_layout_load(temp_dir, sig_b, sizeof(sig_b), areas, 4), 0);
+  assert_layout_equal(areas, layout, 4);
+
+  /* Same DID bytes, another part */
+  assert_int_equal(ra_layout_load(temp_dir, sig_c, sizeof(sig_c), areas, 4), -1);
+
+  /* Too short to identify anything */
+  assert_int_equal(ra_layout_store(temp_dir, sig_a, 4, layout, 4), -1);
+}
+
+static void
+test_corrupt_entry(void **state) {
+  (void)state;
+
+  uint8_t sig[41];
+  uint8_t key[25];
+  ra_area_t areas[4];
+  char path[512];
+  char line[256];
+
+  make_sig(sig, 0x30, "R7FA2L1AB2DFL");
+  assert_int_equal(ra_layout_store(temp_dir, sig, sizeof(sig), layout, 4), 0);
+
+  /* Entry file is named after the CRC-32 of the signature without DID */
+  memcpy(key, sig, SIG_DID_OFFSET);
+  memcpy(key + SIG_DID_OFFSET, sig + SIG_DID_OFFSET + SIG_DID_LEN, 16);
+  snprintf(path,
+      sizeof(path),
+      "%s%clayout-%08x",
+      temp_dir,
+      path_separator(),
+      (unsigned)crc32_calc(key, sizeof(key)));
+
+  /* Keep the header lines, drop the area lines */
+  FILE *f = fopen(path, "r");
+  assert_non_null(f);
+  assert_non_null(fgets(line, sizeof(line), f));
+  assert_non_null(fgets(line, sizeof(line), f));
+  fclose(f);
+  f = fopen(path, "w");
+  assert_non_null(f);
+  fprintf(f, "# radfu layout cache\n%s", line);
+  fclose(f);
+  assert_int_equal(ra_layout_load(temp_dir, sig, sizeof(sig), areas, 4), -1);
+
+  /* Garbage area line */
+  f = fopen(path, "a");
+  assert_non_null(f);
+  fprintf(f, "area zz\n");
+  fclose(f);
+  assert_int_equal(ra_layout_load(temp_dir, sig, sizeof(sig), areas, 4), -1);
+
+  /* Stores again cleanly */
+  assert_int_equal(ra_layout_store(temp_dir, sig, sizeof(sig), layout, 4), 0);
+  assert_int_equal(ra_layout_load(temp_dir, sig, sizeof(sig), areas, 4), 0);
+  assert_layout_equal(areas, layout, 4);
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_store_load),
+    cmocka_unit_test(test_key_ignores_did),
+    cmocka_unit_test(test_corrupt_entry),
+  };
+
+  return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Non-blocking operation tests against a fake bootloader on a socketpair
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../src/raop.h"
+
+#define FLASH_SIZE 0x4000
+
+/* Bootloader end of a socketpair, flash content in mem */
+typedef struct {
+  int fd;
+  uint8_t mem[FLASH_SIZE];
+  uint8_t in[PKT_HDR_LEN + RA_OP_CHUNK + PKT_TRL_LEN];
+  size_t in_len;
+  uint32_t wr_addr; /* WRI range still expecting data */
+  uint32_t wr_end;
+  bool mute; /* never answers */
+} fake_t;
+
+static void
+fake_reply(fake_t *f, uint8_t cmd, const uint8_t *data, size_t len) {
+  uint8_t pkt[PKT_HDR_LEN + RA_OP_CHUNK + PKT_TRL_LEN];
+  ssize_t n = ra_pack_pkt(pkt, sizeof(pkt), cmd, data, len, true);
+
+  assert_true(n > 0);
+  assert_int_equal(write(f->fd, pkt, (size_t)n), n);
+}
+
+static void
+fake_status(fake_t *f, uint8_t cmd, bool ok) {
+  uint8_t sts = ok ? STATUS_OK : ERR_ADDR;
+  fake_reply(f, ok ? cmd : (uint8_t)(cmd | STATUS_ERR), &sts, 1);
+}
+
+/* Handle one complete packet from the host */
+static void
+fake_packet(fake_t *f, uint8_t cmd, const uint8_t *data, size_t len) {
+  if (f->wr_addr <= f->wr_end && cmd == WRI_CMD && f->in[0] == SOD_ACK) {
+    memcpy(&f->mem[f->wr_addr], data, len);
+    f->wr_addr += (uint32_t)len;
+    fake_status(f, WRI_CMD, true);
+    return;
+  }
+
+  assert_int_equal(len, 8);
+  uint32_t start = be_to_uint32(&data[0]);
+  uint32_t end = be_to_uint32(&data[4]);
+  bool ok = start <= end && end < FLASH_SIZE;
+
+  switch (cmd) {
+  case REA_CMD:
+    if (!ok)
+      fake_status(f, REA_CMD, false);
+    else
+      fake_reply(f, REA_CMD, &f->mem[start], end - start + 1);
+    break;
+  case WRI_CMD:
+    if (ok) {
+      f->wr_addr = start;
+      f->wr_end = end;
+    }
+    fake_status(f, WRI_CMD, ok);
+    break;
+  case ERA_CMD:
+    if (ok)
+      memset(&f->mem[start], 0xFF, end - start + 1);
+    fake_status(f, ERA_CMD, ok);
+    break;
+  case CRC_CMD: {
+    uint8_t crc[4];
+    uint32_to_be(0xC0DE0000u ^ start ^ end, crc);
+    fake_reply(f, CRC_CMD, crc, sizeof(crc));
+    break;
+  }
+  default:
+    assert_true(false); /* unexpected command */
+  }
+}
+
+/* Consume what the host sent, answering each packet */
+static void
+fake_serve(fake_t *f) {
+  ssize_t n = read(f->fd, f->in + f->in_len, sizeof(f->in) - f->in_len);
+
+  assert_true(n > 0);
+  f->in_len += (size_t)n;
+  while (f->in_len >= PKT_HDR_LEN) {
+    size_t lnx = ((size_t)f->in[1] << 8) | f->in[2];
+    size_t total = PKT_HDR_LEN + lnx - 1 + PKT_TRL_LEN;
+
+    if (f->in_len < total)
+      break;
+    if (!f->mute)
+      fake_packet(f, f->in[3], f->in + PKT_HDR_LEN, lnx - 1);
+    memmove(f->in, f->in + total, f->in_len - total);
+    f->in_len -= total;
+  }
+}
+
+static void
+pair(ra_device_t *dev, fake_t *f) {
+  int sv[2];
+
+  assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+  ra_dev_init(dev);
+  dev->fd = sv[0];
+  fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+
+  memset(f, 0, sizeof(*f));
+  f->fd = sv[1];
+  f->wr_addr = 1; /* no write in progress */
+  for (size_t i = 0; i < FLASH_SIZE; i++)
+    f->mem[i] = (uint8_t)(i * 7 + (i >> 8));
+}
+
+static void
+unpair(ra_device_t *dev, fake_t *f) {
+  close(dev->fd);
+  close(f->fd);
+  ra_cache_free(dev->cache);
+}
+
+/*
+ * Drive n operations, and their fake devices, from one poll loop
+ * Returns: the ra_op_step result of each operation in ret
+ */
+static void
+run_all(ra_op_t *ops, fake_t *fakes, int *ret, int n) {
+  struct pollfd pfd[8];
+  int live = n;
+
+  for (int i = 0; i < n; i++)
+    ret[i] = 1;
+
+  while (live > 0) {
+    int timeout = -1;
+
+    for (int i = 0; i < n; i++) {
+      int ev = ret[i] > 0 ? ra_op_events(&ops[i]) : 0;
+
+      pfd[2 * i].fd = ev != 0 ? ra_op_fd(&ops[i]) : -1;
+      pfd[2 * i].events = ev == RA_OP_WANT_WRITE ? POLLOUT : POLLIN;
+      pfd[2 * i + 1].fd = fakes[i].fd;
+      pfd[2 * i + 1].events = POLLIN;
+      if (ev != 0 && (timeout < 0 || ra_op_timeout(&ops[i]) < timeout))
+        timeout = ra_op_timeout(&ops[i]);
+    }
+
+    assert_true(poll(pfd, (nfds_t)(2 * n), timeout) >= 0);
+
+    for (int i = 0; i < n; i++) {
+      if (pfd[2 * i + 1].revents & POLLIN)
+        fake_serve(&fakes[i]);
+      if (ret[i] <= 0)
+        continue;
+
+      int ready = (pfd[2 * i].revents & POLLIN ? RA_OP_WANT_READ : 0) |
+                  (pfd[2 * i].revents & POLLOUT ? RA_OP_WANT_WRITE : 0);
+      ret[i] = ra_op_step(&ops[i], ready);
+      if (ret[i] <= 0)
+        live--;
+    }
+  }
+}
+
+static void
+test_read_write_interleaved(void **state) {
+  (void)state;
+  static fake_t fakes[2];
+  ra_device_t devs[2];
+  ra_op_t ops[2];
+  uint8_t src[1500];
+  uint8_t got[3000];
+  int ret[2];
+
+  pair(&devs[0], &fakes[0]);
+  pair(&devs[1], &fakes[1]);
+  for (size_t i = 0; i < sizeof(src); i++)
+    src[i] = (uint8_t)(0xA5 ^ i);
+
+  /* A multi-chunk read on one port while the other is written */
+  assert_int_equal(ra_op_read(&ops[0], &devs[0], 0x100, got, sizeof(got)), 0);
+  assert_int_equal(ra_op_write(&ops[1], &devs[1], 0x800, src, 1400, sizeof(src)), 0);
+  run_all(ops, fakes, ret, 2);
+
+  assert_int_equal(ret[0], 0);
+  assert_int_equal(ret[1], 0);
+  assert_memory_equal(got, &fakes[0].mem[0x100], sizeof(got));
+  assert_memory_equal(&fakes[1].mem[0x800], src, 1400);
+  for (size_t i = 1400; i < sizeof(src); i++)
+    assert_int_equal(fakes[1].mem[0x800 + i], 0);
+
+  /* Read again: served by the session cache, nothing sent */
+  memset(got, 0, sizeof(got));
+  assert_int_equal(ra_op_read(&ops[0], &devs[0], 0x100, got, sizeof(got)), 0);
+  assert_int_equal(ra_op_events(&ops[0]), 0);
+  assert_memory_equal(got, &fakes[0].mem[0x100], sizeof(got));
+
+  unpair(&devs[0], &fakes[0]);
+  unpair(&devs[1], &fakes[1]);
+}
+
+static void
+test_erase_crc_backup(void **state) {
+  (void)state;
+  static fake_t fake;
+  ra_device_t dev;
+  ra_op_t op;
+  uint8_t a[100], b[2048];
+  uint32_t crc = 0;
+  int ret;
+
+  pair(&dev, &fake);
+
+  assert_int_equal(ra_op_erase(&op, &dev, 0x1000, 0x17FF), 0);
+  run_all(&op, &fake, &ret, 1);
+  assert_int_equal(ret, 0);
+  assert_int_equal(fake.mem[0x1000], 0xFF);
+  assert_int_equal(fake.mem[0x17FF], 0xFF);
+
+  assert_int_equal(ra_op_crc(&op, &dev, 0x0000, 0x0FFF, &crc), 0);
+  run_all(&op, &fake, &ret, 1);
+  assert_int_equal(ret, 0);
+  assert_int_equal(crc, 0xC0DE0000u ^ 0x0FFF);
+
+  /* Backup: several ranges in one operation */
+  ra_op_seg_t segs[2] = {
+    { 0x0040, a, sizeof(a) },
+    { 0x1400, b, sizeof(b) },
+  };
+  assert_int_equal(ra_op_backup(&op, &dev, segs, 2), 0);
+  run_all(&op, &fake, &ret, 1);
+  assert_int_equal(ret, 0);
+  assert_memory_equal(a, &fake.mem[0x40], sizeof(a));
+  assert_memory_equal(b, &fake.mem[0x1400], sizeof(b));
+
+  unpair(&dev, &fake);
+}
+
+static void
+test_write_frames(void **state) {
+  (void)state;
+  static fake_t fake;
+  ra_device_t dev;
+  ra_op_t op;
+  uint8_t src[1500];
+  uint8_t frames[2 * (PKT_HDR_LEN + RA_OP_CHUNK + PKT_TRL_LEN) + 16];
+  uint8_t range[8];
+  size_t len = 0;
+  int ret;
+
+  pair(&dev, &fake);
+  for (size_t i = 0; i < sizeof(src); i++)
+    src[i] = (uint8_t)(0x3C ^ i);
+
+  /* A compiled image: WRI command, then its data packets back to back */
+  uint32_to_be(0x2000, &range[0]);
+  uint32_to_be(0x2000 + sizeof(src) - 1, &range[4]);
+  len += (size_t)ra_pack_pkt(frames, sizeof(frames), WRI_CMD, range, sizeof(range), false);
+  len += (size_t)ra_pack_pkt(frames + len, sizeof(frames) - len, WRI_CMD, src, RA_OP_CHUNK, true);
+  len += (size_t)ra_pack_pkt(frames + len,
+      sizeof(frames) - len,
+      WRI_CMD,
+      src + RA_OP_CHUNK,
+      sizeof(src) - RA_OP_CHUNK,
+      true);
+
+  assert_int_equal(
+      ra_op_write_frames(&op, &dev, 0x2000, 0x2000 + sizeof(src) - 1, frames, len), 0);
+  run_all(&op, &fake, &ret, 1);
+  assert_int_equal(ret, 0);
+  assert_int_equal(op.off, sizeof(src));
+  assert_memory_equal(&fake.mem[0x2000], src, sizeof(src));
+
+  /* A packet cut short is refused before anything is sent for it */
+  assert_int_equal(ra_op_write_frames(&op, &dev, 0x2000, 0x2000 + sizeof(src) - 1, frames, 10), -1);
+
+  unpair(&dev, &fake);
+}
+
+static void
+test_error_and_deadline(void **state) {
+  (void)state;
+  static fake_t fake;
+  ra_device_t dev;
+  ra_op_t op;
+  uint8_t buf[64];
+  int ret;
+
+  pair(&dev, &fake);
+
+  /* MCU error instead of read data */
+  assert_int_equal(ra_op_read(&op, &dev, FLASH_SIZE, buf, sizeof(buf)), 0);
+  run_all(&op, &fake, &ret, 1);
+  assert_int_equal(ret, -1);
+  assert_int_equal(ra_op_events(&op), 0);
+
+  /* The line is left clean for the next command */
+  assert_int_equal(ra_op_read(&op, &dev, 0, buf, sizeof(buf)), 0);
+  run_all(&op, &fake, &ret, 1);
+  assert_int_equal(ret, 0);
+  assert_memory_equal(buf, fake.mem, sizeof(buf));
+
+  /* No answer: the operation deadline ends it well before the reply timeout */
+  fake.mute = true;
+  progress_time_t t0;
+  progress_time_now(&t0);
+  assert_int_equal(ra_op_crc(&op, &dev, 0x2000, 0x2FFF, &(uint32_t){ 0 }), 0);
+  ra_op_set_deadline(&op, 50);
+  errno = 0;
+  run_all(&op, &fake, &ret, 1);
+  assert_int_equal(ret, -1);
+  assert_int_equal(errno, ETIMEDOUT);
+  assert_true(progress_time_since(&t0) < 1.0);
+
+  /* The blocking driver stops on the deadline too */
+  assert_int_equal(ra_op_read(&op, &dev, 0x3000, buf, sizeof(buf)), 0);
+  ra_op_set_deadline(&op, 20);
+  assert_int_equal(ra_op_run(&op), -1);
+
+  unpair(&dev, &fake);
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_read_write_interleaved),
+    cmocka_unit_test(test_erase_crc_backup),
+    cmocka_unit_test(test_write_frames),
+    cmocka_unit_test(test_error_and_deadline),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -16,6 +16,8 @@
 
 #include "../src/rapacker.h"
 
+#define CHUNK_TEST_LEN 256
+
 /*
  * Checksum calculation tests
  */
@@ -435,6 +437,346 @@ test_unpack_length_mismatch(void **state) {
   assert_int_equal(errno, EINVAL);
 }
 
+/*
+ * Zero-copy pack/unpack tests
+ */
+
+static void
+test_pack_inplace(void **state) {
+  (void)state;
+
+  uint8_t ref[MAX_PKT_LEN];
+  uint8_t buf[MAX_PKT_LEN];
+  uint8_t data[300];
+  ssize_t ref_len, pkt_len;
+
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = (uint8_t)(i * 7);
+
+  ref_len = ra_pack_pkt(ref, sizeof(ref), WRI_CMD, data, sizeof(data), true);
+
+  /* Payload placed first, framing added around it */
+  memcpy(&buf[PKT_HDR_LEN], data, sizeof(data));
+  pkt_len = ra_pack_pkt_inplace(buf, sizeof(buf), WRI_CMD, sizeof(data), true);
+  assert_int_equal(pkt_len, ref_len);
+  assert_memory_equal(buf, ref, (size_t)ref_len);
+
+  /* Too small for payload + framing */
+  pkt_len = ra_pack_pkt_inplace(buf, sizeof(data) + 5, WRI_CMD, sizeof(data), true);
+  assert_int_equal(pkt_len, -1);
+  assert_int_equal(errno, ENOBUFS);
+}
+
+static void
+test_pack_hdr_trl(void **state) {
+  (void)state;
+
+  uint8_t ref[MAX_PKT_LEN];
+  uint8_t hdr[PKT_HDR_LEN];
+  uint8_t trl[PKT_TRL_LEN];
+  uint8_t data[MAX_DATA_LEN];
+  ssize_t ref_len;
+
+  memset(data, 0x5A, sizeof(data));
+  ref_len = ra_pack_pkt(ref, sizeof(ref), WRI_CMD, data, sizeof(data), true);
+
+  assert_int_equal(ra_pack_hdr_trl(hdr, trl, WRI_CMD, data, sizeof(data), true), 0);
+  assert_memory_equal(hdr, ref, PKT_HDR_LEN);
+  assert_memory_equal(trl, &ref[ref_len - PKT_TRL_LEN], PKT_TRL_LEN);
+
+  assert_int_equal(ra_pack_hdr_trl(hdr, trl, WRI_CMD, data, MAX_DATA_LEN + 1, true), -1);
+  assert_int_equal(errno, EINVAL);
+}
+
+static void
+test_unpack_view(void **state) {
+  (void)state;
+
+  uint8_t buf[MAX_PKT_LEN];
+  uint8_t data[] = { 0x10, 0x20, 0x30, 0x40 };
+  const uint8_t *view = NULL;
+  size_t view_len = 0;
+  uint8_t cmd = 0;
+
+  ssize_t pkt_len = ra_pack_pkt(buf, sizeof(buf), REA_CMD, data, sizeof(data), true);
+  ssize_t ret = ra_unpack_pkt_view(buf, (size_t)pkt_len, &view, &view_len, &cmd);
+  assert_int_equal(ret, sizeof(data));
+  assert_int_equal(cmd, REA_CMD);
+  assert_int_equal(view_len, sizeof(data));
+  /* Payload is referenced in place, not copied */
+  assert_true(view == &buf[PKT_HDR_LEN]);
+
+  /* MCU error still exposes the error payload */
+  uint8_t err[] = { ERR_ADDR };
+  pkt_len = ra_pack_pkt(buf, sizeof(buf), STATUS_ERR | REA_CMD, err, 1, true);
+  view = NULL;
+  ret = ra_unpack_pkt_view(buf, (size_t)pkt_len, &view, &view_len, &cmd);
+  assert_int_equal(ret, -1);
+  assert_int_equal(errno, EIO);
+  assert_non_null(view);
+  assert_int_equal(view[0], ERR_ADDR);
+
+  /* Corrupted checksum */
+  pkt_len = ra_pack_pkt(buf, sizeof(buf), REA_CMD, data, sizeof(data), true);
+  buf[PKT_HDR_LEN + sizeof(data)] ^= 0xFF;
+  ret = ra_unpack_pkt_view(buf, (size_t)pkt_len, &view, &view_len, &cmd);
+  assert_int_equal(ret, -1);
+  assert_int_equal(errno, EBADMSG);
+}
+
+static void
+test_unpack_split(void **state) {
+  (void)state;
+
+  uint8_t buf[MAX_PKT_LEN];
+  uint8_t data[CHUNK_TEST_LEN];
+  uint8_t cmd = 0;
+
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = (uint8_t)i;
+
+  ssize_t pkt_len = ra_pack_pkt(buf, sizeof(buf), REA_CMD, data, sizeof(data), true);
+  const uint8_t *hdr = buf;
+  const uint8_t *payload = &buf[PKT_HDR_LEN];
+  const uint8_t *trl = &buf[pkt_len - PKT_TRL_LEN];
+
+  assert_int_equal(ra_unpack_pkt_split(hdr, payload, sizeof(data), trl, &cmd), sizeof(data));
+  assert_int_equal(cmd, REA_CMD);
+
+  /* Length field must match the expected payload size */
+  assert_int_equal(ra_unpack_pkt_split(hdr, payload, sizeof(data) - 1, trl, &cmd), -1);
+  assert_int_equal(errno, EPROTO);
+
+  /* Payload corruption is caught by the checksum */
+  uint8_t bad[CHUNK_TEST_LEN];
+  memcpy(bad, payload, sizeof(bad));
+  bad[17] ^= 0x01;
+  assert_int_equal(ra_unpack_pkt_split(hdr, bad, sizeof(bad), trl, &cmd), -1);
+  assert_int_equal(errno, EBADMSG);
+
+  /* MCU error header */
+  uint8_t err_hdr[PKT_HDR_LEN] = { SOD_ACK, 0x00, 0x02, STATUS_ERR | REA_CMD };
+  assert_int_equal(ra_unpack_pkt_split(err_hdr, payload, sizeof(data), trl, &cmd), -1);
+  assert_int_equal(errno, EIO);
+  assert_int_equal(cmd, STATUS_ERR | REA_CMD);
+}
+
+/*
+ * Incremental decoder tests
+ */
+
+/* Feed everything, collecting frames; returns number of frames found */
+static int
+decode_all(ra_decoder_t *dec,
+    const uint8_t *in,
+    size_t len,
+    ra_dec_status_t *status,
+    uint8_t (*raw)[MAX_PKT_LEN],
+    size_t *raw_len,
+    int max) {
+  int count = 0;
+  size_t off = 0;
+
+  do {
+    size_t used;
+    ra_frame_t frame;
+    ra_dec_status_t st = ra_decoder_feed(dec, in + off, len - off, &used, &frame);
+    off += used;
+    if (st == RA_DEC_NEED_MORE)
+      continue;
+    if (count < max) {
+      status[count] = st;
+      memcpy(raw[count], frame.raw, frame.raw_len);
+      raw_len[count] = frame.raw_len;
+    }
+    count++;
+  } while (off < len);
+
+  return count;
+}
+
+static void
+test_decoder_single(void **state) {
+  (void)state;
+
+  uint8_t pkt[MAX_PKT_LEN];
+  uint8_t data[] = { 0xDE, 0xAD, 0xBE, 0xEF };
+  ra_decoder_t dec;
+  ra_frame_t frame;
+  size_t used;
+
+  ssize_t pkt_len = ra_pack_pkt(pkt, sizeof(pkt), CRC_CMD, data, sizeof(data), true);
+  ra_decoder_init(&dec, SOD_ACK);
+  assert_int_equal(ra_decoder_need(&dec), 3);
+
+  ra_dec_status_t st = ra_decoder_feed(&dec, pkt, (size_t)pkt_len, &used, &frame);
+  assert_int_equal(st, RA_DEC_FRAME);
+  assert_int_equal(used, (size_t)pkt_len);
+  assert_int_equal(frame.cmd, CRC_CMD);
+  assert_int_equal(frame.len, sizeof(data));
+  assert_memory_equal(frame.data, data, sizeof(data));
+  assert_int_equal(frame.raw_len, (size_t)pkt_len);
+  assert_int_equal(dec.resync, 0);
+}
+
+static void
+test_decoder_every_boundary(void **state) {
+  (void)state;
+
+  uint8_t pkt[MAX_PKT_LEN];
+  uint8_t data[40];
+  ra_decoder_t dec;
+  ra_frame_t frame;
+  size_t used;
+
+  for (size_t i = 0; i < sizeof(data); i++)
+    data[i] = (uint8_t)(0xA0 + i);
+  size_t pkt_len = (size_t)ra_pack_pkt(pkt, sizeof(pkt), REA_CMD, data, sizeof(data), true);
+
+  /* Two slices, split at every possible byte */
+  for (size_t cut = 0; cut <= pkt_len; cut++) {
+    ra_decoder_init(&dec, SOD_ACK);
+
+    ra_dec_status_t st = ra_decoder_feed(&dec, pkt, cut, &used, &frame);
+    assert_int_equal(used, cut);
+    if (cut < pkt_len) {
+      assert_int_equal(st, RA_DEC_NEED_MORE);
+      assert_true(ra_decoder_need(&dec) > 0);
+      assert_true(ra_decoder_need(&dec) <= pkt_len - cut);
+      st = ra_decoder_feed(&dec, pkt + cut, pkt_len - cut, &used, &frame);
+      assert_int_equal(used, pkt_len - cut);
+    }
+    assert_int_equal(st, RA_DEC_FRAME);
+    assert_int_equal(frame.len, sizeof(data));
+    assert_memory_equal(frame.data, data, sizeof(data));
+  }
+
+  /* One byte at a time, need() never asks past the frame end */
+  ra_decoder_init(&dec, SOD_ACK);
+  for (size_t i = 0; i < pkt_len; i++) {
+    assert_true(ra_decoder_need(&dec) <= pkt_len - i);
+    ra_dec_status_t st = ra_decoder_feed(&dec, &pkt[i], 1, &used, &frame);
+    assert_int_equal(used, 1);
+    assert_int_equal(st, i + 1 < pkt_len ? RA_DEC_NEED_MORE : RA_DEC_FRAME);
+  }
+  assert_memory_equal(frame.raw, pkt, pkt_len);
+}
+
+static void
+test_decoder_back_to_back(void **state) {
+  (void)state;
+
+  uint8_t stream[3 * MAX_PKT_LEN];
+  uint8_t raw[4][MAX_PKT_LEN];
+  size_t raw_len[4];
+  ra_dec_status_t status[4];
+  uint8_t d1[] = { 0x00 };
+  uint8_t d2[] = { 0x11, 0x22, 0x33, 0x44 };
+  uint8_t d3[] = { ERR_ADDR };
+  ra_decoder_t dec;
+  size_t len = 0;
+
+  size_t l1 = (size_t)ra_pack_pkt(stream, sizeof(stream), DLM_CMD, d1, sizeof(d1), true);
+  len += l1;
+  size_t l2 = (size_t)ra_pack_pkt(stream + len, sizeof(stream) - len, CRC_CMD, d2, 4, true);
+  len += l2;
+  size_t l3 = (size_t)ra_pack_pkt(
+      stream + len, sizeof(stream) - len, STATUS_ERR | WRI_CMD, d3, sizeof(d3), true);
+  len += l3;
+
+  /* All frames in one read */
+  ra_decoder_init(&dec, SOD_ACK);
+  assert_int_equal(decode_all(&dec, stream, len, status, raw, raw_len, 4), 3);
+  assert_int_equal(status[0], RA_DEC_FRAME);
+  assert_int_equal(status[1], RA_DEC_FRAME);
+  assert_int_equal(status[2], RA_DEC_MCU_ERROR);
+  assert_int_equal(raw_len[0], l1);
+  assert_int_equal(raw_len[1], l2);
+  assert_int_equal(raw_len[2], l3);
+  assert_memory_equal(raw[1], stream + l1, l2);
+
+  /* First feed stops right after the first frame */
+  ra_frame_t frame;
+  size_t used;
+  ra_decoder_init(&dec, SOD_ACK);
+  assert_int_equal(ra_decoder_feed(&dec, stream, len, &used, &frame), RA_DEC_FRAME);
+  assert_int_equal(used, l1);
+}
+
+static void
+test_decoder_resync(void **state) {
+  (void)state;
+
+  uint8_t stream[2 * MAX_PKT_LEN];
+  uint8_t raw[4][MAX_PKT_LEN];
+  size_t raw_len[4];
+  ra_dec_status_t status[4];
+  uint8_t data[] = { 0x01, 0x02, 0x03 };
+  ra_decoder_t dec;
+  size_t len = 0;
+
+  /* Leading noise, including a stray SOD */
+  stream[len++] = 0x00;
+  stream[len++] = 0x55;
+  stream[len++] = SOD_ACK;
+  stream[len++] = 0xFF;
+  size_t pkt_len = (size_t)ra_pack_pkt(stream + len, MAX_PKT_LEN, PRM_CMD, data, 3, true);
+  len += pkt_len;
+
+  ra_decoder_init(&dec, SOD_ACK);
+  assert_int_equal(decode_all(&dec, stream, len, status, raw, raw_len, 4), 1);
+  assert_int_equal(status[0], RA_DEC_FRAME);
+  assert_memory_equal(raw[0], stream + 4, pkt_len);
+  assert_int_equal(dec.resync, 4);
+
+  /* Frame with bad ETX is dropped, the following frame is recovered */
+  len = (size_t)ra_pack_pkt(stream, MAX_PKT_LEN, PRM_CMD, data, 3, true);
+  stream[len - 1] = 0x00;
+  pkt_len = (size_t)ra_pack_pkt(stream + len, MAX_PKT_LEN, BND_CMD, data, 3, true);
+  len += pkt_len;
+
+  for (size_t cut = 0; cut <= len; cut++) {
+    ra_decoder_init(&dec, SOD_ACK);
+    int found = decode_all(&dec, stream, cut, status, raw, raw_len, 4);
+    found += decode_all(&dec,
+        stream + cut,
+        len - cut,
+        status + found,
+        raw + found,
+        raw_len + found,
+        4 - found);
+    assert_int_equal(found, 1);
+    assert_int_equal(status[0], RA_DEC_FRAME);
+    assert_int_equal(raw[0][3], BND_CMD);
+  }
+}
+
+static void
+test_decoder_bad_sum(void **state) {
+  (void)state;
+
+  uint8_t pkt[MAX_PKT_LEN];
+  uint8_t data[] = { 0x42 };
+  ra_decoder_t dec;
+  ra_frame_t frame;
+  size_t used;
+
+  ssize_t pkt_len = ra_pack_pkt(pkt, sizeof(pkt), DLM_CMD, data, 1, true);
+  pkt[pkt_len - 2] ^= 0x5A;
+
+  ra_decoder_init(&dec, SOD_ACK);
+  assert_int_equal(ra_decoder_feed(&dec, pkt, (size_t)pkt_len, &used, &frame), RA_DEC_BAD_SUM);
+  assert_int_equal(frame.cmd, DLM_CMD);
+  assert_int_equal(frame.len, 1);
+
+  /* Oversized length field is treated as noise */
+  uint8_t bogus[] = { SOD_ACK, 0xFF, 0xFF, 0x00 };
+  ra_decoder_init(&dec, SOD_ACK);
+  assert_int_equal(ra_decoder_feed(&dec, bogus, sizeof(bogus), &used, &frame), RA_DEC_NEED_MORE);
+  assert_int_equal(used, sizeof(bogus));
+  assert_int_equal(dec.len, 0);
+}
+
 /*
  * Command constant tests
  */
@@ -514,6 +856,19 @@ main(void) {
     cmocka_unit_test(test_unpack_zero_pkt_len),
     cmocka_unit_test(test_unpack_length_mismatch),
 
+    /* Zero-copy pack/unpack */
+    cmocka_unit_test(test_pack_inplace),
+    cmocka_unit_test(test_pack_hdr_trl),
+    cmocka_unit_test(test_unpack_view),
+    cmocka_unit_test(test_unpack_split),
+
+    /* Incremental decoder */
+    cmocka_unit_test(test_decoder_single),
+    cmocka_unit_test(test_decoder_every_boundary),
+    cmocka_unit_test(test_decoder_back_to_back),
+    cmocka_unit_test(test_decoder_resync),
+    cmocka_unit_test(test_decoder_bad_sum),
+
     /* Constant verification */
     cmocka_unit_test(test_command_constants),
     cmocka_unit_test(test_protocol_constants),
@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for the content-addressed backup store
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../src/compat.h"
+#include "../src/rastore.h"
+
+#define CODE_SIZE 0x8000
+#define DATA_ADDR 0x08000000
+#define DATA_SIZE 0x1800 /* last block shorter than RASTORE_BLOCK_SIZE */
+
+static char temp_dir[256];
+static char store[300];
+static uint8_t code[CODE_SIZE];
+static uint8_t data_a[DATA_SIZE];
+static uint8_t data_b[DATA_SIZE];
+
+static const ra_area_t areas[] = {
+  { 0x00, 0x00000000, CODE_SIZE - 1, 0x2000, 0x80, 0x01, 0x01 },
+  { 0x01, DATA_ADDR, DATA_ADDR + DATA_SIZE - 1, 0x40, 0x04, 0x01, 0x01 },
+};
+
+/* Signature responses of two boards, differing in their DID only */
+static uint8_t sig_a[41] = { 0x00, 0x3D, 0x09, 0x00, 0x03, 0x02, 0x01, 0x02, 0x03, 'T', 'T',
+  0x5A, 0x11, 0x00, 0x00, 'L', 'O', 'T', '0', '0', '1', 0x07, 0x10, 0x20, 0x00, 'R', '7', 'F',
+  'A', '4', 'M', '2', 'A', 'D', '3', 'C', 'F', 'P', ' ', ' ', ' ' };
+static uint8_t sig_b[41];
+
+#define DID_A "54545a1100004c4f5430303107102000"
+
+static int
+setup(void **state) {
+  (void)state;
+  snprintf(
+      temp_dir, sizeof(temp_dir), "%s%ctest_rastore.XXXXXX", get_temp_dir(), path_separator());
+  if (mkdtemp(temp_dir) == NULL)
+    return -1;
+  snprintf(store, sizeof(store), "%s%cstore", temp_dir, path_separator());
+
+  /* Same firmware on both boards, erased tail */
+  memset(code, 0xFF, sizeof(code));
+  uint32_t x = 0x12345678;
+  for (int i = 0; i < 0x3000; i++) {
+    x = x * 1103515245 + 12345;
+    code[i] = i < 0x1000 ? (uint8_t)(x >> 16) : (uint8_t)"firmware 1.2.3 "[i % 15];
+  }
+
+  /* Per board calibration in data flash */
+  memset(data_a, 0xFF, sizeof(data_a));
+  memset(data_b, 0xFF, sizeof(data_b));
+  memcpy(data_a + 0x1010, "CAL\x01\x02\x03", 6);
+  memcpy(data_b + 0x1010, "CAL\x04\x05\x06", 6);
+
+  memcpy(sig_b, sig_a, sizeof(sig_b));
+  sig_b[24] = 0x01;
+  return 0;
+}
+
+static int
+teardown(void **state) {
+  (void)state;
+  char cmd[512];
+#ifdef _WIN32
+  snprintf(cmd, sizeof(cmd), "rmdir /s /q \"%s\"", temp_dir);
+#else
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", temp_dir);
+#endif
+  return system(cmd);
+}
+
+static void
+put(const uint8_t *sig, const uint8_t *data, rastore_stats_t *stats) {
+  const uint8_t *bufs[] = { code, data };
+  assert_int_equal(rastore_put(store, sig, 41, areas, bufs, 2, stats), 0);
+}
+
+static void
+test_did_hex(void **state) {
+  (void)state;
+  char hex[RASTORE_DID_HEX_LEN + 1];
+
+  assert_int_equal(rastore_did_hex(sig_a, sizeof(sig_a), hex), 0);
+  assert_string_equal(hex, DID_A);
+  assert_int_equal(rastore_did_hex(sig_a, 24, hex), -1);
+}
+
+static void
+test_store_dedup(void **state) {
+  (void)state;
+  rastore_stats_t stats;
+
+  /* Code: 3 data blocks, 5 erased; data: 1 erased, 1 calibration block */
+  put(sig_a, data_a, &stats);
+  assert_int_equal(stats.blocks, 10);
+  assert_int_equal(stats.blank, 6);
+  assert_int_equal(stats.added, 4);
+  assert_true(stats.added_len > 0x1000 && stats.added_len < 0x2000 + 0x200);
+
+  /* Same board again: nothing new */
+  put(sig_a, data_a, &stats);
+  assert_int_equal(stats.added, 0);
+  assert_int_equal(stats.added_len, 0);
+
+  /* Another board only adds its calibration block */
+  put(sig_b, data_b, &stats);
+  assert_int_equal(stats.blocks, 10);
+  assert_int_equal(stats.added, 1);
+  assert_true(stats.added_len < 0x100);
+
+  /* Short signature: no DID to name the manifest */
+  const uint8_t *bufs[] = { code, data_a };
+  assert_int_equal(rastore_put(store, sig_a, 20, areas, bufs, 2, &stats), -1);
+}
+
+static void
+check_device(const char *did, const uint8_t *sig, const uint8_t *data) {
+  rastore_manifest_t m;
+  uint8_t block[RASTORE_BLOCK_SIZE];
+
+  assert_int_equal(rastore_load(store, did, &m), 0);
+  assert_int_equal(m.sig_len, 41);
+  assert_memory_equal(m.sig, sig, 41);
+  assert_int_equal(m.nr_areas, 2);
+
+  const uint8_t *src[] = { code, data };
+  for (uint32_t n = 0; n < m.nr_areas; n++) {
+    const rastore_area_t *a = &m.areas[n];
+    assert_int_equal(a->area.koa, areas[n].koa);
+    assert_int_equal(a->area.sad, areas[n].sad);
+    assert_int_equal(a->area.ead, areas[n].ead);
+    assert_int_equal(a->area.eau, areas[n].eau);
+    for (uint32_t i = 0; i < a->nr_blocks; i++) {
+      const uint8_t *want = src[n] + (size_t)i * RASTORE_BLOCK_SIZE;
+      uint32_t len = rastore_block_len(a, i);
+      if (a->blocks[i].blank)
+        continue;
+      assert_int_equal(rastore_block(store, a->blocks[i].hash, block, len), 0);
+      assert_memory_equal(block, want, len);
+    }
+  }
+  assert_true(m.areas[1].blocks[0].blank);
+  assert_false(m.areas[1].blocks[1].blank);
+  assert_int_equal(rastore_block_len(&m.areas[1], 1), 0x800);
+  rastore_free(&m);
+}
+
+static void
+test_store_load(void **state) {
+  (void)state;
+  char did_b[RASTORE_DID_HEX_LEN + 1];
+
+  assert_int_equal(rastore_did_hex(sig_b, sizeof(sig_b), did_b), 0);
+  check_device(DID_A, sig_a, data_a);
+  check_device(did_b, sig_b, data_b);
+
+  rastore_manifest_t m;
+  assert_int_equal(rastore_load(store, "00000000000000000000000000000000", &m), -1);
+}
+
+/* Path of the block file holding the calibration record of board A */
+static void
+calibration_path(char *path, size_t len) {
+  rastore_manifest_t m;
+  char hex[2 * SHA256_LEN + 1];
+
+  assert_int_equal(rastore_load(store, DID_A, &m), 0);
+  sha256_hex(m.areas[1].blocks[1].hash, hex);
+  rastore_free(&m);
+  snprintf(path,
+      len,
+      "%s%cblocks%c%.2s%c%s",
+      store,
+      path_separator(),
+      path_separator(),
+      hex,
+      path_separator(),
+      hex + 2);
+}
+
+static void
+test_store_corrupted(void **state) {
+  (void)state;
+  char path[512];
+  uint8_t buf[RASTORE_BLOCK_SIZE];
+  uint8_t block[RASTORE_BLOCK_SIZE];
+  rastore_manifest_t m;
+
+  calibration_path(path, sizeof(path));
+  FILE *f = fopen(path, "rb");
+  assert_non_null(f);
+  size_t len = fread(buf, 1, sizeof(buf), f);
+  fclose(f);
+
+  /* Damaged: the hash check catches it, whether it still decodes or not */
+  buf[len / 2] ^= 0x01;
+  f = fopen(path, "wb");
+  assert_non_null(f);
+  fwrite(buf, 1, len, f);
+  fclose(f);
+
+  assert_int_equal(rastore_load(store, DID_A, &m), 0);
+  assert_int_equal(rastore_block(store, m.areas[1].blocks[1].hash, block, 0x800), -1);
+
+  /* Missing */
+  assert_int_equal(remove(path), 0);
+  assert_int_equal(rastore_block(store, m.areas[1].blocks[1].hash, block, 0x800), -1);
+  rastore_free(&m);
+
+  /* A backup stores it again */
+  rastore_stats_t stats;
+  put(sig_a, data_a, &stats);
+  assert_int_equal(stats.added, 1);
+  check_device(DID_A, sig_a, data_a);
+}
+
+/* Move a block out of the gc grace period */
+static void
+age_block(const char *path) {
+  struct utimbuf t;
+
+  t.actime = t.modtime = time(NULL) - RASTORE_GC_GRACE - 60;
+  assert_int_equal(utime(path, &t), 0);
+}
+
+static void
+test_store_gc(void **state) {
+  (void)state;
+  char did_b[RASTORE_DID_HEX_LEN + 1];
+  char path[512];
+  uint32_t removed;
+  uint64_t freed;
+  struct stat st;
+
+  /* Everything is referenced */
+  assert_int_equal(rastore_gc(store, &removed, &freed), 0);
+  assert_int_equal(removed, 0);
+  assert_int_equal(freed, 0);
+
+  /* Board A recalibrated: its old calibration block is no longer used */
+  calibration_path(path, sizeof(path));
+  uint8_t calibration = data_a[0x1013];
+  data_a[0x1013] = 0x07;
+  rastore_stats_t stats;
+  put(sig_a, data_a, &stats);
+  assert_int_equal(stats.added, 1);
+
+  /* Recently stored: a backup in progress may still reference it */
+  assert_int_equal(rastore_gc(store, &removed, &freed), 0);
+  assert_int_equal(removed, 0);
+  assert_int_equal(stat(path, &st), 0);
+
+  /* A backup reusing a block renews it */
+  age_block(path);
+  data_a[0x1013] = calibration;
+  put(sig_a, data_a, &stats);
+  assert_int_equal(stats.added, 0);
+  assert_int_equal(stat(path, &st), 0);
+  assert_true(difftime(time(NULL), st.st_mtime) < RASTORE_GC_GRACE);
+
+  data_a[0x1013] = 0x07;
+  put(sig_a, data_a, &stats);
+  age_block(path);
+  assert_int_equal(rastore_gc(store, &removed, &freed), 0);
+  assert_int_equal(removed, 1);
+  assert_true(freed > 0);
+  assert_int_equal(stat(path, &st), -1);
+
+  assert_int_equal(rastore_did_hex(sig_b, sizeof(sig_b), did_b), 0);
+  check_device(DID_A, sig_a, data_a);
+  check_device(did_b, sig_b, data_b);
+
+  /* An unreadable manifest stops gc before anything is removed */
+  snprintf(path,
+      sizeof(path),
+      "%s%cdevices%c%s.txt",
+      store,
+      path_separator(),
+      path_separator(),
+      did_b);
+  FILE *f = fopen(path, "w");
+  assert_non_null(f);
+  fputs("garbage\n", f);
+  fclose(f);
+  assert_int_equal(rastore_gc(store, &removed, &freed), -1);
+  check_device(DID_A, sig_a, data_a);
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_did_hex),
+    cmocka_unit_test(test_store_dedup),
+    cmocka_unit_test(test_store_load),
+    cmocka_unit_test(test_store_corrupted),
+    cmocka_unit_test(test_store_gc),
+  };
+
+  return cmocka_run_group_tests(tests, setup, teardown);
+}
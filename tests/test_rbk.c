@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for the native backup container and its block compressor
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../src/compat.h"
+#include "../src/crc32.h"
+#include "../src/lz.h"
+#include "../src/rbk.h"
+
+#define CODE_SIZE 0x8000
+#define DATA_ADDR 0x00010000
+#define DATA_SIZE 0x1800 /* last block shorter than RBK_BLOCK_SIZE */
+
+static char temp_dir[256];
+static uint8_t code[CODE_SIZE];
+static uint8_t data[DATA_SIZE];
+
+static const ra_area_t areas[] = {
+  { 0x00, 0x00000000, CODE_SIZE - 1, 0x2000, 0x80, 0x01, 0x01 },
+  { 0x01, DATA_ADDR, DATA_ADDR + DATA_SIZE - 1, 0x40, 0x04, 0x01, 0x01 },
+};
+
+static const uint8_t sig[41] = { 0x00, 0x3D, 0x09, 0x00, 0x03, 0x02, 0x01, 0x02, 0x03,
+  'T', 'T', 0x5A, 0x11, 0x00, 0x00, 'L', 'O', 'T', '0', '0', '1', 0x07, 0x10, 0x20, 0x00,
+  'R', '7', 'F', 'A', '4', 'M', '2', 'A', 'D', '3', 'C', 'F', 'P', ' ', ' ', ' ' };
+
+static const char *
+temp_path(const char *name) {
+  static char path[512];
+  snprintf(path, sizeof(path), "%s%c%s", temp_dir, path_separator(), name);
+  return path;
+}
+
+static int
+setup(void **state) {
+  (void)state;
+  snprintf(temp_dir, sizeof(temp_dir), "%s%ctest_rbk.XXXXXX", get_temp_dir(), path_separator());
+  if (mkdtemp(temp_dir) == NULL)
+    return -1;
+
+  /* Code: a vector table, repetitive text, noise, then erased flash */
+  memset(code, 0xFF, sizeof(code));
+  for (int i = 0; i < 0x400; i++)
+    code[i] = (uint8_t)(i & 3 ? 0 : i >> 2);
+  for (int i = 0x400; i < 0x1800; i++)
+    code[i] = (uint8_t)"firmware build 1.2.3 "[i % 21];
+  uint32_t x = 0x12345678;
+  for (int i = 0x1800; i < 0x2800; i++) {
+    x = x * 1103515245 + 12345;
+    code[i] = (uint8_t)(x >> 16);
+  }
+
+  /* Data: a calibration record in the last, short block */
+  memset(data, 0xFF, sizeof(data));
+  memcpy(data + 0x1010, "CAL\x01\x02\x03", 6);
+  return 0;
+}
+
+static int
+teardown(void **state) {
+  (void)state;
+  char cmd[512];
+#ifdef _WIN32
+  snprintf(cmd, sizeof(cmd), "rmdir /s /q \"%s\"", temp_dir);
+#else
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", temp_dir);
+#endif
+  return system(cmd);
+}
+
+static void
+lz_roundtrip(const uint8_t *in, size_t len) {
+  size_t cap = len + len / 8 + 16;
+  uint8_t *packed = malloc(cap);
+  uint8_t *out = malloc(len + 1);
+  assert_non_null(packed);
+  assert_non_null(out);
+
+  size_t n = lz_compress(in, len, packed, cap);
+  assert_true(n > 0);
+  assert_int_equal(lz_decompress(packed, n, out, len), 0);
+  assert_memory_equal(out, in, len);
+
+  /* Exact length only */
+  assert_int_equal(lz_decompress(packed, n, out, len + 1), -1);
+
+  free(packed);
+  free(out);
+}
+
+static void
+test_lz_roundtrip(void **state) {
+  (void)state;
+  static uint8_t buf[0x10000];
+
+  lz_roundtrip(code, 0);
+  lz_roundtrip(code, 3);
+  lz_roundtrip(code, sizeof(code));
+
+  /* Long runs need extended lengths, long literals too */
+  memset(buf, 0x00, sizeof(buf));
+  lz_roundtrip(buf, sizeof(buf));
+  lz_roundtrip(code + 0x1800, 0x1000);
+
+  /* Matches at the 64KB window limit */
+  memcpy(buf, code + 0x1800, 0x800);
+  memcpy(buf + sizeof(buf) - 0x800, code + 0x1800, 0x800);
+  lz_roundtrip(buf, sizeof(buf));
+
+  size_t n = lz_compress(buf, sizeof(buf), buf + 0, 0);
+  assert_int_equal(n, 0);
+}
+
+static void
+test_lz_malformed(void **state) {
+  (void)state;
+  uint8_t packed[RBK_BLOCK_SIZE * 2];
+  uint8_t out[RBK_BLOCK_SIZE];
+
+  /* Noise does not fit in less than its own size */
+  assert_int_equal(lz_compress(code + 0x1800, 0x1000, packed, 0x1000 - 1), 0);
+
+  size_t n = lz_compress(code + 0x400, 0x1000, packed, sizeof(packed));
+  assert_true(n > 0 && n < 0x200);
+  assert_int_equal(lz_decompress(packed, n, out, 0x1000), 0);
+
+  /* Truncated */
+  for (size_t len = 0; len < n; len++)
+    assert_int_equal(lz_decompress(packed, len, out, 0x1000), -1);
+
+  /* Match before the start of the output */
+  const uint8_t bad[] = { 0x10, 'A', 0x02, 0x00 };
+  assert_int_equal(lz_decompress(bad, sizeof(bad), out, 5), -1);
+  const uint8_t zero[] = { 0x10, 'A', 0x00, 0x00 };
+  assert_int_equal(lz_decompress(zero, sizeof(zero), out, 5), -1);
+
+  /* Overlapping match */
+  const uint8_t run[] = { 0x13, 'A', 0x01, 0x00, 0x00 };
+  assert_int_equal(lz_decompress(run, sizeof(run), out, 8), 0);
+  assert_memory_equal(out, "AAAAAAAA", 8);
+}
+
+static void
+write_backup(const char *path) {
+  const uint8_t *bufs[] = { code, data };
+  assert_int_equal(rbk_write(path, sig, sizeof(sig), areas, bufs, 2), 0);
+}
+
+static void
+test_rbk_roundtrip(void **state) {
+  (void)state;
+  const char *path = temp_path("dev.rbk");
+  uint8_t block[RBK_BLOCK_SIZE];
+  rbk_t rbk;
+
+  write_backup(path);
+
+  struct stat st;
+  assert_int_equal(stat(path, &st), 0);
+  assert_true(st.st_size < 0x1000 + 0x800);
+
+  assert_int_equal(rbk_open(path, &rbk), 0);
+  assert_int_equal(rbk.nr_areas, 2);
+  assert_int_equal(rbk.sig_len, sizeof(sig));
+  assert_memory_equal(rbk.sig, sig, sizeof(sig));
+
+  const uint8_t *src[] = { code, data };
+  for (uint32_t n = 0; n < rbk.nr_areas; n++) {
+    const rbk_area_t *a = &rbk.areas[n];
+    assert_int_equal(a->area.koa, areas[n].koa);
+    assert_int_equal(a->area.sad, areas[n].sad);
+    assert_int_equal(a->area.ead, areas[n].ead);
+    assert_int_equal(a->area.eau, areas[n].eau);
+    assert_int_equal(a->area.wau, areas[n].wau);
+    for (uint32_t i = 0; i < a->nr_blocks; i++) {
+      const uint8_t *want = src[n] + (size_t)i * RBK_BLOCK_SIZE;
+      uint32_t len = rbk_block_len(a, i);
+      assert_int_equal(rbk_block_crc(a, i), crc32_calc(want, len));
+      assert_int_equal(rbk_block_read(&rbk, a, i, block), 0);
+      assert_memory_equal(block, want, len);
+    }
+  }
+
+  /* Erased blocks are left out */
+  assert_int_equal(rbk.areas[0].nr_blocks, 8);
+  assert_false(rbk_block_blank(&rbk.areas[0], 0));
+  assert_false(rbk_block_blank(&rbk.areas[0], 2));
+  assert_true(rbk_block_blank(&rbk.areas[0], 3));
+  assert_int_equal(rbk.areas[1].nr_blocks, 2);
+  assert_true(rbk_block_blank(&rbk.areas[1], 0));
+  assert_int_equal(rbk_block_len(&rbk.areas[1], 1), 0x800);
+  rbk_close(&rbk);
+
+  /* Flat image, one extent per area */
+  parsed_file_t parsed;
+  assert_int_equal(format_detect(path), FORMAT_RBK);
+  assert_int_equal(format_parse(path, FORMAT_AUTO, &parsed), 0);
+  assert_int_equal(parsed.base_addr, 0);
+  assert_int_equal(parsed.size, DATA_ADDR + DATA_SIZE);
+  assert_memory_equal(parsed.data, code, sizeof(code));
+  assert_memory_equal(parsed.data + DATA_ADDR, data, sizeof(data));
+  assert_int_equal(parsed.nr_extents, 2);
+  assert_int_equal(parsed.extents[1].addr, DATA_ADDR);
+  assert_int_equal(parsed.extents[1].size, DATA_SIZE);
+  free(parsed.data);
+}
+
+static void
+test_rbk_corrupted(void **state) {
+  (void)state;
+  const char *path = temp_path("bad.rbk");
+  static uint8_t buf[0x4000];
+  uint8_t block[RBK_BLOCK_SIZE];
+  rbk_t rbk;
+
+  write_backup(path);
+  FILE *f = fopen(path, "rb");
+  assert_non_null(f);
+  size_t len = fread(buf, 1, sizeof(buf), f);
+  fclose(f);
+
+  /* Last byte of the data flash block: open works, that block does not decode */
+  buf[len - 1] ^= 0x01;
+  f = fopen(path, "wb");
+  assert_non_null(f);
+  fwrite(buf, 1, len, f);
+  fclose(f);
+  assert_int_equal(rbk_open(path, &rbk), 0);
+  assert_int_equal(rbk_block_read(&rbk, &rbk.areas[0], 0, block), 0);
+  assert_int_equal(rbk_block_read(&rbk, &rbk.areas[1], 1, block), -1);
+  rbk_close(&rbk);
+  buf[len - 1] ^= 0x01;
+
+  /* Block index */
+  buf[RBK_HEADER_LEN + 2 * RBK_AREA_LEN + 8] ^= 0x01;
+  f = fopen(path, "wb");
+  assert_non_null(f);
+  fwrite(buf, 1, len, f);
+  fclose(f);
+  assert_int_equal(rbk_open(path, &rbk), -1);
+  buf[RBK_HEADER_LEN + 2 * RBK_AREA_LEN + 8] ^= 0x01;
+
+  /* Truncated */
+  f = fopen(path, "wb");
+  assert_non_null(f);
+  fwrite(buf, 1, len - 1, f);
+  fclose(f);
+  assert_int_equal(rbk_open(path, &rbk), -1);
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_lz_roundtrip),
+    cmocka_unit_test(test_lz_malformed),
+    cmocka_unit_test(test_rbk_roundtrip),
+    cmocka_unit_test(test_rbk_corrupted),
+  };
+
+  return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for the pre-compiled image container
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/compat.h"
+#include "../src/crc32.h"
+#include "../src/rapacker.h"
+#include "../src/rfi.h"
+
+#define IMG_BASE 0x10000
+#define IMG_SIZE (0x9000 - 0x10) /* last block only partly in the file */
+
+static char temp_dir[256];
+static uint8_t image[IMG_SIZE];
+
+static const char *
+temp_path(const char *name) {
+  static char path[2][512];
+  static int slot;
+  slot ^= 1;
+  snprintf(path[slot], sizeof(path[slot]), "%s%c%s", temp_dir, path_separator(), name);
+  return path[slot];
+}
+
+static void
+write_file(const char *path, const uint8_t *data, size_t len) {
+  FILE *f = fopen(path, "wb");
+  assert_non_null(f);
+  assert_int_equal(fwrite(data, 1, len, f), len);
+  fclose(f);
+}
+
+static int
+setup(void **state) {
+  (void)state;
+  snprintf(temp_dir, sizeof(temp_dir), "%s%ctest_rfi.XXXXXX", get_temp_dir(), path_separator());
+  if (mkdtemp(temp_dir) == NULL)
+    return -1;
+
+  /* Data, an erased hole, then data running across a 32KB boundary */
+  for (size_t i = 0; i < sizeof(image); i++)
+    image[i] = (uint8_t)(i * 7 + 1);
+  memset(image + 0x2000, 0xFF, 0x3000);
+  return 0;
+}
+
+static int
+teardown(void **state) {
+  (void)state;
+  char cmd[512];
+#ifdef _WIN32
+  snprintf(cmd, sizeof(cmd), "rmdir /s /q \"%s\"", temp_dir);
+#else
+  snprintf(cmd, sizeof(cmd), "rm -rf '%s'", temp_dir);
+#endif
+  return system(cmd);
+}
+
+/* Expected content of [start, end], 0xFF past the file */
+static void
+expected(uint32_t start, uint32_t end, uint8_t *out) {
+  for (uint32_t a = start; a <= end; a++)
+    out[a - start] = a - IMG_BASE < IMG_SIZE ? image[a - IMG_BASE] : 0xFF;
+}
+
+static void
+test_compile_open(void **state) {
+  (void)state;
+  const char *bin = temp_path("fw.bin");
+  const char *out = temp_path("fw.rfi");
+  static uint8_t want[RFI_SPLIT];
+  uint8_t pkt[MAX_PKT_LEN];
+  rfi_t rfi;
+
+  write_file(bin, image, sizeof(image));
+  assert_int_equal(rfi_compile(bin, FORMAT_AUTO, IMG_BASE, out), 0);
+  assert_int_equal(rfi_open(out, &rfi), 0);
+
+  static const uint32_t ranges[][2] = {
+    { 0x10000, 0x11FFF },
+    { 0x15000, 0x17FFF },
+    { 0x18000, 0x18FFF },
+  };
+  assert_int_equal(rfi.nr_extents, 3);
+  assert_int_equal(rfi.payload, 0x2000 + 0x3000 + 0x1000);
+
+  for (uint32_t e = 0; e < rfi.nr_extents; e++) {
+    const rfi_extent_t *ext = &rfi.extents[e];
+    assert_int_equal(ext->start, ranges[e][0]);
+    assert_int_equal(ext->end, ranges[e][1]);
+
+    uint32_t len = ext->end - ext->start + 1;
+    expected(ext->start, ext->end, want);
+    assert_int_equal(ext->crc, crc32_calc(want, len));
+    assert_int_equal(ext->nr_chunks, len / RFI_CHUNK);
+
+    /* Stream starts with the write command for the whole extent */
+    uint8_t cmd[8] = {
+      (uint8_t)(ext->start >> 24), (uint8_t)(ext->start >> 16), (uint8_t)(ext->start >> 8),
+      (uint8_t)ext->start,         (uint8_t)(ext->end >> 24),   (uint8_t)(ext->end >> 16),
+      (uint8_t)(ext->end >> 8),    (uint8_t)ext->end,
+    };
+    assert_int_equal(ra_pack_pkt(pkt, sizeof(pkt), WRI_CMD, cmd, 8, false), RFI_CMD_PKT_LEN);
+    assert_memory_equal(ext->stream, pkt, RFI_CMD_PKT_LEN);
+
+    /* Then ready-to-send data packets */
+    for (uint32_t i = 0; i < ext->nr_chunks; i++) {
+      size_t plen;
+      const uint8_t *p = rfi_data_packet(ext, i, &plen);
+      ssize_t n = ra_pack_pkt(pkt, sizeof(pkt), WRI_CMD, want + i * RFI_CHUNK, RFI_CHUNK, true);
+      assert_int_equal(plen, n);
+      assert_memory_equal(p, pkt, plen);
+      assert_int_equal(rfi_chunk_crc(ext, i), crc32_calc(want + i * RFI_CHUNK, RFI_CHUNK));
+    }
+  }
+
+  rfi_close(&rfi);
+}
+
+static void
+test_parse_roundtrip(void **state) {
+  (void)state;
+  const char *bin = temp_path("rt.bin");
+  const char *out = temp_path("rt.rfi");
+  parsed_file_t parsed;
+
+  write_file(bin, image, sizeof(image));
+  assert_int_equal(rfi_compile(bin, FORMAT_BIN, IMG_BASE, out), 0);
+
+  assert_int_equal(format_detect(out), FORMAT_RFI);
+  assert_int_equal(format_parse(out, FORMAT_AUTO, &parsed), 0);
+  assert_true(parsed.has_addr);
+  assert_int_equal(parsed.base_addr, IMG_BASE);
+  assert_int_equal(parsed.size, 0x9000);
+  assert_memory_equal(parsed.data, image, sizeof(image));
+  for (size_t i = sizeof(image); i < parsed.size; i++)
+    assert_int_equal(parsed.data[i], 0xFF);
+  free(parsed.data);
+
+  /* Same content, same identity, whatever the source format */
+  rfi_t a, b;
+  const char *hex = temp_path("rt.hex");
+  const char *out2 = temp_path("rt2.rfi");
+  assert_int_equal(format_write(hex, FORMAT_IHEX, image, sizeof(image), IMG_BASE), 0);
+  assert_int_equal(rfi_compile(hex, FORMAT_AUTO, 0, out2), 0);
+  out = temp_path("rt.rfi");
+  assert_int_equal(rfi_open(out, &a), 0);
+  assert_int_equal(rfi_open(out2, &b), 0);
+  assert_memory_equal(a.sha256, b.sha256, SHA256_LEN);
+  rfi_close(&a);
+  rfi_close(&b);
+}
+
+static void
+test_corrupted(void **state) {
+  (void)state;
+  const char *bin = temp_path("bad.bin");
+  const char *out = temp_path("bad.rfi");
+  rfi_t rfi;
+
+  write_file(bin, image, 0x1000);
+  assert_int_equal(rfi_compile(bin, FORMAT_BIN, IMG_BASE, out), 0);
+
+  FILE *f = fopen(out, "rb");
+  assert_non_null(f);
+  static uint8_t buf[0x2000];
+  size_t len = fread(buf, 1, sizeof(buf), f);
+  fclose(f);
+
+  /* One payload byte flipped: the chunk CRC catches it */
+  buf[len - PKT_TRL_LEN - 10] ^= 0x01;
+  write_file(out, buf, len);
+  assert_int_equal(rfi_open(out, &rfi), -1);
+  buf[len - PKT_TRL_LEN - 10] ^= 0x01;
+
+  /* Packet checksum, data packet length, command address and digest */
+  write_file(out, buf, len);
+  assert_int_equal(rfi_open(out, &rfi), 0);
+  size_t stream_off = (size_t)(rfi.extents[0].stream - (const uint8_t *)rfi.map);
+  rfi_close(&rfi);
+  size_t where[] = {
+    len - PKT_TRL_LEN,
+    stream_off + RFI_CMD_PKT_LEN + 1,
+    stream_off + 4,
+    32,
+  };
+  for (size_t i = 0; i < sizeof(where) / sizeof(where[0]); i++) {
+    buf[where[i]] ^= 0x01;
+    write_file(out, buf, len);
+    assert_int_equal(rfi_open(out, &rfi), -1);
+    buf[where[i]] ^= 0x01;
+  }
+
+  /* Truncated */
+  write_file(out, buf, len - 1);
+  assert_int_equal(rfi_open(out, &rfi), -1);
+
+  /* Bad magic */
+  buf[0] = 'X';
+  write_file(out, buf, len);
+  assert_int_equal(rfi_open(out, &rfi), -1);
+}
+
+static void
+test_blank_image(void **state) {
+  (void)state;
+  const char *bin = temp_path("blank.bin");
+  uint8_t blank[0x800];
+
+  memset(blank, 0xFF, sizeof(blank));
+  write_file(bin, blank, sizeof(blank));
+  assert_int_equal(rfi_compile(bin, FORMAT_BIN, IMG_BASE, temp_path("blank.rfi")), -1);
+
+  /* Containers are not recompiled */
+  assert_int_equal(rfi_compile(temp_path("fw.rfi"), FORMAT_AUTO, 0, temp_path("x.rfi")), -1);
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_compile_open),
+    cmocka_unit_test(test_parse_roundtrip),
+    cmocka_unit_test(test_corrupted),
+    cmocka_unit_test(test_blank_image),
+  };
+
+  return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) Vincent Jardin <vjardin@free.fr> Free Mobile 2025
+ *
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Unit tests for the in-tree SHA-256
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "../src/sha256.h"
+
+static void
+check(const void *data, size_t len, const char *expected) {
+  uint8_t digest[SHA256_LEN];
+  char hex[2 * SHA256_LEN + 1];
+
+  sha256(data, len, digest);
+  sha256_hex(digest, hex);
+  assert_string_equal(hex, expected);
+}
+
+static void
+test_fips_vectors(void **state) {
+  (void)state;
+
+  check("", 0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+  check("abc", 3, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  check("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+      56,
+      "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+static void
+test_incremental(void **state) {
+  (void)state;
+
+  static uint8_t buf[1000000];
+  uint8_t one[SHA256_LEN], split[SHA256_LEN];
+  char hex[2 * SHA256_LEN + 1];
+
+  memset(buf, 'a', sizeof(buf));
+  sha256(buf, sizeof(buf), one);
+  sha256_hex(one, hex);
+  assert_string_equal(hex, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+  /* Odd-sized pieces straddle the 64-byte block boundary */
+  sha256_ctx_t ctx;
+  sha256_init(&ctx);
+  for (size_t off = 0, step = 1; off < sizeof(buf); off += step, step = step % 97 + 13) {
+    size_t n = off + step > sizeof(buf) ? sizeof(buf) - off : step;
+    sha256_update(&ctx, buf + off, n);
+  }
+  sha256_final(&ctx, split);
+  assert_memory_equal(one, split, SHA256_LEN);
+}
+
+int
+main(void) {
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_fips_vectors),
+    cmocka_unit_test(test_incremental),
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}